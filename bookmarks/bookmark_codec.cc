@@ -33,6 +33,7 @@ const char* BookmarkCodec::kDateModifiedKey = "date_modified";
 const char* BookmarkCodec::kChildrenKey = "children";
 const char* BookmarkCodec::kMetaInfo = "meta_info";
 const char* BookmarkCodec::kSyncTransactionVersion = "sync_transaction_version";
+const char* BookmarkCodec::kJournalSequenceKey = "journal_sequence";
 const char* BookmarkCodec::kTypeURL = "url";
 const char* BookmarkCodec::kTypeFolder = "folder";
 
@@ -99,6 +99,9 @@ class BookmarkCodec {
   static const char* kChildrenKey;
   static const char* kMetaInfo;
   static const char* kSyncTransactionVersion;
+  // Written by BookmarkStorage: the sequence number of the last save to the
+  // journal file which the JSON file includes. See BookmarkJournal.
+  static const char* kJournalSequenceKey;
 
   // Possible values for kTypeKey.
   static const char* kTypeURL;
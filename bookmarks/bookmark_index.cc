@@ -6,9 +6,9 @@
 
 #include <algorithm>
 #include <iterator>
-#include <list>
 
 #include "base/i18n/case_conversion.h"
+#include "base/logging.h"
 #include "base/strings/string16.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 #include "chrome/browser/bookmarks/bookmark_title_match.h"
@@ -17,39 +17,29 @@
 #include "chrome/browser/history/query_parser.h"
 #include "chrome/browser/history/url_database.h"
 
-// Used when finding the set of bookmarks that match a query. Each match
-// represents a set of terms (as an interator into the Index) matching the
-// query as well as the set of nodes that contain those terms in their titles.
-struct BookmarkIndex::Match {
-  // List of terms matching the query.
-  std::list<Index::const_iterator> terms;
-
-  // The set of nodes matching the terms. As an optimization this is empty
-  // when we match only one term, and is filled in when we get more than one
-  // term. We can do this as when we have only one matching term we know
-  // the set of matching nodes is terms.front()->second.
-  //
-  // Use nodes_begin() and nodes_end() to get an iterator over the set as
-  // it handles the necessary switching between nodes and terms.front().
-  NodeSet nodes;
-
-  // Returns an iterator to the beginning of the matching nodes. See
-  // description of nodes for why this should be used over nodes.begin().
-  NodeSet::const_iterator nodes_begin() const;
-
-  // Returns an iterator to the beginning of the matching nodes. See
-  // description of nodes for why this should be used over nodes.end().
-  NodeSet::const_iterator nodes_end() const;
-};
-
-BookmarkIndex::NodeSet::const_iterator
-    BookmarkIndex::Match::nodes_begin() const {
-  return nodes.empty() ? terms.front()->second.begin() : nodes.begin();
+namespace {
+
+// The length of the prefixes for which BookmarkIndex keeps the merged nodes
+// of all terms. This is the shortest term QueryParser prefix matches, except
+// for Hangul.
+const size_t kPrefixLength = 3;
+
+// Returns the memory used by |index| beyond its own size.
+template <typename Index>
+size_t EstimateIndexMemoryUsage(const Index& index) {
+  // The map node holds three pointers and a color next to the pair.
+  const size_t kMapNodeOverhead = 4 * sizeof(void*);
+  size_t bytes = 0;
+  for (typename Index::const_iterator i = index.begin(); i != index.end();
+       ++i) {
+    bytes += kMapNodeOverhead + sizeof(*i) +
+        i->first.capacity() * sizeof(base::char16) +
+        i->second.capacity() * sizeof(i->second[0]);
+  }
+  return bytes;
 }
 
-BookmarkIndex::NodeSet::const_iterator BookmarkIndex::Match::nodes_end() const {
-  return nodes.empty() ? terms.front()->second.end() : nodes.end();
-}
+}  // namespace
 
 BookmarkIndex::BookmarkIndex(content::BrowserContext* browser_context)
     : browser_context_(browser_context) {
@@ -61,16 +51,25 @@ BookmarkIndex::~BookmarkIndex() {
 void BookmarkIndex::Add(const BookmarkNode* node) {
   if (!node->is_url())
     return;
-  std::vector<base::string16> terms = ExtractQueryWords(node->GetTitle());
-  for (size_t i = 0; i < terms.size(); ++i)
-    RegisterNode(terms[i], node);
+  AddURLNode(node, node->GetTitle());
 }
 
 void BookmarkIndex::Remove(const BookmarkNode* node) {
   if (!node->is_url())
     return;
+  RemoveURLNode(node, node->GetTitle());
+}
+
+void BookmarkIndex::AddURLNode(const BookmarkNode* node,
+                               const base::string16& title) {
+  std::vector<base::string16> terms = ExtractQueryWords(title);
+  for (size_t i = 0; i < terms.size(); ++i)
+    RegisterNode(terms[i], node);
+}
 
-  std::vector<base::string16> terms = ExtractQueryWords(node->GetTitle());
+void BookmarkIndex::RemoveURLNode(const BookmarkNode* node,
+                                  const base::string16& title) {
+  std::vector<base::string16> terms = ExtractQueryWords(title);
   for (size_t i = 0; i < terms.size(); ++i)
     UnregisterNode(terms[i], node);
 }
@@ -83,7 +82,7 @@ void BookmarkIndex::GetBookmarksWithTitlesMatching(
   if (terms.empty())
     return;
 
-  Matches matches;
+  NodeVector matches;
   for (size_t i = 0; i < terms.size(); ++i) {
     if (!GetBookmarksWithTitleMatchingTerm(terms[i], i == 0, &matches))
       return;
@@ -109,7 +108,12 @@ void BookmarkIndex::GetBookmarksWithTitlesMatching(
     AddMatchToResults(i->first, &parser, query_nodes.get(), results);
 }
 
-void BookmarkIndex::SortMatches(const Matches& matches,
+size_t BookmarkIndex::EstimateMemoryUsage() const {
+  return sizeof(*this) + EstimateIndexMemoryUsage(index_) +
+      EstimateIndexMemoryUsage(prefix_index_);
+}
+
+void BookmarkIndex::SortMatches(const NodeVector& matches,
                                 NodeTypedCountPairs* node_typed_counts) const {
   HistoryService* const history_service = browser_context_ ?
       HistoryServiceFactory::GetForProfile(
@@ -119,30 +123,17 @@ void BookmarkIndex::SortMatches(const Matches& matches,
   history::URLDatabase* url_db = history_service ?
       history_service->InMemoryDatabase() : NULL;
 
-  for (Matches::const_iterator i = matches.begin(); i != matches.end(); ++i)
-    ExtractBookmarkNodePairs(url_db, *i, node_typed_counts);
-
-  std::sort(node_typed_counts->begin(), node_typed_counts->end(),
-            &NodeTypedCountPairSortFunc);
-  // Eliminate duplicates.
-  node_typed_counts->erase(std::unique(node_typed_counts->begin(),
-                                       node_typed_counts->end()),
-                           node_typed_counts->end());
-}
-
-void BookmarkIndex::ExtractBookmarkNodePairs(
-    history::URLDatabase* url_db,
-    const Match& match,
-    NodeTypedCountPairs* node_typed_counts) const {
-
-  for (NodeSet::const_iterator i = match.nodes_begin();
-       i != match.nodes_end(); ++i) {
+  node_typed_counts->reserve(matches.size());
+  for (NodeVector::const_iterator i = matches.begin(); i != matches.end();
+       ++i) {
     history::URLRow url;
     if (url_db)
       url_db->GetRowForURL((*i)->url(), &url);
-    NodeTypedCountPair pair(*i, url.typed_count());
-    node_typed_counts->push_back(pair);
+    node_typed_counts->push_back(NodeTypedCountPair(*i, url.typed_count()));
   }
+
+  std::sort(node_typed_counts->begin(), node_typed_counts->end(),
+            &NodeTypedCountPairSortFunc);
 }
 
 void BookmarkIndex::AddMatchToResults(
@@ -165,84 +156,49 @@ void BookmarkIndex::AddMatchToResults(
 
 bool BookmarkIndex::GetBookmarksWithTitleMatchingTerm(const base::string16& term,
                                                       bool first_term,
-                                                      Matches* matches) {
-  Index::const_iterator i = index_.lower_bound(term);
-  if (i == index_.end())
-    return false;
-
+                                                      NodeVector* matches) {
+  NodeVector prefix_nodes;
+  const NodeVector* term_nodes = &prefix_nodes;
   if (!QueryParser::IsWordLongEnoughForPrefixSearch(term)) {
     // Term is too short for prefix match, compare using exact match.
-    if (i->first != term)
+    Index::const_iterator i = index_.find(term);
+    if (i == index_.end())
       return false;  // No bookmarks with this term.
-
-    if (first_term) {
-      Match match;
-      match.terms.push_back(i);
-      matches->push_back(match);
-      return true;
-    }
-    CombineMatchesInPlace(i, matches);
-  } else if (first_term) {
-    // This is the first term and we're doing a prefix match. Loop through
-    // index adding all entries that start with term to matches.
-    while (i != index_.end() &&
-           i->first.size() >= term.size() &&
-           term.compare(0, term.size(), i->first, 0, term.size()) == 0) {
-      Match match;
-      match.terms.push_back(i);
-      matches->push_back(match);
-      ++i;
-    }
+    term_nodes = &i->second;
   } else {
-    // Prefix match and not the first term. Loop through index combining
-    // current matches in matches with term, placing result in result.
-    Matches result;
-    while (i != index_.end() &&
-           i->first.size() >= term.size() &&
-           term.compare(0, term.size(), i->first, 0, term.size()) == 0) {
-      CombineMatches(i, *matches, &result);
-      ++i;
-    }
-    matches->swap(result);
+    GetBookmarksWithTitlePrefix(term, &prefix_nodes);
   }
-  return !matches->empty();
-}
 
-void BookmarkIndex::CombineMatchesInPlace(const Index::const_iterator& index_i,
-                                          Matches* matches) {
-  for (size_t i = 0; i < matches->size(); ) {
-    Match* match = &((*matches)[i]);
-    NodeSet intersection;
-    std::set_intersection(match->nodes_begin(), match->nodes_end(),
-                          index_i->second.begin(), index_i->second.end(),
-                          std::inserter(intersection, intersection.begin()));
-    if (intersection.empty()) {
-      matches->erase(matches->begin() + i);
-    } else {
-      match->terms.push_back(index_i);
-      match->nodes.swap(intersection);
-      ++i;
-    }
+  if (first_term) {
+    matches->assign(term_nodes->begin(), term_nodes->end());
+  } else {
+    NodeVector intersection;
+    std::set_intersection(matches->begin(), matches->end(),
+                          term_nodes->begin(), term_nodes->end(),
+                          std::back_inserter(intersection));
+    matches->swap(intersection);
   }
+  return !matches->empty();
 }
 
-void BookmarkIndex::CombineMatches(const Index::const_iterator& index_i,
-                                   const Matches& current_matches,
-                                   Matches* result) {
-  for (size_t i = 0; i < current_matches.size(); ++i) {
-    const Match& match = current_matches[i];
-    NodeSet intersection;
-    std::set_intersection(match.nodes_begin(), match.nodes_end(),
-                          index_i->second.begin(), index_i->second.end(),
-                          std::inserter(intersection, intersection.begin()));
-    if (!intersection.empty()) {
-      result->push_back(Match());
-      Match& combined_match = result->back();
-      combined_match.terms = match.terms;
-      combined_match.terms.push_back(index_i);
-      combined_match.nodes.swap(intersection);
+void BookmarkIndex::GetBookmarksWithTitlePrefix(const base::string16& prefix,
+                                                NodeVector* nodes) const {
+  nodes->clear();
+  if (prefix.size() == kPrefixLength) {
+    Index::const_iterator i = prefix_index_.find(prefix);
+    if (i != prefix_index_.end())
+      nodes->assign(i->second.begin(), i->second.end());
+  } else {
+    for (Index::const_iterator i = index_.lower_bound(prefix);
+         i != index_.end() && i->first.size() >= prefix.size() &&
+         prefix.compare(0, prefix.size(), i->first, 0, prefix.size()) == 0;
+         ++i) {
+      nodes->insert(nodes->end(), i->second.begin(), i->second.end());
     }
+    std::sort(nodes->begin(), nodes->end());
   }
+  // A node is listed once for each of its terms with the prefix.
+  nodes->erase(std::unique(nodes->begin(), nodes->end()), nodes->end());
 }
 
 std::vector<base::string16> BookmarkIndex::ExtractQueryWords(
@@ -259,7 +215,18 @@ std::vector<base::string16> BookmarkIndex::ExtractQueryWords(
 
 void BookmarkIndex::RegisterNode(const base::string16& term,
                                  const BookmarkNode* node) {
-  index_[term].insert(node);
+  NodeVector& nodes = index_[term];
+  NodeVector::iterator i = std::lower_bound(nodes.begin(), nodes.end(), node);
+  if (i != nodes.end() && *i == node)
+    return;  // The node has the same term more than once.
+  nodes.insert(i, node);
+
+  if (term.size() >= kPrefixLength) {
+    NodeVector& prefix_nodes = prefix_index_[term.substr(0, kPrefixLength)];
+    prefix_nodes.insert(
+        std::upper_bound(prefix_nodes.begin(), prefix_nodes.end(), node),
+        node);
+  }
 }
 
 void BookmarkIndex::UnregisterNode(const base::string16& term,
@@ -270,7 +237,22 @@ void BookmarkIndex::UnregisterNode(const base::string16& term,
     // example, a bookmark with the title 'foo foo' would end up here.
     return;
   }
-  i->second.erase(node);
+  NodeVector::iterator node_i =
+      std::lower_bound(i->second.begin(), i->second.end(), node);
+  if (node_i == i->second.end() || *node_i != node)
+    return;
+  i->second.erase(node_i);
   if (i->second.empty())
     index_.erase(i);
+
+  if (term.size() >= kPrefixLength) {
+    Index::iterator prefix_i =
+        prefix_index_.find(term.substr(0, kPrefixLength));
+    DCHECK(prefix_i != prefix_index_.end());
+    NodeVector& prefix_nodes = prefix_i->second;
+    prefix_nodes.erase(
+        std::lower_bound(prefix_nodes.begin(), prefix_nodes.end(), node));
+    if (prefix_nodes.empty())
+      prefix_index_.erase(prefix_i);
+  }
 }
@@ -6,7 +6,6 @@
 #define CHROME_BROWSER_BOOKMARKS_BOOKMARK_INDEX_H_
 
 #include <map>
-#include <set>
 #include <vector>
 
 #include "base/basictypes.h"
@@ -29,9 +28,15 @@ class URLDatabase;
 // look up. BookmarkIndex is owned and maintained by BookmarkModel, you
 // shouldn't need to interact directly with BookmarkIndex.
 //
-// BookmarkIndex maintains the index (index_) as a map of sets. The map (type
-// Index) maps from a lower case string to the set (type NodeSet) of
-// BookmarkNodes that contain that string in their title.
+// BookmarkIndex maintains the index (index_) as a map of postings. The map
+// (type Index) maps from a lower case string to the nodes (type NodeVector)
+// that contain that string in their title, kept sorted so that the postings
+// of several terms can be merged and intersected in a single pass.
+//
+// Prefix matching a term scans every term with that prefix. As the shortest
+// prefixes, typed first, have the most terms, the nodes of all terms sharing
+// their first kPrefixLength characters are also kept merged in
+// |prefix_index_|.
 class BookmarkIndex {
  public:
   explicit BookmarkIndex(content::BrowserContext* browser_context);
@@ -43,37 +48,36 @@ class BookmarkIndex {
   // Invoked when a bookmark has been removed from the model.
   void Remove(const BookmarkNode* node);
 
+  // Same as Add() and Remove() for a URL node titled |title|, but without
+  // reading |node|, so that the index can be built on another thread than the
+  // one changing the nodes. See BookmarkIndexBuilder.
+  void AddURLNode(const BookmarkNode* node, const base::string16& title);
+  void RemoveURLNode(const BookmarkNode* node, const base::string16& title);
+
   // Returns up to |max_count| of bookmarks containing the text |query|.
   void GetBookmarksWithTitlesMatching(
       const base::string16& query,
       size_t max_count,
       std::vector<BookmarkTitleMatch>* results);
 
- private:
-  typedef std::set<const BookmarkNode*> NodeSet;
-  typedef std::map<base::string16, NodeSet> Index;
+  // Returns an estimate of the memory used by the index, in bytes.
+  size_t EstimateMemoryUsage() const;
 
-  struct Match;
-  typedef std::vector<Match> Matches;
+ private:
+  typedef std::vector<const BookmarkNode*> NodeVector;
+  typedef std::map<base::string16, NodeVector> Index;
 
   // Pairs BookmarkNodes and the number of times the nodes' URLs were typed.
-  // Used to sort Matches in decreasing order of typed count.
+  // Used to sort matches in decreasing order of typed count.
   typedef std::pair<const BookmarkNode*, int> NodeTypedCountPair;
   typedef std::vector<NodeTypedCountPair> NodeTypedCountPairs;
 
-  // Extracts |matches.nodes| into NodeTypedCountPairs, sorts the pairs in
-  // decreasing order of typed count, and then de-dupes the matches.
-  void SortMatches(const Matches& matches,
+  // Retrieves typed counts for each of |matches| from the in-memory database
+  // and puts the pairs in |node_typed_counts|, in decreasing order of typed
+  // count.
+  void SortMatches(const NodeVector& matches,
                    NodeTypedCountPairs* node_typed_counts) const;
 
-  // Extracts BookmarkNodes from |match| and retrieves typed counts for each
-  // node from the in-memory database. Inserts pairs containing the node and
-  // typed count into the vector |node_typed_counts|. |node_typed_counts| is
-  // sorted in decreasing order of typed count.
-  void ExtractBookmarkNodePairs(history::URLDatabase* url_db,
-                                const Match& match,
-                                NodeTypedCountPairs* node_typed_counts) const;
-
   // Sort function for NodeTypedCountPairs. We sort in decreasing order of typed
   // count so that the best matches will always be added to the results.
   static bool NodeTypedCountPairSortFunc(const NodeTypedCountPair& a,
@@ -87,33 +91,17 @@ class BookmarkIndex {
                          const std::vector<QueryNode*>& query_nodes,
                          std::vector<BookmarkTitleMatch>* results);
 
-  // Populates |matches| for the specified term. If |first_term| is true, this
-  // is the first term in the query. Returns true if there is at least one node
-  // matching the term.
+  // Narrows |matches| to the nodes matching the specified term. If
+  // |first_term| is true, this is the first term in the query and |matches|
+  // is set to the nodes matching it. Returns true if there is at least one
+  // node matching all terms so far.
   bool GetBookmarksWithTitleMatchingTerm(const base::string16& term,
                                          bool first_term,
-                                         Matches* matches);
-
-  // Iterates over |matches| updating each Match's nodes to contain the
-  // intersection of the Match's current nodes and the nodes at |index_i|.
-  // If the intersection is empty, the Match is removed.
-  //
-  // This is invoked from GetBookmarksWithTitleMatchingTerm.
-  void CombineMatchesInPlace(const Index::const_iterator& index_i,
-                             Matches* matches);
-
-  // Iterates over |current_matches| calculating the intersection between the
-  // Match's nodes and the nodes at |index_i|. If the intersection between the
-  // two is non-empty, a new match is added to |result|.
-  //
-  // This differs from CombineMatchesInPlace in that if the intersection is
-  // non-empty the result is added to result, not combined in place. This
-  // variant is used for prefix matching.
-  //
-  // This is invoked from GetBookmarksWithTitleMatchingTerm.
-  void CombineMatches(const Index::const_iterator& index_i,
-                      const Matches& current_matches,
-                      Matches* result);
+                                         NodeVector* matches);
+
+  // Sets |nodes| to the sorted nodes with a term starting with |prefix|.
+  void GetBookmarksWithTitlePrefix(const base::string16& prefix,
+                                   NodeVector* nodes) const;
 
   // Returns the set of query words from |query|.
   std::vector<base::string16> ExtractQueryWords(const base::string16& query);
@@ -126,6 +114,11 @@ class BookmarkIndex {
 
   Index index_;
 
+  // Maps the first kPrefixLength characters of the terms in |index_| to the
+  // nodes of all those terms. A node is listed once for each of its terms
+  // with the prefix.
+  Index prefix_index_;
+
   content::BrowserContext* browser_context_;
 
   DISALLOW_COPY_AND_ASSIGN(BookmarkIndex);
@@ -0,0 +1,89 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/bookmarks/bookmark_index_builder.h"
+
+#include "base/logging.h"
+#include "base/metrics/histogram.h"
+#include "base/threading/thread_restrictions.h"
+#include "base/time/time.h"
+#include "chrome/browser/bookmarks/bookmark_index.h"
+#include "chrome/browser/bookmarks/bookmark_model.h"
+
+BookmarkIndexBuilder::Change::Change(bool add,
+                                     const BookmarkNode* node,
+                                     const base::string16& title)
+    : add(add),
+      node_title(node, title) {
+}
+
+BookmarkIndexBuilder::Change::~Change() {}
+
+BookmarkIndexBuilder::BookmarkIndexBuilder(BookmarkIndex* index)
+    : index_(index),
+      built_(true, false) {
+}
+
+BookmarkIndexBuilder::~BookmarkIndexBuilder() {}
+
+void BookmarkIndexBuilder::AddNodes(const BookmarkNode* node) {
+  if (node->is_url()) {
+    if (node->url().is_valid())
+      node_titles_.push_back(NodeTitle(node, node->GetTitle()));
+  } else {
+    for (int i = 0; i < node->child_count(); ++i)
+      AddNodes(node->GetChild(i));
+  }
+}
+
+void BookmarkIndexBuilder::Build() {
+  DCHECK(!built_.IsSignaled());
+  base::TimeTicks start_time = base::TimeTicks::Now();
+  for (size_t i = 0; i < node_titles_.size(); ++i)
+    index_->AddURLNode(node_titles_[i].first, node_titles_[i].second);
+  std::vector<NodeTitle>().swap(node_titles_);
+  UMA_HISTOGRAM_TIMES("Bookmarks.CreateBookmarkIndexTime",
+                      base::TimeTicks::Now() - start_time);
+  built_.Signal();
+}
+
+bool BookmarkIndexBuilder::IsBuilt() {
+  return built_.IsSignaled();
+}
+
+void BookmarkIndexBuilder::WaitUntilBuilt() {
+  if (built_.IsSignaled())
+    return;
+  // Building the index takes much less than loading the bookmarks, which has
+  // finished by now, so this wait is short.
+  base::ThreadRestrictions::ScopedAllowWait allow_wait;
+  base::TimeTicks start_time = base::TimeTicks::Now();
+  built_.Wait();
+  UMA_HISTOGRAM_TIMES("Bookmarks.WaitForBookmarkIndexTime",
+                      base::TimeTicks::Now() - start_time);
+}
+
+void BookmarkIndexBuilder::Add(const BookmarkNode* node) {
+  if (node->is_url())
+    changes_.push_back(Change(true, node, node->GetTitle()));
+}
+
+void BookmarkIndexBuilder::Remove(const BookmarkNode* node) {
+  if (node->is_url())
+    changes_.push_back(Change(false, node, node->GetTitle()));
+}
+
+BookmarkIndex* BookmarkIndexBuilder::TakeIndex() {
+  DCHECK(index_.get());
+  DCHECK(built_.IsSignaled());
+  for (size_t i = 0; i < changes_.size(); ++i) {
+    const NodeTitle& node_title = changes_[i].node_title;
+    if (changes_[i].add)
+      index_->AddURLNode(node_title.first, node_title.second);
+    else
+      index_->RemoveURLNode(node_title.first, node_title.second);
+  }
+  std::vector<Change>().swap(changes_);
+  return index_.release();
+}
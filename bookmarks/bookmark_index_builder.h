@@ -0,0 +1,91 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_BOOKMARKS_BOOKMARK_INDEX_BUILDER_H_
+#define CHROME_BROWSER_BOOKMARKS_BOOKMARK_INDEX_BUILDER_H_
+
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string16.h"
+#include "base/synchronization/waitable_event.h"
+
+class BookmarkIndex;
+class BookmarkNode;
+
+// BookmarkIndexBuilder builds the BookmarkIndex of the bookmarks loaded by
+// BookmarkStorage on the background thread, after the bookmarks have been
+// handed to BookmarkModel. This way the model can be used as soon as the
+// bookmarks are decoded rather than once they are also indexed.
+//
+// The titles of the nodes are copied before the nodes are handed to the
+// model, so that building the index never reads nodes the model may be
+// changing. The model records the nodes it adds and removes until the index
+// is built, and the builder applies those changes when the model takes the
+// index.
+class BookmarkIndexBuilder
+    : public base::RefCountedThreadSafe<BookmarkIndexBuilder> {
+ public:
+  // Takes ownership of |index|.
+  explicit BookmarkIndexBuilder(BookmarkIndex* index);
+
+  // Copies the titles of the URL nodes in the subtree of |node|. Must be
+  // called before the nodes are handed to the model.
+  void AddNodes(const BookmarkNode* node);
+
+  // Adds the copied titles to the index. Called once, on the background
+  // thread, after the nodes were handed to the model.
+  void Build();
+
+  // Returns true once Build() has finished.
+  bool IsBuilt();
+
+  // Blocks until Build() has finished. Called on the model's thread when the
+  // index is queried before the model has been told it is built.
+  void WaitUntilBuilt();
+
+  // Records that |node| was added to or removed from the model before the
+  // index was taken. Called on the model's thread.
+  void Add(const BookmarkNode* node);
+  void Remove(const BookmarkNode* node);
+
+  // Applies the changes recorded by Add() and Remove(), and returns the index.
+  // The caller takes ownership. Called once, on the model's thread, after
+  // Build() has finished.
+  BookmarkIndex* TakeIndex();
+
+ private:
+  friend class base::RefCountedThreadSafe<BookmarkIndexBuilder>;
+
+  // A URL node and its title.
+  typedef std::pair<const BookmarkNode*, base::string16> NodeTitle;
+
+  // A change recorded by Add() or Remove().
+  struct Change {
+    Change(bool add, const BookmarkNode* node, const base::string16& title);
+    ~Change();
+
+    bool add;
+    NodeTitle node_title;
+  };
+
+  ~BookmarkIndexBuilder();
+
+  scoped_ptr<BookmarkIndex> index_;
+
+  // The titles copied by AddNodes(), released by Build().
+  std::vector<NodeTitle> node_titles_;
+
+  std::vector<Change> changes_;
+
+  // Signaled when Build() has finished.
+  base::WaitableEvent built_;
+
+  DISALLOW_COPY_AND_ASSIGN(BookmarkIndexBuilder);
+};
+
+#endif  // CHROME_BROWSER_BOOKMARKS_BOOKMARK_INDEX_BUILDER_H_
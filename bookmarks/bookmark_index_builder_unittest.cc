@@ -0,0 +1,78 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/bookmarks/bookmark_index_builder.h"
+
+#include <vector>
+
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/utf_string_conversions.h"
+#include "chrome/browser/bookmarks/bookmark_index.h"
+#include "chrome/browser/bookmarks/bookmark_model.h"
+#include "chrome/browser/bookmarks/bookmark_title_match.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using base::ASCIIToUTF16;
+
+namespace {
+
+BookmarkNode* AddURL(BookmarkNode* parent, int64 id, const std::string& title) {
+  BookmarkNode* node = new BookmarkNode(id, GURL("http://www.google.com/"));
+  node->SetTitle(ASCIIToUTF16(title));
+  parent->Add(node, parent->child_count());
+  return node;
+}
+
+size_t CountMatches(BookmarkIndex* index, const std::string& query) {
+  std::vector<BookmarkTitleMatch> matches;
+  index->GetBookmarksWithTitlesMatching(ASCIIToUTF16(query), 100, &matches);
+  return matches.size();
+}
+
+}  // namespace
+
+TEST(BookmarkIndexBuilderTest, Build) {
+  BookmarkNode root(1, GURL());
+  AddURL(&root, 2, "google mail");
+  BookmarkNode* folder = new BookmarkNode(3, GURL());
+  root.Add(folder, 1);
+  AddURL(folder, 4, "google maps");
+
+  scoped_refptr<BookmarkIndexBuilder> builder(
+      new BookmarkIndexBuilder(new BookmarkIndex(NULL)));
+  builder->AddNodes(&root);
+  EXPECT_FALSE(builder->IsBuilt());
+  builder->Build();
+  EXPECT_TRUE(builder->IsBuilt());
+
+  scoped_ptr<BookmarkIndex> index(builder->TakeIndex());
+  EXPECT_EQ(2u, CountMatches(index.get(), "google"));
+  EXPECT_EQ(1u, CountMatches(index.get(), "maps"));
+}
+
+// Changes made to the nodes while the index is built are applied when the
+// index is taken, using the titles the nodes had when they were made.
+TEST(BookmarkIndexBuilderTest, ChangesBeforeTakeIndex) {
+  BookmarkNode root(1, GURL());
+  BookmarkNode* renamed = AddURL(&root, 2, "google mail");
+  BookmarkNode* removed = AddURL(&root, 3, "google maps");
+
+  scoped_refptr<BookmarkIndexBuilder> builder(
+      new BookmarkIndexBuilder(new BookmarkIndex(NULL)));
+  builder->AddNodes(&root);
+
+  builder->Remove(renamed);
+  renamed->SetTitle(ASCIIToUTF16("wikipedia"));
+  builder->Add(renamed);
+  builder->Remove(removed);
+  delete root.Remove(removed);
+  builder->Add(AddURL(&root, 4, "google news"));
+
+  builder->Build();
+  scoped_ptr<BookmarkIndex> index(builder->TakeIndex());
+  EXPECT_EQ(1u, CountMatches(index.get(), "google"));
+  EXPECT_EQ(1u, CountMatches(index.get(), "wikipedia"));
+  EXPECT_EQ(0u, CountMatches(index.get(), "mail"));
+  EXPECT_EQ(0u, CountMatches(index.get(), "maps"));
+}
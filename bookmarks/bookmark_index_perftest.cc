@@ -0,0 +1,93 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/memory/scoped_vector.h"
+#include "base/rand_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/bookmarks/bookmark_index.h"
+#include "chrome/browser/bookmarks/bookmark_model.h"
+#include "chrome/browser/bookmarks/bookmark_title_match.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace {
+
+// Queries typed into the omnibox, each looked up one keystroke at a time.
+const char* kQueries[] = {
+  "google maps", "wikipedia w12ord", "news w4567ord",
+};
+
+// Produces a pseudo-random word from a vocabulary skewed towards a few very
+// common words, as is typical for bookmark titles.
+std::string SyntheticWord(size_t vocabulary_size) {
+  const char* kCommonWords[] = {
+    "google", "mail", "maps", "wikipedia", "news", "search", "video", "home",
+  };
+  if (base::RandInt(0, 3) == 0)
+    return kCommonWords[base::RandInt(0, arraysize(kCommonWords) - 1)];
+  int word_number = base::RandInt(0, static_cast<int>(vocabulary_size) - 1);
+  return "w" + base::IntToString(word_number) + "ord";
+}
+
+void RunKeystrokes(size_t bookmark_count) {
+  const std::string trace = base::Uint64ToString(bookmark_count) + "_bookmarks";
+  const size_t kTitleWords = 5;
+
+  ScopedVector<BookmarkNode> nodes;
+  for (size_t i = 0; i < bookmark_count; ++i) {
+    std::string title = SyntheticWord(bookmark_count);
+    for (size_t j = 1; j < kTitleWords; ++j)
+      title += " " + SyntheticWord(bookmark_count);
+    BookmarkNode* node = new BookmarkNode(
+        static_cast<int64>(i + 1),
+        GURL("http://www.example.com/" + base::Uint64ToString(i)));
+    node->SetTitle(base::UTF8ToUTF16(title));
+    nodes.push_back(node);
+  }
+
+  BookmarkIndex index(NULL);
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t i = 0; i < nodes.size(); ++i)
+    index.Add(nodes[i]);
+  perf_test::PrintResult("bookmark_index_build", "", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+  perf_test::PrintResult("bookmark_index_memory", "", trace,
+                         index.EstimateMemoryUsage(), "bytes", true);
+
+  size_t keystrokes = 0;
+  base::TimeDelta total_time;
+  base::TimeDelta max_time;
+  for (size_t i = 0; i < arraysize(kQueries); ++i) {
+    std::string query = kQueries[i];
+    for (size_t length = 1; length <= query.size(); ++length) {
+      std::vector<BookmarkTitleMatch> matches;
+      start = base::TimeTicks::Now();
+      index.GetBookmarksWithTitlesMatching(
+          base::UTF8ToUTF16(query.substr(0, length)), 50, &matches);
+      base::TimeDelta time = base::TimeTicks::Now() - start;
+      total_time += time;
+      max_time = std::max(max_time, time);
+      ++keystrokes;
+    }
+  }
+  perf_test::PrintResult("bookmark_index_keystroke", "_mean", trace,
+                         total_time.InMillisecondsF() / keystrokes, "ms",
+                         true);
+  perf_test::PrintResult("bookmark_index_keystroke", "_max", trace,
+                         max_time.InMillisecondsF(), "ms", true);
+}
+
+}  // namespace
+
+TEST(BookmarkIndexPerfTest, KeystrokeLatency) {
+  RunKeystrokes(10000);
+  RunKeystrokes(100000);
+}
@@ -197,6 +197,24 @@ TEST_F(BookmarkIndexTest, Remove) {
   ExpectMatches("A", NULL, 0U);
 }
 
+// Makes sure prefix matches are updated when a node with several terms
+// sharing a prefix is removed.
+TEST_F(BookmarkIndexTest, RemoveWithSharedPrefix) {
+  const char* input[] = { "abcd abce", "abcf", "abcdx" };
+  AddBookmarksWithTitles(input, ARRAYSIZE_UNSAFE(input));
+
+  const char* expected[] = { "abcd abce", "abcf", "abcdx" };
+  ExpectMatches("abc", expected, ARRAYSIZE_UNSAFE(expected));
+
+  model_->Remove(model_->other_node(), 0);
+  const char* expected_after_remove[] = { "abcf", "abcdx" };
+  ExpectMatches("abc", expected_after_remove,
+                ARRAYSIZE_UNSAFE(expected_after_remove));
+  const char* expected_abcd[] = { "abcdx" };
+  ExpectMatches("abcd", expected_abcd, ARRAYSIZE_UNSAFE(expected_abcd));
+  ExpectMatches("abce", NULL, 0U);
+}
+
 // Makes sure index is updated when a node's title is changed.
 TEST_F(BookmarkIndexTest, ChangeTitle) {
   const char* input[] = { "a", "b" };
@@ -0,0 +1,536 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/bookmarks/bookmark_journal.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "base/pickle.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_piece.h"
+#include "chrome/browser/bookmarks/bookmark_codec.h"
+#include "grit/generated_resources.h"
+#include "ui/base/l10n/l10n_util.h"
+#include "url/gurl.h"
+
+namespace {
+
+// Identifies the file format; the bytes "BKJ1" when read from disk.
+const int32 kFileSignature = 0x314A4B42;
+
+const int32 kFileVersion = 2;
+
+const size_t kFileHeaderSize = 2 * sizeof(int32);
+
+// Appended records are compacted into a snapshot once there are more of them
+// than live nodes, but not before there are this many.
+const size_t kMinRecordsBeforeSnapshot = 1000;
+
+enum RecordType {
+  RECORD_NODE = 1,
+  RECORD_REMOVE,
+  RECORD_MODEL,
+  RECORD_COMMIT,
+};
+
+uint64 RecordDigest(const char* data, size_t size) {
+  base::MD5Digest digest;
+  base::MD5Sum(data, size, &digest);
+  uint64 result;
+  memcpy(&result, digest.a, sizeof(result));
+  return result;
+}
+
+void WriteMetaInfo(const BookmarkNode::MetaInfoMap* meta_info_map,
+                   Pickle* pickle) {
+  if (!meta_info_map) {
+    pickle->WriteInt(0);
+    return;
+  }
+  pickle->WriteInt(static_cast<int>(meta_info_map->size()));
+  for (BookmarkNode::MetaInfoMap::const_iterator it = meta_info_map->begin();
+       it != meta_info_map->end(); ++it) {
+    pickle->WriteString(it->first);
+    pickle->WriteString(it->second);
+  }
+}
+
+bool ReadMetaInfo(const Pickle& pickle,
+                  PickleIterator* iterator,
+                  BookmarkNode::MetaInfoMap* meta_info_map) {
+  int count;
+  if (!pickle.ReadInt(iterator, &count) || count < 0)
+    return false;
+  meta_info_map->clear();
+  for (int i = 0; i < count; ++i) {
+    std::string key;
+    std::string value;
+    if (!pickle.ReadString(iterator, &key) ||
+        !pickle.ReadString(iterator, &value)) {
+      return false;
+    }
+    (*meta_info_map)[key] = value;
+  }
+  return true;
+}
+
+// Appends |pickle| to |output| as a record: its size, then its bytes. Pickles
+// are padded to a multiple of 4 bytes, so records stay aligned.
+void AppendRecord(const Pickle& pickle, std::string* output) {
+  uint32 size = static_cast<uint32>(pickle.size());
+  output->append(reinterpret_cast<const char*>(&size), sizeof(size));
+  output->append(static_cast<const char*>(pickle.data()), pickle.size());
+}
+
+}  // namespace
+
+// A node record as read from the file.
+struct BookmarkJournal::NodeRecord {
+  NodeRecord()
+      : id(0),
+        type(BookmarkNode::URL),
+        date_added(0),
+        date_folder_modified(0),
+        sync_transaction_version(BookmarkNode::kInvalidSyncTransactionVersion) {
+  }
+
+  bool ReadFromPickle(const Pickle& pickle, PickleIterator* iterator);
+
+  int64 id;
+  BookmarkNode::Type type;
+  base::string16 title;
+  std::string url;
+  int64 date_added;
+  int64 date_folder_modified;
+  int64 sync_transaction_version;
+  BookmarkNode::MetaInfoMap meta_info_map;
+  std::vector<int64> child_ids;
+};
+
+bool BookmarkJournal::NodeRecord::ReadFromPickle(const Pickle& pickle,
+                                                 PickleIterator* iterator) {
+  int type_int;
+  int child_count;
+  if (!pickle.ReadInt64(iterator, &id) ||
+      !pickle.ReadInt(iterator, &type_int) ||
+      type_int < BookmarkNode::URL || type_int > BookmarkNode::MOBILE ||
+      !pickle.ReadString16(iterator, &title) ||
+      !pickle.ReadString(iterator, &url) ||
+      !pickle.ReadInt64(iterator, &date_added) ||
+      !pickle.ReadInt64(iterator, &date_folder_modified) ||
+      !pickle.ReadInt64(iterator, &sync_transaction_version) ||
+      !ReadMetaInfo(pickle, iterator, &meta_info_map) ||
+      !pickle.ReadInt(iterator, &child_count) || child_count < 0) {
+    return false;
+  }
+  type = static_cast<BookmarkNode::Type>(type_int);
+  child_ids.resize(child_count);
+  for (int i = 0; i < child_count; ++i) {
+    if (!pickle.ReadInt64(iterator, &child_ids[i]))
+      return false;
+  }
+  return true;
+}
+
+BookmarkJournal::BookmarkJournal()
+    : model_digest_(0),
+      has_file_(false),
+      appended_records_(0),
+      sequence_(0),
+      pending_records_(0),
+      loaded_(false),
+      ids_valid_(true),
+      maximum_id_(0),
+      ids_reassigned_(false),
+      model_sync_transaction_version_(
+          BookmarkNode::kInvalidSyncTransactionVersion) {
+}
+
+BookmarkJournal::~BookmarkJournal() {}
+
+bool BookmarkJournal::Encode(BookmarkModel* model, std::string* output) {
+  return Encode(model->bookmark_bar_node(),
+                model->other_node(),
+                model->mobile_node(),
+                model->root_node()->GetMetaInfoMap(),
+                model->root_node()->sync_transaction_version(),
+                output);
+}
+
+bool BookmarkJournal::Encode(
+    const BookmarkNode* bookmark_bar_node,
+    const BookmarkNode* other_folder_node,
+    const BookmarkNode* mobile_folder_node,
+    const BookmarkNode::MetaInfoMap* model_meta_info_map,
+    int64 sync_transaction_version,
+    std::string* output) {
+  output->clear();
+  bool snapshot = !has_file_ ||
+      appended_records_ > std::max(kMinRecordsBeforeSnapshot,
+                                   node_digests_.size());
+
+  std::string records;
+  pending_records_ = 0;
+  ids_reassigned_ = false;
+  base::MD5Init(&md5_context_);
+  std::map<int64, uint64> digests;
+  EncodeNode(bookmark_bar_node, snapshot, &digests, &records);
+  EncodeNode(other_folder_node, snapshot, &digests, &records);
+  EncodeNode(mobile_folder_node, snapshot, &digests, &records);
+  FinalizeChecksum();
+  stored_checksum_ = computed_checksum_;
+
+  if (!snapshot) {
+    for (std::map<int64, uint64>::const_iterator it = node_digests_.begin();
+         it != node_digests_.end(); ++it) {
+      if (digests.count(it->first))
+        continue;
+      Pickle pickle;
+      pickle.WriteInt(RECORD_REMOVE);
+      pickle.WriteInt64(it->first);
+      AppendRecord(pickle, &records);
+      ++pending_records_;
+    }
+  }
+  node_digests_.swap(digests);
+
+  Pickle model_pickle;
+  model_pickle.WriteInt(RECORD_MODEL);
+  model_pickle.WriteInt64(sync_transaction_version);
+  WriteMetaInfo(model_meta_info_map, &model_pickle);
+  uint64 model_digest = RecordDigest(
+      static_cast<const char*>(model_pickle.data()), model_pickle.size());
+  if (snapshot || model_digest != model_digest_) {
+    AppendRecord(model_pickle, &records);
+    ++pending_records_;
+  }
+  model_digest_ = model_digest;
+
+  if (records.empty())
+    return false;
+
+  base::MD5Digest records_digest;
+  base::MD5Sum(records.data(), records.size(), &records_digest);
+  Pickle commit_pickle;
+  commit_pickle.WriteInt(RECORD_COMMIT);
+  commit_pickle.WriteString(computed_checksum_);
+  commit_pickle.WriteString(base::MD5DigestToBase16(records_digest));
+  commit_pickle.WriteInt64(++sequence_);
+  AppendRecord(commit_pickle, &records);
+
+  has_file_ = true;
+  if (snapshot) {
+    output->append(reinterpret_cast<const char*>(&kFileSignature),
+                   sizeof(kFileSignature));
+    output->append(reinterpret_cast<const char*>(&kFileVersion),
+                   sizeof(kFileVersion));
+    output->append(records);
+    appended_records_ = 0;
+  } else {
+    output->swap(records);
+    appended_records_ += pending_records_;
+  }
+  return snapshot;
+}
+
+bool BookmarkJournal::Decode(BookmarkNode* bb_node,
+                             BookmarkNode* other_folder_node,
+                             BookmarkNode* mobile_folder_node,
+                             int64* max_node_id,
+                             const std::string& data,
+                             int64 min_sequence) {
+  Reset();
+  loaded_ = false;
+  decoded_ids_.clear();
+  ids_valid_ = true;
+  ids_reassigned_ = false;
+  maximum_id_ = 0;
+  stored_checksum_.clear();
+  model_meta_info_map_.clear();
+  model_sync_transaction_version_ =
+      BookmarkNode::kInvalidSyncTransactionVersion;
+
+  NodeRecords records;
+  if (!ReadRecords(data, &records) || sequence_ < min_sequence) {
+    Reset();
+    return false;
+  }
+
+  const NodeRecord* roots[3] = { NULL, NULL, NULL };
+  for (NodeRecords::const_iterator it = records.begin(); it != records.end();
+       ++it) {
+    if (it->second.type == BookmarkNode::BOOKMARK_BAR)
+      roots[0] = &it->second;
+    else if (it->second.type == BookmarkNode::OTHER_NODE)
+      roots[1] = &it->second;
+    else if (it->second.type == BookmarkNode::MOBILE)
+      roots[2] = &it->second;
+  }
+  if (!roots[0] || !roots[1] || !roots[2]) {
+    Reset();
+    return false;
+  }
+
+  base::MD5Init(&md5_context_);
+  BookmarkNode* nodes[3] = { bb_node, other_folder_node, mobile_folder_node };
+  for (size_t i = 0; i < arraysize(nodes); ++i) {
+    DecodeNode(*roots[i], nodes[i]);
+    DecodeChildren(records, *roots[i], nodes[i]);
+  }
+  FinalizeChecksum();
+
+  // As BookmarkCodec does, reassign the ids if the nodes are not the ones
+  // which were saved. The saved digests then no longer describe the model.
+  if (!ids_valid_ || computed_checksum_ != stored_checksum_) {
+    maximum_id_ = 0;
+    for (size_t i = 0; i < arraysize(nodes); ++i)
+      ReassignIDs(nodes[i]);
+    ids_reassigned_ = true;
+    Reset();
+  }
+  *max_node_id = maximum_id_ + 1;
+
+  // Permanent nodes get their types and localized titles from the model, as
+  // in BookmarkCodec.
+  bb_node->set_type(BookmarkNode::BOOKMARK_BAR);
+  other_folder_node->set_type(BookmarkNode::OTHER_NODE);
+  mobile_folder_node->set_type(BookmarkNode::MOBILE);
+  bb_node->SetTitle(l10n_util::GetStringUTF16(IDS_BOOKMARK_BAR_FOLDER_NAME));
+  other_folder_node->SetTitle(
+      l10n_util::GetStringUTF16(IDS_BOOKMARK_BAR_OTHER_FOLDER_NAME));
+  mobile_folder_node->SetTitle(
+      l10n_util::GetStringUTF16(IDS_BOOKMARK_BAR_MOBILE_FOLDER_NAME));
+
+  loaded_ = true;
+  return true;
+}
+
+void BookmarkJournal::Reset() {
+  node_digests_.clear();
+  model_digest_ = 0;
+  has_file_ = false;
+  appended_records_ = 0;
+}
+
+void BookmarkJournal::EncodeNode(const BookmarkNode* node,
+                                 bool snapshot,
+                                 std::map<int64, uint64>* digests,
+                                 std::string* output) {
+  const base::string16& title = node->GetTitle();
+  std::string url = node->is_url() ? node->url().possibly_invalid_spec() :
+      std::string();
+
+  Pickle pickle;
+  pickle.WriteInt(RECORD_NODE);
+  pickle.WriteInt64(node->id());
+  pickle.WriteInt(node->type());
+  pickle.WriteString16(title);
+  pickle.WriteString(url);
+  pickle.WriteInt64(node->date_added().ToInternalValue());
+  pickle.WriteInt64(node->is_folder() ?
+      node->date_folder_modified().ToInternalValue() : 0);
+  pickle.WriteInt64(node->sync_transaction_version());
+  WriteMetaInfo(node->GetMetaInfoMap(), &pickle);
+  pickle.WriteInt(node->child_count());
+  for (int i = 0; i < node->child_count(); ++i)
+    pickle.WriteInt64(node->GetChild(i)->id());
+
+  uint64 digest =
+      RecordDigest(static_cast<const char*>(pickle.data()), pickle.size());
+  std::map<int64, uint64>::const_iterator previous =
+      node_digests_.find(node->id());
+  if (snapshot || previous == node_digests_.end() ||
+      previous->second != digest) {
+    AppendRecord(pickle, output);
+    ++pending_records_;
+  }
+  (*digests)[node->id()] = digest;
+
+  UpdateChecksumWithNode(base::Int64ToString(node->id()), title,
+                         node->is_url(), url);
+  for (int i = 0; i < node->child_count(); ++i)
+    EncodeNode(node->GetChild(i), snapshot, digests, output);
+}
+
+bool BookmarkJournal::ReadRecords(const std::string& data,
+                                  NodeRecords* records) {
+  if (data.size() < kFileHeaderSize)
+    return false;
+  int32 signature;
+  int32 version;
+  memcpy(&signature, data.data(), sizeof(signature));
+  memcpy(&version, data.data() + sizeof(signature), sizeof(version));
+  if (signature != kFileSignature || version != kFileVersion)
+    return false;
+
+  // The records of the save being read, which are only applied once its
+  // commit record is read and matches them.
+  std::vector<std::pair<const char*, uint32> > pending;
+  size_t save_start = kFileHeaderSize;
+  size_t position = kFileHeaderSize;
+  size_t saves = 0;
+  while (data.size() - position >= sizeof(uint32)) {
+    uint32 size;
+    memcpy(&size, data.data() + position, sizeof(size));
+    position += sizeof(size);
+    if (size > data.size() - position)
+      break;  // Torn write.
+    const char* record = data.data() + position;
+    Pickle pickle(record, size);
+    PickleIterator iterator(pickle);
+    int type;
+    if (!pickle.ReadInt(&iterator, &type))
+      break;
+    if (type != RECORD_COMMIT) {
+      pending.push_back(std::make_pair(record, size));
+      position += size;
+      continue;
+    }
+
+    std::string checksum;
+    std::string records_digest;
+    int64 sequence;
+    if (!pickle.ReadString(&iterator, &checksum) ||
+        !pickle.ReadString(&iterator, &records_digest) ||
+        !pickle.ReadInt64(&iterator, &sequence)) {
+      break;
+    }
+    base::MD5Digest digest;
+    base::MD5Sum(data.data() + save_start,
+                 position - sizeof(size) - save_start, &digest);
+    if (base::MD5DigestToBase16(digest) != records_digest)
+      break;  // Corrupt save.
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+      Pickle record_pickle(pending[i].first, pending[i].second);
+      PickleIterator record_iterator(record_pickle);
+      record_pickle.ReadInt(&record_iterator, &type);
+      uint64 record_digest =
+          RecordDigest(pending[i].first, pending[i].second);
+      if (type == RECORD_NODE) {
+        NodeRecord node_record;
+        if (!node_record.ReadFromPickle(record_pickle, &record_iterator))
+          return false;
+        node_digests_[node_record.id] = record_digest;
+        (*records)[node_record.id] = node_record;
+      } else if (type == RECORD_REMOVE) {
+        int64 id;
+        if (!record_pickle.ReadInt64(&record_iterator, &id))
+          return false;
+        node_digests_.erase(id);
+        records->erase(id);
+      } else if (type == RECORD_MODEL) {
+        if (!record_pickle.ReadInt64(&record_iterator,
+                                     &model_sync_transaction_version_) ||
+            !ReadMetaInfo(record_pickle, &record_iterator,
+                          &model_meta_info_map_)) {
+          return false;
+        }
+        model_digest_ = record_digest;
+      } else {
+        return false;
+      }
+    }
+    if (saves++ > 0)
+      appended_records_ += pending.size();
+    stored_checksum_ = checksum;
+    sequence_ = sequence;
+    pending.clear();
+    position += size;
+    save_start = position;
+  }
+
+  if (!saves)
+    return false;
+  // Saves appended after a torn one would never be read, so a file with one
+  // is replaced by the next save.
+  has_file_ = save_start == data.size();
+  return true;
+}
+
+void BookmarkJournal::DecodeChildren(const NodeRecords& records,
+                                     const NodeRecord& record,
+                                     BookmarkNode* node) {
+  for (size_t i = 0; i < record.child_ids.size(); ++i) {
+    NodeRecords::const_iterator child = records.find(record.child_ids[i]);
+    if (child == records.end() || decoded_ids_.count(child->first) ||
+        child->second.type == BookmarkNode::BOOKMARK_BAR ||
+        child->second.type == BookmarkNode::OTHER_NODE ||
+        child->second.type == BookmarkNode::MOBILE) {
+      // The saved tree is inconsistent. Leave the node out, which the
+      // checksum will catch.
+      ids_valid_ = false;
+      continue;
+    }
+
+    const NodeRecord& child_record = child->second;
+    if (child_record.type == BookmarkNode::URL) {
+      GURL url(child_record.url);
+      if (!url.is_valid())
+        continue;
+      BookmarkNode* child_node = new BookmarkNode(child_record.id, url);
+      node->Add(child_node, node->child_count());
+      DecodeNode(child_record, child_node);
+    } else {
+      BookmarkNode* child_node = new BookmarkNode(child_record.id, GURL());
+      node->Add(child_node, node->child_count());
+      DecodeNode(child_record, child_node);
+      DecodeChildren(records, child_record, child_node);
+    }
+  }
+}
+
+void BookmarkJournal::DecodeNode(const NodeRecord& record,
+                                 BookmarkNode* node) {
+  decoded_ids_.insert(record.id);
+  maximum_id_ = std::max(maximum_id_, record.id);
+
+  node->set_id(record.id);
+  node->set_type(record.type == BookmarkNode::URL ? BookmarkNode::URL :
+                                                    BookmarkNode::FOLDER);
+  node->SetTitle(record.title);
+  node->set_date_added(base::Time::FromInternalValue(record.date_added));
+  if (node->is_folder()) {
+    node->set_date_folder_modified(
+        base::Time::FromInternalValue(record.date_folder_modified));
+  }
+  node->SetMetaInfoMap(record.meta_info_map);
+  node->set_sync_transaction_version(record.sync_transaction_version);
+
+  UpdateChecksumWithNode(base::Int64ToString(record.id), record.title,
+                         node->is_url(), record.url);
+}
+
+void BookmarkJournal::ReassignIDs(BookmarkNode* node) {
+  node->set_id(++maximum_id_);
+  for (int i = 0; i < node->child_count(); ++i)
+    ReassignIDs(node->GetChild(i));
+}
+
+void BookmarkJournal::UpdateChecksumWithNode(const std::string& id,
+                                             const base::string16& title,
+                                             bool is_url,
+                                             const std::string& url) {
+  // Matches BookmarkCodec, so that both formats store the same checksum for a
+  // model.
+  base::MD5Update(&md5_context_, id);
+  base::MD5Update(&md5_context_,
+                  base::StringPiece(
+                      reinterpret_cast<const char*>(title.data()),
+                      title.length() * sizeof(title[0])));
+  if (is_url) {
+    base::MD5Update(&md5_context_, BookmarkCodec::kTypeURL);
+    base::MD5Update(&md5_context_, url);
+  } else {
+    base::MD5Update(&md5_context_, BookmarkCodec::kTypeFolder);
+  }
+}
+
+void BookmarkJournal::FinalizeChecksum() {
+  base::MD5Digest digest;
+  base::MD5Final(&digest, &md5_context_);
+  computed_checksum_ = base::MD5DigestToBase16(digest);
+}
@@ -0,0 +1,164 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_BOOKMARKS_BOOKMARK_JOURNAL_H_
+#define CHROME_BROWSER_BOOKMARKS_BOOKMARK_JOURNAL_H_
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/md5.h"
+#include "base/strings/string16.h"
+#include "chrome/browser/bookmarks/bookmark_model.h"
+
+// BookmarkJournal encodes and decodes the bookmark model in a binary format
+// which, unlike the JSON written by BookmarkCodec, can be updated by
+// appending only the nodes which changed since the last save.
+//
+// The file is a header followed by a sequence of Pickles, each a record:
+//   node:   the id, type, title, url, dates, meta info and sync transaction
+//           version of a node, and the ids of its children for a folder.
+//           Replaces any earlier record for the same id.
+//   remove: the id of a node which no longer exists.
+//   model:  the meta info and sync transaction version of the model root.
+//   commit: ends the records of one save. Holds the checksum BookmarkCodec
+//           would compute for the model as of the save, a digest of the
+//           save's records and the save's sequence number.
+// Decoding replays the records up to the last commit whose digest matches,
+// so a save torn by a crash is dropped as a whole.
+//
+// Every save appends a record for each node whose encoding changed, found by
+// comparing digests of the encodings with those of the last save. Once the
+// appended records outnumber the live nodes the next save writes a snapshot
+// of the whole model instead, which replaces the file.
+//
+// Saves are numbered in sequence, so that BookmarkStorage can tell whether the
+// journal holds changes which are not in the JSON file.
+//
+// Like BookmarkCodec, decoding reassigns the ids of all nodes if the stored
+// checksum does not match the decoded nodes or the ids are not unique.
+class BookmarkJournal {
+ public:
+  BookmarkJournal();
+  ~BookmarkJournal();
+
+  // Encodes the changes to the model since the last call to Encode() or
+  // Decode() to |output|. Returns true if |output| is a snapshot which
+  // replaces the file, false if it is to be appended to it. |output| is left
+  // empty if nothing changed.
+  bool Encode(const BookmarkNode* bookmark_bar_node,
+              const BookmarkNode* other_folder_node,
+              const BookmarkNode* mobile_folder_node,
+              const BookmarkNode::MetaInfoMap* model_meta_info_map,
+              int64 sync_transaction_version,
+              std::string* output);
+  bool Encode(BookmarkModel* model, std::string* output);
+
+  // Decodes the file |data| to the specified nodes, setting |max_node_id| to
+  // one more than the greatest node id. Returns true on success. Fails if the
+  // last complete save in |data| is numbered below |min_sequence|. On failure
+  // the nodes are left untouched, and the next Encode() writes a snapshot.
+  bool Decode(BookmarkNode* bb_node,
+              BookmarkNode* other_folder_node,
+              BookmarkNode* mobile_folder_node,
+              int64* max_node_id,
+              const std::string& data,
+              int64 min_sequence);
+
+  // Forgets what was written, so that the next Encode() writes a snapshot.
+  // Called when a save could not be written.
+  void Reset();
+
+  // Whether the last Decode() succeeded.
+  bool loaded() const { return loaded_; }
+
+  // See the BookmarkCodec methods of the same names.
+  const std::string& computed_checksum() const { return computed_checksum_; }
+  const std::string& stored_checksum() const { return stored_checksum_; }
+  bool ids_reassigned() const { return ids_reassigned_; }
+  const BookmarkNode::MetaInfoMap& model_meta_info_map() const {
+    return model_meta_info_map_;
+  }
+  int64 model_sync_transaction_version() const {
+    return model_sync_transaction_version_;
+  }
+
+  // The number of records in the file which are not part of a snapshot.
+  size_t appended_records() const { return appended_records_; }
+
+  // The sequence number of the last save written or read. The next save is
+  // numbered one more.
+  int64 sequence() const { return sequence_; }
+  void set_sequence(int64 sequence) { sequence_ = sequence; }
+
+ private:
+  struct NodeRecord;
+  typedef std::map<int64, NodeRecord> NodeRecords;
+
+  // Appends the records for |node| and its descendants whose encodings
+  // changed to |output|, or all of them if |snapshot|, and adds |node| to the
+  // checksum.
+  void EncodeNode(const BookmarkNode* node,
+                  bool snapshot,
+                  std::map<int64, uint64>* digests,
+                  std::string* output);
+
+  // Replays the records of |data| into |records|. Returns false if there is
+  // no complete save.
+  bool ReadRecords(const std::string& data, NodeRecords* records);
+
+  // Creates the children of |node| from the child ids of its |record|,
+  // adding them to the checksum. Children which are missing or decoded
+  // already are left out.
+  void DecodeChildren(const NodeRecords& records,
+                      const NodeRecord& record,
+                      BookmarkNode* node);
+
+  // Sets the fields of |node| from |record| and adds it to the checksum.
+  void DecodeNode(const NodeRecord& record, BookmarkNode* node);
+
+  void ReassignIDs(BookmarkNode* node);
+
+  void UpdateChecksumWithNode(const std::string& id,
+                              const base::string16& title,
+                              bool is_url,
+                              const std::string& url);
+  void FinalizeChecksum();
+
+  // Digests of the node records, by id, and the model record as of the last
+  // save.
+  std::map<int64, uint64> node_digests_;
+  uint64 model_digest_;
+
+  // Whether the file has been written or read, so that changes can be
+  // appended to it.
+  bool has_file_;
+
+  size_t appended_records_;
+
+  int64 sequence_;
+
+  // The number of records written by the Encode() in progress.
+  size_t pending_records_;
+
+  bool loaded_;
+
+  // Set while decoding, as in BookmarkCodec.
+  std::set<int64> decoded_ids_;
+  bool ids_valid_;
+  int64 maximum_id_;
+
+  base::MD5Context md5_context_;
+  std::string computed_checksum_;
+  std::string stored_checksum_;
+  bool ids_reassigned_;
+  BookmarkNode::MetaInfoMap model_meta_info_map_;
+  int64 model_sync_transaction_version_;
+
+  DISALLOW_COPY_AND_ASSIGN(BookmarkJournal);
+};
+
+#endif  // CHROME_BROWSER_BOOKMARKS_BOOKMARK_JOURNAL_H_
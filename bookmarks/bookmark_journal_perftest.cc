@@ -0,0 +1,165 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+
+#include "base/json/json_string_value_serializer.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "chrome/browser/bookmarks/bookmark_codec.h"
+#include "chrome/browser/bookmarks/bookmark_journal.h"
+#include "chrome/browser/bookmarks/bookmark_model.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace {
+
+// Bookmarks are spread over folders of this many bookmarks.
+const int kBookmarksPerFolder = 100;
+
+// The permanent nodes of a model, without the model.
+class Roots {
+ public:
+  Roots()
+      : bookmark_bar_(1, GURL()),
+        other_(2, GURL()),
+        mobile_(3, GURL()) {
+    bookmark_bar_.set_type(BookmarkNode::BOOKMARK_BAR);
+    other_.set_type(BookmarkNode::OTHER_NODE);
+    mobile_.set_type(BookmarkNode::MOBILE);
+  }
+
+  // Adds |count| bookmarks in folders to the bookmark bar and other folder.
+  void Populate(int count) {
+    int64 id = 4;
+    BookmarkNode* folder = NULL;
+    for (int i = 0; i < count; ++i) {
+      if (i % kBookmarksPerFolder == 0) {
+        BookmarkNode* parent = i % 2 ? &other_ : &bookmark_bar_;
+        folder = new BookmarkNode(id++, GURL());
+        folder->SetTitle(base::ASCIIToUTF16("folder" + base::IntToString(i)));
+        parent->Add(folder, parent->child_count());
+      }
+      std::string number = base::IntToString(i);
+      BookmarkNode* node = new BookmarkNode(
+          id++, GURL("http://www.site" + number + ".com/path/" + number));
+      node->SetTitle(base::ASCIIToUTF16("Bookmark title number " + number));
+      folder->Add(node, folder->child_count());
+    }
+  }
+
+  BookmarkNode* bookmark_bar() { return &bookmark_bar_; }
+  BookmarkNode* other() { return &other_; }
+  BookmarkNode* mobile() { return &mobile_; }
+
+ private:
+  BookmarkNode bookmark_bar_;
+  BookmarkNode other_;
+  BookmarkNode mobile_;
+
+  DISALLOW_COPY_AND_ASSIGN(Roots);
+};
+
+std::string EncodeJSON(Roots* roots) {
+  BookmarkCodec codec;
+  scoped_ptr<base::Value> value(codec.Encode(
+      roots->bookmark_bar(), roots->other(), roots->mobile(), NULL,
+      BookmarkNode::kInvalidSyncTransactionVersion));
+  std::string data;
+  JSONStringValueSerializer serializer(&data);
+  serializer.set_pretty_print(true);
+  serializer.Serialize(*value);
+  return data;
+}
+
+std::string EncodeJournal(Roots* roots, BookmarkJournal* journal) {
+  std::string data;
+  journal->Encode(roots->bookmark_bar(), roots->other(), roots->mobile(), NULL,
+                  BookmarkNode::kInvalidSyncTransactionVersion, &data);
+  return data;
+}
+
+void RunComparison(int count) {
+  const std::string trace = base::IntToString(count) + "_bookmarks";
+  Roots roots;
+  roots.Populate(count);
+
+  // Full saves, as on the first save of each format.
+  base::TimeTicks start = base::TimeTicks::Now();
+  std::string json = EncodeJSON(&roots);
+  perf_test::PrintResult("bookmarks_save", "_json", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+  BookmarkJournal journal;
+  start = base::TimeTicks::Now();
+  std::string snapshot = EncodeJournal(&roots, &journal);
+  perf_test::PrintResult("bookmarks_save", "_journal", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+  perf_test::PrintResult("bookmarks_file_size", "_json", trace,
+                         static_cast<size_t>(json.size()), "bytes", true);
+  perf_test::PrintResult("bookmarks_file_size", "_journal", trace,
+                         static_cast<size_t>(snapshot.size()), "bytes", true);
+
+  // A save after renaming one bookmark, which rewrites the whole JSON file but
+  // appends a single record to the journal.
+  BookmarkNode* node = roots.bookmark_bar()->GetChild(0)->GetChild(0);
+  node->SetTitle(base::ASCIIToUTF16("Renamed"));
+  start = base::TimeTicks::Now();
+  json = EncodeJSON(&roots);
+  perf_test::PrintResult("bookmarks_edit_save", "_json", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+  start = base::TimeTicks::Now();
+  std::string changes = EncodeJournal(&roots, &journal);
+  perf_test::PrintResult("bookmarks_edit_save", "_journal", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+  perf_test::PrintResult("bookmarks_edit_bytes", "_json", trace,
+                         static_cast<size_t>(json.size()), "bytes", true);
+  perf_test::PrintResult("bookmarks_edit_bytes", "_journal", trace,
+                         static_cast<size_t>(changes.size()), "bytes", true);
+  snapshot += changes;
+
+  // Loads, including parsing the JSON.
+  {
+    Roots decoded;
+    start = base::TimeTicks::Now();
+    JSONStringValueSerializer serializer(json);
+    scoped_ptr<base::Value> value(serializer.Deserialize(NULL, NULL));
+    ASSERT_TRUE(value.get());
+    BookmarkCodec codec;
+    int64 max_id = 0;
+    ASSERT_TRUE(codec.Decode(decoded.bookmark_bar(), decoded.other(),
+                             decoded.mobile(), &max_id, *value));
+    perf_test::PrintResult("bookmarks_load", "_json", trace,
+                           (base::TimeTicks::Now() - start).InMillisecondsF(),
+                           "ms", true);
+    EXPECT_FALSE(codec.ids_reassigned());
+  }
+  {
+    Roots decoded;
+    BookmarkJournal decoder;
+    int64 max_id = 0;
+    start = base::TimeTicks::Now();
+    ASSERT_TRUE(decoder.Decode(decoded.bookmark_bar(), decoded.other(),
+                               decoded.mobile(), &max_id, snapshot, 0));
+    perf_test::PrintResult("bookmarks_load", "_journal", trace,
+                           (base::TimeTicks::Now() - start).InMillisecondsF(),
+                           "ms", true);
+    EXPECT_FALSE(decoder.ids_reassigned());
+    EXPECT_EQ(node->GetTitle(),
+              decoded.bookmark_bar()->GetChild(0)->GetChild(0)->GetTitle());
+  }
+}
+
+}  // namespace
+
+TEST(BookmarkJournalPerfTest, LoadAndSave) {
+  RunComparison(5000);
+  RunComparison(50000);
+}
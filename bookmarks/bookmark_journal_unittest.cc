@@ -0,0 +1,327 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/bookmarks/bookmark_journal.h"
+
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/values.h"
+#include "chrome/browser/bookmarks/bookmark_codec.h"
+#include "chrome/browser/bookmarks/bookmark_model.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using base::ASCIIToUTF16;
+
+namespace {
+
+// Helper to verify the two given bookmark nodes.
+void AssertNodesEqual(const BookmarkNode* expected,
+                      const BookmarkNode* actual) {
+  ASSERT_TRUE(expected);
+  ASSERT_TRUE(actual);
+  EXPECT_EQ(expected->id(), actual->id());
+  EXPECT_EQ(expected->GetTitle(), actual->GetTitle());
+  EXPECT_EQ(expected->type(), actual->type());
+  EXPECT_TRUE(expected->date_added() == actual->date_added());
+  EXPECT_EQ(expected->sync_transaction_version(),
+            actual->sync_transaction_version());
+  if (expected->is_url()) {
+    EXPECT_EQ(expected->url(), actual->url());
+  } else {
+    EXPECT_TRUE(expected->date_folder_modified() ==
+                actual->date_folder_modified());
+    ASSERT_EQ(expected->child_count(), actual->child_count());
+    for (int i = 0; i < expected->child_count(); ++i)
+      AssertNodesEqual(expected->GetChild(i), actual->GetChild(i));
+  }
+}
+
+// The permanent nodes of a model, without the model.
+class Roots {
+ public:
+  Roots()
+      : bookmark_bar_(1, GURL()),
+        other_(2, GURL()),
+        mobile_(3, GURL()) {
+    bookmark_bar_.set_type(BookmarkNode::BOOKMARK_BAR);
+    other_.set_type(BookmarkNode::OTHER_NODE);
+    mobile_.set_type(BookmarkNode::MOBILE);
+  }
+
+  BookmarkNode* bookmark_bar() { return &bookmark_bar_; }
+  BookmarkNode* other() { return &other_; }
+  BookmarkNode* mobile() { return &mobile_; }
+
+  bool Encode(BookmarkJournal* journal, std::string* output) {
+    return journal->Encode(&bookmark_bar_, &other_, &mobile_, NULL,
+                           BookmarkNode::kInvalidSyncTransactionVersion,
+                           output);
+  }
+
+  bool Decode(BookmarkJournal* journal,
+              int64* max_id,
+              const std::string& data) {
+    return DecodeNewerThan(journal, max_id, data, 0);
+  }
+
+  bool DecodeNewerThan(BookmarkJournal* journal,
+                       int64* max_id,
+                       const std::string& data,
+                       int64 min_sequence) {
+    return journal->Decode(&bookmark_bar_, &other_, &mobile_, max_id, data,
+                           min_sequence);
+  }
+
+  void AssertEqual(Roots* other) {
+    ASSERT_NO_FATAL_FAILURE(
+        AssertNodesEqual(&bookmark_bar_, other->bookmark_bar()));
+    ASSERT_NO_FATAL_FAILURE(AssertNodesEqual(&other_, other->other()));
+    ASSERT_NO_FATAL_FAILURE(AssertNodesEqual(&mobile_, other->mobile()));
+  }
+
+ private:
+  BookmarkNode bookmark_bar_;
+  BookmarkNode other_;
+  BookmarkNode mobile_;
+
+  DISALLOW_COPY_AND_ASSIGN(Roots);
+};
+
+BookmarkNode* AddURL(BookmarkNode* parent,
+                     int64 id,
+                     const std::string& title,
+                     const std::string& url) {
+  BookmarkNode* node = new BookmarkNode(id, GURL(url));
+  node->SetTitle(ASCIIToUTF16(title));
+  parent->Add(node, parent->child_count());
+  return node;
+}
+
+BookmarkNode* AddFolder(BookmarkNode* parent,
+                        int64 id,
+                        const std::string& title) {
+  BookmarkNode* node = new BookmarkNode(id, GURL());
+  node->SetTitle(ASCIIToUTF16(title));
+  parent->Add(node, parent->child_count());
+  return node;
+}
+
+void PopulateRoots(Roots* roots) {
+  AddURL(roots->bookmark_bar(), 4, "url1", "http://www.url1.com/");
+  BookmarkNode* folder = AddFolder(roots->bookmark_bar(), 5, "folder1");
+  BookmarkNode::MetaInfoMap meta_info_map;
+  meta_info_map["key"] = "value";
+  AddURL(folder, 6, "url2", "http://www.url2.com/")->SetMetaInfoMap(
+      meta_info_map);
+  AddURL(roots->other(), 7, "url3", "http://www.url3.com/")->
+      set_sync_transaction_version(42);
+  AddURL(roots->mobile(), 8, "url4", "http://www.url4.com/");
+}
+
+}  // namespace
+
+TEST(BookmarkJournalTest, EncodeAndDecode) {
+  Roots roots;
+  PopulateRoots(&roots);
+  BookmarkJournal journal;
+  std::string data;
+  EXPECT_TRUE(roots.Encode(&journal, &data));
+  EXPECT_FALSE(data.empty());
+
+  Roots decoded;
+  BookmarkJournal decoder;
+  int64 max_id = 0;
+  ASSERT_TRUE(decoded.Decode(&decoder, &max_id, data));
+  EXPECT_TRUE(decoder.loaded());
+  EXPECT_FALSE(decoder.ids_reassigned());
+  EXPECT_EQ(journal.computed_checksum(), decoder.stored_checksum());
+  EXPECT_EQ(decoder.stored_checksum(), decoder.computed_checksum());
+  EXPECT_EQ(9, max_id);
+
+  // Decoding sets the localized titles of the permanent nodes, so compare the
+  // nodes after encoding them again.
+  roots.bookmark_bar()->SetTitle(decoded.bookmark_bar()->GetTitle());
+  roots.other()->SetTitle(decoded.other()->GetTitle());
+  roots.mobile()->SetTitle(decoded.mobile()->GetTitle());
+  ASSERT_NO_FATAL_FAILURE(roots.AssertEqual(&decoded));
+  const BookmarkNode::MetaInfoMap* meta_info_map =
+      decoded.bookmark_bar()->GetChild(1)->GetChild(0)->GetMetaInfoMap();
+  ASSERT_TRUE(meta_info_map);
+  EXPECT_EQ("value", meta_info_map->find("key")->second);
+}
+
+// The journal stores the checksum BookmarkCodec computes for the same nodes.
+TEST(BookmarkJournalTest, ChecksumMatchesCodec) {
+  Roots roots;
+  PopulateRoots(&roots);
+  BookmarkCodec codec;
+  scoped_ptr<base::Value> value(codec.Encode(
+      roots.bookmark_bar(), roots.other(), roots.mobile(), NULL,
+      BookmarkNode::kInvalidSyncTransactionVersion));
+
+  BookmarkJournal journal;
+  std::string data;
+  roots.Encode(&journal, &data);
+  EXPECT_EQ(codec.computed_checksum(), journal.computed_checksum());
+}
+
+TEST(BookmarkJournalTest, AppendsChanges) {
+  Roots roots;
+  PopulateRoots(&roots);
+  BookmarkJournal journal;
+  std::string data;
+  ASSERT_TRUE(roots.Encode(&journal, &data));
+
+  // Nothing changed, so nothing is written.
+  std::string changes;
+  EXPECT_FALSE(roots.Encode(&journal, &changes));
+  EXPECT_TRUE(changes.empty());
+
+  // Changing a title appends only that node.
+  roots.bookmark_bar()->GetChild(0)->SetTitle(ASCIIToUTF16("renamed"));
+  EXPECT_FALSE(roots.Encode(&journal, &changes));
+  EXPECT_FALSE(changes.empty());
+  EXPECT_LT(changes.size(), data.size() / 2);
+  EXPECT_EQ(1u, journal.appended_records());
+  data += changes;
+
+  // Removing a node appends a remove record and its parent, and adding one
+  // appends it and its parent.
+  BookmarkNode* folder = roots.bookmark_bar()->GetChild(1);
+  delete folder->Remove(folder->GetChild(0));
+  AddURL(roots.other(), 9, "url5", "http://www.url5.com/");
+  EXPECT_FALSE(roots.Encode(&journal, &changes));
+  EXPECT_EQ(5u, journal.appended_records());
+  data += changes;
+
+  Roots decoded;
+  BookmarkJournal decoder;
+  int64 max_id = 0;
+  ASSERT_TRUE(decoded.Decode(&decoder, &max_id, data));
+  EXPECT_FALSE(decoder.ids_reassigned());
+  EXPECT_EQ(5u, decoder.appended_records());
+  EXPECT_EQ(10, max_id);
+  EXPECT_EQ(ASCIIToUTF16("renamed"),
+            decoded.bookmark_bar()->GetChild(0)->GetTitle());
+  EXPECT_EQ(0, decoded.bookmark_bar()->GetChild(1)->child_count());
+  EXPECT_EQ(2, decoded.other()->child_count());
+
+  // A journal which read the file appends to it too. The first save also
+  // writes the localized titles decoding gave the permanent nodes.
+  EXPECT_FALSE(decoded.Encode(&decoder, &changes));
+  size_t appended_records = decoder.appended_records();
+  decoded.mobile()->GetChild(0)->SetTitle(ASCIIToUTF16("renamed"));
+  EXPECT_FALSE(decoded.Encode(&decoder, &changes));
+  EXPECT_EQ(appended_records + 1, decoder.appended_records());
+}
+
+// Saves are numbered, and a file whose last save is older than required is
+// not decoded.
+TEST(BookmarkJournalTest, Sequence) {
+  Roots roots;
+  PopulateRoots(&roots);
+  BookmarkJournal journal;
+  journal.set_sequence(5);
+  std::string data;
+  ASSERT_TRUE(roots.Encode(&journal, &data));
+  EXPECT_EQ(6, journal.sequence());
+  roots.bookmark_bar()->GetChild(0)->SetTitle(ASCIIToUTF16("renamed"));
+  std::string changes;
+  ASSERT_FALSE(roots.Encode(&journal, &changes));
+  EXPECT_EQ(7, journal.sequence());
+  data += changes;
+
+  Roots decoded;
+  BookmarkJournal decoder;
+  int64 max_id = 0;
+  EXPECT_FALSE(decoded.DecodeNewerThan(&decoder, &max_id, data, 8));
+  EXPECT_EQ(0, decoded.bookmark_bar()->child_count());
+  ASSERT_TRUE(decoded.DecodeNewerThan(&decoder, &max_id, data, 7));
+  EXPECT_EQ(7, decoder.sequence());
+  EXPECT_EQ(ASCIIToUTF16("renamed"),
+            decoded.bookmark_bar()->GetChild(0)->GetTitle());
+}
+
+// A save torn by a crash is dropped, and the next save replaces the file.
+TEST(BookmarkJournalTest, TornSave) {
+  Roots roots;
+  PopulateRoots(&roots);
+  BookmarkJournal journal;
+  std::string data;
+  ASSERT_TRUE(roots.Encode(&journal, &data));
+  roots.bookmark_bar()->GetChild(0)->SetTitle(ASCIIToUTF16("renamed"));
+  std::string changes;
+  ASSERT_FALSE(roots.Encode(&journal, &changes));
+  data += changes.substr(0, changes.size() - 4);
+
+  Roots decoded;
+  BookmarkJournal decoder;
+  int64 max_id = 0;
+  ASSERT_TRUE(decoded.Decode(&decoder, &max_id, data));
+  EXPECT_FALSE(decoder.ids_reassigned());
+  EXPECT_EQ(ASCIIToUTF16("url1"),
+            decoded.bookmark_bar()->GetChild(0)->GetTitle());
+  EXPECT_TRUE(decoded.Encode(&decoder, &changes));
+
+  // A file without a complete save cannot be decoded.
+  Roots empty;
+  EXPECT_FALSE(empty.Decode(&decoder, &max_id, data.substr(0, 16)));
+  EXPECT_FALSE(decoder.loaded());
+}
+
+// As with BookmarkCodec, nodes with duplicate ids get new ids.
+TEST(BookmarkJournalTest, ReassignsDuplicateIDs) {
+  Roots roots;
+  PopulateRoots(&roots);
+  AddURL(roots.mobile(), 4, "duplicate", "http://www.url5.com/");
+  BookmarkJournal journal;
+  std::string data;
+  ASSERT_TRUE(roots.Encode(&journal, &data));
+
+  Roots decoded;
+  BookmarkJournal decoder;
+  int64 max_id = 0;
+  ASSERT_TRUE(decoded.Decode(&decoder, &max_id, data));
+  EXPECT_TRUE(decoder.ids_reassigned());
+  EXPECT_EQ(1, decoded.bookmark_bar()->id());
+  EXPECT_EQ(max_id - 1, decoded.mobile()->GetChild(0)->id());
+
+  // The saved records do not describe the new ids, so the next save is a
+  // snapshot.
+  std::string changes;
+  EXPECT_TRUE(decoded.Encode(&decoder, &changes));
+}
+
+// Once more records were appended than there are nodes, the next save writes
+// a snapshot.
+TEST(BookmarkJournalTest, Compaction) {
+  Roots roots;
+  PopulateRoots(&roots);
+  BookmarkJournal journal;
+  std::string data;
+  ASSERT_TRUE(roots.Encode(&journal, &data));
+
+  BookmarkNode* node = roots.bookmark_bar()->GetChild(0);
+  bool snapshot = false;
+  size_t saves = 0;
+  while (!snapshot && saves < 10000) {
+    node->SetTitle(ASCIIToUTF16(saves % 2 ? "odd" : "even"));
+    std::string changes;
+    snapshot = roots.Encode(&journal, &changes);
+    if (snapshot)
+      data = changes;
+    else
+      data += changes;
+    ++saves;
+  }
+  EXPECT_TRUE(snapshot);
+  EXPECT_EQ(0u, journal.appended_records());
+
+  Roots decoded;
+  BookmarkJournal decoder;
+  int64 max_id = 0;
+  ASSERT_TRUE(decoded.Decode(&decoder, &max_id, data));
+  EXPECT_EQ(node->GetTitle(), decoded.bookmark_bar()->GetChild(0)->GetTitle());
+  EXPECT_EQ(0u, decoder.appended_records());
+}
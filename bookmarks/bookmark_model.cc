@@ -15,6 +15,7 @@
 #include "base/strings/utf_string_conversions.h"
 #include "chrome/browser/bookmarks/bookmark_expanded_state_tracker.h"
 #include "chrome/browser/bookmarks/bookmark_index.h"
+#include "chrome/browser/bookmarks/bookmark_index_builder.h"
 #include "chrome/browser/bookmarks/bookmark_model_observer.h"
 #include "chrome/browser/bookmarks/bookmark_storage.h"
 #include "chrome/browser/bookmarks/bookmark_title_match.h"
@@ -207,7 +208,9 @@ BookmarkModel::BookmarkModel(Profile* profile)
       extensive_changes_(0) {
   if (!profile_) {
     // Profile is null during testing.
-    DoneLoading(CreateLoadDetails());
+    BookmarkLoadDetails* details = CreateLoadDetails();
+    details->index_builder()->Build();
+    DoneLoading(details);
   }
 }
 
@@ -417,9 +420,9 @@ void BookmarkModel::SetTitle(const BookmarkNode* node, const base::string16& tit
 
   // The title index doesn't support changing the title, instead we remove then
   // add it back.
-  index_->Remove(node);
+  RemoveNodeFromIndex(node);
   AsMutable(node)->SetTitle(title);
-  index_->Add(node);
+  AddNodeToIndex(node);
 
   if (store_.get())
     store_->ScheduleSave();
@@ -735,6 +738,9 @@ void BookmarkModel::GetBookmarksWithTitlesMatching(
   if (!loaded_)
     return;
 
+  if (!index_.get())
+    WaitForIndex();
+
   index_->GetBookmarksWithTitlesMatching(text, max_count, matches);
 }
 
@@ -778,7 +784,7 @@ void BookmarkModel::RemoveNode(BookmarkNode* node,
   if (node->is_url()) {
     RemoveNodeFromURLSet(node);
     removed_urls->insert(node->url());
-    index_->Remove(node);
+    RemoveNodeFromIndex(node);
   }
 
   CancelPendingFaviconLoadRequests(node);
@@ -810,7 +816,9 @@ void BookmarkModel::DoneLoading(BookmarkLoadDetails* details_delete_me) {
   bookmark_bar_node_ = details->release_bb_node();
   other_node_ = details->release_other_folder_node();
   mobile_node_ = details->release_mobile_folder_node();
-  index_.reset(details->release_index());
+  index_builder_ = details->index_builder();
+  if (index_builder_->IsBuilt())
+    DoneBuildingIndex();
 
   // WARNING: order is important here, various places assume the order is
   // constant.
@@ -836,6 +844,33 @@ void BookmarkModel::DoneLoading(BookmarkLoadDetails* details_delete_me) {
                     BookmarkModelLoaded(this, details->ids_reassigned()));
 }
 
+void BookmarkModel::DoneBuildingIndex() {
+  if (!index_builder_.get())
+    return;
+  index_.reset(index_builder_->TakeIndex());
+  index_builder_ = NULL;
+}
+
+void BookmarkModel::WaitForIndex() {
+  DCHECK(index_builder_.get());
+  index_builder_->WaitUntilBuilt();
+  DoneBuildingIndex();
+}
+
+void BookmarkModel::AddNodeToIndex(const BookmarkNode* node) {
+  if (index_builder_.get())
+    index_builder_->Add(node);
+  else
+    index_->Add(node);
+}
+
+void BookmarkModel::RemoveNodeFromIndex(const BookmarkNode* node) {
+  if (index_builder_.get())
+    index_builder_->Remove(node);
+  else
+    index_->Remove(node);
+}
+
 void BookmarkModel::RemoveAndDeleteNode(BookmarkNode* delete_me) {
   scoped_ptr<BookmarkNode> node(delete_me);
 
@@ -926,7 +961,7 @@ BookmarkNode* BookmarkModel::AddNode(BookmarkNode* parent,
   FOR_EACH_OBSERVER(BookmarkModelObserver, observers_,
                     BookmarkNodeAdded(this, parent, index));
 
-  index_->Add(node);
+  AddNodeToIndex(node);
 
   return node;
 }
@@ -28,6 +28,7 @@
 
 class BookmarkExpandedStateTracker;
 class BookmarkIndex;
+class BookmarkIndexBuilder;
 class BookmarkLoadDetails;
 class BookmarkModel;
 class BookmarkModelObserver;
@@ -397,6 +398,8 @@ class BookmarkModel : public content::NotificationObserver,
   // combobox of most recently modified folders.
   void ResetDateFolderModified(const BookmarkNode* node);
 
+  // Returns up to |max_count| of the bookmarks whose titles match |text|.
+  // If the title index is still being built, it is built right away instead.
   void GetBookmarksWithTitlesMatching(
       const base::string16& text,
       size_t max_count,
@@ -462,6 +465,18 @@ class BookmarkModel : public content::NotificationObserver,
   // BookmarkModel takes ownership of |details|.
   void DoneLoading(BookmarkLoadDetails* details);
 
+  // Invoked when the index of the loaded bookmarks has been built. Takes the
+  // index from |index_builder_|.
+  void DoneBuildingIndex();
+
+  // Waits for |index_builder_| to build the index, then takes it.
+  void WaitForIndex();
+
+  // Adds |node| to or removes it from the title index, or records the change
+  // with |index_builder_| if the index is not ready yet.
+  void AddNodeToIndex(const BookmarkNode* node);
+  void RemoveNodeFromIndex(const BookmarkNode* node);
+
   // Populates |nodes_ordered_by_url_set_| from root.
   void PopulateNodesByURL(BookmarkNode* node);
 
@@ -566,7 +581,10 @@ class BookmarkModel : public content::NotificationObserver,
   // Reads/writes bookmarks to disk.
   scoped_refptr<BookmarkStorage> store_;
 
+  // The title index. NULL until the index is built, while |index_builder_|
+  // builds it.
   scoped_ptr<BookmarkIndex> index_;
+  scoped_refptr<BookmarkIndexBuilder> index_builder_;
 
   base::WaitableEvent loaded_signal_;
 
@@ -9,20 +9,33 @@
 
 #include "base/base_paths.h"
 #include "base/basictypes.h"
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/compiler_specific.h"
 #include "base/containers/hash_tables.h"
+#include "base/file_util.h"
+#include "base/json/json_string_value_serializer.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/path_service.h"
+#include "base/run_loop.h"
 #include "base/strings/string16.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/thread.h"
 #include "base/time/time.h"
+#include "base/values.h"
+#include "chrome/browser/bookmarks/bookmark_codec.h"
+#include "chrome/browser/bookmarks/bookmark_index.h"
+#include "chrome/browser/bookmarks/bookmark_index_builder.h"
+#include "chrome/browser/bookmarks/bookmark_journal.h"
 #include "chrome/browser/bookmarks/bookmark_model_factory.h"
 #include "chrome/browser/bookmarks/bookmark_model_observer.h"
 #include "chrome/browser/bookmarks/bookmark_test_helpers.h"
+#include "chrome/browser/bookmarks/bookmark_title_match.h"
 #include "chrome/browser/bookmarks/bookmark_utils.h"
+#include "chrome/common/chrome_constants.h"
 #include "chrome/test/base/testing_profile.h"
 #include "content/public/test/test_browser_thread_bundle.h"
 #include "testing/gtest/include/gtest/gtest.h"
@@ -266,6 +279,22 @@ class BookmarkModelTest : public testing::Test,
 
   int AllNodesRemovedObserverCount() const { return all_bookmarks_removed_; }
 
+  // Puts the model back in the state it is in right after loading from disk,
+  // with the title index still being built by |builder|.
+  void StartBuildingIndex(BookmarkIndexBuilder* builder) {
+    model_.index_.reset();
+    model_.index_builder_ = builder;
+  }
+
+  // Called when |builder| has built the index, as BookmarkStorage does.
+  void DoneBuildingIndex() { model_.DoneBuildingIndex(); }
+
+  size_t CountTitleMatches(const std::string& query) {
+    std::vector<BookmarkTitleMatch> matches;
+    model_.GetBookmarksWithTitlesMatching(ASCIIToUTF16(query), 100, &matches);
+    return matches.size();
+  }
+
  protected:
   BookmarkModel model_;
   ObserverDetails observer_details_;
@@ -778,6 +807,57 @@ TEST_F(BookmarkModelTest, GetBookmarksWithDups) {
   EXPECT_EQ(1U, bookmarks.size());
 }
 
+// A title query made before the index is built on the background thread
+// waits for it, and sees the nodes added in the meantime.
+TEST_F(BookmarkModelTest, QueryBeforeIndexBuilt) {
+  const GURL url("http://foo.com/");
+  model_.AddURL(model_.bookmark_bar_node(), 0, ASCIIToUTF16("google mail"),
+                url);
+
+  scoped_refptr<BookmarkIndexBuilder> builder(
+      new BookmarkIndexBuilder(new BookmarkIndex(NULL)));
+  builder->AddNodes(model_.bookmark_bar_node());
+  StartBuildingIndex(builder.get());
+  model_.AddURL(model_.bookmark_bar_node(), 1, ASCIIToUTF16("google maps"),
+                url);
+
+  base::Thread index_thread("BookmarkIndexBuilder");
+  ASSERT_TRUE(index_thread.Start());
+  index_thread.message_loop()->PostTask(
+      FROM_HERE, base::Bind(&BookmarkIndexBuilder::Build, builder));
+  EXPECT_EQ(2U, CountTitleMatches("google"));
+  EXPECT_EQ(1U, CountTitleMatches("maps"));
+  index_thread.Stop();
+  EXPECT_TRUE(builder->HasOneRef());
+
+  // The model has already taken the index.
+  DoneBuildingIndex();
+  model_.Remove(model_.bookmark_bar_node(), 0);
+  EXPECT_EQ(1U, CountTitleMatches("google"));
+  EXPECT_EQ(0U, CountTitleMatches("mail"));
+}
+
+// A title query made once the index is built, but before the model was told,
+// takes that index.
+TEST_F(BookmarkModelTest, QueryAfterIndexBuilt) {
+  const GURL url("http://foo.com/");
+  model_.AddURL(model_.bookmark_bar_node(), 0, ASCIIToUTF16("google mail"),
+                url);
+
+  scoped_refptr<BookmarkIndexBuilder> builder(
+      new BookmarkIndexBuilder(new BookmarkIndex(NULL)));
+  builder->AddNodes(model_.bookmark_bar_node());
+  StartBuildingIndex(builder.get());
+  model_.AddURL(model_.bookmark_bar_node(), 1, ASCIIToUTF16("google maps"),
+                url);
+  builder->Build();
+  EXPECT_EQ(2U, CountTitleMatches("google"));
+  EXPECT_TRUE(builder->HasOneRef());
+
+  DoneBuildingIndex();
+  EXPECT_EQ(2U, CountTitleMatches("google"));
+}
+
 TEST_F(BookmarkModelTest, HasBookmarks) {
   const GURL url("http://foo.com/");
   model_.AddURL(model_.bookmark_bar_node(), 0, ASCIIToUTF16("bar"), url);
@@ -909,6 +989,42 @@ class BookmarkModelTestWithProfile : public testing::Test {
     test::WaitForBookmarkModelToLoad(bb_model_);
   }
 
+  // Returns the JSON bookmarks file for |model|, including the saves to the
+  // journal file up to |journal_sequence|.
+  std::string EncodeJSON(BookmarkModel* model, int64 journal_sequence) {
+    BookmarkCodec codec;
+    scoped_ptr<base::Value> value(codec.Encode(model));
+    static_cast<base::DictionaryValue*>(value.get())->SetString(
+        BookmarkCodec::kJournalSequenceKey,
+        base::Int64ToString(journal_sequence));
+    std::string json;
+    JSONStringValueSerializer serializer(&json);
+    EXPECT_TRUE(serializer.Serialize(*value));
+    return json;
+  }
+
+  base::FilePath JournalPath() {
+    return profile_->GetPath().Append(chrome::kBookmarksFileName)
+        .AddExtension(FILE_PATH_LITERAL("journal"));
+  }
+
+  // Replaces the profile with a new one whose bookmarks file is |json| and
+  // whose journal file is |journal|, and loads its bookmarks.
+  void LoadFromFiles(const std::string& json, const std::string& journal) {
+    profile_.reset(NULL);
+    profile_.reset(new TestingProfile());
+    int json_size = static_cast<int>(json.size());
+    ASSERT_EQ(json_size, file_util::WriteFile(
+        profile_->GetPath().Append(chrome::kBookmarksFileName),
+        json.data(), json_size));
+    int journal_size = static_cast<int>(journal.size());
+    ASSERT_EQ(journal_size,
+              file_util::WriteFile(JournalPath(), journal.data(),
+                                   journal_size));
+    profile_->CreateBookmarkModel(false);
+    BlockTillBookmarkModelLoaded();
+  }
+
   // The profile.
   scoped_ptr<TestingProfile> profile_;
   BookmarkModel* bb_model_;
@@ -969,6 +1085,109 @@ TEST_F(BookmarkModelTestWithProfile, CreateAndRestore) {
   }
 }
 
+// A journal file whose saves are all included in the JSON file is stale. It is
+// deleted rather than read, so the changes written to the JSON file after it
+// are kept.
+TEST_F(BookmarkModelTestWithProfile, StaleJournalIsIgnored) {
+  profile_.reset(new TestingProfile());
+  profile_->CreateBookmarkModel(true);
+  BlockTillBookmarkModelLoaded();
+  const BookmarkNode* bar = bb_model_->bookmark_bar_node();
+  bb_model_->AddURL(bar, 0, ASCIIToUTF16("a"), GURL("http://a.com/"));
+  BookmarkJournal journal;
+  std::string journal_data;
+  ASSERT_TRUE(journal.Encode(bb_model_, &journal_data));
+  bb_model_->AddURL(bar, 1, ASCIIToUTF16("b"), GURL("http://b.com/"));
+  std::string json_data = EncodeJSON(bb_model_, journal.sequence());
+
+  ASSERT_NO_FATAL_FAILURE(LoadFromFiles(json_data, journal_data));
+  bar = bb_model_->bookmark_bar_node();
+  ASSERT_EQ(2, bar->child_count());
+  EXPECT_EQ(ASCIIToUTF16("b"), bar->GetChild(1)->GetTitle());
+  EXPECT_FALSE(base::PathExists(JournalPath()));
+}
+
+// A journal file with saves the JSON file does not include is read instead.
+TEST_F(BookmarkModelTestWithProfile, NewerJournalIsLoaded) {
+  profile_.reset(new TestingProfile());
+  profile_->CreateBookmarkModel(true);
+  BlockTillBookmarkModelLoaded();
+  const BookmarkNode* bar = bb_model_->bookmark_bar_node();
+  bb_model_->AddURL(bar, 0, ASCIIToUTF16("a"), GURL("http://a.com/"));
+  BookmarkJournal journal;
+  std::string journal_data;
+  ASSERT_TRUE(journal.Encode(bb_model_, &journal_data));
+  std::string json_data = EncodeJSON(bb_model_, journal.sequence());
+  bb_model_->AddURL(bar, 1, ASCIIToUTF16("b"), GURL("http://b.com/"));
+  std::string changes;
+  ASSERT_FALSE(journal.Encode(bb_model_, &changes));
+  journal_data += changes;
+
+  ASSERT_NO_FATAL_FAILURE(LoadFromFiles(json_data, journal_data));
+  bar = bb_model_->bookmark_bar_node();
+  ASSERT_EQ(2, bar->child_count());
+  EXPECT_EQ(ASCIIToUTF16("b"), bar->GetChild(1)->GetTitle());
+}
+
+// With --enable-bookmark-journal a journal file holding every save the JSON
+// file does is read instead, and the JSON file is neither parsed nor
+// rewritten.
+TEST_F(BookmarkModelTestWithProfile, JournalIsPrimaryStore) {
+  CommandLine original_command_line(*CommandLine::ForCurrentProcess());
+  CommandLine::ForCurrentProcess()->AppendSwitch("enable-bookmark-journal");
+  profile_.reset(new TestingProfile());
+  profile_->CreateBookmarkModel(true);
+  BlockTillBookmarkModelLoaded();
+  const BookmarkNode* bar = bb_model_->bookmark_bar_node();
+  bb_model_->AddURL(bar, 0, ASCIIToUTF16("a"), GURL("http://a.com/"));
+  std::string json_data = EncodeJSON(bb_model_, 1);
+  bb_model_->AddURL(bar, 1, ASCIIToUTF16("b"), GURL("http://b.com/"));
+  BookmarkJournal journal;
+  std::string journal_data;
+  ASSERT_TRUE(journal.Encode(bb_model_, &journal_data));
+  ASSERT_EQ(1, journal.sequence());
+
+  ASSERT_NO_FATAL_FAILURE(LoadFromFiles(json_data, journal_data));
+  base::RunLoop().RunUntilIdle();
+  bar = bb_model_->bookmark_bar_node();
+  ASSERT_EQ(2, bar->child_count());
+  EXPECT_EQ(ASCIIToUTF16("b"), bar->GetChild(1)->GetTitle());
+  std::string json_after_load;
+  ASSERT_TRUE(base::ReadFileToString(
+      profile_->GetPath().Append(chrome::kBookmarksFileName),
+      &json_after_load));
+  EXPECT_EQ(json_data, json_after_load);
+  EXPECT_TRUE(base::PathExists(JournalPath()));
+  *CommandLine::ForCurrentProcess() = original_command_line;
+}
+
+// A journal file next to a JSON file written by a build which did not keep it
+// is stale, even when the journal file is the primary store.
+TEST_F(BookmarkModelTestWithProfile, JournalIgnoredNextToOlderJSON) {
+  CommandLine original_command_line(*CommandLine::ForCurrentProcess());
+  CommandLine::ForCurrentProcess()->AppendSwitch("enable-bookmark-journal");
+  profile_.reset(new TestingProfile());
+  profile_->CreateBookmarkModel(true);
+  BlockTillBookmarkModelLoaded();
+  const BookmarkNode* bar = bb_model_->bookmark_bar_node();
+  bb_model_->AddURL(bar, 0, ASCIIToUTF16("a"), GURL("http://a.com/"));
+  BookmarkJournal journal;
+  std::string journal_data;
+  ASSERT_TRUE(journal.Encode(bb_model_, &journal_data));
+  bb_model_->AddURL(bar, 1, ASCIIToUTF16("b"), GURL("http://b.com/"));
+  BookmarkCodec codec;
+  scoped_ptr<base::Value> value(codec.Encode(bb_model_));
+  std::string json_data;
+  JSONStringValueSerializer serializer(&json_data);
+  ASSERT_TRUE(serializer.Serialize(*value));
+
+  ASSERT_NO_FATAL_FAILURE(LoadFromFiles(json_data, journal_data));
+  bar = bb_model_->bookmark_bar_node();
+  ASSERT_EQ(2, bar->child_count());
+  EXPECT_EQ(ASCIIToUTF16("b"), bar->GetChild(1)->GetTitle());
+  *CommandLine::ForCurrentProcess() = original_command_line;
+}
+
 TEST_F(BookmarkModelTest, Sort) {
   // Populate the bookmark bar node with nodes for 'B', 'a', 'd' and 'C'.
   // 'C' and 'a' are folders.
@@ -5,15 +5,20 @@
 #include "chrome/browser/bookmarks/bookmark_storage.h"
 
 #include "base/bind.h"
+#include "base/command_line.h"
 #include "base/compiler_specific.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/json/json_file_value_serializer.h"
 #include "base/json/json_string_value_serializer.h"
 #include "base/metrics/histogram.h"
+#include "base/strings/string_number_conversions.h"
 #include "base/time/time.h"
+#include "base/values.h"
 #include "chrome/browser/bookmarks/bookmark_codec.h"
 #include "chrome/browser/bookmarks/bookmark_index.h"
+#include "chrome/browser/bookmarks/bookmark_index_builder.h"
+#include "chrome/browser/bookmarks/bookmark_journal.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 #include "chrome/common/chrome_constants.h"
 #include "components/startup_metric_utils/startup_metric_utils.h"
@@ -28,39 +33,179 @@ namespace {
 // Extension used for backup files (copy of main file created during startup).
 const base::FilePath::CharType kBackupExtension[] = FILE_PATH_LITERAL("bak");
 
+// Extension of the journal file, which is next to the JSON file.
+const base::FilePath::CharType kJournalExtension[] =
+    FILE_PATH_LITERAL("journal");
+
+// Saves the changes made between writes of the JSON file to the journal file.
+const char kEnableBookmarkJournal[] = "enable-bookmark-journal";
+
 // How often we save.
 const int kSaveDelayMS = 2500;
 
+// How long changes wait before they are appended to the journal file.
+const int kJournalSaveDelayMS = 250;
+
+// How long the JSON file may miss changes in the journal file before the next
+// save compacts the journal file, which brings the JSON file up to date.
+const int kMaxJSONAgeMinutes = 30;
+
+// How much of the JSON file is read to find its journal sequence number.
+const int kJSONHeadSize = 256;
+
 void BackupCallback(const base::FilePath& path) {
   base::FilePath backup_path = path.ReplaceExtension(kBackupExtension);
   base::CopyFile(path, backup_path);
 }
 
-// Adds node to the model's index, recursing through all children as well.
-void AddBookmarksToIndex(BookmarkLoadDetails* details,
-                         BookmarkNode* node) {
-  if (node->is_url()) {
-    if (node->url().is_valid())
-      details->index()->Add(node);
-  } else {
-    for (int i = 0; i < node->child_count(); ++i)
-      AddBookmarksToIndex(details, node->GetChild(i));
+// Reads the sequence number of the last journal save which the JSON |root|
+// includes. Returns false if the JSON file has none, as it was written by a
+// build which did not keep the journal file.
+bool ReadJournalSequence(const base::Value& root, int64* sequence) {
+  const base::DictionaryValue* root_dict;
+  std::string sequence_string;
+  return root.GetAsDictionary(&root_dict) &&
+         root_dict->GetString(BookmarkCodec::kJournalSequenceKey,
+                              &sequence_string) &&
+         base::StringToInt64(sequence_string, sequence);
+}
+
+// Reads the sequence number of the last journal save which the JSON file at
+// |path| includes from the head of the file, without parsing the rest. The
+// keys are written sorted, so it comes before the bookmarks. Returns false if
+// the JSON file has none, as it was written by a build which did not keep the
+// journal file.
+bool PeekJournalSequence(const base::FilePath& path, int64* sequence) {
+  char buffer[kJSONHeadSize];
+  int size = base::ReadFile(path, buffer, sizeof(buffer));
+  if (size <= 0)
+    return false;
+  std::string head(buffer, size);
+  std::string key =
+      std::string("\"") + BookmarkCodec::kJournalSequenceKey + "\"";
+  size_t key_pos = head.find(key);
+  if (key_pos == std::string::npos)
+    return false;
+  size_t begin = head.find('"', key_pos + key.size());
+  if (begin == std::string::npos)
+    return false;
+  size_t end = head.find('"', begin + 1);
+  if (end == std::string::npos)
+    return false;
+  return base::StringToInt64(head.substr(begin + 1, end - begin - 1),
+                             sequence);
+}
+
+// Serializes the encoded bookmarks |value| to |output|, recording |sequence|
+// as the last journal save they include.
+bool SerializeJSON(base::Value* value, int64 sequence, std::string* output) {
+  static_cast<base::DictionaryValue*>(value)->SetString(
+      BookmarkCodec::kJournalSequenceKey, base::Int64ToString(sequence));
+  JSONStringValueSerializer serializer(output);
+  serializer.set_pretty_print(true);
+  return serializer.Serialize(*value);
+}
+
+// Decodes the journal file |data| and writes the bookmarks to the JSON file at
+// |path|, for builds which do not read the journal file. This runs on the
+// background thread, so the UI thread never encodes the JSON while the
+// journal file is the primary store.
+void WriteJSONFromJournal(const base::FilePath& path,
+                          const std::string& data) {
+  TimeTicks start_time = TimeTicks::Now();
+  BookmarkJournal journal;
+  scoped_ptr<BookmarkPermanentNode> bb_node(new BookmarkPermanentNode(0));
+  scoped_ptr<BookmarkPermanentNode> other_folder_node(
+      new BookmarkPermanentNode(0));
+  scoped_ptr<BookmarkPermanentNode> mobile_folder_node(
+      new BookmarkPermanentNode(0));
+  int64 max_node_id = 0;
+  if (!journal.Decode(bb_node.get(), other_folder_node.get(),
+                      mobile_folder_node.get(), &max_node_id, data, 0)) {
+    return;
   }
+
+  BookmarkCodec codec;
+  const BookmarkNode::MetaInfoMap& meta_info_map =
+      journal.model_meta_info_map();
+  scoped_ptr<base::Value> value(codec.Encode(
+      bb_node.get(), other_folder_node.get(), mobile_folder_node.get(),
+      meta_info_map.empty() ? NULL : &meta_info_map,
+      journal.model_sync_transaction_version()));
+  std::string json;
+  if (!SerializeJSON(value.get(), journal.sequence(), &json))
+    return;
+  base::ImportantFileWriter::WriteFileAtomically(path, json);
+  UMA_HISTOGRAM_TIMES("Bookmarks.JSONFromJournalTime",
+                      TimeTicks::Now() - start_time);
 }
 
-void LoadCallback(const base::FilePath& path,
-                  BookmarkStorage* storage,
-                  BookmarkLoadDetails* details) {
-  startup_metric_utils::ScopedSlowStartupUMA
-      scoped_timer("Startup.SlowStartupBookmarksLoad");
-  bool bookmark_file_exists = base::PathExists(path);
-  if (bookmark_file_exists) {
+// Decodes the journal file at |path| to |details| if its last save is
+// numbered |min_sequence| or above. Returns false if there is no journal file
+// or it could not be decoded, leaving |details| untouched.
+bool LoadJournal(const base::FilePath& path,
+                 int64 min_sequence,
+                 BookmarkJournal* journal,
+                 BookmarkLoadDetails* details) {
+  std::string data;
+  if (!base::PathExists(path) || !base::ReadFileToString(path, &data))
+    return false;
+
+  int64 max_node_id = 0;
+  TimeTicks start_time = TimeTicks::Now();
+  if (!journal->Decode(details->bb_node(), details->other_folder_node(),
+                       details->mobile_folder_node(), &max_node_id, data,
+                       min_sequence)) {
+    return false;
+  }
+  details->set_max_id(std::max(max_node_id, details->max_id()));
+  details->set_computed_checksum(journal->computed_checksum());
+  details->set_stored_checksum(journal->stored_checksum());
+  details->set_ids_reassigned(journal->ids_reassigned());
+  details->set_model_meta_info_map(journal->model_meta_info_map());
+  details->set_model_sync_transaction_version(
+      journal->model_sync_transaction_version());
+  details->set_loaded_from_journal(true);
+  UMA_HISTOGRAM_TIMES("Bookmarks.JournalDecodeTime",
+                      TimeTicks::Now() - start_time);
+  UMA_HISTOGRAM_COUNTS("Bookmarks.JournalAppendedRecords",
+                       journal->appended_records());
+  return true;
+}
+
+// Loads the bookmarks from the JSON file at |path|, or from the journal file
+// at |journal_path| if it holds saves the JSON file does not include. The
+// journal file is stale otherwise, as is one next to a JSON file written by a
+// build which did not keep it, and is deleted. Returns false if there is
+// neither.
+bool LoadJSON(const base::FilePath& path,
+              const base::FilePath& journal_path,
+              BookmarkLoadDetails* details,
+              BookmarkJournal* journal) {
+  scoped_ptr<base::Value> root;
+  if (base::PathExists(path)) {
     JSONFileValueSerializer serializer(path);
-    scoped_ptr<base::Value> root(serializer.Deserialize(NULL, NULL));
+    root.reset(serializer.Deserialize(NULL, NULL));
+  }
+  int64 json_sequence = 0;
+  bool has_json_sequence =
+      root.get() && ReadJournalSequence(*root, &json_sequence);
+
+  bool loaded = false;
+  if (base::PathExists(journal_path)) {
+    int64 min_sequence = 0;
+    if (root.get())
+      min_sequence = has_json_sequence ? json_sequence + 1 : kint64max;
+    loaded = LoadJournal(journal_path, min_sequence, journal, details);
+    if (!loaded)
+      base::DeleteFile(journal_path, false);
+  }
 
+  if (!loaded) {
+    // Later saves to the journal file are numbered after those the JSON file
+    // includes.
+    journal->set_sequence(json_sequence);
     if (root.get()) {
-      // Building the index can take a while, so we do it on the background
-      // thread.
       int64 max_node_id = 0;
       BookmarkCodec codec;
       TimeTicks start_time = TimeTicks::Now();
@@ -75,19 +220,97 @@ void LoadCallback(const base::FilePath& path,
           codec.model_sync_transaction_version());
       UMA_HISTOGRAM_TIMES("Bookmarks.DecodeTime",
                           TimeTicks::Now() - start_time);
-
-      start_time = TimeTicks::Now();
-      AddBookmarksToIndex(details, details->bb_node());
-      AddBookmarksToIndex(details, details->other_folder_node());
-      AddBookmarksToIndex(details, details->mobile_folder_node());
-      UMA_HISTOGRAM_TIMES("Bookmarks.CreateBookmarkIndexTime",
-                          TimeTicks::Now() - start_time);
+      loaded = true;
     }
   }
+  return loaded;
+}
+
+void LoadCallback(const base::FilePath& path,
+                  const base::FilePath& journal_path,
+                  bool use_journal,
+                  BookmarkStorage* storage,
+                  BookmarkLoadDetails* details,
+                  BookmarkJournal* journal) {
+  startup_metric_utils::ScopedSlowStartupUMA
+      scoped_timer("Startup.SlowStartupBookmarksLoad");
+
+  // When the journal file is the primary store the JSON file is not parsed,
+  // unless it holds saves the journal file does not, or was written by a build
+  // which did not keep the journal file.
+  bool loaded = false;
+  if (use_journal && base::PathExists(journal_path)) {
+    int64 json_sequence = 0;
+    if (!base::PathExists(path) || PeekJournalSequence(path, &json_sequence))
+      loaded = LoadJournal(journal_path, json_sequence, journal, details);
+    if (!loaded)
+      base::DeleteFile(journal_path, false);
+  }
+  if (!loaded)
+    loaded = LoadJSON(path, journal_path, details, journal);
+
+  // Building the index can take a while, so we do it on the background
+  // thread, and only once the model has the bookmarks.
+  scoped_refptr<BookmarkIndexBuilder> index_builder(details->index_builder());
+  if (loaded) {
+    index_builder->AddNodes(details->bb_node());
+    index_builder->AddNodes(details->other_folder_node());
+    index_builder->AddNodes(details->mobile_folder_node());
+  }
 
   BrowserThread::PostTask(
       BrowserThread::UI, FROM_HERE,
       base::Bind(&BookmarkStorage::OnLoadFinished, storage));
+
+  index_builder->Build();
+  BrowserThread::PostTask(
+      BrowserThread::UI, FROM_HERE,
+      base::Bind(&BookmarkStorage::OnIndexBuilt, storage));
+}
+
+// Writes |data| to the journal file at |path|, replacing the file if
+// |replace| and appending to it otherwise. If |json_path| is not empty the
+// snapshot |data| is then written to the JSON file at |json_path| too.
+void WriteJournalCallback(const base::FilePath& path,
+                          const base::FilePath& json_path,
+                          const std::string& data,
+                          bool replace,
+                          BookmarkStorage* storage) {
+  bool success;
+  if (replace) {
+    success = base::ImportantFileWriter::WriteFileAtomically(path, data);
+  } else {
+    int size = static_cast<int>(data.size());
+    success = file_util::AppendToFile(path, data.data(), size) == size;
+  }
+  if (!success) {
+    BrowserThread::PostTask(
+        BrowserThread::UI, FROM_HERE,
+        base::Bind(&BookmarkStorage::OnJournalWriteFailed, storage));
+    return;
+  }
+  if (replace && !json_path.empty())
+    WriteJSONFromJournal(json_path, data);
+}
+
+// Brings the JSON file at |json_path| up to date with the journal file at
+// |path|.
+void WriteJSONFromJournalFileCallback(const base::FilePath& path,
+                                      const base::FilePath& json_path) {
+  std::string data;
+  if (base::ReadFileToString(path, &data))
+    WriteJSONFromJournal(json_path, data);
+}
+
+// Writes |data| to the JSON file at |path|, and deletes the journal file at
+// |journal_path| once the write has succeeded, as the JSON file then includes
+// every save to it. If the write fails the journal is kept, and is loaded
+// again on the next run.
+void WriteJSONCallback(const base::FilePath& path,
+                       const base::FilePath& journal_path,
+                       const std::string& data) {
+  if (base::ImportantFileWriter::WriteFileAtomically(path, data))
+    base::DeleteFile(journal_path, false);
 }
 
 }  // namespace
@@ -103,11 +326,12 @@ BookmarkLoadDetails::BookmarkLoadDetails(
     : bb_node_(bb_node),
       other_folder_node_(other_folder_node),
       mobile_folder_node_(mobile_folder_node),
-      index_(index),
+      index_builder_(new BookmarkIndexBuilder(index)),
       model_sync_transaction_version_(
           BookmarkNode::kInvalidSyncTransactionVersion),
       max_id_(max_id),
-      ids_reassigned_(false) {
+      ids_reassigned_(false),
+      loaded_from_journal_(false) {
 }
 
 BookmarkLoadDetails::~BookmarkLoadDetails() {
@@ -121,7 +345,12 @@ BookmarkStorage::BookmarkStorage(
     base::SequencedTaskRunner* sequenced_task_runner)
     : model_(model),
       writer_(context->GetPath().Append(chrome::kBookmarksFileName),
-              sequenced_task_runner) {
+              sequenced_task_runner),
+      use_journal_(CommandLine::ForCurrentProcess()->HasSwitch(
+          kEnableBookmarkJournal)),
+      journal_path_(writer_.path().AddExtension(kJournalExtension)),
+      journal_(new BookmarkJournal),
+      json_current_(true) {
   sequenced_task_runner_ = sequenced_task_runner;
   writer_.set_commit_interval(base::TimeDelta::FromMilliseconds(kSaveDelayMS));
   sequenced_task_runner_->PostTask(FROM_HERE,
@@ -137,14 +366,26 @@ void BookmarkStorage::LoadBookmarks(BookmarkLoadDetails* details) {
   DCHECK(!details_.get());
   DCHECK(details);
   details_.reset(details);
+  load_start_time_ = TimeTicks::Now();
   sequenced_task_runner_->PostTask(
       FROM_HERE,
-      base::Bind(&LoadCallback, writer_.path(), make_scoped_refptr(this),
-                 details_.get()));
+      base::Bind(&LoadCallback, writer_.path(), journal_path_, use_journal_,
+                 make_scoped_refptr(this), details_.get(), journal_.get()));
 }
 
 void BookmarkStorage::ScheduleSave() {
-  writer_.ScheduleWrite(this);
+  if (!use_journal_) {
+    writer_.ScheduleWrite(this);
+    return;
+  }
+  // Changes only go to the journal file. The JSON file is written when the
+  // journal file is compacted, and when the model is deleted.
+  json_current_ = false;
+  if (!journal_timer_.IsRunning()) {
+    journal_timer_.Start(FROM_HERE,
+                         base::TimeDelta::FromMilliseconds(kJournalSaveDelayMS),
+                         this, &BookmarkStorage::SaveJournalNow);
+  }
 }
 
 void BookmarkStorage::BookmarkModelDeleted() {
@@ -152,22 +393,72 @@ void BookmarkStorage::BookmarkModelDeleted() {
   // the model is gone.
   if (writer_.HasPendingWrite())
     SaveNow();
+  if (journal_timer_.IsRunning()) {
+    journal_timer_.Stop();
+    SaveJournalNow();
+  }
+  // Bring the JSON file up to date on the background thread, so that a build
+  // which does not read the journal file gets every change.
+  if (use_journal_ && !json_current_) {
+    json_current_ = true;
+    sequenced_task_runner_->PostTask(
+        FROM_HERE,
+        base::Bind(&WriteJSONFromJournalFileCallback, journal_path_,
+                   writer_.path()));
+  }
   model_ = NULL;
 }
 
 bool BookmarkStorage::SerializeData(std::string* output) {
   BookmarkCodec codec;
   scoped_ptr<base::Value> value(codec.Encode(model_));
-  JSONStringValueSerializer serializer(output);
-  serializer.set_pretty_print(true);
-  return serializer.Serialize(*(value.get()));
+  return SerializeJSON(value.get(), journal_->sequence(), output);
 }
 
 void BookmarkStorage::OnLoadFinished() {
   if (!model_)
     return;
 
+  UMA_HISTOGRAM_TIMES("Bookmarks.TimeToModelLoaded",
+                      TimeTicks::Now() - load_start_time_);
+  bool loaded_from_journal = details_->loaded_from_journal();
+  // The JSON file misses the changes appended to the journal file since it
+  // was last compacted.
+  json_current_ = !loaded_from_journal || journal_->appended_records() == 0;
+  json_written_time_ = TimeTicks::Now();
   model_->DoneLoading(details_.release());
+
+  if (use_journal_) {
+    // Bookmarks read from the JSON file are written to a snapshot of the
+    // journal file, which the next load reads instead.
+    if (!loaded_from_journal && !journal_timer_.IsRunning()) {
+      journal_timer_.Start(FROM_HERE,
+                           base::TimeDelta::FromMilliseconds(
+                               kJournalSaveDelayMS),
+                           this, &BookmarkStorage::SaveJournalNow);
+    }
+    return;
+  }
+
+  // The JSON file misses the changes read from the journal file, so bring it
+  // up to date, which also deletes the journal file.
+  if (loaded_from_journal)
+    SaveJSONNow();
+}
+
+void BookmarkStorage::OnIndexBuilt() {
+  UMA_HISTOGRAM_TIMES("Bookmarks.TimeToIndexReady",
+                      TimeTicks::Now() - load_start_time_);
+  if (model_)
+    model_->DoneBuildingIndex();
+}
+
+void BookmarkStorage::OnJournalWriteFailed() {
+  // The journal file may end in a partial save, so replace it with the next
+  // save.
+  journal_->Reset();
+  if (model_)
+    ScheduleSave();
 }
 
 bool BookmarkStorage::SaveNow() {
@@ -184,3 +475,63 @@ bool BookmarkStorage::SaveNow() {
   writer_.WriteNow(data);
   return true;
 }
+
+void BookmarkStorage::SaveJSONNow() {
+  if (!model_ || !model_->loaded()) {
+    NOTREACHED();
+    return;
+  }
+
+  // The JSON file gets every change, so none are left for the journal file.
+  journal_timer_.Stop();
+  std::string data;
+  if (!SerializeData(&data))
+    return;
+  // The journal file is deleted once the JSON file is written, so the next
+  // save to it replaces it.
+  journal_->Reset();
+  sequenced_task_runner_->PostTask(
+      FROM_HERE,
+      base::Bind(&WriteJSONCallback, writer_.path(), journal_path_, data));
+}
+
+void BookmarkStorage::SaveJournalNow() {
+  if (!model_ || !model_->loaded()) {
+    NOTREACHED();
+    return;
+  }
+
+  // Compact the journal file if the JSON file has missed its changes for too
+  // long, so that the JSON file is brought up to date.
+  base::TimeDelta json_age = TimeTicks::Now() - json_written_time_;
+  if (!json_current_ &&
+      json_age > base::TimeDelta::FromMinutes(kMaxJSONAgeMinutes)) {
+    journal_->Reset();
+  }
+
+  std::string data;
+  TimeTicks start_time = TimeTicks::Now();
+  bool replace = journal_->Encode(model_, &data);
+  UMA_HISTOGRAM_TIMES("Bookmarks.JournalEncodeTime",
+                      TimeTicks::Now() - start_time);
+  if (data.empty())
+    return;
+  if (replace)
+    UMA_HISTOGRAM_COUNTS("Bookmarks.JournalSnapshotBytes", data.size());
+  else
+    UMA_HISTOGRAM_COUNTS("Bookmarks.JournalAppendBytes", data.size());
+
+  // A snapshot compacts the journal file, and the JSON file is written from
+  // it on the background thread unless it is current already.
+  base::FilePath json_path;
+  if (replace && !json_current_) {
+    json_path = writer_.path();
+    json_written_time_ = TimeTicks::Now();
+  }
+  if (replace)
+    json_current_ = true;
+  sequenced_task_runner_->PostTask(
+      FROM_HERE,
+      base::Bind(&WriteJournalCallback, journal_path_, json_path, data,
+                 replace, make_scoped_refptr(this)));
+}
@@ -8,9 +8,13 @@
 #include "base/files/important_file_writer.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 
 class BookmarkIndex;
+class BookmarkIndexBuilder;
+class BookmarkJournal;
 class BookmarkModel;
 class BookmarkPermanentNode;
 
@@ -24,12 +28,14 @@ class BrowserContext;
 
 // BookmarkLoadDetails is used by BookmarkStorage when loading bookmarks.
 // BookmarkModel creates a BookmarkLoadDetails and passes it (including
-// ownership) to BookmarkStorage. BookmarkStorage loads the bookmarks (and
-// index) in the background thread, then calls back to the BookmarkModel (on
-// the main thread) when loading is done, passing ownership back to the
-// BookmarkModel. While loading BookmarkModel does not maintain references to
-// the contents of the BookmarkLoadDetails, this ensures we don't have any
-// threading problems.
+// ownership) to BookmarkStorage. BookmarkStorage loads the bookmarks in the
+// background thread, then calls back to the BookmarkModel (on the main thread)
+// when loading is done, passing ownership back to the BookmarkModel. While
+// loading BookmarkModel does not maintain references to the contents of the
+// BookmarkLoadDetails, this ensures we don't have any threading problems.
+//
+// The index is built by the index builder on the background thread after the
+// bookmarks are handed to the model. See BookmarkIndexBuilder.
 class BookmarkLoadDetails {
  public:
   BookmarkLoadDetails(BookmarkPermanentNode* bb_node,
@@ -53,8 +59,7 @@ class BookmarkLoadDetails {
   BookmarkPermanentNode* release_other_folder_node() {
     return other_folder_node_.release();
   }
-  BookmarkIndex* index() { return index_.get(); }
-  BookmarkIndex* release_index() { return index_.release(); }
+  BookmarkIndexBuilder* index_builder() { return index_builder_.get(); }
 
   const BookmarkNode::MetaInfoMap& model_meta_info_map() const {
     return model_meta_info_map_;
@@ -93,17 +98,23 @@ class BookmarkLoadDetails {
   void set_ids_reassigned(bool value) { ids_reassigned_ = value; }
   bool ids_reassigned() const { return ids_reassigned_; }
 
+  // Whether the bookmarks were read from the journal file rather than the
+  // JSON file.
+  void set_loaded_from_journal(bool value) { loaded_from_journal_ = value; }
+  bool loaded_from_journal() const { return loaded_from_journal_; }
+
  private:
   scoped_ptr<BookmarkPermanentNode> bb_node_;
   scoped_ptr<BookmarkPermanentNode> other_folder_node_;
   scoped_ptr<BookmarkPermanentNode> mobile_folder_node_;
-  scoped_ptr<BookmarkIndex> index_;
+  scoped_refptr<BookmarkIndexBuilder> index_builder_;
   BookmarkNode::MetaInfoMap model_meta_info_map_;
   int64 model_sync_transaction_version_;
   int64 max_id_;
   std::string computed_checksum_;
   std::string stored_checksum_;
   bool ids_reassigned_;
+  bool loaded_from_journal_;
 
   DISALLOW_COPY_AND_ASSIGN(BookmarkLoadDetails);
 };
@@ -113,6 +124,20 @@ class BookmarkLoadDetails {
 // as notifying the BookmarkStorage every time the model changes.
 //
 // Internally BookmarkStorage uses BookmarkCodec to do the actual read/write.
+// With --enable-bookmark-journal the journal file next to the JSON file,
+// written with BookmarkJournal, is the primary store instead. Changes are only
+// appended to it, and bookmarks are loaded from it without parsing the JSON
+// file. The JSON file is written for builds which do not read the journal
+// file: from each snapshot which compacts the journal file, and from the
+// journal file when the model is deleted. Both are done on the background
+// thread, so the UI thread never encodes the JSON.
+//
+// The JSON file records the sequence number of the last journal save it
+// includes. A journal file is read instead of the JSON file only if it holds
+// every save the JSON file does; otherwise, or next to a JSON file written by
+// a build which did not keep it, it is stale and deleted. Without the switch a
+// journal file is only read if it holds later saves, and the bookmarks read
+// from it are written to the JSON file right away, which deletes it.
 class BookmarkStorage : public base::ImportantFileWriter::DataSerializer,
                         public base::RefCountedThreadSafe<BookmarkStorage> {
  public:
@@ -135,6 +160,12 @@ class BookmarkStorage : public base::ImportantFileWriter::DataSerializer,
   // Callback from backend after loading the bookmark file.
   void OnLoadFinished();
 
+  // Callback from backend after building the index of the loaded bookmarks.
+  void OnIndexBuilt();
+
+  // Callback from backend when writing to the journal file failed.
+  void OnJournalWriteFailed();
+
   // ImportantFileWriter::DataSerializer implementation.
   virtual bool SerializeData(std::string* output) OVERRIDE;
 
@@ -147,12 +178,43 @@ class BookmarkStorage : public base::ImportantFileWriter::DataSerializer,
   // Returns true on successful serialization.
   bool SaveNow();
 
+  // Writes the JSON file and then deletes the journal file. Used instead of
+  // |writer_| after loading from the journal file without the switch.
+  void SaveJSONNow();
+
+  // Encodes the changes to the model with |journal_| and writes them to the
+  // journal file. A snapshot also brings the JSON file up to date.
+  void SaveJournalNow();
+
   // The model. The model is NULL once BookmarkModelDeleted has been invoked.
   BookmarkModel* model_;
 
   // Helper to write bookmark data safely.
   base::ImportantFileWriter writer_;
 
+  // Whether the journal file is the primary store.
+  const bool use_journal_;
+
+  // Path of the journal file.
+  const base::FilePath journal_path_;
+
+  // Encodes the saves to the journal file. Used on the background thread to
+  // load the bookmarks, and on the UI thread once they are loaded.
+  scoped_ptr<BookmarkJournal> journal_;
+
+  // Delays saves to the journal file when it is used.
+  base::OneShotTimer<BookmarkStorage> journal_timer_;
+
+  // Whether the JSON file includes every change to the model, or will once
+  // the pending writes are done. When the journal file is used.
+  bool json_current_;
+
+  // When the JSON file was last brought up to date.
+  base::TimeTicks json_written_time_;
+
+  // When LoadBookmarks() was called.
+  base::TimeTicks load_start_time_;
+
   // See class description of BookmarkLoadDetails for details on this.
   scoped_ptr<BookmarkLoadDetails> details_;
 
@@ -8,6 +8,7 @@
 
 #include "base/command_line.h"
 #include "base/logging.h"
+#include "base/metrics/histogram.h"
 #include "base/strings/string_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/threading/thread.h"
@@ -109,16 +110,22 @@ void ActivityDatabase::AdviseFlush(int size) {
     return;
   if (!batch_mode_ || size == kFlushImmediately ||
       size >= kSizeThresholdForFlush) {
-    if (!delegate_->FlushDatabase(&db_))
-      SoftFailureClose();
+    Flush();
   }
 }
 
 void ActivityDatabase::RecordBatchedActions() {
-  if (valid_db_) {
-    if (!delegate_->FlushDatabase(&db_))
-      SoftFailureClose();
-  }
+  if (valid_db_)
+    Flush();
+}
+
+void ActivityDatabase::Flush() {
+  base::TimeTicks start = base::TimeTicks::Now();
+  bool flushed = delegate_->FlushDatabase(&db_);
+  UMA_HISTOGRAM_TIMES("Extensions.ActivityLog.FlushTime",
+                      base::TimeTicks::Now() - start);
+  if (!flushed)
+    SoftFailureClose();
 }
 
 void ActivityDatabase::SetBatchModeForTesting(bool batch_mode) {
@@ -157,6 +157,10 @@ class ActivityDatabase {
   // of writing to disk multiple times a second.
   void RecordBatchedActions();
 
+  // Writes out the queued data through the delegate, recording how long the
+  // delegate took.
+  void Flush();
+
   // If an error is unrecoverable or occurred while we were trying to close
   // the database properly, we take "emergency" actions: break any outstanding
   // transactions, raze the database, and close. When next opened, the
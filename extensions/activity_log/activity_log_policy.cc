@@ -6,9 +6,13 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+
 #include "base/files/file_path.h"
 #include "base/json/json_string_value_serializer.h"
 #include "base/logging.h"
+#include "base/metrics/histogram.h"
+#include "base/rand_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/time/clock.h"
 #include "base/time/time.h"
@@ -46,16 +50,23 @@ base::Time ActivityLogPolicy::Now() const {
     return base::Time::Now();
 }
 
+const size_t ActivityLogDatabasePolicy::kMaxPendingActions;
+
 ActivityLogDatabasePolicy::ActivityLogDatabasePolicy(
     Profile* profile,
     const base::FilePath& database_name)
-    : ActivityLogPolicy(profile) {
+    : ActivityLogPolicy(profile),
+      overflow_policy_(OVERFLOW_DROP),
+      logged_actions_(0),
+      dropped_actions_(0) {
   CHECK(profile);
   base::FilePath profile_base_path = profile->GetPath();
   db_ = new ActivityDatabase(this);
   database_path_ = profile_base_path.Append(database_name);
 }
 
+ActivityLogDatabasePolicy::~ActivityLogDatabasePolicy() {}
+
 void ActivityLogDatabasePolicy::Init() {
   ScheduleAndForget(db_, &ActivityDatabase::Init, database_path_);
 }
@@ -70,6 +81,91 @@ sql::Connection* ActivityLogDatabasePolicy::GetDatabaseConnection() const {
   return db_->GetSqlConnection();
 }
 
+void ActivityLogDatabasePolicy::ScheduleQueueAction(
+    scoped_refptr<Action> action) {
+  bool schedule_drain;
+  {
+    base::AutoLock lock(pending_lock_);
+    schedule_drain = logged_actions_ == 0;
+    ++logged_actions_;
+    if (pending_actions_.size() < kMaxPendingActions)
+      pending_actions_.push_back(std::make_pair(action, 1));
+    else
+      AddOverflowingAction(action);
+  }
+  if (schedule_drain)
+    ScheduleAndForget(this, &ActivityLogDatabasePolicy::DrainPendingActions);
+}
+
+void ActivityLogDatabasePolicy::AddOverflowingAction(
+    scoped_refptr<Action> action) {
+  pending_lock_.AssertAcquired();
+  switch (overflow_policy_) {
+    case OVERFLOW_DROP:
+      ++dropped_actions_;
+      break;
+    case OVERFLOW_SAMPLE: {
+      // Reservoir sampling: the action replaces a random pending action with
+      // a probability of kMaxPendingActions / |logged_actions_|, which keeps
+      // every action logged since the last hand over equally likely to be
+      // pending.
+      uint64 slot = base::RandGenerator(logged_actions_);
+      if (slot < pending_actions_.size())
+        pending_actions_[slot] = std::make_pair(action, 1);
+      ++dropped_actions_;
+      break;
+    }
+    case OVERFLOW_COALESCE: {
+      if (pending_index_.empty()) {
+        for (size_t i = 0; i < pending_actions_.size(); ++i)
+          pending_index_.insert(std::make_pair(pending_actions_[i].first, i));
+      }
+      PendingActionIndex::const_iterator it = pending_index_.find(action);
+      if (it == pending_index_.end()) {
+        ++dropped_actions_;
+        break;
+      }
+      std::pair<scoped_refptr<Action>, int>& pending =
+          pending_actions_[it->second];
+      // Actions are only merged within a day, like CountingPolicy does.
+      if (pending.first->time().LocalMidnight() !=
+          action->time().LocalMidnight()) {
+        ++dropped_actions_;
+        break;
+      }
+      // The pending action may be shared with other users, so it is copied
+      // before its time is updated.
+      if (pending.second == 1)
+        pending.first = pending.first->Clone();
+      pending.first->set_time(std::max(pending.first->time(), action->time()));
+      ++pending.second;
+      break;
+    }
+  }
+}
+
+void ActivityLogDatabasePolicy::DrainPendingActions() {
+  PendingActions actions;
+  size_t dropped_actions;
+  {
+    base::AutoLock lock(pending_lock_);
+    actions.swap(pending_actions_);
+    dropped_actions = dropped_actions_;
+    logged_actions_ = 0;
+    dropped_actions_ = 0;
+    pending_index_.clear();
+  }
+
+  UMA_HISTOGRAM_COUNTS_10000("Extensions.ActivityLog.PendingActions",
+                             actions.size());
+  if (dropped_actions) {
+    UMA_HISTOGRAM_COUNTS_10000("Extensions.ActivityLog.DroppedActions",
+                               dropped_actions);
+  }
+  if (activity_database()->is_db_valid())
+    QueueActions(actions);
+}
+
 // static
 std::string ActivityLogPolicy::Util::Serialize(const base::Value* value) {
   std::string value_as_text;
@@ -176,4 +272,27 @@ bool ActivityLogPolicy::Util::DropObsoleteTables(sql::Connection* db) {
   return true;
 }
 
+const size_t ActivityLogPolicy::Util::kRowsPerInsert;
+
+// static
+std::string ActivityLogPolicy::Util::InsertRowsStatement(
+    const char* table_name,
+    const char* columns[],
+    size_t column_count,
+    size_t row_count) {
+  DCHECK_GT(column_count, 0u);
+  DCHECK_GT(row_count, 0u);
+  std::string column_names = columns[0];
+  std::string row = "SELECT ?";
+  for (size_t i = 1; i < column_count; ++i) {
+    column_names = column_names + ", " + columns[i];
+    row += ", ?";
+  }
+  std::string statement = base::StringPrintf(
+      "INSERT INTO %s (%s) %s", table_name, column_names.c_str(), row.c_str());
+  for (size_t i = 1; i < row_count; ++i)
+    statement += " UNION ALL " + row;
+  return statement;
+}
+
 }  // namespace extensions
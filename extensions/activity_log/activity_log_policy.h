@@ -14,6 +14,7 @@
 #include "base/bind_helpers.h"
 #include "base/callback.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/synchronization/lock.h"
 #include "base/values.h"
 #include "chrome/browser/extensions/activity_log/activity_actions.h"
 #include "chrome/browser/extensions/activity_log/activity_database.h"
@@ -123,6 +124,20 @@ class ActivityLogPolicy {
     // code.  Returns true on success, false on database error.
     static bool DropObsoleteTables(sql::Connection* db);
 
+    // The number of rows inserted at once by statements from
+    // InsertRowsStatement().  SQLite limits statements to 999 variables and
+    // 500 compound SELECTs, so rows may have up to 19 columns.
+    static const size_t kRowsPerInsert = 50;
+
+    // Returns an SQL statement inserting |row_count| rows into the
+    // |column_count| |columns| of |table_name|, with a variable for each
+    // column of each row.  The rows are inserted as a compound SELECT, which
+    // unlike a multi-row VALUES clause is supported by all SQLite versions.
+    static std::string InsertRowsStatement(const char* table_name,
+                                           const char* columns[],
+                                           size_t column_count,
+                                           size_t row_count);
+
    private:
     DISALLOW_IMPLICIT_CONSTRUCTORS(Util);
   };
@@ -188,6 +203,42 @@ class ActivityLogDatabasePolicy : public ActivityLogPolicy,
   virtual void DeleteDatabase() = 0;
 
  protected:
+  // What to do with an action logged while kMaxPendingActions actions are
+  // already waiting to be handed to the database thread, which happens when
+  // the database thread is stalled, for instance by a long flush.
+  enum OverflowPolicy {
+    // Drop the action.
+    OVERFLOW_DROP,
+    // Keep a uniform sample of the actions logged since the pending actions
+    // were last handed over.
+    OVERFLOW_SAMPLE,
+    // Merge the action into a pending action which only differs in the time,
+    // as CountingPolicy merges rows, or drop it if there is none.
+    OVERFLOW_COALESCE,
+  };
+
+  // Actions waiting to be queued on the database thread, each with the
+  // number of identical actions merged into it.
+  typedef std::vector<std::pair<scoped_refptr<Action>, int> > PendingActions;
+
+  // The most actions waiting to be handed to the database thread.
+  static const size_t kMaxPendingActions = 2000;
+
+  virtual ~ActivityLogDatabasePolicy();
+
+  // Hands |action| to QueueActions() on the database thread.  Actions logged
+  // while the database thread is busy are handed over together, with a single
+  // task.  May be called on any thread.
+  void ScheduleQueueAction(scoped_refptr<Action> action);
+
+  // Queues |actions| to be written by the next FlushDatabase().  Called on the
+  // database thread while the database is valid.
+  virtual void QueueActions(const PendingActions& actions) = 0;
+
+  void set_overflow_policy(OverflowPolicy overflow_policy) {
+    overflow_policy_ = overflow_policy;
+  }
+
   // The Schedule methods dispatch the calls to the database on a
   // separate thread.
   template<typename DatabaseType, typename DatabaseFunc>
@@ -224,10 +275,38 @@ class ActivityLogDatabasePolicy : public ActivityLogPolicy,
   sql::Connection* GetDatabaseConnection() const;
 
  private:
+  typedef std::map<scoped_refptr<Action>, size_t,
+                   ActionComparatorExcludingTime> PendingActionIndex;
+
+  // Handles an action logged while |pending_actions_| is full, according to
+  // |overflow_policy_|.  Called with |pending_lock_| held.
+  void AddOverflowingAction(scoped_refptr<Action> action);
+
+  // Hands the pending actions to QueueActions(); runs on the database thread.
+  void DrainPendingActions();
+
   // See the comments for the ActivityDatabase class for a discussion of how
   // database cleanup runs.
   ActivityDatabase* db_;
   base::FilePath database_path_;
+
+  OverflowPolicy overflow_policy_;
+
+  // Guards the members below, which are shared by the threads logging actions
+  // and the database thread.
+  base::Lock pending_lock_;
+
+  PendingActions pending_actions_;
+
+  // The number of actions logged since the pending actions were last handed
+  // over, including the dropped ones.  A task to hand them over is posted
+  // when this becomes non-zero.
+  size_t logged_actions_;
+  size_t dropped_actions_;
+
+  // The index of each pending action in |pending_actions_|.  Only built once
+  // actions overflow with OVERFLOW_COALESCE.
+  PendingActionIndex pending_index_;
 };
 
 }  // namespace extensions
@@ -93,4 +93,17 @@ TEST_F(ActivityLogPolicyUtilTest, ParseUrls) {
   EXPECT_TRUE(action->page_incognito());
 }
 
+// Test that statements inserting several rows have a variable for each
+// column of each row.
+TEST_F(ActivityLogPolicyUtilTest, InsertRowsStatement) {
+  const char* columns[] = {"count", "time"};
+  ASSERT_EQ("INSERT INTO log (count, time) SELECT ?, ?",
+            ActivityLogPolicy::Util::InsertRowsStatement(
+                "log", columns, arraysize(columns), 1));
+  ASSERT_EQ("INSERT INTO log (count, time) SELECT ?, ? UNION ALL SELECT ?, ?"
+            " UNION ALL SELECT ?, ?",
+            ActivityLogPolicy::Util::InsertRowsStatement(
+                "log", columns, arraysize(columns), 3));
+}
+
 }  // namespace extensions
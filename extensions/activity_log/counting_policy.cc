@@ -92,6 +92,13 @@ const char* kTableFieldTypes[] = {
     "INTEGER", "INTEGER", "INTEGER", "INTEGER", "INTEGER",
     "INTEGER"};
 
+// A row to be inserted into the main database table.  See FlushDatabase().
+struct NewRow {
+  int count;
+  int64 time;
+  std::vector<int64> matched_values;
+};
+
 // Miscellaneous SQL commands for initializing the database; these should be
 // idempotent.
 static const char kPolicyMiscSetup[] =
@@ -160,6 +167,7 @@ CountingPolicy::CountingPolicy(Profile* profile)
       string_table_("string_ids"),
       url_table_("url_ids"),
       retention_time_(base::TimeDelta::FromHours(60)) {
+  set_overflow_policy(OVERFLOW_COALESCE);
   for (size_t i = 0; i < arraysize(kAlwaysLog); i++) {
     api_arg_whitelist_.insert(
         std::make_pair(kAlwaysLog[i].type, kAlwaysLog[i].name));
@@ -191,36 +199,41 @@ bool CountingPolicy::InitDatabase(sql::Connection* db) {
 }
 
 void CountingPolicy::ProcessAction(scoped_refptr<Action> action) {
-  ScheduleAndForget(this, &CountingPolicy::QueueAction, action);
+  // Strip the action before it is queued, so that actions which only differ
+  // in the stripped fields are merged when the pending queue overflows.  The
+  // action may be shared with other users, so it is copied first.
+  action = action->Clone();
+  Util::StripPrivacySensitiveFields(action);
+  Util::StripArguments(api_arg_whitelist_, action);
+  ScheduleQueueAction(action);
 }
 
-void CountingPolicy::QueueAction(scoped_refptr<Action> action) {
-  if (activity_database()->is_db_valid()) {
-    action = action->Clone();
-    Util::StripPrivacySensitiveFields(action);
-    Util::StripArguments(api_arg_whitelist_, action);
-
-    // If the current action falls on a different date than the ones in the
-    // queue, flush the queue out now to prevent any false merging (actions
-    // from different days being merged).
-    base::Time new_date = action->time().LocalMidnight();
-    if (new_date != queued_actions_date_)
-      activity_database()->AdviseFlush(ActivityDatabase::kFlushImmediately);
-    queued_actions_date_ = new_date;
-
-    ActionQueue::iterator queued_entry = queued_actions_.find(action);
-    if (queued_entry == queued_actions_.end()) {
-      queued_actions_[action] = 1;
-    } else {
-      // Update the timestamp in the key to be the latest time seen.  Modifying
-      // the time is safe since that field is not involved in key comparisons
-      // in the map.
-      using std::max;
-      queued_entry->first->set_time(
-          max(queued_entry->first->time(), action->time()));
-      queued_entry->second++;
-    }
-    activity_database()->AdviseFlush(queued_actions_.size());
+void CountingPolicy::QueueActions(const PendingActions& actions) {
+  for (size_t i = 0; i < actions.size(); ++i)
+    QueueAction(actions[i].first, actions[i].second);
+  activity_database()->AdviseFlush(queued_actions_.size());
+}
+
+void CountingPolicy::QueueAction(scoped_refptr<Action> action, int count) {
+  // If the current action falls on a different date than the ones in the
+  // queue, flush the queue out now to prevent any false merging (actions
+  // from different days being merged).
+  base::Time new_date = action->time().LocalMidnight();
+  if (new_date != queued_actions_date_)
+    activity_database()->AdviseFlush(ActivityDatabase::kFlushImmediately);
+  queued_actions_date_ = new_date;
+
+  ActionQueue::iterator queued_entry = queued_actions_.find(action);
+  if (queued_entry == queued_actions_.end()) {
+    queued_actions_[action] = count;
+  } else {
+    // Update the timestamp in the key to be the latest time seen.  Modifying
+    // the time is safe since that field is not involved in key comparisons
+    // in the map.
+    using std::max;
+    queued_entry->first->set_time(
+        max(queued_entry->first->time(), action->time()));
+    queued_entry->second += count;
   }
 }
 
@@ -254,29 +267,28 @@ bool CountingPolicy::FlushDatabase(sql::Connection* db) {
   //      have the count incremented.
   //  2a. If found, increment the count using update_str and the rowid found in
   //      step 1, or
-  //  2b. If not found, insert a new row using insert_str.
+  //  2b. If not found, remember the row in new_rows.
+  // The new rows are then inserted together, Util::kRowsPerInsert at a time.
+  // No action in the queue can match a new row for another one, since the
+  // queue already merges the actions which would match, so deferring the
+  // inserts does not change which rows are incremented.
   std::string locate_str =
       "SELECT rowid FROM " + std::string(kTableName) +
       " WHERE time >= ? AND time < ?";
-  std::string insert_str =
-      "INSERT INTO " + std::string(kTableName) + "(count, time";
   std::string update_str =
       "UPDATE " + std::string(kTableName) +
       " SET count = count + ?, time = max(?, time)"
       " WHERE rowid = ?";
+  const char* insert_columns[2 + arraysize(matched_columns)] = {
+      "count", "time"};
 
   for (size_t i = 0; i < arraysize(matched_columns); i++) {
     locate_str = base::StringPrintf(
         "%s AND %s IS ?", locate_str.c_str(), matched_columns[i]);
-    insert_str =
-        base::StringPrintf("%s, %s", insert_str.c_str(), matched_columns[i]);
-  }
-  insert_str += ") VALUES (?, ?";
-  for (size_t i = 0; i < arraysize(matched_columns); i++) {
-    insert_str += ", ?";
+    insert_columns[i + 2] = matched_columns[i];
   }
   locate_str += " ORDER BY time DESC LIMIT 1";
-  insert_str += ")";
+  std::vector<NewRow> new_rows;
 
   for (ActionQueue::iterator i = queue.begin(); i != queue.end(); ++i) {
     const Action& action = *i->first;
@@ -381,24 +393,50 @@ bool CountingPolicy::FlushDatabase(sql::Connection* db) {
         return false;
     } else if (locate_statement.Succeeded()) {
       // No matching row was found, so we need to insert one.
-      sql::Statement insert_statement(db->GetCachedStatement(
-          sql::StatementID(SQL_FROM_HERE), insert_str.c_str()));
-      insert_statement.BindInt(0, count);
-      insert_statement.BindInt64(1, action.time().ToInternalValue());
-      for (size_t j = 0; j < matched_values.size(); j++) {
-        if (matched_values[j] == -1)
-          insert_statement.BindNull(j + 2);
-        else
-          insert_statement.BindInt64(j + 2, matched_values[j]);
-      }
-      if (!insert_statement.Run())
-        return false;
+      new_rows.push_back(NewRow());
+      new_rows.back().count = count;
+      new_rows.back().time = action.time().ToInternalValue();
+      new_rows.back().matched_values.swap(matched_values);
     } else {
       // Database error.
       return false;
     }
   }
 
+  if (!new_rows.empty()) {
+    const size_t rows_per_insert = Util::kRowsPerInsert;
+    std::string rows_str = Util::InsertRowsStatement(
+        kTableName, insert_columns, arraysize(insert_columns),
+        rows_per_insert);
+    std::string row_str = Util::InsertRowsStatement(
+        kTableName, insert_columns, arraysize(insert_columns), 1);
+    size_t i = 0;
+    while (i != new_rows.size()) {
+      bool insert_rows = new_rows.size() - i >= rows_per_insert;
+      sql::Statement insert_statement(
+          insert_rows ? db->GetCachedStatement(sql::StatementID(SQL_FROM_HERE),
+                                               rows_str.c_str())
+                      : db->GetCachedStatement(sql::StatementID(SQL_FROM_HERE),
+                                               row_str.c_str()));
+      size_t end = insert_rows ? i + rows_per_insert : i + 1;
+      int first = 0;
+      for (; i != end; ++i) {
+        const NewRow& row = new_rows[i];
+        insert_statement.BindInt(first, row.count);
+        insert_statement.BindInt64(first + 1, row.time);
+        for (size_t j = 0; j < row.matched_values.size(); j++) {
+          if (row.matched_values[j] == -1)
+            insert_statement.BindNull(first + j + 2);
+          else
+            insert_statement.BindInt64(first + j + 2, row.matched_values[j]);
+        }
+        first += arraysize(insert_columns);
+      }
+      if (!insert_statement.Run())
+        return false;
+    }
+  }
+
   if (clean_database) {
     base::Time cutoff = (Now() - retention_time()).LocalMidnight();
     if (!CleanOlderThan(db, cutoff))
@@ -67,6 +67,10 @@ class CountingPolicy : public ActivityLogDatabasePolicy {
   virtual void OnDatabaseFailure() OVERRIDE;
   virtual void OnDatabaseClose() OVERRIDE;
 
+  // Adds the actions to those to be written out; this is called on the
+  // database thread.
+  virtual void QueueActions(const PendingActions& actions) OVERRIDE;
+
  private:
   // A type used to track pending writes to the database.  The key is an action
   // to write; the value is the amount by which the count field should be
@@ -74,9 +78,11 @@ class CountingPolicy : public ActivityLogDatabasePolicy {
   typedef std::map<scoped_refptr<Action>, int, ActionComparatorExcludingTime>
       ActionQueue;
 
-  // Adds an Action to those to be written out; this is an internal method used
-  // by ProcessAction and is called on the database thread.
-  void QueueAction(scoped_refptr<Action> action);
+  // Adds an Action, which stands for |count| identical actions, to those to be
+  // written out; this is an internal method used by QueueActions and is called
+  // on the database thread.  |action| must already be stripped by
+  // ProcessAction, and is not shared, so its time may be updated.
+  void QueueAction(scoped_refptr<Action> action, int count);
 
   // Internal method to read data from the database; called on the database
   // thread.
@@ -5,11 +5,14 @@
 #include "base/cancelable_callback.h"
 #include "base/command_line.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/metrics/histogram_samples.h"
+#include "base/metrics/statistics_recorder.h"
 #include "base/run_loop.h"
 #include "base/strings/string_split.h"
 #include "base/strings/stringprintf.h"
 #include "base/synchronization/waitable_event.h"
 #include "base/test/simple_test_clock.h"
+#include "base/test/statistics_delta_reader.h"
 #include "base/test/test_timeouts.h"
 #include "chrome/browser/extensions/activity_log/activity_log.h"
 #include "chrome/browser/extensions/activity_log/counting_policy.h"
@@ -52,6 +55,10 @@ class CountingPolicyTest : public testing::Test {
             (&command_line, base::FilePath(), false);
   }
 
+  static void SetUpTestCase() {
+    base::StatisticsRecorder::Initialize();
+  }
+
   virtual ~CountingPolicyTest() {
 #if defined OS_CHROMEOS
     test_user_manager_.reset();
@@ -148,6 +155,66 @@ class CountingPolicyTest : public testing::Test {
     ASSERT_LE(policy->queued_actions_.size(), 200U);
   }
 
+  // Sets how |policy| handles actions logged while its pending queue is full.
+  static void DropOnOverflow(CountingPolicy* policy) {
+    policy->set_overflow_policy(CountingPolicy::OVERFLOW_DROP);
+  }
+  static void SampleOnOverflow(CountingPolicy* policy) {
+    policy->set_overflow_policy(CountingPolicy::OVERFLOW_SAMPLE);
+  }
+
+  static size_t MaxPendingActions() {
+    return CountingPolicy::kMaxPendingActions;
+  }
+
+  // Checks the number of rows in the activity log table and the sum of their
+  // counts.  Runs on the database thread.
+  static void CheckRowsAndCounts(CountingPolicy* policy,
+                                 int rows,
+                                 int total_count) {
+    sql::Connection* db = policy->GetDatabaseConnection();
+    sql::Statement statement(db->GetUniqueStatement(
+        "SELECT COUNT(*), SUM(count) FROM activitylog_compressed"));
+    ASSERT_TRUE(statement.Step());
+    EXPECT_EQ(rows, statement.ColumnInt(0));
+    EXPECT_EQ(total_count, statement.ColumnInt(1));
+  }
+
+  // Logs |count| actions with distinct API names starting at |first|, all at
+  // |time|.  Nothing reaches the database thread while this runs, since it
+  // shares the message loop, so every action past kMaxPendingActions
+  // overflows.
+  static void LogActions(CountingPolicy* policy,
+                         const base::Time& time,
+                         int first,
+                         int count) {
+    for (int i = first; i < first + count; i++) {
+      scoped_refptr<Action> action =
+          new Action("punky", time, Action::ACTION_API_CALL,
+                     base::StringPrintf("apicall_%d", i));
+      policy->ProcessAction(action);
+    }
+  }
+
+  // Checks the pending and dropped actions recorded by the one hand over to
+  // the database thread since |reader| was created.
+  static void CheckOverflowHistograms(base::StatisticsDeltaReader* reader,
+                                      int pending,
+                                      int dropped) {
+    scoped_ptr<base::HistogramSamples> samples(
+        reader->GetHistogramSamplesSinceCreation(
+            "Extensions.ActivityLog.PendingActions"));
+    ASSERT_TRUE(samples.get());
+    EXPECT_EQ(1, samples->TotalCount());
+    EXPECT_EQ(pending, samples->sum());
+
+    samples = reader->GetHistogramSamplesSinceCreation(
+        "Extensions.ActivityLog.DroppedActions");
+    ASSERT_TRUE(samples.get());
+    EXPECT_EQ(1, samples->TotalCount());
+    EXPECT_EQ(dropped, samples->sum());
+  }
+
   static void CheckWrapper(
       const base::Callback<void(scoped_ptr<Action::ActionVector>)>& checker,
       const base::Closure& done,
@@ -792,6 +859,80 @@ TEST_F(CountingPolicyTest, EarlyFlush) {
   policy->Close();
 }
 
+// Actions logged while kMaxPendingActions are pending are dropped with
+// OVERFLOW_DROP.
+TEST_F(CountingPolicyTest, OverflowDrop) {
+  CountingPolicy* policy = new CountingPolicy(profile_.get());
+  policy->Init();
+  DropOnOverflow(policy);
+  int max_pending = static_cast<int>(MaxPendingActions());
+
+  base::StatisticsDeltaReader reader;
+  LogActions(policy, base::Time::Now(), 0, max_pending + 500);
+  policy->Flush();
+  WaitOnThread(BrowserThread::DB);
+
+  CheckOverflowHistograms(&reader, max_pending, 500);
+  policy->ScheduleAndForget(policy, &CountingPolicyTest::CheckRowsAndCounts,
+                            max_pending, max_pending);
+  WaitOnThread(BrowserThread::DB);
+  policy->Close();
+}
+
+// With OVERFLOW_SAMPLE the overflowing actions replace pending ones, so the
+// number pending stays bounded.
+TEST_F(CountingPolicyTest, OverflowSample) {
+  CountingPolicy* policy = new CountingPolicy(profile_.get());
+  policy->Init();
+  SampleOnOverflow(policy);
+  int max_pending = static_cast<int>(MaxPendingActions());
+
+  base::StatisticsDeltaReader reader;
+  LogActions(policy, base::Time::Now(), 0, max_pending + 500);
+  policy->Flush();
+  WaitOnThread(BrowserThread::DB);
+
+  CheckOverflowHistograms(&reader, max_pending, 500);
+  policy->ScheduleAndForget(policy, &CountingPolicyTest::CheckRowsAndCounts,
+                            max_pending, max_pending);
+  WaitOnThread(BrowserThread::DB);
+  policy->Close();
+}
+
+// With OVERFLOW_COALESCE, the default, overflowing actions are merged into
+// pending actions they would be merged with in the database, once stripped,
+// and dropped otherwise.
+TEST_F(CountingPolicyTest, OverflowCoalesce) {
+  CountingPolicy* policy = new CountingPolicy(profile_.get());
+  policy->Init();
+  int max_pending = static_cast<int>(MaxPendingActions());
+  base::Time time = base::Time::Now();
+
+  base::StatisticsDeltaReader reader;
+  LogActions(policy, time, 0, max_pending);
+  // These only differ from pending actions in their arguments and the query
+  // of their page URL, which are both stripped.
+  for (int i = 0; i < 500; i++) {
+    scoped_refptr<Action> action =
+        new Action("punky", time, Action::ACTION_API_CALL,
+                   base::StringPrintf("apicall_%d", i % 10));
+    action->mutable_args()->AppendInteger(i);
+    action->set_page_url(
+        GURL(base::StringPrintf("http://www.google.com/?q=%d", i)));
+    policy->ProcessAction(action);
+  }
+  // These match no pending action.
+  LogActions(policy, time, max_pending, 100);
+  policy->Flush();
+  WaitOnThread(BrowserThread::DB);
+
+  CheckOverflowHistograms(&reader, max_pending, 100);
+  policy->ScheduleAndForget(policy, &CountingPolicyTest::CheckRowsAndCounts,
+                            max_pending, max_pending + 500);
+  WaitOnThread(BrowserThread::DB);
+  policy->Close();
+}
+
 TEST_F(CountingPolicyTest, CapReturns) {
   CountingPolicy* policy = new CountingPolicy(profile_.get());
   policy->Init();
@@ -48,7 +48,9 @@ const int FullStreamUIPolicy::kTableFieldCount =
 FullStreamUIPolicy::FullStreamUIPolicy(Profile* profile)
     : ActivityLogDatabasePolicy(
           profile,
-          FilePath(chrome::kExtensionActivityLogFilename)) {}
+          FilePath(chrome::kExtensionActivityLogFilename)) {
+  set_overflow_policy(OVERFLOW_SAMPLE);
+}
 
 FullStreamUIPolicy::~FullStreamUIPolicy() {}
 
@@ -72,41 +74,59 @@ bool FullStreamUIPolicy::FlushDatabase(sql::Connection* db) {
   if (!transaction.Begin())
     return false;
 
-  std::string sql_str =
-      "INSERT INTO " + std::string(FullStreamUIPolicy::kTableName) +
-      " (extension_id, time, action_type, api_name, args, "
-      "page_url, page_title, arg_url, other) VALUES (?,?,?,?,?,?,?,?,?)";
-  sql::Statement statement(db->GetCachedStatement(
-      sql::StatementID(SQL_FROM_HERE), sql_str.c_str()));
-
-  Action::ActionVector::size_type i;
-  for (i = 0; i != queued_actions_.size(); ++i) {
-    const Action& action = *queued_actions_[i];
-    statement.Reset(true);
-    statement.BindString(0, action.extension_id());
-    statement.BindInt64(1, action.time().ToInternalValue());
-    statement.BindInt(2, static_cast<int>(action.action_type()));
-    statement.BindString(3, action.api_name());
-    if (action.args()) {
-      statement.BindString(4, Util::Serialize(action.args()));
-    }
-    std::string page_url_string = action.SerializePageUrl();
-    if (!page_url_string.empty()) {
-      statement.BindString(5, page_url_string);
-    }
-    if (!action.page_title().empty()) {
-      statement.BindString(6, action.page_title());
-    }
-    std::string arg_url_string = action.SerializeArgUrl();
-    if (!arg_url_string.empty()) {
-      statement.BindString(7, arg_url_string);
+  // Most actions are inserted Util::kRowsPerInsert at a time, which saves
+  // stepping a statement for each of them; the rest are inserted one by one.
+  const size_t rows_per_insert = Util::kRowsPerInsert;
+  std::string rows_str = Util::InsertRowsStatement(
+      kTableName, kTableContentFields, kTableFieldCount, rows_per_insert);
+  sql::Statement rows_statement(db->GetCachedStatement(
+      sql::StatementID(SQL_FROM_HERE), rows_str.c_str()));
+  std::string row_str = Util::InsertRowsStatement(
+      kTableName, kTableContentFields, kTableFieldCount, 1);
+  sql::Statement row_statement(db->GetCachedStatement(
+      sql::StatementID(SQL_FROM_HERE), row_str.c_str()));
+
+  Action::ActionVector::size_type i = 0;
+  while (i != queued_actions_.size()) {
+    size_t rows = queued_actions_.size() - i;
+    sql::Statement* statement = &row_statement;
+    if (rows >= rows_per_insert) {
+      rows = rows_per_insert;
+      statement = &rows_statement;
+    } else {
+      rows = 1;
     }
-    if (action.other()) {
-      statement.BindString(8, Util::Serialize(action.other()));
+
+    statement->Reset(true);
+    for (size_t row = 0; row < rows; ++row, ++i) {
+      const Action& action = *queued_actions_[i];
+      const int first = static_cast<int>(row) * kTableFieldCount;
+      statement->BindString(first, action.extension_id());
+      statement->BindInt64(first + 1, action.time().ToInternalValue());
+      statement->BindInt(first + 2, static_cast<int>(action.action_type()));
+      statement->BindString(first + 3, action.api_name());
+      if (action.args()) {
+        statement->BindString(first + 4, Util::Serialize(action.args()));
+      }
+      std::string page_url_string = action.SerializePageUrl();
+      if (!page_url_string.empty()) {
+        statement->BindString(first + 5, page_url_string);
+      }
+      if (!action.page_title().empty()) {
+        statement->BindString(first + 6, action.page_title());
+      }
+      std::string arg_url_string = action.SerializeArgUrl();
+      if (!arg_url_string.empty()) {
+        statement->BindString(first + 7, arg_url_string);
+      }
+      if (action.other()) {
+        statement->BindString(first + 8, Util::Serialize(action.other()));
+      }
     }
 
-    if (!statement.Run()) {
-      LOG(ERROR) << "Activity log database I/O failed: " << sql_str;
+    if (!statement->Run()) {
+      LOG(ERROR) << "Activity log database I/O failed: "
+                 << (rows == 1 ? row_str : rows_str);
       return false;
     }
   }
@@ -398,14 +418,16 @@ void FullStreamUIPolicy::ProcessAction(scoped_refptr<Action> action) {
   // database writing is moved to policy class, the modifications should be
   // made locally.
   action = ProcessArguments(action);
-  ScheduleAndForget(this, &FullStreamUIPolicy::QueueAction, action);
+  ScheduleQueueAction(action);
 }
 
-void FullStreamUIPolicy::QueueAction(scoped_refptr<Action> action) {
-  if (activity_database()->is_db_valid()) {
-    queued_actions_.push_back(action);
-    activity_database()->AdviseFlush(queued_actions_.size());
+void FullStreamUIPolicy::QueueActions(const PendingActions& actions) {
+  for (size_t i = 0; i < actions.size(); ++i) {
+    // Actions are only merged with OVERFLOW_COALESCE.
+    DCHECK_EQ(1, actions[i].second);
+    queued_actions_.push_back(actions[i].first);
   }
+  activity_database()->AdviseFlush(queued_actions_.size());
 }
 
 }  // namespace extensions
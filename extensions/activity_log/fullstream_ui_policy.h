@@ -67,6 +67,10 @@ class FullStreamUIPolicy : public ActivityLogDatabasePolicy {
   virtual void OnDatabaseFailure() OVERRIDE;
   virtual void OnDatabaseClose() OVERRIDE;
 
+  // Adds the actions to queued_actions_; this is invoked only on the
+  // database thread.
+  virtual void QueueActions(const PendingActions& actions) OVERRIDE;
+
   // Strips arguments if needed by policy.  May return the original object (if
   // unmodified), or a copy (if modifications were made).  The implementation
   // in FullStreamUIPolicy returns the action unmodified.
@@ -90,10 +94,6 @@ class FullStreamUIPolicy : public ActivityLogDatabasePolicy {
   Action::ActionVector queued_actions_;
 
  private:
-  // Adds an Action to queued_actions_; this should be invoked only on the
-  // database thread.
-  void QueueAction(scoped_refptr<Action> action);
-
   // Internal method to read data from the database; called on the database
   // thread.
   scoped_ptr<Action::ActionVector> DoReadFilteredData(
@@ -35,6 +35,8 @@ namespace extensions {
 
 const char RulesCacheDelegate::kRulesStoredKey[] =
     "has_declarative_rules";
+const char RulesCacheDelegate::kRulesEncodedKey[] =
+    "has_encoded_declarative_rules";
 
 RulesCacheDelegate::RulesCacheDelegate(bool log_storage_init_delay)
     : profile_(NULL),
@@ -54,6 +56,15 @@ std::string RulesCacheDelegate::GetRulesStoredKey(const std::string& event_name,
   return result + event_name;
 }
 
+// static
+std::string RulesCacheDelegate::GetRulesEncodedKey(
+    const std::string& event_name,
+    bool incognito) {
+  std::string result(kRulesEncodedKey);
+  result += incognito ? ".incognito." : ".";
+  return result + event_name;
+}
+
 // This is called from the constructor of RulesRegistry, so it is
 // important that it both
 // 1. calls no (in particular virtual) methods of the rules registry, and
@@ -70,14 +81,19 @@ void RulesCacheDelegate::Init(RulesRegistry* registry) {
   storage_key_ =
       GetDeclarativeRuleStorageKey(registry->event_name(),
                                    profile_->IsOffTheRecord());
+  encoded_storage_key_ = storage_key_ + ".encoded";
   rules_stored_key_ = GetRulesStoredKey(registry->event_name(),
                                         profile_->IsOffTheRecord());
+  rules_encoded_key_ = GetRulesEncodedKey(registry->event_name(),
+                                          profile_->IsOffTheRecord());
   rules_registry_thread_ = registry->owner_thread();
 
   ExtensionSystem& system = *ExtensionSystem::Get(profile_);
   extensions::StateStore* store = system.rules_store();
-  if (store)
+  if (store) {
     store->RegisterKey(storage_key_);
+    store->RegisterKey(encoded_storage_key_);
+  }
 
   if (profile_->IsOffTheRecord())
     log_storage_init_delay_ = false;
@@ -92,7 +108,8 @@ void RulesCacheDelegate::Init(RulesRegistry* registry) {
 }
 
 void RulesCacheDelegate::WriteToStorage(const std::string& extension_id,
-                                     scoped_ptr<base::Value> value) {
+                                        scoped_ptr<base::Value> value,
+                                        scoped_ptr<base::Value> encoded_rules) {
   DCHECK(content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
   if (!profile_)
     return;
@@ -106,8 +123,22 @@ void RulesCacheDelegate::WriteToStorage(const std::string& extension_id,
     return;
 
   StateStore* store = ExtensionSystem::Get(profile_)->rules_store();
-  if (store)
-    store->SetExtensionValue(extension_id, storage_key_, value.Pass());
+  if (!store)
+    return;
+
+  // The JSON is always written: older versions read only it, and it is what
+  // the rules are restored from when the encoded rules cannot be decoded.
+  // The encoded rules are written first, so that if writing the JSON does not
+  // complete, the JSON is older than the encoded rules rather than newer.
+  bool encoded_previously = GetEncodedRulesStored(extension_id);
+  SetEncodedRulesStored(extension_id, encoded_rules.get() != NULL);
+  if (encoded_rules) {
+    store->SetExtensionValue(extension_id, encoded_storage_key_,
+                             encoded_rules.Pass());
+  } else if (encoded_previously) {
+    store->RemoveExtensionValue(extension_id, encoded_storage_key_);
+  }
+  store->SetExtensionValue(extension_id, storage_key_, value.Pass());
 }
 
 void RulesCacheDelegate::CheckIfReady() {
@@ -166,6 +197,27 @@ void RulesCacheDelegate::ReadFromStorage(const std::string& extension_id) {
   if (!store)
     return;
   waiting_for_extensions_.insert(extension_id);
+
+  if (!GetEncodedRulesStored(extension_id)) {
+    ReadJSONFromStorage(extension_id);
+    return;
+  }
+
+  store->GetExtensionValue(
+      extension_id,
+      encoded_storage_key_,
+      base::Bind(&RulesCacheDelegate::ReadEncodedFromStorageCallback,
+                 weak_ptr_factory_.GetWeakPtr(),
+                 extension_id));
+}
+
+void RulesCacheDelegate::ReadJSONFromStorage(const std::string& extension_id) {
+  DCHECK(content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
+  extensions::StateStore* store = ExtensionSystem::Get(profile_)->rules_store();
+  if (!store) {
+    OnRulesRead(extension_id);
+    return;
+  }
   store->GetExtensionValue(
       extension_id,
       storage_key_,
@@ -185,7 +237,32 @@ void RulesCacheDelegate::ReadFromStorageCallback(
                  registry_,
                  extension_id,
                  base::Passed(&value)));
+  OnRulesRead(extension_id);
+}
 
+void RulesCacheDelegate::ReadEncodedFromStorageCallback(
+    const std::string& extension_id,
+    scoped_ptr<base::Value> value) {
+  DCHECK(content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
+  if (!value) {
+    ReadJSONFromStorage(extension_id);
+    return;
+  }
+
+  // The registry decodes the rules on its own thread, and then calls either
+  // OnRulesRead() or, if the rules cannot be decoded, ReadJSONFromStorage().
+  // Until then the registry is not marked ready.
+  content::BrowserThread::PostTask(
+      rules_registry_thread_,
+      FROM_HERE,
+      base::Bind(&RulesRegistry::DecodeAndAddRules,
+                 registry_,
+                 extension_id,
+                 base::Passed(&value)));
+}
+
+void RulesCacheDelegate::OnRulesRead(const std::string& extension_id) {
+  DCHECK(content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
   waiting_for_extensions_.erase(extension_id);
 
   if (waiting_for_extensions_.empty())
@@ -224,4 +301,26 @@ void RulesCacheDelegate::SetDeclarativeRulesStored(
       new base::FundamentalValue(rules_stored));
 }
 
+bool RulesCacheDelegate::GetEncodedRulesStored(
+    const std::string& extension_id) const {
+  CHECK(profile_);
+  const ExtensionScopedPrefs* extension_prefs = ExtensionPrefs::Get(profile_);
+
+  bool rules_encoded = false;
+  extension_prefs->ReadPrefAsBoolean(
+      extension_id, rules_encoded_key_, &rules_encoded);
+  return rules_encoded;
+}
+
+void RulesCacheDelegate::SetEncodedRulesStored(
+    const std::string& extension_id,
+    bool rules_encoded) {
+  CHECK(profile_);
+  ExtensionScopedPrefs* extension_prefs = ExtensionPrefs::Get(profile_);
+  extension_prefs->UpdateExtensionPref(
+      extension_id,
+      rules_encoded_key_,
+      rules_encoded ? new base::FundamentalValue(true) : NULL);
+}
+
 }  // namespace extensions
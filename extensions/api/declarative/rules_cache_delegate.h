@@ -35,11 +35,28 @@ class RulesCacheDelegate {
   static std::string GetRulesStoredKey(const std::string& event_name,
                                        bool incognito);
 
+  // Returns a key for the preference indicating whether the rules are stored
+  // encoded by RulesCodec besides being serialized to Values.
+  static std::string GetRulesEncodedKey(const std::string& event_name,
+                                        bool incognito);
+
   // Initialize the storage functionality.
   void Init(RulesRegistry* registry);
 
+  // Stores the rules of |extension_id|, serialized to |value|. Unless
+  // |encoded_rules| is NULL, it holds the same rules encoded by RulesCodec,
+  // which is what is read back as long as it can be decoded.
   void WriteToStorage(const std::string& extension_id,
-                      scoped_ptr<base::Value> value);
+                      scoped_ptr<base::Value> value,
+                      scoped_ptr<base::Value> encoded_rules);
+
+  // Reads the rules of |extension_id| serialized to Values, which is how they
+  // are restored unless their encoded form can be decoded.
+  void ReadJSONFromStorage(const std::string& extension_id);
+
+  // Notes that the rules of |extension_id| were read and passed to the
+  // registry.
+  void OnRulesRead(const std::string& extension_id);
 
   base::WeakPtr<RulesCacheDelegate> GetWeakPtr() {
     DCHECK(content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
@@ -53,6 +70,7 @@ class RulesCacheDelegate {
                            RulesStoredFlagMultipleRegistries);
 
   static const char kRulesStoredKey[];
+  static const char kRulesEncodedKey[];
 
   // Check if we are done reading all data from storage on startup, and notify
   // the RulesRegistry on its thread if so. The notification is delivered
@@ -68,6 +86,11 @@ class RulesCacheDelegate {
   void ReadFromStorageCallback(const std::string& extension_id,
                                scoped_ptr<base::Value> value);
 
+  // Passes the rules encoded by RulesCodec to the registry to decode, or
+  // reads the rules serialized to Values if the encoded rules are missing.
+  void ReadEncodedFromStorageCallback(const std::string& extension_id,
+                                      scoped_ptr<base::Value> value);
+
   // Check the preferences whether the extension with |extension_id| has some
   // rules stored on disk. If this information is not in the preferences, true
   // is returned as a safe default value.
@@ -76,14 +99,27 @@ class RulesCacheDelegate {
   void SetDeclarativeRulesStored(const std::string& extension_id,
                                  bool rules_stored);
 
+  // Whether the rules of |extension_id| are stored encoded by RulesCodec too.
+  // Extensions installed before the rules were encoded have only the JSON.
+  bool GetEncodedRulesStored(const std::string& extension_id) const;
+  void SetEncodedRulesStored(const std::string& extension_id,
+                             bool rules_encoded);
+
   Profile* profile_;
 
   // The key under which rules are stored.
   std::string storage_key_;
 
+  // The key under which the rules encoded by RulesCodec are stored. Older
+  // versions only read |storage_key_|.
+  std::string encoded_storage_key_;
+
   // The key under which we store whether the rules have been stored.
   std::string rules_stored_key_;
 
+  // The key under which we store whether the rules have been stored encoded.
+  std::string rules_encoded_key_;
+
   // A set of extension IDs that have rules we are reading from storage.
   std::set<std::string> waiting_for_extensions_;
 
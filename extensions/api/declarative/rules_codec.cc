@@ -0,0 +1,463 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/extensions/api/declarative/rules_codec.h"
+
+#include <string.h>
+
+#include <map>
+
+#include "base/logging.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/pickle.h"
+#include "base/values.h"
+
+namespace extensions {
+
+namespace {
+
+// Tags of the encoded Values.
+enum ValueTag {
+  TAG_NULL,
+  TAG_FALSE,
+  TAG_TRUE,
+  TAG_INTEGER,
+  TAG_DOUBLE,
+  TAG_STRING,
+  TAG_LIST,
+  TAG_DICTIONARY,
+};
+
+// Bits telling which optional fields of a rule are encoded.
+enum RuleField {
+  FIELD_ID = 1 << 0,
+  FIELD_PRIORITY = 1 << 1,
+  FIELD_TAGS = 1 << 2,
+};
+
+// Values nested deeper than this are not decoded, so that corrupt data cannot
+// exhaust the stack.
+const int kMaxDepth = 100;
+
+typedef std::vector<linked_ptr<base::Value> > Values;
+
+// Writes rules to a Pickle in two passes: the first collects the strings of
+// the rules into the string table, the second writes the rules referring to
+// the strings by their index in the table.
+class Encoder {
+ public:
+  Encoder() {}
+
+  // Adds the strings of |rule| to the table. Returns false if the rule holds
+  // a Value which cannot be encoded.
+  bool AddStrings(const RulesCodec::Rule& rule);
+
+  void WriteStrings(Pickle* pickle) const;
+  void WriteRule(const RulesCodec::Rule& rule, Pickle* pickle) const;
+
+ private:
+  bool AddValueStrings(const base::Value& value);
+  void AddString(const std::string& string);
+
+  void WriteValue(const base::Value& value, Pickle* pickle) const;
+  void WriteValues(const Values& values, Pickle* pickle) const;
+  void WriteString(const std::string& string, Pickle* pickle) const;
+
+  // The index of each string in |strings_|.
+  std::map<std::string, int> string_ids_;
+  std::vector<const std::string*> strings_;
+
+  DISALLOW_COPY_AND_ASSIGN(Encoder);
+};
+
+bool Encoder::AddStrings(const RulesCodec::Rule& rule) {
+  if (rule.id)
+    AddString(*rule.id);
+  if (rule.tags) {
+    for (size_t i = 0; i < rule.tags->size(); ++i)
+      AddString((*rule.tags)[i]);
+  }
+  for (size_t i = 0; i < rule.conditions.size(); ++i) {
+    if (!AddValueStrings(*rule.conditions[i]))
+      return false;
+  }
+  for (size_t i = 0; i < rule.actions.size(); ++i) {
+    if (!AddValueStrings(*rule.actions[i]))
+      return false;
+  }
+  return true;
+}
+
+void Encoder::WriteStrings(Pickle* pickle) const {
+  pickle->WriteInt(static_cast<int>(strings_.size()));
+  for (size_t i = 0; i < strings_.size(); ++i)
+    pickle->WriteString(*strings_[i]);
+}
+
+void Encoder::WriteRule(const RulesCodec::Rule& rule, Pickle* pickle) const {
+  int fields = 0;
+  if (rule.id)
+    fields |= FIELD_ID;
+  if (rule.priority)
+    fields |= FIELD_PRIORITY;
+  if (rule.tags)
+    fields |= FIELD_TAGS;
+  pickle->WriteInt(fields);
+  if (rule.id)
+    WriteString(*rule.id, pickle);
+  if (rule.priority)
+    pickle->WriteInt(*rule.priority);
+  if (rule.tags) {
+    pickle->WriteInt(static_cast<int>(rule.tags->size()));
+    for (size_t i = 0; i < rule.tags->size(); ++i)
+      WriteString((*rule.tags)[i], pickle);
+  }
+  WriteValues(rule.conditions, pickle);
+  WriteValues(rule.actions, pickle);
+}
+
+bool Encoder::AddValueStrings(const base::Value& value) {
+  switch (value.GetType()) {
+    case base::Value::TYPE_NULL:
+    case base::Value::TYPE_BOOLEAN:
+    case base::Value::TYPE_INTEGER:
+    case base::Value::TYPE_DOUBLE:
+      return true;
+    case base::Value::TYPE_STRING: {
+      std::string string;
+      value.GetAsString(&string);
+      AddString(string);
+      return true;
+    }
+    case base::Value::TYPE_LIST: {
+      const base::ListValue* list = NULL;
+      value.GetAsList(&list);
+      for (base::ListValue::const_iterator it = list->begin();
+           it != list->end(); ++it) {
+        if (!AddValueStrings(**it))
+          return false;
+      }
+      return true;
+    }
+    case base::Value::TYPE_DICTIONARY: {
+      const base::DictionaryValue* dictionary = NULL;
+      value.GetAsDictionary(&dictionary);
+      for (base::DictionaryValue::Iterator it(*dictionary); !it.IsAtEnd();
+           it.Advance()) {
+        AddString(it.key());
+        if (!AddValueStrings(it.value()))
+          return false;
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+void Encoder::AddString(const std::string& string) {
+  std::pair<std::map<std::string, int>::iterator, bool> insertion =
+      string_ids_.insert(
+          std::make_pair(string, static_cast<int>(strings_.size())));
+  if (insertion.second)
+    strings_.push_back(&insertion.first->first);
+}
+
+void Encoder::WriteValue(const base::Value& value, Pickle* pickle) const {
+  switch (value.GetType()) {
+    case base::Value::TYPE_NULL:
+      pickle->WriteInt(TAG_NULL);
+      break;
+    case base::Value::TYPE_BOOLEAN: {
+      bool boolean = false;
+      value.GetAsBoolean(&boolean);
+      pickle->WriteInt(boolean ? TAG_TRUE : TAG_FALSE);
+      break;
+    }
+    case base::Value::TYPE_INTEGER: {
+      int integer = 0;
+      value.GetAsInteger(&integer);
+      pickle->WriteInt(TAG_INTEGER);
+      pickle->WriteInt(integer);
+      break;
+    }
+    case base::Value::TYPE_DOUBLE: {
+      double number = 0;
+      value.GetAsDouble(&number);
+      int64 bits;
+      COMPILE_ASSERT(sizeof(bits) == sizeof(number), double_must_be_64_bits);
+      memcpy(&bits, &number, sizeof(bits));
+      pickle->WriteInt(TAG_DOUBLE);
+      pickle->WriteInt64(bits);
+      break;
+    }
+    case base::Value::TYPE_STRING: {
+      std::string string;
+      value.GetAsString(&string);
+      pickle->WriteInt(TAG_STRING);
+      WriteString(string, pickle);
+      break;
+    }
+    case base::Value::TYPE_LIST: {
+      const base::ListValue* list = NULL;
+      value.GetAsList(&list);
+      pickle->WriteInt(TAG_LIST);
+      pickle->WriteInt(static_cast<int>(list->GetSize()));
+      for (base::ListValue::const_iterator it = list->begin();
+           it != list->end(); ++it) {
+        WriteValue(**it, pickle);
+      }
+      break;
+    }
+    case base::Value::TYPE_DICTIONARY: {
+      const base::DictionaryValue* dictionary = NULL;
+      value.GetAsDictionary(&dictionary);
+      pickle->WriteInt(TAG_DICTIONARY);
+      pickle->WriteInt(static_cast<int>(dictionary->size()));
+      for (base::DictionaryValue::Iterator it(*dictionary); !it.IsAtEnd();
+           it.Advance()) {
+        WriteString(it.key(), pickle);
+        WriteValue(it.value(), pickle);
+      }
+      break;
+    }
+    default:
+      // AddValueStrings() rejected the rules.
+      NOTREACHED();
+  }
+}
+
+void Encoder::WriteValues(const Values& values, Pickle* pickle) const {
+  pickle->WriteInt(static_cast<int>(values.size()));
+  for (size_t i = 0; i < values.size(); ++i)
+    WriteValue(*values[i], pickle);
+}
+
+void Encoder::WriteString(const std::string& string, Pickle* pickle) const {
+  std::map<std::string, int>::const_iterator it = string_ids_.find(string);
+  DCHECK(it != string_ids_.end());
+  pickle->WriteInt(it->second);
+}
+
+// Reads rules written by Encoder.
+class Decoder {
+ public:
+  Decoder(const char* data, size_t size)
+      : pickle_(data, static_cast<int>(size)),
+        iterator_(pickle_) {}
+
+  bool ReadVersion(int* version);
+  bool ReadStrings();
+  bool ReadRules(std::vector<linked_ptr<RulesCodec::Rule> >* rules);
+
+ private:
+  bool ReadRule(RulesCodec::Rule* rule);
+  base::Value* ReadValue(int depth);
+  bool ReadValues(Values* values);
+  bool ReadString(std::string* string);
+  bool ReadCount(int* count);
+
+  Pickle pickle_;
+  PickleIterator iterator_;
+  std::vector<std::string> strings_;
+
+  DISALLOW_COPY_AND_ASSIGN(Decoder);
+};
+
+bool Decoder::ReadVersion(int* version) {
+  return pickle_.ReadInt(&iterator_, version);
+}
+
+bool Decoder::ReadStrings() {
+  int count;
+  if (!ReadCount(&count))
+    return false;
+  strings_.resize(count);
+  for (int i = 0; i < count; ++i) {
+    if (!pickle_.ReadString(&iterator_, &strings_[i]))
+      return false;
+  }
+  return true;
+}
+
+bool Decoder::ReadRules(std::vector<linked_ptr<RulesCodec::Rule> >* rules) {
+  int count;
+  if (!ReadCount(&count))
+    return false;
+  rules->reserve(count);
+  for (int i = 0; i < count; ++i) {
+    linked_ptr<RulesCodec::Rule> rule(new RulesCodec::Rule);
+    if (!ReadRule(rule.get()))
+      return false;
+    rules->push_back(rule);
+  }
+  return true;
+}
+
+bool Decoder::ReadRule(RulesCodec::Rule* rule) {
+  int fields;
+  if (!pickle_.ReadInt(&iterator_, &fields))
+    return false;
+  if (fields & FIELD_ID) {
+    rule->id.reset(new std::string);
+    if (!ReadString(rule->id.get()))
+      return false;
+  }
+  if (fields & FIELD_PRIORITY) {
+    rule->priority.reset(new int);
+    if (!pickle_.ReadInt(&iterator_, rule->priority.get()))
+      return false;
+  }
+  if (fields & FIELD_TAGS) {
+    int count;
+    if (!ReadCount(&count))
+      return false;
+    rule->tags.reset(new std::vector<std::string>(count));
+    for (int i = 0; i < count; ++i) {
+      if (!ReadString(&(*rule->tags)[i]))
+        return false;
+    }
+  }
+  return ReadValues(&rule->conditions) && ReadValues(&rule->actions);
+}
+
+base::Value* Decoder::ReadValue(int depth) {
+  int tag;
+  if (depth > kMaxDepth || !pickle_.ReadInt(&iterator_, &tag))
+    return NULL;
+  switch (tag) {
+    case TAG_NULL:
+      return base::Value::CreateNullValue();
+    case TAG_FALSE:
+      return new base::FundamentalValue(false);
+    case TAG_TRUE:
+      return new base::FundamentalValue(true);
+    case TAG_INTEGER: {
+      int integer;
+      if (!pickle_.ReadInt(&iterator_, &integer))
+        return NULL;
+      return new base::FundamentalValue(integer);
+    }
+    case TAG_DOUBLE: {
+      int64 bits;
+      if (!pickle_.ReadInt64(&iterator_, &bits))
+        return NULL;
+      double number;
+      memcpy(&number, &bits, sizeof(number));
+      return new base::FundamentalValue(number);
+    }
+    case TAG_STRING: {
+      std::string string;
+      if (!ReadString(&string))
+        return NULL;
+      return new base::StringValue(string);
+    }
+    case TAG_LIST: {
+      int count;
+      if (!ReadCount(&count))
+        return NULL;
+      scoped_ptr<base::ListValue> list(new base::ListValue);
+      for (int i = 0; i < count; ++i) {
+        base::Value* value = ReadValue(depth + 1);
+        if (!value)
+          return NULL;
+        list->Append(value);
+      }
+      return list.release();
+    }
+    case TAG_DICTIONARY: {
+      int count;
+      if (!ReadCount(&count))
+        return NULL;
+      scoped_ptr<base::DictionaryValue> dictionary(new base::DictionaryValue);
+      for (int i = 0; i < count; ++i) {
+        std::string key;
+        if (!ReadString(&key))
+          return NULL;
+        base::Value* value = ReadValue(depth + 1);
+        if (!value)
+          return NULL;
+        dictionary->SetWithoutPathExpansion(key, value);
+      }
+      return dictionary.release();
+    }
+    default:
+      return NULL;
+  }
+}
+
+bool Decoder::ReadValues(Values* values) {
+  int count;
+  if (!ReadCount(&count))
+    return false;
+  values->reserve(count);
+  for (int i = 0; i < count; ++i) {
+    base::Value* value = ReadValue(0);
+    if (!value)
+      return false;
+    values->push_back(linked_ptr<base::Value>(value));
+  }
+  return true;
+}
+
+bool Decoder::ReadString(std::string* string) {
+  int index;
+  if (!pickle_.ReadInt(&iterator_, &index) || index < 0 ||
+      static_cast<size_t>(index) >= strings_.size()) {
+    return false;
+  }
+  *string = strings_[index];
+  return true;
+}
+
+// Reads the number of elements which follow. Every element takes at least
+// four bytes, which bounds the count of valid data by the size of the pickle.
+bool Decoder::ReadCount(int* count) {
+  return pickle_.ReadInt(&iterator_, count) && *count >= 0 &&
+         static_cast<size_t>(*count) <= pickle_.size() / sizeof(int);
+}
+
+}  // namespace
+
+const int RulesCodec::kVersion = 1;
+
+// static
+bool RulesCodec::Encode(const std::vector<linked_ptr<Rule> >& rules,
+                        std::string* output) {
+  Encoder encoder;
+  for (size_t i = 0; i < rules.size(); ++i) {
+    if (!encoder.AddStrings(*rules[i]))
+      return false;
+  }
+
+  Pickle pickle;
+  pickle.WriteInt(kVersion);
+  encoder.WriteStrings(&pickle);
+  pickle.WriteInt(static_cast<int>(rules.size()));
+  for (size_t i = 0; i < rules.size(); ++i)
+    encoder.WriteRule(*rules[i], &pickle);
+  output->assign(static_cast<const char*>(pickle.data()), pickle.size());
+  return true;
+}
+
+// static
+RulesCodec::DecodeResult RulesCodec::Decode(
+    const char* data,
+    size_t size,
+    std::vector<linked_ptr<Rule> >* rules) {
+  DCHECK(rules->empty());
+  Decoder decoder(data, size);
+  int version;
+  if (!decoder.ReadVersion(&version))
+    return CORRUPT;
+  if (version != kVersion)
+    return VERSION_MISMATCH;
+  if (!decoder.ReadStrings() || !decoder.ReadRules(rules)) {
+    rules->clear();
+    return CORRUPT;
+  }
+  return DECODED;
+}
+
+}  // namespace extensions
@@ -0,0 +1,61 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_EXTENSIONS_API_DECLARATIVE_RULES_CODEC_H__
+#define CHROME_BROWSER_EXTENSIONS_API_DECLARATIVE_RULES_CODEC_H__
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/linked_ptr.h"
+#include "chrome/common/extensions/api/events.h"
+
+namespace extensions {
+
+// Encodes declarative rules in a compact binary format which, unlike the JSON
+// the rules used to be stored as, is read without parsing JSON or populating
+// the rules from Values.
+//
+// The format is a Pickle holding the format version, a table of the strings
+// used by the rules and then the rules. Every string, be it a rule id, a tag,
+// a dictionary key or a string value of a condition or action, is stored once
+// in the table and referred to by its index. Conditions and actions mostly
+// repeat the same keys, instance types and URL matcher strings, so this
+// shrinks the rules a lot.
+class RulesCodec {
+ public:
+  typedef api::events::Rule Rule;
+
+  // The version of the format written by Encode(). Bump it whenever the format
+  // changes. Decode() only reads this version; rules stored in another one are
+  // restored from the JSON stored next to them instead.
+  static const int kVersion;
+
+  // Used for UMA, so only append.
+  enum DecodeResult {
+    DECODED,
+    VERSION_MISMATCH,
+    CORRUPT,
+    DECODE_RESULT_BOUNDARY
+  };
+
+  // Encodes |rules| to |output|. Returns false if a rule holds a Value which
+  // cannot be encoded, in which case the rules need to be stored as JSON.
+  static bool Encode(const std::vector<linked_ptr<Rule> >& rules,
+                     std::string* output);
+
+  // Decodes the |size| bytes at |data| written by Encode() to |rules|.
+  // |rules| is left empty unless DECODED is returned.
+  static DecodeResult Decode(const char* data,
+                             size_t size,
+                             std::vector<linked_ptr<Rule> >* rules);
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(RulesCodec);
+};
+
+}  // namespace extensions
+
+#endif  // CHROME_BROWSER_EXTENSIONS_API_DECLARATIVE_RULES_CODEC_H__
@@ -0,0 +1,101 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/json/json_reader.h"
+#include "base/json/json_writer.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/test/values_test_util.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "chrome/browser/extensions/api/declarative/rules_codec.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace extensions {
+
+namespace {
+
+typedef RulesCodec::Rule Rule;
+
+// Creates a rule shaped like the declarativeWebRequest rules of ad blockers,
+// which register thousands of them.
+linked_ptr<Rule> CreateRule(int i) {
+  linked_ptr<Rule> rule(new Rule);
+  rule->id.reset(new std::string("rule" + base::IntToString(i)));
+  rule->priority.reset(new int(100));
+  rule->conditions.push_back(linked_ptr<base::Value>(base::test::ParseJson(
+      base::StringPrintf(
+          "{ \"instanceType\": \"declarativeWebRequest.RequestMatcher\", "
+          "  \"url\": { \"hostSuffix\": \"ads%d.example.com\", "
+          "             \"schemes\": [\"http\", \"https\"] }, "
+          "  \"resourceType\": [\"image\", \"script\", \"sub_frame\"] }",
+          i)).release()));
+  rule->actions.push_back(linked_ptr<base::Value>(base::test::ParseJson(
+      "{ \"instanceType\": \"declarativeWebRequest.CancelRequest\" }")
+      .release()));
+  return rule;
+}
+
+void RunRestore(int rule_count) {
+  const std::string trace = base::IntToString(rule_count) + "_rules";
+  std::vector<linked_ptr<Rule> > rules;
+  for (int i = 0; i < rule_count; ++i)
+    rules.push_back(CreateRule(i));
+
+  // The rules as RulesRegistry stores them in JSON.
+  base::ListValue list;
+  for (size_t i = 0; i < rules.size(); ++i)
+    list.Append(rules[i]->ToValue().release());
+  std::string json;
+  base::JSONWriter::Write(&list, &json);
+
+  // The encoded rules, which RulesCacheDelegate stores as they are.
+  std::string encoded;
+  ASSERT_TRUE(RulesCodec::Encode(rules, &encoded));
+  perf_test::PrintResult("declarative_rules_size", "_json", trace,
+                         json.size(), "bytes", true);
+  perf_test::PrintResult("declarative_rules_size", "_binary", trace,
+                         encoded.size(), "bytes", true);
+
+  // Restoring from JSON parses the JSON and populates the rules from it.
+  base::TimeTicks start = base::TimeTicks::Now();
+  scoped_ptr<base::Value> value(base::JSONReader::Read(json));
+  base::ListValue* restored_list = NULL;
+  ASSERT_TRUE(value && value->GetAsList(&restored_list));
+  std::vector<linked_ptr<Rule> > json_rules;
+  for (size_t i = 0; i < restored_list->GetSize(); ++i) {
+    const base::DictionaryValue* dict = NULL;
+    ASSERT_TRUE(restored_list->GetDictionary(i, &dict));
+    linked_ptr<Rule> rule(new Rule);
+    ASSERT_TRUE(Rule::Populate(*dict, rule.get()));
+    json_rules.push_back(rule);
+  }
+  perf_test::PrintResult("declarative_rules_restore", "_json", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+
+  start = base::TimeTicks::Now();
+  std::vector<linked_ptr<Rule> > decoded_rules;
+  ASSERT_EQ(RulesCodec::DECODED,
+            RulesCodec::Decode(encoded.data(), encoded.size(),
+                               &decoded_rules));
+  perf_test::PrintResult("declarative_rules_restore", "_binary", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+  EXPECT_EQ(json_rules.size(), decoded_rules.size());
+}
+
+}  // namespace
+
+TEST(RulesCodecPerfTest, Restore) {
+  RunRestore(1000);
+  RunRestore(10000);
+}
+
+}  // namespace extensions
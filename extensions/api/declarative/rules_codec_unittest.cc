@@ -0,0 +1,140 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/extensions/api/declarative/rules_codec.h"
+
+#include "base/values.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace extensions {
+
+namespace {
+
+typedef RulesCodec::Rule Rule;
+
+linked_ptr<Rule> CreateRule(const std::string& id, const std::string& host) {
+  linked_ptr<Rule> rule(new Rule);
+  rule->id.reset(new std::string(id));
+  rule->priority.reset(new int(100));
+  rule->tags.reset(new std::vector<std::string>(1, "tag"));
+
+  base::DictionaryValue* url = new base::DictionaryValue;
+  url->SetString("hostSuffix", host);
+  base::ListValue* schemes = new base::ListValue;
+  schemes->Append(new base::StringValue("http"));
+  schemes->Append(new base::StringValue("https"));
+  url->Set("schemes", schemes);
+  base::DictionaryValue* condition = new base::DictionaryValue;
+  condition->SetString("instanceType", "declarativeWebRequest.RequestMatcher");
+  condition->Set("url", url);
+  condition->Set("thirdPartyForCookies", new base::FundamentalValue(true));
+  rule->conditions.push_back(linked_ptr<base::Value>(condition));
+
+  base::DictionaryValue* action = new base::DictionaryValue;
+  action->SetString("instanceType", "declarativeWebRequest.RedirectRequest");
+  action->SetString("redirectUrl", "http://" + host + "/");
+  action->Set("ratio", new base::FundamentalValue(0.5));
+  action->Set("count", new base::FundamentalValue(-3));
+  action->Set("none", base::Value::CreateNullValue());
+  rule->actions.push_back(linked_ptr<base::Value>(action));
+  return rule;
+}
+
+void ExpectValuesEqual(const std::vector<linked_ptr<base::Value> >& expected,
+                       const std::vector<linked_ptr<base::Value> >& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i)
+    EXPECT_TRUE(expected[i]->Equals(actual[i].get()));
+}
+
+}  // namespace
+
+TEST(RulesCodecTest, EncodeAndDecode) {
+  std::vector<linked_ptr<Rule> > rules;
+  rules.push_back(CreateRule("rule1", "example.com"));
+  rules.push_back(CreateRule("rule2", "example.org"));
+  // A rule without any of the optional fields.
+  rules.push_back(make_linked_ptr(new Rule));
+
+  std::string data;
+  ASSERT_TRUE(RulesCodec::Encode(rules, &data));
+
+  std::vector<linked_ptr<Rule> > decoded;
+  ASSERT_EQ(RulesCodec::DECODED,
+            RulesCodec::Decode(data.data(), data.size(), &decoded));
+  ASSERT_EQ(rules.size(), decoded.size());
+  for (size_t i = 0; i < 2; ++i) {
+    ASSERT_TRUE(decoded[i]->id.get());
+    EXPECT_EQ(*rules[i]->id, *decoded[i]->id);
+    ASSERT_TRUE(decoded[i]->priority.get());
+    EXPECT_EQ(100, *decoded[i]->priority);
+    ASSERT_TRUE(decoded[i]->tags.get());
+    EXPECT_EQ(*rules[i]->tags, *decoded[i]->tags);
+    ExpectValuesEqual(rules[i]->conditions, decoded[i]->conditions);
+    ExpectValuesEqual(rules[i]->actions, decoded[i]->actions);
+  }
+  EXPECT_FALSE(decoded[2]->id.get());
+  EXPECT_FALSE(decoded[2]->priority.get());
+  EXPECT_FALSE(decoded[2]->tags.get());
+  EXPECT_TRUE(decoded[2]->conditions.empty());
+  EXPECT_TRUE(decoded[2]->actions.empty());
+}
+
+// Strings repeated across rules are stored once.
+TEST(RulesCodecTest, InternsStrings) {
+  std::vector<linked_ptr<Rule> > rules(1, CreateRule("rule", "example.com"));
+  std::string one_rule;
+  ASSERT_TRUE(RulesCodec::Encode(rules, &one_rule));
+  rules.push_back(CreateRule("rule2", "example.com"));
+  std::string two_rules;
+  ASSERT_TRUE(RulesCodec::Encode(rules, &two_rules));
+  EXPECT_LT(two_rules.size() - one_rule.size(), one_rule.size() / 2);
+}
+
+TEST(RulesCodecTest, BinaryValuesAreNotEncoded) {
+  std::vector<linked_ptr<Rule> > rules(1, make_linked_ptr(new Rule));
+  rules[0]->actions.push_back(
+      linked_ptr<base::Value>(new base::BinaryValue));
+  std::string data;
+  EXPECT_FALSE(RulesCodec::Encode(rules, &data));
+}
+
+TEST(RulesCodecTest, RejectsOtherVersions) {
+  std::vector<linked_ptr<Rule> > rules(1, CreateRule("rule", "example.com"));
+  std::string data;
+  ASSERT_TRUE(RulesCodec::Encode(rules, &data));
+
+  // The version is the first int of the pickle's payload.
+  std::string other_version = data;
+  other_version[sizeof(uint32)] ^= 0x10;
+  std::vector<linked_ptr<Rule> > decoded;
+  EXPECT_EQ(RulesCodec::VERSION_MISMATCH,
+            RulesCodec::Decode(other_version.data(), other_version.size(),
+                               &decoded));
+  EXPECT_TRUE(decoded.empty());
+}
+
+TEST(RulesCodecTest, RejectsCorruptData) {
+  std::vector<linked_ptr<Rule> > rules(1, CreateRule("rule", "example.com"));
+  std::string data;
+  ASSERT_TRUE(RulesCodec::Encode(rules, &data));
+
+  std::vector<linked_ptr<Rule> > decoded;
+  EXPECT_EQ(RulesCodec::CORRUPT, RulesCodec::Decode("", 0, &decoded));
+  for (size_t size = 0; size < data.size(); size += 4) {
+    EXPECT_NE(RulesCodec::DECODED,
+              RulesCodec::Decode(data.data(), size, &decoded));
+    EXPECT_TRUE(decoded.empty());
+  }
+
+  // Flipping bits anywhere after the version must not crash.
+  for (size_t i = 2 * sizeof(uint32); i < data.size(); ++i) {
+    std::string corrupt = data;
+    corrupt[i] ^= 0x5a;
+    RulesCodec::Decode(corrupt.data(), corrupt.size(), &decoded);
+    decoded.clear();
+  }
+}
+
+}  // namespace extensions
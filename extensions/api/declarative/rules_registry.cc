@@ -16,6 +16,7 @@
 #include "base/values.h"
 #include "chrome/browser/chrome_notification_types.h"
 #include "chrome/browser/extensions/api/declarative/rules_cache_delegate.h"
+#include "chrome/browser/extensions/api/declarative/rules_codec.h"
 #include "chrome/browser/extensions/extension_service.h"
 #include "chrome/browser/extensions/extension_util.h"
 #include "chrome/browser/extensions/state_store.h"
@@ -40,6 +41,19 @@ scoped_ptr<base::Value> RulesToValue(
   return list.PassAs<base::Value>();
 }
 
+// Returns the rules encoded by RulesCodec, or NULL if they cannot be encoded
+// or there are none.
+scoped_ptr<base::Value> RulesToEncodedValue(
+    const std::vector<linked_ptr<extensions::RulesRegistry::Rule> >& rules) {
+  std::string encoded_rules;
+  if (rules.empty() ||
+      !extensions::RulesCodec::Encode(rules, &encoded_rules)) {
+    return scoped_ptr<base::Value>();
+  }
+  return make_scoped_ptr(base::BinaryValue::CreateWithCopiedBuffer(
+      encoded_rules.data(), encoded_rules.size())).PassAs<base::Value>();
+}
+
 std::vector<linked_ptr<extensions::RulesRegistry::Rule> > RulesFromValue(
     const base::Value* value) {
   std::vector<linked_ptr<extensions::RulesRegistry::Rule> > rules;
@@ -254,7 +268,65 @@ void RulesRegistry::DeserializeAndAddRules(
     scoped_ptr<base::Value> rules) {
   DCHECK(content::BrowserThread::CurrentlyOn(owner_thread()));
 
-  AddRulesNoFill(extension_id, RulesFromValue(rules.get()));
+  base::TimeTicks start = base::TimeTicks::Now();
+  std::vector<linked_ptr<Rule> > restored_rules = RulesFromValue(rules.get());
+  UMA_HISTOGRAM_TIMES("Extensions.DeclarativeRulesDecodeTime.JSON",
+                      base::TimeTicks::Now() - start);
+
+  // Adding the rules stores them encoded by RulesCodec too, so rules stored
+  // only as JSON are decoded from then on.
+  AddRestoredRules(extension_id, restored_rules);
+}
+
+void RulesRegistry::DecodeAndAddRules(
+    const std::string& extension_id,
+    scoped_ptr<base::Value> encoded_rules) {
+  DCHECK(content::BrowserThread::CurrentlyOn(owner_thread()));
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  std::vector<linked_ptr<Rule> > restored_rules;
+  RulesCodec::DecodeResult result = RulesCodec::CORRUPT;
+  if (encoded_rules && encoded_rules->IsType(base::Value::TYPE_BINARY)) {
+    const base::BinaryValue* binary_value =
+        static_cast<const base::BinaryValue*>(encoded_rules.get());
+    result = RulesCodec::Decode(binary_value->GetBuffer(),
+                                binary_value->GetSize(),
+                                &restored_rules);
+  }
+  UMA_HISTOGRAM_ENUMERATION("Extensions.DeclarativeRulesDecodeResult",
+                            result,
+                            RulesCodec::DECODE_RESULT_BOUNDARY);
+
+  if (result != RulesCodec::DECODED) {
+    // The rules were encoded by another version of RulesCodec, or are
+    // corrupt. The JSON stored next to them still holds them.
+    content::BrowserThread::PostTask(
+        content::BrowserThread::UI,
+        FROM_HERE,
+        base::Bind(&RulesCacheDelegate::ReadJSONFromStorage,
+                   cache_delegate_,
+                   extension_id));
+    return;
+  }
+  UMA_HISTOGRAM_TIMES("Extensions.DeclarativeRulesDecodeTime.Binary",
+                      base::TimeTicks::Now() - start);
+
+  AddRestoredRules(extension_id, restored_rules);
+  content::BrowserThread::PostTask(
+      content::BrowserThread::UI,
+      FROM_HERE,
+      base::Bind(&RulesCacheDelegate::OnRulesRead,
+                 cache_delegate_,
+                 extension_id));
+}
+
+void RulesRegistry::AddRestoredRules(
+    const std::string& extension_id,
+    const std::vector<linked_ptr<Rule> >& rules) {
+  base::TimeTicks start = base::TimeTicks::Now();
+  AddRulesNoFill(extension_id, rules);
+  UMA_HISTOGRAM_TIMES("Extensions.DeclarativeRulesRestoreAddTime",
+                      base::TimeTicks::Now() - start);
 }
 
 RulesRegistry::~RulesRegistry() {
@@ -285,7 +357,8 @@ void RulesRegistry::ProcessChangedRules(const std::string& extension_id) {
       base::Bind(&RulesCacheDelegate::WriteToStorage,
                  cache_delegate_,
                  extension_id,
-                 base::Passed(RulesToValue(new_rules))));
+                 base::Passed(RulesToValue(new_rules)),
+                 base::Passed(RulesToEncodedValue(new_rules))));
 }
 
 void RulesRegistry::MaybeProcessChangedRules(const std::string& extension_id) {
@@ -223,6 +223,16 @@ class RulesRegistry : public base::RefCountedThreadSafe<RulesRegistry> {
   void DeserializeAndAddRules(const std::string& extension_id,
                               scoped_ptr<base::Value> rules);
 
+  // Decodes the rules which RulesCodec encoded to |encoded_rules| and adds
+  // them to the RulesRegistry. If they cannot be decoded, the cache delegate
+  // is asked for the rules serialized to Values instead.
+  void DecodeAndAddRules(const std::string& extension_id,
+                         scoped_ptr<base::Value> encoded_rules);
+
+  // Adds the rules restored from storage.
+  void AddRestoredRules(const std::string& extension_id,
+                        const std::vector<linked_ptr<Rule> >& rules);
+
   // The profile to which this rules registry belongs.
   Profile* profile_;
 
@@ -8,11 +8,16 @@
 // implementation of RulesRegistryWithCache as a proxy for
 // RulesRegistryWithCache.
 
+#include "base/bind.h"
 #include "base/command_line.h"
+#include "base/pickle.h"
 #include "base/run_loop.h"
+#include "base/values.h"
 #include "chrome/browser/extensions/api/declarative/rules_cache_delegate.h"
+#include "chrome/browser/extensions/api/declarative/rules_codec.h"
 #include "chrome/browser/extensions/api/declarative/test_rules_registry.h"
 #include "chrome/browser/extensions/extension_service.h"
+#include "chrome/browser/extensions/state_store.h"
 #include "chrome/browser/extensions/test_extension_environment.h"
 #include "chrome/browser/extensions/test_extension_system.h"
 #include "chrome/browser/value_store/testing_value_store.h"
@@ -30,6 +35,11 @@ using extension_test_util::LoadManifestUnchecked;
 namespace {
 const char kRuleId[] = "rule";
 const char kRule2Id[] = "rule2";
+
+void StoreValue(scoped_ptr<base::Value>* result,
+                scoped_ptr<base::Value> value) {
+  *result = value.Pass();
+}
 }
 
 namespace extensions {
@@ -254,7 +264,8 @@ TEST_F(RulesRegistryWithCacheTest, DeclarativeRulesStored) {
   scoped_ptr<base::ListValue> value(new base::ListValue);
   value->AppendBoolean(true);
   cache_delegate->WriteToStorage(extension1_->id(),
-                                 value.PassAs<base::Value>());
+                                 value.PassAs<base::Value>(),
+                                 scoped_ptr<base::Value>());
   EXPECT_TRUE(cache_delegate->GetDeclarativeRulesStored(extension1_->id()));
   base::RunLoop().RunUntilIdle();
   EXPECT_EQ(write_count + 1, store->write_count());
@@ -262,7 +273,8 @@ TEST_F(RulesRegistryWithCacheTest, DeclarativeRulesStored) {
 
   value.reset(new base::ListValue);
   cache_delegate->WriteToStorage(extension1_->id(),
-                                 value.PassAs<base::Value>());
+                                 value.PassAs<base::Value>(),
+                                 scoped_ptr<base::Value>());
   EXPECT_FALSE(cache_delegate->GetDeclarativeRulesStored(extension1_->id()));
   base::RunLoop().RunUntilIdle();
   // No rules currently, but previously there were, so we expect a write.
@@ -271,7 +283,8 @@ TEST_F(RulesRegistryWithCacheTest, DeclarativeRulesStored) {
 
   value.reset(new base::ListValue);
   cache_delegate->WriteToStorage(extension1_->id(),
-                                 value.PassAs<base::Value>());
+                                 value.PassAs<base::Value>(),
+                                 scoped_ptr<base::Value>());
   EXPECT_FALSE(cache_delegate->GetDeclarativeRulesStored(extension1_->id()));
   base::RunLoop().RunUntilIdle();
   EXPECT_EQ(write_count, store->write_count());
@@ -378,6 +391,160 @@ TEST_F(RulesRegistryWithCacheTest, RulesPreservedAcrossRestart) {
   EXPECT_EQ(1, GetNumberOfRules(extension1_->id(), registry.get()));
 }
 
+TEST_F(RulesRegistryWithCacheTest, RulesMigratedFromJSON) {
+  // Rules stored as JSON by older versions are restored, and then stored
+  // encoded by RulesCodec next to the JSON.
+
+  // TODO(vabr): Once some API using declarative rules enters the stable
+  // channel, make sure to use that API here, and remove |channel|.
+  ScopedCurrentChannel channel(chrome::VersionInfo::CHANNEL_UNKNOWN);
+
+  ExtensionService* extension_service = env_.GetExtensionService();
+  StateStore* store = env_.GetExtensionSystem()->rules_store();
+
+  std::string error;
+  scoped_refptr<Extension> extension(
+      LoadManifestUnchecked("permissions",
+                            "web_request_all_host_permissions.json",
+                            Manifest::INVALID_LOCATION,
+                            Extension::NO_FLAGS,
+                            extension1_->id(),
+                            &error));
+  ASSERT_TRUE(error.empty());
+  extension_service->AddExtension(extension.get());
+  env_.GetExtensionSystem()->SetReady();
+
+  const std::string storage_key("declarative_rules.testEvent");
+  RulesRegistry::Rule rule;
+  rule.id.reset(new std::string(kRuleId));
+  rule.priority.reset(new int(100));
+  scoped_ptr<base::ListValue> json_rules(new base::ListValue);
+  json_rules->Append(rule.ToValue().release());
+  store->SetExtensionValue(extension1_->id(), storage_key,
+                           json_rules.PassAs<base::Value>());
+
+  scoped_ptr<RulesCacheDelegate> cache_delegate(new RulesCacheDelegate(false));
+  scoped_refptr<TestRulesRegistry> registry(new TestRulesRegistry(
+      profile(),
+      "testEvent",
+      content::BrowserThread::UI,
+      cache_delegate.get(),
+      RulesRegistry::WebViewKey(0, 0)));
+  base::RunLoop().RunUntilIdle();  // Posted tasks retrieve and store the rule.
+  EXPECT_EQ(1, GetNumberOfRules(extension1_->id(), registry.get()));
+
+  scoped_ptr<base::Value> stored_rules;
+  store->GetExtensionValue(extension1_->id(), storage_key,
+                           base::Bind(&StoreValue, &stored_rules));
+  base::RunLoop().RunUntilIdle();
+  ASSERT_TRUE(stored_rules);
+  EXPECT_TRUE(stored_rules->IsType(base::Value::TYPE_LIST));
+
+  scoped_ptr<base::Value> encoded_rules;
+  store->GetExtensionValue(extension1_->id(), storage_key + ".encoded",
+                           base::Bind(&StoreValue, &encoded_rules));
+  base::RunLoop().RunUntilIdle();
+  ASSERT_TRUE(encoded_rules);
+  EXPECT_TRUE(encoded_rules->IsType(base::Value::TYPE_BINARY));
+
+  // The encoded rules are restored.
+  cache_delegate.reset(new RulesCacheDelegate(false));
+  registry = new TestRulesRegistry(
+      profile(),
+      "testEvent",
+      content::BrowserThread::UI,
+      cache_delegate.get(),
+      RulesRegistry::WebViewKey(0, 0));
+  base::RunLoop().RunUntilIdle();  // Posted tasks retrieve the stored rule.
+  EXPECT_EQ(1, GetNumberOfRules(extension1_->id(), registry.get()));
+}
+
+TEST_F(RulesRegistryWithCacheTest, RulesRestoredFromJSONOnVersionMismatch) {
+  // Rules encoded by another version of RulesCodec, as after its kVersion is
+  // bumped, are restored from the JSON stored next to them.
+
+  // TODO(vabr): Once some API using declarative rules enters the stable
+  // channel, make sure to use that API here, and remove |channel|.
+  ScopedCurrentChannel channel(chrome::VersionInfo::CHANNEL_UNKNOWN);
+
+  ExtensionService* extension_service = env_.GetExtensionService();
+  StateStore* store = env_.GetExtensionSystem()->rules_store();
+
+  std::string error;
+  scoped_refptr<Extension> extension(
+      LoadManifestUnchecked("permissions",
+                            "web_request_all_host_permissions.json",
+                            Manifest::INVALID_LOCATION,
+                            Extension::NO_FLAGS,
+                            extension1_->id(),
+                            &error));
+  ASSERT_TRUE(error.empty());
+  extension_service->AddExtension(extension.get());
+  env_.GetExtensionSystem()->SetReady();
+
+  // Store a rule, both as JSON and encoded.
+  scoped_ptr<RulesCacheDelegate> cache_delegate(new RulesCacheDelegate(false));
+  scoped_refptr<TestRulesRegistry> registry(new TestRulesRegistry(
+      profile(),
+      "testEvent",
+      content::BrowserThread::UI,
+      cache_delegate.get(),
+      RulesRegistry::WebViewKey(0, 0)));
+  AddRule(extension1_->id(), kRuleId, registry.get());
+  base::RunLoop().RunUntilIdle();  // Posted tasks store the added rule.
+
+  // Replace the encoded rule with data of another format version.
+  Pickle pickle;
+  pickle.WriteInt(RulesCodec::kVersion + 1);
+  pickle.WriteString("unknown format");
+  store->SetExtensionValue(
+      extension1_->id(),
+      "declarative_rules.testEvent.encoded",
+      make_scoped_ptr(base::BinaryValue::CreateWithCopiedBuffer(
+          static_cast<const char*>(pickle.data()),
+          pickle.size())).PassAs<base::Value>());
+  base::RunLoop().RunUntilIdle();
+
+  // The rule is still restored by the time the registry is ready.
+  cache_delegate.reset(new RulesCacheDelegate(false));
+  registry = new TestRulesRegistry(
+      profile(),
+      "testEvent",
+      content::BrowserThread::UI,
+      cache_delegate.get(),
+      RulesRegistry::WebViewKey(0, 0));
+  base::RunLoop().RunUntilIdle();  // Posted tasks retrieve the stored rule.
+  EXPECT_TRUE(registry->ready().is_signaled());
+  EXPECT_EQ(1, GetNumberOfRules(extension1_->id(), registry.get()));
+
+  // Restoring the rule encoded it in the current format again.
+  cache_delegate.reset(new RulesCacheDelegate(false));
+  registry = new TestRulesRegistry(
+      profile(),
+      "testEvent",
+      content::BrowserThread::UI,
+      cache_delegate.get(),
+      RulesRegistry::WebViewKey(0, 0));
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(1, GetNumberOfRules(extension1_->id(), registry.get()));
+
+  scoped_ptr<base::Value> encoded_rules;
+  store->GetExtensionValue(extension1_->id(),
+                           "declarative_rules.testEvent.encoded",
+                           base::Bind(&StoreValue, &encoded_rules));
+  base::RunLoop().RunUntilIdle();
+  ASSERT_TRUE(encoded_rules);
+  ASSERT_TRUE(encoded_rules->IsType(base::Value::TYPE_BINARY));
+  const base::BinaryValue* binary_value =
+      static_cast<const base::BinaryValue*>(encoded_rules.get());
+  std::vector<linked_ptr<RulesRegistry::Rule> > decoded_rules;
+  EXPECT_EQ(RulesCodec::DECODED,
+            RulesCodec::Decode(binary_value->GetBuffer(),
+                               binary_value->GetSize(),
+                               &decoded_rules));
+  EXPECT_EQ(1u, decoded_rules.size());
+}
+
 TEST_F(RulesRegistryWithCacheTest, ConcurrentStoringOfRules) {
   // When an extension updates its rules, the new set of rules is stored to disk
   // with some delay. While it is acceptable for a quick series of updates for a
@@ -392,7 +559,8 @@ TEST_F(RulesRegistryWithCacheTest, ConcurrentStoringOfRules) {
   EXPECT_EQ("", AddRule(extension2_->id(), kRule2Id));
   env_.GetExtensionSystem()->SetReady();
   base::RunLoop().RunUntilIdle();
-  EXPECT_EQ(write_count + 2, store->write_count());
+  // Each extension's rules are written as JSON and encoded.
+  EXPECT_EQ(write_count + 4, store->write_count());
 }
 
 }  //  namespace extensions
@@ -4,6 +4,8 @@
 
 #include "chrome/browser/extensions/api/declarative_webrequest/webrequest_condition.h"
 
+#include <algorithm>
+
 #include "base/bind.h"
 #include "base/logging.h"
 #include "base/stl_util.h"
@@ -35,6 +37,34 @@ const char kInvalidTypeOfParamter[] = "Attribute '%s' has an invalid type";
 const char kConditionCannotBeFulfilled[] = "A condition can never be "
     "fulfilled because its attributes cannot all be tested at the "
     "same time in the request life-cycle.";
+
+// Returns the relative cost of testing an attribute of |type|, so that
+// conditions test their cheapest attributes first.
+int GetEvaluationCost(extensions::WebRequestConditionAttribute::Type type) {
+  typedef extensions::WebRequestConditionAttribute Attribute;
+  switch (type) {
+    case Attribute::CONDITION_STAGES:
+      return 0;  // Compares bit masks.
+    case Attribute::CONDITION_RESOURCE_TYPE:
+      return 1;  // Looks up the request info.
+    case Attribute::CONDITION_THIRD_PARTY:
+      return 2;  // Compares the registry controlled domains of two URLs.
+    case Attribute::CONDITION_CONTENT_TYPE:
+      return 3;  // Parses the Content-Type header.
+    case Attribute::CONDITION_REQUEST_HEADERS:
+    case Attribute::CONDITION_RESPONSE_HEADERS:
+      return 4;  // Tests every header.
+  }
+  NOTREACHED();
+  return 4;
+}
+
+bool IsCheaperToEvaluate(
+    const scoped_refptr<const extensions::WebRequestConditionAttribute>& a,
+    const scoped_refptr<const extensions::WebRequestConditionAttribute>& b) {
+  return GetEvaluationCost(a->GetType()) < GetEvaluationCost(b->GetType());
+}
+
 }  // namespace
 
 namespace extensions {
@@ -86,6 +116,8 @@ WebRequestCondition::WebRequestCondition(
        condition_attributes_.begin(); i != condition_attributes_.end(); ++i) {
     applicable_request_stages_ &= (*i)->GetStages();
   }
+  std::stable_sort(condition_attributes_.begin(), condition_attributes_.end(),
+                   &IsCheaperToEvaluate);
 }
 
 WebRequestCondition::~WebRequestCondition() {}
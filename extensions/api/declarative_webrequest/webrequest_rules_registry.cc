@@ -33,10 +33,17 @@ const char kAllURLsPermissionNeeded[] =
     "To execute the action '*', you need to request host permission for all "
     "hosts.";
 
+// The number of requests whose URLMatcher results are cached.
+const size_t kURLMatchCacheSize = 128;
+
 }  // namespace
 
 namespace extensions {
 
+WebRequestRulesRegistry::URLMatchResults::URLMatchResults() {}
+
+WebRequestRulesRegistry::URLMatchResults::~URLMatchResults() {}
+
 WebRequestRulesRegistry::WebRequestRulesRegistry(
     Profile* profile,
     RulesCacheDelegate* cache_delegate,
@@ -46,6 +53,7 @@ WebRequestRulesRegistry::WebRequestRulesRegistry(
                     content::BrowserThread::IO,
                     cache_delegate,
                     webview_key),
+      url_match_cache_(kURLMatchCacheSize),
       profile_id_(profile) {
   if (profile)
     extension_info_map_ = ExtensionSystem::Get(profile)->info_map();
@@ -56,10 +64,7 @@ std::set<const WebRequestRule*> WebRequestRulesRegistry::GetMatches(
   RuleSet result;
 
   WebRequestDataWithMatchIds request_data(&request_data_without_ids);
-  request_data.url_match_ids = url_matcher_.MatchURL(
-      request_data.data->request->url());
-  request_data.first_party_url_match_ids = url_matcher_.MatchURL(
-      request_data.data->request->first_party_for_cookies());
+  MatchURLs(&request_data);
 
   // 1st phase -- add all rules with some conditions without UrlFilter
   // attributes.
@@ -228,6 +233,7 @@ std::string WebRequestRulesRegistry::AddRulesImpl(
   }
   url_matcher_.AddConditionSets(all_new_condition_sets);
 
+  ClearURLMatchCache();
   ClearCacheOnNavigation();
 
   if (profile_id_ && !registered_rules.empty()) {
@@ -267,6 +273,7 @@ std::string WebRequestRulesRegistry::RemoveRulesImpl(
   // Clear URLMatcher based on condition_set_ids that are not needed any more.
   url_matcher_.RemoveConditionSets(remove_from_url_matcher);
 
+  ClearURLMatchCache();
   ClearCacheOnNavigation();
 
   return std::string();
@@ -285,6 +292,7 @@ std::string WebRequestRulesRegistry::RemoveAllRulesImpl(
   url_matcher_.RemoveConditionSets(remove_from_url_matcher);
 
   webrequest_rules_.erase(extension_id);
+  ClearURLMatchCache();
   ClearCacheOnNavigation();
   return std::string();
 }
@@ -410,4 +418,26 @@ void WebRequestRulesRegistry::AddTriggeredRules(
   }
 }
 
+void WebRequestRulesRegistry::MatchURLs(
+    WebRequestDataWithMatchIds* request_data) const {
+  const net::URLRequest* request = request_data->data->request;
+  const RequestURLs key(request->url().spec(),
+                        request->first_party_for_cookies().spec());
+  URLMatchCache::iterator cached = url_match_cache_.Get(key);
+  if (cached == url_match_cache_.end()) {
+    URLMatchResults results;
+    results.url_match_ids = url_matcher_.MatchURL(request->url());
+    results.first_party_url_match_ids =
+        url_matcher_.MatchURL(request->first_party_for_cookies());
+    cached = url_match_cache_.Put(key, results);
+  }
+  request_data->url_match_ids = cached->second.url_match_ids;
+  request_data->first_party_url_match_ids =
+      cached->second.first_party_url_match_ids;
+}
+
+void WebRequestRulesRegistry::ClearURLMatchCache() {
+  url_match_cache_.Clear();
+}
+
 }  // namespace extensions
@@ -11,6 +11,7 @@
 #include <string>
 #include <vector>
 
+#include "base/containers/mru_cache.h"
 #include "base/gtest_prod_util.h"
 #include "base/memory/linked_ptr.h"
 #include "base/memory/ref_counted.h"
@@ -134,6 +135,18 @@ class WebRequestRulesRegistry : public RulesRegistry {
   typedef std::set<url_matcher::URLMatcherConditionSet::ID> URLMatches;
   typedef std::set<const WebRequestRule*> RuleSet;
 
+  // The URLMatcher results for the URL and the first party URL of a request.
+  struct URLMatchResults {
+    URLMatchResults();
+    ~URLMatchResults();
+
+    URLMatches url_match_ids;
+    URLMatches first_party_url_match_ids;
+  };
+  // The specs of the URL and first party URL of a request.
+  typedef std::pair<std::string, std::string> RequestURLs;
+  typedef base::MRUCache<RequestURLs, URLMatchResults> URLMatchCache;
+
   // This bundles all consistency checkers. Returns true in case of consistency
   // and MUST set |error| otherwise.
   static bool Checker(const Extension* extension,
@@ -170,6 +183,14 @@ class WebRequestRulesRegistry : public RulesRegistry {
                          const WebRequestCondition::MatchData& request_data,
                          RuleSet* result) const;
 
+  // Sets the URL match ids of |request_data| to the URLMatcher results for
+  // its request, from |url_match_cache_| if the URLs were matched before.
+  void MatchURLs(WebRequestDataWithMatchIds* request_data) const;
+
+  // Forgets the cached URLMatcher results. Called whenever rules are added or
+  // removed.
+  void ClearURLMatchCache();
+
   // Map that tells us which WebRequestRule may match under the condition that
   // the URLMatcherConditionSet::ID was returned by the |url_matcher_|.
   RuleTriggers rule_triggers_;
@@ -183,6 +204,11 @@ class WebRequestRulesRegistry : public RulesRegistry {
 
   url_matcher::URLMatcher url_matcher_;
 
+  // The URLMatcher results for recent requests. The subresources of a page
+  // share their first party URL and often their URL, and every request is
+  // matched once for each stage.
+  mutable URLMatchCache url_match_cache_;
+
   void* profile_id_;
   scoped_refptr<InfoMap> extension_info_map_;
 
@@ -0,0 +1,192 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/memory/linked_ptr.h"
+#include "base/message_loop/message_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/test/values_test_util.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "chrome/browser/extensions/api/declarative_webrequest/webrequest_constants.h"
+#include "chrome/browser/extensions/api/declarative_webrequest/webrequest_rules_registry.h"
+#include "chrome/browser/extensions/api/web_request/web_request_perftest_util.h"
+#include "chrome/common/extensions/extension_test_util.h"
+#include "content/public/test/test_browser_thread.h"
+#include "net/base/request_priority.h"
+#include "net/http/http_response_headers.h"
+#include "net/http/http_util.h"
+#include "net/url_request/url_request_test_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+using extension_test_util::LoadManifestUnchecked;
+
+namespace extensions {
+
+namespace keys = declarative_webrequest_constants;
+namespace perftest_util = web_request_perftest_util;
+
+namespace {
+
+const char kExtensionId[] = "ext1";
+
+// The number of rules registered.
+const int kRuleCount = 10000;
+
+// The number of times the page is loaded.
+const int kPageLoads = 10;
+
+// The stages each request is matched in.
+const RequestStage kStages[] = {
+  ON_BEFORE_REQUEST, ON_BEFORE_SEND_HEADERS, ON_HEADERS_RECEIVED,
+};
+
+class TestWebRequestRulesRegistry : public WebRequestRulesRegistry {
+ public:
+  explicit TestWebRequestRulesRegistry(
+      scoped_refptr<InfoMap> extension_info_map)
+      : WebRequestRulesRegistry(NULL /*profile*/,
+                                NULL /* cache_delegate */,
+                                WebViewKey(0, 0)) {
+    SetExtensionInfoMapForTesting(extension_info_map);
+  }
+
+ protected:
+  virtual ~TestWebRequestRulesRegistry() {}
+
+  virtual void ClearCacheOnNavigation() OVERRIDE {}
+};
+
+// Returns the |i|th rule. Most rules match the URLs of other sites; every
+// hundredth matches images of the page by their content type, and another
+// hundredth matches third party ads.
+linked_ptr<RulesRegistry::Rule> CreateRule(int i) {
+  std::string condition;
+  if (i % 100 == 0) {
+    condition =
+        "\"url\": { \"hostSuffix\": \"news.com\" }, "
+        "\"contentType\": [\"image/gif\"], "
+        "\"resourceType\": [\"image\"], ";
+  } else if (i % 100 == 1) {
+    condition =
+        "\"url\": { \"pathContains\": \"/ads/\" }, "
+        "\"thirdPartyForCookies\": true, ";
+  } else {
+    condition = base::StringPrintf(
+        "\"url\": { \"hostSuffix\": \"site%d.com\", "
+        "\"pathPrefix\": \"/p%d\" }, ", i, i);
+  }
+  condition += "\"instanceType\": \"declarativeWebRequest.RequestMatcher\"";
+
+  base::DictionaryValue action_dict;
+  action_dict.SetString(keys::kInstanceTypeKey, keys::kCancelRequestType);
+
+  linked_ptr<RulesRegistry::Rule> rule(new RulesRegistry::Rule);
+  rule->id.reset(new std::string("rule" + base::IntToString(i)));
+  rule->priority.reset(new int(100));
+  rule->actions.push_back(linked_ptr<base::Value>(action_dict.DeepCopy()));
+  rule->conditions.push_back(linked_ptr<base::Value>(
+      base::test::ParseJson("{ " + condition + " }").release()));
+  return rule;
+}
+
+}  // namespace
+
+class WebRequestRulesRegistryPerfTest : public testing::Test {
+ public:
+  WebRequestRulesRegistryPerfTest()
+      : ui_(content::BrowserThread::UI, &message_loop_),
+        io_(content::BrowserThread::IO, &message_loop_) {}
+
+  virtual void SetUp() OVERRIDE {
+    std::string error;
+    extension_ = LoadManifestUnchecked("permissions",
+                                       "web_request_all_host_permissions.json",
+                                       Manifest::INVALID_LOCATION,
+                                       Extension::NO_FLAGS,
+                                       kExtensionId,
+                                       &error);
+    ASSERT_TRUE(extension_.get()) << error;
+    extension_info_map_ = new InfoMap;
+    extension_info_map_->AddExtension(extension_.get(),
+                                      base::Time(),
+                                      false /*incognito_enabled*/,
+                                      false /*notifications_disabled*/);
+  }
+
+  virtual void TearDown() OVERRIDE {
+    message_loop_.RunUntilIdle();
+  }
+
+ protected:
+  // Matches the requests of |kPageLoads| page loads in every stage. Unless
+  // |repeat_urls|, each page load requests different URLs.
+  void RunPageLoads(WebRequestRulesRegistry* registry, bool repeat_urls) {
+    const std::string response =
+        "HTTP/1.1 200 OK\r\nContent-Type: image/png\r\n\r\n";
+    scoped_refptr<net::HttpResponseHeaders> response_headers(
+        new net::HttpResponseHeaders(net::HttpUtil::AssembleRawHeaders(
+            response.c_str(), response.size())));
+
+    net::TestURLRequestContext context;
+    base::TimeDelta total_time;
+    size_t matched_rules = 0;
+    int evaluations = 0;
+    for (int load = 0; load < kPageLoads; ++load) {
+      const std::string query =
+          repeat_urls ? std::string() : "#load" + base::IntToString(load);
+      for (size_t i = 0; i < perftest_util::kNewsPageRequestCount; ++i) {
+        net::TestURLRequest request(
+            GURL(perftest_util::kNewsPageRequests[i].url + query),
+            net::DEFAULT_PRIORITY, NULL, &context);
+        request.set_first_party_for_cookies(
+            GURL(perftest_util::kNewsPageURL + query));
+        for (size_t stage = 0; stage < arraysize(kStages); ++stage) {
+          WebRequestData request_data(&request, kStages[stage],
+                                      response_headers.get());
+          base::TimeTicks start = base::TimeTicks::Now();
+          matched_rules += registry->GetMatches(request_data).size();
+          total_time += base::TimeTicks::Now() - start;
+          ++evaluations;
+        }
+      }
+    }
+    EXPECT_GT(matched_rules, 0u);
+    perf_test::PrintResult(
+        "declarative_webrequest_match",
+        repeat_urls ? "_repeated_urls" : "_unique_urls",
+        base::IntToString(kRuleCount) + "_rules",
+        total_time.InMillisecondsF() * 1000 / evaluations, "us", true);
+  }
+
+  base::MessageLoopForIO message_loop_;
+  content::TestBrowserThread ui_;
+  content::TestBrowserThread io_;
+  scoped_refptr<Extension> extension_;
+  scoped_refptr<InfoMap> extension_info_map_;
+};
+
+TEST_F(WebRequestRulesRegistryPerfTest, GetMatches) {
+  scoped_refptr<TestWebRequestRulesRegistry> registry(
+      new TestWebRequestRulesRegistry(extension_info_map_));
+  std::vector<linked_ptr<RulesRegistry::Rule> > rules;
+  for (int i = 0; i < kRuleCount; ++i)
+    rules.push_back(CreateRule(i));
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  ASSERT_EQ("", registry->AddRules(kExtensionId, rules));
+  perf_test::PrintResult("declarative_webrequest_add_rules", "",
+                         base::IntToString(kRuleCount) + "_rules",
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+
+  RunPageLoads(registry.get(), false);
+  RunPageLoads(registry.get(), true);
+}
+
+}  // namespace extensions
@@ -665,6 +665,44 @@ TEST_F(WebRequestRulesRegistryTest, GetMatchesDifferentUrls) {
   }
 }
 
+// Test that the URLMatcher results cached for a request are dropped when
+// rules are added or removed.
+TEST_F(WebRequestRulesRegistryTest, GetMatchesAfterRulesChange) {
+  scoped_refptr<TestWebRequestRulesRegistry> registry(
+      new TestWebRequestRulesRegistry(extension_info_map_));
+  std::vector<linked_ptr<RulesRegistry::Rule> > rules;
+  rules.push_back(CreateRule1());
+  EXPECT_EQ("", registry->AddRules(kExtensionId, rules));
+
+  GURL url("http://www.example.com/index.html");
+  net::TestURLRequestContext context;
+  net::TestURLRequest http_request(url, net::DEFAULT_PRIORITY, NULL, &context);
+  WebRequestData request_data(&http_request, ON_BEFORE_REQUEST);
+  EXPECT_EQ(1u, registry->GetMatches(request_data).size());
+
+  // A later stage of the same request matches the same rules.
+  request_data.stage = ON_BEFORE_SEND_HEADERS;
+  EXPECT_EQ(1u, registry->GetMatches(request_data).size());
+
+  rules.clear();
+  rules.push_back(CreateIgnoreRule());
+  EXPECT_EQ("", registry->AddRules(kExtensionId, rules));
+  EXPECT_EQ(2u, registry->GetMatches(request_data).size());
+
+  std::vector<std::string> rules_to_remove;
+  rules_to_remove.push_back(kRuleId1);
+  EXPECT_EQ("", registry->RemoveRules(kExtensionId, rules_to_remove));
+  std::set<const WebRequestRule*> matches =
+      registry->GetMatches(request_data);
+  ASSERT_EQ(1u, matches.size());
+  EXPECT_EQ(WebRequestRule::GlobalRuleId(
+                std::make_pair(kExtensionId, kRuleId4)),
+            (*matches.begin())->id());
+
+  EXPECT_EQ("", registry->RemoveAllRules(kExtensionId));
+  EXPECT_TRUE(registry->GetMatches(request_data).empty());
+}
+
 TEST(WebRequestRulesRegistrySimpleTest, StageChecker) {
   // The contentType condition can only be evaluated during ON_HEADERS_RECEIVED
   // but the redirect action can only be executed during ON_BEFORE_REQUEST.
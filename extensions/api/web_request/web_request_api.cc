@@ -29,6 +29,7 @@
 #include "chrome/browser/extensions/api/web_request/upload_data_presenter.h"
 #include "chrome/browser/extensions/api/web_request/web_request_api_constants.h"
 #include "chrome/browser/extensions/api/web_request/web_request_api_helpers.h"
+#include "chrome/browser/extensions/api/web_request/web_request_listener_index.h"
 #include "chrome/browser/extensions/api/web_request/web_request_time_tracker.h"
 #include "chrome/browser/extensions/extension_renderer_state.h"
 #include "chrome/browser/extensions/extension_warning_service.h"
@@ -338,6 +339,59 @@ base::StringValue* GetStatusLine(net::HttpResponseHeaders* headers) {
       headers ? headers->GetStatusLine() : std::string());
 }
 
+// Returns the size of a string of |length| bytes written to a Pickle, which
+// aligns every field to 4 bytes.
+size_t GetPickledStringSize(size_t length) {
+  const size_t kAlignment = sizeof(uint32);
+  return kAlignment + ((length + kAlignment - 1) & ~(kAlignment - 1));
+}
+
+// Returns the number of bytes |value| takes up in an IPC message, as written
+// by IPC::ParamTraits<base::DictionaryValue>.
+size_t GetSerializedSize(const base::Value& value) {
+  // The type of the value comes first.
+  size_t size = sizeof(uint32);
+  switch (value.GetType()) {
+    case base::Value::TYPE_NULL:
+      break;
+    case base::Value::TYPE_BOOLEAN:
+    case base::Value::TYPE_INTEGER:
+      size += sizeof(uint32);
+      break;
+    case base::Value::TYPE_DOUBLE:
+      size += sizeof(double);
+      break;
+    case base::Value::TYPE_STRING:
+      size += GetPickledStringSize(
+          static_cast<const base::StringValue&>(value).GetString().size());
+      break;
+    case base::Value::TYPE_BINARY:
+      size += GetPickledStringSize(
+          static_cast<const base::BinaryValue&>(value).GetSize());
+      break;
+    case base::Value::TYPE_DICTIONARY: {
+      size += sizeof(uint32);
+      for (base::DictionaryValue::Iterator it(
+               static_cast<const base::DictionaryValue&>(value));
+           !it.IsAtEnd(); it.Advance()) {
+        size += GetPickledStringSize(it.key().size()) +
+                GetSerializedSize(it.value());
+      }
+      break;
+    }
+    case base::Value::TYPE_LIST: {
+      const base::ListValue& list = static_cast<const base::ListValue&>(value);
+      size += sizeof(uint32);
+      for (base::ListValue::const_iterator it = list.begin();
+           it != list.end(); ++it) {
+        size += GetSerializedSize(**it);
+      }
+      break;
+    }
+  }
+  return size;
+}
+
 void RemoveEventListenerOnUI(
   void* profile_id,
   const std::string& event_name,
@@ -472,6 +526,186 @@ struct ExtensionWebRequestEventRouter::EventListener {
   EventListener() : extra_info_spec(0) {}
 };
 
+// The listeners of a profile to an event, in the order of the set holding
+// them, and their index.
+struct ExtensionWebRequestEventRouter::IndexedListeners {
+  std::vector<const EventListener*> listeners;
+  WebRequestListenerIndex index;
+};
+
+// The details of a request passed to the listeners of an event. The details
+// every listener gets are extracted once. The headers and the request body
+// are converted when the first listener which asked for them is dispatched
+// to, and only given to the listeners which asked for them.
+//
+// Listeners asking for the same parts share a set of details. Each of them
+// gets a copy, except for the last one, which is given the details
+// themselves.
+class ExtensionWebRequestEventRouter::EventDetails {
+ public:
+  explicit EventDetails(net::URLRequest* request);
+  ~EventDetails();
+
+  // The details every listener gets, to which each event adds its own.
+  base::DictionaryValue* dict() { return dict_.get(); }
+
+  // Makes the headers and the request body available to the listeners which
+  // ask for them. |headers| must outlive the dispatch; |response_headers| may
+  // be NULL, which gives an empty list.
+  void SetRequestHeaders(const net::HttpRequestHeaders& headers);
+  void SetResponseHeaders(const net::HttpResponseHeaders* headers);
+  void SetRequestBody();
+
+  // Counts the listeners sharing each set of details. Called before the first
+  // call to TakeDetails().
+  void SetListeners(const std::vector<const EventListener*>& listeners);
+
+  // Returns the details for the next of the listeners with |extra_info_spec|,
+  // and sets |serialized_size| to the bytes they take up in an IPC message.
+  scoped_ptr<base::DictionaryValue> TakeDetails(int extra_info_spec,
+                                                size_t* serialized_size);
+
+ private:
+  // The parts of the details listeners can ask for.
+  enum Part {
+    REQUEST_HEADERS_PART = 1 << 0,
+    RESPONSE_HEADERS_PART = 1 << 1,
+    REQUEST_BODY_PART = 1 << 2,
+    ALL_PARTS = (1 << 3) - 1
+  };
+
+  // The details shared by the listeners asking for the same parts.
+  struct SharedDetails {
+    SharedDetails() : listeners(0), serialized_size(0) {}
+
+    int listeners;
+    scoped_ptr<base::DictionaryValue> dict;
+    size_t serialized_size;
+  };
+
+  // Returns the available parts a listener with |extra_info_spec| asked for.
+  int GetParts(int extra_info_spec) const;
+
+  // Builds the details with |parts|.
+  void BuildDetails(int parts);
+
+  net::URLRequest* request_;
+  scoped_ptr<base::DictionaryValue> dict_;
+
+  // The available parts, and the parts converted so far.
+  int available_parts_;
+  const net::HttpRequestHeaders* request_headers_;
+  const net::HttpResponseHeaders* response_headers_;
+  scoped_ptr<base::ListValue> request_headers_list_;
+  scoped_ptr<base::ListValue> response_headers_list_;
+  scoped_ptr<base::DictionaryValue> request_body_;
+
+  // The number of different sets of details to build.
+  int shared_details_count_;
+  SharedDetails shared_details_[ALL_PARTS + 1];
+
+  DISALLOW_COPY_AND_ASSIGN(EventDetails);
+};
+
+ExtensionWebRequestEventRouter::EventDetails::EventDetails(
+    net::URLRequest* request)
+    : request_(request),
+      dict_(new base::DictionaryValue),
+      available_parts_(0),
+      request_headers_(NULL),
+      response_headers_(NULL),
+      shared_details_count_(0) {
+  ExtractRequestInfo(request, dict_.get());
+}
+
+ExtensionWebRequestEventRouter::EventDetails::~EventDetails() {}
+
+void ExtensionWebRequestEventRouter::EventDetails::SetRequestHeaders(
+    const net::HttpRequestHeaders& headers) {
+  request_headers_ = &headers;
+  available_parts_ |= REQUEST_HEADERS_PART;
+}
+
+void ExtensionWebRequestEventRouter::EventDetails::SetResponseHeaders(
+    const net::HttpResponseHeaders* headers) {
+  response_headers_ = headers;
+  available_parts_ |= RESPONSE_HEADERS_PART;
+}
+
+void ExtensionWebRequestEventRouter::EventDetails::SetRequestBody() {
+  available_parts_ |= REQUEST_BODY_PART;
+}
+
+void ExtensionWebRequestEventRouter::EventDetails::SetListeners(
+    const std::vector<const EventListener*>& listeners) {
+  for (std::vector<const EventListener*>::const_iterator it =
+           listeners.begin(); it != listeners.end(); ++it) {
+    SharedDetails& shared = shared_details_[GetParts((*it)->extra_info_spec)];
+    if (shared.listeners++ == 0)
+      ++shared_details_count_;
+  }
+}
+
+scoped_ptr<base::DictionaryValue>
+ExtensionWebRequestEventRouter::EventDetails::TakeDetails(
+    int extra_info_spec,
+    size_t* serialized_size) {
+  int parts = GetParts(extra_info_spec);
+  SharedDetails& shared = shared_details_[parts];
+  DCHECK_GT(shared.listeners, 0);
+  if (!shared.dict)
+    BuildDetails(parts);
+  *serialized_size = shared.serialized_size;
+  if (--shared.listeners == 0)
+    return shared.dict.Pass();
+  return make_scoped_ptr(shared.dict->DeepCopy());
+}
+
+int ExtensionWebRequestEventRouter::EventDetails::GetParts(
+    int extra_info_spec) const {
+  int parts = 0;
+  if (extra_info_spec & ExtraInfoSpec::REQUEST_HEADERS)
+    parts |= REQUEST_HEADERS_PART;
+  if (extra_info_spec & ExtraInfoSpec::RESPONSE_HEADERS)
+    parts |= RESPONSE_HEADERS_PART;
+  if (extra_info_spec & ExtraInfoSpec::REQUEST_BODY)
+    parts |= REQUEST_BODY_PART;
+  return parts & available_parts_;
+}
+
+void ExtensionWebRequestEventRouter::EventDetails::BuildDetails(int parts) {
+  SharedDetails& shared = shared_details_[parts];
+  // A single set of details takes the parts instead of copying them.
+  const bool take_parts = shared_details_count_ == 1;
+  if (take_parts)
+    shared.dict = dict_.Pass();
+  else
+    shared.dict.reset(dict_->DeepCopy());
+
+  if (parts & REQUEST_HEADERS_PART) {
+    if (!request_headers_list_)
+      request_headers_list_.reset(GetRequestHeadersList(*request_headers_));
+    shared.dict->Set(keys::kRequestHeadersKey,
+                     take_parts ? request_headers_list_.release() :
+                                  request_headers_list_->DeepCopy());
+  }
+  if (parts & RESPONSE_HEADERS_PART) {
+    if (!response_headers_list_)
+      response_headers_list_.reset(GetResponseHeadersList(response_headers_));
+    shared.dict->Set(keys::kResponseHeadersKey,
+                     take_parts ? response_headers_list_.release() :
+                                  response_headers_list_->DeepCopy());
+  }
+  if (parts & REQUEST_BODY_PART) {
+    if (!request_body_) {
+      request_body_.reset(new base::DictionaryValue);
+      ExtractRequestInfoBody(request_, request_body_.get());
+    }
+    shared.dict->MergeDictionary(request_body_.get());
+  }
+  shared.serialized_size = GetSerializedSize(*shared.dict);
+}
+
 // Contains info about requests that are blocked waiting for a response from
 // an extension.
 struct ExtensionWebRequestEventRouter::BlockedRequest {
@@ -700,15 +934,11 @@ int ExtensionWebRequestEventRouter::OnBeforeRequest(
                            &extra_info_spec);
   if (!listeners.empty() &&
       !GetAndSetSignaled(request->identifier(), kOnBeforeRequest)) {
-    base::ListValue args;
-    base::DictionaryValue* dict = new base::DictionaryValue();
-    ExtractRequestInfo(request, dict);
-    if (extra_info_spec & ExtraInfoSpec::REQUEST_BODY)
-      ExtractRequestInfoBody(request, dict);
-    args.Append(dict);
+    EventDetails details(request);
+    details.SetRequestBody();
 
     initialize_blocked_requests |=
-        DispatchEvent(profile, request, listeners, args);
+        DispatchEvent(profile, request, listeners, &details);
   }
 
   if (!initialize_blocked_requests)
@@ -757,15 +987,11 @@ int ExtensionWebRequestEventRouter::OnBeforeSendHeaders(
                            &extra_info_spec);
   if (!listeners.empty() &&
       !GetAndSetSignaled(request->identifier(), kOnBeforeSendHeaders)) {
-    base::ListValue args;
-    base::DictionaryValue* dict = new base::DictionaryValue();
-    ExtractRequestInfo(request, dict);
-    if (extra_info_spec & ExtraInfoSpec::REQUEST_HEADERS)
-      dict->Set(keys::kRequestHeadersKey, GetRequestHeadersList(*headers));
-    args.Append(dict);
+    EventDetails details(request);
+    details.SetRequestHeaders(*headers);
 
     initialize_blocked_requests |=
-        DispatchEvent(profile, request, listeners, args);
+        DispatchEvent(profile, request, listeners, &details);
   }
 
   if (!initialize_blocked_requests)
@@ -812,14 +1038,10 @@ void ExtensionWebRequestEventRouter::OnSendHeaders(
   if (listeners.empty())
     return;
 
-  base::ListValue args;
-  base::DictionaryValue* dict = new base::DictionaryValue();
-  ExtractRequestInfo(request, dict);
-  if (extra_info_spec & ExtraInfoSpec::REQUEST_HEADERS)
-    dict->Set(keys::kRequestHeadersKey, GetRequestHeadersList(headers));
-  args.Append(dict);
+  EventDetails details(request);
+  details.SetRequestHeaders(headers);
 
-  DispatchEvent(profile, request, listeners, args);
+  DispatchEvent(profile, request, listeners, &details);
 }
 
 int ExtensionWebRequestEventRouter::OnHeadersReceived(
@@ -850,19 +1072,13 @@ int ExtensionWebRequestEventRouter::OnHeadersReceived(
 
   if (!listeners.empty() &&
       !GetAndSetSignaled(request->identifier(), kOnHeadersReceived)) {
-    base::ListValue args;
-    base::DictionaryValue* dict = new base::DictionaryValue();
-    ExtractRequestInfo(request, dict);
-    dict->SetString(keys::kStatusLineKey,
+    EventDetails details(request);
+    details.dict()->SetString(keys::kStatusLineKey,
         original_response_headers->GetStatusLine());
-    if (extra_info_spec & ExtraInfoSpec::RESPONSE_HEADERS) {
-      dict->Set(keys::kResponseHeadersKey,
-          GetResponseHeadersList(original_response_headers));
-    }
-    args.Append(dict);
+    details.SetResponseHeaders(original_response_headers);
 
     initialize_blocked_requests |=
-        DispatchEvent(profile, request, listeners, args);
+        DispatchEvent(profile, request, listeners, &details);
   }
 
   if (!initialize_blocked_requests)
@@ -911,9 +1127,8 @@ ExtensionWebRequestEventRouter::OnAuthRequired(
   if (listeners.empty())
     return net::NetworkDelegate::AUTH_REQUIRED_RESPONSE_NO_ACTION;
 
-  base::ListValue args;
-  base::DictionaryValue* dict = new base::DictionaryValue();
-  ExtractRequestInfo(request, dict);
+  EventDetails details(request);
+  base::DictionaryValue* dict = details.dict();
   dict->SetBoolean(keys::kIsProxyKey, auth_info.is_proxy);
   if (!auth_info.scheme.empty())
     dict->SetString(keys::kSchemeKey, auth_info.scheme);
@@ -924,13 +1139,9 @@ ExtensionWebRequestEventRouter::OnAuthRequired(
   challenger->SetInteger(keys::kPortKey, auth_info.challenger.port());
   dict->Set(keys::kChallengerKey, challenger);
   dict->Set(keys::kStatusLineKey, GetStatusLine(request->response_headers()));
-  if (extra_info_spec & ExtraInfoSpec::RESPONSE_HEADERS) {
-    dict->Set(keys::kResponseHeadersKey,
-              GetResponseHeadersList(request->response_headers()));
-  }
-  args.Append(dict);
+  details.SetResponseHeaders(request->response_headers());
 
-  if (DispatchEvent(profile, request, listeners, args)) {
+  if (DispatchEvent(profile, request, listeners, &details)) {
     blocked_requests_[request->identifier()].event = kOnAuthRequired;
     blocked_requests_[request->identifier()].is_incognito |=
         IsIncognitoProfile(profile);
@@ -973,22 +1184,17 @@ void ExtensionWebRequestEventRouter::OnBeforeRedirect(
 
   std::string response_ip = request->GetSocketAddress().host();
 
-  base::ListValue args;
-  base::DictionaryValue* dict = new base::DictionaryValue();
-  ExtractRequestInfo(request, dict);
+  EventDetails details(request);
+  base::DictionaryValue* dict = details.dict();
   dict->SetString(keys::kRedirectUrlKey, new_location.spec());
   dict->SetInteger(keys::kStatusCodeKey, http_status_code);
   if (!response_ip.empty())
     dict->SetString(keys::kIpKey, response_ip);
   dict->SetBoolean(keys::kFromCache, request->was_cached());
   dict->Set(keys::kStatusLineKey, GetStatusLine(request->response_headers()));
-  if (extra_info_spec & ExtraInfoSpec::RESPONSE_HEADERS) {
-    dict->Set(keys::kResponseHeadersKey,
-              GetResponseHeadersList(request->response_headers()));
-  }
-  args.Append(dict);
+  details.SetResponseHeaders(request->response_headers());
 
-  DispatchEvent(profile, request, listeners, args);
+  DispatchEvent(profile, request, listeners, &details);
 }
 
 void ExtensionWebRequestEventRouter::OnResponseStarted(
@@ -1019,21 +1225,16 @@ void ExtensionWebRequestEventRouter::OnResponseStarted(
 
   std::string response_ip = request->GetSocketAddress().host();
 
-  base::ListValue args;
-  base::DictionaryValue* dict = new base::DictionaryValue();
-  ExtractRequestInfo(request, dict);
+  EventDetails details(request);
+  base::DictionaryValue* dict = details.dict();
   if (!response_ip.empty())
     dict->SetString(keys::kIpKey, response_ip);
   dict->SetBoolean(keys::kFromCache, request->was_cached());
   dict->SetInteger(keys::kStatusCodeKey, response_code);
   dict->Set(keys::kStatusLineKey, GetStatusLine(request->response_headers()));
-  if (extra_info_spec & ExtraInfoSpec::RESPONSE_HEADERS) {
-    dict->Set(keys::kResponseHeadersKey,
-              GetResponseHeadersList(request->response_headers()));
-  }
-  args.Append(dict);
+  details.SetResponseHeaders(request->response_headers());
 
-  DispatchEvent(profile, request, listeners, args);
+  DispatchEvent(profile, request, listeners, &details);
 }
 
 void ExtensionWebRequestEventRouter::OnCompleted(void* profile,
@@ -1071,21 +1272,16 @@ void ExtensionWebRequestEventRouter::OnCompleted(void* profile,
 
   std::string response_ip = request->GetSocketAddress().host();
 
-  base::ListValue args;
-  base::DictionaryValue* dict = new base::DictionaryValue();
-  ExtractRequestInfo(request, dict);
+  EventDetails details(request);
+  base::DictionaryValue* dict = details.dict();
   dict->SetInteger(keys::kStatusCodeKey, response_code);
   if (!response_ip.empty())
     dict->SetString(keys::kIpKey, response_ip);
   dict->SetBoolean(keys::kFromCache, request->was_cached());
   dict->Set(keys::kStatusLineKey, GetStatusLine(request->response_headers()));
-  if (extra_info_spec & ExtraInfoSpec::RESPONSE_HEADERS) {
-    dict->Set(keys::kResponseHeadersKey,
-              GetResponseHeadersList(request->response_headers()));
-  }
-  args.Append(dict);
+  details.SetResponseHeaders(request->response_headers());
 
-  DispatchEvent(profile, request, listeners, args);
+  DispatchEvent(profile, request, listeners, &details);
 }
 
 void ExtensionWebRequestEventRouter::OnErrorOccurred(
@@ -1120,9 +1316,8 @@ void ExtensionWebRequestEventRouter::OnErrorOccurred(
   if (listeners.empty())
     return;
 
-  base::ListValue args;
-  base::DictionaryValue* dict = new base::DictionaryValue();
-  ExtractRequestInfo(request, dict);
+  EventDetails details(request);
+  base::DictionaryValue* dict = details.dict();
   if (started) {
     std::string response_ip = request->GetSocketAddress().host();
     if (!response_ip.empty())
@@ -1131,9 +1326,8 @@ void ExtensionWebRequestEventRouter::OnErrorOccurred(
   dict->SetBoolean(keys::kFromCache, request->was_cached());
   dict->SetString(keys::kErrorKey,
                   net::ErrorToString(request->status().error()));
-  args.Append(dict);
 
-  DispatchEvent(profile, request, listeners, args);
+  DispatchEvent(profile, request, listeners, &details);
 }
 
 void ExtensionWebRequestEventRouter::OnURLRequestDestroyed(
@@ -1142,6 +1336,14 @@ void ExtensionWebRequestEventRouter::OnURLRequestDestroyed(
 
   signaled_requests_.erase(request->identifier());
 
+  SerializedBytesMap::iterator serialized_bytes =
+      serialized_bytes_.find(request->identifier());
+  if (serialized_bytes != serialized_bytes_.end()) {
+    UMA_HISTOGRAM_COUNTS("Extensions.WebRequest.SerializedBytesPerRequest",
+                         static_cast<int>(serialized_bytes->second));
+    serialized_bytes_.erase(serialized_bytes);
+  }
+
   request_time_tracker_->LogRequestEndTime(request->identifier(),
                                            base::Time::Now());
 }
@@ -1155,25 +1357,26 @@ bool ExtensionWebRequestEventRouter::DispatchEvent(
     void* profile_id,
     net::URLRequest* request,
     const std::vector<const EventListener*>& listeners,
-    const base::ListValue& args) {
+    EventDetails* details) {
   // TODO(mpcomplete): Consider consolidating common (extension_id,json_args)
   // pairs into a single message sent to a list of sub_event_names.
   int num_handlers_blocking = 0;
+  size_t serialized_bytes = 0;
+  details->SetListeners(listeners);
   for (std::vector<const EventListener*>::const_iterator it = listeners.begin();
        it != listeners.end(); ++it) {
-    // Filter out the optional keys that this listener didn't request.
-    scoped_ptr<base::ListValue> args_filtered(args.DeepCopy());
-    base::DictionaryValue* dict = NULL;
-    CHECK(args_filtered->GetDictionary(0, &dict) && dict);
-    if (!((*it)->extra_info_spec & ExtraInfoSpec::REQUEST_HEADERS))
-      dict->Remove(keys::kRequestHeadersKey, NULL);
-    if (!((*it)->extra_info_spec & ExtraInfoSpec::RESPONSE_HEADERS))
-      dict->Remove(keys::kResponseHeadersKey, NULL);
+    // Only pass the optional keys that this listener requested.
+    size_t serialized_size = 0;
+    scoped_ptr<base::ListValue> args(new base::ListValue);
+    args->Append(
+        details->TakeDetails((*it)->extra_info_spec, &serialized_size)
+            .release());
+    serialized_bytes += serialized_size;
 
     extensions::EventRouter::DispatchEvent(
         (*it)->ipc_sender.get(), profile_id,
         (*it)->extension_id, (*it)->sub_event_name,
-        args_filtered.Pass(),
+        args.Pass(),
         extensions::EventRouter::USER_GESTURE_UNKNOWN,
         extensions::EventFilteringInfo());
     if ((*it)->extra_info_spec &
@@ -1192,6 +1395,7 @@ bool ExtensionWebRequestEventRouter::DispatchEvent(
       ++num_handlers_blocking;
     }
   }
+  serialized_bytes_[request->identifier()] += serialized_bytes;
 
   if (num_handlers_blocking > 0) {
     blocked_requests_[request->identifier()].request = request;
@@ -1262,6 +1466,7 @@ bool ExtensionWebRequestEventRouter::AddEventListener(
     return false;
   }
   listeners_[profile][event_name].insert(listener);
+  UpdateListenerIndex(profile, event_name);
   return true;
 }
 
@@ -1295,6 +1500,7 @@ void ExtensionWebRequestEventRouter::RemoveEventListener(
   }
 
   listeners_[profile][event_name].erase(listener);
+  UpdateListenerIndex(profile, event_name);
 
   helpers::ClearCacheOnNavigation();
 }
@@ -1424,39 +1630,43 @@ void ExtensionWebRequestEventRouter::GetMatchingListenersImpl(
   if (is_guest)
     web_request_event_name.replace(0, sizeof(kWebRequest) - 1, kWebView);
 
-  std::set<EventListener>& listeners =
-      listeners_[profile][web_request_event_name];
-  for (std::set<EventListener>::iterator it = listeners.begin();
-       it != listeners.end(); ++it) {
-    if (!it->ipc_sender.get()) {
+  ListenerIndexMap::const_iterator indexes = listener_indexes_.find(profile);
+  if (indexes == listener_indexes_.end())
+    return;
+  ListenerIndexMapForProfile::const_iterator indexed =
+      indexes->second.find(web_request_event_name);
+  if (indexed == indexes->second.end())
+    return;
+
+  // The index leaves out the listeners whose host, tab, window or resource
+  // type filters rule out the request.
+  std::vector<size_t> candidates;
+  indexed->second->index.GetCandidates(url, tab_id, window_id, resource_type,
+                                       &candidates);
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const EventListener* listener = indexed->second->listeners[candidates[i]];
+    if (!listener->ipc_sender.get()) {
       // The IPC sender has been deleted. This listener will be removed soon
       // via a call to RemoveEventListener. For now, just skip it.
       continue;
     }
 
     if (is_guest &&
-        (it->embedder_process_id != webview_info.embedder_process_id ||
-         it->webview_instance_id != webview_info.instance_id))
+        (listener->embedder_process_id != webview_info.embedder_process_id ||
+         listener->webview_instance_id != webview_info.instance_id))
       continue;
 
-    if (!it->filter.urls.is_empty() && !it->filter.urls.MatchesURL(url))
-      continue;
-    if (it->filter.tab_id != -1 && tab_id != it->filter.tab_id)
-      continue;
-    if (it->filter.window_id != -1 && window_id != it->filter.window_id)
-      continue;
-    if (!it->filter.types.empty() &&
-        std::find(it->filter.types.begin(), it->filter.types.end(),
-                  resource_type) == it->filter.types.end())
+    if (!listener->filter.urls.is_empty() &&
+        !listener->filter.urls.MatchesURL(url))
       continue;
 
     if (!is_guest && !WebRequestPermissions::CanExtensionAccessURL(
-            extension_info_map, it->extension_id, url, crosses_incognito,
+            extension_info_map, listener->extension_id, url, crosses_incognito,
             WebRequestPermissions::REQUIRE_HOST_PERMISSION))
       continue;
 
     bool blocking_listener =
-        (it->extra_info_spec &
+        (listener->extra_info_spec &
             (ExtraInfoSpec::BLOCKING | ExtraInfoSpec::ASYNC_BLOCKING)) != 0;
 
     // We do not want to notify extensions about XHR requests that are
@@ -1472,8 +1682,32 @@ void ExtensionWebRequestEventRouter::GetMatchingListenersImpl(
     if (blocking_listener && synchronous_xhr_from_extension)
       continue;
 
-    matching_listeners->push_back(&(*it));
-    *extra_info_spec |= it->extra_info_spec;
+    matching_listeners->push_back(listener);
+    *extra_info_spec |= listener->extra_info_spec;
+  }
+}
+
+void ExtensionWebRequestEventRouter::UpdateListenerIndex(
+    void* profile,
+    const std::string& event_name) {
+  const std::set<EventListener>& listeners = listeners_[profile][event_name];
+  ListenerIndexMapForProfile& indexes = listener_indexes_[profile];
+  if (listeners.empty()) {
+    indexes.erase(event_name);
+    if (indexes.empty())
+      listener_indexes_.erase(profile);
+    return;
+  }
+
+  linked_ptr<IndexedListeners>& indexed = indexes[event_name];
+  if (!indexed.get())
+    indexed.reset(new IndexedListeners);
+  indexed->listeners.clear();
+  indexed->index.Clear();
+  for (std::set<EventListener>::const_iterator it = listeners.begin();
+       it != listeners.end(); ++it) {
+    indexed->listeners.push_back(&(*it));
+    indexed->index.Add(it->filter);
   }
 }
 
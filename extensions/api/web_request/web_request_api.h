@@ -11,6 +11,7 @@
 #include <string>
 #include <vector>
 
+#include "base/memory/linked_ptr.h"
 #include "base/memory/singleton.h"
 #include "base/memory/weak_ptr.h"
 #include "base/time/time.h"
@@ -309,12 +310,19 @@ class ExtensionWebRequestEventRouter
  private:
   friend struct DefaultSingletonTraits<ExtensionWebRequestEventRouter>;
 
+  class EventDetails;
   struct EventListener;
+  struct IndexedListeners;
   typedef std::map<std::string, std::set<EventListener> > ListenerMapForProfile;
   typedef std::map<void*, ListenerMapForProfile> ListenerMap;
+  typedef std::map<std::string, linked_ptr<IndexedListeners> >
+      ListenerIndexMapForProfile;
+  typedef std::map<void*, ListenerIndexMapForProfile> ListenerIndexMap;
   typedef std::map<uint64, BlockedRequest> BlockedRequestMap;
   // Map of request_id -> bit vector of EventTypes already signaled
   typedef std::map<uint64, int> SignaledRequestMap;
+  // Map of request_id -> bytes of event details sent to listeners
+  typedef std::map<uint64, size_t> SerializedBytesMap;
   // For each profile: a bool indicating whether it is an incognito profile,
   // and a pointer to the corresponding (non-)incognito profile.
   typedef std::map<void*, std::pair<bool, void*> > CrossProfileMap;
@@ -327,11 +335,13 @@ class ExtensionWebRequestEventRouter
   // destroyed safely.
   void ClearPendingCallbacks(net::URLRequest* request);
 
+  // Sends each of |listeners| the parts of |details| it asked for. Returns
+  // true if any of them blocks the request.
   bool DispatchEvent(
       void* profile,
       net::URLRequest* request,
       const std::vector<const EventListener*>& listeners,
-      const base::ListValue& args);
+      EventDetails* details);
 
   // Returns a list of event listeners that care about the given event, based
   // on their filter parameters. |extra_info_spec| will contain the combined
@@ -434,10 +444,18 @@ class ExtensionWebRequestEventRouter
   // Returns true if |request| was already signaled to some event handlers.
   bool WasSignaled(const net::URLRequest& request) const;
 
+  // Rebuilds the index of the listeners of |profile| to |event_name|.
+  void UpdateListenerIndex(void* profile, const std::string& event_name);
+
   // A map for each profile that maps an event name to a set of extensions that
   // are listening to that event.
   ListenerMap listeners_;
 
+  // The listeners of |listeners_| indexed by their filters, so that a request
+  // is matched against the filters of only the listeners which may match it.
+  // Rebuilt whenever a listener is added or removed.
+  ListenerIndexMap listener_indexes_;
+
   // A map of network requests that are waiting for at least one event handler
   // to respond.
   BlockedRequestMap blocked_requests_;
@@ -446,6 +464,10 @@ class ExtensionWebRequestEventRouter
   // signaled and should not be sent again.
   SignaledRequestMap signaled_requests_;
 
+  // The number of bytes of event details sent to listeners for each request,
+  // recorded when the request is destroyed.
+  SerializedBytesMap serialized_bytes_;
+
   // A map of original profile -> corresponding incognito profile (and vice
   // versa).
   CrossProfileMap cross_profile_map_;
@@ -742,6 +742,52 @@ TEST_F(ExtensionWebRequestTest, NoAccessRequestBodyData) {
   EXPECT_EQ(i, ipc_sender_.sent_end());
 }
 
+// The request body is only passed to the listeners which asked for it.
+TEST_F(ExtensionWebRequestTest, RequestBodyOnlyForListenersAskingForIt) {
+  const std::string kEventName(web_request::OnBeforeRequest::kEventName);
+  ExtensionWebRequestEventRouter::RequestFilter filter;
+  int extra_info_spec_body = 0;
+  int extra_info_spec_empty = 0;
+  ASSERT_TRUE(GenerateInfoSpec("blocking,requestBody", &extra_info_spec_body));
+  ASSERT_TRUE(GenerateInfoSpec("blocking", &extra_info_spec_empty));
+  base::WeakPtrFactory<TestIPCSender> ipc_sender_factory(&ipc_sender_);
+
+  ExtensionWebRequestEventRouter::GetInstance()->AddEventListener(
+      &profile_, "1", "1", kEventName, kEventName + "/1", filter,
+      extra_info_spec_body, -1, -1, ipc_sender_factory.GetWeakPtr());
+  ExtensionWebRequestEventRouter::GetInstance()->AddEventListener(
+      &profile_, "2", "2", kEventName, kEventName + "/2", filter,
+      extra_info_spec_empty, -1, -1, ipc_sender_factory.GetWeakPtr());
+
+  const char kPlainBlock[] = "abcd\n";
+  std::vector<char> plain(kPlainBlock, kPlainBlock + sizeof(kPlainBlock) - 1);
+  // One task for each listener.
+  ipc_sender_.PushTask(base::Bind(&base::DoNothing));
+  FireURLRequestWithData("POST", NULL /*no header*/, plain, plain);
+
+  base::MessageLoop::current()->RunUntilIdle();
+
+  ExtensionWebRequestEventRouter::GetInstance()->RemoveEventListener(
+      &profile_, "1", kEventName + "/1");
+  ExtensionWebRequestEventRouter::GetInstance()->RemoveEventListener(
+      &profile_, "2", kEventName + "/2");
+
+  const bool kHasBody[] = { true, false };
+  TestIPCSender::SentMessages::const_iterator i = ipc_sender_.sent_begin();
+  for (size_t listener = 0; listener < arraysize(kHasBody); ++listener, ++i) {
+    SCOPED_TRACE(testing::Message("listener number ") << listener);
+    ASSERT_NE(i, ipc_sender_.sent_end());
+    const base::DictionaryValue* details = NULL;
+    ExtensionMsg_MessageInvoke::Param param;
+    GetPartOfMessageArguments(i->get(), &details, &param);
+    ASSERT_TRUE(details != NULL);
+    EXPECT_EQ(kHasBody[listener], details->HasKey(keys::kRequestBodyKey));
+    EXPECT_TRUE(details->HasKey(keys::kUrlKey));
+  }
+
+  EXPECT_EQ(i, ipc_sender_.sent_end());
+}
+
 struct HeaderModificationTest_Header {
   const char* name;
   const char* value;
@@ -0,0 +1,135 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/extensions/api/web_request/web_request_listener_index.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "extensions/common/url_pattern.h"
+#include "url/gurl.h"
+
+namespace {
+
+COMPILE_ASSERT(ResourceType::LAST_TYPE <= 32, too_many_resource_types);
+
+const uint32 kAllTypes = 0xffffffff;
+
+}  // namespace
+
+WebRequestListenerIndex::WebRequestListenerIndex() : listener_count_(0) {}
+
+WebRequestListenerIndex::~WebRequestListenerIndex() {}
+
+void WebRequestListenerIndex::Add(
+    const ExtensionWebRequestEventRouter::RequestFilter& filter) {
+  Entry entry;
+  entry.listener = listener_count_++;
+  entry.tab_id = filter.tab_id;
+  entry.window_id = filter.window_id;
+  entry.types = filter.types.empty() ? kAllTypes : 0;
+  for (size_t i = 0; i < filter.types.size(); ++i)
+    entry.types |= 1u << filter.types[i];
+
+  if (filter.urls.is_empty()) {
+    any_host_.push_back(entry);
+    return;
+  }
+  for (extensions::URLPatternSet::const_iterator it = filter.urls.begin();
+       it != filter.urls.end(); ++it) {
+    if (it->match_all_urls() || it->host().empty()) {
+      // Patterns like "file:///*" have no host but match few URLs; they are
+      // rare enough to be tested for every request.
+      AddEntry(entry, &any_host_);
+    } else if (it->match_subdomains()) {
+      AddEntry(entry, &domains_[it->host()]);
+    } else {
+      AddEntry(entry, &hosts_[it->host()]);
+    }
+  }
+}
+
+void WebRequestListenerIndex::Clear() {
+  listener_count_ = 0;
+  any_host_.clear();
+  hosts_.clear();
+  domains_.clear();
+}
+
+void WebRequestListenerIndex::GetCandidates(
+    const GURL& url,
+    int tab_id,
+    int window_id,
+    ResourceType::Type resource_type,
+    std::vector<size_t>* listeners) const {
+  listeners->clear();
+  const uint32 type_bit = 1u << resource_type;
+  AppendMatching(any_host_, tab_id, window_id, type_bit, listeners);
+
+  // URLPattern matches filesystem: URLs against their inner URL.
+  const GURL& host_url =
+      url.SchemeIsFileSystem() && url.inner_url() ? *url.inner_url() : url;
+  const std::string& host = host_url.host();
+  size_t any_host_matches = listeners->size();
+  if (!host.empty()) {
+    AppendMatchingHost(hosts_, host, tab_id, window_id, type_bit, listeners);
+    AppendMatchingHost(domains_, host, tab_id, window_id, type_bit,
+                       listeners);
+    // URLPattern does not match subdomains of IP addresses.
+    if (!host_url.HostIsIPAddress()) {
+      for (size_t dot = host.find('.'); dot != std::string::npos;
+           dot = host.find('.', dot + 1)) {
+        AppendMatchingHost(domains_, host.substr(dot + 1), tab_id, window_id,
+                           type_bit, listeners);
+      }
+    }
+  }
+
+  // Puts the listeners from the different buckets in order, dropping those
+  // appended from more than one bucket.
+  if (listeners->size() > any_host_matches) {
+    std::sort(listeners->begin(), listeners->end());
+    listeners->erase(std::unique(listeners->begin(), listeners->end()),
+                     listeners->end());
+  }
+}
+
+// static
+void WebRequestListenerIndex::AddEntry(const Entry& entry, Entries* entries) {
+  // Entries are added in the order of the listeners, so a listener with
+  // several patterns in the same bucket would be the last entry.
+  if (entries->empty() || entries->back().listener != entry.listener)
+    entries->push_back(entry);
+}
+
+// static
+void WebRequestListenerIndex::AppendMatching(const Entries& entries,
+                                             int tab_id,
+                                             int window_id,
+                                             uint32 type_bit,
+                                             std::vector<size_t>* listeners) {
+  for (Entries::const_iterator it = entries.begin(); it != entries.end();
+       ++it) {
+    if (it->tab_id != -1 && it->tab_id != tab_id)
+      continue;
+    if (it->window_id != -1 && it->window_id != window_id)
+      continue;
+    if (!(it->types & type_bit))
+      continue;
+    listeners->push_back(it->listener);
+  }
+}
+
+// static
+void WebRequestListenerIndex::AppendMatchingHost(
+    const HostMap& map,
+    const std::string& host,
+    int tab_id,
+    int window_id,
+    uint32 type_bit,
+    std::vector<size_t>* listeners) {
+  HostMap::const_iterator it = map.find(host);
+  if (it != map.end())
+    AppendMatching(it->second, tab_id, window_id, type_bit, listeners);
+}
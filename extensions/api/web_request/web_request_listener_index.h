@@ -0,0 +1,97 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_EXTENSIONS_API_WEB_REQUEST_WEB_REQUEST_LISTENER_INDEX_H_
+#define CHROME_BROWSER_EXTENSIONS_API_WEB_REQUEST_WEB_REQUEST_LISTENER_INDEX_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
+#include "chrome/browser/extensions/api/web_request/web_request_api.h"
+#include "webkit/common/resource_type.h"
+
+class GURL;
+
+// WebRequestListenerIndex finds the listeners of a webRequest event whose
+// filters may match a request, without testing the filter of every listener.
+// Listeners are identified by their position in the list of listeners the
+// index is built from, and are added in that order.
+//
+// Listeners are kept in buckets by the hosts of their URL patterns, and the
+// listeners with a pattern matching any host in a bucket of their own. A
+// request is looked up in the buckets of its host and of the domains its host
+// is a subdomain of. Each bucket entry holds the tab, window and resource
+// types of the listener's filter, so that these are checked without touching
+// the filter. The index does not check schemes, ports or paths, so the caller
+// still matches the URL patterns of the listeners it returns.
+class WebRequestListenerIndex {
+ public:
+  WebRequestListenerIndex();
+  ~WebRequestListenerIndex();
+
+  // Adds the listener with |filter| as the next listener.
+  void Add(const ExtensionWebRequestEventRouter::RequestFilter& filter);
+
+  // Removes all listeners.
+  void Clear();
+
+  // Sets |listeners| to the positions of the listeners whose filters may
+  // match a request for |url| of |resource_type| from |tab_id| and
+  // |window_id|, in increasing order.
+  void GetCandidates(const GURL& url,
+                     int tab_id,
+                     int window_id,
+                     ResourceType::Type resource_type,
+                     std::vector<size_t>* listeners) const;
+
+  size_t size() const { return listener_count_; }
+
+ private:
+  // A listener in a bucket.
+  struct Entry {
+    size_t listener;
+    int tab_id;
+    int window_id;
+    // A bit for each resource type the listener accepts.
+    uint32 types;
+  };
+  typedef std::vector<Entry> Entries;
+  typedef base::hash_map<std::string, Entries> HostMap;
+
+  // Adds |entry| to |entries| unless it's there already.
+  static void AddEntry(const Entry& entry, Entries* entries);
+
+  // Appends the listeners of |entries| which accept a request from |tab_id|
+  // and |window_id| of |type_bit| to |listeners|.
+  static void AppendMatching(const Entries& entries,
+                             int tab_id,
+                             int window_id,
+                             uint32 type_bit,
+                             std::vector<size_t>* listeners);
+
+  // Appends the listeners of the bucket for |host| in |map| to |listeners|.
+  static void AppendMatchingHost(const HostMap& map,
+                                 const std::string& host,
+                                 int tab_id,
+                                 int window_id,
+                                 uint32 type_bit,
+                                 std::vector<size_t>* listeners);
+
+  size_t listener_count_;
+
+  // Listeners with a pattern matching any host, or no patterns.
+  Entries any_host_;
+
+  // Listeners by the hosts of their patterns.
+  HostMap hosts_;
+
+  // Listeners by the hosts of their patterns which match subdomains too.
+  HostMap domains_;
+
+  DISALLOW_COPY_AND_ASSIGN(WebRequestListenerIndex);
+};
+
+#endif  // CHROME_BROWSER_EXTENSIONS_API_WEB_REQUEST_WEB_REQUEST_LISTENER_INDEX_H_
@@ -0,0 +1,154 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/extensions/api/web_request/web_request_listener_index.h"
+#include "chrome/browser/extensions/api/web_request/web_request_perftest_util.h"
+#include "extensions/common/url_pattern.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+#include "url/gurl.h"
+
+using extensions::URLPattern;
+using extensions::web_request_perftest_util::kNewsPageRequestCount;
+using extensions::web_request_perftest_util::kNewsPageRequests;
+
+namespace {
+
+typedef ExtensionWebRequestEventRouter::RequestFilter RequestFilter;
+
+// Returns the filter of the |i|th of |count| listeners. A tenth of them
+// listen to all URLs, the others to one or two sites, some of them only to
+// subframes or scripts. A few listen to the hosts of the page load.
+RequestFilter FilterForListener(size_t i, size_t count) {
+  RequestFilter filter;
+  std::vector<std::string> patterns;
+  if (i % 10 == 0) {
+    patterns.push_back("<all_urls>");
+  } else if (i % 10 == 1) {
+    patterns.push_back("*://*.site" + base::Uint64ToString(i) + ".com/*");
+    patterns.push_back("*://*.example" + base::Uint64ToString(i) + ".org/*");
+  } else if (i % 50 == 2) {
+    patterns.push_back("*://*.doubleclick.net/*");
+    filter.types.push_back(ResourceType::SUB_FRAME);
+    filter.types.push_back(ResourceType::SCRIPT);
+  } else if (i % 50 == 3) {
+    patterns.push_back("http://www.news.com/*");
+  } else {
+    patterns.push_back("http://www.site" + base::Uint64ToString(count + i) +
+                       ".com/*");
+  }
+  for (size_t j = 0; j < patterns.size(); ++j) {
+    URLPattern pattern(URLPattern::SCHEME_ALL);
+    EXPECT_EQ(URLPattern::PARSE_SUCCESS, pattern.Parse(patterns[j]));
+    filter.urls.AddPattern(pattern);
+  }
+  return filter;
+}
+
+// Tests the filters of all listeners, as GetMatchingListenersImpl did before
+// the listeners were indexed.
+void MatchLinear(const std::vector<RequestFilter>& filters,
+                 const GURL& url,
+                 ResourceType::Type type,
+                 std::vector<size_t>* matches) {
+  matches->clear();
+  for (size_t i = 0; i < filters.size(); ++i) {
+    const RequestFilter& filter = filters[i];
+    if (!filter.urls.is_empty() && !filter.urls.MatchesURL(url))
+      continue;
+    if (filter.tab_id != -1 && filter.tab_id != 1)
+      continue;
+    if (filter.window_id != -1 && filter.window_id != 1)
+      continue;
+    if (!filter.types.empty() &&
+        std::find(filter.types.begin(), filter.types.end(), type) ==
+            filter.types.end())
+      continue;
+    matches->push_back(i);
+  }
+}
+
+void MatchIndexed(const std::vector<RequestFilter>& filters,
+                  const WebRequestListenerIndex& index,
+                  const GURL& url,
+                  ResourceType::Type type,
+                  std::vector<size_t>* matches) {
+  std::vector<size_t> candidates;
+  index.GetCandidates(url, 1, 1, type, &candidates);
+  matches->clear();
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const RequestFilter& filter = filters[candidates[i]];
+    if (!filter.urls.is_empty() && !filter.urls.MatchesURL(url))
+      continue;
+    matches->push_back(candidates[i]);
+  }
+}
+
+void RunDispatch(size_t listener_count) {
+  const std::string trace = base::Uint64ToString(listener_count) +
+                            "_listeners";
+  const int kIterations = 100;
+
+  std::vector<RequestFilter> filters;
+  for (size_t i = 0; i < listener_count; ++i)
+    filters.push_back(FilterForListener(i, listener_count));
+  std::vector<GURL> urls;
+  for (size_t i = 0; i < kNewsPageRequestCount; ++i)
+    urls.push_back(GURL(kNewsPageRequests[i].url));
+
+  WebRequestListenerIndex index;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t i = 0; i < filters.size(); ++i)
+    index.Add(filters[i]);
+  perf_test::PrintResult("web_request_listener_index_build", "", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+
+  // Both ways of matching find the same listeners.
+  for (size_t i = 0; i < urls.size(); ++i) {
+    std::vector<size_t> linear;
+    std::vector<size_t> indexed;
+    MatchLinear(filters, urls[i], kNewsPageRequests[i].type, &linear);
+    MatchIndexed(filters, index, urls[i], kNewsPageRequests[i].type,
+                 &indexed);
+    ASSERT_EQ(linear, indexed) << kNewsPageRequests[i].url;
+  }
+
+  const size_t requests = kIterations * urls.size();
+  std::vector<size_t> matches;
+  start = base::TimeTicks::Now();
+  for (int iteration = 0; iteration < kIterations; ++iteration) {
+    for (size_t i = 0; i < urls.size(); ++i)
+      MatchLinear(filters, urls[i], kNewsPageRequests[i].type, &matches);
+  }
+  perf_test::PrintResult(
+      "web_request_dispatch", "_linear", trace,
+      (base::TimeTicks::Now() - start).InMillisecondsF() * 1000 / requests,
+      "us", true);
+
+  start = base::TimeTicks::Now();
+  for (int iteration = 0; iteration < kIterations; ++iteration) {
+    for (size_t i = 0; i < urls.size(); ++i)
+      MatchIndexed(filters, index, urls[i], kNewsPageRequests[i].type,
+                   &matches);
+  }
+  perf_test::PrintResult(
+      "web_request_dispatch", "_indexed", trace,
+      (base::TimeTicks::Now() - start).InMillisecondsF() * 1000 / requests,
+      "us", true);
+}
+
+}  // namespace
+
+TEST(WebRequestListenerIndexPerfTest, Dispatch) {
+  RunDispatch(10);
+  RunDispatch(100);
+  RunDispatch(1000);
+}
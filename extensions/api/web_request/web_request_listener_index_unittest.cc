@@ -0,0 +1,122 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/extensions/api/web_request/web_request_listener_index.h"
+
+#include <string>
+#include <vector>
+
+#include "base/strings/string_number_conversions.h"
+#include "extensions/common/url_pattern.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "url/gurl.h"
+
+using extensions::URLPattern;
+
+namespace {
+
+typedef ExtensionWebRequestEventRouter::RequestFilter RequestFilter;
+
+RequestFilter FilterForPatterns(const char* pattern1,
+                                const char* pattern2 = NULL) {
+  RequestFilter filter;
+  const char* patterns[] = { pattern1, pattern2 };
+  for (size_t i = 0; i < arraysize(patterns) && patterns[i]; ++i) {
+    URLPattern pattern(URLPattern::SCHEME_ALL);
+    EXPECT_EQ(URLPattern::PARSE_SUCCESS, pattern.Parse(patterns[i]));
+    filter.urls.AddPattern(pattern);
+  }
+  return filter;
+}
+
+// Returns the candidates for a request for |url| from tab 1 in window 1, as a
+// string of comma separated listener positions.
+std::string GetCandidates(const WebRequestListenerIndex& index,
+                          const std::string& url,
+                          ResourceType::Type type = ResourceType::MAIN_FRAME,
+                          int tab_id = 1,
+                          int window_id = 1) {
+  std::vector<size_t> candidates;
+  index.GetCandidates(GURL(url), tab_id, window_id, type, &candidates);
+  std::string result;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    if (i)
+      result += ",";
+    result += base::Uint64ToString(candidates[i]);
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(WebRequestListenerIndexTest, Hosts) {
+  WebRequestListenerIndex index;
+  index.Add(FilterForPatterns("http://www.example.com/*"));
+  index.Add(FilterForPatterns("*://*.example.com/*"));
+  index.Add(FilterForPatterns("https://*.google.com/*",
+                              "http://www.example.com/foo*"));
+  index.Add(FilterForPatterns("http://127.0.0.1/*", "*://*.0.0.1/*"));
+  EXPECT_EQ(4u, index.size());
+
+  EXPECT_EQ("0,1,2", GetCandidates(index, "http://www.example.com/"));
+  EXPECT_EQ("1", GetCandidates(index, "http://example.com/"));
+  EXPECT_EQ("1", GetCandidates(index, "http://a.b.example.com/"));
+  EXPECT_EQ("", GetCandidates(index, "http://anexample.com/"));
+  EXPECT_EQ("2", GetCandidates(index, "https://mail.google.com/"));
+  EXPECT_EQ("", GetCandidates(index, "https://google.co.uk/"));
+
+  // Subdomain patterns do not match IP addresses.
+  EXPECT_EQ("3", GetCandidates(index, "http://127.0.0.1/"));
+
+  // filesystem: URLs are matched by their inner URL.
+  EXPECT_EQ("1", GetCandidates(index,
+                               "filesystem:http://example.com/temporary/"));
+}
+
+// Listeners matching any host are candidates for every request.
+TEST(WebRequestListenerIndexTest, AnyHost) {
+  WebRequestListenerIndex index;
+  index.Add(FilterForPatterns("http://www.example.com/*"));
+  index.Add(RequestFilter());
+  index.Add(FilterForPatterns("<all_urls>"));
+  index.Add(FilterForPatterns("*://*/*"));
+  index.Add(FilterForPatterns("file:///*"));
+
+  EXPECT_EQ("0,1,2,3,4", GetCandidates(index, "http://www.example.com/"));
+  EXPECT_EQ("1,2,3,4", GetCandidates(index, "file:///tmp/file"));
+}
+
+TEST(WebRequestListenerIndexTest, TabsWindowsAndTypes) {
+  WebRequestListenerIndex index;
+  RequestFilter filter = FilterForPatterns("*://*.example.com/*");
+  filter.tab_id = 2;
+  index.Add(filter);
+  filter = FilterForPatterns("*://*.example.com/*");
+  filter.window_id = 2;
+  index.Add(filter);
+  filter = FilterForPatterns("<all_urls>");
+  filter.types.push_back(ResourceType::IMAGE);
+  filter.types.push_back(ResourceType::SCRIPT);
+  index.Add(filter);
+
+  const std::string kURL = "http://www.example.com/";
+  EXPECT_EQ("", GetCandidates(index, kURL));
+  EXPECT_EQ("0", GetCandidates(index, kURL, ResourceType::MAIN_FRAME, 2));
+  EXPECT_EQ("1", GetCandidates(index, kURL, ResourceType::MAIN_FRAME, 1, 2));
+  EXPECT_EQ("0,1,2", GetCandidates(index, kURL, ResourceType::IMAGE, 2, 2));
+  EXPECT_EQ("2", GetCandidates(index, kURL, ResourceType::SCRIPT));
+  EXPECT_EQ("", GetCandidates(index, kURL, ResourceType::STYLESHEET));
+}
+
+TEST(WebRequestListenerIndexTest, Clear) {
+  WebRequestListenerIndex index;
+  index.Add(FilterForPatterns("<all_urls>"));
+  index.Add(FilterForPatterns("http://www.example.com/*"));
+  index.Clear();
+  EXPECT_EQ(0u, index.size());
+  EXPECT_EQ("", GetCandidates(index, "http://www.example.com/"));
+
+  index.Add(FilterForPatterns("http://www.example.com/*"));
+  EXPECT_EQ("0", GetCandidates(index, "http://www.example.com/"));
+}
@@ -0,0 +1,45 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/extensions/api/web_request/web_request_perftest_util.h"
+
+#include "base/basictypes.h"
+
+namespace extensions {
+namespace web_request_perftest_util {
+
+const char kNewsPageURL[] = "http://www.news.com/";
+
+const PageRequest kNewsPageRequests[] = {
+  { "http://www.news.com/", ResourceType::MAIN_FRAME },
+  { "http://www.news.com/css/site.css", ResourceType::STYLESHEET },
+  { "http://static.news.com/js/app.js", ResourceType::SCRIPT },
+  { "http://static.news.com/img/logo.png", ResourceType::IMAGE },
+  { "http://img.news.com/2014/06/photo1.jpg", ResourceType::IMAGE },
+  { "http://img.news.com/2014/06/photo2.jpg", ResourceType::IMAGE },
+  { "http://img.news.com/2014/06/photo3.jpg", ResourceType::IMAGE },
+  { "https://fonts.googleapis.com/css?family=Open+Sans",
+    ResourceType::STYLESHEET },
+  { "https://fonts.gstatic.com/s/opensans/v8/font.woff",
+    ResourceType::FONT_RESOURCE },
+  { "http://ajax.googleapis.com/ajax/libs/jquery/1.11.1/jquery.min.js",
+    ResourceType::SCRIPT },
+  { "http://www.google-analytics.com/ga.js", ResourceType::SCRIPT },
+  { "http://www.google-analytics.com/__utm.gif?utmwv=5", ResourceType::IMAGE },
+  { "http://pagead2.googlesyndication.com/pagead/show_ads.js",
+    ResourceType::SCRIPT },
+  { "http://ad.doubleclick.net/ads/news/home", ResourceType::SCRIPT },
+  { "http://ad.doubleclick.net/ads/news/sidebar", ResourceType::SUB_FRAME },
+  { "http://connect.facebook.net/en_US/all.js", ResourceType::SCRIPT },
+  { "http://www.facebook.com/plugins/like.php", ResourceType::SUB_FRAME },
+  { "https://platform.twitter.com/widgets.js", ResourceType::SCRIPT },
+  { "http://cdn.site7.com/p7/embed/player.js", ResourceType::SCRIPT },
+  { "http://www.news.com/api/comments?id=1", ResourceType::XHR },
+  { "http://www.news.com/favicon.ico", ResourceType::FAVICON },
+};
+
+const size_t kNewsPageRequestCount = arraysize(kNewsPageRequests);
+
+}  // namespace web_request_perftest_util
+}  // namespace extensions
@@ -0,0 +1,33 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_EXTENSIONS_API_WEB_REQUEST_WEB_REQUEST_PERFTEST_UTIL_H_
+#define CHROME_BROWSER_EXTENSIONS_API_WEB_REQUEST_WEB_REQUEST_PERFTEST_UTIL_H_
+
+#include <stddef.h>
+
+#include "webkit/common/resource_type.h"
+
+namespace extensions {
+namespace web_request_perftest_util {
+
+// A request made while loading a page.
+struct PageRequest {
+  const char* url;
+  ResourceType::Type type;
+};
+
+// The URL of the page whose requests are listed in kNewsPageRequests.
+extern const char kNewsPageURL[];
+
+// The requests of a page load on a news site, in the order they are made:
+// the page itself, its own resources and those of third party CDNs, fonts,
+// analytics, ads and social widgets.
+extern const PageRequest kNewsPageRequests[];
+extern const size_t kNewsPageRequestCount;
+
+}  // namespace web_request_perftest_util
+}  // namespace extensions
+
+#endif  // CHROME_BROWSER_EXTENSIONS_API_WEB_REQUEST_WEB_REQUEST_PERFTEST_UTIL_H_
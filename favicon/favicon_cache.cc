@@ -0,0 +1,213 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/favicon/favicon_cache.h"
+
+#include "base/metrics/histogram.h"
+#include "ui/gfx/image/image_skia.h"
+
+namespace {
+
+// The bytes charged for each entry on top of its bitmaps, so that the many
+// entries for pages without a favicon are bounded too.
+size_t EntryOverheadBytes(const FaviconCache::Key& key) {
+  return sizeof(FaviconCache::Key) + key.page_url.spec().size() + 64;
+}
+
+size_t BitmapResultsBytes(
+    const std::vector<chrome::FaviconBitmapResult>& bitmap_results) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < bitmap_results.size(); ++i) {
+    bytes += sizeof(chrome::FaviconBitmapResult) +
+        bitmap_results[i].icon_url.spec().size();
+    if (bitmap_results[i].bitmap_data.get())
+      bytes += bitmap_results[i].bitmap_data->size();
+  }
+  return bytes;
+}
+
+size_t ImageBytes(const gfx::Image& image) {
+  if (image.IsEmpty())
+    return 0;
+  gfx::ImageSkia image_skia = image.AsImageSkia();
+  const std::vector<gfx::ImageSkiaRep>& image_reps = image_skia.image_reps();
+  size_t bytes = 0;
+  for (size_t i = 0; i < image_reps.size(); ++i)
+    bytes += image_reps[i].sk_bitmap().getSize();
+  return bytes;
+}
+
+}  // namespace
+
+FaviconCache::Key::Key(
+    const GURL& page_url,
+    int icon_types,
+    int desired_size_in_dip,
+    const std::vector<ui::ScaleFactor>& desired_scale_factors)
+    : page_url(page_url),
+      icon_types(icon_types),
+      desired_size_in_dip(desired_size_in_dip),
+      desired_scale_factors(desired_scale_factors) {
+}
+
+FaviconCache::Key::~Key() {}
+
+bool FaviconCache::Key::operator<(const Key& other) const {
+  if (page_url != other.page_url)
+    return page_url < other.page_url;
+  if (icon_types != other.icon_types)
+    return icon_types < other.icon_types;
+  if (desired_size_in_dip != other.desired_size_in_dip)
+    return desired_size_in_dip < other.desired_size_in_dip;
+  return desired_scale_factors < other.desired_scale_factors;
+}
+
+FaviconCache::Entry::Entry() : bytes(0) {}
+
+FaviconCache::Entry::~Entry() {}
+
+FaviconCache::FaviconCache(size_t max_bytes)
+    : entries_(EntryMap::NO_AUTO_EVICT),
+      max_bytes_(max_bytes),
+      bytes_(0),
+      generation_(0),
+      hits_(0),
+      misses_(0) {
+}
+
+FaviconCache::~FaviconCache() {}
+
+bool FaviconCache::Get(
+    const Key& key,
+    std::vector<chrome::FaviconBitmapResult>* bitmap_results,
+    gfx::Image* image) {
+  EntryMap::iterator it = entries_.Get(key);
+  UMA_HISTOGRAM_BOOLEAN("Favicons.CacheHit", it != entries_.end());
+  if (it == entries_.end()) {
+    ++misses_;
+    return false;
+  }
+
+  ++hits_;
+  *bitmap_results = it->second.bitmap_results;
+  if (image)
+    *image = it->second.image;
+  return true;
+}
+
+void FaviconCache::Put(
+    const Key& key,
+    int generation,
+    const std::vector<chrome::FaviconBitmapResult>& bitmap_results) {
+  if (generation != generation_)
+    return;
+
+  EntryMap::iterator it = entries_.Peek(key);
+  if (it != entries_.end()) {
+    bytes_ -= it->second.bytes;
+    RemoveFromIconURLKeys(it->first, it->second);
+    entries_.Erase(it);
+  }
+
+  Entry entry;
+  entry.bitmap_results = bitmap_results;
+  entry.bytes = EntryOverheadBytes(key) + BitmapResultsBytes(bitmap_results);
+  if (entry.bytes > max_bytes_)
+    return;
+  bytes_ += entry.bytes;
+  AddToIconURLKeys(key, entry);
+  entries_.Put(key, entry);
+  EvictToSize(max_bytes_);
+}
+
+void FaviconCache::PutImage(const Key& key,
+                            int generation,
+                            const gfx::Image& image) {
+  if (generation != generation_)
+    return;
+
+  EntryMap::iterator it = entries_.Peek(key);
+  if (it == entries_.end() || !it->second.image.IsEmpty())
+    return;
+
+  size_t image_bytes = ImageBytes(image);
+  it->second.image = image;
+  it->second.bytes += image_bytes;
+  bytes_ += image_bytes;
+  EvictToSize(max_bytes_);
+}
+
+void FaviconCache::InvalidatePageURLs(const std::set<GURL>& page_urls) {
+  ++generation_;
+  EntryMap::iterator it = entries_.begin();
+  while (it != entries_.end()) {
+    if (page_urls.count(it->first.page_url)) {
+      bytes_ -= it->second.bytes;
+      RemoveFromIconURLKeys(it->first, it->second);
+      it = entries_.Erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void FaviconCache::InvalidateIconURLs(const std::set<GURL>& icon_urls) {
+  ++generation_;
+  for (std::set<GURL>::const_iterator icon_it = icon_urls.begin();
+       icon_it != icon_urls.end(); ++icon_it) {
+    IconURLKeyMap::iterator keys_it = icon_url_keys_.find(*icon_it);
+    if (keys_it == icon_url_keys_.end())
+      continue;
+    // Removing the entries updates |icon_url_keys_|.
+    const std::set<Key> keys(keys_it->second);
+    for (std::set<Key>::const_iterator key_it = keys.begin();
+         key_it != keys.end(); ++key_it) {
+      EntryMap::iterator it = entries_.Peek(*key_it);
+      DCHECK(it != entries_.end());
+      bytes_ -= it->second.bytes;
+      RemoveFromIconURLKeys(it->first, it->second);
+      entries_.Erase(it);
+    }
+  }
+}
+
+void FaviconCache::Clear() {
+  ++generation_;
+  entries_.Clear();
+  icon_url_keys_.clear();
+  bytes_ = 0;
+}
+
+void FaviconCache::TrimMemory(bool aggressively) {
+  if (aggressively)
+    Clear();
+  else
+    EvictToSize(max_bytes_ / 2);
+}
+
+void FaviconCache::EvictToSize(size_t max_bytes) {
+  while (bytes_ > max_bytes && !entries_.empty()) {
+    EntryMap::reverse_iterator oldest = entries_.rbegin();
+    bytes_ -= oldest->second.bytes;
+    RemoveFromIconURLKeys(oldest->first, oldest->second);
+    entries_.Erase(oldest);
+  }
+}
+
+void FaviconCache::AddToIconURLKeys(const Key& key, const Entry& entry) {
+  for (size_t i = 0; i < entry.bitmap_results.size(); ++i)
+    icon_url_keys_[entry.bitmap_results[i].icon_url].insert(key);
+}
+
+void FaviconCache::RemoveFromIconURLKeys(const Key& key, const Entry& entry) {
+  for (size_t i = 0; i < entry.bitmap_results.size(); ++i) {
+    IconURLKeyMap::iterator it =
+        icon_url_keys_.find(entry.bitmap_results[i].icon_url);
+    if (it == icon_url_keys_.end())
+      continue;
+    it->second.erase(key);
+    if (it->second.empty())
+      icon_url_keys_.erase(it);
+  }
+}
@@ -0,0 +1,138 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_FAVICON_FAVICON_CACHE_H_
+#define CHROME_BROWSER_FAVICON_FAVICON_CACHE_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/containers/mru_cache.h"
+#include "chrome/common/favicon/favicon_types.h"
+#include "ui/base/layout.h"
+#include "ui/gfx/image/image.h"
+#include "url/gurl.h"
+
+// An in-memory cache of the favicons of page URLs, as looked up in the history
+// backend, so that the icons shown over and over again by the UI need not be
+// read from the thumbnail database and decoded each time.
+//
+// Entries hold the bitmap results the history backend returned for a request
+// and, once a caller has decoded them, the decoded image. The least recently
+// used entries are evicted once the entries use more than the byte budget.
+// The cache does not see the thumbnail database change, so its owner must
+// invalidate the page URLs whose favicons change, and the icon URLs whose
+// bitmaps change. Many pages may share an icon, so the entries are indexed by
+// the icon URLs of their bitmap results too.
+//
+// Requests to the history backend which were started before an invalidation
+// may return data the invalidation should have removed. The cache therefore
+// only accepts entries for the current generation, which each invalidation
+// advances.
+//
+// Used on a single thread.
+class FaviconCache {
+ public:
+  struct Key {
+    Key(const GURL& page_url,
+        int icon_types,
+        int desired_size_in_dip,
+        const std::vector<ui::ScaleFactor>& desired_scale_factors);
+    ~Key();
+
+    bool operator<(const Key& other) const;
+
+    GURL page_url;
+    int icon_types;
+    int desired_size_in_dip;
+    std::vector<ui::ScaleFactor> desired_scale_factors;
+  };
+
+  explicit FaviconCache(size_t max_bytes);
+  ~FaviconCache();
+
+  // Returns true and fills in |bitmap_results| if there is an entry for |key|,
+  // which becomes the most recently used. If |image| is non-NULL it is set to
+  // the decoded image added with PutImage(), or to an empty image if there is
+  // none yet.
+  bool Get(const Key& key,
+           std::vector<chrome::FaviconBitmapResult>* bitmap_results,
+           gfx::Image* image);
+
+  // Adds an entry for |key|, replacing any existing one, unless the cache has
+  // been invalidated since |generation|.
+  void Put(const Key& key,
+           int generation,
+           const std::vector<chrome::FaviconBitmapResult>& bitmap_results);
+
+  // Adds |image|, decoded from the bitmap results of the entry for |key|, to
+  // that entry. Does nothing if there is no entry or the cache has been
+  // invalidated since |generation|.
+  void PutImage(const Key& key, int generation, const gfx::Image& image);
+
+  // Removes the entries for |page_urls|.
+  void InvalidatePageURLs(const std::set<GURL>& page_urls);
+
+  // Removes the entries holding bitmap results for |icon_urls|, whatever
+  // their page URL.
+  void InvalidateIconURLs(const std::set<GURL>& icon_urls);
+
+  // Removes all entries.
+  void Clear();
+
+  // Frees memory in response to memory pressure. Trimming aggressively
+  // removes all entries, otherwise the cache is halved.
+  void TrimMemory(bool aggressively);
+
+  // The generation to pass to Put() and PutImage() for a lookup started now.
+  int generation() const { return generation_; }
+
+  size_t size() const { return entries_.size(); }
+  size_t bytes() const { return bytes_; }
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+ private:
+  struct Entry {
+    Entry();
+    ~Entry();
+
+    std::vector<chrome::FaviconBitmapResult> bitmap_results;
+    gfx::Image image;
+
+    // The memory charged to the entry against |max_bytes_|.
+    size_t bytes;
+  };
+
+  typedef base::MRUCache<Key, Entry> EntryMap;
+
+  // The keys of the entries holding bitmap results for each icon URL.
+  typedef std::map<GURL, std::set<Key> > IconURLKeyMap;
+
+  // Updates |icon_url_keys_| for the entry |key| being added or removed.
+  void AddToIconURLKeys(const Key& key, const Entry& entry);
+  void RemoveFromIconURLKeys(const Key& key, const Entry& entry);
+
+  // Evicts the least recently used entries until at most |max_bytes| remain.
+  void EvictToSize(size_t max_bytes);
+
+  EntryMap entries_;
+  IconURLKeyMap icon_url_keys_;
+
+  const size_t max_bytes_;
+
+  // The sum of the bytes of |entries_|.
+  size_t bytes_;
+
+  int generation_;
+
+  size_t hits_;
+  size_t misses_;
+
+  DISALLOW_COPY_AND_ASSIGN(FaviconCache);
+};
+
+#endif  // CHROME_BROWSER_FAVICON_FAVICON_CACHE_H_
@@ -0,0 +1,219 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/favicon/favicon_cache.h"
+
+#include <set>
+#include <vector>
+
+#include "base/memory/ref_counted_memory.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "third_party/skia/include/core/SkBitmap.h"
+#include "ui/gfx/image/image_skia.h"
+
+namespace {
+
+const size_t kMaxBytes = 64 * 1024;
+
+FaviconCache::Key MakeKey(const std::string& page_url) {
+  std::vector<ui::ScaleFactor> scale_factors;
+  scale_factors.push_back(ui::SCALE_FACTOR_100P);
+  return FaviconCache::Key(GURL(page_url), chrome::FAVICON, 16,
+                           scale_factors);
+}
+
+std::vector<chrome::FaviconBitmapResult> MakeBitmapResults(size_t bytes) {
+  std::vector<unsigned char> data(bytes, 'a');
+  chrome::FaviconBitmapResult bitmap_result;
+  bitmap_result.bitmap_data = base::RefCountedBytes::TakeVector(&data);
+  bitmap_result.pixel_size = gfx::Size(16, 16);
+  bitmap_result.icon_url = GURL("http://www.google.com/favicon.ico");
+  bitmap_result.icon_type = chrome::FAVICON;
+  return std::vector<chrome::FaviconBitmapResult>(1, bitmap_result);
+}
+
+gfx::Image MakeImage(int edge) {
+  SkBitmap bitmap;
+  bitmap.setConfig(SkBitmap::kARGB_8888_Config, edge, edge);
+  bitmap.allocPixels();
+  bitmap.eraseColor(SK_ColorRED);
+  return gfx::Image(gfx::ImageSkia::CreateFrom1xBitmap(bitmap));
+}
+
+}  // namespace
+
+TEST(FaviconCacheTest, GetAndPut) {
+  FaviconCache cache(kMaxBytes);
+  FaviconCache::Key key = MakeKey("http://www.google.com/");
+  std::vector<chrome::FaviconBitmapResult> results;
+  EXPECT_FALSE(cache.Get(key, &results, NULL));
+
+  cache.Put(key, cache.generation(), MakeBitmapResults(1000));
+  gfx::Image image;
+  ASSERT_TRUE(cache.Get(key, &results, &image));
+  ASSERT_EQ(1u, results.size());
+  EXPECT_EQ(1000u, results[0].bitmap_data->size());
+  EXPECT_TRUE(image.IsEmpty());
+
+  // The same page at another size is a separate entry.
+  std::vector<ui::ScaleFactor> scale_factors(1, ui::SCALE_FACTOR_100P);
+  FaviconCache::Key large_key(key.page_url, chrome::FAVICON, 32,
+                              scale_factors);
+  EXPECT_FALSE(cache.Get(large_key, &results, NULL));
+
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_EQ(2u, cache.misses());
+}
+
+// Pages without a favicon are cached too.
+TEST(FaviconCacheTest, EmptyResults) {
+  FaviconCache cache(kMaxBytes);
+  FaviconCache::Key key = MakeKey("http://www.google.com/");
+  cache.Put(key, cache.generation(),
+            std::vector<chrome::FaviconBitmapResult>());
+  std::vector<chrome::FaviconBitmapResult> results = MakeBitmapResults(10);
+  EXPECT_TRUE(cache.Get(key, &results, NULL));
+  EXPECT_TRUE(results.empty());
+  EXPECT_LT(0u, cache.bytes());
+}
+
+TEST(FaviconCacheTest, PutImage) {
+  FaviconCache cache(kMaxBytes);
+  FaviconCache::Key key = MakeKey("http://www.google.com/");
+
+  // Images are only added to existing entries.
+  cache.PutImage(key, cache.generation(), MakeImage(16));
+  EXPECT_EQ(0u, cache.size());
+
+  cache.Put(key, cache.generation(), MakeBitmapResults(1000));
+  size_t bytes = cache.bytes();
+  cache.PutImage(key, cache.generation(), MakeImage(16));
+  EXPECT_EQ(bytes + 16 * 16 * 4, cache.bytes());
+
+  std::vector<chrome::FaviconBitmapResult> results;
+  gfx::Image image;
+  ASSERT_TRUE(cache.Get(key, &results, &image));
+  EXPECT_FALSE(image.IsEmpty());
+  EXPECT_EQ(16, image.Width());
+}
+
+// Least recently used entries are evicted once the byte budget is exceeded.
+TEST(FaviconCacheTest, EvictsLeastRecentlyUsed) {
+  FaviconCache cache(kMaxBytes);
+  FaviconCache::Key first = MakeKey("http://first.com/");
+  FaviconCache::Key second = MakeKey("http://second.com/");
+  cache.Put(first, cache.generation(), MakeBitmapResults(kMaxBytes / 3));
+  cache.Put(second, cache.generation(), MakeBitmapResults(kMaxBytes / 3));
+
+  std::vector<chrome::FaviconBitmapResult> results;
+  EXPECT_TRUE(cache.Get(first, &results, NULL));
+
+  cache.Put(MakeKey("http://third.com/"), cache.generation(),
+            MakeBitmapResults(kMaxBytes / 3));
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_LE(cache.bytes(), kMaxBytes);
+  EXPECT_TRUE(cache.Get(first, &results, NULL));
+  EXPECT_FALSE(cache.Get(second, &results, NULL));
+
+  // An entry larger than the whole cache is not added.
+  cache.Put(second, cache.generation(), MakeBitmapResults(kMaxBytes));
+  EXPECT_FALSE(cache.Get(second, &results, NULL));
+  EXPECT_EQ(2u, cache.size());
+}
+
+TEST(FaviconCacheTest, InvalidatePageURLs) {
+  FaviconCache cache(kMaxBytes);
+  FaviconCache::Key key = MakeKey("http://www.google.com/");
+  FaviconCache::Key other_key = MakeKey("http://www.example.com/");
+  cache.Put(other_key, cache.generation(), MakeBitmapResults(100));
+  size_t other_bytes = cache.bytes();
+  cache.Put(key, cache.generation(), MakeBitmapResults(100));
+
+  std::set<GURL> page_urls;
+  page_urls.insert(key.page_url);
+  cache.InvalidatePageURLs(page_urls);
+
+  std::vector<chrome::FaviconBitmapResult> results;
+  EXPECT_FALSE(cache.Get(key, &results, NULL));
+  EXPECT_TRUE(cache.Get(other_key, &results, NULL));
+  EXPECT_EQ(other_bytes, cache.bytes());
+}
+
+// A changed icon drops the entries of every page sharing it, even though only
+// one of the pages was notified.
+TEST(FaviconCacheTest, InvalidateIconURLs) {
+  FaviconCache cache(kMaxBytes);
+  FaviconCache::Key key = MakeKey("http://www.google.com/");
+  FaviconCache::Key sharing_key = MakeKey("http://www.google.com/search");
+  FaviconCache::Key other_key = MakeKey("http://www.example.com/");
+  std::vector<chrome::FaviconBitmapResult> other_results =
+      MakeBitmapResults(100);
+  other_results[0].icon_url = GURL("http://www.example.com/favicon.ico");
+  cache.Put(other_key, cache.generation(), other_results);
+  size_t other_bytes = cache.bytes();
+  cache.Put(key, cache.generation(), MakeBitmapResults(100));
+  cache.Put(sharing_key, cache.generation(), MakeBitmapResults(100));
+  ASSERT_EQ(3u, cache.size());
+
+  int generation = cache.generation();
+  std::set<GURL> icon_urls;
+  icon_urls.insert(GURL("http://www.google.com/favicon.ico"));
+  cache.InvalidateIconURLs(icon_urls);
+
+  std::vector<chrome::FaviconBitmapResult> results;
+  EXPECT_FALSE(cache.Get(key, &results, NULL));
+  EXPECT_FALSE(cache.Get(sharing_key, &results, NULL));
+  EXPECT_TRUE(cache.Get(other_key, &results, NULL));
+  EXPECT_EQ(other_bytes, cache.bytes());
+
+  // Lookups started before the icon changed are not cached.
+  cache.Put(sharing_key, generation, MakeBitmapResults(100));
+  EXPECT_EQ(1u, cache.size());
+
+  // Entries put back after the invalidation are indexed again.
+  cache.Put(key, cache.generation(), MakeBitmapResults(100));
+  cache.InvalidateIconURLs(icon_urls);
+  EXPECT_EQ(1u, cache.size());
+  EXPECT_EQ(other_bytes, cache.bytes());
+}
+
+// Results of lookups started before an invalidation are not cached.
+TEST(FaviconCacheTest, StaleGeneration) {
+  FaviconCache cache(kMaxBytes);
+  FaviconCache::Key key = MakeKey("http://www.google.com/");
+  int generation = cache.generation();
+
+  std::set<GURL> page_urls;
+  page_urls.insert(key.page_url);
+  cache.InvalidatePageURLs(page_urls);
+  cache.Put(key, generation, MakeBitmapResults(100));
+  EXPECT_EQ(0u, cache.size());
+
+  cache.Put(key, cache.generation(), MakeBitmapResults(100));
+  generation = cache.generation();
+  cache.Clear();
+  cache.Put(key, cache.generation(), MakeBitmapResults(100));
+  cache.PutImage(key, generation, MakeImage(16));
+  gfx::Image image;
+  std::vector<chrome::FaviconBitmapResult> results;
+  ASSERT_TRUE(cache.Get(key, &results, &image));
+  EXPECT_TRUE(image.IsEmpty());
+}
+
+TEST(FaviconCacheTest, TrimMemory) {
+  FaviconCache cache(kMaxBytes);
+  for (int i = 0; i < 8; ++i) {
+    cache.Put(MakeKey("http://site" + std::string(1, 'a' + i) + ".com/"),
+              cache.generation(), MakeBitmapResults(kMaxBytes / 10));
+  }
+  EXPECT_EQ(8u, cache.size());
+
+  cache.TrimMemory(false);
+  EXPECT_LE(cache.bytes(), kMaxBytes / 2);
+  EXPECT_LT(0u, cache.size());
+
+  cache.TrimMemory(true);
+  EXPECT_EQ(0u, cache.size());
+  EXPECT_EQ(0u, cache.bytes());
+}
@@ -15,7 +15,12 @@ struct FaviconChangedDetails : public history::HistoryDetails {
   FaviconChangedDetails();
   virtual ~FaviconChangedDetails();
 
+  // The page URLs whose favicon mappings or favicons changed.
   std::set<GURL> urls;
+
+  // The icon URLs whose bitmaps changed. Every page mapped to them is
+  // affected, not only |urls|.
+  std::set<GURL> icon_urls;
 };
 
 #endif  // CHROME_BROWSER_FAVICON_FAVICON_CHANGED_DETAILS_H_
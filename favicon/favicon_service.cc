@@ -6,6 +6,8 @@
 
 #include "base/hash.h"
 #include "base/message_loop/message_loop_proxy.h"
+#include "chrome/browser/chrome_notification_types.h"
+#include "chrome/browser/favicon/favicon_changed_details.h"
 #include "chrome/browser/favicon/favicon_util.h"
 #include "chrome/browser/history/history_backend.h"
 #include "chrome/browser/history/history_service.h"
@@ -15,6 +17,8 @@
 #include "chrome/common/favicon/favicon_types.h"
 #include "chrome/common/importer/imported_favicon_usage.h"
 #include "chrome/common/url_constants.h"
+#include "content/public/browser/notification_details.h"
+#include "content/public/browser/notification_source.h"
 #include "extensions/common/constants.h"
 #include "third_party/skia/include/core/SkBitmap.h"
 #include "ui/gfx/codec/png_codec.h"
@@ -25,6 +29,10 @@ using base::Bind;
 
 namespace {
 
+// The most memory the favicons cached for page URLs may use. A 16x16 favicon
+// takes about 1KB for its PNG data and as much again once decoded.
+const size_t kFaviconCacheMaxBytes = 2 * 1024 * 1024;
+
 void CancelOrRunFaviconResultsCallback(
     const base::CancelableTaskTracker::IsCanceledCallback& is_canceled,
     const FaviconService::FaviconResultsCallback& callback,
@@ -62,12 +70,83 @@ base::CancelableTaskTracker::TaskId GetFaviconForChromeURL(
   return id;
 }
 
+chrome::FaviconImageResult MakeFaviconImageResult(
+    const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results,
+    int desired_size_in_dip) {
+  chrome::FaviconImageResult image_result;
+  image_result.image = FaviconUtil::SelectFaviconFramesFromPNGs(
+      favicon_bitmap_results,
+      FaviconUtil::GetFaviconScaleFactors(),
+      desired_size_in_dip);
+  FaviconUtil::SetFaviconColorSpace(&image_result.image);
+
+  image_result.icon_url = image_result.image.IsEmpty() ?
+      GURL() : favicon_bitmap_results[0].icon_url;
+  return image_result;
+}
+
+// Returns the single bitmap of |favicon_bitmap_results|, resized to
+// |desired_size_in_dip| at |desired_scale_factor| if needed, or an invalid
+// result if there is none.
+chrome::FaviconBitmapResult ResizeFaviconBitmapResult(
+    const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results,
+    int desired_size_in_dip,
+    ui::ScaleFactor desired_scale_factor) {
+  if (favicon_bitmap_results.empty() || !favicon_bitmap_results[0].is_valid()) {
+    return chrome::FaviconBitmapResult();
+  }
+
+  DCHECK_EQ(1u, favicon_bitmap_results.size());
+  chrome::FaviconBitmapResult bitmap_result = favicon_bitmap_results[0];
+
+  // If the desired size is 0, SelectFaviconFrames() will return the largest
+  // bitmap without doing any resizing. As |favicon_bitmap_results| has bitmap
+  // data for a single bitmap, return it and avoid an unnecessary decode.
+  if (desired_size_in_dip == 0) {
+    return bitmap_result;
+  }
+
+  // If history bitmap is already desired pixel size, return early.
+  float desired_scale = ui::GetImageScale(desired_scale_factor);
+  int desired_edge_width_in_pixel = static_cast<int>(
+      desired_size_in_dip * desired_scale + 0.5f);
+  gfx::Size desired_size_in_pixel(desired_edge_width_in_pixel,
+                                  desired_edge_width_in_pixel);
+  if (bitmap_result.pixel_size == desired_size_in_pixel) {
+    return bitmap_result;
+  }
+
+  // Convert raw bytes to SkBitmap, resize via SelectFaviconFrames(), then
+  // convert back.
+  std::vector<ui::ScaleFactor> desired_scale_factors;
+  desired_scale_factors.push_back(desired_scale_factor);
+  gfx::Image resized_image = FaviconUtil::SelectFaviconFramesFromPNGs(
+      favicon_bitmap_results, desired_scale_factors, desired_size_in_dip);
+
+  std::vector<unsigned char> resized_bitmap_data;
+  if (!gfx::PNGCodec::EncodeBGRASkBitmap(resized_image.AsBitmap(), false,
+                                         &resized_bitmap_data)) {
+    return chrome::FaviconBitmapResult();
+  }
+
+  bitmap_result.bitmap_data = base::RefCountedBytes::TakeVector(
+      &resized_bitmap_data);
+  return bitmap_result;
+}
+
 }  // namespace
 
 FaviconService::FaviconService(Profile* profile)
     : history_service_(HistoryServiceFactory::GetForProfile(
           profile, Profile::EXPLICIT_ACCESS)),
-      profile_(profile) {
+      profile_(profile),
+      favicon_cache_(kFaviconCacheMaxBytes) {
+  registrar_.Add(this, chrome::NOTIFICATION_FAVICON_CHANGED,
+                 content::Source<Profile>(profile_));
+  registrar_.Add(this, chrome::NOTIFICATION_HISTORY_URLS_DELETED,
+                 content::Source<Profile>(profile_));
+  memory_pressure_listener_.reset(new base::MemoryPressureListener(
+      base::Bind(&FaviconService::OnMemoryPressure, base::Unretained(this))));
 }
 
 // static
@@ -148,6 +227,7 @@ FaviconService::UpdateFaviconMappingsAndFetch(
     int desired_size_in_dip,
     const FaviconResultsCallback& callback,
     base::CancelableTaskTracker* tracker) {
+  InvalidateCachedFavicons(page_url);
   if (history_service_) {
     return history_service_->UpdateFaviconMappingsAndFetch(
         page_url, icon_urls, icon_types, desired_size_in_dip,
@@ -161,6 +241,39 @@ base::CancelableTaskTracker::TaskId FaviconService::GetFaviconImageForURL(
     const FaviconForURLParams& params,
     const FaviconImageCallback& callback,
     base::CancelableTaskTracker* tracker) {
+  if (IsCacheable(params.page_url)) {
+    FaviconCache::Key key(params.page_url, params.icon_types,
+                          params.desired_size_in_dip,
+                          FaviconUtil::GetFaviconScaleFactors());
+    std::vector<chrome::FaviconBitmapResult> bitmap_results;
+    gfx::Image image;
+    if (favicon_cache_.Get(key, &bitmap_results, &image)) {
+      chrome::FaviconImageResult image_result;
+      if (image.IsEmpty()) {
+        image_result = MakeFaviconImageResult(bitmap_results,
+                                              params.desired_size_in_dip);
+        favicon_cache_.PutImage(key, favicon_cache_.generation(),
+                                image_result.image);
+      } else {
+        image_result.image = image;
+        image_result.icon_url = bitmap_results[0].icon_url;
+      }
+      return tracker->PostTask(base::MessageLoopProxy::current().get(),
+                               FROM_HERE, Bind(callback, image_result));
+    }
+    return history_service_->GetFaviconsForURL(
+        params.page_url,
+        params.icon_types,
+        params.desired_size_in_dip,
+        key.desired_scale_factors,
+        Bind(&FaviconService::CacheFaviconImage,
+             base::Unretained(this),
+             key,
+             favicon_cache_.generation(),
+             callback),
+        tracker);
+  }
+
   return GetFaviconForURLImpl(
       params,
       FaviconUtil::GetFaviconScaleFactors(),
@@ -189,6 +302,36 @@ base::CancelableTaskTracker::TaskId FaviconService::GetRawFaviconForURL(
       tracker);
 }
 
+base::CancelableTaskTracker::TaskId FaviconService::GetRawFaviconsForURLs(
+    const std::vector<GURL>& page_urls,
+    int icon_types,
+    int desired_size_in_dip,
+    ui::ScaleFactor desired_scale_factor,
+    const FaviconRawResultsCallback& callback,
+    base::CancelableTaskTracker* tracker) {
+  if (!history_service_) {
+    return tracker->PostTask(
+        base::MessageLoopProxy::current().get(),
+        FROM_HERE,
+        Bind(callback, std::vector<chrome::FaviconBitmapResult>(
+            page_urls.size())));
+  }
+
+  std::vector<ui::ScaleFactor> desired_scale_factors;
+  desired_scale_factors.push_back(desired_scale_factor);
+  return history_service_->GetFaviconsForURLs(
+      page_urls,
+      icon_types,
+      desired_size_in_dip,
+      desired_scale_factors,
+      Bind(&FaviconService::RunFaviconRawResultsCallbackWithBitmapResults,
+           base::Unretained(this),
+           callback,
+           desired_size_in_dip,
+           desired_scale_factor),
+      tracker);
+}
+
 base::CancelableTaskTracker::TaskId FaviconService::GetLargestRawFaviconForURL(
     Profile* profile,
     const GURL& page_url,
@@ -245,12 +388,16 @@ base::CancelableTaskTracker::TaskId FaviconService::GetLargestRawFaviconForID(
 }
 
 void FaviconService::SetFaviconOutOfDateForPage(const GURL& page_url) {
+  // Every favicon of |page_url| expires, including the ones it shares with
+  // other pages.
+  favicon_cache_.Clear();
   if (history_service_)
     history_service_->SetFaviconsOutOfDateForPage(page_url);
 }
 
 void FaviconService::CloneFavicon(const GURL& old_page_url,
                                   const GURL& new_page_url) {
+  InvalidateCachedFavicons(new_page_url);
   if (history_service_)
     history_service_->CloneFavicons(old_page_url, new_page_url);
 }
@@ -267,6 +414,8 @@ void FaviconService::MergeFavicon(
     chrome::IconType icon_type,
     scoped_refptr<base::RefCountedMemory> bitmap_data,
     const gfx::Size& pixel_size) {
+  InvalidateCachedFavicons(page_url);
+  InvalidateCachedIcon(icon_url);
   if (history_service_) {
     history_service_->MergeFavicon(page_url, icon_url, icon_type, bitmap_data,
                                    pixel_size);
@@ -277,6 +426,8 @@ void FaviconService::SetFavicons(const GURL& page_url,
                                  const GURL& icon_url,
                                  chrome::IconType icon_type,
                                  const gfx::Image& image) {
+  InvalidateCachedFavicons(page_url);
+  InvalidateCachedIcon(icon_url);
   if (!history_service_)
     return;
 
@@ -318,6 +469,10 @@ void FaviconService::ClearUnableToDownloadFavicons() {
   missing_favicon_urls_.clear();
 }
 
+void FaviconService::PurgeMemory() {
+  favicon_cache_.Clear();
+}
+
 FaviconService::~FaviconService() {}
 
 base::CancelableTaskTracker::TaskId FaviconService::GetFaviconForURLImpl(
@@ -330,30 +485,100 @@ base::CancelableTaskTracker::TaskId FaviconService::GetFaviconForURLImpl(
     return GetFaviconForChromeURL(profile_, params.page_url,
                                   desired_scale_factors, callback, tracker);
   } else if (history_service_) {
-    return history_service_->GetFaviconsForURL(params.page_url,
-                                               params.icon_types,
-                                               params.desired_size_in_dip,
-                                               desired_scale_factors,
-                                               callback,
-                                               tracker);
+    FaviconCache::Key key(params.page_url, params.icon_types,
+                          params.desired_size_in_dip, desired_scale_factors);
+    std::vector<chrome::FaviconBitmapResult> bitmap_results;
+    if (favicon_cache_.Get(key, &bitmap_results, NULL)) {
+      return tracker->PostTask(base::MessageLoopProxy::current().get(),
+                               FROM_HERE, Bind(callback, bitmap_results));
+    }
+    return history_service_->GetFaviconsForURL(
+        params.page_url,
+        params.icon_types,
+        params.desired_size_in_dip,
+        desired_scale_factors,
+        Bind(&FaviconService::CacheFaviconBitmapResults,
+             base::Unretained(this),
+             key,
+             favicon_cache_.generation(),
+             callback),
+        tracker);
   }
   return RunWithEmptyResultAsync(callback, tracker);
 }
 
+void FaviconService::Observe(int type,
+                             const content::NotificationSource& source,
+                             const content::NotificationDetails& details) {
+  switch (type) {
+    case chrome::NOTIFICATION_FAVICON_CHANGED: {
+      const FaviconChangedDetails* changed_details =
+          content::Details<FaviconChangedDetails>(details).ptr();
+      favicon_cache_.InvalidatePageURLs(changed_details->urls);
+      favicon_cache_.InvalidateIconURLs(changed_details->icon_urls);
+      break;
+    }
+    case chrome::NOTIFICATION_HISTORY_URLS_DELETED:
+      // Deleted pages lose their favicons. Deletions are rare enough that
+      // dropping everything is simpler than matching the deleted URLs.
+      favicon_cache_.Clear();
+      break;
+    default:
+      NOTREACHED();
+  }
+}
+
+void FaviconService::OnMemoryPressure(
+    base::MemoryPressureListener::MemoryPressureLevel memory_pressure_level) {
+  favicon_cache_.TrimMemory(memory_pressure_level ==
+      base::MemoryPressureListener::MEMORY_PRESSURE_CRITICAL);
+}
+
+void FaviconService::InvalidateCachedFavicons(const GURL& page_url) {
+  std::set<GURL> page_urls;
+  page_urls.insert(page_url);
+  favicon_cache_.InvalidatePageURLs(page_urls);
+}
+
+void FaviconService::InvalidateCachedIcon(const GURL& icon_url) {
+  std::set<GURL> icon_urls;
+  icon_urls.insert(icon_url);
+  favicon_cache_.InvalidateIconURLs(icon_urls);
+}
+
+bool FaviconService::IsCacheable(const GURL& page_url) const {
+  return history_service_ &&
+      !page_url.SchemeIs(chrome::kChromeUIScheme) &&
+      !page_url.SchemeIs(extensions::kExtensionScheme);
+}
+
+void FaviconService::CacheFaviconBitmapResults(
+    const FaviconCache::Key& key,
+    int generation,
+    const FaviconResultsCallback& callback,
+    const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results) {
+  favicon_cache_.Put(key, generation, favicon_bitmap_results);
+  callback.Run(favicon_bitmap_results);
+}
+
+void FaviconService::CacheFaviconImage(
+    const FaviconCache::Key& key,
+    int generation,
+    const FaviconImageCallback& callback,
+    const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results) {
+  favicon_cache_.Put(key, generation, favicon_bitmap_results);
+  chrome::FaviconImageResult image_result = MakeFaviconImageResult(
+      favicon_bitmap_results, key.desired_size_in_dip);
+  favicon_cache_.PutImage(key, generation, image_result.image);
+  callback.Run(image_result);
+}
+
 void FaviconService::RunFaviconImageCallbackWithBitmapResults(
     const FaviconImageCallback& callback,
     int desired_size_in_dip,
     const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results) {
-  chrome::FaviconImageResult image_result;
-  image_result.image = FaviconUtil::SelectFaviconFramesFromPNGs(
-      favicon_bitmap_results,
-      FaviconUtil::GetFaviconScaleFactors(),
-      desired_size_in_dip);
-  FaviconUtil::SetFaviconColorSpace(&image_result.image);
-
-  image_result.icon_url = image_result.image.IsEmpty() ?
-      GURL() : favicon_bitmap_results[0].icon_url;
-  callback.Run(image_result);
+  callback.Run(MakeFaviconImageResult(favicon_bitmap_results,
+                                      desired_size_in_dip));
 }
 
 void FaviconService::RunFaviconRawCallbackWithBitmapResults(
@@ -361,48 +586,22 @@ void FaviconService::RunFaviconRawCallbackWithBitmapResults(
     int desired_size_in_dip,
     ui::ScaleFactor desired_scale_factor,
     const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results) {
-  if (favicon_bitmap_results.empty() || !favicon_bitmap_results[0].is_valid()) {
-    callback.Run(chrome::FaviconBitmapResult());
-    return;
-  }
-
-  DCHECK_EQ(1u, favicon_bitmap_results.size());
-  chrome::FaviconBitmapResult bitmap_result = favicon_bitmap_results[0];
-
-  // If the desired size is 0, SelectFaviconFrames() will return the largest
-  // bitmap without doing any resizing. As |favicon_bitmap_results| has bitmap
-  // data for a single bitmap, return it and avoid an unnecessary decode.
-  if (desired_size_in_dip == 0) {
-    callback.Run(bitmap_result);
-    return;
-  }
-
-  // If history bitmap is already desired pixel size, return early.
-  float desired_scale = ui::GetImageScale(desired_scale_factor);
-  int desired_edge_width_in_pixel = static_cast<int>(
-      desired_size_in_dip * desired_scale + 0.5f);
-  gfx::Size desired_size_in_pixel(desired_edge_width_in_pixel,
-                                  desired_edge_width_in_pixel);
-  if (bitmap_result.pixel_size == desired_size_in_pixel) {
-    callback.Run(bitmap_result);
-    return;
-  }
-
-  // Convert raw bytes to SkBitmap, resize via SelectFaviconFrames(), then
-  // convert back.
-  std::vector<ui::ScaleFactor> desired_scale_factors;
-  desired_scale_factors.push_back(desired_scale_factor);
-  gfx::Image resized_image = FaviconUtil::SelectFaviconFramesFromPNGs(
-      favicon_bitmap_results, desired_scale_factors, desired_size_in_dip);
+  callback.Run(ResizeFaviconBitmapResult(favicon_bitmap_results,
+                                         desired_size_in_dip,
+                                         desired_scale_factor));
+}
 
-  std::vector<unsigned char> resized_bitmap_data;
-  if (!gfx::PNGCodec::EncodeBGRASkBitmap(resized_image.AsBitmap(), false,
-                                         &resized_bitmap_data)) {
-    callback.Run(chrome::FaviconBitmapResult());
-    return;
+void FaviconService::RunFaviconRawResultsCallbackWithBitmapResults(
+    const FaviconRawResultsCallback& callback,
+    int desired_size_in_dip,
+    ui::ScaleFactor desired_scale_factor,
+    const std::vector<std::vector<chrome::FaviconBitmapResult> >&
+        favicon_bitmap_results) {
+  std::vector<chrome::FaviconBitmapResult> results;
+  for (size_t i = 0; i < favicon_bitmap_results.size(); ++i) {
+    results.push_back(ResizeFaviconBitmapResult(favicon_bitmap_results[i],
+                                                desired_size_in_dip,
+                                                desired_scale_factor));
   }
-
-  bitmap_result.bitmap_data = base::RefCountedBytes::TakeVector(
-      &resized_bitmap_data);
-  callback.Run(bitmap_result);
+  callback.Run(results);
 }
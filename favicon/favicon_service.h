@@ -9,12 +9,17 @@
 
 #include "base/callback.h"
 #include "base/containers/hash_tables.h"
+#include "base/memory/memory_pressure_listener.h"
 #include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/task/cancelable_task_tracker.h"
 #include "chrome/browser/common/cancelable_request.h"
+#include "chrome/browser/favicon/favicon_cache.h"
 #include "chrome/common/favicon/favicon_types.h"
 #include "chrome/common/ref_counted_util.h"
 #include "components/browser_context_keyed_service/browser_context_keyed_service.h"
+#include "content/public/browser/notification_observer.h"
+#include "content/public/browser/notification_registrar.h"
 #include "ui/base/layout.h"
 
 class GURL;
@@ -31,8 +36,14 @@ struct FaviconImageResult;
 //
 // This service is thread safe. Each request callback is invoked in the
 // thread that made the request.
+//
+// The favicons of page URLs are cached in memory, so that requests for the
+// icons the UI shows over and over again are answered without a round trip to
+// the history thread. The cache is invalidated by favicon change and history
+// deletion notifications.
 class FaviconService : public CancelableRequestProvider,
-                       public BrowserContextKeyedService {
+                       public BrowserContextKeyedService,
+                       public content::NotificationObserver {
  public:
   explicit FaviconService(Profile* profile);
 
@@ -81,6 +92,18 @@ class FaviconService : public CancelableRequestProvider,
   typedef base::Callback<void(const std::vector<chrome::FaviconBitmapResult>&)>
       FaviconResultsCallback;
 
+  // Callback for GetRawFaviconsForURLs(). Has the result GetRawFaviconForURL()
+  // would give for each of the page URLs, in the same order.
+  typedef base::Callback<void(const std::vector<chrome::FaviconBitmapResult>&)>
+      FaviconRawResultsCallback;
+
+  // Callback for HistoryService::GetFaviconsForURLs(). Has the results
+  // GetFaviconForURL() would give for each of the page URLs, in the same
+  // order.
+  typedef base::Callback<void(
+      const std::vector<std::vector<chrome::FaviconBitmapResult> >&)>
+      FaviconResultsForURLsCallback;
+
   // We usually pass parameters with pointer to avoid copy. This function is a
   // helper to run FaviconResultsCallback with pointer parameters.
   static void FaviconResultsCallbackRunner(
@@ -167,6 +190,18 @@ class FaviconService : public CancelableRequestProvider,
       const FaviconRawCallback& callback,
       base::CancelableTaskTracker* tracker);
 
+  // Like GetRawFaviconForURL() for each of |page_urls|, but looks them all up
+  // in one request to the history backend, which is much cheaper for pages
+  // showing many favicons. Favicons of chrome:// and extension pages are not
+  // looked up, and get invalid results.
+  base::CancelableTaskTracker::TaskId GetRawFaviconsForURLs(
+      const std::vector<GURL>& page_urls,
+      int icon_types,
+      int desired_size_in_dip,
+      ui::ScaleFactor desired_scale_factor,
+      const FaviconRawResultsCallback& callback,
+      base::CancelableTaskTracker* tracker);
+
   // See HistoryService::GetLargestFaviconForURL().
   base::CancelableTaskTracker::TaskId GetLargestRawFaviconForURL(
       Profile* profile,
@@ -237,12 +272,44 @@ class FaviconService : public CancelableRequestProvider,
   bool WasUnableToDownloadFavicon(const GURL& icon_url) const;
   void ClearUnableToDownloadFavicons();
 
+  // Drops the favicons cached in memory. Called by the MemoryPurger.
+  void PurgeMemory();
+
+  // The in-memory cache of the favicons of page URLs, for its counters.
+  const FaviconCache& favicon_cache() const { return favicon_cache_; }
+
  private:
   typedef uint32 MissingFaviconURLHash;
   base::hash_set<MissingFaviconURLHash> missing_favicon_urls_;
   HistoryService* history_service_;
   Profile* profile_;
 
+  // Favicons recently looked up for page URLs.
+  FaviconCache favicon_cache_;
+
+  content::NotificationRegistrar registrar_;
+
+  scoped_ptr<base::MemoryPressureListener> memory_pressure_listener_;
+
+  // content::NotificationObserver:
+  virtual void Observe(int type,
+                       const content::NotificationSource& source,
+                       const content::NotificationDetails& details) OVERRIDE;
+
+  void OnMemoryPressure(
+      base::MemoryPressureListener::MemoryPressureLevel memory_pressure_level);
+
+  // Removes the cached favicons of |page_url|, ahead of a change to them.
+  void InvalidateCachedFavicons(const GURL& page_url);
+
+  // Removes the cached favicons of every page using |icon_url|, ahead of a
+  // change to its bitmaps.
+  void InvalidateCachedIcon(const GURL& icon_url);
+
+  // Whether the favicons of |page_url| are looked up in, and cached from, the
+  // history service.
+  bool IsCacheable(const GURL& page_url) const;
+
   // Helper function for GetFaviconImageForURL(), GetRawFaviconForURL() and
   // GetFaviconForURL().
   base::CancelableTaskTracker::TaskId GetFaviconForURLImpl(
@@ -251,6 +318,24 @@ class FaviconService : public CancelableRequestProvider,
       const FaviconResultsCallback& callback,
       base::CancelableTaskTracker* tracker);
 
+  // Intermediate callback for lookups of the favicons of page URLs. Caches
+  // |favicon_bitmap_results| as the results for |key|, unless the cache was
+  // invalidated since |generation|, then runs |callback|.
+  void CacheFaviconBitmapResults(
+      const FaviconCache::Key& key,
+      int generation,
+      const FaviconResultsCallback& callback,
+      const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results);
+
+  // Intermediate callback for GetFaviconImageForURL(). Like
+  // CacheFaviconBitmapResults(), but also caches the image decoded from
+  // |favicon_bitmap_results| and runs |callback| with it.
+  void CacheFaviconImage(
+      const FaviconCache::Key& key,
+      int generation,
+      const FaviconImageCallback& callback,
+      const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results);
+
   // Intermediate callback for GetFaviconImage() and GetFaviconImageForURL()
   // so that history service can deal solely with FaviconResultsCallback.
   // Builds chrome::FaviconImageResult from |favicon_bitmap_results| and runs
@@ -269,6 +354,15 @@ class FaviconService : public CancelableRequestProvider,
       ui::ScaleFactor desired_scale_factor,
       const std::vector<chrome::FaviconBitmapResult>& favicon_bitmap_results);
 
+  // Intermediate callback for GetRawFaviconsForURLs(). Does what
+  // RunFaviconRawCallbackWithBitmapResults() does for each page.
+  void RunFaviconRawResultsCallbackWithBitmapResults(
+      const FaviconRawResultsCallback& callback,
+      int desired_size_in_dip,
+      ui::ScaleFactor desired_scale_factor,
+      const std::vector<std::vector<chrome::FaviconBitmapResult> >&
+          favicon_bitmap_results);
+
   DISALLOW_COPY_AND_ASSIGN(FaviconService);
 };
 
@@ -30,6 +30,14 @@ FaviconService* FaviconServiceFactory::GetForProfile(
   return NULL;
 }
 
+// static
+FaviconService* FaviconServiceFactory::GetForProfileIfExists(
+    Profile* profile) {
+  return static_cast<FaviconService*>(
+      GetInstance()->GetServiceForBrowserContext(
+          profile->GetOriginalProfile(), false));
+}
+
 // static
 FaviconServiceFactory* FaviconServiceFactory::GetInstance() {
   return Singleton<FaviconServiceFactory>::get();
@@ -23,6 +23,10 @@ class FaviconServiceFactory : public BrowserContextKeyedServiceFactory {
   static FaviconService* GetForProfile(Profile* profile,
                                        Profile::ServiceAccessType sat);
 
+  // Like GetForProfile(), but returns NULL instead of creating the service
+  // if it has not been created yet.
+  static FaviconService* GetForProfileIfExists(Profile* profile);
+
   static FaviconServiceFactory* GetInstance();
 
  private:
@@ -0,0 +1,270 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_COPY_ON_WRITE_CONTAINERS_H_
+#define CHROME_BROWSER_HISTORY_COPY_ON_WRITE_CONTAINERS_H_
+
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/hash.h"
+#include "base/logging.h"
+#include "base/memory/ref_counted.h"
+#include "base/strings/string16.h"
+
+namespace history {
+
+// Containers for the InMemoryURLIndex whose copies share storage until one of
+// them is modified. Each container is split into fixed-size chunks of
+// reference-counted storage; copying a container copies only the chunk
+// pointers, and a write clones just the chunk it touches, and only if that
+// chunk is still shared. Taking a snapshot of the index therefore costs a
+// pointer per chunk, and keeping it alive costs memory proportional to the
+// chunks written since, rather than a full copy of the index.
+//
+// Copies may be read on any thread, but each instance is only modified on
+// the thread that made it: a chunk is written in place only when this
+// instance holds the sole reference to it, which no other thread can change.
+
+// Maps a key to one of the CopyOnWriteMap shards.
+inline size_t CopyOnWriteShardHash(base::char16 key) { return key; }
+inline size_t CopyOnWriteShardHash(size_t key) { return key; }
+inline size_t CopyOnWriteShardHash(int64 key) {
+  return static_cast<size_t>(key);
+}
+inline size_t CopyOnWriteShardHash(const base::string16& key) {
+  return base::SuperFastHash(reinterpret_cast<const char*>(key.data()),
+                             static_cast<int>(key.size() *
+                                              sizeof(base::char16)));
+}
+
+// A std::map-like container sharded by key hash. Iteration visits every entry
+// exactly once but, unlike std::map, not in key order. Only const iteration
+// is offered; entries are modified through operator[], FindMutable() and
+// erase(), which unshare the affected shard first.
+template <typename Key, typename Value>
+class CopyOnWriteMap {
+ private:
+  typedef std::map<Key, Value> ShardMap;
+  typedef base::RefCountedData<ShardMap> Shard;
+  typedef std::vector<scoped_refptr<Shard> > ShardVector;
+
+ public:
+  typedef Key key_type;
+  typedef Value mapped_type;
+  typedef typename ShardMap::value_type value_type;
+
+  class const_iterator
+      : public std::iterator<std::forward_iterator_tag, const value_type> {
+   public:
+    const_iterator() : shards_(NULL), shard_(0) {}
+
+    const value_type& operator*() const { return *iter_; }
+    const value_type* operator->() const { return &*iter_; }
+
+    const_iterator& operator++() {
+      ++iter_;
+      SkipEmptyShards();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator result(*this);
+      ++*this;
+      return result;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return shard_ == other.shard_ &&
+          (shard_ == kShardCount || iter_ == other.iter_);
+    }
+    bool operator!=(const const_iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    friend class CopyOnWriteMap;
+
+    const_iterator(const ShardVector* shards,
+                   size_t shard,
+                   typename ShardMap::const_iterator iter)
+        : shards_(shards), shard_(shard), iter_(iter) {}
+
+    // Advances to the first entry at or after |iter_|, moving on through
+    // the following shards if |iter_| is at the end of its own.
+    void SkipEmptyShards() {
+      while (shard_ < kShardCount) {
+        const Shard* shard = (*shards_)[shard_].get();
+        if (shard && iter_ != shard->data.end())
+          return;
+        if (++shard_ < kShardCount && (*shards_)[shard_].get())
+          iter_ = (*shards_)[shard_]->data.begin();
+      }
+    }
+
+    const ShardVector* shards_;
+    size_t shard_;
+    typename ShardMap::const_iterator iter_;
+  };
+
+  CopyOnWriteMap() : shards_(kShardCount), size_(0) {}
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  const_iterator begin() const {
+    const_iterator iter(&shards_, 0, typename ShardMap::const_iterator());
+    if (shards_[0].get())
+      iter.iter_ = shards_[0]->data.begin();
+    iter.SkipEmptyShards();
+    return iter;
+  }
+
+  const_iterator end() const {
+    return const_iterator(&shards_, kShardCount,
+                          typename ShardMap::const_iterator());
+  }
+
+  const_iterator find(const Key& key) const {
+    const size_t index = ShardIndex(key);
+    const Shard* shard = shards_[index].get();
+    if (!shard)
+      return end();
+    typename ShardMap::const_iterator iter = shard->data.find(key);
+    if (iter == shard->data.end())
+      return end();
+    return const_iterator(&shards_, index, iter);
+  }
+
+  size_t count(const Key& key) const { return find(key) == end() ? 0 : 1; }
+
+  // Returns the value for |key|, inserting a default value if there is none.
+  Value& operator[](const Key& key) {
+    ShardMap& shard = MutableShard(ShardIndex(key));
+    const size_t shard_size = shard.size();
+    Value& value = shard[key];
+    size_ += shard.size() - shard_size;
+    return value;
+  }
+
+  // Returns the value for |key| for modification, or NULL if there is none.
+  // Does not unshare anything when |key| is absent.
+  Value* FindMutable(const Key& key) {
+    if (find(key) == end())
+      return NULL;
+    return &MutableShard(ShardIndex(key))[key];
+  }
+
+  size_t erase(const Key& key) {
+    if (find(key) == end())
+      return 0;
+    MutableShard(ShardIndex(key)).erase(key);
+    --size_;
+    return 1;
+  }
+
+  void clear() {
+    shards_.assign(kShardCount, scoped_refptr<Shard>());
+    size_ = 0;
+  }
+
+  // Returns true if this map and |other| share the storage for |key|'s shard.
+  // Exposed for testing.
+  bool SharesShardWith(const CopyOnWriteMap& other, const Key& key) const {
+    const size_t index = ShardIndex(key);
+    return shards_[index].get() == other.shards_[index].get();
+  }
+
+ private:
+  // Enough shards that a write unshares a small fraction of the map, few
+  // enough that a copy is still a couple of kilobytes of pointers.
+  static const size_t kShardCount = 256;
+
+  static size_t ShardIndex(const Key& key) {
+    return CopyOnWriteShardHash(key) % kShardCount;
+  }
+
+  ShardMap& MutableShard(size_t index) {
+    scoped_refptr<Shard>& shard = shards_[index];
+    if (!shard.get())
+      shard = new Shard;
+    else if (!shard->HasOneRef())
+      shard = new Shard(shard->data);
+    return shard->data;
+  }
+
+  ShardVector shards_;
+  size_t size_;
+
+  // Copy and assign are allowed: they share all shards.
+};
+
+// A std::vector-like container stored in fixed-size chunks. Elements are
+// modified through set() and push_back(), which unshare the affected chunk.
+template <typename T>
+class CopyOnWriteVector {
+ public:
+  CopyOnWriteVector() : size_(0) {}
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  const T& operator[](size_t index) const {
+    DCHECK_LT(index, size_);
+    return chunks_[index / kChunkSize]->data[index % kChunkSize];
+  }
+
+  void set(size_t index, const T& value) {
+    DCHECK_LT(index, size_);
+    MutableChunk(index / kChunkSize)[index % kChunkSize] = value;
+  }
+
+  void push_back(const T& value) {
+    if (size_ % kChunkSize == 0) {
+      chunks_.push_back(new Chunk);
+      chunks_.back()->data.reserve(kChunkSize);
+    }
+    MutableChunk(chunks_.size() - 1).push_back(value);
+    ++size_;
+  }
+
+  void clear() {
+    chunks_.clear();
+    size_ = 0;
+  }
+
+  // Returns true if this vector and |other| share the storage for the
+  // |index|th element. Exposed for testing.
+  bool SharesChunkWith(const CopyOnWriteVector& other, size_t index) const {
+    return chunks_[index / kChunkSize].get() ==
+        other.chunks_[index / kChunkSize].get();
+  }
+
+ private:
+  typedef base::RefCountedData<std::vector<T> > Chunk;
+
+  static const size_t kChunkSize = 1024;
+
+  std::vector<T>& MutableChunk(size_t chunk_index) {
+    scoped_refptr<Chunk>& chunk = chunks_[chunk_index];
+    if (!chunk->HasOneRef()) {
+      scoped_refptr<Chunk> copy(new Chunk);
+      copy->data.reserve(kChunkSize);
+      copy->data.assign(chunk->data.begin(), chunk->data.end());
+      chunk = copy;
+    }
+    return chunk->data;
+  }
+
+  std::vector<scoped_refptr<Chunk> > chunks_;
+  size_t size_;
+
+  // Copy and assign are allowed: they share all chunks.
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_COPY_ON_WRITE_CONTAINERS_H_
@@ -0,0 +1,136 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/copy_on_write_containers.h"
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace history {
+
+namespace {
+
+typedef CopyOnWriteMap<int64, std::string> TestMap;
+
+// Returns the contents of |map| as a std::map, checking that iteration visits
+// each entry exactly once.
+std::map<int64, std::string> ToStdMap(const TestMap& map) {
+  std::map<int64, std::string> result;
+  for (TestMap::const_iterator iter = map.begin(); iter != map.end(); ++iter)
+    EXPECT_TRUE(result.insert(*iter).second) << iter->first;
+  EXPECT_EQ(map.size(), result.size());
+  return result;
+}
+
+}  // namespace
+
+TEST(CopyOnWriteMapTest, BehavesLikeMap) {
+  TestMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.begin() == map.end());
+  EXPECT_TRUE(map.find(1) == map.end());
+  EXPECT_EQ(0U, map.erase(1));
+  EXPECT_EQ(NULL, map.FindMutable(1));
+
+  std::map<int64, std::string> expected;
+  for (int64 i = 0; i < 2000; i += 3) {
+    map[i] = "value";
+    expected[i] = "value";
+  }
+  map[3] = "three";
+  expected[3] = "three";
+  EXPECT_EQ(expected.size(), map.size());
+  EXPECT_EQ(expected, ToStdMap(map));
+  EXPECT_EQ("three", map.find(3)->second);
+  EXPECT_EQ(1U, map.count(6));
+  EXPECT_EQ(0U, map.count(7));
+
+  *map.FindMutable(6) = "six";
+  EXPECT_EQ("six", map.find(6)->second);
+  EXPECT_EQ(1U, map.erase(6));
+  EXPECT_EQ(0U, map.erase(6));
+  expected.erase(6);
+  EXPECT_EQ(expected.size(), map.size());
+
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.begin() == map.end());
+}
+
+TEST(CopyOnWriteMapTest, CopiesAreIsolated) {
+  TestMap map;
+  for (int64 i = 0; i < 5000; ++i)
+    map[i] = "original";
+  TestMap snapshot(map);
+  EXPECT_TRUE(map.SharesShardWith(snapshot, 1));
+  EXPECT_TRUE(map.SharesShardWith(snapshot, 2));
+
+  map[1] = "changed";
+  map.erase(2);
+  map[5000] = "added";
+  *map.FindMutable(3) = "changed";
+
+  EXPECT_EQ("original", snapshot.find(1)->second);
+  EXPECT_TRUE(snapshot.find(2) != snapshot.end());
+  EXPECT_TRUE(snapshot.find(5000) == snapshot.end());
+  EXPECT_EQ("original", snapshot.find(3)->second);
+  EXPECT_EQ(5000U, snapshot.size());
+  EXPECT_EQ("changed", map.find(1)->second);
+  EXPECT_EQ(5000U, map.size());
+
+  // Only the shards which were written were unshared.
+  EXPECT_FALSE(map.SharesShardWith(snapshot, 1));
+  EXPECT_TRUE(map.SharesShardWith(snapshot, 4));
+
+  // Reads and misses never unshare.
+  EXPECT_EQ(NULL, map.FindMutable(100000));
+  EXPECT_EQ(0U, map.erase(100000));
+  map.find(4);
+  EXPECT_TRUE(map.SharesShardWith(snapshot, 4));
+  EXPECT_TRUE(map.SharesShardWith(snapshot, 100000));
+
+  map.clear();
+  EXPECT_EQ(5000U, ToStdMap(snapshot).size());
+}
+
+TEST(CopyOnWriteMapTest, StringKeys) {
+  CopyOnWriteMap<base::string16, size_t> map;
+  map[base::string16(1, 'a')] = 1;
+  map[base::string16(2, 'b')] = 2;
+  CopyOnWriteMap<base::string16, size_t> snapshot(map);
+  map.erase(base::string16(1, 'a'));
+  EXPECT_EQ(1U, map.size());
+  EXPECT_EQ(2U, snapshot.size());
+  EXPECT_EQ(1U, snapshot.find(base::string16(1, 'a'))->second);
+}
+
+TEST(CopyOnWriteVectorTest, CopiesAreIsolated) {
+  CopyOnWriteVector<std::string> vector;
+  EXPECT_TRUE(vector.empty());
+  for (size_t i = 0; i < 3000; ++i)
+    vector.push_back("original");
+  EXPECT_EQ(3000U, vector.size());
+
+  CopyOnWriteVector<std::string> snapshot(vector);
+  vector.set(10, "changed");
+  vector.push_back("added");
+
+  EXPECT_EQ("changed", vector[10]);
+  EXPECT_EQ("added", vector[3000]);
+  EXPECT_EQ(3001U, vector.size());
+  EXPECT_EQ("original", snapshot[10]);
+  EXPECT_EQ(3000U, snapshot.size());
+  EXPECT_FALSE(vector.SharesChunkWith(snapshot, 10));
+  EXPECT_TRUE(vector.SharesChunkWith(snapshot, 1500));
+  EXPECT_FALSE(vector.SharesChunkWith(snapshot, 2999));
+
+  vector.clear();
+  EXPECT_TRUE(vector.empty());
+  EXPECT_EQ("original", snapshot[2999]);
+}
+
+}  // namespace history
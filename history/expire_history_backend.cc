@@ -14,6 +14,7 @@
 #include "base/files/file_enumerator.h"
 #include "base/logging.h"
 #include "base/message_loop/message_loop.h"
+#include "base/metrics/histogram.h"
 #include "chrome/browser/bookmarks/bookmark_service.h"
 #include "chrome/browser/chrome_notification_types.h"
 #include "chrome/browser/history/archived_database.h"
@@ -23,6 +24,7 @@
 
 using base::Time;
 using base::TimeDelta;
+using base::TimeTicks;
 
 namespace history {
 
@@ -136,6 +138,14 @@ const int kExpirationDelaySec = 30;
 // iteration, so we want to wait longer before checking to avoid wasting CPU.
 const int kExpirationEmptyDelayMin = 5;
 
+// The longest an expiration slice should keep the history thread busy. Both
+// periodic archiving and ExpireHistoryBetweenInSlices() stop once a step takes
+// them past this, and leave the rest for a later task.
+const int kExpireSliceBudgetMs = 20;
+
+// The number of visits ExpireHistoryBetweenInSlices() deletes per step.
+const int kNumExpirePerStep = 100;
+
 }  // namespace
 
 struct ExpireHistoryBackend::DeleteDependencies {
@@ -164,6 +174,13 @@ struct ExpireHistoryBackend::DeleteDependencies {
   std::set<GURL> expired_favicons;
 };
 
+ExpireHistoryBackend::SlicedExpiration::SlicedExpiration()
+    : deleted_visits(0) {
+}
+
+ExpireHistoryBackend::SlicedExpiration::~SlicedExpiration() {
+}
+
 ExpireHistoryBackend::ExpireHistoryBackend(
     BroadcastNotificationDelegate* delegate,
     BookmarkService* bookmark_service)
@@ -172,6 +189,7 @@ ExpireHistoryBackend::ExpireHistoryBackend(
       archived_db_(NULL),
       thumb_db_(NULL),
       weak_factory_(this),
+      slice_budget_(TimeDelta::FromMilliseconds(kExpireSliceBudgetMs)),
       bookmark_service_(bookmark_service) {
 }
 
@@ -253,6 +271,28 @@ void ExpireHistoryBackend::ExpireHistoryBetween(
   ExpireVisits(visits);
 }
 
+void ExpireHistoryBackend::ExpireHistoryBetweenInSlices(
+    Time begin_time, Time end_time, const base::Closure& done) {
+  if (!main_db_) {
+    if (!done.is_null())
+      done.Run();
+    return;
+  }
+
+  // Visits added while the slices run are newer than the request, and must
+  // survive it.
+  SlicedExpiration expiration;
+  expiration.begin_time = begin_time;
+  expiration.end_time =
+      end_time.is_null() || end_time.is_max() ? Time::Now() : end_time;
+  expiration.done = done;
+  sliced_expirations_.push_back(expiration);
+  SavePendingExpirations();
+  Commit();
+  if (sliced_expirations_.size() == 1)
+    ScheduleExpireSlice();
+}
+
 void ExpireHistoryBackend::ExpireHistoryForTimes(
     const std::vector<base::Time>& times) {
   // |times| must be in reverse chronological order and have no
@@ -340,6 +380,20 @@ void ExpireHistoryBackend::StartArchivingOldStuff(
   // Initialize the queue with all tasks for the first set of iterations.
   InitWorkQueue();
   ScheduleArchive();
+
+  // Finish the deletions the last run did not get to.
+  if (main_db_ && sliced_expirations_.empty()) {
+    HistoryDatabase::ExpirationRanges ranges;
+    main_db_->GetPendingExpirations(&ranges);
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      SlicedExpiration expiration;
+      expiration.begin_time = ranges[i].first;
+      expiration.end_time = ranges[i].second;
+      sliced_expirations_.push_back(expiration);
+    }
+    if (!sliced_expirations_.empty())
+      ScheduleExpireSlice();
+  }
 }
 
 void ExpireHistoryBackend::DeleteFaviconsIfPossible(
@@ -596,9 +650,17 @@ void ExpireHistoryBackend::ScheduleArchive() {
 void ExpireHistoryBackend::DoArchiveIteration() {
   DCHECK(!work_queue_.empty()) << "queue has to be non-empty";
 
+  // Keep archiving with the same reader while there is more to do and the
+  // slice has time left.
+  TimeTicks start = TimeTicks::Now();
+  TimeDelta budget = TimeDelta::FromMilliseconds(kExpireSliceBudgetMs);
   const ExpiringVisitsReader* reader = work_queue_.front();
-  bool more_to_expire = ArchiveSomeOldHistory(GetCurrentArchiveTime(), reader,
-                                              kNumExpirePerIteration);
+  bool more_to_expire;
+  do {
+    more_to_expire = ArchiveSomeOldHistory(GetCurrentArchiveTime(), reader,
+                                           kNumExpirePerIteration);
+  } while (more_to_expire && TimeTicks::Now() - start < budget);
+  UMA_HISTOGRAM_TIMES("History.ArchiveSliceTime", TimeTicks::Now() - start);
 
   work_queue_.pop();
   // If there are more items to expire, add the reader back to the queue, thus
@@ -609,6 +671,91 @@ void ExpireHistoryBackend::DoArchiveIteration() {
   ScheduleArchive();
 }
 
+void ExpireHistoryBackend::ScheduleExpireSlice() {
+  base::MessageLoop::current()->PostTask(
+      FROM_HERE,
+      base::Bind(&ExpireHistoryBackend::DoExpireSlice,
+                 weak_factory_.GetWeakPtr()));
+}
+
+void ExpireHistoryBackend::DoExpireSlice() {
+  DCHECK(!sliced_expirations_.empty());
+  // The databases are closed when the backend shuts down. The saved ranges
+  // will be finished on the next run.
+  if (!main_db_)
+    return;
+
+  TimeTicks start = TimeTicks::Now();
+  SlicedExpiration& expiration = sliced_expirations_.front();
+
+  // Each step deletes the oldest visits left in the range, so there is no
+  // position to keep between slices.
+  DeleteDependencies dependencies;
+  bool finished = false;
+  do {
+    VisitVector visits;
+    main_db_->GetAllVisitsInRange(expiration.begin_time, expiration.end_time,
+                                  kNumExpirePerStep, &visits);
+    DeleteVisitRelatedInfo(visits, &dependencies);
+    ExpireURLsForVisits(visits, &dependencies);
+    expiration.deleted_visits += static_cast<int>(visits.size());
+    finished = static_cast<int>(visits.size()) < kNumExpirePerStep;
+  } while (!finished && TimeTicks::Now() - start < slice_budget_);
+
+  // Favicons may be shared by URLs deleted in different slices, so they are
+  // only checked once the whole range is gone.
+  expiration.affected_favicons.insert(dependencies.affected_favicons.begin(),
+                                      dependencies.affected_favicons.end());
+  if (finished) {
+    DeleteFaviconsIfPossible(expiration.affected_favicons,
+                             &dependencies.expired_favicons);
+  }
+  BroadcastDeleteNotifications(&dependencies, DELETION_USER_INITIATED);
+
+  TimeDelta slice_time = TimeTicks::Now() - start;
+  expiration.busy_time += slice_time;
+  expiration.longest_slice = std::max(expiration.longest_slice, slice_time);
+
+  base::Closure done;
+  if (finished) {
+    UMA_HISTOGRAM_TIMES("History.ExpireSlicesLongestSlice",
+                        expiration.longest_slice);
+    if (expiration.busy_time > TimeDelta()) {
+      UMA_HISTOGRAM_COUNTS("History.ExpireSlicesVisitsPerSecond",
+                           static_cast<int>(expiration.deleted_visits /
+                                            expiration.busy_time.InSecondsF()));
+    }
+
+    done = expiration.done;
+    sliced_expirations_.pop_front();
+    SavePendingExpirations();
+    ParanoidExpireHistory();
+  }
+
+  // Commit every slice, so that a crash does not undo the visits deleted so
+  // far and leave the next run to delete them again.
+  Commit();
+  if (!done.is_null())
+    done.Run();
+
+  if (!sliced_expirations_.empty())
+    ScheduleExpireSlice();
+}
+
+void ExpireHistoryBackend::SavePendingExpirations() {
+  HistoryDatabase::ExpirationRanges ranges;
+  for (std::deque<SlicedExpiration>::const_iterator i =
+           sliced_expirations_.begin();
+       i != sliced_expirations_.end(); ++i)
+    ranges.push_back(std::make_pair(i->begin_time, i->end_time));
+  main_db_->SetPendingExpirations(ranges);
+}
+
+void ExpireHistoryBackend::Commit() {
+  if (!commit_.is_null())
+    commit_.Run();
+}
+
 bool ExpireHistoryBackend::ArchiveSomeOldHistory(
     base::Time end_time,
     const ExpiringVisitsReader* reader,
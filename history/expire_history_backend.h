@@ -5,11 +5,13 @@
 #ifndef CHROME_BROWSER_HISTORY_EXPIRE_HISTORY_BACKEND_H_
 #define CHROME_BROWSER_HISTORY_EXPIRE_HISTORY_BACKEND_H_
 
+#include <deque>
 #include <queue>
 #include <set>
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/callback.h"
 #include "base/gtest_prod_util.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/memory/weak_ptr.h"
@@ -77,6 +79,11 @@ class ExpireHistoryBackend {
                     ArchivedDatabase* archived_db,
                     ThumbnailDatabase* thumb_db);
 
+  // Sets the callback run to commit the databases once the ranges of
+  // ExpireHistoryBetweenInSlices() are saved and after every slice, so that
+  // the saved ranges and the progress made survive a crash.
+  void SetCommitCallback(const base::Closure& commit) { commit_ = commit; }
+
   // Begins periodic expiration of history older than the given threshold. This
   // will continue until the object is deleted.
   void StartArchivingOldStuff(base::TimeDelta expiration_threshold);
@@ -92,6 +99,16 @@ class ExpireHistoryBackend {
   void ExpireHistoryBetween(const std::set<GURL>& restrict_urls,
                             base::Time begin_time, base::Time end_time);
 
+  // Like ExpireHistoryBetween() with no URL restriction, but deletes the
+  // visits a slice at a time, returning to the message loop between slices so
+  // that a large deletion does not hold up other history requests. |done| is
+  // run once all the visits are deleted. Until then the range is saved in the
+  // database, so that StartArchivingOldStuff() finishes a deletion which was
+  // interrupted by shutdown.
+  void ExpireHistoryBetweenInSlices(base::Time begin_time,
+                                    base::Time end_time,
+                                    const base::Closure& done);
+
   // Removes all visits to all URLs with the given times, updating the
   // URLs accordingly.  |times| must be in reverse chronological order
   // and not contain any duplicates.
@@ -119,10 +136,29 @@ class ExpireHistoryBackend {
   FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ArchiveSomeOldHistory);
   FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ExpiringVisitsReader);
   FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ArchiveSomeOldHistoryWithSource);
+  FRIEND_TEST_ALL_PREFIXES(ExpireHistoryTest, ResumeSlicesAfterCrash);
   friend class ::TestingProfile;
 
   struct DeleteDependencies;
 
+  // A range being deleted by ExpireHistoryBetweenInSlices().
+  struct SlicedExpiration {
+    SlicedExpiration();
+    ~SlicedExpiration();
+
+    base::Time begin_time;
+    base::Time end_time;
+    base::Closure done;
+
+    // Favicons of the URLs deleted so far, checked once at the end.
+    std::set<chrome::FaviconID> affected_favicons;
+
+    // For the metrics recorded at the end.
+    int deleted_visits;
+    base::TimeDelta busy_time;
+    base::TimeDelta longest_slice;
+  };
+
   // Deletes the visit-related stuff for all the visits in the given list, and
   // adds the rows for unique URLs affected to the affected_urls list in
   // the dependencies structure.
@@ -222,6 +258,20 @@ class ExpireHistoryBackend {
   // future.
   void DoArchiveIteration();
 
+  // Posts a call to DoExpireSlice() to run after the tasks already queued.
+  void ScheduleExpireSlice();
+
+  // Deletes visits of the first of |sliced_expirations_| for up to
+  // kExpireSliceBudgetMs, finishing it if none are left, and schedules the
+  // next slice if there is more to do.
+  void DoExpireSlice();
+
+  // Saves the ranges of |sliced_expirations_| in the main database.
+  void SavePendingExpirations();
+
+  // Runs |commit_|, if set.
+  void Commit();
+
   // Tries to expire the oldest |max_visits| visits from history that are older
   // than |time_threshold|. The return value indicates if we think there might
   // be more history to expire with the current time threshold (it does not
@@ -275,6 +325,17 @@ class ExpireHistoryBackend {
   // iterations.
   std::queue<const ExpiringVisitsReader*> work_queue_;
 
+  // Deletions requested with ExpireHistoryBetweenInSlices(), in order. A slice
+  // is scheduled whenever this is not empty.
+  std::deque<SlicedExpiration> sliced_expirations_;
+
+  // Commits the databases; see SetCommitCallback(). May be null.
+  base::Closure commit_;
+
+  // How long DoExpireSlice() keeps deleting, kExpireSliceBudgetMs except in
+  // tests.
+  base::TimeDelta slice_budget_;
+
   // Readers for various types of visits.
   // TODO(dglazkov): If you are adding another one, please consider reorganizing
   // into a map.
@@ -7,14 +7,17 @@
 #include <utility>
 
 #include "base/basictypes.h"
+#include "base/bind.h"
 #include "base/compiler_specific.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/path_service.h"
+#include "base/run_loop.h"
 #include "base/stl_util.h"
 #include "base/strings/string16.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 #include "chrome/browser/bookmarks/bookmark_utils.h"
@@ -50,6 +53,20 @@ static const base::FilePath::CharType kThumbnailFile[] =
 // to work. It also eliminates a bunch of ugly "history::".
 namespace history {
 
+namespace {
+
+void SetTrue(bool* value) {
+  *value = true;
+}
+
+// Stands in for HistoryBackend::Commit().
+void CommitAndBegin(HistoryDatabase* db) {
+  db->CommitTransaction();
+  db->BeginTransaction();
+}
+
+}  // namespace
+
 // ExpireHistoryTest -----------------------------------------------------------
 
 class ExpireHistoryTest : public testing::Test,
@@ -575,6 +592,127 @@ TEST_F(ExpireHistoryTest, FlushRecentURLsUnstarred) {
   EXPECT_FALSE(HasFavicon(favicon_id2));
 }
 
+// Same as FlushRecentURLsUnstarred, but deleting a slice at a time.
+TEST_F(ExpireHistoryTest, FlushRecentURLsInSlices) {
+  URLID url_ids[3];
+  Time visit_times[4];
+  AddExampleData(url_ids, visit_times);
+
+  URLRow url_row1, url_row2;
+  ASSERT_TRUE(main_db_->GetURLRow(url_ids[1], &url_row1));
+  ASSERT_TRUE(main_db_->GetURLRow(url_ids[2], &url_row2));
+  chrome::FaviconID favicon_id2 = GetFavicon(url_row2.url(), chrome::FAVICON);
+
+  bool done = false;
+  Time end_time = visit_times[3] + TimeDelta::FromSeconds(1);
+  expirer_.ExpireHistoryBetweenInSlices(visit_times[2], end_time,
+                                        base::Bind(&SetTrue, &done));
+
+  // Nothing is deleted until the slices run, but the range is saved.
+  EXPECT_FALSE(done);
+  HistoryDatabase::ExpirationRanges ranges;
+  main_db_->GetPendingExpirations(&ranges);
+  ASSERT_EQ(1U, ranges.size());
+  EXPECT_EQ(visit_times[2], ranges[0].first);
+  EXPECT_EQ(end_time, ranges[0].second);
+
+  base::RunLoop().RunUntilIdle();
+  EXPECT_TRUE(done);
+  main_db_->GetPendingExpirations(&ranges);
+  EXPECT_TRUE(ranges.empty());
+
+  VisitVector visits;
+  main_db_->GetVisitsForURL(url_ids[1], &visits);
+  EXPECT_EQ(1U, visits.size());
+  URLRow temp_row;
+  ASSERT_TRUE(main_db_->GetURLRow(url_ids[1], &temp_row));
+  EXPECT_TRUE(visit_times[1] == temp_row.last_visit());
+  EXPECT_EQ(1, temp_row.visit_count());
+
+  EnsureURLInfoGone(url_row2);
+  EXPECT_FALSE(HasFavicon(favicon_id2));
+}
+
+// A deletion left unfinished by the last run is finished once expiration
+// starts.
+TEST_F(ExpireHistoryTest, ResumePendingExpirations) {
+  URLID url_ids[3];
+  Time visit_times[4];
+  AddExampleData(url_ids, visit_times);
+
+  URLRow url_row2;
+  ASSERT_TRUE(main_db_->GetURLRow(url_ids[2], &url_row2));
+
+  HistoryDatabase::ExpirationRanges ranges;
+  ranges.push_back(std::make_pair(visit_times[3],
+                                  visit_times[3] + TimeDelta::FromSeconds(1)));
+  main_db_->SetPendingExpirations(ranges);
+
+  expirer_.StartArchivingOldStuff(TimeDelta::FromDays(90));
+  base::RunLoop().RunUntilIdle();
+
+  EnsureURLInfoGone(url_row2);
+  main_db_->GetPendingExpirations(&ranges);
+  EXPECT_TRUE(ranges.empty());
+}
+
+// A crash part way through ExpireHistoryBetweenInSlices() keeps both the
+// saved range and the slices already committed, and the next run deletes the
+// rest.
+TEST_F(ExpireHistoryTest, ResumeSlicesAfterCrash) {
+  ASSERT_TRUE(main_db_.get());
+  const int kNumVisits = 250;
+  Time begin_time = now_ - TimeDelta::FromHours(1);
+  for (int i = 0; i < kNumVisits; ++i) {
+    URLRow url_row(GURL(base::StringPrintf("http://www.google.com/%d", i)));
+    Time visit_time = begin_time + TimeDelta::FromSeconds(i);
+    url_row.set_last_visit(visit_time);
+    url_row.set_visit_count(1);
+    VisitRow visit_row;
+    visit_row.url_id = main_db_->AddURL(url_row);
+    visit_row.visit_time = visit_time;
+    main_db_->AddVisit(&visit_row, SOURCE_BROWSED);
+  }
+  Time end_time = begin_time + TimeDelta::FromSeconds(kNumVisits);
+
+  // Run a single step per slice inside a transaction, as the backend would.
+  main_db_->BeginTransaction();
+  expirer_.SetCommitCallback(base::Bind(&CommitAndBegin, main_db_.get()));
+  expirer_.slice_budget_ = TimeDelta();
+
+  bool done = false;
+  expirer_.ExpireHistoryBetweenInSlices(begin_time, end_time,
+                                        base::Bind(&SetTrue, &done));
+  expirer_.DoExpireSlice();
+  EXPECT_FALSE(done);
+
+  // Crash: whatever was not committed is lost, and the pending slices never
+  // run. The one slice that ran deleted a single step of 100 visits.
+  main_db_->RollbackTransaction();
+  expirer_.SetDatabases(NULL, NULL, NULL);
+
+  HistoryDatabase::ExpirationRanges ranges;
+  main_db_->GetPendingExpirations(&ranges);
+  ASSERT_EQ(1U, ranges.size());
+  EXPECT_EQ(begin_time, ranges[0].first);
+  EXPECT_EQ(end_time, ranges[0].second);
+  VisitVector visits;
+  main_db_->GetAllVisitsInRange(begin_time, end_time, 0, &visits);
+  EXPECT_EQ(static_cast<size_t>(kNumVisits - 100), visits.size());
+
+  ExpireHistoryBackend restarted(this, &bookmark_model_);
+  restarted.SetDatabases(main_db_.get(), archived_db_.get(), thumb_db_.get());
+  restarted.StartArchivingOldStuff(TimeDelta::FromDays(90));
+  base::RunLoop().RunUntilIdle();
+  restarted.SetDatabases(NULL, NULL, NULL);
+
+  main_db_->GetAllVisitsInRange(begin_time, end_time, 0, &visits);
+  EXPECT_TRUE(visits.empty());
+  main_db_->GetPendingExpirations(&ranges);
+  EXPECT_TRUE(ranges.empty());
+  EXPECT_FALSE(done);
+}
+
 // Expires all URLs with times in a given set.
 TEST_F(ExpireHistoryTest, FlushURLsForTimes) {
   URLID url_ids[3];
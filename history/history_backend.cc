@@ -119,6 +119,51 @@ MostVisitedURL MakeMostVisitedURL(const PageUsageData& page_data,
   return mv;
 }
 
+// Sets |best_favicon_id| to the one of |candidate_favicon_ids| whose bitmaps,
+// listed in |bitmap_id_sizes|, best match |desired_size_in_dip| and
+// |desired_scale_factors|, and |best_bitmap_ids| to the bitmaps of it to use.
+// |best_favicon_id| is 0 if no candidate has a score.
+void SelectBestFaviconBitmaps(
+    const std::vector<chrome::FaviconID>& candidate_favicon_ids,
+    const std::map<chrome::FaviconID, std::vector<FaviconBitmapIDSize> >&
+        bitmap_id_sizes,
+    int desired_size_in_dip,
+    const std::vector<ui::ScaleFactor>& desired_scale_factors,
+    chrome::FaviconID* best_favicon_id,
+    std::vector<FaviconBitmapID>* best_bitmap_ids) {
+  *best_favicon_id = 0;
+  best_bitmap_ids->clear();
+  float highest_score = kSelectFaviconFramesInvalidScore;
+  for (size_t i = 0; i < candidate_favicon_ids.size(); ++i) {
+    std::map<chrome::FaviconID, std::vector<FaviconBitmapIDSize> >::
+        const_iterator found = bitmap_id_sizes.find(candidate_favicon_ids[i]);
+
+    // Build vector of gfx::Size from the bitmap sizes.
+    std::vector<gfx::Size> sizes;
+    if (found != bitmap_id_sizes.end()) {
+      for (size_t j = 0; j < found->second.size(); ++j)
+        sizes.push_back(found->second[j].pixel_size);
+    }
+
+    std::vector<size_t> candidate_bitmap_indices;
+    float score = 0;
+    SelectFaviconFrameIndices(sizes,
+                              desired_scale_factors,
+                              desired_size_in_dip,
+                              &candidate_bitmap_indices,
+                              &score);
+    if (score > highest_score) {
+      highest_score = score;
+      *best_favicon_id = candidate_favicon_ids[i];
+      best_bitmap_ids->clear();
+      for (size_t j = 0; j < candidate_bitmap_indices.size(); ++j) {
+        size_t candidate_index = candidate_bitmap_indices[j];
+        best_bitmap_ids->push_back(found->second[candidate_index].bitmap_id);
+      }
+    }
+  }
+}
+
 // This task is run on a timer so that commits happen at regular intervals
 // so they are batched together. The important thing about this class is that
 // it supports canceling of the task so the reference to the backend will be
@@ -160,6 +205,64 @@ class CommitLaterTask : public base::RefCounted<CommitLaterTask> {
   scoped_refptr<HistoryBackend> history_backend_;
 };
 
+// Holds the URL row and segment count updates made while a batch of page
+// additions is added, so that a URL visited several times in the batch is
+// written once, and a segment's count once per day. New URLs and visits are
+// still inserted immediately since their IDs are needed.
+class AddPageBatch {
+ public:
+  AddPageBatch() {}
+
+  // Like URLDatabase::GetRowForURL(), but sees the pending updates.
+  URLID GetRowForURL(HistoryDatabase* db, const GURL& url, URLRow* row) {
+    std::map<GURL, URLRow>::const_iterator found = url_rows_.find(url);
+    if (found != url_rows_.end()) {
+      *row = found->second;
+      return row->id();
+    }
+    return db->GetRowForURL(url, row);
+  }
+
+  // |row| must have been read with GetRowForURL().
+  void UpdateURLRow(const GURL& url, const URLRow& row) {
+    url_rows_[url] = row;
+  }
+
+  void IncreaseSegmentVisitCount(SegmentID segment_id, base::Time ts) {
+    ++segment_visit_counts_[std::make_pair(segment_id, ts.LocalMidnight())];
+  }
+
+  // Writes the pending URL rows, for callers which read the URL table
+  // directly.
+  void WriteURLRows(HistoryDatabase* db) {
+    for (std::map<GURL, URLRow>::const_iterator i = url_rows_.begin();
+         i != url_rows_.end(); ++i)
+      db->UpdateURLRow(i->second.id(), i->second);
+    url_rows_.clear();
+  }
+
+  void Write(HistoryDatabase* db) {
+    WriteURLRows(db);
+    for (SegmentVisitCounts::const_iterator i = segment_visit_counts_.begin();
+         i != segment_visit_counts_.end(); ++i) {
+      if (!db->IncreaseSegmentVisitCount(i->first.first, i->first.second,
+                                         i->second))
+        NOTREACHED();
+    }
+    segment_visit_counts_.clear();
+  }
+
+ private:
+  typedef std::map<std::pair<SegmentID, base::Time>, int> SegmentVisitCounts;
+
+  std::map<GURL, URLRow> url_rows_;
+
+  // Visit counts to add, by segment and day.
+  SegmentVisitCounts segment_visit_counts_;
+
+  DISALLOW_COPY_AND_ASSIGN(AddPageBatch);
+};
+
 // HistoryBackend --------------------------------------------------------------
 
 HistoryBackend::HistoryBackend(const base::FilePath& history_dir,
@@ -342,7 +445,9 @@ SegmentID HistoryBackend::UpdateSegments(
   }
 
   // Finally, increase the counter for that segment / day.
-  if (!db_->IncreaseSegmentVisitCount(segment_id, ts, 1)) {
+  if (add_page_batch_) {
+    add_page_batch_->IncreaseSegmentVisitCount(segment_id, ts);
+  } else if (!db_->IncreaseSegmentVisitCount(segment_id, ts, 1)) {
     NOTREACHED();
     return 0;
   }
@@ -372,6 +477,24 @@ void HistoryBackend::UpdateVisitDuration(VisitID visit_id, const Time end_ts) {
   }
 }
 
+void HistoryBackend::AddPages(const std::vector<HistoryAddPageArgs>& requests,
+                              TimeTicks queued_time) {
+  if (!db_)
+    return;
+
+  TimeTicks start = TimeTicks::Now();
+  UMA_HISTOGRAM_TIMES("History.AddPageBatchQueueTime", start - queued_time);
+  UMA_HISTOGRAM_COUNTS_100("History.AddPageQueueDepth", requests.size());
+
+  add_page_batch_.reset(new AddPageBatch);
+  for (size_t i = 0; i < requests.size(); ++i)
+    AddPage(requests[i]);
+  add_page_batch_->Write(db_.get());
+  add_page_batch_.reset();
+
+  UMA_HISTOGRAM_TIMES("History.AddPageBatchTime", TimeTicks::Now() - start);
+}
+
 void HistoryBackend::AddPage(const HistoryAddPageArgs& request) {
   if (!db_)
     return;
@@ -416,6 +539,9 @@ void HistoryBackend::AddPage(const HistoryAddPageArgs& request) {
               host,
               net::registry_controlled_domains::EXCLUDE_UNKNOWN_REGISTRIES,
               net::registry_controlled_domains::EXCLUDE_PRIVATE_REGISTRIES);
+      // IsTypedHost() reads the typed counts of the URL table.
+      if (registry_length == 0 && add_page_batch_)
+        add_page_batch_->WriteURLRows(db_.get());
       if (registry_length == 0 && !db_->IsTypedHost(host)) {
         stripped_transition = content::PAGE_TRANSITION_TYPED;
         request_transition =
@@ -650,6 +776,9 @@ void HistoryBackend::InitImpl(const std::string& languages) {
   // The main DB initialization should intuitively be first (not that it
   // actually matters) and the expirer should be set last.
   expirer_.SetDatabases(db_.get(), archived_db_.get(), thumbnail_db_.get());
+  // The expirer is owned by this object, so it cannot outlive it.
+  expirer_.SetCommitCallback(
+      base::Bind(&HistoryBackend::Commit, base::Unretained(this)));
 
   // Open the long-running transaction.
   db_->BeginTransaction();
@@ -738,7 +867,9 @@ std::pair<URLID, VisitID> HistoryBackend::AddPageVisit(
 
   // See if this URL is already in the DB.
   URLRow url_info(url);
-  URLID url_id = db_->GetRowForURL(url, &url_info);
+  URLID url_id = add_page_batch_ ?
+      add_page_batch_->GetRowForURL(db_.get(), url, &url_info) :
+      db_->GetRowForURL(url, &url_info);
   if (url_id) {
     // Update of an existing row.
     if (content::PageTransitionStripQualifier(transition) !=
@@ -753,7 +884,10 @@ std::pair<URLID, VisitID> HistoryBackend::AddPageVisit(
     if (!new_hidden)
       url_info.set_hidden(false);
 
-    db_->UpdateURLRow(url_id, url_info);
+    if (add_page_batch_)
+      add_page_batch_->UpdateURLRow(url, url_info);
+    else
+      db_->UpdateURLRow(url_id, url_info);
   } else {
     // Addition of a new row.
     url_info.set_visit_count(1);
@@ -1917,8 +2051,13 @@ void HistoryBackend::MergeFavicon(
     mapping_changed = true;
   }
 
-  if (mapping_changed || !bitmap_identical)
-    SendFaviconChangedNotificationForPageAndRedirects(page_url);
+  if (mapping_changed || !bitmap_identical) {
+    // Bitmaps may have been added to or copied into |icon_url|, which other
+    // pages may share.
+    std::set<GURL> icon_urls;
+    icon_urls.insert(icon_url);
+    SendFaviconChangedNotificationForPageAndRedirects(page_url, icon_urls);
+  }
   ScheduleCommit();
 }
 
@@ -1971,7 +2110,12 @@ void HistoryBackend::SetFavicons(
   if (data_modified) {
     // Send notification to the UI as an icon mapping, favicon, or favicon
     // bitmap was changed by this function.
-    SendFaviconChangedNotificationForPageAndRedirects(page_url);
+    std::set<GURL> icon_urls;
+    for (BitmapDataByIconURL::const_iterator it = grouped_by_icon_url.begin();
+         it != grouped_by_icon_url.end(); ++it) {
+      icon_urls.insert(it->first);
+    }
+    SendFaviconChangedNotificationForPageAndRedirects(page_url, icon_urls);
   }
   ScheduleCommit();
 }
@@ -2121,7 +2265,8 @@ void HistoryBackend::UpdateFaviconMappingsAndFetchImpl(
         SetFaviconMappingsForPageAndRedirects(*page_url, selected_icon_type,
                                               favicon_ids);
     if (mappings_updated) {
-      SendFaviconChangedNotificationForPageAndRedirects(*page_url);
+      SendFaviconChangedNotificationForPageAndRedirects(*page_url,
+                                                        std::set<GURL>());
       ScheduleCommit();
     }
   }
@@ -2225,6 +2370,98 @@ bool HistoryBackend::IsFaviconBitmapDataEqual(
   return new_bitmap_data->Equals(original_bitmap_data);
 }
 
+void HistoryBackend::GetFaviconsForURLs(
+    const std::vector<GURL>& page_urls,
+    int icon_types,
+    int desired_size_in_dip,
+    const std::vector<ui::ScaleFactor>& desired_scale_factors,
+    std::vector<std::vector<chrome::FaviconBitmapResult> >* bitmap_results) {
+  DCHECK(bitmap_results);
+  bitmap_results->clear();
+  bitmap_results->resize(page_urls.size());
+
+  if (!db_ || !thumbnail_db_)
+    return;
+
+  TimeTicks beginning_time = TimeTicks::Now();
+
+  // Look up the mappings of all the pages, then the bitmap sizes of all the
+  // favicons they map to.
+  std::map<GURL, std::vector<IconMapping> > icon_mappings;
+  thumbnail_db_->GetIconMappingsForPageURLs(page_urls, icon_types,
+                                            &icon_mappings);
+  std::map<chrome::FaviconID, const IconMapping*> favicons;
+  for (std::map<GURL, std::vector<IconMapping> >::const_iterator i =
+           icon_mappings.begin();
+       i != icon_mappings.end(); ++i) {
+    for (size_t j = 0; j < i->second.size(); ++j)
+      favicons[i->second[j].icon_id] = &i->second[j];
+  }
+  std::vector<chrome::FaviconID> favicon_ids;
+  for (std::map<chrome::FaviconID, const IconMapping*>::const_iterator i =
+           favicons.begin();
+       i != favicons.end(); ++i)
+    favicon_ids.push_back(i->first);
+  std::map<chrome::FaviconID, std::vector<FaviconBitmapIDSize> >
+      bitmap_id_sizes;
+  thumbnail_db_->GetFaviconBitmapIDSizesForIcons(favicon_ids,
+                                                 &bitmap_id_sizes);
+
+  // Pick the bitmaps of each page as GetFaviconsFromDB() would, then read
+  // them all at once.
+  std::vector<chrome::FaviconID> best_favicon_ids(page_urls.size());
+  std::vector<std::vector<FaviconBitmapID> > best_bitmap_ids(
+      page_urls.size());
+  std::set<FaviconBitmapID> bitmap_ids;
+  for (size_t i = 0; i < page_urls.size(); ++i) {
+    std::map<GURL, std::vector<IconMapping> >::const_iterator mappings =
+        icon_mappings.find(page_urls[i]);
+    if (mappings == icon_mappings.end())
+      continue;
+
+    std::vector<chrome::FaviconID> candidate_favicon_ids;
+    for (size_t j = 0; j < mappings->second.size(); ++j)
+      candidate_favicon_ids.push_back(mappings->second[j].icon_id);
+    SelectBestFaviconBitmaps(candidate_favicon_ids, bitmap_id_sizes,
+                             desired_size_in_dip, desired_scale_factors,
+                             &best_favicon_ids[i], &best_bitmap_ids[i]);
+    bitmap_ids.insert(best_bitmap_ids[i].begin(), best_bitmap_ids[i].end());
+  }
+  std::vector<FaviconBitmap> bitmaps;
+  thumbnail_db_->GetFaviconBitmapsForIDs(
+      std::vector<FaviconBitmapID>(bitmap_ids.begin(), bitmap_ids.end()),
+      &bitmaps);
+  std::map<FaviconBitmapID, const FaviconBitmap*> bitmaps_by_id;
+  for (size_t i = 0; i < bitmaps.size(); ++i)
+    bitmaps_by_id[bitmaps[i].bitmap_id] = &bitmaps[i];
+
+  for (size_t i = 0; i < page_urls.size(); ++i) {
+    if (!best_favicon_ids[i])
+      continue;
+    const IconMapping* favicon = favicons[best_favicon_ids[i]];
+    for (size_t j = 0; j < best_bitmap_ids[i].size(); ++j) {
+      std::map<FaviconBitmapID, const FaviconBitmap*>::const_iterator bitmap =
+          bitmaps_by_id.find(best_bitmap_ids[i][j]);
+      if (bitmap == bitmaps_by_id.end())
+        continue;
+
+      chrome::FaviconBitmapResult bitmap_result;
+      bitmap_result.icon_url = favicon->icon_url;
+      bitmap_result.icon_type = favicon->icon_type;
+      bitmap_result.bitmap_data = bitmap->second->bitmap_data;
+      bitmap_result.pixel_size = bitmap->second->pixel_size;
+      bitmap_result.expired = (Time::Now() - bitmap->second->last_updated) >
+          TimeDelta::FromDays(kFaviconRefetchDays);
+      if (bitmap_result.is_valid())
+        (*bitmap_results)[i].push_back(bitmap_result);
+    }
+  }
+  UMA_HISTOGRAM_TIMES("History.GetFaviconsForURLsFromDB",
+                      TimeTicks::Now() - beginning_time);
+  UMA_HISTOGRAM_COUNTS_1000("History.GetFaviconsForURLsCount",
+                            page_urls.size());
+}
+
 bool HistoryBackend::GetFaviconsFromDB(
     const GURL& page_url,
     int icon_types,
@@ -2270,37 +2507,17 @@ bool HistoryBackend::GetFaviconBitmapResultsForBestMatch(
   // |desired_size_in_dip| and |desired_scale_factors|.
   // TODO(pkotwicz): Select bitmap results from multiple favicons once
   // content::FaviconStatus supports multiple icon URLs.
-  chrome::FaviconID best_favicon_id = 0;
-  std::vector<FaviconBitmapID> best_bitmap_ids;
-  float highest_score = kSelectFaviconFramesInvalidScore;
+  std::map<chrome::FaviconID, std::vector<FaviconBitmapIDSize> >
+      bitmap_id_sizes;
   for (size_t i = 0; i < candidate_favicon_ids.size(); ++i) {
-    std::vector<FaviconBitmapIDSize> bitmap_id_sizes;
-    thumbnail_db_->GetFaviconBitmapIDSizes(candidate_favicon_ids[i],
-                                           &bitmap_id_sizes);
-
-    // Build vector of gfx::Size from |bitmap_id_sizes|.
-    std::vector<gfx::Size> sizes;
-    for (size_t j = 0; j < bitmap_id_sizes.size(); ++j)
-      sizes.push_back(bitmap_id_sizes[j].pixel_size);
-
-    std::vector<size_t> candidate_bitmap_indices;
-    float score = 0;
-    SelectFaviconFrameIndices(sizes,
-                              desired_scale_factors,
-                              desired_size_in_dip,
-                              &candidate_bitmap_indices,
-                              &score);
-    if (score > highest_score) {
-      highest_score = score;
-      best_favicon_id = candidate_favicon_ids[i],
-      best_bitmap_ids.clear();
-      for (size_t j = 0; j < candidate_bitmap_indices.size(); ++j) {
-        size_t candidate_index = candidate_bitmap_indices[j];
-        best_bitmap_ids.push_back(
-            bitmap_id_sizes[candidate_index].bitmap_id);
-      }
-    }
+    thumbnail_db_->GetFaviconBitmapIDSizes(
+        candidate_favicon_ids[i], &bitmap_id_sizes[candidate_favicon_ids[i]]);
   }
+  chrome::FaviconID best_favicon_id;
+  std::vector<FaviconBitmapID> best_bitmap_ids;
+  SelectBestFaviconBitmaps(candidate_favicon_ids, bitmap_id_sizes,
+                           desired_size_in_dip, desired_scale_factors,
+                           &best_favicon_id, &best_bitmap_ids);
 
   // Construct FaviconBitmapResults from |best_favicon_id| and
   // |best_bitmap_ids|.
@@ -2426,13 +2643,15 @@ void HistoryBackend::GetCachedRecentRedirects(
 }
 
 void HistoryBackend::SendFaviconChangedNotificationForPageAndRedirects(
-    const GURL& page_url) {
+    const GURL& page_url,
+    const std::set<GURL>& icon_urls) {
   history::RedirectList redirect_list;
   GetCachedRecentRedirects(page_url, &redirect_list);
 
   FaviconChangedDetails* changed_details = new FaviconChangedDetails;
   for (size_t i = 0; i < redirect_list.size(); ++i)
     changed_details->urls.insert(redirect_list[i]);
+  changed_details->icon_urls = icon_urls;
 
   BroadcastNotifications(chrome::NOTIFICATION_FAVICON_CHANGED,
                          changed_details);
@@ -2628,6 +2847,36 @@ void HistoryBackend::ExpireHistoryForTimes(
     db_->GetStartDate(&first_recorded_time_);
 }
 
+void HistoryBackend::ExpireHistoryBetweenInSlices(
+    const std::set<GURL>& restrict_urls,
+    Time begin_time,
+    Time end_time,
+    const base::Closure& done) {
+  // Deleting all history is already fast, and deletions restricted to a few
+  // URLs are small.
+  if (!db_ || !restrict_urls.empty() ||
+      (begin_time.is_null() && (end_time.is_null() || end_time.is_max()))) {
+    ExpireHistoryBetween(restrict_urls, begin_time, end_time);
+    done.Run();
+    return;
+  }
+
+  // The expirer is owned by this object, so it cannot outlive it.
+  expirer_.ExpireHistoryBetweenInSlices(
+      begin_time, end_time,
+      base::Bind(&HistoryBackend::OnExpireHistoryBetweenInSlicesDone,
+                 base::Unretained(this), begin_time, done));
+}
+
+void HistoryBackend::OnExpireHistoryBetweenInSlicesDone(
+    Time begin_time,
+    const base::Closure& done) {
+  // The expirer has already committed the last slice.
+  if (begin_time <= first_recorded_time_)
+    db_->GetStartDate(&first_recorded_time_);
+  done.Run();
+}
+
 void HistoryBackend::ExpireHistory(
     const std::vector<history::ExpireHistoryArgs>& expire_list) {
   if (db_) {
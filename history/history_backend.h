@@ -36,6 +36,7 @@ namespace history {
 class AndroidProviderBackend;
 #endif
 
+class AddPageBatch;
 class CommitLaterTask;
 class VisitFilter;
 struct DownloadRow;
@@ -143,6 +144,12 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
 
   // |request.time| must be unique with high probability.
   void AddPage(const HistoryAddPageArgs& request);
+
+  // Adds |requests| in order, as AddPage() would, writing the URL rows and
+  // segment counts they update once at the end. |queued_time| is when the
+  // first of them was queued by the HistoryService.
+  void AddPages(const std::vector<HistoryAddPageArgs>& requests,
+                base::TimeTicks queued_time);
   virtual void SetPageTitle(const GURL& url, const base::string16& title);
   void AddPageNoVisitForBookmark(const GURL& url, const base::string16& title);
 
@@ -248,6 +255,15 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
       const std::vector<ui::ScaleFactor>& desired_scale_factors,
       std::vector<chrome::FaviconBitmapResult>* bitmap_results);
 
+  // Like GetFaviconsForURL() for each of |page_urls|, with the results in the
+  // same order, but looks up all the pages with a few set-based queries.
+  void GetFaviconsForURLs(
+      const std::vector<GURL>& page_urls,
+      int icon_types,
+      int desired_size_in_dip,
+      const std::vector<ui::ScaleFactor>& desired_scale_factors,
+      std::vector<std::vector<chrome::FaviconBitmapResult> >* bitmap_results);
+
   void GetFaviconForID(
       chrome::FaviconID favicon_id,
       int desired_size_in_dip,
@@ -420,6 +436,14 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
       base::Time begin_time,
       base::Time end_time);
 
+  // Like ExpireHistoryBetween(), but large deletions are done a slice at a
+  // time so that other requests are handled in between. Runs |done| once the
+  // deletion is committed.
+  void ExpireHistoryBetweenInSlices(const std::set<GURL>& restrict_urls,
+                                    base::Time begin_time,
+                                    base::Time end_time,
+                                    const base::Closure& done);
+
   // Finds the URLs visited at |times| and expires all their visits within
   // [|begin_time|, |end_time|). All times in |times| should be in
   // [|begin_time|, |end_time|). This is used when expiration request is from
@@ -488,6 +512,7 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
   friend class CommitLaterTask;  // The commit task needs to call Commit().
   friend class HistoryBackendTest;
   friend class HistoryBackendDBTest;  // So the unit tests can poke our innards.
+  friend class HistoryBackendPerfTest;
   FRIEND_TEST_ALL_PREFIXES(HistoryBackendTest, DeleteAll);
   FRIEND_TEST_ALL_PREFIXES(HistoryBackendTest, DeleteAllThenAddData);
   FRIEND_TEST_ALL_PREFIXES(HistoryBackendTest, ImportedFaviconsTest);
@@ -631,6 +656,11 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
   // to write something to disk.
   void Commit();
 
+  // Called by the expirer when ExpireHistoryBetweenInSlices() has deleted all
+  // of the visits from |begin_time|. Commits and runs |done|.
+  void OnExpireHistoryBetweenInSlicesDone(base::Time begin_time,
+                                          const base::Closure& done);
+
   // Schedules a commit to happen in the future. We do this so that many
   // operations over a period of time will be batched together. If there is
   // already a commit scheduled for the future, this will do nothing.
@@ -756,9 +786,11 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
                                 history::RedirectList* redirect_list);
 
   // Send notification that the favicon has changed for |page_url| and all its
-  // redirects.
+  // redirects, and that the bitmaps of |icon_urls| have changed for every page
+  // mapped to them.
   void SendFaviconChangedNotificationForPageAndRedirects(
-      const GURL& page_url);
+      const GURL& page_url,
+      const std::set<GURL>& icon_urls);
 
   // Generic stuff -------------------------------------------------------------
 
@@ -845,6 +877,10 @@ class HistoryBackend : public base::RefCountedThreadSafe<HistoryBackend>,
   // scheduled commit at a time (see ScheduleCommit).
   scoped_refptr<CommitLaterTask> scheduled_commit_;
 
+  // Collects the updates of the page additions in progress in AddPages(),
+  // NULL otherwise.
+  scoped_ptr<AddPageBatch> add_page_batch_;
+
   // Maps recent redirect destination pages to the chain of redirects that
   // brought us to there. Pages that did not have redirects or were not the
   // final redirect in a chain will not be in this list, as well as pages that
@@ -0,0 +1,280 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/memory/ref_counted.h"
+#include "base/message_loop/message_loop.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/run_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/history_backend.h"
+#include "chrome/browser/history/thumbnail_database.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+#include "url/gurl.h"
+
+namespace history {
+
+namespace {
+
+// The most additions the HistoryService sends the backend at once.
+const size_t kBatchSize = 64;
+
+// HistoryBackend manages the lifetime of its delegate.
+class NullBackendDelegate : public HistoryBackend::Delegate {
+ public:
+  NullBackendDelegate() {}
+
+  virtual void NotifyProfileError(int backend_id,
+                                  sql::InitStatus init_status) OVERRIDE {}
+  virtual void SetInMemoryBackend(int backend_id,
+                                  InMemoryHistoryBackend* backend) OVERRIDE {
+    delete backend;
+  }
+  virtual void BroadcastNotifications(int type,
+                                      HistoryDetails* details) OVERRIDE {
+    delete details;
+  }
+  virtual void DBLoaded(int backend_id) OVERRIDE {}
+  virtual void NotifyVisitDBObserversOnAddVisit(
+      const BriefVisitInfo& info) OVERRIDE {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NullBackendDelegate);
+};
+
+HistoryAddPageArgs MakeArgs(const GURL& url,
+                            base::Time time,
+                            int32 page_id,
+                            const GURL& referrer,
+                            const RedirectList& redirects,
+                            content::PageTransition transition) {
+  return HistoryAddPageArgs(url, time, NULL, page_id, referrer, redirects,
+                            transition, SOURCE_BROWSED, false);
+}
+
+// Appends the navigations of the tabs restored with a session, which are
+// added in a burst at startup.
+void AppendSessionRestore(size_t pages,
+                          base::Time* time,
+                          std::vector<HistoryAddPageArgs>* trace) {
+  for (size_t i = 0; i < pages; ++i) {
+    GURL url("http://site" + base::Uint64ToString(i % 40) + ".com/page" +
+             base::Uint64ToString(i));
+    *time += base::TimeDelta::FromMilliseconds(1);
+    trace->push_back(MakeArgs(url, *time, 0, GURL(), RedirectList(),
+                              content::PAGE_TRANSITION_RELOAD));
+  }
+}
+
+// Appends page loads which each load the same few ad frames.
+void AppendAdFrames(size_t pages,
+                    base::Time* time,
+                    std::vector<HistoryAddPageArgs>* trace) {
+  const size_t kFramesPerPage = 4;
+  for (size_t i = 0; i < pages; ++i) {
+    GURL page("http://news.com/article" + base::Uint64ToString(i));
+    *time += base::TimeDelta::FromSeconds(1);
+    trace->push_back(MakeArgs(page, *time, i, GURL(), RedirectList(),
+                              content::PAGE_TRANSITION_LINK));
+    for (size_t j = 0; j < kFramesPerPage; ++j) {
+      GURL frame("http://ads.com/frame" + base::Uint64ToString(j));
+      *time += base::TimeDelta::FromMilliseconds(1);
+      trace->push_back(MakeArgs(frame, *time, i, page, RedirectList(),
+                                content::PAGE_TRANSITION_AUTO_SUBFRAME));
+    }
+  }
+}
+
+// Appends navigations which each go through a chain of tracking redirects.
+void AppendRedirectChains(size_t pages,
+                          base::Time* time,
+                          std::vector<HistoryAddPageArgs>* trace) {
+  for (size_t i = 0; i < pages; ++i) {
+    GURL url("http://shop.com/item" + base::Uint64ToString(i));
+    RedirectList redirects;
+    redirects.push_back(GURL("http://click.com/r"));
+    redirects.push_back(GURL("http://track.com/r?" + base::Uint64ToString(i)));
+    redirects.push_back(url);
+    *time += base::TimeDelta::FromSeconds(1);
+    trace->push_back(MakeArgs(url, *time, 0, GURL(), redirects,
+                              content::PageTransitionFromInt(
+                                  content::PAGE_TRANSITION_LINK |
+                                  content::PAGE_TRANSITION_SERVER_REDIRECT)));
+  }
+}
+
+// Appends typed navigations to a few sites followed by links within them.
+void AppendLinkBrowsing(size_t pages,
+                        base::Time* time,
+                        std::vector<HistoryAddPageArgs>* trace) {
+  const size_t kLinksPerSite = 9;
+  for (size_t i = 0; i < pages; i += kLinksPerSite + 1) {
+    std::string site = "http://blog" + base::Uint64ToString(i % 7) + ".com/";
+    GURL referrer(site);
+    *time += base::TimeDelta::FromSeconds(1);
+    trace->push_back(MakeArgs(referrer, *time, i, GURL(), RedirectList(),
+                              content::PAGE_TRANSITION_TYPED));
+    for (size_t j = 0; j < kLinksPerSite; ++j) {
+      GURL url(site + "post" + base::Uint64ToString(j));
+      *time += base::TimeDelta::FromSeconds(1);
+      trace->push_back(MakeArgs(url, *time, i + j + 1, referrer,
+                                RedirectList(),
+                                content::PAGE_TRANSITION_LINK));
+      referrer = url;
+    }
+  }
+}
+
+}  // namespace
+
+class HistoryBackendPerfTest : public testing::Test {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+  }
+
+  scoped_refptr<HistoryBackend> CreateBackend(const std::string& name) {
+    scoped_refptr<HistoryBackend> backend(
+        new HistoryBackend(temp_dir_.path().AppendASCII(name), 0,
+                           new NullBackendDelegate, NULL));
+    backend->Init(std::string(), false);
+    return backend;
+  }
+
+  // Times adding |trace| one page per backend task, as the HistoryService
+  // did before it queued additions, against adding it in batches.
+  void RunComparison(const std::string& trace_name,
+                     const std::vector<HistoryAddPageArgs>& trace) {
+    scoped_refptr<HistoryBackend> backend = CreateBackend(trace_name + "_s");
+    base::TimeTicks start = base::TimeTicks::Now();
+    for (size_t i = 0; i < trace.size(); ++i)
+      backend->AddPage(trace[i]);
+    backend->Commit();
+    base::TimeDelta single_time = base::TimeTicks::Now() - start;
+    backend->Closing();
+
+    backend = CreateBackend(trace_name + "_b");
+    start = base::TimeTicks::Now();
+    for (size_t i = 0; i < trace.size(); i += kBatchSize) {
+      std::vector<HistoryAddPageArgs> batch(
+          trace.begin() + i,
+          trace.begin() + std::min(i + kBatchSize, trace.size()));
+      backend->AddPages(batch, base::TimeTicks::Now());
+    }
+    backend->Commit();
+    base::TimeDelta batched_time = base::TimeTicks::Now() - start;
+    backend->Closing();
+    backend = NULL;
+    base::RunLoop().RunUntilIdle();
+
+    perf_test::PrintResult("history_add_page", "_single", trace_name,
+                           single_time.InMillisecondsF() / trace.size(),
+                           "ms", true);
+    perf_test::PrintResult("history_add_page", "_batched", trace_name,
+                           batched_time.InMillisecondsF() / trace.size(),
+                           "ms", true);
+  }
+
+  // Gives each of |page_urls| a favicon with 16 and 32 pixel bitmaps, the
+  // pages of each site sharing their site's icon.
+  void AddFavicons(HistoryBackend* backend,
+                   const std::vector<GURL>& page_urls) {
+    std::vector<unsigned char> data(1024, 'a');
+    scoped_refptr<base::RefCountedBytes> bitmap_data(
+        new base::RefCountedBytes(data));
+    ThumbnailDatabase* db = backend->thumbnail_db_.get();
+    ASSERT_TRUE(db);
+    for (size_t i = 0; i < page_urls.size(); ++i) {
+      GURL icon_url = page_urls[i].GetWithEmptyPath().Resolve("favicon.ico");
+      chrome::FaviconID icon_id = db->GetFaviconIDForFaviconURL(
+          icon_url, chrome::FAVICON, NULL);
+      if (!icon_id) {
+        icon_id = db->AddFavicon(icon_url, chrome::FAVICON, bitmap_data,
+                                 base::Time::Now(), gfx::Size(16, 16));
+        db->AddFaviconBitmap(icon_id, bitmap_data, base::Time::Now(),
+                             gfx::Size(32, 32));
+      }
+      db->AddIconMapping(page_urls[i], icon_id);
+    }
+    backend->Commit();
+  }
+
+ private:
+  base::MessageLoop message_loop_;
+  base::ScopedTempDir temp_dir_;
+};
+
+TEST_F(HistoryBackendPerfTest, AddPageThroughput) {
+  const size_t kPages = 2000;
+  base::Time time = base::Time::Now() - base::TimeDelta::FromDays(1);
+
+  std::vector<HistoryAddPageArgs> trace;
+  AppendSessionRestore(kPages, &time, &trace);
+  RunComparison("session_restore", trace);
+
+  trace.clear();
+  AppendAdFrames(kPages / 5, &time, &trace);
+  RunComparison("ad_frames", trace);
+
+  trace.clear();
+  AppendRedirectChains(kPages, &time, &trace);
+  RunComparison("redirect_chains", trace);
+
+  trace.clear();
+  AppendLinkBrowsing(kPages, &time, &trace);
+  RunComparison("link_browsing", trace);
+}
+
+// Times fetching the favicons of a page of history results one page URL at a
+// time, as the history page does, against fetching them all at once.
+TEST_F(HistoryBackendPerfTest, FaviconsForHistoryPage) {
+  const size_t kResults = 200;
+  const size_t kRuns = 20;
+  std::vector<GURL> page_urls;
+  for (size_t i = 0; i < kResults; ++i) {
+    page_urls.push_back(GURL("http://site" + base::Uint64ToString(i % 50) +
+                             ".com/page" + base::Uint64ToString(i)));
+  }
+  scoped_refptr<HistoryBackend> backend = CreateBackend("favicons");
+  AddFavicons(backend.get(), page_urls);
+
+  std::vector<ui::ScaleFactor> scale_factors;
+  scale_factors.push_back(ui::SCALE_FACTOR_100P);
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t run = 0; run < kRuns; ++run) {
+    for (size_t i = 0; i < page_urls.size(); ++i) {
+      std::vector<chrome::FaviconBitmapResult> results;
+      backend->GetFaviconsForURL(page_urls[i], chrome::FAVICON, 16,
+                                 scale_factors, &results);
+      ASSERT_EQ(1u, results.size());
+    }
+  }
+  base::TimeDelta single_time = base::TimeTicks::Now() - start;
+
+  start = base::TimeTicks::Now();
+  for (size_t run = 0; run < kRuns; ++run) {
+    std::vector<std::vector<chrome::FaviconBitmapResult> > results;
+    backend->GetFaviconsForURLs(page_urls, chrome::FAVICON, 16, scale_factors,
+                                &results);
+    ASSERT_EQ(kResults, results.size());
+  }
+  base::TimeDelta bulk_time = base::TimeTicks::Now() - start;
+  backend->Closing();
+  backend = NULL;
+  base::RunLoop().RunUntilIdle();
+
+  perf_test::PrintResult("history_page_favicons", "_single", "200_results",
+                         single_time.InMillisecondsF() / kRuns, "ms", true);
+  perf_test::PrintResult("history_page_favicons", "_bulk", "200_results",
+                         bulk_time.InMillisecondsF() / kRuns, "ms", true);
+}
+
+}  // namespace history
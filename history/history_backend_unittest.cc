@@ -15,6 +15,7 @@
 #include "base/files/file_path.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/memory/scoped_vector.h"
 #include "base/path_service.h"
 #include "base/run_loop.h"
 #include "base/strings/string16.h"
@@ -29,6 +30,7 @@
 #include "chrome/browser/history/history_service_factory.h"
 #include "chrome/browser/history/in_memory_database.h"
 #include "chrome/browser/history/in_memory_history_backend.h"
+#include "chrome/browser/history/page_usage_data.h"
 #include "chrome/browser/history/visit_filter.h"
 #include "chrome/common/chrome_constants.h"
 #include "chrome/common/chrome_paths.h"
@@ -1016,6 +1018,114 @@ TEST_F(HistoryBackendTest, AddPageArgsSource) {
   EXPECT_EQ(history::SOURCE_SYNCED, visit_sources.begin()->second);
 }
 
+// Returns the additions of typed, link, reload and link visits to |url1|
+// followed by a link visit to |url2|, starting at |visit_time|.
+static std::vector<HistoryAddPageArgs> AddPagesBatchRequests(
+    const GURL& url1,
+    const GURL& url2,
+    base::Time visit_time) {
+  std::vector<HistoryAddPageArgs> requests;
+  content::PageTransition transitions[] = {
+    content::PAGE_TRANSITION_TYPED,
+    content::PAGE_TRANSITION_LINK,
+    content::PAGE_TRANSITION_RELOAD,
+    content::PAGE_TRANSITION_LINK,
+  };
+  for (size_t i = 0; i < arraysize(transitions); ++i) {
+    requests.push_back(HistoryAddPageArgs(
+        url1, visit_time + base::TimeDelta::FromSeconds(i), NULL, 0, GURL(),
+        history::RedirectList(), transitions[i], history::SOURCE_BROWSED,
+        false));
+  }
+  requests.push_back(HistoryAddPageArgs(
+      url2, visit_time + base::TimeDelta::FromSeconds(10), NULL, 0, GURL(),
+      history::RedirectList(), content::PAGE_TRANSITION_LINK,
+      history::SOURCE_BROWSED, false));
+  return requests;
+}
+
+// AddPages() should leave the URL rows, visits and segments as adding each
+// page in turn would, although URL rows updated several times are only
+// written at the end.
+TEST_F(HistoryBackendTest, AddPagesBatch) {
+  ASSERT_TRUE(backend_.get());
+
+  GURL url1("http://batched.com/");
+  GURL url2("http://batched.com/other");
+  base::Time visit_time = base::Time::Now() - base::TimeDelta::FromMinutes(5);
+  backend_->AddPages(AddPagesBatchRequests(url1, url2, visit_time),
+                     base::TimeTicks::Now());
+
+  // The same pages on another host, added one at a time.
+  GURL unbatched_url1("http://unbatched.com/");
+  GURL unbatched_url2("http://unbatched.com/other");
+  std::vector<HistoryAddPageArgs> unbatched_requests =
+      AddPagesBatchRequests(unbatched_url1, unbatched_url2, visit_time);
+  for (size_t i = 0; i < unbatched_requests.size(); ++i)
+    backend_->AddPage(unbatched_requests[i]);
+
+  // The reload does not count as a visit to the URL, but is recorded.
+  URLRow row1;
+  URLID id1 = backend_->db()->GetRowForURL(url1, &row1);
+  ASSERT_TRUE(id1);
+  EXPECT_EQ(3, row1.visit_count());
+  EXPECT_EQ(1, row1.typed_count());
+  EXPECT_EQ(visit_time + base::TimeDelta::FromSeconds(3), row1.last_visit());
+  EXPECT_FALSE(row1.hidden());
+  VisitVector visits;
+  ASSERT_TRUE(backend_->db()->GetVisitsForURL(id1, &visits));
+  EXPECT_EQ(4U, visits.size());
+
+  URLRow unbatched_row1;
+  URLID unbatched_id1 =
+      backend_->db()->GetRowForURL(unbatched_url1, &unbatched_row1);
+  ASSERT_TRUE(unbatched_id1);
+  EXPECT_EQ(unbatched_row1.visit_count(), row1.visit_count());
+  EXPECT_EQ(unbatched_row1.typed_count(), row1.typed_count());
+  EXPECT_EQ(unbatched_row1.last_visit(), row1.last_visit());
+  EXPECT_EQ(unbatched_row1.hidden(), row1.hidden());
+  VisitVector unbatched_visits;
+  ASSERT_TRUE(backend_->db()->GetVisitsForURL(unbatched_id1,
+                                              &unbatched_visits));
+  ASSERT_EQ(unbatched_visits.size(), visits.size());
+  for (size_t i = 0; i < visits.size(); ++i) {
+    EXPECT_EQ(unbatched_visits[i].visit_time, visits[i].visit_time);
+    EXPECT_EQ(unbatched_visits[i].transition, visits[i].transition);
+    EXPECT_EQ(unbatched_visits[i].segment_id != 0, visits[i].segment_id != 0);
+  }
+
+  URLRow row2;
+  ASSERT_TRUE(backend_->db()->GetRowForURL(url2, &row2));
+  EXPECT_EQ(1, row2.visit_count());
+  EXPECT_EQ(0, row2.typed_count());
+  URLRow unbatched_row2;
+  ASSERT_TRUE(backend_->db()->GetRowForURL(unbatched_url2, &unbatched_row2));
+  EXPECT_EQ(unbatched_row2.visit_count(), row2.visit_count());
+  EXPECT_EQ(unbatched_row2.typed_count(), row2.typed_count());
+
+  // The typed visit started a segment, whose visits were counted as when
+  // adding the pages one at a time.
+  SegmentID segment = backend_->db()->GetSegmentNamed(
+      VisitSegmentDatabase::ComputeSegmentName(url1));
+  EXPECT_NE(0, segment);
+  SegmentID unbatched_segment = backend_->db()->GetSegmentNamed(
+      VisitSegmentDatabase::ComputeSegmentName(unbatched_url1));
+  EXPECT_NE(0, unbatched_segment);
+  ScopedVector<PageUsageData> segment_usage;
+  backend_->db()->QuerySegmentUsage(visit_time - base::TimeDelta::FromDays(1),
+                                    10, &segment_usage.get());
+  double score = -1;
+  double unbatched_score = -1;
+  for (size_t i = 0; i < segment_usage.size(); ++i) {
+    if (segment_usage[i]->GetID() == segment)
+      score = segment_usage[i]->GetScore();
+    else if (segment_usage[i]->GetID() == unbatched_segment)
+      unbatched_score = segment_usage[i]->GetScore();
+  }
+  EXPECT_GT(score, 0);
+  EXPECT_EQ(unbatched_score, score);
+}
+
 TEST_F(HistoryBackendTest, AddVisitsSource) {
   ASSERT_TRUE(backend_.get());
 
@@ -1922,6 +2032,59 @@ TEST_F(HistoryBackendTest, MergeFaviconShowsUpInGetFaviconsForURLResult) {
   EXPECT_TRUE(BitmapDataEqual('c', result.bitmap_data));
 }
 
+// Tests that GetFaviconsForURLs() returns the same results as calling
+// GetFaviconsForURL() for each page URL.
+TEST_F(HistoryBackendTest, GetFaviconsForURLsMatchesGetFaviconsForURL) {
+  std::vector<GURL> page_urls;
+  std::vector<chrome::FaviconBitmapData> favicon_bitmap_data;
+  for (int i = 0; i < 6; ++i) {
+    GURL page_url("http://www.site" + base::IntToString(i) + ".com");
+    page_urls.push_back(page_url);
+    // Every other page shares the icon of the page before it.
+    GURL icon_url("http://www.site" + base::IntToString(i - i % 2) +
+                  ".com/favicon.ico");
+    GenerateFaviconBitmapData(icon_url, GetSizesSmallAndLarge(),
+                              &favicon_bitmap_data);
+    backend_->SetFavicons(page_url, chrome::FAVICON, favicon_bitmap_data);
+  }
+  GURL touch_icon_url("http://www.site0.com/touch.png");
+  GenerateFaviconBitmapData(touch_icon_url, GetSizesLarge(),
+                            &favicon_bitmap_data);
+  backend_->SetFavicons(page_urls[0], chrome::TOUCH_ICON, favicon_bitmap_data);
+  page_urls.push_back(GURL("http://www.noicon.com"));
+
+  const int kIconTypes[] = {
+    chrome::FAVICON, chrome::TOUCH_ICON, chrome::FAVICON | chrome::TOUCH_ICON,
+  };
+  const int kSizes[] = { 0, kSmallSize.width(), kLargeSize.width() };
+  for (size_t i = 0; i < arraysize(kIconTypes); ++i) {
+    for (size_t j = 0; j < arraysize(kSizes); ++j) {
+      std::vector<std::vector<chrome::FaviconBitmapResult> > bulk_results;
+      backend_->GetFaviconsForURLs(page_urls, kIconTypes[i], kSizes[j],
+                                   GetScaleFactors1x2x(), &bulk_results);
+      ASSERT_EQ(page_urls.size(), bulk_results.size());
+      for (size_t k = 0; k < page_urls.size(); ++k) {
+        std::vector<chrome::FaviconBitmapResult> results;
+        backend_->GetFaviconsForURL(page_urls[k], kIconTypes[i], kSizes[j],
+                                    GetScaleFactors1x2x(), &results);
+        ASSERT_EQ(results.size(), bulk_results[k].size());
+        for (size_t l = 0; l < results.size(); ++l) {
+          EXPECT_EQ(results[l].icon_url, bulk_results[k][l].icon_url);
+          EXPECT_EQ(results[l].icon_type, bulk_results[k][l].icon_type);
+          EXPECT_EQ(results[l].pixel_size, bulk_results[k][l].pixel_size);
+          EXPECT_EQ(results[l].expired, bulk_results[k][l].expired);
+          ASSERT_EQ(results[l].bitmap_data->size(),
+                    bulk_results[k][l].bitmap_data->size());
+          EXPECT_TRUE(std::equal(results[l].bitmap_data->front(),
+                                 results[l].bitmap_data->front() +
+                                     results[l].bitmap_data->size(),
+                                 bulk_results[k][l].bitmap_data->front()));
+        }
+      }
+    }
+  }
+}
+
 // Tests GetFaviconsForURL with icon_types priority,
 TEST_F(HistoryBackendTest, TestGetFaviconsForURLWithIconTypesPriority) {
   GURL page_url("http://www.google.com");
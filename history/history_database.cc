@@ -12,6 +12,8 @@
 #include "base/file_util.h"
 #include "base/metrics/histogram.h"
 #include "base/rand_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
 #include "base/time/time.h"
 #include "sql/transaction.h"
@@ -27,9 +29,13 @@ namespace {
 // Current version number. We write databases at the "current" version number,
 // but any previous version that can read the "compatible" one can make do with
 // or database without *too* many bad effects.
-const int kCurrentVersionNumber = 28;
+const int kCurrentVersionNumber = 29;
 const int kCompatibleVersionNumber = 16;
 const char kEarlyExpirationThresholdKey[] = "early_expiration_threshold";
+const char kPendingExpirationsKey[] = "pending_expirations";
+// The number of URLs and the largest URL ID when url_words was last changed.
+const char kURLWordsURLCountKey[] = "url_words_url_count";
+const char kURLWordsMaxURLIDKey[] = "url_words_max_url_id";
 
 }  // namespace
 
@@ -85,11 +91,12 @@ sql::InitStatus HistoryDatabase::Init(const base::FilePath& history_name) {
   if (!meta_table_.Init(&db_, GetCurrentVersion(), kCompatibleVersionNumber))
     return sql::INIT_FAILURE;
   if (!CreateURLTable(false) || !InitVisitTable() ||
-      !InitKeywordSearchTermsTable() || !InitDownloadTable() ||
-      !InitSegmentTables())
+      !InitKeywordSearchTermsTable() || !InitURLWordTable() ||
+      !InitDownloadTable() || !InitSegmentTables())
     return sql::INIT_FAILURE;
   CreateMainURLIndex();
   CreateKeywordSearchTermsIndices();
+  CreateURLWordIndices();
 
   // TODO(benjhayden) Remove at some point.
   meta_table_.DeleteKey("next_download_id");
@@ -99,6 +106,18 @@ sql::InitStatus HistoryDatabase::Init(const base::FilePath& history_name) {
   if (version_status != sql::INIT_OK)
     return version_status;
 
+  // Builds older than version 29 can still open the database, but add and
+  // delete URLs without updating url_words. Those URLs would be missing from
+  // history search, so index every URL again if the URLs have changed since
+  // url_words was last written.
+  if (!URLWordTableIsCurrent()) {
+    if (!RebuildURLWordTable()) {
+      LOG(WARNING) << "Unable to rebuild the history URL word table.";
+      return sql::INIT_FAILURE;
+    }
+    RecordURLWordTableCoverage();
+  }
+
   return committer.Commit() ? sql::INIT_OK : sql::INIT_FAILURE;
 }
 
@@ -197,6 +216,9 @@ void HistoryDatabase::BeginTransaction() {
 }
 
 void HistoryDatabase::CommitTransaction() {
+  // Record the URLs url_words covers as part of the changes to it.
+  if (db_.transaction_nesting() == 1 && url_words_changed())
+    RecordURLWordTableCoverage();
   db_.CommitTransaction();
 }
 
@@ -286,10 +308,79 @@ void HistoryDatabase::UpdateEarlyExpirationThreshold(base::Time threshold) {
   cached_early_expiration_threshold_ = threshold;
 }
 
+void HistoryDatabase::GetPendingExpirations(ExpirationRanges* ranges) {
+  ranges->clear();
+  std::string value;
+  if (!meta_table_.GetValue(kPendingExpirationsKey, &value))
+    return;
+
+  // Stored as "begin:end" pairs of internal time values separated by commas.
+  std::vector<std::string> range_strings;
+  base::SplitString(value, ',', &range_strings);
+  for (size_t i = 0; i < range_strings.size(); ++i) {
+    std::vector<std::string> times;
+    base::SplitString(range_strings[i], ':', &times);
+    int64 begin, end;
+    if (times.size() != 2 || !base::StringToInt64(times[0], &begin) ||
+        !base::StringToInt64(times[1], &end))
+      continue;
+    ranges->push_back(std::make_pair(base::Time::FromInternalValue(begin),
+                                     base::Time::FromInternalValue(end)));
+  }
+}
+
+void HistoryDatabase::SetPendingExpirations(const ExpirationRanges& ranges) {
+  if (ranges.empty()) {
+    meta_table_.DeleteKey(kPendingExpirationsKey);
+    return;
+  }
+
+  std::string value;
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    if (i)
+      value += ",";
+    value += base::Int64ToString(ranges[i].first.ToInternalValue()) + ":" +
+             base::Int64ToString(ranges[i].second.ToInternalValue());
+  }
+  meta_table_.SetValue(kPendingExpirationsKey, value);
+}
+
 sql::Connection& HistoryDatabase::GetDB() {
   return db_;
 }
 
+bool HistoryDatabase::GetURLTableCoverage(int64* url_count,
+                                          int64* max_url_id) {
+  sql::Statement statement(db_.GetUniqueStatement(
+      "SELECT count(*), IFNULL(MAX(id), 0) FROM urls"));
+  if (!statement.Step())
+    return false;
+  *url_count = statement.ColumnInt64(0);
+  *max_url_id = statement.ColumnInt64(1);
+  return true;
+}
+
+bool HistoryDatabase::URLWordTableIsCurrent() {
+  int64 recorded_url_count = 0;
+  int64 recorded_max_url_id = 0;
+  int64 url_count = 0;
+  int64 max_url_id = 0;
+  return meta_table_.GetValue(kURLWordsURLCountKey, &recorded_url_count) &&
+      meta_table_.GetValue(kURLWordsMaxURLIDKey, &recorded_max_url_id) &&
+      GetURLTableCoverage(&url_count, &max_url_id) &&
+      url_count == recorded_url_count && max_url_id == recorded_max_url_id;
+}
+
+void HistoryDatabase::RecordURLWordTableCoverage() {
+  int64 url_count = 0;
+  int64 max_url_id = 0;
+  if (GetURLTableCoverage(&url_count, &max_url_id)) {
+    meta_table_.SetValue(kURLWordsURLCountKey, url_count);
+    meta_table_.SetValue(kURLWordsMaxURLIDKey, max_url_id);
+  }
+  clear_url_words_changed();
+}
+
 // Migration -------------------------------------------------------------------
 
 sql::InitStatus HistoryDatabase::EnsureCurrentVersion() {
@@ -307,6 +398,11 @@ sql::InitStatus HistoryDatabase::EnsureCurrentVersion() {
 
   int cur_version = meta_table_.GetVersionNumber();
 
+  // Let older builds open version 29 databases which were marked as
+  // incompatible with them.
+  if (meta_table_.GetCompatibleVersionNumber() > kCompatibleVersionNumber)
+    meta_table_.SetCompatibleVersionNumber(kCompatibleVersionNumber);
+
   // Put migration code here
 
   if (cur_version == 15) {
@@ -432,6 +528,14 @@ sql::InitStatus HistoryDatabase::EnsureCurrentVersion() {
     meta_table_.SetVersionNumber(cur_version);
   }
 
+  if (cur_version == 28) {
+    // The word table was created empty by Init(), which indexes the existing
+    // URLs once the database is current. The compatible version stays at 16:
+    // older builds only leave the table stale, which Init() detects.
+    cur_version++;
+    meta_table_.SetVersionNumber(cur_version);
+  }
+
   // When the version is too old, we just try to continue anyway, there should
   // not be a released product that makes a database too old for us to handle.
   LOG_IF(WARNING, cur_version < GetCurrentVersion()) <<
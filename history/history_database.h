@@ -5,6 +5,9 @@
 #ifndef CHROME_BROWSER_HISTORY_HISTORY_DATABASE_H_
 #define CHROME_BROWSER_HISTORY_HISTORY_DATABASE_H_
 
+#include <utility>
+#include <vector>
+
 #include "base/basictypes.h"
 #include "base/compiler_specific.h"
 #include "base/gtest_prod_util.h"
@@ -164,6 +167,13 @@ class HistoryDatabase : public DownloadDatabase,
   virtual base::Time GetEarlyExpirationThreshold();
   virtual void UpdateEarlyExpirationThreshold(base::Time threshold);
 
+  // Retrieves/Updates the [begin, end) time ranges which ExpireHistoryBackend
+  // is deleting a slice at a time, so that deletions interrupted by shutdown
+  // are finished on the next run. An empty list clears them.
+  typedef std::vector<std::pair<base::Time, base::Time> > ExpirationRanges;
+  void GetPendingExpirations(ExpirationRanges* ranges);
+  void SetPendingExpirations(const ExpirationRanges& ranges);
+
  private:
 #if defined(OS_ANDROID)
   // AndroidProviderBackend uses the |db_|.
@@ -176,6 +186,18 @@ class HistoryDatabase : public DownloadDatabase,
   // Overridden from URLDatabase:
   virtual sql::Connection& GetDB() OVERRIDE;
 
+  // Retrieves the number of URLs and the largest URL ID, which change when
+  // URLs are added or deleted.
+  bool GetURLTableCoverage(int64* url_count, int64* max_url_id);
+
+  // Returns true if the URLs have not been added to or deleted since
+  // RecordURLWordTableCoverage() was last called, so that url_words is not
+  // missing any URL.
+  bool URLWordTableIsCurrent();
+
+  // Records the URLs url_words covers, as of now.
+  void RecordURLWordTableCoverage();
+
   // Migration -----------------------------------------------------------------
 
   // Makes sure the version is up-to-date, updating if necessary. If the
@@ -8,8 +8,11 @@
 #include "base/files/file_path.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/path_service.h"
+#include "base/strings/utf_string_conversions.h"
 #include "chrome/common/chrome_paths.h"
+#include "sql/connection.h"
 #include "sql/init_status.h"
+#include "sql/meta_table.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 namespace history {
@@ -46,4 +49,46 @@ TEST(HistoryDatabaseTest, DropBookmarks) {
   }
 }
 
+// Older builds can open the database, and URLs they add without indexing
+// their words are indexed when the database is next opened.
+TEST(HistoryDatabaseTest, RebuildStaleURLWordTable) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  const base::FilePath db_file = temp_dir.path().AppendASCII("History");
+
+  {
+    HistoryDatabase history_db;
+    ASSERT_EQ(sql::INIT_OK, history_db.Init(db_file));
+    URLRow row(GURL("http://www.google.com/"));
+    row.set_title(base::ASCIIToUTF16("Google Search"));
+    row.set_last_visit(base::Time::Now());
+    history_db.BeginTransaction();
+    ASSERT_TRUE(history_db.AddURL(row));
+    history_db.CommitTransaction();
+  }
+
+  {
+    // Add a URL as a build which does not know about url_words would.
+    sql::Connection db;
+    ASSERT_TRUE(db.Open(db_file));
+    sql::MetaTable meta_table;
+    ASSERT_TRUE(meta_table.Init(&db, 28, 16));
+    EXPECT_EQ(16, meta_table.GetCompatibleVersionNumber());
+    ASSERT_TRUE(db.Execute(
+        "INSERT INTO urls (url, title, visit_count, last_visit_time) "
+        "VALUES ('http://www.example.com/', 'Example Domain', 1, 1)"));
+  }
+
+  HistoryDatabase history_db;
+  ASSERT_EQ(sql::INIT_OK, history_db.Init(db_file));
+  URLRows results;
+  ASSERT_TRUE(history_db.GetTextMatches(base::ASCIIToUTF16("example"),
+                                        &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(GURL("http://www.example.com/"), results[0].url());
+  ASSERT_TRUE(history_db.GetTextMatches(base::ASCIIToUTF16("google"),
+                                        &results));
+  EXPECT_EQ(1U, results.size());
+}
+
 }  // namespace history
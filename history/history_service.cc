@@ -29,6 +29,7 @@
 #include "base/message_loop/message_loop.h"
 #include "base/path_service.h"
 #include "base/prefs/pref_service.h"
+#include "base/single_thread_task_runner.h"
 #include "base/thread_task_runner_handle.h"
 #include "base/threading/thread.h"
 #include "base/time/time.h"
@@ -73,6 +74,9 @@ namespace {
 
 static const char* kHistoryThreadName = "Chrome_HistoryThread";
 
+// The most page additions sent to the backend in one batch.
+const size_t kMaxAddPageBatchSize = 64;
+
 template<typename PODType> void DerefPODType(
     const base::Callback<void(PODType)>& callback, PODType* pod_value) {
   callback.Run(*pod_value);
@@ -84,12 +88,25 @@ void RunWithFaviconResults(
   callback.Run(*bitmap_results);
 }
 
+void RunWithFaviconResultsForURLs(
+    const FaviconService::FaviconResultsForURLsCallback& callback,
+    std::vector<std::vector<chrome::FaviconBitmapResult> >* bitmap_results) {
+  callback.Run(*bitmap_results);
+}
+
 void RunWithFaviconResult(
     const FaviconService::FaviconRawCallback& callback,
     chrome::FaviconBitmapResult* bitmap_result) {
   callback.Run(*bitmap_result);
 }
 
+void RunUnlessCanceled(
+    const base::CancelableTaskTracker::IsCanceledCallback& is_canceled,
+    const base::Closure& callback) {
+  if (!is_canceled.Run())
+    callback.Run();
+}
+
 // Extract history::URLRows into GURLs for VisitedLinkMaster.
 class URLIteratorFromURLRows
     : public visitedlink::VisitedLinkMaster::URLIterator {
@@ -293,6 +310,9 @@ void HistoryService::Cleanup() {
     return;
   }
 
+  // Don't drop the page additions which are still queued.
+  SendPendingAddPages();
+
   weak_ptr_factory_.InvalidateWeakPtrs();
 
   // Unload the backend.
@@ -444,7 +464,7 @@ HistoryService::Handle HistoryService::QuerySegmentUsageSince(
 }
 
 void HistoryService::FlushForTest(const base::Closure& flushed) {
-  thread_->message_loop_proxy()->PostTaskAndReply(
+  BackendTaskRunner()->PostTaskAndReply(
       FROM_HERE, base::Bind(&base::DoNothing), flushed);
 }
 
@@ -508,7 +528,31 @@ void HistoryService::AddPage(const history::HistoryAddPageArgs& add_page_args) {
     }
   }
 
-  ScheduleAndForget(PRIORITY_NORMAL, &HistoryBackend::AddPage, add_page_args);
+  // Bursts of additions, such as when restoring a session or loading the
+  // frames of a page, are sent to the backend together once the current task
+  // is done, so it can handle them as one batch.
+  LoadBackendIfNecessary();
+  if (pending_add_pages_.empty()) {
+    pending_add_pages_time_ = base::TimeTicks::Now();
+    base::MessageLoop::current()->PostTask(
+        FROM_HERE,
+        base::Bind(&HistoryService::SendPendingAddPages,
+                   weak_ptr_factory_.GetWeakPtr()));
+  }
+  pending_add_pages_.push_back(add_page_args);
+  if (pending_add_pages_.size() >= kMaxAddPageBatchSize)
+    SendPendingAddPages();
+}
+
+void HistoryService::SendPendingAddPages() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (pending_add_pages_.empty())
+    return;
+
+  std::vector<history::HistoryAddPageArgs> add_pages;
+  add_pages.swap(pending_add_pages_);
+  ScheduleAndForget(PRIORITY_NORMAL, &HistoryBackend::AddPages, add_pages,
+                    pending_add_pages_time_);
 }
 
 void HistoryService::AddPageNoVisitForBookmark(const GURL& url,
@@ -597,7 +641,7 @@ base::CancelableTaskTracker::TaskId HistoryService::GetFavicons(
   std::vector<chrome::FaviconBitmapResult>* results =
       new std::vector<chrome::FaviconBitmapResult>();
   return tracker->PostTaskAndReply(
-      thread_->message_loop_proxy().get(),
+      BackendTaskRunner().get(),
       FROM_HERE,
       base::Bind(&HistoryBackend::GetFavicons,
                  history_backend_.get(),
@@ -622,7 +666,7 @@ base::CancelableTaskTracker::TaskId HistoryService::GetFaviconsForURL(
   std::vector<chrome::FaviconBitmapResult>* results =
       new std::vector<chrome::FaviconBitmapResult>();
   return tracker->PostTaskAndReply(
-      thread_->message_loop_proxy().get(),
+      BackendTaskRunner().get(),
       FROM_HERE,
       base::Bind(&HistoryBackend::GetFaviconsForURL,
                  history_backend_.get(),
@@ -634,6 +678,33 @@ base::CancelableTaskTracker::TaskId HistoryService::GetFaviconsForURL(
       base::Bind(&RunWithFaviconResults, callback, base::Owned(results)));
 }
 
+base::CancelableTaskTracker::TaskId HistoryService::GetFaviconsForURLs(
+    const std::vector<GURL>& page_urls,
+    int icon_types,
+    int desired_size_in_dip,
+    const std::vector<ui::ScaleFactor>& desired_scale_factors,
+    const FaviconService::FaviconResultsForURLsCallback& callback,
+    base::CancelableTaskTracker* tracker) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  LoadBackendIfNecessary();
+
+  std::vector<std::vector<chrome::FaviconBitmapResult> >* results =
+      new std::vector<std::vector<chrome::FaviconBitmapResult> >();
+  return tracker->PostTaskAndReply(
+      BackendTaskRunner().get(),
+      FROM_HERE,
+      base::Bind(&HistoryBackend::GetFaviconsForURLs,
+                 history_backend_.get(),
+                 page_urls,
+                 icon_types,
+                 desired_size_in_dip,
+                 desired_scale_factors,
+                 results),
+      base::Bind(&RunWithFaviconResultsForURLs,
+                 callback,
+                 base::Owned(results)));
+}
+
 base::CancelableTaskTracker::TaskId HistoryService::GetLargestFaviconForURL(
     const GURL& page_url,
     const std::vector<int>& icon_types,
@@ -645,7 +716,7 @@ base::CancelableTaskTracker::TaskId HistoryService::GetLargestFaviconForURL(
 
   chrome::FaviconBitmapResult* result = new chrome::FaviconBitmapResult();
   return tracker->PostTaskAndReply(
-      thread_->message_loop_proxy().get(),
+      BackendTaskRunner().get(),
       FROM_HERE,
       base::Bind(&HistoryBackend::GetLargestFaviconForURL,
                  history_backend_.get(),
@@ -668,7 +739,7 @@ base::CancelableTaskTracker::TaskId HistoryService::GetFaviconForID(
   std::vector<chrome::FaviconBitmapResult>* results =
       new std::vector<chrome::FaviconBitmapResult>();
   return tracker->PostTaskAndReply(
-      thread_->message_loop_proxy().get(),
+      BackendTaskRunner().get(),
       FROM_HERE,
       base::Bind(&HistoryBackend::GetFaviconForID,
                  history_backend_.get(),
@@ -694,7 +765,7 @@ HistoryService::UpdateFaviconMappingsAndFetch(
   std::vector<chrome::FaviconBitmapResult>* results =
       new std::vector<chrome::FaviconBitmapResult>();
   return tracker->PostTaskAndReply(
-      thread_->message_loop_proxy().get(),
+      BackendTaskRunner().get(),
       FROM_HERE,
       base::Bind(&HistoryBackend::UpdateFaviconMappingsAndFetch,
                  history_backend_.get(),
@@ -774,7 +845,7 @@ void HistoryService::CreateDownload(
   DCHECK(thread_checker_.CalledOnValidThread());
   LoadBackendIfNecessary();
   bool* success = new bool(false);
-  thread_->message_loop_proxy()->PostTaskAndReply(
+  BackendTaskRunner()->PostTaskAndReply(
       FROM_HERE,
       base::Bind(&HistoryBackend::CreateDownload,
                  history_backend_.get(),
@@ -789,7 +860,7 @@ void HistoryService::GetNextDownloadId(
   DCHECK(thread_checker_.CalledOnValidThread());
   LoadBackendIfNecessary();
   uint32* next_id = new uint32(content::DownloadItem::kInvalidId);
-  thread_->message_loop_proxy()->PostTaskAndReply(
+  BackendTaskRunner()->PostTaskAndReply(
       FROM_HERE,
       base::Bind(&HistoryBackend::GetNextDownloadId,
                  history_backend_.get(),
@@ -811,7 +882,7 @@ void HistoryService::QueryDownloads(
   // base::Passed(&scoped_rows) nullifies |scoped_rows|, and compilers do not
   // guarantee that the first Bind's arguments are evaluated before the second
   // Bind's arguments.
-  thread_->message_loop_proxy()->PostTaskAndReply(
+  BackendTaskRunner()->PostTaskAndReply(
       FROM_HERE,
       base::Bind(&HistoryBackend::QueryDownloads, history_backend_.get(), rows),
       base::Bind(callback, base::Passed(&scoped_rows)));
@@ -996,7 +1067,14 @@ void HistoryService::ScheduleTask(SchedulePriority priority,
   CHECK(thread_);
   CHECK(thread_->message_loop());
   // TODO(brettw): Do prioritization.
-  thread_->message_loop()->PostTask(FROM_HERE, task);
+  BackendTaskRunner()->PostTask(FROM_HERE, task);
+}
+
+scoped_refptr<base::SingleThreadTaskRunner>
+HistoryService::BackendTaskRunner() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  SendPendingAddPages();
+  return thread_->message_loop_proxy();
 }
 
 // static
@@ -1119,14 +1197,24 @@ void HistoryService::ExpireHistoryBetween(
   DCHECK(thread_);
   DCHECK(thread_checker_.CalledOnValidThread());
   DCHECK(history_backend_.get());
-  tracker->PostTaskAndReply(thread_->message_loop_proxy().get(),
-                            FROM_HERE,
-                            base::Bind(&HistoryBackend::ExpireHistoryBetween,
-                                       history_backend_,
-                                       restrict_urls,
-                                       begin_time,
-                                       end_time),
-                            callback);
+
+  // The backend may spread the deletion over several tasks, so it posts the
+  // reply itself once done.
+  base::CancelableTaskTracker::IsCanceledCallback is_canceled;
+  tracker->NewTrackedTaskId(&is_canceled);
+  base::Closure reply = base::Bind(
+      base::IgnoreResult(&base::TaskRunner::PostTask),
+      base::ThreadTaskRunnerHandle::Get(),
+      FROM_HERE,
+      base::Bind(&RunUnlessCanceled, is_canceled, callback));
+  BackendTaskRunner()->PostTask(
+      FROM_HERE,
+      base::Bind(&HistoryBackend::ExpireHistoryBetweenInSlices,
+                 history_backend_,
+                 restrict_urls,
+                 begin_time,
+                 end_time,
+                 reply));
 }
 
 void HistoryService::ExpireHistory(
@@ -1137,7 +1225,7 @@ void HistoryService::ExpireHistory(
   DCHECK(thread_checker_.CalledOnValidThread());
   DCHECK(history_backend_.get());
   tracker->PostTaskAndReply(
-      thread_->message_loop_proxy().get(),
+      BackendTaskRunner().get(),
       FROM_HERE,
       base::Bind(&HistoryBackend::ExpireHistory, history_backend_, expire_list),
       callback);
@@ -52,6 +52,7 @@ struct HistoryURLProviderParams;
 
 namespace base {
 class FilePath;
+class SingleThreadTaskRunner;
 class Thread;
 }
 
@@ -377,7 +378,8 @@ class HistoryService : public CancelableRequestProvider,
   // the expiration is complete. You may use null Time values to do an
   // unbounded delete in either direction.
   // If |restrict_urls| is not empty, only visits to the URLs in this set are
-  // removed.
+  // removed. Large deletions are done a slice at a time, so requests made
+  // before |callback| runs may see part of the range deleted.
   void ExpireHistoryBetween(const std::set<GURL>& restrict_urls,
                             base::Time begin_time,
                             base::Time end_time,
@@ -690,6 +692,17 @@ class HistoryService : public CancelableRequestProvider,
       const FaviconService::FaviconResultsCallback& callback,
       base::CancelableTaskTracker* tracker);
 
+  // Used by the FaviconService to get the favicons of many pages at once. The
+  // results for each of |page_urls| are those GetFaviconsForURL() would give,
+  // in the same order, and are all passed to |callback| together.
+  base::CancelableTaskTracker::TaskId GetFaviconsForURLs(
+      const std::vector<GURL>& page_urls,
+      int icon_types,
+      int desired_size_in_dip,
+      const std::vector<ui::ScaleFactor>& desired_scale_factors,
+      const FaviconService::FaviconResultsForURLsCallback& callback,
+      base::CancelableTaskTracker* tracker);
+
   // Used by FaviconService to find the first favicon bitmap whose width and
   // height are greater than that of |minimum_size_in_pixels|. This searches
   // for icons by IconType. Each element of |icon_types| is a bitmask of
@@ -813,9 +826,18 @@ class HistoryService : public CancelableRequestProvider,
   void NotifyProfileError(int backend_id, sql::InitStatus init_status);
 
   // Call to schedule a given task for running on the history thread with the
-  // specified priority. The task will have ownership taken.
+  // specified priority. The task will have ownership taken. Any queued page
+  // additions are sent first, so the backend sees requests in order.
   void ScheduleTask(SchedulePriority priority, const base::Closure& task);
 
+  // Sends the page additions queued by AddPage() to the backend as one batch.
+  void SendPendingAddPages();
+
+  // Returns the history thread's task runner, after sending it the page
+  // additions still queued by AddPage(). Every task for the backend must be
+  // posted through this, so that it runs after the pages added before it.
+  scoped_refptr<base::SingleThreadTaskRunner> BackendTaskRunner();
+
   // Schedule ------------------------------------------------------------------
   //
   // Functions for scheduling operations on the history thread that have a
@@ -1053,6 +1075,11 @@ class HistoryService : public CancelableRequestProvider,
   // is not NULL.
   int current_backend_id_;
 
+  // Page additions waiting to be sent to the backend as one batch, and when
+  // the first of them was queued. See AddPage().
+  std::vector<history::HistoryAddPageArgs> pending_add_pages_;
+  base::TimeTicks pending_add_pages_time_;
+
   // Cached values from Init(), used whenever we need to reload the backend.
   base::FilePath history_dir_;
   BookmarkService* bookmark_service_;
@@ -32,6 +32,7 @@
 #include "base/files/file_path.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/logging.h"
+#include "base/memory/ref_counted_memory.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/memory/scoped_vector.h"
 #include "base/message_loop/message_loop.h"
@@ -70,6 +71,7 @@
 #include "testing/gtest/include/gtest/gtest.h"
 #include "third_party/skia/include/core/SkBitmap.h"
 #include "ui/gfx/codec/jpeg_codec.h"
+#include "ui/gfx/size.h"
 
 using base::Time;
 using base::TimeDelta;
@@ -879,6 +881,15 @@ static void* MakeFakeHost(int id) {
   return host;
 }
 
+// Saves the favicon bitmap |results| to |saved_results| and quits the current
+// message loop.
+static void SaveFaviconResultsAndQuit(
+    std::vector<chrome::FaviconBitmapResult>* saved_results,
+    const std::vector<chrome::FaviconBitmapResult>& results) {
+  *saved_results = results;
+  base::MessageLoop::current()->Quit();
+}
+
 class HistoryTest : public testing::Test {
  public:
   HistoryTest()
@@ -1131,6 +1142,49 @@ TEST_F(HistoryTest, AddRedirect) {
   EXPECT_EQ(second_visit, query_url_visits_[0].referring_visit);
 }
 
+// Favicon requests made right after AddPage() must see the page and its
+// redirects, although the addition is still queued when they are made.
+TEST_F(HistoryTest, UpdateFaviconMappingsRightAfterAddPage) {
+  ASSERT_TRUE(history_service_.get());
+  const GURL icon_url("http://www.google.com/favicon.ico");
+  std::vector<chrome::FaviconBitmapData> favicon_bitmap_data(1);
+  favicon_bitmap_data[0].bitmap_data =
+      new base::RefCountedBytes(std::vector<unsigned char>(1, 'a'));
+  favicon_bitmap_data[0].pixel_size = gfx::Size(16, 16);
+  favicon_bitmap_data[0].icon_url = icon_url;
+  history_service_->SetFavicons(GURL("http://www.google.com/"),
+                                chrome::FAVICON, favicon_bitmap_data);
+
+  history::RedirectList redirects;
+  redirects.push_back(GURL("http://google.com/"));
+  redirects.push_back(GURL("http://www.google.com/search"));
+  history_service_->AddPage(
+      redirects.back(), base::Time::Now(), MakeFakeHost(1), 0, GURL(),
+      redirects, content::PAGE_TRANSITION_LINK, history::SOURCE_BROWSED,
+      false);
+
+  // Mapping the icon to the page also maps it to the pages which redirected
+  // to it, which the backend only knows of once it has added the page.
+  const std::vector<ui::ScaleFactor> scale_factors(1, ui::SCALE_FACTOR_100P);
+  base::CancelableTaskTracker tracker;
+  std::vector<chrome::FaviconBitmapResult> results;
+  history_service_->UpdateFaviconMappingsAndFetch(
+      redirects.back(), std::vector<GURL>(1, icon_url), chrome::FAVICON, 16,
+      scale_factors, base::Bind(&SaveFaviconResultsAndQuit, &results),
+      &tracker);
+  base::MessageLoop::current()->Run();
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(icon_url, results[0].icon_url);
+
+  results.clear();
+  history_service_->GetFaviconsForURL(
+      redirects.front(), chrome::FAVICON, 16, scale_factors,
+      base::Bind(&SaveFaviconResultsAndQuit, &results), &tracker);
+  base::MessageLoop::current()->Run();
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(icon_url, results[0].icon_url);
+}
+
 TEST_F(HistoryTest, MakeIntranetURLsTyped) {
   ASSERT_TRUE(history_service_.get());
 
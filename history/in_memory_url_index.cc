@@ -6,6 +6,7 @@
 
 #include "base/debug/trace_event.h"
 #include "base/file_util.h"
+#include "base/metrics/histogram.h"
 #include "base/strings/utf_string_conversions.h"
 #include "chrome/browser/bookmarks/bookmark_model.h"
 #include "chrome/browser/bookmarks/bookmark_model_factory.h"
@@ -58,35 +59,44 @@ InMemoryURLIndex::SaveCacheObserver::~SaveCacheObserver() {}
 
 InMemoryURLIndex::RebuildPrivateDataFromHistoryDBTask::
     RebuildPrivateDataFromHistoryDBTask(
-        InMemoryURLIndex* index,
+        const base::WeakPtr<InMemoryURLIndex>& index,
         const std::string& languages,
         const std::set<std::string>& scheme_whitelist)
     : index_(index),
       languages_(languages),
-      scheme_whitelist_(scheme_whitelist),
-      succeeded_(false) {
+      scheme_whitelist_(scheme_whitelist) {
 }
 
 bool InMemoryURLIndex::RebuildPrivateDataFromHistoryDBTask::RunOnDBThread(
     HistoryBackend* backend,
     HistoryDatabase* db) {
-  data_ = URLIndexPrivateData::RebuildFromHistory(db, languages_,
-                                                  scheme_whitelist_);
-  succeeded_ = data_.get() && !data_->Empty();
-  if (!succeeded_ && data_.get())
-    data_->Clear();
+  URLIndexPrivateData::StartRebuildFromHistory(
+      db, languages_, scheme_whitelist_,
+      base::Bind(&RebuildPrivateDataFromHistoryDBTask::DoneRebuilding, index_));
   return true;
 }
 
 void InMemoryURLIndex::RebuildPrivateDataFromHistoryDBTask::
     DoneRunOnMainThread() {
-  index_->DoneRebuidingPrivateDataFromHistoryDB(succeeded_, data_);
 }
 
 InMemoryURLIndex::RebuildPrivateDataFromHistoryDBTask::
     ~RebuildPrivateDataFromHistoryDBTask() {
 }
 
+// static
+void InMemoryURLIndex::RebuildPrivateDataFromHistoryDBTask::DoneRebuilding(
+    const base::WeakPtr<InMemoryURLIndex>& index,
+    scoped_refptr<URLIndexPrivateData> data) {
+  const bool succeeded = data.get() && !data->Empty();
+  if (!succeeded && data.get())
+    data->Clear();
+  content::BrowserThread::PostTask(
+      content::BrowserThread::UI, FROM_HERE,
+      base::Bind(&InMemoryURLIndex::DoneRebuidingPrivateDataFromHistoryDB,
+                 index, succeeded, data));
+}
+
 // InMemoryURLIndex ------------------------------------------------------------
 
 InMemoryURLIndex::InMemoryURLIndex(Profile* profile,
@@ -255,10 +265,15 @@ void InMemoryURLIndex::PostRestoreFromCacheFileTask() {
 void InMemoryURLIndex::OnCacheLoadDone(
     scoped_refptr<URLIndexPrivateData> private_data) {
   if (private_data.get() && !private_data->Empty()) {
+    // The index was built on the file thread; adopting it is all that is
+    // left for the UI thread, which this records apart from the restore.
+    base::TimeTicks beginning_time = base::TimeTicks::Now();
     private_data_ = private_data;
     restored_ = true;
     if (restore_cache_observer_)
       restore_cache_observer_->OnCacheRestoreFinished(true);
+    UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexRestoreUIThreadTime",
+                        base::TimeTicks::Now() - beginning_time);
   } else if (profile_) {
     // When unable to restore from the cache file delete the cache file, if
     // it exists, and then rebuild from the history database if it's available,
@@ -287,7 +302,7 @@ void InMemoryURLIndex::ScheduleRebuildFromHistory() {
                                            Profile::EXPLICIT_ACCESS);
   service->ScheduleDBTask(
       new InMemoryURLIndex::RebuildPrivateDataFromHistoryDBTask(
-          this, languages_, scheme_whitelist_),
+          AsWeakPtr(), languages_, scheme_whitelist_),
       &cache_reader_consumer_);
 }
 
@@ -295,6 +310,8 @@ void InMemoryURLIndex::DoneRebuidingPrivateDataFromHistoryDB(
     bool succeeded,
     scoped_refptr<URLIndexPrivateData> private_data) {
   DCHECK(content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
+  if (shutdown_)
+    return;
   if (succeeded) {
     private_data_ = private_data;
     PostSaveToCacheFileTask();  // Cache the newly rebuilt index.
@@ -320,13 +337,15 @@ void InMemoryURLIndex::PostSaveToCacheFileTask() {
   base::FilePath path;
   if (!GetCacheFilePath(&path))
     return;
-  // If there is anything in our private data then make a copy of it and tell
-  // it to save itself to a file.
+  // If there is anything in our private data then take a snapshot of it and
+  // tell the snapshot to save itself to a file. The snapshot shares storage
+  // with |private_data_|, so updates made while the save is in progress copy
+  // only what they touch.
   if (private_data_.get() && !private_data_->Empty()) {
-    // Note that ownership of the copy of our private data is passed to the
+    // Note that ownership of the snapshot of our private data is passed to the
     // completion closure below.
     scoped_refptr<URLIndexPrivateData> private_data_copy =
-        private_data_->Duplicate();
+        private_data_->Snapshot();
     content::BrowserThread::PostTaskAndReplyWithResult<bool>(
         content::BrowserThread::FILE, FROM_HERE,
         base::Bind(&URLIndexPrivateData::WritePrivateDataToCacheFileTask,
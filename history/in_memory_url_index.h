@@ -154,10 +154,13 @@ class InMemoryURLIndex : public content::NotificationObserver,
   class RebuildPrivateDataFromHistoryDBTask : public HistoryDBTask {
    public:
     explicit RebuildPrivateDataFromHistoryDBTask(
-        InMemoryURLIndex* index,
+        const base::WeakPtr<InMemoryURLIndex>& index,
         const std::string& languages,
         const std::set<std::string>& scheme_whitelist);
 
+    // Reads the history database and starts breaking the rows into words on
+    // the blocking pool. The rebuild finishes on the DB thread after this has
+    // returned, in DoneRebuilding().
     virtual bool RunOnDBThread(HistoryBackend* backend,
                                history::HistoryDatabase* db) OVERRIDE;
     virtual void DoneRunOnMainThread() OVERRIDE;
@@ -165,11 +168,15 @@ class InMemoryURLIndex : public content::NotificationObserver,
    private:
     virtual ~RebuildPrivateDataFromHistoryDBTask();
 
-    InMemoryURLIndex* index_;  // Call back to this index at completion.
+    // Hands the rebuilt |data| to |index| on the main thread. Runs on the DB
+    // thread.
+    static void DoneRebuilding(const base::WeakPtr<InMemoryURLIndex>& index,
+                               scoped_refptr<URLIndexPrivateData> data);
+
+    // Call back to this index at completion.
+    base::WeakPtr<InMemoryURLIndex> index_;
     std::string languages_;  // Languages for word-breaking.
     std::set<std::string> scheme_whitelist_;  // Schemes to be indexed.
-    bool succeeded_;  // Indicates if the rebuild was successful.
-    scoped_refptr<URLIndexPrivateData> data_;  // The rebuilt private data.
 
     DISALLOW_COPY_AND_ASSIGN(RebuildPrivateDataFromHistoryDBTask);
   };
@@ -5,12 +5,12 @@
 #ifndef CHROME_BROWSER_HISTORY_IN_MEMORY_URL_INDEX_TYPES_H_
 #define CHROME_BROWSER_HISTORY_IN_MEMORY_URL_INDEX_TYPES_H_
 
-#include <map>
 #include <set>
 #include <vector>
 
 #include "base/strings/string16.h"
 #include "chrome/browser/autocomplete/history_provider_util.h"
+#include "chrome/browser/history/copy_on_write_containers.h"
 #include "chrome/browser/history/history_types.h"
 #include "url/gurl.h"
 
@@ -135,22 +135,28 @@ Char16Set Char16SetFromString16(const base::string16& uni_word);
 
 // Support for InMemoryURLIndex Private Data -----------------------------------
 
+// The index containers below are copy-on-write so that a snapshot of the
+// index can be taken cheaply; see copy_on_write_containers.h.
+
+// A list of all of the words we have indexed.
+typedef CopyOnWriteVector<base::string16> WordList;
+
 // An index into a list of all of the words we have indexed.
 typedef size_t WordID;
 
 // A map allowing a WordID to be determined given a word.
-typedef std::map<base::string16, WordID> WordMap;
+typedef CopyOnWriteMap<base::string16, WordID> WordMap;
 
 // A map from character to the word_ids of words containing that character.
 typedef std::set<WordID> WordIDSet;  // An index into the WordList.
-typedef std::map<base::char16, WordIDSet> CharWordIDMap;
+typedef CopyOnWriteMap<base::char16, WordIDSet> CharWordIDMap;
 
 // A map from word (by word_id) to history items containing that word.
 typedef history::URLID HistoryID;
 typedef std::set<HistoryID> HistoryIDSet;
 typedef std::vector<HistoryID> HistoryIDVector;
-typedef std::map<WordID, HistoryIDSet> WordIDHistoryMap;
-typedef std::map<HistoryID, WordIDSet> HistoryIDWordMap;
+typedef CopyOnWriteMap<WordID, HistoryIDSet> WordIDHistoryMap;
+typedef CopyOnWriteMap<HistoryID, WordIDSet> HistoryIDWordMap;
 
 
 // Information used in scoring a particular URL.
@@ -170,7 +176,7 @@ struct HistoryInfoMapValue {
 };
 
 // A map from history_id to the history's URL and title.
-typedef std::map<HistoryID, HistoryInfoMapValue> HistoryInfoMap;
+typedef CopyOnWriteMap<HistoryID, HistoryInfoMapValue> HistoryInfoMap;
 
 // A map from history_id to URL and page title word start metrics.
 struct RowWordStarts {
@@ -183,7 +189,7 @@ struct RowWordStarts {
   WordStarts url_word_starts_;
   WordStarts title_word_starts_;
 };
-typedef std::map<HistoryID, RowWordStarts> WordStartsMap;
+typedef CopyOnWriteMap<HistoryID, RowWordStarts> WordStartsMap;
 
 }  // namespace history
 
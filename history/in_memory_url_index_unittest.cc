@@ -6,13 +6,19 @@
 #include <fstream>
 
 #include "base/auto_reset.h"
+#include "base/bind.h"
+#include "base/bind_helpers.h"
+#include "base/command_line.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/message_loop/message_loop.h"
 #include "base/path_service.h"
+#include "base/run_loop.h"
 #include "base/strings/string16.h"
+#include "base/strings/string_split.h"
 #include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "chrome/browser/autocomplete/autocomplete_provider.h"
 #include "chrome/browser/bookmarks/bookmark_test_helpers.h"
@@ -33,6 +39,7 @@
 #include "content/public/test/test_browser_thread.h"
 #include "sql/transaction.h"
 #include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
 
 using base::ASCIIToUTF16;
 using content::BrowserThread;
@@ -90,8 +97,7 @@ class InMemoryURLIndexTest : public testing::Test {
 
   // Validates that the given |term| is contained in |cache| and that it is
   // marked as in-use.
-  void CheckTerm(const URLIndexPrivateData::SearchTermCacheMap& cache,
-                 base::string16 term) const;
+  void CheckTerm(const SearchTermCache& cache, base::string16 term) const;
 
   // Pass-through function to simplify our friendship with HistoryService.
   sql::Connection& GetDB();
@@ -282,15 +288,12 @@ base::FilePath::StringType InMemoryURLIndexTest::TestDBName() const {
     return FILE_PATH_LITERAL("url_history_provider_test.db.txt");
 }
 
-void InMemoryURLIndexTest::CheckTerm(
-    const URLIndexPrivateData::SearchTermCacheMap& cache,
-    base::string16 term) const {
-  URLIndexPrivateData::SearchTermCacheMap::const_iterator cache_iter(
-      cache.find(term));
-  ASSERT_TRUE(cache.end() != cache_iter)
+void InMemoryURLIndexTest::CheckTerm(const SearchTermCache& cache,
+                                     base::string16 term) const {
+  const SearchTermCache::Item* cache_item = cache.Find(term);
+  ASSERT_TRUE(cache_item != NULL)
       << "Cache does not contain '" << term << "' but should.";
-  URLIndexPrivateData::SearchTermCacheItem cache_item = cache_iter->second;
-  EXPECT_TRUE(cache_item.used_)
+  EXPECT_TRUE(cache_item->used_)
       << "Cache item '" << term << "' should be marked as being in use.";
 }
 
@@ -758,11 +761,7 @@ TEST_F(InMemoryURLIndexTest, TypedCharacterCaching) {
   // Verify that match results for previously typed characters are retained
   // (in the term_char_word_set_cache_) and reused, if possible, in future
   // autocompletes.
-  typedef URLIndexPrivateData::SearchTermCacheMap::iterator CacheIter;
-  typedef URLIndexPrivateData::SearchTermCacheItem CacheItem;
-
-  URLIndexPrivateData::SearchTermCacheMap& cache(
-      GetPrivateData()->search_term_cache_);
+  const SearchTermCache& cache(GetPrivateData()->search_term_cache_);
 
   // The cache should be empty at this point.
   EXPECT_EQ(0U, cache.size());
@@ -813,6 +812,53 @@ TEST_F(InMemoryURLIndexTest, TypedCharacterCaching) {
   CheckTerm(cache, ASCIIToUTF16("rec"));
 }
 
+TEST_F(InMemoryURLIndexTest, TypedCharacterCacheUpdates) {
+  const SearchTermCache& cache(GetPrivateData()->search_term_cache_);
+
+  // Typing "mort" one character at a time keeps each prefix cached, as each
+  // is used to narrow the search for the next.
+  url_index_->HistoryItemsForTerms(ASCIIToUTF16("mo"), base::string16::npos);
+  url_index_->HistoryItemsForTerms(ASCIIToUTF16("mor"), base::string16::npos);
+  url_index_->HistoryItemsForTerms(ASCIIToUTF16("mort"), base::string16::npos);
+  ASSERT_EQ(3U, cache.size());
+  CheckTerm(cache, ASCIIToUTF16("mo"));
+  CheckTerm(cache, ASCIIToUTF16("mor"));
+  CheckTerm(cache, ASCIIToUTF16("mort"));
+
+  // So deleting the last character finds the results for "mor" cached.
+  const size_t mor_matches = url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("mor"), base::string16::npos).size();
+  ASSERT_EQ(2U, cache.size());
+  CheckTerm(cache, ASCIIToUTF16("mor"));
+
+  // Adding a row invalidates only the terms found within its words.
+  url_index_->HistoryItemsForTerms(ASCIIToUTF16("mor reco"),
+                                   base::string16::npos);
+  ASSERT_EQ(2U, cache.size());
+  URLRow new_row(GURL("http://www.recorded.com/"), 87654321);
+  new_row.set_last_visit(base::Time::Now());
+  EXPECT_TRUE(UpdateURL(new_row));
+  EXPECT_EQ(1U, cache.size());
+  CheckTerm(cache, ASCIIToUTF16("mor"));
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("reco")) == NULL);
+
+  // A change to a row which leaves its words alone invalidates nothing, and
+  // the cached results are still correct.
+  new_row.set_visit_count(5);
+  EXPECT_TRUE(UpdateURL(new_row));
+  EXPECT_EQ(1U, cache.size());
+  EXPECT_EQ(mor_matches, url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("mor"), base::string16::npos).size());
+
+  // Deleting the row invalidates the terms within its words again.
+  url_index_->HistoryItemsForTerms(ASCIIToUTF16("mor recorded"),
+                                   base::string16::npos);
+  ASSERT_EQ(2U, cache.size());
+  EXPECT_TRUE(DeleteURL(new_row.url()));
+  EXPECT_EQ(1U, cache.size());
+  CheckTerm(cache, ASCIIToUTF16("mor"));
+}
+
 TEST_F(InMemoryURLIndexTest, AddNewRows) {
   // Verify that the row we're going to add does not already exist.
   URLID new_row_id = 87654321;
@@ -874,6 +920,246 @@ TEST_F(InMemoryURLIndexTest, ExpireRow) {
       ASCIIToUTF16("DrudgeReport"), base::string16::npos).empty());
 }
 
+TEST_F(InMemoryURLIndexTest, SnapshotIsolatedFromUpdates) {
+  const base::string16 deleted_terms = ASCIIToUTF16("DrudgeReport");
+  const base::string16 original_title_terms =
+      ASCIIToUTF16("lebronomics could high taxes influence");
+  const base::string16 new_title_terms =
+      ASCIIToUTF16("does eat oats little lambs ivy");
+  const base::string16 added_terms = ASCIIToUTF16("brokeandalone");
+
+  ScoredHistoryMatches matches =
+      url_index_->HistoryItemsForTerms(deleted_terms, base::string16::npos);
+  ASSERT_EQ(1U, matches.size());
+  const GURL deleted_url(matches[0].url_info.url());
+  matches = url_index_->HistoryItemsForTerms(original_title_terms,
+                                             base::string16::npos);
+  ASSERT_EQ(1U, matches.size());
+  URLRow retitled_row(matches[0].url_info);
+
+  URLIndexPrivateData* private_data = GetPrivateData();
+  scoped_refptr<URLIndexPrivateData> snapshot(private_data->Snapshot());
+  ExpectPrivateDataEqual(*private_data, *snapshot.get());
+  const size_t snapshot_item_count = snapshot->history_info_map_.size();
+  const size_t snapshot_word_count = snapshot->word_map_.size();
+
+  // Delete one row, retitle another and add a third to the live index.
+  EXPECT_TRUE(DeleteURL(deleted_url));
+  retitled_row.set_title(
+      ASCIIToUTF16("Does eat oats and little lambs eat ivy"));
+  EXPECT_TRUE(UpdateURL(retitled_row));
+  URLRow new_row(GURL("http://www.brokeandaloneinmanitoba.com/"), 87654321);
+  new_row.set_last_visit(base::Time::Now());
+  EXPECT_TRUE(UpdateURL(new_row));
+
+  EXPECT_TRUE(url_index_->HistoryItemsForTerms(
+      deleted_terms, base::string16::npos).empty());
+  EXPECT_TRUE(url_index_->HistoryItemsForTerms(
+      original_title_terms, base::string16::npos).empty());
+  EXPECT_EQ(1U, url_index_->HistoryItemsForTerms(
+      new_title_terms, base::string16::npos).size());
+  EXPECT_EQ(1U, url_index_->HistoryItemsForTerms(
+      added_terms, base::string16::npos).size());
+
+  // The snapshot still sees the index as it was when it was taken.
+  EXPECT_EQ(snapshot_item_count, snapshot->history_info_map_.size());
+  EXPECT_EQ(snapshot_word_count, snapshot->word_map_.size());
+  EXPECT_EQ(1U, snapshot->HistoryItemsForTerms(
+      deleted_terms, base::string16::npos, url_index_->languages_,
+      NULL).size());
+  matches = snapshot->HistoryItemsForTerms(
+      original_title_terms, base::string16::npos, url_index_->languages_,
+      NULL);
+  ASSERT_EQ(1U, matches.size());
+  EXPECT_EQ(ASCIIToUTF16(
+      "LeBronomics: Could High Taxes Influence James' Team Decision?"),
+      matches[0].url_info.title());
+  EXPECT_TRUE(snapshot->HistoryItemsForTerms(
+      new_title_terms, base::string16::npos, url_index_->languages_,
+      NULL).empty());
+  EXPECT_TRUE(snapshot->HistoryItemsForTerms(
+      added_terms, base::string16::npos, url_index_->languages_,
+      NULL).empty());
+
+  // Clearing the live index leaves the snapshot intact.
+  ClearPrivateData();
+  ExpectPrivateDataEmpty(*private_data);
+  ExpectPrivateDataNotEmpty(*snapshot.get());
+}
+
+namespace {
+
+// Returns |count| synthetic history rows whose URLs and titles share words to
+// varying degrees, as those in a large history do.
+std::vector<URLRow> SyntheticHistoryRows(size_t count) {
+  std::vector<URLRow> rows;
+  const base::Time now = base::Time::Now();
+  for (int i = 0; i < static_cast<int>(count); ++i) {
+    URLRow row(GURL(base::StringPrintf(
+        "http://www.site%d.com/section%d/page%d.html", i % 997, i % 31, i)),
+        i + 1);
+    row.set_title(ASCIIToUTF16(base::StringPrintf(
+        "Article %d about topic%d and subject%d", i, i % 101, i % 13)));
+    row.set_visit_count(i % 7 + 1);
+    row.set_typed_count(i % 3);
+    row.set_last_visit(now - base::TimeDelta::FromHours(i % 1000));
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+}  // namespace
+
+TEST_F(InMemoryURLIndexTest, ParallelRebuildMatchesSerial) {
+  std::vector<URLRow> rows = SyntheticHistoryRows(5500);
+  // A row which must be skipped, in the middle of a shard.
+  rows[2500] = URLRow(GURL("data:text/plain,skipped"), rows[2500].id());
+
+  scoped_refptr<URLIndexPrivateData> serial_data(new URLIndexPrivateData);
+  for (std::vector<URLRow>::const_iterator iter = rows.begin();
+       iter != rows.end(); ++iter) {
+    serial_data->IndexRow(history_database_, NULL, *iter,
+                          url_index_->languages_, scheme_whitelist());
+  }
+  EXPECT_EQ(rows.size() - 1, serial_data->history_info_map_.size());
+
+  const size_t kShardCounts[] = {1, 2, 3, 5};
+  for (size_t i = 0; i < arraysize(kShardCounts); ++i) {
+    SCOPED_TRACE(kShardCounts[i]);
+    scoped_refptr<URLIndexPrivateData> sharded_data(new URLIndexPrivateData);
+    std::vector<URLRow> shard_rows(rows);
+    base::RunLoop run_loop;
+    sharded_data->IndexRows(&shard_rows, url_index_->languages_,
+                            scheme_whitelist(), kShardCounts[i],
+                            BrowserThread::GetBlockingPool(),
+                            run_loop.QuitClosure());
+    run_loop.Run();
+    // WordIDs, and so every map keyed by them, must match the serial build.
+    ExpectPrivateDataEqual(*serial_data.get(), *sharded_data.get());
+    EXPECT_TRUE(sharded_data->available_words_.empty());
+  }
+}
+
+// Measures how a rebuild of a large history scales with the number of shards
+// the rows are broken into words in.
+TEST_F(InMemoryURLIndexTest, DISABLED_RebuildBenchmark) {
+  const std::vector<URLRow> rows = SyntheticHistoryRows(100000);
+  const size_t kShardCounts[] = {1, 2, 4, 8};
+  for (size_t i = 0; i < arraysize(kShardCounts); ++i) {
+    scoped_refptr<URLIndexPrivateData> data(new URLIndexPrivateData);
+    std::vector<URLRow> shard_rows(rows);
+    base::RunLoop run_loop;
+    const base::TimeTicks start = base::TimeTicks::Now();
+    data->IndexRows(&shard_rows, url_index_->languages_, scheme_whitelist(),
+                    kShardCounts[i], BrowserThread::GetBlockingPool(),
+                    run_loop.QuitClosure());
+    run_loop.Run();
+    perf_test::PrintResult(
+        "url_index_rebuild", "",
+        base::StringPrintf("100000_rows_%d_shards",
+                           static_cast<int>(kShardCounts[i])),
+        (base::TimeTicks::Now() - start).InMillisecondsF(), "ms", true);
+    EXPECT_EQ(rows.size(), data->history_info_map_.size());
+  }
+}
+
+// Replays omnibox input one keystroke at a time against an index of 50000
+// rows and reports the median and 99th percentile latency of
+// HistoryItemsForTerms(). The inputs are read one per line from the file
+// named by --omnibox-replay-file if given, and are otherwise a built-in
+// sample.
+TEST_F(InMemoryURLIndexTest, DISABLED_HistoryItemsForTermsReplay) {
+  const size_t kRowCount = 50000;
+  const std::vector<URLRow> rows = SyntheticHistoryRows(kRowCount);
+  scoped_refptr<URLIndexPrivateData> data(new URLIndexPrivateData);
+  std::vector<URLRow> index_rows(rows);
+  data->IndexRows(&index_rows, url_index_->languages_, scheme_whitelist(), 1,
+                  NULL, base::Bind(&base::DoNothing));
+  const base::Time now = base::Time::Now();
+  for (std::vector<URLRow>::const_iterator iter = rows.begin();
+       iter != rows.end(); ++iter) {
+    VisitVector visits;
+    for (int i = 0; i < iter->visit_count(); ++i) {
+      visits.push_back(VisitRow(
+          iter->id(),
+          now - base::TimeDelta::FromDays(i * static_cast<int>(iter->id() % 9)),
+          0, (i < iter->typed_count()) ? content::PAGE_TRANSITION_TYPED :
+              content::PAGE_TRANSITION_LINK, 0));
+    }
+    data->UpdateRecentVisits(iter->id(), visits);
+  }
+
+  std::vector<std::string> inputs;
+  const base::FilePath replay_file = CommandLine::ForCurrentProcess()->
+      GetSwitchValuePath("omnibox-replay-file");
+  if (!replay_file.empty()) {
+    std::string contents;
+    ASSERT_TRUE(base::ReadFileToString(replay_file, &contents));
+    base::SplitString(contents, '\n', &inputs);
+  } else {
+    const char* kInputs[] = {
+      "site42", "article 123", "topic7 subject3", "www.site9.com/section",
+      "page4711.html", "about topic", "section12 page", "http://www.site1",
+    };
+    inputs.assign(kInputs, kInputs + arraysize(kInputs));
+  }
+
+  std::vector<double> latencies;
+  for (std::vector<std::string>::const_iterator iter = inputs.begin();
+       iter != inputs.end(); ++iter) {
+    const base::string16 input(base::UTF8ToUTF16(*iter));
+    for (size_t length = 1; length <= input.length(); ++length) {
+      const base::string16 typed(input.substr(0, length));
+      const base::TimeTicks start = base::TimeTicks::Now();
+      data->HistoryItemsForTerms(typed, typed.length(),
+                                 url_index_->languages_, NULL);
+      latencies.push_back((base::TimeTicks::Now() - start).InMillisecondsF());
+    }
+  }
+  ASSERT_FALSE(latencies.empty());
+  std::sort(latencies.begin(), latencies.end());
+  perf_test::PrintResult("history_items_for_terms", "_p50", "50000_rows",
+                         latencies[latencies.size() / 2], "ms", true);
+  perf_test::PrintResult("history_items_for_terms", "_p99", "50000_rows",
+                         latencies[latencies.size() * 99 / 100], "ms", true);
+}
+
+// Measures restoring the index of a large history from its cache file, which
+// builds the index on the file thread, and the first query against it.
+TEST_F(InMemoryURLIndexTest, DISABLED_RestoreBenchmark) {
+  base::ScopedTempDir temp_directory;
+  ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
+  const base::FilePath cache_path =
+      temp_directory.path().AppendASCII("History Provider Cache");
+  const size_t kRowCount = 100000;
+  {
+    std::vector<URLRow> rows = SyntheticHistoryRows(kRowCount);
+    scoped_refptr<URLIndexPrivateData> data(new URLIndexPrivateData);
+    data->last_time_rebuilt_from_history_ = base::Time::Now();
+    data->IndexRows(&rows, url_index_->languages_, scheme_whitelist(), 1,
+                    NULL, base::Bind(&base::DoNothing));
+    ASSERT_TRUE(data->SaveToFile(cache_path));
+  }
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  scoped_refptr<URLIndexPrivateData> data =
+      URLIndexPrivateData::RestoreFromFile(cache_path, url_index_->languages_);
+  const base::TimeDelta restore_time = base::TimeTicks::Now() - start;
+  ASSERT_TRUE(data.get());
+  EXPECT_EQ(kRowCount, data->history_info_map_.size());
+
+  const base::string16 query(ASCIIToUTF16("site42"));
+  start = base::TimeTicks::Now();
+  data->HistoryItemsForTerms(query, base::string16::npos,
+                             url_index_->languages_, NULL);
+  const base::TimeDelta first_query_time = base::TimeTicks::Now() - start;
+
+  perf_test::PrintResult("url_index_restore", "", "100000_rows_restore",
+                         restore_time.InMillisecondsF(), "ms", true);
+  perf_test::PrintResult("url_index_restore", "", "100000_rows_first_query",
+                         first_query_time.InMillisecondsF(), "ms", true);
+}
+
 TEST_F(InMemoryURLIndexTest, WhitelistedURLs) {
   struct TestData {
     const std::string url_spec;
@@ -1023,7 +1309,13 @@ TEST_F(InMemoryURLIndexTest, CacheSaveRestore) {
   EXPECT_EQ(0, private_data.restored_cache_version_);
 
   // Capture the current private data for later comparison to restored data.
-  scoped_refptr<URLIndexPrivateData> old_data(private_data.Duplicate());
+  // The snapshot shares the index's storage rather than copying it.
+  scoped_refptr<URLIndexPrivateData> old_data(private_data.Snapshot());
+  const HistoryID history_id = private_data.history_info_map_.begin()->first;
+  EXPECT_TRUE(private_data.history_info_map_.SharesShardWith(
+      old_data->history_info_map_, history_id));
+  EXPECT_TRUE(private_data.word_map_.SharesShardWith(
+      old_data->word_map_, private_data.word_map_.begin()->first));
   const base::Time rebuild_time = private_data.last_time_rebuilt_from_history_;
 
   // Save then restore our private data.
@@ -1033,7 +1325,8 @@ TEST_F(InMemoryURLIndexTest, CacheSaveRestore) {
   message_loop_.Run();
   EXPECT_TRUE(save_observer.succeeded_);
 
-  // Clear and then prove it's clear before restoring.
+  // Clear and then prove it's clear before restoring. The snapshot must not
+  // see the clear.
   ClearPrivateData();
   EXPECT_TRUE(private_data.word_list_.empty());
   EXPECT_TRUE(private_data.available_words_.empty());
@@ -1043,6 +1336,8 @@ TEST_F(InMemoryURLIndexTest, CacheSaveRestore) {
   EXPECT_TRUE(private_data.history_id_word_map_.empty());
   EXPECT_TRUE(private_data.history_info_map_.empty());
   EXPECT_TRUE(private_data.word_starts_map_.empty());
+  ExpectPrivateDataNotEmpty(*old_data.get());
+  EXPECT_EQ(1U, old_data->history_info_map_.count(history_id));
 
   HistoryIndexRestoreObserver restore_observer(
       base::Bind(&base::MessageLoop::Quit, base::Unretained(&message_loop_)));
@@ -1093,7 +1388,13 @@ TEST_F(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld) {
   private_data.last_time_rebuilt_from_history_ = fake_rebuild_time;
 
   // Capture the current private data for later comparison to restored data.
-  scoped_refptr<URLIndexPrivateData> old_data(private_data.Duplicate());
+  // The snapshot shares the index's storage rather than copying it.
+  scoped_refptr<URLIndexPrivateData> old_data(private_data.Snapshot());
+  const HistoryID history_id = private_data.history_info_map_.begin()->first;
+  EXPECT_TRUE(private_data.history_info_map_.SharesShardWith(
+      old_data->history_info_map_, history_id));
+  EXPECT_TRUE(private_data.word_map_.SharesShardWith(
+      old_data->word_map_, private_data.word_map_.begin()->first));
 
   // Save then restore our private data.
   CacheFileSaverObserver save_observer(&message_loop_);
@@ -1102,7 +1403,8 @@ TEST_F(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld) {
   message_loop_.Run();
   EXPECT_TRUE(save_observer.succeeded_);
 
-  // Clear and then prove it's clear before restoring.
+  // Clear and then prove it's clear before restoring. The snapshot must not
+  // see the clear.
   ClearPrivateData();
   EXPECT_TRUE(private_data.word_list_.empty());
   EXPECT_TRUE(private_data.available_words_.empty());
@@ -1112,6 +1414,8 @@ TEST_F(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld) {
   EXPECT_TRUE(private_data.history_id_word_map_.empty());
   EXPECT_TRUE(private_data.history_info_map_.empty());
   EXPECT_TRUE(private_data.word_starts_map_.empty());
+  ExpectPrivateDataNotEmpty(*old_data.get());
+  EXPECT_EQ(1U, old_data->history_info_map_.count(history_id));
 
   HistoryIndexRestoreObserver restore_observer(
       base::Bind(&base::MessageLoop::Quit, base::Unretained(&message_loop_)));
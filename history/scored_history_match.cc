@@ -59,14 +59,113 @@ ScoredHistoryMatch::ScoredHistoryMatch(const URLRow& row,
       can_inline_(false) {
   Init();
 
-  GURL gurl = row.url();
-  if (!gurl.is_valid())
+  float topicality_score = 0.0f;
+  if (!MatchTerms(languages, lower_string, terms, word_starts,
+                  &topicality_score))
     return;
+  const float frecency_score = GetFrecency(
+      now, (bookmark_service && bookmark_service->IsBookmarked(row.url())),
+      visits);
+  SetRawScore(topicality_score, frecency_score, terms);
+}
+
+ScoredHistoryMatch::ScoredHistoryMatch(const URLRow& row)
+    : HistoryMatch(row, 0, false, false),
+      raw_score_(0),
+      can_inline_(false) {
+  Init();
+}
+
+ScoredHistoryMatch::~ScoredHistoryMatch() {}
+
+// static
+void ScoredHistoryMatch::ScoreCandidates(const Candidates& candidates,
+                                         const std::string& languages,
+                                         const base::string16& lower_string,
+                                         const String16Vector& terms,
+                                         const base::Time now,
+                                         BookmarkService* bookmark_service,
+                                         ScoredHistoryMatches* scored_matches) {
+  Init();
+
+  // First match the terms in each candidate, which is the only per-candidate
+  // string work, and lay out the sampled visits of every candidate that
+  // could still score as parallel arrays of recency buckets and values.
+  // Visits of the |i|th match run from |visit_ends[i - 1]| (or 0) up to
+  // |visit_ends[i]|.
+  ScoredHistoryMatches matches;
+  std::vector<float> topicality_scores;
+  std::vector<size_t> visit_counts;
+  std::vector<size_t> visit_ends;
+  std::vector<int> visit_buckets;
+  std::vector<int> visit_values;
+  matches.reserve(candidates.size());
+  topicality_scores.reserve(candidates.size());
+  visit_counts.reserve(candidates.size());
+  visit_ends.reserve(candidates.size());
+  visit_buckets.reserve(candidates.size() * kMaxVisitsToScore);
+  visit_values.reserve(candidates.size() * kMaxVisitsToScore);
+  for (Candidates::const_iterator iter = candidates.begin();
+       iter != candidates.end(); ++iter) {
+    ScoredHistoryMatch match(*iter->row);
+    float topicality_score = 0.0f;
+    if (!match.MatchTerms(languages, lower_string, terms, *iter->word_starts,
+                          &topicality_score))
+      continue;
+    const VisitInfoVector& visits = *iter->visits;
+    // A zero topicality score yields a zero relevancy score whatever the
+    // frecency, so there is no need to look at the visits.
+    if (topicality_score != 0) {
+      const size_t sampled_visits = std::min(visits.size(), kMaxVisitsToScore);
+      const bool bookmarked = sampled_visits && bookmark_service &&
+          bookmark_service->IsBookmarked(iter->row->url());
+      for (size_t i = 0; i < sampled_visits; ++i) {
+        visit_buckets.push_back(
+            GetRecencyBucket((now - visits[i].first).InDays()));
+        visit_values.push_back(GetVisitValue(visits[i].second, bookmarked));
+      }
+    }
+    matches.push_back(match);
+    topicality_scores.push_back(topicality_score);
+    visit_counts.push_back(visits.size());
+    visit_ends.push_back(visit_buckets.size());
+  }
+
+  // Then compute every frecency score in one pass over the visit arrays and
+  // combine it with the topicality score.
+  const float* days_ago_to_recency_score = GetDaysAgoToRecencyScore();
+  size_t visit_begin = 0;
+  for (size_t i = 0; i < matches.size(); ++i) {
+    const size_t visit_end = visit_ends[i];
+    float summed_visit_points = 0;
+    for (size_t j = visit_begin; j < visit_end; ++j) {
+      summed_visit_points +=
+          visit_values[j] * days_ago_to_recency_score[visit_buckets[j]];
+    }
+    const float frecency_score = (visit_end == visit_begin) ? 0.0f :
+        GetFrecencyFromVisitPoints(visit_counts[i],
+                                   static_cast<int>(visit_end - visit_begin),
+                                   summed_visit_points);
+    visit_begin = visit_end;
+    matches[i].SetRawScore(topicality_scores[i], frecency_score, terms);
+    if (matches[i].raw_score() > 0)
+      scored_matches->push_back(matches[i]);
+  }
+}
+
+bool ScoredHistoryMatch::MatchTerms(const std::string& languages,
+                                    const base::string16& lower_string,
+                                    const String16Vector& terms,
+                                    const RowWordStarts& word_starts,
+                                    float* topicality_score) {
+  const GURL& gurl = url_info.url();
+  if (!gurl.is_valid())
+    return false;
 
   // Figure out where each search term appears in the URL and/or page title
   // so that we can score as well as provide autocomplete highlighting.
   base::string16 url = CleanUpUrlForMatching(gurl, languages);
-  base::string16 title = CleanUpTitleForMatching(row.title());
+  base::string16 title = CleanUpTitleForMatching(url_info.title());
   int term_num = 0;
   for (String16Vector::const_iterator iter = terms.begin(); iter != terms.end();
        ++iter, ++term_num) {
@@ -74,7 +173,7 @@ ScoredHistoryMatch::ScoredHistoryMatch(const URLRow& row,
     TermMatches url_term_matches = MatchTermInString(term, url, term_num);
     TermMatches title_term_matches = MatchTermInString(term, title, term_num);
     if (url_term_matches.empty() && title_term_matches.empty())
-      return;  // A term was not found in either URL or title - reject.
+      return false;  // A term was not found in either URL or title - reject.
     url_matches_.insert(url_matches_.end(), url_term_matches.begin(),
                         url_term_matches.end());
     title_matches_.insert(title_matches_.end(), title_term_matches.begin(),
@@ -146,10 +245,13 @@ ScoredHistoryMatch::ScoredHistoryMatch(const URLRow& row,
         num_components_in_best_prefix);
   }
 
-  const float topicality_score =
-      GetTopicalityScore(terms.size(), url, word_starts);
-  const float frecency_score = GetFrecency(
-      now, (bookmark_service && bookmark_service->IsBookmarked(gurl)), visits);
+  *topicality_score = GetTopicalityScore(terms.size(), url, word_starts);
+  return true;
+}
+
+void ScoredHistoryMatch::SetRawScore(float topicality_score,
+                                     float frecency_score,
+                                     const String16Vector& terms) {
   raw_score_ = GetFinalRelevancyScore(topicality_score, frecency_score);
   raw_score_ =
       (raw_score_ <= kint32max) ? static_cast<int>(raw_score_) : kint32max;
@@ -160,8 +262,8 @@ ScoredHistoryMatch::ScoredHistoryMatch(const URLRow& row,
     // are given a higher score that lets them be shown in inline.
     // This test here derives from the test in
     // HistoryURLProvider::PromoteMatchForInlineAutocomplete().
-    const bool promote_to_inline = (row.typed_count() > 1) ||
-        (IsHostOnly() && (row.typed_count() == 1));
+    const bool promote_to_inline = (url_info.typed_count() > 1) ||
+        (IsHostOnly() && (url_info.typed_count() == 1));
     int hup_like_score = promote_to_inline ?
         HistoryURLProvider::kScoreForBestInlineableResult :
         HistoryURLProvider::kBaseScoreForNonInlineableResult;
@@ -171,7 +273,7 @@ ScoredHistoryMatch::ScoredHistoryMatch(const URLRow& row,
     // (because the URL-that-you-typed will go first and everything
     // else will be assigned one minus the previous score, as coded
     // at the end of HistoryURLProvider::DoAutocomplete().
-    if (base::UTF8ToUTF16(gurl.host()) == terms[0])
+    if (base::UTF8ToUTF16(url_info.url().host()) == terms[0])
       hup_like_score = HistoryURLProvider::kScoreForBestInlineableResult;
 
     // HistoryURLProvider has the function PromoteOrCreateShorterSuggestion()
@@ -206,8 +308,6 @@ ScoredHistoryMatch::ScoredHistoryMatch(const URLRow& row,
   }
 }
 
-ScoredHistoryMatch::~ScoredHistoryMatch() {}
-
 // Comparison function for sorting ScoredMatches by their scores with
 // intelligent tie-breaking.
 bool ScoredHistoryMatch::MatchScoreGreater(const ScoredHistoryMatch& m1,
@@ -443,6 +543,11 @@ void ScoredHistoryMatch::FillInTermScoreToTopicalityScoreArray() {
 
 // static
 float ScoredHistoryMatch::GetRecencyScore(int last_visit_days_ago) {
+  return GetDaysAgoToRecencyScore()[GetRecencyBucket(last_visit_days_ago)];
+}
+
+// static
+const float* ScoredHistoryMatch::GetDaysAgoToRecencyScore() {
   // Because the below thread is not thread safe, we check that we're
   // only calling it from one thread: the UI thread.  Specifically,
   // we check "if we've heard of the UI thread then we'd better
@@ -456,14 +561,16 @@ float ScoredHistoryMatch::GetRecencyScore(int last_visit_days_ago) {
     days_ago_to_recency_score_ = new float[kDaysToPrecomputeRecencyScoresFor];
     FillInDaysAgoToRecencyScoreArray();
   }
-  // Lookup the score in days_ago_to_recency_score, treating
-  // everything older than what we've precomputed as the oldest thing
+  return days_ago_to_recency_score_;
+}
+
+// static
+int ScoredHistoryMatch::GetRecencyBucket(int days_ago) {
+  // Treat everything older than what we've precomputed as the oldest thing
   // we've precomputed.  The std::max is to protect against corruption
-  // in the database (in case last_visit_days_ago is negative).
-  return days_ago_to_recency_score_[
-      std::max(
-      std::min(last_visit_days_ago, kDaysToPrecomputeRecencyScoresFor - 1),
-      0)];
+  // in the database (in case days_ago is negative).
+  return std::max(std::min(days_ago, kDaysToPrecomputeRecencyScoresFor - 1),
+                  0);
 }
 
 void ScoredHistoryMatch::FillInDaysAgoToRecencyScoreArray() {
@@ -513,17 +620,33 @@ float ScoredHistoryMatch::GetFrecency(const base::Time& now,
     return 0.0f;
   float summed_visit_points = 0;
   for (int i = 0; i < total_sampled_visits; ++i) {
-    int value_of_transition =
-        (visits[i].second == content::PAGE_TRANSITION_TYPED) ? 20 : 1;
-    if (bookmarked)
-      value_of_transition = std::max(value_of_transition, bookmark_value_);
+    const int value_of_transition = GetVisitValue(visits[i].second, bookmarked);
     const float bucket_weight =
         GetRecencyScore((now - visits[i].first).InDays());
     summed_visit_points += (value_of_transition * bucket_weight);
   }
-  return visits.size() * summed_visit_points /
+  return GetFrecencyFromVisitPoints(visits.size(), total_sampled_visits,
+                                    summed_visit_points);
+}
+
+// static
+int ScoredHistoryMatch::GetVisitValue(content::PageTransition transition,
+                                      bool bookmarked) {
+  int value_of_transition =
+      (transition == content::PAGE_TRANSITION_TYPED) ? 20 : 1;
+  if (bookmarked)
+    value_of_transition = std::max(value_of_transition, bookmark_value_);
+  return value_of_transition;
+}
+
+// static
+float ScoredHistoryMatch::GetFrecencyFromVisitPoints(
+    size_t visit_count,
+    int sampled_visit_count,
+    float summed_visit_points) {
+  return visit_count * summed_visit_points /
       (discount_frecency_when_few_visits_ ?
-          kMaxVisitsToScore : total_sampled_visits);
+          kMaxVisitsToScore : sampled_visit_count);
 }
 
 // static
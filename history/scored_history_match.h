@@ -19,7 +19,9 @@ class BookmarkService;
 
 namespace history {
 
+class ScoredHistoryMatch;
 class ScoredHistoryMatchTest;
+typedef std::vector<ScoredHistoryMatch> ScoredHistoryMatches;
 
 // An HistoryMatch that has a score as well as metrics defining where in the
 // history item's URL and/or page title matches have occurred.
@@ -52,6 +54,35 @@ class ScoredHistoryMatch : public history::HistoryMatch {
                      BookmarkService* bookmark_service);
   ~ScoredHistoryMatch();
 
+  // A history item to be scored by ScoreCandidates(). The pointed-to data
+  // must outlive the call.
+  struct Candidate {
+    Candidate(const URLRow* row,
+              const VisitInfoVector* visits,
+              const RowWordStarts* word_starts)
+        : row(row), visits(visits), word_starts(word_starts) {}
+
+    const URLRow* row;
+    const VisitInfoVector* visits;
+    const RowWordStarts* word_starts;
+  };
+  typedef std::vector<Candidate> Candidates;
+
+  // Scores each of |candidates| exactly as the constructor above would and
+  // appends those with a nonzero raw score to |scored_matches|, in candidate
+  // order. Rather than scoring each candidate from start to finish, this
+  // first matches the terms in every candidate, then gathers the recent
+  // visits of the candidates which matched into flat arrays of recency
+  // buckets and visit values, and computes their frecency scores in a
+  // single pass over those arrays.
+  static void ScoreCandidates(const Candidates& candidates,
+                              const std::string& languages,
+                              const base::string16& lower_string,
+                              const String16Vector& terms_vector,
+                              const base::Time now,
+                              BookmarkService* bookmark_service,
+                              ScoredHistoryMatches* scored_matches);
+
   // Compares two matches by score.  Functor supporting URLIndexPrivateData's
   // HistoryItemsForTerms function.  Looks at particular fields within
   // with url_info to make tie-breaking a bit smarter.
@@ -81,6 +112,7 @@ class ScoredHistoryMatch : public history::HistoryMatch {
   FRIEND_TEST_ALL_PREFIXES(ScoredHistoryMatchTest, ScoringDiscountFrecency);
   FRIEND_TEST_ALL_PREFIXES(ScoredHistoryMatchTest, ScoringScheme);
   FRIEND_TEST_ALL_PREFIXES(ScoredHistoryMatchTest, ScoringTLD);
+  FRIEND_TEST_ALL_PREFIXES(ScoredHistoryMatchTest, ScoreCandidates);
 
   // The number of days of recency scores to precompute.
   static const int kDaysToPrecomputeRecencyScoresFor;
@@ -89,6 +121,26 @@ class ScoredHistoryMatch : public history::HistoryMatch {
   // greater this are capped at the score of the largest bucket.
   static const int kMaxRawTermScore;
 
+  // Creates an unscored match for |row|, for ScoreCandidates().
+  explicit ScoredHistoryMatch(const URLRow& row);
+
+  // Finds each of |terms| in the URL and title, filling in |url_matches_|,
+  // |title_matches_|, |can_inline_| and |innermost_match|, and sets
+  // |topicality_score| to the resulting GetTopicalityScore(). Returns false,
+  // leaving the match with a raw score of 0, if the URL is invalid or some
+  // term appears in neither the URL nor the title.
+  bool MatchTerms(const std::string& languages,
+                  const base::string16& lower_string,
+                  const String16Vector& terms,
+                  const RowWordStarts& word_starts,
+                  float* topicality_score);
+
+  // Sets |raw_score_| from the component scores, applying HUP-like scoring
+  // and the cap on non-inlineable matches. Must follow MatchTerms().
+  void SetRawScore(float topicality_score,
+                   float frecency_score,
+                   const String16Vector& terms);
+
   // Return a topicality score based on how many matches appear in the
   // url and the page's title and where they are (e.g., at word
   // boundaries).  Revises |url_matches_| and |title_matches_| in the
@@ -106,6 +158,24 @@ class ScoredHistoryMatch : public history::HistoryMatch {
   // how many days ago the page was last visited.
   static float GetRecencyScore(int last_visit_days_ago);
 
+  // Returns |days_ago_to_recency_score_|, filling it in on first use.
+  static const float* GetDaysAgoToRecencyScore();
+
+  // Returns the index into |days_ago_to_recency_score_| for a visit
+  // |days_ago| days ago.
+  static int GetRecencyBucket(int days_ago);
+
+  // Returns the value of a single visit with the given |transition| for
+  // GetFrecency().
+  static int GetVisitValue(content::PageTransition transition,
+                           bool bookmarked);
+
+  // Returns the frecency score of a row with |visit_count| recent visits,
+  // the first |sampled_visit_count| of which sum to |summed_visit_points|.
+  static float GetFrecencyFromVisitPoints(size_t visit_count,
+                                          int sampled_visit_count,
+                                          float summed_visit_points);
+
   // Pre-calculates days_ago_to_recency_numerator_, used in
   // GetRecencyScore().
   static void FillInDaysAgoToRecencyScoreArray();
@@ -204,7 +274,6 @@ class ScoredHistoryMatch : public history::HistoryMatch {
   // Set to -1 to indicate no maximum score.
   static int max_assigned_score_for_non_inlineable_matches_;
 };
-typedef std::vector<ScoredHistoryMatch> ScoredHistoryMatches;
 
 }  // namespace history
 
@@ -6,6 +6,7 @@
 
 #include "base/auto_reset.h"
 #include "base/strings/string16.h"
+#include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
 #include "chrome/browser/bookmarks/bookmark_service.h"
 #include "chrome/browser/history/scored_history_match.h"
@@ -462,4 +463,70 @@ TEST_F(ScoredHistoryMatchTest, GetTopicalityScore) {
   EXPECT_GT(hostname_mid_word_score, tld_mid_word_score);
 }
 
+TEST_F(ScoredHistoryMatchTest, ScoreCandidates) {
+  // We use NowFromSystemTime() because MakeURLRow uses the same function
+  // to calculate last visit time when building a row.
+  base::Time now = base::Time::NowFromSystemTime();
+
+  // A mix of rows which match in the URL, in the title, not at all, or only
+  // mid-word, with varying numbers of visits up to beyond kMaxVisitsToScore,
+  // one of them bookmarked.
+  const size_t kRowCount = 6;
+  URLRow rows[kRowCount] = {
+    MakeURLRow("http://abcdef.com/", "nothing", 3, 1, 1),
+    MakeURLRow("http://example.com/abc", "ABC news", 12, 2, 0),
+    MakeURLRow("http://fedcba.com/", "unrelated", 2, 40, 0),
+    MakeURLRow("http://xyzabc.com/", "", 1, 400, 0),
+    MakeURLRow("http://bookmarked.com/", "abc site", 5, 7, 2),
+    MakeURLRow("http://novisits.com/", "abc", 0, 0, 0),
+  };
+  const int kVisitCounts[kRowCount] = { 3, 12, 2, 1, 5, 0 };
+  const int kVisitFrequencies[kRowCount] = { 1, 2, 20, 400, 7, 1 };
+  RowWordStarts word_starts[kRowCount];
+  VisitInfoVector visits[kRowCount];
+  ScoredHistoryMatch::Candidates candidates;
+  for (size_t i = 0; i < kRowCount; ++i) {
+    PopulateWordStarts(rows[i], &word_starts[i]);
+    visits[i] = CreateVisitInfoVector(kVisitCounts[i], kVisitFrequencies[i],
+                                      now);
+    candidates.push_back(ScoredHistoryMatch::Candidate(
+        &rows[i], &visits[i], &word_starts[i]));
+  }
+  visits[1][0].second = content::PAGE_TRANSITION_TYPED;
+  base::AutoReset<int> reset(&ScoredHistoryMatch::bookmark_value_, 5);
+  BookmarkServiceMock bookmark_model_mock(rows[4].url());
+
+  const char* kQueries[] = { "abc", "abc news", "fed", "zzz" };
+  for (size_t i = 0; i < arraysize(kQueries); ++i) {
+    SCOPED_TRACE(kQueries[i]);
+    const base::string16 lower_string(ASCIIToUTF16(kQueries[i]));
+    String16Vector terms;
+    Tokenize(lower_string, base::kWhitespaceUTF16, &terms);
+    ScoredHistoryMatches expected;
+    for (size_t j = 0; j < kRowCount; ++j) {
+      ScoredHistoryMatch match(rows[j], visits[j], std::string(), lower_string,
+                               terms, word_starts[j], now,
+                               &bookmark_model_mock);
+      if (match.raw_score() > 0)
+        expected.push_back(match);
+    }
+
+    ScoredHistoryMatches matches;
+    ScoredHistoryMatch::ScoreCandidates(candidates, std::string(),
+                                        lower_string, terms, now,
+                                        &bookmark_model_mock, &matches);
+    ASSERT_EQ(expected.size(), matches.size());
+    for (size_t j = 0; j < matches.size(); ++j) {
+      EXPECT_EQ(expected[j].url_info.url(), matches[j].url_info.url());
+      EXPECT_EQ(expected[j].raw_score(), matches[j].raw_score());
+      EXPECT_EQ(expected[j].can_inline(), matches[j].can_inline());
+      EXPECT_EQ(expected[j].innermost_match, matches[j].innermost_match);
+      EXPECT_EQ(expected[j].url_matches().size(),
+                matches[j].url_matches().size());
+      EXPECT_EQ(expected[j].title_matches().size(),
+                matches[j].title_matches().size());
+    }
+  }
+}
+
 }  // namespace history
@@ -0,0 +1,179 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/search_term_cache.h"
+
+#include <map>
+
+#include "base/stl_util.h"
+
+namespace history {
+
+// SearchTermCache::Item -------------------------------------------------------
+
+SearchTermCache::Item::Item(const WordIDSet& word_id_set,
+                            const HistoryIDSet& history_id_set)
+    : word_id_set_(word_id_set),
+      history_id_set_(history_id_set),
+      used_(true) {}
+
+SearchTermCache::Item::Item()
+    : used_(true) {}
+
+SearchTermCache::Item::~Item() {}
+
+// SearchTermCache::Node -------------------------------------------------------
+
+// A node of the trie. The path from the root to a node spells out a term,
+// which has a cached |item_| if it has been searched for.
+class SearchTermCache::Node {
+ public:
+  typedef std::map<base::char16, Node*> Children;
+
+  Node() {}
+  ~Node() { STLDeleteValues(&children_); }
+
+  // Returns the child for |c|, or NULL if there is none.
+  Node* GetChild(base::char16 c) const {
+    Children::const_iterator iter = children_.find(c);
+    return (iter == children_.end()) ? NULL : iter->second;
+  }
+
+  // Returns the child for |c|, creating it if necessary.
+  Node* GetOrAddChild(base::char16 c) {
+    Node*& child = children_[c];
+    if (!child)
+      child = new Node;
+    return child;
+  }
+
+  // Sets or clears |used_| on every item at or below this node.
+  void SetUsed(bool used) {
+    if (item_)
+      item_->used_ = used;
+    for (Children::iterator iter = children_.begin(); iter != children_.end();
+         ++iter)
+      iter->second->SetUsed(used);
+  }
+
+  // Removes every unused item at or below this node, then prunes any
+  // descendants left with neither an item nor children. Returns the number
+  // of items removed.
+  size_t RemoveUnused() {
+    size_t removed = 0;
+    if (item_ && !item_->used_) {
+      item_.reset();
+      ++removed;
+    }
+    for (Children::iterator iter = children_.begin(); iter != children_.end();
+         ++iter)
+      removed += iter->second->RemoveUnused();
+    Prune();
+    return removed;
+  }
+
+  // Deletes the descendants which have neither an item nor children.
+  void Prune() {
+    for (Children::iterator iter = children_.begin();
+         iter != children_.end(); ) {
+      iter->second->Prune();
+      if (!iter->second->item_ && iter->second->children_.empty()) {
+        delete iter->second;
+        children_.erase(iter++);
+      } else {
+        ++iter;
+      }
+    }
+  }
+
+  scoped_ptr<Item> item_;
+
+ private:
+  Children children_;
+
+  DISALLOW_COPY_AND_ASSIGN(Node);
+};
+
+// SearchTermCache -------------------------------------------------------------
+
+SearchTermCache::SearchTermCache()
+    : root_(new Node),
+      size_(0) {}
+
+SearchTermCache::~SearchTermCache() {}
+
+const SearchTermCache::Item* SearchTermCache::Find(
+    const base::string16& term) const {
+  const Node* node = root_.get();
+  for (size_t i = 0; node && i < term.length(); ++i)
+    node = node->GetChild(term[i]);
+  return node ? node->item_.get() : NULL;
+}
+
+SearchTermCache::Item* SearchTermCache::FindLongestPrefix(
+    const base::string16& term,
+    size_t* prefix_length) {
+  *prefix_length = 0;
+  Item* best_prefix = NULL;
+  const Node* node = root_.get();
+  for (size_t i = 0; i < term.length(); ++i) {
+    node = node->GetChild(term[i]);
+    if (!node)
+      break;
+    if (node->item_) {
+      node->item_->used_ = true;
+      best_prefix = node->item_.get();
+      *prefix_length = i + 1;
+    }
+  }
+  return best_prefix;
+}
+
+void SearchTermCache::Insert(const base::string16& term, const Item& item) {
+  Node* node = root_.get();
+  for (size_t i = 0; i < term.length(); ++i)
+    node = node->GetOrAddChild(term[i]);
+  if (!node->item_)
+    ++size_;
+  node->item_.reset(new Item(item));
+  node->item_->used_ = true;
+}
+
+void SearchTermCache::MarkAllUnused() {
+  root_->SetUsed(false);
+}
+
+void SearchTermCache::RemoveUnused() {
+  size_ -= root_->RemoveUnused();
+}
+
+size_t SearchTermCache::InvalidateWord(const base::string16& word) {
+  if (empty())
+    return 0;
+  // Every substring of |word| is a prefix of one of its suffixes, so walking
+  // each suffix down the trie visits every cached term within |word|.
+  size_t removed = 0;
+  for (size_t start = 0; start < word.length(); ++start) {
+    Node* node = root_.get();
+    for (size_t i = start; node && i < word.length(); ++i) {
+      node = node->GetChild(word[i]);
+      if (node && node->item_) {
+        node->item_.reset();
+        ++removed;
+      }
+    }
+  }
+  if (removed) {
+    root_->Prune();
+    size_ -= removed;
+  }
+  return removed;
+}
+
+void SearchTermCache::clear() {
+  root_.reset(new Node);
+  size_ = 0;
+}
+
+}  // namespace history
@@ -0,0 +1,89 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_SEARCH_TERM_CACHE_H_
+#define CHROME_BROWSER_HISTORY_SEARCH_TERM_CACHE_H_
+
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string16.h"
+#include "chrome/browser/history/in_memory_url_index_types.h"
+
+namespace history {
+
+// Caches the results of looking up recent search terms in the
+// InMemoryURLIndex so that searches which build upon a previous search can be
+// optimized. For example, if the user had typed "google blog trans" and then
+// typed an additional 'l' (at the end, of course) then the lookup of 'transl'
+// starts from the words found for 'trans' rather than from the whole index.
+//
+// The terms are held in a trie keyed by character, so the longest cached
+// prefix of a term is found by a single walk down the term, and the entries
+// which a change to the index may affect, those whose term occurs within a
+// word added to or removed from a row, are found by walking that word.
+// Entries not used by a search are discarded by a mark-and-sweep: the owner
+// calls MarkAllUnused() before a search and RemoveUnused() after it.
+class SearchTermCache {
+ public:
+  // The results for a single term. If a search term exactly matches one in
+  // the cache then its |history_id_set_| is the answer; if a cached term is a
+  // prefix of it then only words in that term's |word_id_set_| need be
+  // considered.
+  struct Item {
+    Item(const WordIDSet& word_id_set, const HistoryIDSet& history_id_set);
+    // Creates a cache item for a term which has no results.
+    Item();
+    ~Item();
+
+    WordIDSet word_id_set_;
+    HistoryIDSet history_id_set_;
+    bool used_;  // True if this item has been used for the current search.
+  };
+
+  SearchTermCache();
+  ~SearchTermCache();
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  // Returns the item cached for exactly |term|, or NULL if there is none.
+  const Item* Find(const base::string16& term) const;
+
+  // Returns the item cached for the longest prefix of |term|, which may be
+  // |term| itself, and sets |prefix_length| to that prefix's length. Returns
+  // NULL if no prefix of |term| is cached. Marks the returned item and those
+  // of all shorter cached prefixes of |term| as used, so the terms the user
+  // typed on the way to |term| survive the next RemoveUnused() and are hits
+  // again if the user deletes characters.
+  Item* FindLongestPrefix(const base::string16& term, size_t* prefix_length);
+
+  // Caches |item|, marked as used, for |term|, replacing any previous item.
+  void Insert(const base::string16& term, const Item& item);
+
+  // Clears |used_| for every item.
+  void MarkAllUnused();
+
+  // Removes every item not marked as used.
+  void RemoveUnused();
+
+  // Removes every item whose term occurs within |word|, which are the only
+  // items whose results change when |word| is added to or removed from a
+  // row, or is removed from or reassigned in the index. Returns the number
+  // of items removed.
+  size_t InvalidateWord(const base::string16& word);
+
+  void clear();
+
+ private:
+  class Node;
+
+  scoped_ptr<Node> root_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(SearchTermCache);
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_SEARCH_TERM_CACHE_H_
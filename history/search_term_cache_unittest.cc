@@ -0,0 +1,119 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/search_term_cache.h"
+
+#include "base/strings/utf_string_conversions.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using base::ASCIIToUTF16;
+
+namespace history {
+
+namespace {
+
+// Returns a cache item whose history ID set holds just |history_id|.
+SearchTermCache::Item MakeItem(HistoryID history_id) {
+  HistoryIDSet history_id_set;
+  history_id_set.insert(history_id);
+  return SearchTermCache::Item(WordIDSet(), history_id_set);
+}
+
+}  // namespace
+
+TEST(SearchTermCacheTest, FindLongestPrefix) {
+  SearchTermCache cache;
+  size_t prefix_length = 0;
+  EXPECT_TRUE(cache.empty());
+  EXPECT_TRUE(cache.FindLongestPrefix(ASCIIToUTF16("abc"), &prefix_length) ==
+              NULL);
+  EXPECT_EQ(0U, prefix_length);
+
+  cache.Insert(ASCIIToUTF16("ab"), MakeItem(1));
+  cache.Insert(ASCIIToUTF16("abcd"), MakeItem(2));
+  cache.Insert(ASCIIToUTF16("xy"), MakeItem(3));
+  EXPECT_EQ(3U, cache.size());
+
+  SearchTermCache::Item* item =
+      cache.FindLongestPrefix(ASCIIToUTF16("abc"), &prefix_length);
+  ASSERT_TRUE(item != NULL);
+  EXPECT_EQ(2U, prefix_length);
+  EXPECT_EQ(1U, item->history_id_set_.count(1));
+
+  item = cache.FindLongestPrefix(ASCIIToUTF16("abcdef"), &prefix_length);
+  ASSERT_TRUE(item != NULL);
+  EXPECT_EQ(4U, prefix_length);
+  EXPECT_EQ(1U, item->history_id_set_.count(2));
+
+  item = cache.FindLongestPrefix(ASCIIToUTF16("abcd"), &prefix_length);
+  ASSERT_TRUE(item != NULL);
+  EXPECT_EQ(4U, prefix_length);
+
+  EXPECT_TRUE(cache.FindLongestPrefix(ASCIIToUTF16("a"), &prefix_length) ==
+              NULL);
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("abc")) == NULL);
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("xy")) != NULL);
+
+  // Inserting an existing term replaces its item.
+  cache.Insert(ASCIIToUTF16("xy"), MakeItem(4));
+  EXPECT_EQ(3U, cache.size());
+  EXPECT_EQ(1U, cache.Find(ASCIIToUTF16("xy"))->history_id_set_.count(4));
+}
+
+TEST(SearchTermCacheTest, MarkAndSweep) {
+  SearchTermCache cache;
+  cache.Insert(ASCIIToUTF16("mo"), MakeItem(1));
+  cache.Insert(ASCIIToUTF16("mor"), MakeItem(1));
+  cache.Insert(ASCIIToUTF16("mort"), MakeItem(1));
+  cache.Insert(ASCIIToUTF16("reco"), MakeItem(2));
+
+  // Looking up "mors" uses "mor", and keeps the shorter "mo" in use too.
+  cache.MarkAllUnused();
+  size_t prefix_length = 0;
+  cache.FindLongestPrefix(ASCIIToUTF16("mors"), &prefix_length);
+  EXPECT_EQ(3U, prefix_length);
+  cache.RemoveUnused();
+  EXPECT_EQ(2U, cache.size());
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("mo")) != NULL);
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("mor")) != NULL);
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("mort")) == NULL);
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("reco")) == NULL);
+
+  cache.MarkAllUnused();
+  cache.RemoveUnused();
+  EXPECT_TRUE(cache.empty());
+}
+
+TEST(SearchTermCacheTest, InvalidateWord) {
+  SearchTermCache cache;
+  cache.Insert(ASCIIToUTF16("cor"), MakeItem(1));
+  cache.Insert(ASCIIToUTF16("cord"), MakeItem(1));
+  cache.Insert(ASCIIToUTF16("core"), MakeItem(1));
+  cache.Insert(ASCIIToUTF16("re"), MakeItem(1));
+  cache.Insert(ASCIIToUTF16("xy"), MakeItem(1));
+
+  // Exactly the terms which occur within the word go.
+  EXPECT_EQ(0U, cache.InvalidateWord(ASCIIToUTF16("abc")));
+  EXPECT_EQ(3U, cache.InvalidateWord(ASCIIToUTF16("recorded")));
+  EXPECT_EQ(2U, cache.size());
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("cor")) == NULL);
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("cord")) == NULL);
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("re")) == NULL);
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("core")) != NULL);
+  EXPECT_TRUE(cache.Find(ASCIIToUTF16("xy")) != NULL);
+
+  // The pruned branches are rebuilt by later inserts.
+  cache.Insert(ASCIIToUTF16("cor"), MakeItem(2));
+  EXPECT_EQ(3U, cache.size());
+  size_t prefix_length = 0;
+  EXPECT_TRUE(cache.FindLongestPrefix(ASCIIToUTF16("cord"), &prefix_length) !=
+              NULL);
+  EXPECT_EQ(3U, prefix_length);
+
+  cache.clear();
+  EXPECT_TRUE(cache.empty());
+  EXPECT_EQ(0U, cache.InvalidateWord(ASCIIToUTF16("core")));
+}
+
+}  // namespace history
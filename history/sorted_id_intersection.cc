@@ -0,0 +1,150 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/sorted_id_intersection.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "build/build_config.h"
+
+#if defined(ARCH_CPU_X86_FAMILY)
+#include <emmintrin.h>
+#endif
+
+namespace history {
+
+namespace {
+
+// When the larger input is at least this many times the size of the smaller,
+// galloping through the larger input beats a linear merge.
+const size_t kGallopingRatio = 32;
+
+}  // namespace
+
+size_t IntersectSortedIDs(const uint32* a,
+                          size_t a_size,
+                          const uint32* b,
+                          size_t b_size,
+                          uint32* out) {
+  if (a_size == 0 || b_size == 0)
+    return 0;
+  if (a_size > b_size) {
+    std::swap(a, b);
+    std::swap(a_size, b_size);
+  }
+  if (b_size / a_size >= kGallopingRatio)
+    return IntersectSortedIDsGalloping(a, a_size, b, b_size, out);
+  return IntersectSortedIDsBlocked(a, a_size, b, b_size, out);
+}
+
+void IntersectSortedIDs(const std::vector<uint32>& a,
+                        const std::vector<uint32>& b,
+                        std::vector<uint32>* out) {
+  DCHECK(out);
+  DCHECK_NE(&a, out);
+  DCHECK_NE(&b, out);
+  out->resize(std::min(a.size(), b.size()));
+  if (out->empty())
+    return;
+  out->resize(IntersectSortedIDs(a.empty() ? NULL : &a[0], a.size(),
+                                 b.empty() ? NULL : &b[0], b.size(),
+                                 &(*out)[0]));
+}
+
+size_t IntersectSortedIDsScalar(const uint32* a,
+                                size_t a_size,
+                                const uint32* b,
+                                size_t b_size,
+                                uint32* out) {
+  size_t count = 0;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < a_size && j < b_size) {
+    if (a[i] < b[j]) {
+      ++i;
+    } else if (b[j] < a[i]) {
+      ++j;
+    } else {
+      out[count++] = a[i];
+      ++i;
+      ++j;
+    }
+  }
+  return count;
+}
+
+size_t IntersectSortedIDsGalloping(const uint32* small,
+                                   size_t small_size,
+                                   const uint32* large,
+                                   size_t large_size,
+                                   uint32* out) {
+  size_t count = 0;
+  size_t low = 0;
+  for (size_t i = 0; i < small_size && low < large_size; ++i) {
+    const uint32 target = small[i];
+    // Double the step until we overshoot |target|, then binary search the
+    // last step.
+    size_t step = 1;
+    size_t high = low;
+    while (high < large_size && large[high] < target) {
+      low = high + 1;
+      high += step;
+      step *= 2;
+    }
+    high = std::min(high + 1, large_size);
+    const uint32* found = std::lower_bound(large + low, large + high, target);
+    low = found - large;
+    if (low < large_size && *found == target) {
+      out[count++] = target;
+      ++low;
+    }
+  }
+  return count;
+}
+
+size_t IntersectSortedIDsBlocked(const uint32* a,
+                                 size_t a_size,
+                                 const uint32* b,
+                                 size_t b_size,
+                                 uint32* out) {
+  size_t count = 0;
+  size_t i = 0;
+  size_t j = 0;
+#if defined(ARCH_CPU_X86_FAMILY)
+  // Compare each block of four IDs from |a| against all four rotations of a
+  // block from |b|; any lane which matched in some rotation is in both inputs.
+  // Then advance whichever block ends with the smaller ID (or both).
+  const size_t a_blocks_end = a_size & ~static_cast<size_t>(3);
+  const size_t b_blocks_end = b_size & ~static_cast<size_t>(3);
+  while (i < a_blocks_end && j < b_blocks_end) {
+    const __m128i a_block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    const __m128i b_block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+    __m128i matches = _mm_cmpeq_epi32(a_block, b_block);
+    matches = _mm_or_si128(matches, _mm_cmpeq_epi32(
+        a_block, _mm_shuffle_epi32(b_block, _MM_SHUFFLE(0, 3, 2, 1))));
+    matches = _mm_or_si128(matches, _mm_cmpeq_epi32(
+        a_block, _mm_shuffle_epi32(b_block, _MM_SHUFFLE(1, 0, 3, 2))));
+    matches = _mm_or_si128(matches, _mm_cmpeq_epi32(
+        a_block, _mm_shuffle_epi32(b_block, _MM_SHUFFLE(2, 1, 0, 3))));
+    const int mask = _mm_movemask_ps(_mm_castsi128_ps(matches));
+    for (int lane = 0; lane < 4; ++lane) {
+      if (mask & (1 << lane))
+        out[count++] = a[i + lane];
+    }
+    const uint32 a_max = a[i + 3];
+    const uint32 b_max = b[j + 3];
+    if (a_max <= b_max)
+      i += 4;
+    if (b_max <= a_max)
+      j += 4;
+  }
+#endif  // defined(ARCH_CPU_X86_FAMILY)
+  return count + IntersectSortedIDsScalar(a + i, a_size - i, b + j, b_size - j,
+                                          out + count);
+}
+
+}  // namespace history
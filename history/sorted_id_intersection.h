@@ -0,0 +1,58 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_SORTED_ID_INTERSECTION_H_
+#define CHROME_BROWSER_HISTORY_SORTED_ID_INTERSECTION_H_
+
+#include <vector>
+
+#include "base/basictypes.h"
+
+namespace history {
+
+// Intersection kernels for sorted arrays of unique 32-bit IDs, as used by the
+// in-memory URL index when narrowing candidate word and history ID sets.
+//
+// IntersectSortedIDs() picks a strategy based on the relative sizes of the
+// inputs: when one array is much smaller than the other it gallops
+// (exponential search) through the larger one, touching only O(m log(n/m))
+// elements; otherwise it compares blocks of four IDs at a time using SSE2 on
+// x86, falling back to a scalar merge elsewhere.
+
+// Writes the IDs present in both |a| and |b| to |out|, which must have room
+// for at least min(|a_size|, |b_size|) entries, and returns the number
+// written. |out| must not overlap either input.
+size_t IntersectSortedIDs(const uint32* a,
+                          size_t a_size,
+                          const uint32* b,
+                          size_t b_size,
+                          uint32* out);
+
+// Convenience wrapper which replaces the contents of |out| with the
+// intersection of |a| and |b|.
+void IntersectSortedIDs(const std::vector<uint32>& a,
+                        const std::vector<uint32>& b,
+                        std::vector<uint32>* out);
+
+// The individual strategies, exposed for testing and benchmarking. Each has
+// the same contract as IntersectSortedIDs().
+size_t IntersectSortedIDsScalar(const uint32* a,
+                                size_t a_size,
+                                const uint32* b,
+                                size_t b_size,
+                                uint32* out);
+size_t IntersectSortedIDsGalloping(const uint32* small,
+                                   size_t small_size,
+                                   const uint32* large,
+                                   size_t large_size,
+                                   uint32* out);
+size_t IntersectSortedIDsBlocked(const uint32* a,
+                                 size_t a_size,
+                                 const uint32* b,
+                                 size_t b_size,
+                                 uint32* out);
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_SORTED_ID_INTERSECTION_H_
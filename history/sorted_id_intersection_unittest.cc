@@ -0,0 +1,159 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/sorted_id_intersection.h"
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <string>
+
+#include "base/rand_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace history {
+
+namespace {
+
+typedef size_t (*IntersectionFunction)(const uint32*, size_t, const uint32*,
+                                       size_t, uint32*);
+
+// Returns |count| unique IDs drawn from [0, |range|), sorted.
+std::vector<uint32> RandomSortedIDs(size_t count, uint32 range) {
+  std::set<uint32> ids;
+  while (ids.size() < count)
+    ids.insert(static_cast<uint32>(base::RandInt(0, range - 1)));
+  return std::vector<uint32>(ids.begin(), ids.end());
+}
+
+std::vector<uint32> ReferenceIntersection(const std::vector<uint32>& a,
+                                          const std::vector<uint32>& b) {
+  std::vector<uint32> result;
+  std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                        std::back_inserter(result));
+  return result;
+}
+
+std::vector<uint32> RunIntersection(IntersectionFunction function,
+                                    const std::vector<uint32>& a,
+                                    const std::vector<uint32>& b) {
+  std::vector<uint32> result(std::min(a.size(), b.size()) + 1);
+  size_t count = function(a.empty() ? NULL : &a[0], a.size(),
+                          b.empty() ? NULL : &b[0], b.size(), &result[0]);
+  result.resize(count);
+  return result;
+}
+
+}  // namespace
+
+TEST(SortedIDIntersectionTest, Basic) {
+  const uint32 kA[] = {1, 3, 5, 7, 9, 11, 13, 15, 17};
+  const uint32 kB[] = {2, 3, 4, 5, 6, 15, 16, 17, 100};
+  std::vector<uint32> a(kA, kA + arraysize(kA));
+  std::vector<uint32> b(kB, kB + arraysize(kB));
+  const uint32 kExpected[] = {3, 5, 15, 17};
+  std::vector<uint32> expected(kExpected, kExpected + arraysize(kExpected));
+
+  std::vector<uint32> result;
+  IntersectSortedIDs(a, b, &result);
+  EXPECT_EQ(expected, result);
+  EXPECT_EQ(expected, RunIntersection(&IntersectSortedIDsScalar, a, b));
+  EXPECT_EQ(expected, RunIntersection(&IntersectSortedIDsGalloping, a, b));
+  EXPECT_EQ(expected, RunIntersection(&IntersectSortedIDsBlocked, a, b));
+}
+
+TEST(SortedIDIntersectionTest, EmptyAndDisjoint) {
+  std::vector<uint32> empty;
+  std::vector<uint32> a;
+  a.push_back(1);
+  a.push_back(2);
+  std::vector<uint32> b;
+  b.push_back(3);
+  b.push_back(4);
+  std::vector<uint32> result(1, 42);
+  IntersectSortedIDs(empty, a, &result);
+  EXPECT_TRUE(result.empty());
+  IntersectSortedIDs(a, b, &result);
+  EXPECT_TRUE(result.empty());
+}
+
+// Every strategy must agree with std::set_intersection across balanced and
+// skewed sizes, including sizes which are not a multiple of the block width.
+TEST(SortedIDIntersectionTest, MatchesReference) {
+  const size_t kSizes[] = {1, 3, 4, 5, 17, 64, 250, 1000, 5000};
+  for (size_t i = 0; i < arraysize(kSizes); ++i) {
+    for (size_t j = 0; j < arraysize(kSizes); ++j) {
+      std::vector<uint32> a = RandomSortedIDs(kSizes[i], 8000);
+      std::vector<uint32> b = RandomSortedIDs(kSizes[j], 8000);
+      std::vector<uint32> expected = ReferenceIntersection(a, b);
+      std::vector<uint32> result;
+      IntersectSortedIDs(a, b, &result);
+      EXPECT_EQ(expected, result) << kSizes[i] << " x " << kSizes[j];
+      EXPECT_EQ(expected, RunIntersection(&IntersectSortedIDsGalloping, a, b));
+      EXPECT_EQ(expected, RunIntersection(&IntersectSortedIDsBlocked, a, b));
+    }
+  }
+}
+
+// Microbenchmark showing how intersecting the candidate sets for a multi-term
+// omnibox query scales with the number of terms and the size of the history.
+TEST(SortedIDIntersectionTest, DISABLED_ScalingBenchmark) {
+  const size_t kHistorySizes[] = {10000, 100000, 1000000};
+  const size_t kTermCounts[] = {2, 4, 8};
+  const int kIterations = 20;
+  for (size_t h = 0; h < arraysize(kHistorySizes); ++h) {
+    const uint32 history_size = static_cast<uint32>(kHistorySizes[h]);
+    for (size_t t = 0; t < arraysize(kTermCounts); ++t) {
+      // Term candidate sets range from very common (half of history) to
+      // rare, as with "com" versus a specific site name.
+      std::vector<std::vector<uint32> > term_sets;
+      std::vector<std::set<uint32> > term_trees;
+      for (size_t term = 0; term < kTermCounts[t]; ++term) {
+        term_sets.push_back(RandomSortedIDs(
+            std::max<size_t>(history_size >> (term + 1), 1), history_size));
+        term_trees.push_back(std::set<uint32>(term_sets.back().begin(),
+                                              term_sets.back().end()));
+      }
+      const std::string trace = base::Uint64ToString(history_size) + "_rows_" +
+          base::Uint64ToString(kTermCounts[t]) + "_terms";
+
+      base::TimeTicks start = base::TimeTicks::Now();
+      for (int iteration = 0; iteration < kIterations; ++iteration) {
+        std::set<uint32> result(term_trees[0]);
+        for (size_t term = 1; term < term_trees.size(); ++term) {
+          std::set<uint32> new_result;
+          std::set_intersection(result.begin(), result.end(),
+                                term_trees[term].begin(),
+                                term_trees[term].end(),
+                                std::inserter(new_result, new_result.begin()));
+          result.swap(new_result);
+        }
+      }
+      perf_test::PrintResult(
+          "id_intersection", "_std_set", trace,
+          (base::TimeTicks::Now() - start).InMillisecondsF() / kIterations,
+          "ms", true);
+
+      start = base::TimeTicks::Now();
+      for (int iteration = 0; iteration < kIterations; ++iteration) {
+        // Smallest set first, as URLIndexPrivateData does.
+        std::vector<uint32> result(term_sets.back());
+        std::vector<uint32> scratch;
+        for (size_t term = term_sets.size() - 1; term-- > 0;) {
+          IntersectSortedIDs(result, term_sets[term], &scratch);
+          result.swap(scratch);
+        }
+      }
+      perf_test::PrintResult(
+          "id_intersection", "_kernel", trace,
+          (base::TimeTicks::Now() - start).InMillisecondsF() / kIterations,
+          "ms", true);
+    }
+  }
+}
+
+}  // namespace history
@@ -5,6 +5,7 @@
 #include "chrome/browser/history/thumbnail_database.h"
 
 #include <algorithm>
+#include <map>
 #include <string>
 
 #include "base/bind.h"
@@ -99,6 +100,44 @@ void FillIconMapping(const sql::Statement& statement,
   icon_mapping->page_url = page_url;
 }
 
+// Copies the mappings of |mappings|, which are in descending order of
+// IconType, whose type is the largest of |required_icon_types| that any of
+// them has to |filtered_mappings|. Returns true if there were any.
+bool FilterIconMappings(const std::vector<history::IconMapping>& mappings,
+                        int required_icon_types,
+                        std::vector<history::IconMapping>* filtered_mappings) {
+  bool result = false;
+  for (std::vector<history::IconMapping>::const_iterator m = mappings.begin();
+       m != mappings.end(); ++m) {
+    if (m->icon_type & required_icon_types) {
+      result = true;
+      if (!filtered_mappings)
+        return result;
+
+      // Restrict icon type of subsequent matches to |m->icon_type|.
+      // |m->icon_type| is the largest IconType in |mappings| because
+      // |mappings| is sorted in descending order of IconType.
+      required_icon_types = m->icon_type;
+
+      filtered_mappings->push_back(*m);
+    }
+  }
+  return result;
+}
+
+// The number of keys each statement of the set-based lookups binds. Shorter
+// lists are padded with keys which never match, so that each lookup needs a
+// single cached statement.
+const size_t kLookupsPerStatement = 50;
+
+// Returns "(?,?,...,?)" with kLookupsPerStatement placeholders.
+std::string LookupPlaceholders() {
+  std::string placeholders = "(?";
+  for (size_t i = 1; i < kLookupsPerStatement; ++i)
+    placeholders += ",?";
+  return placeholders + ")";
+}
+
 enum InvalidStructureType {
   // NOTE(shess): Intentionally skip bucket 0 to account for
   // conversion from a boolean histogram.
@@ -668,6 +707,35 @@ bool ThumbnailDatabase::GetFaviconBitmapIDSizes(
   return result;
 }
 
+void ThumbnailDatabase::GetFaviconBitmapIDSizesForIcons(
+    const std::vector<chrome::FaviconID>& icon_ids,
+    std::map<chrome::FaviconID, std::vector<FaviconBitmapIDSize> >*
+        bitmap_id_sizes) {
+  bitmap_id_sizes->clear();
+
+  const std::string sql =
+      "SELECT id, width, height, icon_id FROM favicon_bitmaps "
+      "WHERE icon_id IN " + LookupPlaceholders();
+  for (size_t first = 0; first < icon_ids.size();
+       first += kLookupsPerStatement) {
+    sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
+                                                    sql.c_str()));
+    // Favicon ids start at 1, so the padding matches nothing.
+    for (size_t i = 0; i < kLookupsPerStatement; ++i) {
+      statement.BindInt64(
+          i, first + i < icon_ids.size() ? icon_ids[first + i] : 0);
+    }
+
+    while (statement.Step()) {
+      FaviconBitmapIDSize bitmap_id_size;
+      bitmap_id_size.bitmap_id = statement.ColumnInt64(0);
+      bitmap_id_size.pixel_size = gfx::Size(statement.ColumnInt(1),
+                                            statement.ColumnInt(2));
+      (*bitmap_id_sizes)[statement.ColumnInt64(3)].push_back(bitmap_id_size);
+    }
+  }
+}
+
 bool ThumbnailDatabase::GetFaviconBitmaps(
     chrome::FaviconID icon_id,
     std::vector<FaviconBitmap>* favicon_bitmaps) {
@@ -730,6 +798,42 @@ bool ThumbnailDatabase::GetFaviconBitmap(
   return true;
 }
 
+void ThumbnailDatabase::GetFaviconBitmapsForIDs(
+    const std::vector<FaviconBitmapID>& bitmap_ids,
+    std::vector<FaviconBitmap>* favicon_bitmaps) {
+  favicon_bitmaps->clear();
+
+  const std::string sql =
+      "SELECT id, icon_id, last_updated, image_data, width, height "
+      "FROM favicon_bitmaps WHERE id IN " + LookupPlaceholders();
+  for (size_t first = 0; first < bitmap_ids.size();
+       first += kLookupsPerStatement) {
+    sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
+                                                    sql.c_str()));
+    // Bitmap ids start at 1, so the padding matches nothing.
+    for (size_t i = 0; i < kLookupsPerStatement; ++i) {
+      statement.BindInt64(
+          i, first + i < bitmap_ids.size() ? bitmap_ids[first + i] : 0);
+    }
+
+    while (statement.Step()) {
+      FaviconBitmap favicon_bitmap;
+      favicon_bitmap.bitmap_id = statement.ColumnInt64(0);
+      favicon_bitmap.icon_id = statement.ColumnInt64(1);
+      favicon_bitmap.last_updated =
+          base::Time::FromInternalValue(statement.ColumnInt64(2));
+      if (statement.ColumnByteLength(3) > 0) {
+        scoped_refptr<base::RefCountedBytes> data(new base::RefCountedBytes());
+        statement.ColumnBlobAsVector(3, &data->data());
+        favicon_bitmap.bitmap_data = data;
+      }
+      favicon_bitmap.pixel_size = gfx::Size(statement.ColumnInt(4),
+                                            statement.ColumnInt(5));
+      favicon_bitmaps->push_back(favicon_bitmap);
+    }
+  }
+}
+
 FaviconBitmapID ThumbnailDatabase::AddFaviconBitmap(
     chrome::FaviconID icon_id,
     const scoped_refptr<base::RefCountedMemory>& icon_data,
@@ -888,23 +992,8 @@ bool ThumbnailDatabase::GetIconMappingsForPageURL(
   if (!GetIconMappingsForPageURL(page_url, &mapping_data))
     return false;
 
-  bool result = false;
-  for (std::vector<IconMapping>::iterator m = mapping_data.begin();
-       m != mapping_data.end(); ++m) {
-    if (m->icon_type & required_icon_types) {
-      result = true;
-      if (!filtered_mapping_data)
-        return result;
-
-      // Restrict icon type of subsequent matches to |m->icon_type|.
-      // |m->icon_type| is the largest IconType in |mapping_data| because
-      // |mapping_data| is sorted in descending order of IconType.
-      required_icon_types = m->icon_type;
-
-      filtered_mapping_data->push_back(*m);
-    }
-  }
-  return result;
+  return FilterIconMappings(mapping_data, required_icon_types,
+                            filtered_mapping_data);
 }
 
 bool ThumbnailDatabase::GetIconMappingsForPageURL(
@@ -933,6 +1022,68 @@ bool ThumbnailDatabase::GetIconMappingsForPageURL(
   return result;
 }
 
+void ThumbnailDatabase::GetIconMappingsForPageURLs(
+    const std::vector<GURL>& page_urls,
+    int required_icon_types,
+    std::map<GURL, std::vector<IconMapping> >* mappings) {
+  mappings->clear();
+
+  // The database form of a URL can differ from the URL asked for, and several
+  // of |page_urls| can share it.
+  std::map<std::string, std::vector<GURL> > requested_urls;
+  for (size_t i = 0; i < page_urls.size(); ++i) {
+    requested_urls[URLDatabase::GURLToDatabaseURL(page_urls[i])].push_back(
+        page_urls[i]);
+  }
+
+  std::map<std::string, std::vector<IconMapping> > all_mappings;
+  const std::string sql =
+      "SELECT icon_mapping.id, icon_mapping.icon_id, favicons.icon_type, "
+      "favicons.url, icon_mapping.page_url "
+      "FROM icon_mapping "
+      "INNER JOIN favicons "
+      "ON icon_mapping.icon_id = favicons.id "
+      "WHERE icon_mapping.page_url IN " + LookupPlaceholders() + " "
+      "ORDER BY favicons.icon_type DESC";
+  std::map<std::string, std::vector<GURL> >::const_iterator next =
+      requested_urls.begin();
+  while (next != requested_urls.end()) {
+    sql::Statement statement(db_.GetCachedStatement(SQL_FROM_HERE,
+                                                    sql.c_str()));
+    // No page URL is empty, so the padding matches nothing.
+    for (size_t i = 0; i < kLookupsPerStatement; ++i) {
+      if (next != requested_urls.end()) {
+        statement.BindString(i, next->first);
+        ++next;
+      } else {
+        statement.BindString(i, std::string());
+      }
+    }
+
+    while (statement.Step()) {
+      std::string page_url = statement.ColumnString(4);
+      IconMapping icon_mapping;
+      FillIconMapping(statement, GURL(page_url), &icon_mapping);
+      all_mappings[page_url].push_back(icon_mapping);
+    }
+  }
+
+  for (std::map<std::string, std::vector<IconMapping> >::const_iterator i =
+           all_mappings.begin();
+       i != all_mappings.end(); ++i) {
+    const std::vector<GURL>& urls = requested_urls[i->first];
+    for (size_t j = 0; j < urls.size(); ++j) {
+      std::vector<IconMapping> filtered_mappings;
+      if (!FilterIconMappings(i->second, required_icon_types,
+                              &filtered_mappings))
+        continue;
+      for (size_t k = 0; k < filtered_mappings.size(); ++k)
+        filtered_mappings[k].page_url = urls[j];
+      (*mappings)[urls[j]].swap(filtered_mappings);
+    }
+  }
+}
+
 IconMappingID ThumbnailDatabase::AddIconMapping(const GURL& page_url,
                                                 chrome::FaviconID icon_id) {
   const char kSql[] =
@@ -5,6 +5,7 @@
 #ifndef CHROME_BROWSER_HISTORY_THUMBNAIL_DATABASE_H_
 #define CHROME_BROWSER_HISTORY_THUMBNAIL_DATABASE_H_
 
+#include <map>
 #include <vector>
 
 #include "base/gtest_prod_util.h"
@@ -83,6 +84,19 @@ class ThumbnailDatabase {
                         scoped_refptr<base::RefCountedMemory>* png_icon_data,
                         gfx::Size* pixel_size);
 
+  // Sets |bitmap_id_sizes| to the result of GetFaviconBitmapIDSizes() for each
+  // of |icon_ids| which has favicon bitmaps, using a query per 50 favicons
+  // rather than one per favicon.
+  void GetFaviconBitmapIDSizesForIcons(
+      const std::vector<chrome::FaviconID>& icon_ids,
+      std::map<chrome::FaviconID, std::vector<FaviconBitmapIDSize> >*
+          bitmap_id_sizes);
+
+  // Sets |favicon_bitmaps| to those of the favicon bitmaps at |bitmap_ids|
+  // which exist, in no particular order.
+  void GetFaviconBitmapsForIDs(const std::vector<FaviconBitmapID>& bitmap_ids,
+                               std::vector<FaviconBitmap>* favicon_bitmaps);
+
   // Adds a bitmap component at |pixel_size| for the favicon with |icon_id|.
   // Only favicons representing a .ico file should have multiple favicon bitmaps
   // per favicon.
@@ -176,6 +190,14 @@ class ThumbnailDatabase {
   bool GetIconMappingsForPageURL(const GURL& page_url,
                                  std::vector<IconMapping>* mapping_data);
 
+  // Sets |mappings| to the result of GetIconMappingsForPageURL() with
+  // |required_icon_types| for each of |page_urls| which has matching icon
+  // mappings, using a query per 50 pages rather than one per page.
+  void GetIconMappingsForPageURLs(
+      const std::vector<GURL>& page_urls,
+      int required_icon_types,
+      std::map<GURL, std::vector<IconMapping> >* mappings);
+
   // Adds a mapping between the given page_url and icon_id.
   // Returns the new mapping id if the adding succeeds, otherwise 0 is returned.
   IconMappingID AddIconMapping(const GURL& page_url, chrome::FaviconID icon_id);
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <algorithm>
+#include <map>
 #include <vector>
 
 #include "base/basictypes.h"
@@ -11,6 +12,7 @@
 #include "base/files/scoped_temp_dir.h"
 #include "base/memory/ref_counted_memory.h"
 #include "base/path_service.h"
+#include "base/strings/string_number_conversions.h"
 #include "chrome/browser/history/thumbnail_database.h"
 #include "chrome/common/chrome_paths.h"
 #include "sql/connection.h"
@@ -306,6 +308,83 @@ TEST_F(ThumbnailDatabaseTest, GetIconMappingsForPageURL) {
   EXPECT_EQ(id2, icon_mappings[1].icon_id);
 }
 
+// Test that the bulk lookups return the same data as the per-page and
+// per-icon ones, including for more keys than fit in one query.
+TEST_F(ThumbnailDatabaseTest, BulkLookups) {
+  ThumbnailDatabase db;
+  ASSERT_EQ(sql::INIT_OK, db.Init(file_name_));
+  db.BeginTransaction();
+
+  std::vector<unsigned char> data(kBlob1, kBlob1 + sizeof(kBlob1));
+  scoped_refptr<base::RefCountedBytes> favicon(new base::RefCountedBytes(data));
+  base::Time time = base::Time::Now();
+
+  // Every third page shares an icon with the page before it.
+  const size_t kPages = 120;
+  std::vector<GURL> page_urls;
+  std::vector<chrome::FaviconID> icon_ids;
+  chrome::FaviconID icon_id = 0;
+  for (size_t i = 0; i < kPages; ++i) {
+    GURL page_url("http://site" + base::Uint64ToString(i) + ".com/");
+    page_urls.push_back(page_url);
+    if (i % 3 != 2) {
+      icon_id = db.AddFavicon(GURL(page_url.spec() + "favicon.ico"),
+                              chrome::FAVICON);
+      db.AddFaviconBitmap(icon_id, favicon, time, kSmallSize);
+      db.AddFaviconBitmap(icon_id, favicon, time, kLargeSize);
+      icon_ids.push_back(icon_id);
+    }
+    EXPECT_LT(0, db.AddIconMapping(page_url, icon_id));
+  }
+  // A page without an icon and a duplicate request.
+  page_urls.push_back(GURL("http://noicon.com/"));
+  page_urls.push_back(page_urls[0]);
+
+  std::map<GURL, std::vector<IconMapping> > mappings;
+  db.GetIconMappingsForPageURLs(page_urls, chrome::FAVICON, &mappings);
+  EXPECT_EQ(kPages, mappings.size());
+  EXPECT_TRUE(mappings.find(GURL("http://noicon.com/")) == mappings.end());
+  for (size_t i = 0; i < kPages; ++i) {
+    std::vector<IconMapping> expected;
+    EXPECT_TRUE(db.GetIconMappingsForPageURL(page_urls[i], &expected));
+    ASSERT_EQ(expected.size(), mappings[page_urls[i]].size());
+    EXPECT_EQ(expected[0].icon_id, mappings[page_urls[i]][0].icon_id);
+    EXPECT_EQ(expected[0].icon_url, mappings[page_urls[i]][0].icon_url);
+  }
+
+  // No touch icons were added.
+  std::map<GURL, std::vector<IconMapping> > touch_mappings;
+  db.GetIconMappingsForPageURLs(page_urls, chrome::TOUCH_ICON,
+                                &touch_mappings);
+  EXPECT_TRUE(touch_mappings.empty());
+
+  std::map<chrome::FaviconID, std::vector<FaviconBitmapIDSize> > id_sizes;
+  db.GetFaviconBitmapIDSizesForIcons(icon_ids, &id_sizes);
+  EXPECT_EQ(icon_ids.size(), id_sizes.size());
+  std::vector<FaviconBitmapID> bitmap_ids;
+  for (size_t i = 0; i < icon_ids.size(); ++i) {
+    std::vector<FaviconBitmapIDSize> expected;
+    EXPECT_TRUE(db.GetFaviconBitmapIDSizes(icon_ids[i], &expected));
+    ASSERT_EQ(2u, expected.size());
+    ASSERT_EQ(expected.size(), id_sizes[icon_ids[i]].size());
+    for (size_t j = 0; j < expected.size(); ++j) {
+      EXPECT_EQ(expected[j].bitmap_id, id_sizes[icon_ids[i]][j].bitmap_id);
+      EXPECT_EQ(expected[j].pixel_size, id_sizes[icon_ids[i]][j].pixel_size);
+      bitmap_ids.push_back(expected[j].bitmap_id);
+    }
+  }
+
+  std::vector<FaviconBitmap> bitmaps;
+  db.GetFaviconBitmapsForIDs(bitmap_ids, &bitmaps);
+  ASSERT_EQ(bitmap_ids.size(), bitmaps.size());
+  for (size_t i = 0; i < bitmaps.size(); ++i) {
+    EXPECT_TRUE(std::find(bitmap_ids.begin(), bitmap_ids.end(),
+                          bitmaps[i].bitmap_id) != bitmap_ids.end());
+    ASSERT_TRUE(bitmaps[i].bitmap_data.get());
+    EXPECT_EQ(sizeof(kBlob1), bitmaps[i].bitmap_data->size());
+  }
+}
+
 TEST_F(ThumbnailDatabaseTest, RetainDataForPageUrls) {
   ThumbnailDatabase db;
 
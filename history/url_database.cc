@@ -5,6 +5,7 @@
 #include "chrome/browser/history/url_database.h"
 
 #include <algorithm>
+#include <iterator>
 #include <limits>
 #include <string>
 #include <vector>
@@ -41,7 +42,9 @@ bool URLDatabase::URLEnumerator::GetNextURL(URLRow* r) {
 }
 
 URLDatabase::URLDatabase()
-    : has_keyword_search_terms_(false) {
+    : has_keyword_search_terms_(false),
+      has_url_words_(false),
+      url_words_changed_(false) {
 }
 
 URLDatabase::~URLDatabase() {
@@ -116,6 +119,19 @@ URLID URLDatabase::GetRowForURL(const GURL& url, history::URLRow* info) {
 
 bool URLDatabase::UpdateURLRow(URLID url_id,
                                const history::URLRow& info) {
+  // The URL can't change, so the words only need updating with the title.
+  base::string16 old_url;
+  bool title_changed = false;
+  if (has_url_words_) {
+    sql::Statement old_statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+        "SELECT url, title FROM urls WHERE id=?"));
+    old_statement.BindInt64(0, url_id);
+    if (old_statement.Step()) {
+      old_url = old_statement.ColumnString16(0);
+      title_changed = old_statement.ColumnString16(1) != info.title();
+    }
+  }
+
   sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
       "UPDATE urls SET title=?,visit_count=?,typed_count=?,last_visit_time=?,"
         "hidden=?"
@@ -127,7 +143,12 @@ bool URLDatabase::UpdateURLRow(URLID url_id,
   statement.BindInt(4, info.hidden() ? 1 : 0);
   statement.BindInt64(5, url_id);
 
-  return statement.Run();
+  if (!statement.Run())
+    return false;
+
+  if (!title_changed)
+    return true;
+  return DeleteURLWords(url_id) && AddURLWords(url_id, old_url, info.title());
 }
 
 URLID URLDatabase::AddURLInternal(const history::URLRow& info,
@@ -165,7 +186,15 @@ URLID URLDatabase::AddURLInternal(const history::URLRow& info,
             << " to table history.urls.";
     return 0;
   }
-  return GetDB().GetLastInsertRowId();
+  URLID url_id = GetDB().GetLastInsertRowId();
+
+  // The temporary table's words are added when it replaces the URL table.
+  if (has_url_words_ && !is_temporary &&
+      !AddURLWords(url_id, base::UTF8ToUTF16(GURLToDatabaseURL(info.url())),
+                   info.title())) {
+    return 0;
+  }
+  return url_id;
 }
 
 bool URLDatabase::DeleteURLRow(URLID id) {
@@ -176,6 +205,9 @@ bool URLDatabase::DeleteURLRow(URLID id) {
   if (!statement.Run())
     return false;
 
+  if (has_url_words_ && !DeleteURLWords(id))
+    return false;
+
   // And delete any keyword visits.
   return !has_keyword_search_terms_ || DeleteKeywordSearchTermForURL(id);
 }
@@ -208,6 +240,10 @@ bool URLDatabase::CommitTemporaryURLTable() {
   // are created by HistoryDatabase::RecreateAllButStarAndURLTables().
   CreateMainURLIndex();
 
+  // The kept URLs were given new IDs, so their words must be added again.
+  if (has_url_words_ && !RebuildURLWordTable())
+    return false;
+
   return true;
 }
 
@@ -337,26 +373,61 @@ bool URLDatabase::GetTextMatches(const base::string16& query,
   query_parser_.ParseQueryNodes(query, &query_nodes.get());
 
   results->clear();
-  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
-      "SELECT" HISTORY_URL_ROW_FIELDS "FROM urls WHERE hidden = 0"));
+  if (query_nodes.empty())
+    return false;
 
-  while (statement.Step()) {
-    std::vector<QueryWord> query_words;
-    base::string16 url = base::i18n::ToLower(statement.ColumnString16(1));
-    query_parser_.ExtractQueryWords(url, &query_words);
-    GURL gurl(url);
-    if (gurl.is_valid()) {
-      // Decode punycode to match IDN.
-      // |query_words| won't be shown to user - therefore we can use empty
-      // |languages| to reduce dependency (no need to call PrefService).
-      base::string16 ascii = base::ASCIIToUTF16(gurl.host());
-      base::string16 utf = net::IDNToUnicode(gurl.host(), std::string());
-      if (ascii != utf)
-        query_parser_.ExtractQueryWords(utf, &query_words);
+  if (!has_url_words_) {
+    sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+        "SELECT" HISTORY_URL_ROW_FIELDS "FROM urls WHERE hidden = 0"));
+
+    while (statement.Step()) {
+      std::vector<QueryWord> query_words;
+      ExtractURLWords(statement.ColumnString16(1), statement.ColumnString16(2),
+                      &query_words);
+      if (query_parser_.DoesQueryMatch(query_words, query_nodes.get())) {
+        history::URLResult info;
+        FillURLRow(statement, &info);
+        if (info.url().is_valid())
+          results->push_back(info);
+      }
     }
-    base::string16 title = base::i18n::ToLower(statement.ColumnString16(2));
-    query_parser_.ExtractQueryWords(title, &query_words);
+    return !results->empty();
+  }
 
+  // Every node must match, so only URLs having words for all of them can
+  // match the query.
+  std::vector<URLID> candidates;
+  std::vector<URLID> node_url_ids;
+  std::vector<URLID> intersection;
+  for (size_t i = 0; i < query_nodes.size(); ++i) {
+    if (!GetURLIDsForQueryNode(*query_nodes[i], &node_url_ids))
+      return false;
+    if (i == 0) {
+      candidates.swap(node_url_ids);
+    } else {
+      intersection.clear();
+      std::set_intersection(candidates.begin(), candidates.end(),
+                            node_url_ids.begin(), node_url_ids.end(),
+                            std::back_inserter(intersection));
+      candidates.swap(intersection);
+    }
+    if (candidates.empty())
+      return false;
+  }
+
+  // Check the candidates the same way as the brute force search, which also
+  // takes care of the order of the words in phrases.
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "SELECT" HISTORY_URL_ROW_FIELDS "FROM urls WHERE id=? AND hidden = 0"));
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    statement.Reset(true);
+    statement.BindInt64(0, candidates[i]);
+    if (!statement.Step())
+      continue;
+
+    std::vector<QueryWord> query_words;
+    ExtractURLWords(statement.ColumnString16(1), statement.ColumnString16(2),
+                    &query_words);
     if (query_parser_.DoesQueryMatch(query_words, query_nodes.get())) {
       history::URLResult info;
       FillURLRow(statement, &info);
@@ -367,6 +438,167 @@ bool URLDatabase::GetTextMatches(const base::string16& query,
   return !results->empty();
 }
 
+void URLDatabase::ExtractURLWords(const base::string16& url,
+                                  const base::string16& title,
+                                  std::vector<QueryWord>* words) {
+  base::string16 lower_url = base::i18n::ToLower(url);
+  query_parser_.ExtractQueryWords(lower_url, words);
+  GURL gurl(lower_url);
+  if (gurl.is_valid()) {
+    // Decode punycode to match IDN.
+    // |words| won't be shown to user - therefore we can use empty
+    // |languages| to reduce dependency (no need to call PrefService).
+    base::string16 ascii = base::ASCIIToUTF16(gurl.host());
+    base::string16 utf = net::IDNToUnicode(gurl.host(), std::string());
+    if (ascii != utf)
+      query_parser_.ExtractQueryWords(utf, words);
+  }
+  query_parser_.ExtractQueryWords(base::i18n::ToLower(title), words);
+}
+
+bool URLDatabase::InitURLWordTable() {
+  has_url_words_ = true;
+  if (!GetDB().DoesTableExist("url_words")) {
+    if (!GetDB().Execute("CREATE TABLE url_words ("
+        "word LONGVARCHAR NOT NULL,"  // A word of the URL or title, lower case.
+        "url_id INTEGER NOT NULL)"))  // ID of the url.
+      return false;
+  }
+  return true;
+}
+
+bool URLDatabase::CreateURLWordIndices() {
+  // For searching.  Including the url_id lets lookups of a single word be
+  // answered from the index, in order of url_id.
+  if (!GetDB().Execute(
+          "CREATE INDEX IF NOT EXISTS url_words_index ON "
+          "url_words (word, url_id)")) {
+    return false;
+  }
+
+  // For deletion.
+  return GetDB().Execute(
+      "CREATE INDEX IF NOT EXISTS url_words_url_index ON url_words (url_id)");
+}
+
+bool URLDatabase::DropURLWordTable() {
+  has_url_words_ = false;
+  // This will implicitly delete the indices over the table.
+  return GetDB().Execute("DROP TABLE url_words");
+}
+
+bool URLDatabase::RebuildURLWordTable() {
+  DCHECK(has_url_words_);
+  url_words_changed_ = true;
+  if (!GetDB().Execute("DELETE FROM url_words"))
+    return false;
+
+  sql::Statement statement(GetDB().GetUniqueStatement(
+      "SELECT id, url, title FROM urls"));
+  while (statement.Step()) {
+    if (!AddURLWords(statement.ColumnInt64(0), statement.ColumnString16(1),
+                     statement.ColumnString16(2)))
+      return false;
+  }
+  return statement.Succeeded();
+}
+
+bool URLDatabase::AddURLWords(URLID url_id,
+                              const base::string16& url,
+                              const base::string16& title) {
+  std::vector<QueryWord> query_words;
+  ExtractURLWords(url, title, &query_words);
+
+  std::vector<base::string16> words;
+  words.reserve(query_words.size());
+  for (size_t i = 0; i < query_words.size(); ++i)
+    words.push_back(query_words[i].word);
+  std::sort(words.begin(), words.end());
+  words.erase(std::unique(words.begin(), words.end()), words.end());
+
+  url_words_changed_ = true;
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "INSERT INTO url_words (word, url_id) VALUES (?,?)"));
+  for (size_t i = 0; i < words.size(); ++i) {
+    statement.Reset(true);
+    statement.BindString16(0, words[i]);
+    statement.BindInt64(1, url_id);
+    if (!statement.Run())
+      return false;
+  }
+  return true;
+}
+
+bool URLDatabase::DeleteURLWords(URLID url_id) {
+  url_words_changed_ = true;
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "DELETE FROM url_words WHERE url_id=?"));
+  statement.BindInt64(0, url_id);
+  return statement.Run();
+}
+
+bool URLDatabase::GetURLIDsForQueryNode(const QueryNode& node,
+                                        std::vector<URLID>* url_ids) {
+  url_ids->clear();
+  std::vector<base::string16> words;
+  node.AppendWords(&words);
+  if (words.empty())
+    return true;
+
+  if (node.IsWord() &&
+      QueryParser::IsWordLongEnoughForPrefixSearch(words[0])) {
+    // A word matches any word it is a prefix of.  As with
+    // AutocompleteForPrefix(), compare in UTF-8, where a byte of 0xFF never
+    // occurs, so everything starting with the word sorts before the bound.
+    std::string prefix = base::UTF16ToUTF8(words[0]);
+    std::string end_prefix(prefix);
+    end_prefix.push_back(std::numeric_limits<unsigned char>::max());
+
+    sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+        "SELECT url_id FROM url_words WHERE word >= ? AND word < ?"));
+    statement.BindString(0, prefix);
+    statement.BindString(1, end_prefix);
+    while (statement.Step())
+      url_ids->push_back(statement.ColumnInt64(0));
+    if (!statement.Succeeded())
+      return false;
+
+    // Each of the matching words is in url_id order, but not the whole range.
+    std::sort(url_ids->begin(), url_ids->end());
+    url_ids->erase(std::unique(url_ids->begin(), url_ids->end()),
+                   url_ids->end());
+    return true;
+  }
+
+  // Short words, and the words of a phrase, must match exactly.
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "SELECT url_id FROM url_words WHERE word=? ORDER BY url_id"));
+  std::vector<URLID> word_url_ids;
+  std::vector<URLID> intersection;
+  for (size_t i = 0; i < words.size(); ++i) {
+    statement.Reset(true);
+    statement.BindString16(0, words[i]);
+    word_url_ids.clear();
+    while (statement.Step())
+      word_url_ids.push_back(statement.ColumnInt64(0));
+    if (!statement.Succeeded())
+      return false;
+
+    if (i == 0) {
+      url_ids->swap(word_url_ids);
+    } else {
+      intersection.clear();
+      std::set_intersection(url_ids->begin(), url_ids->end(),
+                            word_url_ids.begin(), word_url_ids.end(),
+                            std::back_inserter(intersection));
+      url_ids->swap(intersection);
+    }
+    if (url_ids->empty())
+      break;
+  }
+  return true;
+}
+
 bool URLDatabase::InitKeywordSearchTermsTable() {
   has_keyword_search_terms_ = true;
   if (!GetDB().DoesTableExist("keyword_search_terms")) {
@@ -179,8 +179,10 @@ class URLDatabase {
 
   // History search ------------------------------------------------------------
 
-  // Performs a brute force search over the database to find any URLs or titles
-  // which match the |query| string.  Returns any matches in |results|.
+  // Finds any URLs or titles which match the |query| string.  Returns any
+  // matches in |results|, in order of URL ID.  When the word table has been
+  // initialized only the rows holding the query's words are read, otherwise
+  // this is a brute force search over the whole URL table.
   bool GetTextMatches(const base::string16& query, URLRows* results);
 
   // Keyword Search Terms ------------------------------------------------------
@@ -262,6 +264,27 @@ class URLDatabase {
   // Deletes the keyword search terms table.
   bool DropKeywordSearchTermsTable();
 
+  // Ensures the table of the words in each URL and title exists.  Once this
+  // has been called the table is kept up to date as URLs are added, updated
+  // and deleted, and is used by GetTextMatches().
+  bool InitURLWordTable();
+
+  // Creates the index used to look up URLs by word.
+  bool CreateURLWordIndices();
+
+  // Deletes the word table.  GetTextMatches() goes back to searching the whole
+  // URL table.
+  bool DropURLWordTable();
+
+  // Replaces the contents of the word table with the words of every URL.
+  // Used to populate the table when migrating, and after the URL IDs change.
+  bool RebuildURLWordTable();
+
+  // True if the word table has been changed since the last call to
+  // clear_url_words_changed().
+  bool url_words_changed() const { return url_words_changed_; }
+  void clear_url_words_changed() { url_words_changed_ = false; }
+
   // Inserts the given URL row into the URLs table, using the regular table
   // if is_temporary is false, or the temporary URL table if is temporary is
   // true. The temporary table may only be used in between
@@ -277,10 +300,37 @@ class URLDatabase {
   virtual sql::Connection& GetDB() = 0;
 
  private:
+  // Extracts the words which GetTextMatches() matches queries against from the
+  // database form of a URL and its title.
+  void ExtractURLWords(const base::string16& url,
+                       const base::string16& title,
+                       std::vector<QueryWord>* words);
+
+  // Adds each distinct word of |url| and |title| to the word table.
+  bool AddURLWords(URLID url_id,
+                   const base::string16& url,
+                   const base::string16& title);
+
+  // Deletes the words of the given URL from the word table.
+  bool DeleteURLWords(URLID url_id);
+
+  // Replaces |url_ids| with the sorted IDs of the URLs having words which
+  // could satisfy |node|.  This is a superset of the URLs matching |node|,
+  // since a phrase's words need not be adjacent.
+  bool GetURLIDsForQueryNode(const QueryNode& node,
+                             std::vector<URLID>* url_ids);
+
   // True if InitKeywordSearchTermsTable() has been invoked. Not all subclasses
   // have keyword search terms.
   bool has_keyword_search_terms_;
 
+  // True if InitURLWordTable() has been invoked and the word table has not
+  // been dropped since.
+  bool has_url_words_;
+
+  // See url_words_changed().
+  bool url_words_changed_;
+
   QueryParser query_parser_;
 
   DISALLOW_COPY_AND_ASSIGN(URLDatabase);
@@ -0,0 +1,132 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/rand_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/url_database.h"
+#include "sql/connection.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace history {
+
+namespace {
+
+// Queries typed into the history page, from a common word matching many rows
+// to words matching only a few.
+const char* kQueries[] = {
+  "google", "mail", "google mail", "\"google mail\"", "wikipedia w12ord",
+  "w123", "w4567ord", "nomatch",
+};
+
+// Produces a pseudo-random word from a vocabulary skewed towards a few very
+// common words, as is typical for URLs and titles.
+std::string SyntheticWord(size_t vocabulary_size) {
+  const char* kCommonWords[] = {
+    "google", "mail", "wikipedia", "news", "search", "video", "home", "the",
+  };
+  if (base::RandInt(0, 3) == 0)
+    return kCommonWords[base::RandInt(0, arraysize(kCommonWords) - 1)];
+  int word_number = base::RandInt(0, static_cast<int>(vocabulary_size) - 1);
+  return "w" + base::IntToString(word_number) + "ord";
+}
+
+class URLDatabasePerfTest : public testing::Test,
+                            public URLDatabase {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+  }
+
+  // Provided for URLDatabase.
+  virtual sql::Connection& GetDB() OVERRIDE {
+    return db_;
+  }
+
+  // Fills a new database with |history_size| URLs and their words.
+  void BuildDatabase(size_t history_size) {
+    db_.Close();
+    base::FilePath db_file = temp_dir_.path().AppendASCII(
+        "URLPerf" + base::Uint64ToString(history_size) + ".db");
+    ASSERT_TRUE(db_.Open(db_file));
+    ASSERT_TRUE(CreateURLTable(false));
+    ASSERT_TRUE(CreateMainURLIndex());
+    ASSERT_TRUE(InitURLWordTable());
+    ASSERT_TRUE(CreateURLWordIndices());
+
+    const size_t kTitleWords = 6;
+    ASSERT_TRUE(db_.BeginTransaction());
+    for (size_t i = 0; i < history_size; ++i) {
+      URLRow row(GURL("http://www." + SyntheticWord(history_size) + ".com/" +
+                      base::Uint64ToString(i)));
+      std::string title = SyntheticWord(history_size);
+      for (size_t j = 1; j < kTitleWords; ++j)
+        title += " " + SyntheticWord(history_size);
+      row.set_title(base::UTF8ToUTF16(title));
+      row.set_last_visit(base::Time::Now());
+      ASSERT_TRUE(AddURL(row));
+    }
+    ASSERT_TRUE(db_.CommitTransaction());
+  }
+
+  void RunComparison(size_t history_size) {
+    const std::string trace = base::Uint64ToString(history_size) + "_rows";
+
+    base::TimeTicks start = base::TimeTicks::Now();
+    BuildDatabase(history_size);
+    perf_test::PrintResult("history_text_index_build", "", trace,
+                           (base::TimeTicks::Now() - start).InMillisecondsF(),
+                           "ms", true);
+
+    std::vector<URLRows> indexed_results(arraysize(kQueries));
+    start = base::TimeTicks::Now();
+    for (size_t i = 0; i < arraysize(kQueries); ++i)
+      GetTextMatches(base::UTF8ToUTF16(kQueries[i]), &indexed_results[i]);
+    base::TimeDelta indexed_time = base::TimeTicks::Now() - start;
+
+    ASSERT_TRUE(DropURLWordTable());
+    std::vector<URLRows> scan_results(arraysize(kQueries));
+    start = base::TimeTicks::Now();
+    for (size_t i = 0; i < arraysize(kQueries); ++i)
+      GetTextMatches(base::UTF8ToUTF16(kQueries[i]), &scan_results[i]);
+    base::TimeDelta scan_time = base::TimeTicks::Now() - start;
+
+    // Both searches must agree before their timings are worth comparing.
+    for (size_t i = 0; i < arraysize(kQueries); ++i) {
+      ASSERT_EQ(scan_results[i].size(), indexed_results[i].size())
+          << kQueries[i];
+      for (size_t j = 0; j < scan_results[i].size(); ++j)
+        EXPECT_EQ(scan_results[i][j].id(), indexed_results[i][j].id());
+    }
+
+    perf_test::PrintResult("history_text_query", "_scan", trace,
+                           scan_time.InMillisecondsF() / arraysize(kQueries),
+                           "ms", true);
+    perf_test::PrintResult("history_text_query", "_indexed", trace,
+                           indexed_time.InMillisecondsF() /
+                               arraysize(kQueries),
+                           "ms", true);
+  }
+
+ private:
+  base::ScopedTempDir temp_dir_;
+  sql::Connection db_;
+};
+
+}  // namespace
+
+TEST_F(URLDatabasePerfTest, TextQueryLatency) {
+  RunComparison(50000);
+  RunComparison(250000);
+  RunComparison(1000000);
+}
+
+}  // namespace history
@@ -30,6 +30,14 @@ bool IsURLRowEqual(const URLRow& a,
       a.hidden() == b.hidden();
 }
 
+// Returns the URLs of |rows| in order.
+std::vector<std::string> URLsOf(const URLRows& rows) {
+  std::vector<std::string> urls;
+  for (size_t i = 0; i < rows.size(); ++i)
+    urls.push_back(rows[i].url().spec());
+  return urls;
+}
+
 }  // namespace
 
 class URLDatabaseTest : public testing::Test,
@@ -57,6 +65,8 @@ class URLDatabaseTest : public testing::Test,
     CreateMainURLIndex();
     InitKeywordSearchTermsTable();
     CreateKeywordSearchTermsIndices();
+    InitURLWordTable();
+    CreateURLWordIndices();
   }
   virtual void TearDown() {
     db_.Close();
@@ -297,4 +307,125 @@ TEST_F(URLDatabaseTest, GetAndDeleteKeywordSearchTermByTerm) {
   EXPECT_TRUE(rows.empty());
 }
 
+// Test that GetTextMatches() finds the same URLs using the word table as by
+// searching the whole URL table.
+TEST_F(URLDatabaseTest, GetTextMatchesUsesWordTable) {
+  const struct {
+    const char* url;
+    const char* title;
+    bool hidden;
+  } kURLs[] = {
+    { "http://www.google.com/", "Google", false },
+    { "http://mail.google.com/mail", "Inbox - Google Mail", false },
+    { "http://www.example.com/mailbox", "Example mailbox", false },
+    { "http://www.example.com/hidden", "Google Hidden", true },
+    { "http://news.example.org/", "Mail news", false },
+    { "http://ab.example.org/", "An ab page", false },
+  };
+  for (size_t i = 0; i < arraysize(kURLs); ++i) {
+    URLRow row(GURL(kURLs[i].url));
+    row.set_title(base::UTF8ToUTF16(kURLs[i].title));
+    row.set_hidden(kURLs[i].hidden);
+    ASSERT_TRUE(AddURL(row));
+  }
+
+  const char* kQueries[] = {
+    "google", "goo", "GOOGLE MAIL", "mail", "mai", "\"google mail\"",
+    "\"google inbox\"", "ab", "a", "example mailbox", "hidden", "missing",
+    "com", "",
+  };
+  std::vector<URLRows> indexed_results(arraysize(kQueries));
+  for (size_t i = 0; i < arraysize(kQueries); ++i)
+    GetTextMatches(base::UTF8ToUTF16(kQueries[i]), &indexed_results[i]);
+
+  ASSERT_TRUE(DropURLWordTable());
+  for (size_t i = 0; i < arraysize(kQueries); ++i) {
+    URLRows results;
+    GetTextMatches(base::UTF8ToUTF16(kQueries[i]), &results);
+    EXPECT_EQ(URLsOf(results), URLsOf(indexed_results[i])) << kQueries[i];
+  }
+
+  // Spot check a few of the results.
+  EXPECT_EQ(2U, indexed_results[0].size());
+  EXPECT_EQ(1U, indexed_results[2].size());
+  EXPECT_EQ(3U, indexed_results[4].size());
+  EXPECT_EQ(1U, indexed_results[5].size());
+  EXPECT_TRUE(indexed_results[6].empty());
+  EXPECT_EQ(1U, indexed_results[7].size());
+  EXPECT_TRUE(indexed_results[10].empty());
+}
+
+// Test that the word table follows changes to the URL table.
+TEST_F(URLDatabaseTest, WordTableTracksURLChanges) {
+  URLRow row(GURL("http://www.example.com/"));
+  row.set_title(base::UTF8ToUTF16("Original title"));
+  URLID url_id = AddURL(row);
+  ASSERT_NE(0, url_id);
+
+  URLRows results;
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("original"), &results));
+
+  // Changing the title replaces its words.
+  row.set_title(base::UTF8ToUTF16("Replacement title"));
+  ASSERT_TRUE(UpdateURLRow(url_id, row));
+  EXPECT_FALSE(GetTextMatches(base::UTF8ToUTF16("original"), &results));
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("replacement"), &results));
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("example"), &results));
+
+  // Hiding the URL hides it from searches.
+  row.set_hidden(true);
+  ASSERT_TRUE(UpdateURLRow(url_id, row));
+  EXPECT_FALSE(GetTextMatches(base::UTF8ToUTF16("replacement"), &results));
+  row.set_hidden(false);
+  ASSERT_TRUE(UpdateURLRow(url_id, row));
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("replacement"), &results));
+
+  // Deleting the URL deletes its words.
+  ASSERT_TRUE(DeleteURLRow(url_id));
+  EXPECT_FALSE(GetTextMatches(base::UTF8ToUTF16("replacement"), &results));
+  sql::Statement statement(GetDB().GetUniqueStatement(
+      "SELECT count(*) FROM url_words"));
+  ASSERT_TRUE(statement.Step());
+  EXPECT_EQ(0, statement.ColumnInt(0));
+}
+
+// Test that the words of URLs kept when replacing the URL table are found
+// under their new IDs.
+TEST_F(URLDatabaseTest, WordTableFollowsTemporaryURLTable) {
+  URLRow dropped(GURL("http://www.dropped.com/"));
+  dropped.set_title(base::UTF8ToUTF16("Shared dropped"));
+  ASSERT_TRUE(AddURL(dropped));
+  URLRow kept(GURL("http://www.kept.com/"));
+  kept.set_title(base::UTF8ToUTF16("Shared kept"));
+  ASSERT_TRUE(AddURL(kept));
+
+  ASSERT_TRUE(CreateTemporaryURLTable());
+  URLID kept_id = AddTemporaryURL(kept);
+  ASSERT_NE(0, kept_id);
+  ASSERT_TRUE(CommitTemporaryURLTable());
+
+  URLRows results;
+  ASSERT_TRUE(GetTextMatches(base::UTF8ToUTF16("shared"), &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(kept_id, results[0].id());
+  EXPECT_EQ(kept.url(), results[0].url());
+  EXPECT_FALSE(GetTextMatches(base::UTF8ToUTF16("dropped"), &results));
+}
+
+// Test that RebuildURLWordTable() indexes URLs added without the word table,
+// as when migrating an existing database.
+TEST_F(URLDatabaseTest, RebuildURLWordTable) {
+  ASSERT_TRUE(DropURLWordTable());
+  URLRow row(GURL("http://www.example.com/"));
+  row.set_title(base::UTF8ToUTF16("Migrated page"));
+  ASSERT_TRUE(AddURL(row));
+
+  ASSERT_TRUE(InitURLWordTable());
+  ASSERT_TRUE(CreateURLWordIndices());
+  URLRows results;
+  EXPECT_FALSE(GetTextMatches(base::UTF8ToUTF16("migrated"), &results));
+  ASSERT_TRUE(RebuildURLWordTable());
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("migrated"), &results));
+}
+
 }  // namespace history
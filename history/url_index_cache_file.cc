@@ -0,0 +1,478 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_index_cache_file.h"
+
+#include <string.h>
+
+#include "base/file_util.h"
+#include "base/files/file_path.h"
+#include "base/hash.h"
+#include "base/logging.h"
+#include "base/strings/utf_string_conversions.h"
+
+namespace history {
+
+using url_index_cache_file::CharRecord;
+using url_index_cache_file::RowRecord;
+using url_index_cache_file::VisitRecord;
+
+namespace {
+
+// "HQPC", for HistoryQuickProvider Cache.
+const uint32 kMagic = 0x43505148;
+
+const uint32 kFlagHasWordStarts = 1 << 0;
+
+enum Section {
+  SECTION_WORD_OFFSETS,
+  SECTION_WORD_CHARS,
+  SECTION_POSTING_OFFSETS,
+  SECTION_POSTINGS,
+  SECTION_CHARS,
+  SECTION_CHAR_WORD_IDS,
+  SECTION_ROWS,
+  SECTION_STRINGS,
+  SECTION_VISITS,
+  SECTION_WORD_STARTS,
+  SECTION_COUNT,
+};
+
+struct CacheFileHeader {
+  uint32 magic;
+  uint32 format_version;
+  // base::SuperFastHash() of every byte following the header.
+  uint32 checksum;
+  uint32 flags;
+  int64 last_rebuild_time;
+  int32 data_version;
+  uint32 section_count;
+};
+
+struct SectionEntry {
+  uint32 offset;
+  uint32 size;
+};
+
+const size_t kSectionAlignment = 8;
+const size_t kSectionTableEnd =
+    sizeof(CacheFileHeader) + SECTION_COUNT * sizeof(SectionEntry);
+
+COMPILE_ASSERT(sizeof(CacheFileHeader) == 32, cache_file_header_size);
+COMPILE_ASSERT(sizeof(CharRecord) == 16, char_record_size);
+COMPILE_ASSERT(sizeof(RowRecord) == 64, row_record_size);
+COMPILE_ASSERT(sizeof(VisitRecord) == 16, visit_record_size);
+COMPILE_ASSERT(kSectionTableEnd % kSectionAlignment == 0,
+               section_table_alignment);
+
+// Returns true if [|offset|, |offset| + |count|) lies within [0, |limit|).
+bool RangeIsValid(uint64 offset, uint64 count, uint64 limit) {
+  return offset <= limit && count <= limit - offset;
+}
+
+// Returns true if |offsets| ascends from zero to |limit|.
+bool OffsetsAreValid(const uint32* offsets, size_t count, size_t limit) {
+  if (count == 0 || offsets[0] != 0 || offsets[count - 1] != limit)
+    return false;
+  for (size_t i = 1; i < count; ++i) {
+    if (offsets[i] < offsets[i - 1])
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+void AppendSection(int section,
+                   const T* data,
+                   size_t count,
+                   std::string* file_data) {
+  file_data->resize(
+      (file_data->size() + kSectionAlignment - 1) & ~(kSectionAlignment - 1));
+  SectionEntry* entry = reinterpret_cast<SectionEntry*>(
+      &(*file_data)[sizeof(CacheFileHeader)]) + section;
+  entry->offset = static_cast<uint32>(file_data->size());
+  entry->size = static_cast<uint32>(count * sizeof(T));
+  if (count)
+    file_data->append(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+template <typename T>
+void AppendSection(int section,
+                   const std::vector<T>& data,
+                   std::string* file_data) {
+  AppendSection(section, data.empty() ? NULL : &data[0], data.size(),
+                file_data);
+}
+
+}  // namespace
+
+// URLIndexCacheFileWriter -----------------------------------------------------
+
+URLIndexCacheFileWriter::URLIndexCacheFileWriter(base::Time last_rebuild_time,
+                                                 int data_version)
+    : last_rebuild_time_(last_rebuild_time),
+      data_version_(data_version),
+      has_word_starts_(true),
+      word_offsets_(1, 0),
+      posting_offsets_(1, 0) {
+}
+
+URLIndexCacheFileWriter::~URLIndexCacheFileWriter() {}
+
+void URLIndexCacheFileWriter::AddWord(const base::string16& word,
+                                      const HistoryIDSet& history_ids) {
+  word_chars_.append(word);
+  word_offsets_.push_back(static_cast<uint32>(word_chars_.size()));
+  postings_.insert(postings_.end(), history_ids.begin(), history_ids.end());
+  posting_offsets_.push_back(static_cast<uint32>(postings_.size()));
+}
+
+void URLIndexCacheFileWriter::AddChar(base::char16 c,
+                                      const WordIDSet& word_ids) {
+  DCHECK(chars_.empty() || chars_.back().character < c);
+  CharRecord record = {};
+  record.character = c;
+  record.word_ids_offset = static_cast<uint32>(char_word_ids_.size());
+  record.word_ids_count = static_cast<uint32>(word_ids.size());
+  char_word_ids_.insert(char_word_ids_.end(), word_ids.begin(),
+                        word_ids.end());
+  chars_.push_back(record);
+}
+
+void URLIndexCacheFileWriter::AddRow(const URLRow& row,
+                                     const VisitInfoVector& visits,
+                                     const RowWordStarts* word_starts) {
+  RowRecord record = {};
+  record.history_id = row.id();
+  record.last_visit = row.last_visit().ToInternalValue();
+  record.visit_count = row.visit_count();
+  record.typed_count = row.typed_count();
+
+  const std::string& url = row.url().spec();
+  record.url_offset = static_cast<uint32>(strings_.size());
+  record.url_length = static_cast<uint32>(url.size());
+  strings_.append(url);
+  const std::string title = base::UTF16ToUTF8(row.title());
+  record.title_offset = static_cast<uint32>(strings_.size());
+  record.title_length = static_cast<uint32>(title.size());
+  strings_.append(title);
+
+  record.visits_offset = static_cast<uint32>(visits_.size());
+  record.visits_count = static_cast<uint32>(visits.size());
+  for (VisitInfoVector::const_iterator iter = visits.begin();
+       iter != visits.end(); ++iter) {
+    VisitRecord visit = {};
+    visit.visit_time = iter->first.ToInternalValue();
+    visit.transition = iter->second;
+    visits_.push_back(visit);
+  }
+
+  if (!word_starts) {
+    has_word_starts_ = false;
+  } else {
+    record.url_starts_offset = static_cast<uint32>(word_starts_.size());
+    record.url_starts_count =
+        static_cast<uint32>(word_starts->url_word_starts_.size());
+    word_starts_.insert(word_starts_.end(),
+                        word_starts->url_word_starts_.begin(),
+                        word_starts->url_word_starts_.end());
+    record.title_starts_offset = static_cast<uint32>(word_starts_.size());
+    record.title_starts_count =
+        static_cast<uint32>(word_starts->title_word_starts_.size());
+    word_starts_.insert(word_starts_.end(),
+                        word_starts->title_word_starts_.begin(),
+                        word_starts->title_word_starts_.end());
+  }
+  rows_.push_back(record);
+}
+
+bool URLIndexCacheFileWriter::WriteToFile(
+    const base::FilePath& file_path) const {
+  std::string data;
+  Serialize(&data);
+  int size = static_cast<int>(data.size());
+  if (file_util::WriteFile(file_path, data.data(), size) != size) {
+    LOG(WARNING) << "Failed to write " << file_path.value();
+    return false;
+  }
+  return true;
+}
+
+void URLIndexCacheFileWriter::Serialize(std::string* data) const {
+  DCHECK(data);
+  data->assign(kSectionTableEnd, '\0');
+  AppendSection(SECTION_WORD_OFFSETS, word_offsets_, data);
+  AppendSection(SECTION_WORD_CHARS, word_chars_.data(), word_chars_.size(),
+                data);
+  AppendSection(SECTION_POSTING_OFFSETS, posting_offsets_, data);
+  AppendSection(SECTION_POSTINGS, postings_, data);
+  AppendSection(SECTION_CHARS, chars_, data);
+  AppendSection(SECTION_CHAR_WORD_IDS, char_word_ids_, data);
+  AppendSection(SECTION_ROWS, rows_, data);
+  AppendSection(SECTION_STRINGS, strings_.data(), strings_.size(), data);
+  AppendSection(SECTION_VISITS, visits_, data);
+  AppendSection(SECTION_WORD_STARTS, word_starts_, data);
+
+  CacheFileHeader header = {};
+  header.magic = kMagic;
+  header.format_version = kMappedCacheFileVersion;
+  header.flags = has_word_starts_ ? kFlagHasWordStarts : 0;
+  header.last_rebuild_time = last_rebuild_time_.ToInternalValue();
+  header.data_version = data_version_;
+  header.section_count = SECTION_COUNT;
+  header.checksum = base::SuperFastHash(
+      data->data() + sizeof(header),
+      static_cast<int>(data->size() - sizeof(header)));
+  memcpy(&(*data)[0], &header, sizeof(header));
+}
+
+// URLIndexCacheFileReader -----------------------------------------------------
+
+URLIndexCacheFileReader::URLIndexCacheFileReader() : data_(NULL), size_(0) {}
+
+URLIndexCacheFileReader::~URLIndexCacheFileReader() {}
+
+URLIndexCacheFileReader::OpenResult URLIndexCacheFileReader::Open(
+    const base::FilePath& file_path) {
+  if (!file_.Initialize(file_path))
+    return OPEN_FAILED;
+  return Validate(file_.data(), file_.length());
+}
+
+URLIndexCacheFileReader::OpenResult URLIndexCacheFileReader::OpenForTesting(
+    const std::string& data) {
+  return Validate(reinterpret_cast<const uint8*>(data.data()), data.size());
+}
+
+base::Time URLIndexCacheFileReader::last_rebuild_time() const {
+  return base::Time::FromInternalValue(
+      reinterpret_cast<const CacheFileHeader*>(data_)->last_rebuild_time);
+}
+
+int URLIndexCacheFileReader::data_version() const {
+  return reinterpret_cast<const CacheFileHeader*>(data_)->data_version;
+}
+
+size_t URLIndexCacheFileReader::word_count() const {
+  return SectionCount(SECTION_WORD_OFFSETS, sizeof(uint32)) - 1;
+}
+
+base::string16 URLIndexCacheFileReader::WordAt(size_t word_id) const {
+  DCHECK_LT(word_id, word_count());
+  const base::char16* chars =
+      reinterpret_cast<const base::char16*>(SectionData(SECTION_WORD_CHARS));
+  const uint32* offsets = word_offsets();
+  return base::string16(chars + offsets[word_id],
+                        chars + offsets[word_id + 1]);
+}
+
+const int64* URLIndexCacheFileReader::HistoryIDsForWord(size_t word_id,
+                                                        size_t* count) const {
+  DCHECK_LT(word_id, word_count());
+  const uint32* offsets =
+      reinterpret_cast<const uint32*>(SectionData(SECTION_POSTING_OFFSETS));
+  *count = offsets[word_id + 1] - offsets[word_id];
+  return reinterpret_cast<const int64*>(SectionData(SECTION_POSTINGS)) +
+      offsets[word_id];
+}
+
+size_t URLIndexCacheFileReader::char_count() const {
+  return SectionCount(SECTION_CHARS, sizeof(CharRecord));
+}
+
+base::char16 URLIndexCacheFileReader::CharAt(size_t index) const {
+  DCHECK_LT(index, char_count());
+  return static_cast<base::char16>(
+      reinterpret_cast<const CharRecord*>(SectionData(SECTION_CHARS))[index].
+          character);
+}
+
+const uint32* URLIndexCacheFileReader::WordIDsForChar(size_t index,
+                                                      size_t* count) const {
+  DCHECK_LT(index, char_count());
+  const CharRecord& record =
+      reinterpret_cast<const CharRecord*>(SectionData(SECTION_CHARS))[index];
+  *count = record.word_ids_count;
+  return reinterpret_cast<const uint32*>(
+      SectionData(SECTION_CHAR_WORD_IDS)) + record.word_ids_offset;
+}
+
+size_t URLIndexCacheFileReader::row_count() const {
+  return SectionCount(SECTION_ROWS, sizeof(RowRecord));
+}
+
+bool URLIndexCacheFileReader::has_word_starts() const {
+  return (reinterpret_cast<const CacheFileHeader*>(data_)->flags &
+          kFlagHasWordStarts) != 0;
+}
+
+void URLIndexCacheFileReader::RowAt(size_t index,
+                                    URLRow* row,
+                                    VisitInfoVector* visits,
+                                    RowWordStarts* word_starts) const {
+  DCHECK_LT(index, row_count());
+  const RowRecord& record = rows()[index];
+  const char* strings =
+      reinterpret_cast<const char*>(SectionData(SECTION_STRINGS));
+
+  *row = URLRow(GURL(std::string(strings + record.url_offset,
+                                 record.url_length)),
+                record.history_id);
+  row->set_visit_count(record.visit_count);
+  row->set_typed_count(record.typed_count);
+  row->set_last_visit(base::Time::FromInternalValue(record.last_visit));
+  row->set_title(base::UTF8ToUTF16(
+      std::string(strings + record.title_offset, record.title_length)));
+
+  const VisitRecord* visit_records =
+      reinterpret_cast<const VisitRecord*>(SectionData(SECTION_VISITS)) +
+      record.visits_offset;
+  visits->clear();
+  visits->reserve(record.visits_count);
+  for (uint32 i = 0; i < record.visits_count; ++i) {
+    visits->push_back(std::make_pair(
+        base::Time::FromInternalValue(visit_records[i].visit_time),
+        static_cast<content::PageTransition>(visit_records[i].transition)));
+  }
+
+  if (word_starts && has_word_starts()) {
+    const uint32* starts =
+        reinterpret_cast<const uint32*>(SectionData(SECTION_WORD_STARTS));
+    word_starts->url_word_starts_.assign(
+        starts + record.url_starts_offset,
+        starts + record.url_starts_offset + record.url_starts_count);
+    word_starts->title_word_starts_.assign(
+        starts + record.title_starts_offset,
+        starts + record.title_starts_offset + record.title_starts_count);
+  }
+}
+
+URLIndexCacheFileReader::OpenResult URLIndexCacheFileReader::Validate(
+    const uint8* data,
+    size_t size) {
+  if (size < sizeof(CacheFileHeader))
+    return OPEN_NOT_MAPPED_FORMAT;
+  const CacheFileHeader* header =
+      reinterpret_cast<const CacheFileHeader*>(data);
+  if (header->magic != kMagic)
+    return OPEN_NOT_MAPPED_FORMAT;
+  if (header->format_version != kMappedCacheFileVersion ||
+      header->section_count != SECTION_COUNT || size < kSectionTableEnd ||
+      size > static_cast<size_t>(kint32max)) {
+    return OPEN_FAILED;
+  }
+  const uint32 checksum = base::SuperFastHash(
+      reinterpret_cast<const char*>(data) + sizeof(CacheFileHeader),
+      static_cast<int>(size - sizeof(CacheFileHeader)));
+  if (checksum != header->checksum)
+    return OPEN_FAILED;
+
+  const SectionEntry* sections = reinterpret_cast<const SectionEntry*>(
+      data + sizeof(CacheFileHeader));
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    if (sections[i].offset < kSectionTableEnd ||
+        sections[i].offset % kSectionAlignment != 0 ||
+        !RangeIsValid(sections[i].offset, sections[i].size, size)) {
+      return OPEN_FAILED;
+    }
+  }
+  data_ = data;
+  size_ = size;
+  OpenResult result = ValidateSections();
+  if (result != OPEN_OK) {
+    data_ = NULL;
+    size_ = 0;
+  }
+  return result;
+}
+
+URLIndexCacheFileReader::OpenResult
+URLIndexCacheFileReader::ValidateSections() const {
+  const SectionEntry* sections = reinterpret_cast<const SectionEntry*>(
+      data_ + sizeof(CacheFileHeader));
+
+  // Every section must hold a whole number of its elements.
+  const size_t kElementSizes[SECTION_COUNT] = {
+    sizeof(uint32), sizeof(base::char16), sizeof(uint32), sizeof(int64),
+    sizeof(CharRecord), sizeof(uint32), sizeof(RowRecord), sizeof(char),
+    sizeof(VisitRecord), sizeof(uint32),
+  };
+  for (int i = 0; i < SECTION_COUNT; ++i) {
+    if (sections[i].size % kElementSizes[i] != 0)
+      return OPEN_FAILED;
+  }
+
+  // Cross-check the offsets which index into other sections.
+  const size_t word_offset_count =
+      SectionCount(SECTION_WORD_OFFSETS, sizeof(uint32));
+  if (!OffsetsAreValid(word_offsets(), word_offset_count,
+                       SectionCount(SECTION_WORD_CHARS,
+                                    sizeof(base::char16))) ||
+      SectionCount(SECTION_POSTING_OFFSETS, sizeof(uint32)) !=
+          word_offset_count ||
+      !OffsetsAreValid(
+          reinterpret_cast<const uint32*>(
+              SectionData(SECTION_POSTING_OFFSETS)),
+          word_offset_count, SectionCount(SECTION_POSTINGS, sizeof(int64)))) {
+    return OPEN_FAILED;
+  }
+
+  const size_t words = word_offset_count - 1;
+  const size_t char_word_id_count =
+      SectionCount(SECTION_CHAR_WORD_IDS, sizeof(uint32));
+  const uint32* char_word_ids =
+      reinterpret_cast<const uint32*>(SectionData(SECTION_CHAR_WORD_IDS));
+  for (size_t i = 0; i < char_word_id_count; ++i) {
+    if (char_word_ids[i] >= words)
+      return OPEN_FAILED;
+  }
+  const CharRecord* char_records =
+      reinterpret_cast<const CharRecord*>(SectionData(SECTION_CHARS));
+  for (size_t i = 0; i < char_count(); ++i) {
+    if (!RangeIsValid(char_records[i].word_ids_offset,
+                      char_records[i].word_ids_count, char_word_id_count))
+      return OPEN_FAILED;
+  }
+
+  const size_t strings_size = SectionCount(SECTION_STRINGS, sizeof(char));
+  const size_t visit_count = SectionCount(SECTION_VISITS, sizeof(VisitRecord));
+  const size_t word_start_count =
+      SectionCount(SECTION_WORD_STARTS, sizeof(uint32));
+  for (size_t i = 0; i < row_count(); ++i) {
+    const RowRecord& row = rows()[i];
+    if (!RangeIsValid(row.url_offset, row.url_length, strings_size) ||
+        !RangeIsValid(row.title_offset, row.title_length, strings_size) ||
+        !RangeIsValid(row.visits_offset, row.visits_count, visit_count) ||
+        !RangeIsValid(row.url_starts_offset, row.url_starts_count,
+                      word_start_count) ||
+        !RangeIsValid(row.title_starts_offset, row.title_starts_count,
+                      word_start_count)) {
+      return OPEN_FAILED;
+    }
+  }
+  return OPEN_OK;
+}
+
+const uint8* URLIndexCacheFileReader::SectionData(int section) const {
+  const SectionEntry* sections = reinterpret_cast<const SectionEntry*>(
+      data_ + sizeof(CacheFileHeader));
+  return data_ + sections[section].offset;
+}
+
+size_t URLIndexCacheFileReader::SectionCount(int section,
+                                             size_t element_size) const {
+  const SectionEntry* sections = reinterpret_cast<const SectionEntry*>(
+      data_ + sizeof(CacheFileHeader));
+  return sections[section].size / element_size;
+}
+
+const uint32* URLIndexCacheFileReader::word_offsets() const {
+  return reinterpret_cast<const uint32*>(SectionData(SECTION_WORD_OFFSETS));
+}
+
+const RowRecord* URLIndexCacheFileReader::rows() const {
+  return reinterpret_cast<const RowRecord*>(SectionData(SECTION_ROWS));
+}
+
+}  // namespace history
@@ -0,0 +1,210 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_URL_INDEX_CACHE_FILE_H_
+#define CHROME_BROWSER_HISTORY_URL_INDEX_CACHE_FILE_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/strings/string16.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/in_memory_url_index_types.h"
+
+namespace base {
+class FilePath;
+}
+
+namespace history {
+
+// The InMemoryURLIndex cache file format, designed to be memory-mapped and
+// read in place rather than parsed. Every section is a flat array of
+// fixed-size records, so looking up a word's posting list or a row's URL is
+// pointer arithmetic into the mapping; nothing is copied until the caller
+// materializes it.
+//
+// The file begins with a fixed header holding a magic number, the format
+// version and a checksum of everything that follows, then a table of section
+// offsets, then the sections themselves, each 8-byte aligned. Integers are in
+// host byte order: the cache never leaves the machine it was written on.
+//
+// Sections:
+//   word offsets      uint32[word_count + 1] into the word characters.
+//   word characters   char16[], the concatenated words. A WordID is the
+//                     word's index; removed words occupy empty slots.
+//   posting offsets   uint32[word_count + 1] into the postings.
+//   postings          int64[], each word's sorted HistoryIDs.
+//   chars             CharRecord[], sorted by character.
+//   char word IDs     uint32[], each character's sorted WordIDs.
+//   rows              RowRecord[], one per indexed history item.
+//   strings           UTF-8 URLs and titles referenced by the rows.
+//   visits            VisitRecord[] referenced by the rows.
+//   word starts       uint32[] referenced by the rows.
+
+// Version of the mapped format itself. Unrelated to kCurrentCacheFileVersion,
+// which describes the index contents and is stored in the header alongside.
+const uint32 kMappedCacheFileVersion = 1;
+
+namespace url_index_cache_file {
+
+// On-disk records. The layouts are part of the format: changing them requires
+// bumping kMappedCacheFileVersion.
+struct CharRecord {
+  uint32 character;
+  uint32 word_ids_offset;
+  uint32 word_ids_count;
+  uint32 padding;
+};
+
+struct RowRecord {
+  int64 history_id;
+  int64 last_visit;
+  int32 visit_count;
+  int32 typed_count;
+  uint32 url_offset;
+  uint32 url_length;
+  uint32 title_offset;
+  uint32 title_length;
+  uint32 visits_offset;
+  uint32 visits_count;
+  uint32 url_starts_offset;
+  uint32 url_starts_count;
+  uint32 title_starts_offset;
+  uint32 title_starts_count;
+};
+
+struct VisitRecord {
+  int64 visit_time;
+  int32 transition;
+  int32 padding;
+};
+
+}  // namespace url_index_cache_file
+
+// Accumulates the contents of a cache file and writes it out. Words must be
+// added in WordID order and characters in ascending order.
+class URLIndexCacheFileWriter {
+ public:
+  URLIndexCacheFileWriter(base::Time last_rebuild_time, int data_version);
+  ~URLIndexCacheFileWriter();
+
+  // Adds the word with the next WordID and the history items containing it.
+  // Free word slots are added as an empty |word| with no |history_ids|.
+  void AddWord(const base::string16& word, const HistoryIDSet& history_ids);
+
+  // Adds the words containing the character |c|.
+  void AddChar(base::char16 c, const WordIDSet& word_ids);
+
+  // Adds an indexed history item. |word_starts| may be NULL, in which case no
+  // word starts are stored for any row and the reader's has_word_starts()
+  // returns false.
+  void AddRow(const URLRow& row,
+              const VisitInfoVector& visits,
+              const RowWordStarts* word_starts);
+
+  // Serializes everything added so far into |file_path|. Returns false if the
+  // file could not be written.
+  bool WriteToFile(const base::FilePath& file_path) const;
+
+  // Serializes everything added so far into |data|. Exposed for testing.
+  void Serialize(std::string* data) const;
+
+ private:
+  base::Time last_rebuild_time_;
+  int data_version_;
+  bool has_word_starts_;
+
+  std::vector<uint32> word_offsets_;
+  base::string16 word_chars_;
+  std::vector<uint32> posting_offsets_;
+  std::vector<int64> postings_;
+  std::vector<url_index_cache_file::CharRecord> chars_;
+  std::vector<uint32> char_word_ids_;
+  std::vector<url_index_cache_file::RowRecord> rows_;
+  std::string strings_;
+  std::vector<url_index_cache_file::VisitRecord> visits_;
+  std::vector<uint32> word_starts_;
+
+  DISALLOW_COPY_AND_ASSIGN(URLIndexCacheFileWriter);
+};
+
+// Maps a cache file and provides in-place access to its contents. All offsets
+// are validated when the file is opened, so the accessors never read outside
+// the mapping.
+class URLIndexCacheFileReader {
+ public:
+  enum OpenResult {
+    // The file was mapped and validated.
+    OPEN_OK,
+    // The file is not in the mapped format, e.g. a legacy protobuf cache.
+    OPEN_NOT_MAPPED_FORMAT,
+    // The file is in the mapped format but could not be read, is from a
+    // different format version, fails its checksum or is internally
+    // inconsistent.
+    OPEN_FAILED,
+  };
+
+  URLIndexCacheFileReader();
+  ~URLIndexCacheFileReader();
+
+  OpenResult Open(const base::FilePath& file_path);
+
+  // Validates and adopts an in-memory image, as produced by
+  // URLIndexCacheFileWriter::Serialize(). |data| must outlive this object.
+  // Exposed for testing.
+  OpenResult OpenForTesting(const std::string& data);
+
+  base::Time last_rebuild_time() const;
+  int data_version() const;
+  size_t file_size() const { return size_; }
+
+  size_t word_count() const;
+  base::string16 WordAt(size_t word_id) const;
+  // Returns the sorted HistoryIDs for |word_id| in place, storing the number
+  // of entries in |count|.
+  const int64* HistoryIDsForWord(size_t word_id, size_t* count) const;
+
+  size_t char_count() const;
+  base::char16 CharAt(size_t index) const;
+  // Returns the sorted WordIDs for the |index|th character in place, storing
+  // the number of entries in |count|.
+  const uint32* WordIDsForChar(size_t index, size_t* count) const;
+
+  size_t row_count() const;
+  bool has_word_starts() const;
+  // Materializes the |index|th row. |word_starts| is only filled in if
+  // has_word_starts() and may be NULL.
+  void RowAt(size_t index,
+             URLRow* row,
+             VisitInfoVector* visits,
+             RowWordStarts* word_starts) const;
+
+ private:
+  // Checks the header and checksum of |data| and adopts it.
+  OpenResult Validate(const uint8* data, size_t size);
+
+  // Checks that every section and every offset between sections is in bounds.
+  OpenResult ValidateSections() const;
+
+  // Returns a pointer to the start of |section| and its size in elements of
+  // |element_size| bytes.
+  const uint8* SectionData(int section) const;
+  size_t SectionCount(int section, size_t element_size) const;
+
+  // Typed accessors for the sections.
+  const uint32* word_offsets() const;
+  const url_index_cache_file::RowRecord* rows() const;
+
+  base::MemoryMappedFile file_;
+  const uint8* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(URLIndexCacheFileReader);
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_URL_INDEX_CACHE_FILE_H_
@@ -0,0 +1,183 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_index_cache_file.h"
+
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/utf_string_conversions.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using base::ASCIIToUTF16;
+
+namespace history {
+
+class URLIndexCacheFileTest : public testing::Test {
+ protected:
+  URLIndexCacheFileTest()
+      : rebuild_time_(base::Time::FromInternalValue(1234567890)) {}
+
+  // Fills |writer| with two words, one free word slot, two characters and
+  // two rows, the second of which has visits.
+  void PopulateWriter(URLIndexCacheFileWriter* writer) {
+    HistoryIDSet history_ids;
+    history_ids.insert(1);
+    history_ids.insert(2);
+    writer->AddWord(ASCIIToUTF16("foo"), history_ids);
+    writer->AddWord(base::string16(), HistoryIDSet());
+    history_ids.erase(1);
+    writer->AddWord(ASCIIToUTF16("bar"), history_ids);
+
+    WordIDSet word_ids;
+    word_ids.insert(0);
+    writer->AddChar('f', word_ids);
+    word_ids.insert(2);
+    writer->AddChar('o', word_ids);
+
+    URLRow row1(GURL("http://foo.com/"), 1);
+    row1.set_title(ASCIIToUTF16("Foo"));
+    row1.set_visit_count(3);
+    row1.set_typed_count(1);
+    row1.set_last_visit(base::Time::FromInternalValue(1000));
+    RowWordStarts starts1;
+    starts1.url_word_starts_.push_back(0);
+    starts1.url_word_starts_.push_back(7);
+    starts1.title_word_starts_.push_back(0);
+    writer->AddRow(row1, VisitInfoVector(), &starts1);
+
+    URLRow row2(GURL("http://bar.com/foo"), 2);
+    VisitInfoVector visits;
+    visits.push_back(std::make_pair(base::Time::FromInternalValue(2000),
+                                    content::PAGE_TRANSITION_TYPED));
+    visits.push_back(std::make_pair(base::Time::FromInternalValue(3000),
+                                    content::PAGE_TRANSITION_LINK));
+    RowWordStarts starts2;
+    starts2.url_word_starts_.push_back(0);
+    writer->AddRow(row2, visits, &starts2);
+  }
+
+  const base::Time rebuild_time_;
+};
+
+TEST_F(URLIndexCacheFileTest, RoundTrip) {
+  URLIndexCacheFileWriter writer(rebuild_time_, 4);
+  PopulateWriter(&writer);
+  std::string data;
+  writer.Serialize(&data);
+
+  URLIndexCacheFileReader reader;
+  ASSERT_EQ(URLIndexCacheFileReader::OPEN_OK, reader.OpenForTesting(data));
+  EXPECT_EQ(rebuild_time_, reader.last_rebuild_time());
+  EXPECT_EQ(4, reader.data_version());
+
+  ASSERT_EQ(3U, reader.word_count());
+  EXPECT_EQ(ASCIIToUTF16("foo"), reader.WordAt(0));
+  EXPECT_TRUE(reader.WordAt(1).empty());
+  EXPECT_EQ(ASCIIToUTF16("bar"), reader.WordAt(2));
+  size_t count = 0;
+  const int64* history_ids = reader.HistoryIDsForWord(0, &count);
+  ASSERT_EQ(2U, count);
+  EXPECT_EQ(1, history_ids[0]);
+  EXPECT_EQ(2, history_ids[1]);
+  reader.HistoryIDsForWord(1, &count);
+  EXPECT_EQ(0U, count);
+  history_ids = reader.HistoryIDsForWord(2, &count);
+  ASSERT_EQ(1U, count);
+  EXPECT_EQ(2, history_ids[0]);
+
+  ASSERT_EQ(2U, reader.char_count());
+  EXPECT_EQ('f', reader.CharAt(0));
+  EXPECT_EQ('o', reader.CharAt(1));
+  const uint32* word_ids = reader.WordIDsForChar(1, &count);
+  ASSERT_EQ(2U, count);
+  EXPECT_EQ(0U, word_ids[0]);
+  EXPECT_EQ(2U, word_ids[1]);
+
+  ASSERT_EQ(2U, reader.row_count());
+  ASSERT_TRUE(reader.has_word_starts());
+  URLRow row;
+  VisitInfoVector visits;
+  RowWordStarts word_starts;
+  reader.RowAt(0, &row, &visits, &word_starts);
+  EXPECT_EQ(1, row.id());
+  EXPECT_EQ(GURL("http://foo.com/"), row.url());
+  EXPECT_EQ(ASCIIToUTF16("Foo"), row.title());
+  EXPECT_EQ(3, row.visit_count());
+  EXPECT_EQ(1, row.typed_count());
+  EXPECT_EQ(base::Time::FromInternalValue(1000), row.last_visit());
+  EXPECT_TRUE(visits.empty());
+  ASSERT_EQ(2U, word_starts.url_word_starts_.size());
+  EXPECT_EQ(7U, word_starts.url_word_starts_[1]);
+  ASSERT_EQ(1U, word_starts.title_word_starts_.size());
+
+  reader.RowAt(1, &row, &visits, &word_starts);
+  EXPECT_EQ(2, row.id());
+  EXPECT_TRUE(row.title().empty());
+  ASSERT_EQ(2U, visits.size());
+  EXPECT_EQ(base::Time::FromInternalValue(3000), visits[1].first);
+  EXPECT_EQ(content::PAGE_TRANSITION_LINK, visits[1].second);
+  EXPECT_EQ(1U, word_starts.url_word_starts_.size());
+  EXPECT_TRUE(word_starts.title_word_starts_.empty());
+}
+
+TEST_F(URLIndexCacheFileTest, WithoutWordStarts) {
+  URLIndexCacheFileWriter writer(rebuild_time_, 4);
+  writer.AddWord(ASCIIToUTF16("foo"), HistoryIDSet());
+  writer.AddRow(URLRow(GURL("http://foo.com/"), 1), VisitInfoVector(), NULL);
+  std::string data;
+  writer.Serialize(&data);
+
+  URLIndexCacheFileReader reader;
+  ASSERT_EQ(URLIndexCacheFileReader::OPEN_OK, reader.OpenForTesting(data));
+  EXPECT_FALSE(reader.has_word_starts());
+}
+
+TEST_F(URLIndexCacheFileTest, RejectsOtherFormats) {
+  URLIndexCacheFileReader reader;
+  EXPECT_EQ(URLIndexCacheFileReader::OPEN_NOT_MAPPED_FORMAT,
+            reader.OpenForTesting(std::string()));
+  // A protobuf cache starts with a field tag rather than the magic number.
+  EXPECT_EQ(URLIndexCacheFileReader::OPEN_NOT_MAPPED_FORMAT,
+            reader.OpenForTesting(std::string(64, '\x08')));
+}
+
+TEST_F(URLIndexCacheFileTest, RejectsCorruption) {
+  URLIndexCacheFileWriter writer(rebuild_time_, 4);
+  PopulateWriter(&writer);
+  std::string data;
+  writer.Serialize(&data);
+
+  // Any flipped bit after the header fails the checksum.
+  for (size_t i = 32; i < data.size(); i += 7) {
+    std::string corrupt(data);
+    corrupt[i] ^= 0x10;
+    URLIndexCacheFileReader reader;
+    EXPECT_EQ(URLIndexCacheFileReader::OPEN_FAILED,
+              reader.OpenForTesting(corrupt)) << "offset " << i;
+  }
+
+  // So does truncation.
+  URLIndexCacheFileReader reader;
+  EXPECT_EQ(URLIndexCacheFileReader::OPEN_FAILED,
+            reader.OpenForTesting(data.substr(0, data.size() - 8)));
+}
+
+TEST_F(URLIndexCacheFileTest, WriteAndMap) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.path().AppendASCII("cache");
+
+  URLIndexCacheFileWriter writer(rebuild_time_, 4);
+  PopulateWriter(&writer);
+  ASSERT_TRUE(writer.WriteToFile(path));
+
+  URLIndexCacheFileReader reader;
+  ASSERT_EQ(URLIndexCacheFileReader::OPEN_OK, reader.Open(path));
+  EXPECT_EQ(3U, reader.word_count());
+  EXPECT_EQ(2U, reader.row_count());
+}
+
+}  // namespace history
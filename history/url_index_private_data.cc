@@ -8,16 +8,22 @@
 #include <functional>
 #include <iterator>
 #include <limits>
+#include <map>
 #include <numeric>
 #include <string>
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/bind.h"
 #include "base/file_util.h"
 #include "base/i18n/case_conversion.h"
+#include "base/memory/scoped_vector.h"
 #include "base/metrics/histogram.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/sys_info.h"
+#include "base/task_runner.h"
+#include "base/threading/sequenced_worker_pool.h"
 #include "base/time/time.h"
 #include "chrome/browser/autocomplete/autocomplete_provider.h"
 #include "chrome/browser/autocomplete/url_prefix.h"
@@ -26,6 +32,8 @@
 #include "chrome/browser/history/history_db_task.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/in_memory_url_index.h"
+#include "chrome/browser/history/sorted_id_intersection.h"
+#include "chrome/browser/history/url_index_cache_file.h"
 #include "content/public/browser/browser_thread.h"
 #include "content/public/browser/notification_details.h"
 #include "content/public/browser/notification_service.h"
@@ -44,6 +52,36 @@ using in_memory_url_index::InMemoryURLIndexCacheItem;
 
 namespace {
 static const size_t kMaxVisitsToStoreInCache = 10u;
+
+// A parallel rebuild gives each shard at least this many rows; below that the
+// cost of handing a shard to another thread outweighs the work in it.
+static const size_t kMinRowsPerRebuildShard = 1000u;
+
+void StoreRebuiltData(
+    scoped_refptr<history::URLIndexPrivateData>* result,
+    scoped_refptr<history::URLIndexPrivateData> private_data) {
+  *result = private_data;
+}
+
+// Outcomes of looking up a search term in the search term cache. These values
+// are written to logs. New values should be added before
+// SEARCH_TERM_CACHE_LOOKUP_COUNT and existing values should not be reordered.
+enum SearchTermCacheLookup {
+  // The term itself was cached.
+  SEARCH_TERM_CACHE_HIT = 0,
+  // A prefix of the term was cached, so only the words matching that prefix
+  // were searched.
+  SEARCH_TERM_CACHE_PREFIX_HIT = 1,
+  // Nothing was cached, so the whole index was searched.
+  SEARCH_TERM_CACHE_MISS = 2,
+  SEARCH_TERM_CACHE_LOOKUP_COUNT
+};
+
+void RecordSearchTermCacheLookup(SearchTermCacheLookup lookup) {
+  UMA_HISTOGRAM_ENUMERATION("History.InMemoryURLIndexSearchTermCacheLookup",
+                            lookup, SEARCH_TERM_CACHE_LOOKUP_COUNT);
+}
+
 }  // anonymous namespace
 
 namespace history {
@@ -78,6 +116,89 @@ bool LengthGreater(const base::string16& string_a,
   return string_a.length() > string_b.length();
 }
 
+// Comparison function for sorting ID sets by ascending size.
+template <typename IDSet>
+bool IDSetSizeLess(const IDSet* set_a, const IDSet* set_b) {
+  return set_a->size() < set_b->size();
+}
+
+// Returns the intersection of all of the sets in |unsorted_sets|. The sets are
+// intersected smallest first so that the working set shrinks as quickly as
+// possible. The sets are flattened into sorted arrays and handed to the
+// IntersectSortedIDs() kernel unless some ID does not fit in 32 bits, in which
+// case std::set_intersection is used instead.
+template <typename IDSet>
+IDSet IntersectIDSets(const std::vector<const IDSet*>& unsorted_sets) {
+  if (unsorted_sets.empty())
+    return IDSet();
+  std::vector<const IDSet*> sets(unsorted_sets);
+  std::sort(sets.begin(), sets.end(), IDSetSizeLess<IDSet>);
+  if (sets.front()->empty())
+    return IDSet();
+  if (sets.size() == 1)
+    return *sets.front();
+
+  bool fits_in_32_bits = true;
+  for (size_t i = 0; i < sets.size() && fits_in_32_bits; ++i) {
+    fits_in_32_bits = static_cast<uint64>(*sets[i]->rbegin()) <= kuint32max &&
+        static_cast<uint64>(*sets[i]->begin()) <= kuint32max;
+  }
+  if (!fits_in_32_bits) {
+    IDSet result(*sets.front());
+    for (size_t i = 1; i < sets.size() && !result.empty(); ++i) {
+      IDSet new_result;
+      std::set_intersection(result.begin(), result.end(),
+                            sets[i]->begin(), sets[i]->end(),
+                            std::inserter(new_result, new_result.begin()));
+      result.swap(new_result);
+    }
+    return result;
+  }
+
+  std::vector<uint32> result(sets.front()->begin(), sets.front()->end());
+  std::vector<uint32> other;
+  std::vector<uint32> new_result;
+  for (size_t i = 1; i < sets.size() && !result.empty(); ++i) {
+    other.assign(sets[i]->begin(), sets[i]->end());
+    IntersectSortedIDs(result, other, &new_result);
+    result.swap(new_result);
+  }
+  return IDSet(result.begin(), result.end());
+}
+
+// Returns the copy of |row| which is stored in the index: its URL has any
+// username and password stripped.
+URLRow IndexableRow(const URLRow& row, const std::string& languages) {
+  base::string16 url(net::FormatUrl(row.url(), languages,
+      net::kFormatUrlOmitUsernamePassword,
+      net::UnescapeRule::NONE,
+      NULL, NULL, NULL));
+  URLRow new_row(GURL(url), row.id());
+  new_row.set_visit_count(row.visit_count());
+  new_row.set_typed_count(row.typed_count());
+  new_row.set_last_visit(row.last_visit());
+  new_row.set_title(row.title());
+  return new_row;
+}
+
+// Splits the URL and page title of |row| into individual, unique words,
+// saving the word starts of each in |word_starts| if it is not NULL.
+String16Set IndexableWordsForRow(const URLRow& row,
+                                 RowWordStarts* word_starts,
+                                 const std::string& languages) {
+  const base::string16& url = CleanUpUrlForMatching(row.url(), languages);
+  String16Set url_words = String16SetFromString16(url,
+      word_starts ? &word_starts->url_word_starts_ : NULL);
+  const base::string16& title = CleanUpTitleForMatching(row.title());
+  String16Set title_words = String16SetFromString16(title,
+      word_starts ? &word_starts->title_word_starts_ : NULL);
+  String16Set words;
+  std::set_union(url_words.begin(), url_words.end(),
+                 title_words.begin(), title_words.end(),
+                 std::insert_iterator<String16Set>(words, words.begin()));
+  return words;
+}
+
 
 // UpdateRecentVisitsFromHistoryDBTask -----------------------------------------
 
@@ -191,7 +312,7 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
 
   // Reset used_ flags for search_term_cache_. We use a basic mark-and-sweep
   // approach.
-  ResetSearchTermCache();
+  search_term_cache_.MarkAllUnused();
 
   HistoryIDSet history_id_set = HistoryIDSetFromWords(lower_words);
 
@@ -246,9 +367,22 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
     // but this is such a rare edge case that it's not worth the time.
     return scored_items;
   }
-  scored_items = std::for_each(history_id_set.begin(), history_id_set.end(),
-      AddHistoryMatch(*this, languages, bookmark_service, lower_raw_string,
-                      lower_raw_terms, base::Time::Now())).ScoredMatches();
+  ScoredHistoryMatch::Candidates candidates;
+  candidates.reserve(history_id_set.size());
+  for (HistoryIDSet::const_iterator iter = history_id_set.begin();
+       iter != history_id_set.end(); ++iter) {
+    HistoryInfoMap::const_iterator hist_pos = history_info_map_.find(*iter);
+    if (hist_pos == history_info_map_.end())
+      continue;
+    WordStartsMap::const_iterator starts_pos = word_starts_map_.find(*iter);
+    DCHECK(starts_pos != word_starts_map_.end());
+    candidates.push_back(ScoredHistoryMatch::Candidate(
+        &hist_pos->second.url_row, &hist_pos->second.visits,
+        &starts_pos->second));
+  }
+  ScoredHistoryMatch::ScoreCandidates(candidates, languages, lower_raw_string,
+                                      lower_raw_terms, base::Time::Now(),
+                                      bookmark_service, &scored_items);
 
   // Select and sort only the top kMaxMatches results.
   if (scored_items.size() > AutocompleteProvider::kMaxMatches) {
@@ -267,14 +401,8 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
   if (was_trimmed) {
     search_term_cache_.clear();  // Invalidate the term cache.
   } else {
-    // Remove any stale SearchTermCacheItems.
-    for (SearchTermCacheMap::iterator cache_iter = search_term_cache_.begin();
-         cache_iter != search_term_cache_.end(); ) {
-      if (!cache_iter->second.used_)
-        search_term_cache_.erase(cache_iter++);
-      else
-        ++cache_iter;
-    }
+    // Remove any stale search term cache items.
+    search_term_cache_.RemoveUnused();
   }
 
   return scored_items;
@@ -291,7 +419,7 @@ bool URLIndexPrivateData::UpdateURL(
   // is deleted from the index.
   bool row_was_updated = false;
   URLID row_id = row.id();
-  HistoryInfoMap::iterator row_pos = history_info_map_.find(row_id);
+  HistoryInfoMap::const_iterator row_pos = history_info_map_.find(row_id);
   if (row_pos == history_info_map_.end()) {
     // This new row should be indexed if it qualifies.
     URLRow new_row(row);
@@ -302,11 +430,12 @@ bool URLIndexPrivateData::UpdateURL(
     // This indexed row still qualifies and will be re-indexed.
     // The url won't have changed but the title, visit count, etc.
     // might have changed.
-    URLRow& row_to_update = row_pos->second.url_row;
-    bool title_updated = row_to_update.title() != row.title();
-    if (row_to_update.visit_count() != row.visit_count() ||
-        row_to_update.typed_count() != row.typed_count() ||
-        row_to_update.last_visit() != row.last_visit() || title_updated) {
+    const URLRow& indexed_row = row_pos->second.url_row;
+    bool title_updated = indexed_row.title() != row.title();
+    if (indexed_row.visit_count() != row.visit_count() ||
+        indexed_row.typed_count() != row.typed_count() ||
+        indexed_row.last_visit() != row.last_visit() || title_updated) {
+      URLRow& row_to_update = history_info_map_.FindMutable(row_id)->url_row;
       row_to_update.set_visit_count(row.visit_count());
       row_to_update.set_typed_count(row.typed_count());
       row_to_update.set_last_visit(row.last_visit());
@@ -332,17 +461,17 @@ bool URLIndexPrivateData::UpdateURL(
     RemoveRowFromIndex(row);
     row_was_updated = true;
   }
-  if (row_was_updated)
-    search_term_cache_.clear();  // This invalidates the cache.
+  // Any search term cache items the update affected were invalidated as
+  // words were added to or removed from the row.
   return row_was_updated;
 }
 
 void URLIndexPrivateData::UpdateRecentVisits(
     URLID url_id,
     const VisitVector& recent_visits) {
-  HistoryInfoMap::iterator row_pos = history_info_map_.find(url_id);
-  if (row_pos != history_info_map_.end()) {
-    VisitInfoVector* visits = &row_pos->second.visits;
+  HistoryInfoMapValue* row_value = history_info_map_.FindMutable(url_id);
+  if (row_value) {
+    VisitInfoVector* visits = &row_value->visits;
     visits->clear();
     const size_t size =
         std::min(recent_visits.size(), kMaxVisitsToStoreInCache);
@@ -382,14 +511,13 @@ class HistoryInfoMapItemHasURL {
 
 bool URLIndexPrivateData::DeleteURL(const GURL& url) {
   // Find the matching entry in the history_info_map_.
-  HistoryInfoMap::iterator pos = std::find_if(
+  HistoryInfoMap::const_iterator pos = std::find_if(
       history_info_map_.begin(),
       history_info_map_.end(),
       HistoryInfoMapItemHasURL(url));
   if (pos == history_info_map_.end())
     return false;
   RemoveRowFromIndex(pos->second.url_row);
-  search_term_cache_.clear();  // This invalidates the cache.
   return true;
 }
 
@@ -400,6 +528,33 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::RestoreFromFile(
   base::TimeTicks beginning_time = base::TimeTicks::Now();
   if (!base::PathExists(file_path))
     return NULL;
+
+  // Prefer the memory-mapped format, which is read in place. Legacy protobuf
+  // caches are still restored so that existing profiles need not rebuild from
+  // history; they are rewritten in the mapped format at the next save.
+  scoped_ptr<URLIndexCacheFileReader> reader(new URLIndexCacheFileReader);
+  URLIndexCacheFileReader::OpenResult open_result = reader->Open(file_path);
+  UMA_HISTOGRAM_ENUMERATION("History.InMemoryURLIndexMappedCacheOpenResult",
+                            open_result,
+                            URLIndexCacheFileReader::OPEN_FAILED + 1);
+  if (open_result == URLIndexCacheFileReader::OPEN_FAILED) {
+    // A corrupt or incompatible cache causes a rebuild from the history
+    // database.
+    LOG(WARNING) << "Failed to map URLIndexPrivateData cache file "
+                 << file_path.value();
+    return NULL;
+  }
+  if (open_result == URLIndexCacheFileReader::OPEN_OK) {
+    scoped_refptr<URLIndexPrivateData> restored_data(new URLIndexPrivateData);
+    if (!restored_data->RestoreFromMappedCache(*reader, languages))
+      return NULL;
+    UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexRestoreMappedCacheTime",
+                        base::TimeTicks::Now() - beginning_time);
+    UMA_HISTOGRAM_COUNTS("History.InMemoryURLCacheSize", reader->file_size());
+    restored_data->RecordRestoreMetrics();
+    return restored_data;
+  }
+
   std::string data;
   // If there is no cache file then simply give up. This will cause us to
   // attempt to rebuild from the history database.
@@ -419,48 +574,102 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::RestoreFromFile(
 
   UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexRestoreCacheTime",
                       base::TimeTicks::Now() - beginning_time);
-  UMA_HISTOGRAM_COUNTS("History.InMemoryURLHistoryItems",
-                       restored_data->history_id_word_map_.size());
   UMA_HISTOGRAM_COUNTS("History.InMemoryURLCacheSize", data.size());
-  UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLWords",
-                             restored_data->word_map_.size());
-  UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLChars",
-                             restored_data->char_word_map_.size());
+  restored_data->RecordRestoreMetrics();
   if (restored_data->Empty())
     return NULL;  // 'No data' is the same as a failed reload.
   return restored_data;
 }
 
+void URLIndexPrivateData::RecordRestoreMetrics() const {
+  UMA_HISTOGRAM_COUNTS("History.InMemoryURLHistoryItems",
+                       history_id_word_map_.size());
+  UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLWords", word_map_.size());
+  UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLChars",
+                             char_word_map_.size());
+}
+
 // static
 scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::RebuildFromHistory(
     HistoryDatabase* history_db,
     const std::string& languages,
     const std::set<std::string>& scheme_whitelist) {
-  if (!history_db)
-    return NULL;
+  // Without a task runner the rebuild is done before this returns.
+  scoped_refptr<URLIndexPrivateData> rebuilt_data;
+  RebuildFromHistoryInShards(history_db, languages, scheme_whitelist, 1, NULL,
+                             base::Bind(&StoreRebuiltData, &rebuilt_data));
+  return rebuilt_data;
+}
+
+// static
+void URLIndexPrivateData::StartRebuildFromHistory(
+    HistoryDatabase* history_db,
+    const std::string& languages,
+    const std::set<std::string>& scheme_whitelist,
+    const RebuildCallback& callback) {
+  RebuildFromHistoryInShards(history_db, languages, scheme_whitelist,
+                             base::SysInfo::NumberOfProcessors(),
+                             content::BrowserThread::GetBlockingPool(),
+                             callback);
+}
+
+// static
+void URLIndexPrivateData::RebuildFromHistoryInShards(
+    HistoryDatabase* history_db,
+    const std::string& languages,
+    const std::set<std::string>& scheme_whitelist,
+    size_t shard_count,
+    base::TaskRunner* task_runner,
+    const RebuildCallback& callback) {
+  URLDatabase::URLEnumerator history_enum;
+  if (!history_db || !history_db->InitURLEnumeratorForSignificant(
+                         &history_enum)) {
+    callback.Run(NULL);
+    return;
+  }
 
   base::TimeTicks beginning_time = base::TimeTicks::Now();
 
   scoped_refptr<URLIndexPrivateData>
       rebuilt_data(new URLIndexPrivateData);
-  URLDatabase::URLEnumerator history_enum;
-  if (!history_db->InitURLEnumeratorForSignificant(&history_enum))
-    return NULL;
   rebuilt_data->last_time_rebuilt_from_history_ = base::Time::Now();
+
+  // Make sure the private data is going to get as many recent visits as
+  // ScoredHistoryMatch::GetFrecency() hopes to use.
+  DCHECK_GE(kMaxVisitsToStoreInCache, ScoredHistoryMatch::kMaxVisitsToScore);
+  // The recent visits of the rows to be indexed are read along with the rows,
+  // so that |history_db| is not needed once the rows are being indexed.
+  std::vector<URLRow> rows;
   for (URLRow row; history_enum.GetNextURL(&row); ) {
-    rebuilt_data->IndexRow(history_db, NULL, row, languages,
-                           scheme_whitelist);
+    VisitVector recent_visits;
+    if (URLSchemeIsWhitelisted(row.url(), scheme_whitelist) &&
+        history_db->GetMostRecentVisitsForURL(row.id(),
+                                              kMaxVisitsToStoreInCache,
+                                              &recent_visits)) {
+      // Add the entry MergeRebuildShard() stores the row in.
+      rebuilt_data->history_info_map_[static_cast<HistoryID>(row.id())];
+      rebuilt_data->UpdateRecentVisits(row.id(), recent_visits);
+    }
+    rows.push_back(row);
   }
+  rebuilt_data->IndexRows(
+      &rows, languages, scheme_whitelist, shard_count, task_runner,
+      base::Bind(&URLIndexPrivateData::DoneRebuildingFromHistory,
+                 rebuilt_data, beginning_time, callback));
+}
 
+void URLIndexPrivateData::DoneRebuildingFromHistory(
+    base::TimeTicks beginning_time,
+    const RebuildCallback& callback) {
   UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexingTime",
                       base::TimeTicks::Now() - beginning_time);
   UMA_HISTOGRAM_COUNTS("History.InMemoryURLHistoryItems",
-                       rebuilt_data->history_id_word_map_.size());
+                       history_id_word_map_.size());
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLWords",
-                             rebuilt_data->word_map_.size());
+                             word_map_.size());
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLChars",
-                             rebuilt_data->char_word_map_.size());
-  return rebuilt_data;
+                             char_word_map_.size());
+  callback.Run(make_scoped_refptr(this));
 }
 
 // static
@@ -476,7 +685,7 @@ void URLIndexPrivateData::CancelPendingUpdates() {
   recent_visits_consumer_.CancelAllRequests();
 }
 
-scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::Duplicate() const {
+scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::Snapshot() const {
   scoped_refptr<URLIndexPrivateData> data_copy = new URLIndexPrivateData;
   data_copy->last_time_rebuilt_from_history_ = last_time_rebuilt_from_history_;
   data_copy->word_list_ = word_list_;
@@ -520,32 +729,21 @@ HistoryIDSet URLIndexPrivateData::HistoryIDSetFromWords(
   // Note that a single 'term' from the user's perspective might be
   // a string like "http://www.somewebsite.com" which, from our perspective,
   // is four words: 'http', 'www', 'somewebsite', and 'com'.
-  HistoryIDSet history_id_set;
   String16Vector words(unsorted_words);
   // Sort the words into the longest first as such are likely to narrow down
   // the results quicker. Also, single character words are the most expensive
   // to process so save them for last.
   std::sort(words.begin(), words.end(), LengthGreater);
-  for (String16Vector::iterator iter = words.begin(); iter != words.end();
-       ++iter) {
-    base::string16 uni_word = *iter;
-    HistoryIDSet term_history_set = HistoryIDsForTerm(uni_word);
-    if (term_history_set.empty()) {
-      history_id_set.clear();
-      break;
-    }
-    if (iter == words.begin()) {
-      history_id_set.swap(term_history_set);
-    } else {
-      HistoryIDSet new_history_id_set;
-      std::set_intersection(history_id_set.begin(), history_id_set.end(),
-                            term_history_set.begin(), term_history_set.end(),
-                            std::inserter(new_history_id_set,
-                                          new_history_id_set.begin()));
-      history_id_set.swap(new_history_id_set);
-    }
+  std::vector<HistoryIDSet> term_history_sets(words.size());
+  std::vector<const HistoryIDSet*> term_history_set_ptrs;
+  for (size_t i = 0; i < words.size(); ++i) {
+    HistoryIDSet term_history_set = HistoryIDsForTerm(words[i]);
+    if (term_history_set.empty())
+      return HistoryIDSet();
+    term_history_sets[i].swap(term_history_set);
+    term_history_set_ptrs.push_back(&term_history_sets[i]);
   }
-  return history_id_set;
+  return IntersectIDSets(term_history_set_ptrs);
 }
 
 HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
@@ -561,37 +759,34 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
   WordIDSet word_id_set;
   if (term_length > 1) {
     // See if this term or a prefix thereof is present in the cache.
-    SearchTermCacheMap::iterator best_prefix(search_term_cache_.end());
-    for (SearchTermCacheMap::iterator cache_iter = search_term_cache_.begin();
-         cache_iter != search_term_cache_.end(); ++cache_iter) {
-      if (StartsWith(term, cache_iter->first, false) &&
-          (best_prefix == search_term_cache_.end() ||
-           cache_iter->first.length() > best_prefix->first.length()))
-        best_prefix = cache_iter;
-    }
+    size_t prefix_length = 0;
+    const SearchTermCache::Item* best_prefix =
+        search_term_cache_.FindLongestPrefix(term, &prefix_length);
 
     // If a prefix was found then determine the leftover characters to be used
     // for further refining the results from that prefix.
     Char16Set prefix_chars;
     base::string16 leftovers(term);
-    if (best_prefix != search_term_cache_.end()) {
+    if (!best_prefix) {
+      RecordSearchTermCacheLookup(SEARCH_TERM_CACHE_MISS);
+    } else {
       // If the prefix is an exact match for the term then grab the cached
       // results and we're done.
-      size_t prefix_length = best_prefix->first.length();
       if (prefix_length == term_length) {
-        best_prefix->second.used_ = true;
-        return best_prefix->second.history_id_set_;
+        RecordSearchTermCacheLookup(SEARCH_TERM_CACHE_HIT);
+        return best_prefix->history_id_set_;
       }
+      RecordSearchTermCacheLookup(SEARCH_TERM_CACHE_PREFIX_HIT);
 
       // Otherwise we have a handy starting point.
       // If there are no history results for this prefix then we can bail early
       // as there will be no history results for the full term.
-      if (best_prefix->second.history_id_set_.empty()) {
-        search_term_cache_[term] = SearchTermCacheItem();
+      if (best_prefix->history_id_set_.empty()) {
+        search_term_cache_.Insert(term, SearchTermCache::Item());
         return HistoryIDSet();
       }
-      word_id_set = best_prefix->second.word_id_set_;
-      prefix_chars = Char16SetFromString16(best_prefix->first);
+      word_id_set = best_prefix->word_id_set_;
+      prefix_chars = Char16SetFromString16(term.substr(0, prefix_length));
       leftovers = term.substr(prefix_length);
     }
 
@@ -605,18 +800,17 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
       WordIDSet leftover_set(WordIDSetForTermChars(unique_chars));
       // We might come up empty on the leftovers.
       if (leftover_set.empty()) {
-        search_term_cache_[term] = SearchTermCacheItem();
+        search_term_cache_.Insert(term, SearchTermCache::Item());
         return HistoryIDSet();
       }
       // Or there may not have been a prefix from which to start.
       if (prefix_chars.empty()) {
         word_id_set.swap(leftover_set);
       } else {
-        WordIDSet new_word_id_set;
-        std::set_intersection(word_id_set.begin(), word_id_set.end(),
-                              leftover_set.begin(), leftover_set.end(),
-                              std::inserter(new_word_id_set,
-                                            new_word_id_set.begin()));
+        std::vector<const WordIDSet*> word_id_sets;
+        word_id_sets.push_back(&word_id_set);
+        word_id_sets.push_back(&leftover_set);
+        WordIDSet new_word_id_set = IntersectIDSets(word_id_sets);
         word_id_set.swap(new_word_id_set);
       }
     }
@@ -641,9 +835,10 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
     for (WordIDSet::iterator word_id_iter = word_id_set.begin();
          word_id_iter != word_id_set.end(); ++word_id_iter) {
       WordID word_id = *word_id_iter;
-      WordIDHistoryMap::iterator word_iter = word_id_history_map_.find(word_id);
+      WordIDHistoryMap::const_iterator word_iter =
+          word_id_history_map_.find(word_id);
       if (word_iter != word_id_history_map_.end()) {
-        HistoryIDSet& word_history_id_set(word_iter->second);
+        const HistoryIDSet& word_history_id_set(word_iter->second);
         history_id_set.insert(word_history_id_set.begin(),
                               word_history_id_set.end());
       }
@@ -652,45 +847,197 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
 
   // Record a new cache entry for this word if the term is longer than
   // a single character.
-  if (term_length > 1)
-    search_term_cache_[term] = SearchTermCacheItem(word_id_set, history_id_set);
+  if (term_length > 1) {
+    search_term_cache_.Insert(term,
+                              SearchTermCache::Item(word_id_set,
+                                                    history_id_set));
+  }
 
   return history_id_set;
 }
 
 WordIDSet URLIndexPrivateData::WordIDSetForTermChars(
     const Char16Set& term_chars) {
-  WordIDSet word_id_set;
+  std::vector<const WordIDSet*> char_word_id_sets;
   for (Char16Set::const_iterator c_iter = term_chars.begin();
        c_iter != term_chars.end(); ++c_iter) {
-    CharWordIDMap::iterator char_iter = char_word_map_.find(*c_iter);
-    if (char_iter == char_word_map_.end()) {
-      // A character was not found so there are no matching results: bail.
-      word_id_set.clear();
-      break;
-    }
-    WordIDSet& char_word_id_set(char_iter->second);
+    CharWordIDMap::const_iterator char_iter = char_word_map_.find(*c_iter);
+    // A character was not found so there are no matching results: bail.
+    if (char_iter == char_word_map_.end())
+      return WordIDSet();
     // It is possible for there to no longer be any words associated with
     // a particular character. Give up in that case.
-    if (char_word_id_set.empty()) {
-      word_id_set.clear();
-      break;
+    if (char_iter->second.empty())
+      return WordIDSet();
+    char_word_id_sets.push_back(&char_iter->second);
+  }
+  return IntersectIDSets(char_word_id_sets);
+}
+
+// URLIndexPrivateData::RebuildShard ------------------------------------------
+
+struct URLIndexPrivateData::RebuildShard {
+  // The rows to be indexed, in order, as returned by IndexableRow(), and the
+  // word starts of each.
+  std::vector<URLRow> rows;
+  std::vector<RowWordStarts> word_starts;
+
+  // The distinct words in the rows in order of first appearance, and for each
+  // word the IDs of the rows containing it, in row order.
+  String16Vector words;
+  std::vector<HistoryIDVector> word_history_ids;
+};
+
+// URLIndexPrivateData::RebuildState ------------------------------------------
+
+struct URLIndexPrivateData::RebuildState
+    : public base::RefCountedThreadSafe<RebuildState> {
+  RebuildState(const std::string& languages,
+               const std::set<std::string>& scheme_whitelist,
+               const base::Closure& done)
+      : languages(languages),
+        scheme_whitelist(scheme_whitelist),
+        rows_per_shard(0),
+        shards_merged(0),
+        done(done) {}
+
+  // The rows being indexed, and how they are broken into words.
+  std::vector<URLRow> rows;
+  const std::string languages;
+  const std::set<std::string> scheme_whitelist;
+
+  // Shard i holds the rows from i * |rows_per_shard| on.
+  size_t rows_per_shard;
+  ScopedVector<RebuildShard> shards;
+  std::vector<bool> shard_built;
+
+  // The shards before this one have been merged into the index.
+  size_t shards_merged;
+
+  // Run once all shards have been merged.
+  base::Closure done;
+
+ private:
+  friend class base::RefCountedThreadSafe<RebuildState>;
+  ~RebuildState() {}
+
+  DISALLOW_COPY_AND_ASSIGN(RebuildState);
+};
+
+void URLIndexPrivateData::IndexRows(
+    std::vector<URLRow>* rows,
+    const std::string& languages,
+    const std::set<std::string>& scheme_whitelist,
+    size_t shard_count,
+    base::TaskRunner* task_runner,
+    const base::Closure& done) {
+  scoped_refptr<RebuildState> rebuild(
+      new RebuildState(languages, scheme_whitelist, done));
+  rebuild->rows.swap(*rows);
+  const size_t row_count = rebuild->rows.size();
+  shard_count = std::min(shard_count, row_count / kMinRowsPerRebuildShard);
+  if (shard_count == 0 || !task_runner)
+    shard_count = 1;
+  rebuild->rows_per_shard = (row_count + shard_count - 1) / shard_count;
+  for (size_t i = 0; i < shard_count; ++i)
+    rebuild->shards.push_back(new RebuildShard);
+  rebuild->shard_built.resize(shard_count, false);
+
+  if (shard_count == 1) {
+    BuildRebuildShard(rebuild, 0);
+    OnRebuildShardBuilt(rebuild, 0);
+    return;
+  }
+
+  // Each shard is merged as soon as it and its predecessors are built, so
+  // merging overlaps with building the later shards. This thread is free to
+  // run other tasks in the meantime.
+  for (size_t i = 0; i < shard_count; ++i) {
+    if (!task_runner->PostTaskAndReply(
+            FROM_HERE,
+            base::Bind(&URLIndexPrivateData::BuildRebuildShard, rebuild, i),
+            base::Bind(&URLIndexPrivateData::OnRebuildShardBuilt, this,
+                       rebuild, i))) {
+      BuildRebuildShard(rebuild, i);
+      OnRebuildShardBuilt(rebuild, i);
     }
+  }
+}
 
-    if (c_iter == term_chars.begin()) {
-      // First character results becomes base set of results.
-      word_id_set = char_word_id_set;
-    } else {
-      // Subsequent character results get intersected in.
-      WordIDSet new_word_id_set;
-      std::set_intersection(word_id_set.begin(), word_id_set.end(),
-                            char_word_id_set.begin(), char_word_id_set.end(),
-                            std::inserter(new_word_id_set,
-                                          new_word_id_set.begin()));
-      word_id_set.swap(new_word_id_set);
+// static
+void URLIndexPrivateData::BuildRebuildShard(
+    scoped_refptr<RebuildState> rebuild,
+    size_t index) {
+  const std::vector<URLRow>& rows = rebuild->rows;
+  const size_t begin = std::min(rows.size(), index * rebuild->rows_per_shard);
+  const size_t end = std::min(rows.size(), begin + rebuild->rows_per_shard);
+  RebuildShard* shard = rebuild->shards[index];
+  std::map<base::string16, size_t> shard_word_ids;
+  for (size_t i = begin; i < end; ++i) {
+    const URLRow& row = rows[i];
+    // Index only URLs with a whitelisted scheme.
+    if (!URLSchemeIsWhitelisted(row.url(), rebuild->scheme_whitelist))
+      continue;
+    const HistoryID history_id = static_cast<HistoryID>(row.id());
+    DCHECK_LT(history_id, std::numeric_limits<HistoryID>::max());
+
+    shard->rows.push_back(IndexableRow(row, rebuild->languages));
+    shard->word_starts.push_back(RowWordStarts());
+    String16Set words = IndexableWordsForRow(
+        shard->rows.back(), &shard->word_starts.back(), rebuild->languages);
+    for (String16Set::const_iterator word_iter = words.begin();
+         word_iter != words.end(); ++word_iter) {
+      std::pair<std::map<base::string16, size_t>::iterator, bool> inserted =
+          shard_word_ids.insert(
+              std::make_pair(*word_iter, shard->words.size()));
+      if (inserted.second) {
+        shard->words.push_back(*word_iter);
+        shard->word_history_ids.push_back(HistoryIDVector());
+      }
+      shard->word_history_ids[inserted.first->second].push_back(history_id);
     }
   }
-  return word_id_set;
+}
+
+void URLIndexPrivateData::OnRebuildShardBuilt(
+    scoped_refptr<RebuildState> rebuild,
+    size_t index) {
+  rebuild->shard_built[index] = true;
+  const size_t shard_count = rebuild->shards.size();
+  while (rebuild->shards_merged < shard_count &&
+         rebuild->shard_built[rebuild->shards_merged]) {
+    RebuildShard* shard = rebuild->shards[rebuild->shards_merged];
+    MergeRebuildShard(*shard);
+    *shard = RebuildShard();  // Release the merged words and rows.
+    ++rebuild->shards_merged;
+  }
+  if (rebuild->shards_merged < shard_count)
+    return;
+  search_term_cache_.clear();  // Invalidate the term cache.
+  rebuild->done.Run();
+}
+
+void URLIndexPrivateData::MergeRebuildShard(const RebuildShard& shard) {
+  for (size_t i = 0; i < shard.rows.size(); ++i) {
+    const HistoryID history_id = static_cast<HistoryID>(shard.rows[i].id());
+    history_info_map_[history_id].url_row = shard.rows[i];
+    word_starts_map_[history_id] = shard.word_starts[i];
+  }
+  // Words new to the index are assigned WordIDs in the order in which the
+  // shard first saw them. As the shards are merged in row order this is the
+  // order in which a serial rebuild would have assigned them.
+  for (size_t i = 0; i < shard.words.size(); ++i) {
+    const base::string16& word = shard.words[i];
+    WordMap::const_iterator word_pos = word_map_.find(word);
+    const WordID word_id =
+        (word_pos != word_map_.end()) ? word_pos->second : AddWord(word);
+    const HistoryIDVector& history_ids = shard.word_history_ids[i];
+    word_id_history_map_[word_id].insert(history_ids.begin(),
+                                         history_ids.end());
+    for (HistoryIDVector::const_iterator iter = history_ids.begin();
+         iter != history_ids.end(); ++iter)
+      AddToHistoryIDWordMap(*iter, word_id);
+  }
 }
 
 bool URLIndexPrivateData::IndexRow(
@@ -706,21 +1053,11 @@ bool URLIndexPrivateData::IndexRow(
     return false;
 
   URLID row_id = row.id();
-  // Strip out username and password before saving and indexing.
-  base::string16 url(net::FormatUrl(gurl, languages,
-      net::kFormatUrlOmitUsernamePassword,
-      net::UnescapeRule::NONE,
-      NULL, NULL, NULL));
-
   HistoryID history_id = static_cast<HistoryID>(row_id);
   DCHECK_LT(history_id, std::numeric_limits<HistoryID>::max());
 
   // Add the row for quick lookup in the history info store.
-  URLRow new_row(GURL(url), row_id);
-  new_row.set_visit_count(row.visit_count());
-  new_row.set_typed_count(row.typed_count());
-  new_row.set_last_visit(row.last_visit());
-  new_row.set_title(row.title());
+  URLRow new_row(IndexableRow(row, languages));
   history_info_map_[history_id].url_row = new_row;
 
   // Index the words contained in the URL and title of the row.
@@ -755,27 +1092,17 @@ void URLIndexPrivateData::AddRowWordsToIndex(const URLRow& row,
                                              const std::string& languages) {
   HistoryID history_id = static_cast<HistoryID>(row.id());
   // Split URL into individual, unique words then add in the title words.
-  const GURL& gurl(row.url());
-  const base::string16& url = CleanUpUrlForMatching(gurl, languages);
-  String16Set url_words = String16SetFromString16(url,
-      word_starts ? &word_starts->url_word_starts_ : NULL);
-  const base::string16& title = CleanUpTitleForMatching(row.title());
-  String16Set title_words = String16SetFromString16(title,
-      word_starts ? &word_starts->title_word_starts_ : NULL);
-  String16Set words;
-  std::set_union(url_words.begin(), url_words.end(),
-                 title_words.begin(), title_words.end(),
-                 std::insert_iterator<String16Set>(words, words.begin()));
+  String16Set words = IndexableWordsForRow(row, word_starts, languages);
   for (String16Set::iterator word_iter = words.begin();
-       word_iter != words.end(); ++word_iter)
+       word_iter != words.end(); ++word_iter) {
     AddWordToIndex(*word_iter, history_id);
-
-  search_term_cache_.clear();  // Invalidate the term cache.
+    InvalidateSearchTermCacheForWord(*word_iter);
+  }
 }
 
 void URLIndexPrivateData::AddWordToIndex(const base::string16& term,
                                          HistoryID history_id) {
-  WordMap::iterator word_pos = word_map_.find(term);
+  WordMap::const_iterator word_pos = word_map_.find(term);
   if (word_pos != word_map_.end())
     UpdateWordHistory(word_pos->second, history_id);
   else
@@ -784,32 +1111,34 @@ void URLIndexPrivateData::AddWordToIndex(const base::string16& term,
 
 void URLIndexPrivateData::AddWordHistory(const base::string16& term,
                                          HistoryID history_id) {
+  WordID word_id = AddWord(term);
+  HistoryIDSet history_id_set;
+  history_id_set.insert(history_id);
+  word_id_history_map_[word_id] = history_id_set;
+  AddToHistoryIDWordMap(history_id, word_id);
+}
+
+WordID URLIndexPrivateData::AddWord(const base::string16& term) {
   WordID word_id = word_list_.size();
   if (available_words_.empty()) {
     word_list_.push_back(term);
   } else {
     word_id = *(available_words_.begin());
-    word_list_[word_id] = term;
+    word_list_.set(word_id, term);
     available_words_.erase(word_id);
   }
   word_map_[term] = word_id;
 
-  HistoryIDSet history_id_set;
-  history_id_set.insert(history_id);
-  word_id_history_map_[word_id] = history_id_set;
-  AddToHistoryIDWordMap(history_id, word_id);
-
   // For each character in the newly added word (i.e. a word that is not
   // already in the word index), add the word to the character index.
   Char16Set characters = Char16SetFromString16(term);
   for (Char16Set::iterator uni_char_iter = characters.begin();
        uni_char_iter != characters.end(); ++uni_char_iter) {
     base::char16 uni_char = *uni_char_iter;
-    CharWordIDMap::iterator char_iter = char_word_map_.find(uni_char);
-    if (char_iter != char_word_map_.end()) {
+    WordIDSet* char_word_ids = char_word_map_.FindMutable(uni_char);
+    if (char_word_ids) {
       // Update existing entry in the char/word index.
-      WordIDSet& word_id_set(char_iter->second);
-      word_id_set.insert(word_id);
+      char_word_ids->insert(word_id);
     } else {
       // Create a new entry in the char/word index.
       WordIDSet word_id_set;
@@ -817,23 +1146,22 @@ void URLIndexPrivateData::AddWordHistory(const base::string16& term,
       char_word_map_[uni_char] = word_id_set;
     }
   }
+  return word_id;
 }
 
 void URLIndexPrivateData::UpdateWordHistory(WordID word_id,
                                             HistoryID history_id) {
-  WordIDHistoryMap::iterator history_pos = word_id_history_map_.find(word_id);
-  DCHECK(history_pos != word_id_history_map_.end());
-  HistoryIDSet& history_id_set(history_pos->second);
-  history_id_set.insert(history_id);
+  HistoryIDSet* history_id_set = word_id_history_map_.FindMutable(word_id);
+  DCHECK(history_id_set);
+  history_id_set->insert(history_id);
   AddToHistoryIDWordMap(history_id, word_id);
 }
 
 void URLIndexPrivateData::AddToHistoryIDWordMap(HistoryID history_id,
                                                 WordID word_id) {
-  HistoryIDWordMap::iterator iter = history_id_word_map_.find(history_id);
-  if (iter != history_id_word_map_.end()) {
-    WordIDSet& word_id_set(iter->second);
-    word_id_set.insert(word_id);
+  WordIDSet* history_word_ids = history_id_word_map_.FindMutable(history_id);
+  if (history_word_ids) {
+    history_word_ids->insert(word_id);
   } else {
     WordIDSet word_id_set;
     word_id_set.insert(word_id);
@@ -859,12 +1187,13 @@ void URLIndexPrivateData::RemoveRowWordsFromIndex(const URLRow& row) {
   for (WordIDSet::iterator word_id_iter = word_id_set.begin();
        word_id_iter != word_id_set.end(); ++word_id_iter) {
     WordID word_id = *word_id_iter;
+    base::string16 word = word_list_[word_id];
+    InvalidateSearchTermCacheForWord(word);
     word_id_history_map_[word_id].erase(history_id);
     if (!word_id_history_map_[word_id].empty())
       continue;  // The word is still in use.
 
     // The word is no longer in use. Reconcile any changes to character usage.
-    base::string16 word = word_list_[word_id];
     Char16Set characters = Char16SetFromString16(word);
     for (Char16Set::iterator uni_char_iter = characters.begin();
          uni_char_iter != characters.end(); ++uni_char_iter) {
@@ -877,167 +1206,160 @@ void URLIndexPrivateData::RemoveRowWordsFromIndex(const URLRow& row) {
     // Complete the removal of references to the word.
     word_id_history_map_.erase(word_id);
     word_map_.erase(word);
-    word_list_[word_id] = base::string16();
+    word_list_.set(word_id, base::string16());
     available_words_.insert(word_id);
   }
 }
 
-void URLIndexPrivateData::ResetSearchTermCache() {
-  for (SearchTermCacheMap::iterator iter = search_term_cache_.begin();
-       iter != search_term_cache_.end(); ++iter)
-    iter->second.used_ = false;
+void URLIndexPrivateData::InvalidateSearchTermCacheForWord(
+    const base::string16& word) {
+  const size_t invalidated = search_term_cache_.InvalidateWord(word);
+  if (invalidated) {
+    UMA_HISTOGRAM_COUNTS_100(
+        "History.InMemoryURLIndexSearchTermCacheInvalidations", invalidated);
+  }
 }
 
 bool URLIndexPrivateData::SaveToFile(const base::FilePath& file_path) {
   base::TimeTicks beginning_time = base::TimeTicks::Now();
-  InMemoryURLIndexCacheItem index_cache;
-  SavePrivateData(&index_cache);
-  std::string data;
-  if (!index_cache.SerializeToString(&data)) {
-    LOG(WARNING) << "Failed to serialize the InMemoryURLIndex cache.";
-    return false;
-  }
-
-  int size = data.size();
-  if (file_util::WriteFile(file_path, data.c_str(), size) != size) {
-    LOG(WARNING) << "Failed to write " << file_path.value();
+  URLIndexCacheFileWriter writer(last_time_rebuilt_from_history_,
+                                 saved_cache_version_);
+  SavePrivateData(&writer);
+  if (!writer.WriteToFile(file_path))
     return false;
-  }
   UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexSaveCacheTime",
                       base::TimeTicks::Now() - beginning_time);
   return true;
 }
 
 void URLIndexPrivateData::SavePrivateData(
-    InMemoryURLIndexCacheItem* cache) const {
-  DCHECK(cache);
-  cache->set_last_rebuild_timestamp(
-      last_time_rebuilt_from_history_.ToInternalValue());
-  cache->set_version(saved_cache_version_);
-  // history_item_count_ is no longer used but rather than change the protobuf
-  // definition use a placeholder. This will go away with the switch to SQLite.
-  cache->set_history_item_count(0);
-  SaveWordList(cache);
-  SaveWordMap(cache);
-  SaveCharWordMap(cache);
-  SaveWordIDHistoryMap(cache);
-  SaveHistoryInfoMap(cache);
-  SaveWordStartsMap(cache);
+    URLIndexCacheFileWriter* writer) const {
+  DCHECK(writer);
+  for (WordID word_id = 0; word_id < word_list_.size(); ++word_id) {
+    WordIDHistoryMap::const_iterator history_iter =
+        word_id_history_map_.find(word_id);
+    writer->AddWord(word_list_[word_id],
+                    history_iter != word_id_history_map_.end() ?
+                        history_iter->second : HistoryIDSet());
+  }
+  // The writer wants characters in ascending order, which the map does not
+  // iterate in.
+  std::vector<base::char16> chars;
+  chars.reserve(char_word_map_.size());
+  for (CharWordIDMap::const_iterator iter = char_word_map_.begin();
+       iter != char_word_map_.end(); ++iter)
+    chars.push_back(iter->first);
+  std::sort(chars.begin(), chars.end());
+  for (std::vector<base::char16>::const_iterator iter = chars.begin();
+       iter != chars.end(); ++iter)
+    writer->AddChar(*iter, char_word_map_.find(*iter)->second);
+  for (HistoryInfoMap::const_iterator iter = history_info_map_.begin();
+       iter != history_info_map_.end(); ++iter) {
+    // For unit testing: Enable saving of the cache as an earlier version
+    // without word starts to allow testing of their reconstruction upon
+    // restore.
+    const RowWordStarts* word_starts = NULL;
+    if (saved_cache_version_ >= 1) {
+      WordStartsMap::const_iterator starts_iter =
+          word_starts_map_.find(iter->first);
+      DCHECK(starts_iter != word_starts_map_.end());
+      word_starts = &starts_iter->second;
+    }
+    writer->AddRow(iter->second.url_row, iter->second.visits, word_starts);
+  }
 }
 
-void URLIndexPrivateData::SaveWordList(InMemoryURLIndexCacheItem* cache) const {
-  if (word_list_.empty())
-    return;
-  WordListItem* list_item = cache->mutable_word_list();
-  list_item->set_word_count(word_list_.size());
-  for (String16Vector::const_iterator iter = word_list_.begin();
-       iter != word_list_.end(); ++iter)
-    list_item->add_word(base::UTF16ToUTF8(*iter));
-}
+bool URLIndexPrivateData::RestoreFromMappedCache(
+    const URLIndexCacheFileReader& reader,
+    const std::string& languages) {
+  last_time_rebuilt_from_history_ = reader.last_rebuild_time();
+  if (!RebuildTimeIsRecent(last_time_rebuilt_from_history_))
+    return false;
+  // Don't try to restore an old format cache file.  (This will cause the
+  // InMemoryURLIndex to schedule rebuilding the URLIndexPrivateData from
+  // history.)
+  if (reader.data_version() < kCurrentCacheFileVersion)
+    return false;
+  restored_cache_version_ = reader.data_version();
 
-void URLIndexPrivateData::SaveWordMap(InMemoryURLIndexCacheItem* cache) const {
-  if (word_map_.empty())
-    return;
-  WordMapItem* map_item = cache->mutable_word_map();
-  map_item->set_item_count(word_map_.size());
-  for (WordMap::const_iterator iter = word_map_.begin();
-       iter != word_map_.end(); ++iter) {
-    WordMapEntry* map_entry = map_item->add_word_map_entry();
-    map_entry->set_word(base::UTF16ToUTF8(iter->first));
-    map_entry->set_word_id(iter->second);
-  }
+  // The offsets of every section were checked when the file was opened, so
+  // nothing more can go wrong when the index is built from it.
+  if (reader.word_count() == 0 || reader.row_count() == 0 ||
+      reader.char_count() == 0)
+    return false;
+  MaterializeMappedCache(reader, languages);
+  return true;
 }
 
-void URLIndexPrivateData::SaveCharWordMap(
-    InMemoryURLIndexCacheItem* cache) const {
-  if (char_word_map_.empty())
-    return;
-  CharWordMapItem* map_item = cache->mutable_char_word_map();
-  map_item->set_item_count(char_word_map_.size());
-  for (CharWordIDMap::const_iterator iter = char_word_map_.begin();
-       iter != char_word_map_.end(); ++iter) {
-    CharWordMapEntry* map_entry = map_item->add_char_word_map_entry();
-    map_entry->set_char_16(iter->first);
-    const WordIDSet& word_id_set(iter->second);
-    map_entry->set_item_count(word_id_set.size());
-    for (WordIDSet::const_iterator set_iter = word_id_set.begin();
-         set_iter != word_id_set.end(); ++set_iter)
-      map_entry->add_word_id(*set_iter);
+void URLIndexPrivateData::MaterializeMappedCache(
+    const URLIndexCacheFileReader& reader,
+    const std::string& languages) {
+  base::TimeTicks beginning_time = base::TimeTicks::Now();
+  const size_t word_count = reader.word_count();
+  for (WordID word_id = 0; word_id < word_count; ++word_id) {
+    const base::string16 word = reader.WordAt(word_id);
+    word_list_.push_back(word);
+    size_t history_id_count = 0;
+    const int64* history_ids =
+        reader.HistoryIDsForWord(word_id, &history_id_count);
+    if (word.empty()) {
+      available_words_.insert(word_id);
+      continue;
+    }
+    word_map_[word] = word_id;
+    word_id_history_map_[word_id] =
+        HistoryIDSet(history_ids, history_ids + history_id_count);
+    for (size_t i = 0; i < history_id_count; ++i)
+      AddToHistoryIDWordMap(history_ids[i], word_id);
   }
-}
 
-void URLIndexPrivateData::SaveWordIDHistoryMap(
-    InMemoryURLIndexCacheItem* cache) const {
-  if (word_id_history_map_.empty())
-    return;
-  WordIDHistoryMapItem* map_item = cache->mutable_word_id_history_map();
-  map_item->set_item_count(word_id_history_map_.size());
-  for (WordIDHistoryMap::const_iterator iter = word_id_history_map_.begin();
-       iter != word_id_history_map_.end(); ++iter) {
-    WordIDHistoryMapEntry* map_entry =
-        map_item->add_word_id_history_map_entry();
-    map_entry->set_word_id(iter->first);
-    const HistoryIDSet& history_id_set(iter->second);
-    map_entry->set_item_count(history_id_set.size());
-    for (HistoryIDSet::const_iterator set_iter = history_id_set.begin();
-         set_iter != history_id_set.end(); ++set_iter)
-      map_entry->add_history_id(*set_iter);
+  for (size_t i = 0; i < reader.char_count(); ++i) {
+    size_t word_id_count = 0;
+    const uint32* word_ids = reader.WordIDsForChar(i, &word_id_count);
+    char_word_map_[reader.CharAt(i)] =
+        WordIDSet(word_ids, word_ids + word_id_count);
   }
-}
 
-void URLIndexPrivateData::SaveHistoryInfoMap(
-    InMemoryURLIndexCacheItem* cache) const {
-  if (history_info_map_.empty())
-    return;
-  HistoryInfoMapItem* map_item = cache->mutable_history_info_map();
-  map_item->set_item_count(history_info_map_.size());
-  for (HistoryInfoMap::const_iterator iter = history_info_map_.begin();
-       iter != history_info_map_.end(); ++iter) {
-    HistoryInfoMapEntry* map_entry = map_item->add_history_info_map_entry();
-    map_entry->set_history_id(iter->first);
-    const URLRow& url_row(iter->second.url_row);
-    // Note: We only save information that contributes to the index so there
-    // is no need to save search_term_cache_ (not persistent).
-    map_entry->set_visit_count(url_row.visit_count());
-    map_entry->set_typed_count(url_row.typed_count());
-    map_entry->set_last_visit(url_row.last_visit().ToInternalValue());
-    map_entry->set_url(url_row.url().spec());
-    map_entry->set_title(base::UTF16ToUTF8(url_row.title()));
-    const VisitInfoVector& visits(iter->second.visits);
-    for (VisitInfoVector::const_iterator visit_iter = visits.begin();
-         visit_iter != visits.end(); ++visit_iter) {
-      HistoryInfoMapEntry_VisitInfo* visit_info = map_entry->add_visits();
-      visit_info->set_visit_time(visit_iter->first.ToInternalValue());
-      visit_info->set_transition_type(visit_iter->second);
-    }
+  for (size_t i = 0; i < reader.row_count(); ++i) {
+    URLRow row;
+    VisitInfoVector visits;
+    RowWordStarts word_starts;
+    reader.RowAt(i, &row, &visits, &word_starts);
+    HistoryInfoMapValue& value = history_info_map_[row.id()];
+    value.url_row = row;
+    value.visits.swap(visits);
+    if (reader.has_word_starts())
+      word_starts_map_[row.id()] = word_starts;
   }
+  if (!reader.has_word_starts())
+    RebuildWordStartsMap(languages);
+
+  UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexMaterializeMappedCacheTime",
+                      base::TimeTicks::Now() - beginning_time);
 }
 
-void URLIndexPrivateData::SaveWordStartsMap(
-    InMemoryURLIndexCacheItem* cache) const {
-  if (word_starts_map_.empty())
-    return;
-  // For unit testing: Enable saving of the cache as an earlier version to
-  // allow testing of cache file upgrading in ReadFromFile().
-  // TODO(mrossetti): Instead of intruding on production code with this kind of
-  // test harness, save a copy of an older version cache with known results.
-  // Implement this when switching the caching over to SQLite.
-  if (saved_cache_version_ < 1)
-    return;
+// static
+bool URLIndexPrivateData::RebuildTimeIsRecent(base::Time rebuild_time) {
+  const base::TimeDelta rebuilt_ago = base::Time::Now() - rebuild_time;
+  // A cache more than a week old or, somehow, from some time in the future
+  // should be rebuilt from history to allow synced entries to now appear,
+  // expired entries to disappear, etc. Allow one day in the future to make the
+  // cache not rebuild on simple system clock changes such as time zone
+  // changes.
+  return (rebuilt_ago <= base::TimeDelta::FromDays(7)) &&
+      (rebuilt_ago >= base::TimeDelta::FromDays(-1));
+}
 
-  WordStartsMapItem* map_item = cache->mutable_word_starts_map();
-  map_item->set_item_count(word_starts_map_.size());
-  for (WordStartsMap::const_iterator iter = word_starts_map_.begin();
-       iter != word_starts_map_.end(); ++iter) {
-    WordStartsMapEntry* map_entry = map_item->add_word_starts_map_entry();
-    map_entry->set_history_id(iter->first);
-    const RowWordStarts& word_starts(iter->second);
-    for (WordStarts::const_iterator i = word_starts.url_word_starts_.begin();
-         i != word_starts.url_word_starts_.end(); ++i)
-      map_entry->add_url_word_starts(*i);
-    for (WordStarts::const_iterator i = word_starts.title_word_starts_.begin();
-         i != word_starts.title_word_starts_.end(); ++i)
-      map_entry->add_title_word_starts(*i);
+void URLIndexPrivateData::RebuildWordStartsMap(const std::string& languages) {
+  for (HistoryInfoMap::const_iterator iter = history_info_map_.begin();
+       iter != history_info_map_.end(); ++iter) {
+    RowWordStarts word_starts;
+    const URLRow& row(iter->second.url_row);
+    const base::string16& url = CleanUpUrlForMatching(row.url(), languages);
+    String16VectorFromString16(url, false, &word_starts.url_word_starts_);
+    const base::string16& title = CleanUpTitleForMatching(row.title());
+    String16VectorFromString16(title, false, &word_starts.title_word_starts_);
+    word_starts_map_[iter->first] = word_starts;
   }
 }
 
@@ -1046,17 +1368,8 @@ bool URLIndexPrivateData::RestorePrivateData(
     const std::string& languages) {
   last_time_rebuilt_from_history_ =
       base::Time::FromInternalValue(cache.last_rebuild_timestamp());
-  const base::TimeDelta rebuilt_ago =
-      base::Time::Now() - last_time_rebuilt_from_history_;
-  if ((rebuilt_ago > base::TimeDelta::FromDays(7)) ||
-      (rebuilt_ago < base::TimeDelta::FromDays(-1))) {
-    // Cache is more than a week old or, somehow, from some time in the future.
-    // It's probably a good time to rebuild the index from history to
-    // allow synced entries to now appear, expired entries to disappear, etc.
-    // Allow one day in the future to make the cache not rebuild on simple
-    // system clock changes such as time zone changes.
+  if (!RebuildTimeIsRecent(last_time_rebuilt_from_history_))
     return false;
-  }
   if (cache.has_version()) {
     if (cache.version() < kCurrentCacheFileVersion) {
       // Don't try to restore an old format cache file.  (This will cause
@@ -1233,16 +1546,7 @@ bool URLIndexPrivateData::RestoreWordStartsMap(
   } else {
     // Since the cache did not contain any word starts we must rebuild then from
     // the URL and page titles.
-    for (HistoryInfoMap::const_iterator iter = history_info_map_.begin();
-         iter != history_info_map_.end(); ++iter) {
-      RowWordStarts word_starts;
-      const URLRow& row(iter->second.url_row);
-      const base::string16& url = CleanUpUrlForMatching(row.url(), languages);
-      String16VectorFromString16(url, false, &word_starts.url_word_starts_);
-      const base::string16& title = CleanUpTitleForMatching(row.title());
-      String16VectorFromString16(title, false, &word_starts.title_word_starts_);
-      word_starts_map_[iter->first] = word_starts;
-    }
+    RebuildWordStartsMap(languages);
   }
   return true;
 }
@@ -1255,58 +1559,6 @@ bool URLIndexPrivateData::URLSchemeIsWhitelisted(
 }
 
 
-// SearchTermCacheItem ---------------------------------------------------------
-
-URLIndexPrivateData::SearchTermCacheItem::SearchTermCacheItem(
-    const WordIDSet& word_id_set,
-    const HistoryIDSet& history_id_set)
-    : word_id_set_(word_id_set),
-      history_id_set_(history_id_set),
-      used_(true) {}
-
-URLIndexPrivateData::SearchTermCacheItem::SearchTermCacheItem()
-    : used_(true) {}
-
-URLIndexPrivateData::SearchTermCacheItem::~SearchTermCacheItem() {}
-
-
-// URLIndexPrivateData::AddHistoryMatch ----------------------------------------
-
-URLIndexPrivateData::AddHistoryMatch::AddHistoryMatch(
-    const URLIndexPrivateData& private_data,
-    const std::string& languages,
-    BookmarkService* bookmark_service,
-    const base::string16& lower_string,
-    const String16Vector& lower_terms,
-    const base::Time now)
-  : private_data_(private_data),
-    languages_(languages),
-    bookmark_service_(bookmark_service),
-    lower_string_(lower_string),
-    lower_terms_(lower_terms),
-    now_(now) {}
-
-URLIndexPrivateData::AddHistoryMatch::~AddHistoryMatch() {}
-
-void URLIndexPrivateData::AddHistoryMatch::operator()(
-    const HistoryID history_id) {
-  HistoryInfoMap::const_iterator hist_pos =
-      private_data_.history_info_map_.find(history_id);
-  if (hist_pos != private_data_.history_info_map_.end()) {
-    const URLRow& hist_item = hist_pos->second.url_row;
-    const VisitInfoVector& visits = hist_pos->second.visits;
-    WordStartsMap::const_iterator starts_pos =
-        private_data_.word_starts_map_.find(history_id);
-    DCHECK(starts_pos != private_data_.word_starts_map_.end());
-    ScoredHistoryMatch match(hist_item, visits, languages_, lower_string_,
-                             lower_terms_, starts_pos->second, now_,
-                             bookmark_service_);
-    if (match.raw_score() > 0)
-      scored_matches_.push_back(match);
-  }
-}
-
-
 // URLIndexPrivateData::HistoryItemFactorGreater -------------------------------
 
 URLIndexPrivateData::HistoryItemFactorGreater::HistoryItemFactorGreater(
@@ -7,20 +7,28 @@
 
 #include <set>
 #include <string>
+#include <vector>
 
+#include "base/callback.h"
 #include "base/files/file_path.h"
 #include "base/gtest_prod_util.h"
 #include "base/memory/ref_counted.h"
+#include "base/time/time.h"
 #include "chrome/browser/common/cancelable_request.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/in_memory_url_index_cache.pb.h"
 #include "chrome/browser/history/in_memory_url_index_types.h"
 #include "chrome/browser/history/scored_history_match.h"
+#include "chrome/browser/history/search_term_cache.h"
 #include "content/public/browser/notification_details.h"
 
 class BookmarkService;
 class HistoryQuickProviderTest;
 
+namespace base {
+class TaskRunner;
+}
+
 namespace in_memory_url_index {
 class InMemoryURLIndexCacheItem;
 }
@@ -32,6 +40,8 @@ namespace imui = in_memory_url_index;
 class HistoryDatabase;
 class InMemoryURLIndex;
 class RefCountedBool;
+class URLIndexCacheFileReader;
+class URLIndexCacheFileWriter;
 
 // Current version of the cache file.
 static const int kCurrentCacheFileVersion = 4;
@@ -109,21 +119,40 @@ class URLIndexPrivateData
   // at |path|. Returns the new URLIndexPrivateData which on success will
   // contain the restored data but upon failure will be empty.  |languages|
   // is used to break URLs and page titles into words.  This function
-  // should be run on the the file thread.
+  // should be run on the the file thread. A cache in the memory-mappable
+  // format is read in place, and the index is built from it here, so the
+  // UI thread only adopts the result.
   static scoped_refptr<URLIndexPrivateData> RestoreFromFile(
       const base::FilePath& path,
       const std::string& languages);
 
+  typedef base::Callback<void(scoped_refptr<URLIndexPrivateData>)>
+      RebuildCallback;
+
   // Constructs a new object by rebuilding its contents from the history
   // database in |history_db|. Returns the new URLIndexPrivateData which on
   // success will contain the rebuilt data but upon failure will be empty.
   // |languages| gives a list of language encodings by which the URLs and page
-  // titles are broken down into words and characters.
+  // titles are broken down into words and characters. The rows are indexed on
+  // the calling thread.
   static scoped_refptr<URLIndexPrivateData> RebuildFromHistory(
       HistoryDatabase* history_db,
       const std::string& languages,
       const std::set<std::string>& scheme_whitelist);
 
+  // Rebuilds as RebuildFromHistory() does, but only reads the rows and their
+  // recent visits from |history_db| on the calling thread. The rows are then
+  // broken into words in parallel on the browser's blocking pool, and merged
+  // on the calling thread between its other tasks; the result is the same as
+  // indexing them one at a time. Runs |callback| on the calling thread with
+  // the new URLIndexPrivateData, or NULL if |history_db| cannot be read. The
+  // calling thread must have a message loop.
+  static void StartRebuildFromHistory(
+      HistoryDatabase* history_db,
+      const std::string& languages,
+      const std::set<std::string>& scheme_whitelist,
+      const RebuildCallback& callback);
+
   // Writes |private_data| as a cache file to |file_path| and returns success.
   static bool WritePrivateDataToCacheFileTask(
       scoped_refptr<URLIndexPrivateData> private_data,
@@ -133,8 +162,12 @@ class URLIndexPrivateData
   // called during shutdown.
   void CancelPendingUpdates();
 
-  // Creates a copy of ourself.
-  scoped_refptr<URLIndexPrivateData> Duplicate() const;
+  // Creates a read-only copy of the cached parts of ourself, suitable for
+  // saving on another thread. The copy shares storage with this instance, so
+  // it costs time proportional to the number of index shards rather than the
+  // size of the index; later updates to this instance copy only the shards
+  // they touch and are not visible in the snapshot.
+  scoped_refptr<URLIndexPrivateData> Snapshot() const;
 
   // Returns true if there is no data in the index.
   bool Empty() const;
@@ -147,76 +180,23 @@ class URLIndexPrivateData
   friend class base::RefCountedThreadSafe<URLIndexPrivateData>;
   ~URLIndexPrivateData();
 
-  friend class AddHistoryMatch;
   friend class ::HistoryQuickProviderTest;
   friend class InMemoryURLIndexTest;
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, CacheSaveRestore);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, HugeResultSet);
+  FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, ParallelRebuildMatchesSerial);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, ReadVisitsFromHistory);
+  FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, RebuildBenchmark);
+  FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, RestoreBenchmark);
+  FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, HistoryItemsForTermsReplay);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, Scoring);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, TitleSearch);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, TypedCharacterCaching);
+  FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, TypedCharacterCacheUpdates);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, WhitelistedURLs);
   FRIEND_TEST_ALL_PREFIXES(LimitedInMemoryURLIndexTest, Initialization);
 
-  // Support caching of term results so that we can optimize searches which
-  // build upon a previous search. Each entry in this map represents one
-  // search term from the most recent search. For example, if the user had
-  // typed "google blog trans" and then typed an additional 'l' (at the end,
-  // of course) then there would be four items in the cache: 'blog', 'google',
-  // 'trans', and 'transl'. All would be marked as being in use except for the
-  // 'trans' item; its cached data would have been used when optimizing the
-  // construction of the search results candidates for 'transl' but then would
-  // no longer needed.
-  //
-  // Items stored in the search term cache. If a search term exactly matches one
-  // in the cache then we can quickly supply the proper |history_id_set_| (and
-  // marking the cache item as being |used_|. If we find a prefix for a search
-  // term in the cache (which is very likely to occur as the user types each
-  // term into the omnibox) then we can short-circuit the index search for those
-  // characters in the prefix by returning the |word_id_set|. In that case we do
-  // not mark the item as being |used_|.
-  struct SearchTermCacheItem {
-    SearchTermCacheItem(const WordIDSet& word_id_set,
-                        const HistoryIDSet& history_id_set);
-    // Creates a cache item for a term which has no results.
-    SearchTermCacheItem();
-
-    ~SearchTermCacheItem();
-
-    WordIDSet word_id_set_;
-    HistoryIDSet history_id_set_;
-    bool used_;  // True if this item has been used for the current term search.
-  };
-  typedef std::map<base::string16, SearchTermCacheItem> SearchTermCacheMap;
-
-  // A helper class which performs the final filter on each candidate
-  // history URL match, inserting accepted matches into |scored_matches_|.
-  class AddHistoryMatch : public std::unary_function<HistoryID, void> {
-   public:
-    AddHistoryMatch(const URLIndexPrivateData& private_data,
-                    const std::string& languages,
-                    BookmarkService* bookmark_service,
-                    const base::string16& lower_string,
-                    const String16Vector& lower_terms,
-                    const base::Time now);
-    ~AddHistoryMatch();
-
-    void operator()(const HistoryID history_id);
-
-    ScoredHistoryMatches ScoredMatches() const { return scored_matches_; }
-
-   private:
-    const URLIndexPrivateData& private_data_;
-    const std::string& languages_;
-    BookmarkService* bookmark_service_;
-    ScoredHistoryMatches scored_matches_;
-    const base::string16& lower_string_;
-    const String16Vector& lower_terms_;
-    const base::Time now_;
-  };
-
   // A helper predicate class used to filter excess history items when the
   // candidate results set is too large.
   class HistoryItemFactorGreater
@@ -231,6 +211,14 @@ class URLIndexPrivateData
     const history::HistoryInfoMap& history_info_map_;
   };
 
+  // The words and word starts of a contiguous run of rows, computed off the
+  // main thread during a rebuild. Defined in the .cc file.
+  struct RebuildShard;
+
+  // The rows being indexed by IndexRows() and the shards they are broken
+  // into. Defined in the .cc file.
+  struct RebuildState;
+
   // URL History indexing support functions.
 
   // Composes a set of history item IDs by intersecting the set for each word
@@ -260,6 +248,50 @@ class URLIndexPrivateData
                 const std::string& languages,
                 const std::set<std::string>& scheme_whitelist);
 
+  // Rebuilds from |history_db| as StartRebuildFromHistory() does, splitting
+  // the rows into at most |shard_count| shards which are broken into words on
+  // |task_runner|. Without |task_runner| the rebuild is done, and |callback|
+  // run, before this returns.
+  static void RebuildFromHistoryInShards(
+      HistoryDatabase* history_db,
+      const std::string& languages,
+      const std::set<std::string>& scheme_whitelist,
+      size_t shard_count,
+      base::TaskRunner* task_runner,
+      const RebuildCallback& callback);
+
+  // Records how the rebuild started at |beginning_time| went, and runs
+  // |callback| with this object.
+  void DoneRebuildingFromHistory(base::TimeTicks beginning_time,
+                                 const RebuildCallback& callback);
+
+  // Indexes the rows taken from |rows| in order, exactly as calling IndexRow()
+  // on each would but without fetching recent visits, then runs |done|. The
+  // rows are broken into words in up to |shard_count| shards on |task_runner|,
+  // and the shards are merged on the calling thread as they are built, in
+  // order, so that WordIDs are assigned in the same order as by a serial
+  // rebuild. Without |task_runner| the rows are indexed, and |done| run,
+  // before this returns.
+  void IndexRows(std::vector<URLRow>* rows,
+                 const std::string& languages,
+                 const std::set<std::string>& scheme_whitelist,
+                 size_t shard_count,
+                 base::TaskRunner* task_runner,
+                 const base::Closure& done);
+
+  // Breaks the rows of shard |index| of |rebuild| into words. Runs on any
+  // thread.
+  static void BuildRebuildShard(scoped_refptr<RebuildState> rebuild,
+                                size_t index);
+
+  // Called on the thread which called IndexRows() once shard |index| of
+  // |rebuild| is built. Merges the built shards which follow the ones already
+  // merged, and finishes the rebuild once all are.
+  void OnRebuildShardBuilt(scoped_refptr<RebuildState> rebuild, size_t index);
+
+  // Adds the rows and words of |shard| to the index.
+  void MergeRebuildShard(const RebuildShard& shard);
+
   // Parses and indexes the words in the URL and page title of |row| and
   // calculate the word starts in each, saving the starts in |word_starts|.
   // |languages| gives a list of language encodings by which the URLs and page
@@ -276,6 +308,10 @@ class URLIndexPrivateData
   // |history_id| as the initial element of the word's set.
   void AddWordHistory(const base::string16& uni_word, HistoryID history_id);
 
+  // Assigns a WordID to the new word |uni_word| and adds it to the word and
+  // character indexes, but not to the word/history map.
+  WordID AddWord(const base::string16& uni_word);
+
   // Updates an existing entry in the word/history index by adding the
   // |history_id| to set for |word_id| in the word_id_history_map_.
   void UpdateWordHistory(WordID word_id, HistoryID history_id);
@@ -290,25 +326,43 @@ class URLIndexPrivateData
   // Removes all words and characters associated with |row| from the index.
   void RemoveRowWordsFromIndex(const URLRow& row);
 
-  // Clears |used_| for each item in the search term cache.
-  void ResetSearchTermCache();
+  // Removes the search term cache entries affected by adding |word| to or
+  // removing it from a row.
+  void InvalidateSearchTermCacheForWord(const base::string16& word);
 
   // Caches the index private data and writes the cache file to the profile
-  // directory.  Called by WritePrivateDataToCacheFileTask.
+  // directory in the memory-mappable format described in
+  // url_index_cache_file.h.  Called by WritePrivateDataToCacheFileTask.
   bool SaveToFile(const base::FilePath& file_path);
 
-  // Encode a data structure into the protobuf |cache|.
-  void SavePrivateData(imui::InMemoryURLIndexCacheItem* cache) const;
-  void SaveWordList(imui::InMemoryURLIndexCacheItem* cache) const;
-  void SaveWordMap(imui::InMemoryURLIndexCacheItem* cache) const;
-  void SaveCharWordMap(imui::InMemoryURLIndexCacheItem* cache) const;
-  void SaveWordIDHistoryMap(imui::InMemoryURLIndexCacheItem* cache) const;
-  void SaveHistoryInfoMap(imui::InMemoryURLIndexCacheItem* cache) const;
-  void SaveWordStartsMap(imui::InMemoryURLIndexCacheItem* cache) const;
-
-  // Decode a data structure from the protobuf |cache|. Return false if there
-  // is any kind of failure. |languages| will be used to break URLs and page
-  // titles into words
+  // Encode the index into |writer|.
+  void SavePrivateData(URLIndexCacheFileWriter* writer) const;
+
+  // Restores the index from the mapped cache file |reader|. Return false if
+  // the cache is too old, of an old version or empty. |languages| will be
+  // used to break URLs and page titles into words if the cache holds no word
+  // starts.
+  bool RestoreFromMappedCache(const URLIndexCacheFileReader& reader,
+                              const std::string& languages);
+
+  // Builds the index maps from the checked cache file |reader|.
+  void MaterializeMappedCache(const URLIndexCacheFileReader& reader,
+                              const std::string& languages);
+
+  // Returns false if an index last rebuilt from history at |rebuild_time| is
+  // too old (or from the future) to be worth restoring.
+  static bool RebuildTimeIsRecent(base::Time rebuild_time);
+
+  // Records the size of the freshly restored index.
+  void RecordRestoreMetrics() const;
+
+  // Computes the word starts for the URL and title of every row in
+  // history_info_map_. Used when restoring from a cache without word starts.
+  void RebuildWordStartsMap(const std::string& languages);
+
+  // Decode a data structure from the legacy protobuf |cache|. Return false if
+  // there is any kind of failure. |languages| will be used to break URLs and
+  // page titles into words
   bool RestorePrivateData(const imui::InMemoryURLIndexCacheItem& cache,
                           const std::string& languages);
   bool RestoreWordList(const imui::InMemoryURLIndexCacheItem& cache);
@@ -323,8 +377,8 @@ class URLIndexPrivateData
   static bool URLSchemeIsWhitelisted(const GURL& gurl,
                                      const std::set<std::string>& whitelist);
 
-  // Cache of search terms.
-  SearchTermCacheMap search_term_cache_;
+  // Cache of the results for the terms of recent searches.
+  SearchTermCache search_term_cache_;
 
   // Allows canceling pending requests to update recent visits information.
   CancelableRequestConsumer recent_visits_consumer_;
@@ -342,7 +396,7 @@ class URLIndexPrivateData
   // A list of all of indexed words. The index of a word in this list is the
   // ID of the word in the word_map_. It reduces the memory overhead by
   // replacing a potentially long and repeated string with a simple index.
-  String16Vector word_list_;
+  WordList word_list_;
 
   // A list of available words slots in |word_list_|. An available word slot
   // is the index of a unused word in word_list_ vector, also referred to as
@@ -10,6 +10,8 @@
 #include "base/bind.h"
 #include "base/threading/thread.h"
 #include "chrome/browser/browser_process.h"
+#include "chrome/browser/favicon/favicon_service.h"
+#include "chrome/browser/favicon/favicon_service_factory.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/history_service_factory.h"
 #include "chrome/browser/profiles/profile_manager.h"
@@ -116,6 +118,12 @@ void MemoryPurger::PurgeBrowser() {
     if (history_service)
       history_service->UnloadBackend();
 
+    // Drop the favicons cached in memory for the UI.
+    FaviconService* favicon_service =
+        FaviconServiceFactory::GetForProfileIfExists(profiles[i]);
+    if (favicon_service)
+      favicon_service->PurgeMemory();
+
     // Unload all web databases (freeing memory used to cache sqlite).
     WebDataServiceWrapper* wds_wrapper =
         WebDataServiceFactory::GetForProfileIfExists(
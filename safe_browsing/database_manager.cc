@@ -446,8 +446,11 @@ void SafeBrowsingDatabaseManager::HandleGetHashResults(
   OnHandleGetHashResults(check, full_hashes);  // 'check' is deleted here.
 
   if (can_cache && MakeDatabaseAvailable()) {
-    // Cache the GetHash results in memory:
-    database_->CacheHashResults(prefixes, full_hashes);
+    // Cache the GetHash results in memory.  This replaces the cache which
+    // lookups read, so it is done on the database thread rather than here.
+    safe_browsing_thread_->message_loop()->PostTask(FROM_HERE, base::Bind(
+        &SafeBrowsingDatabaseManager::CacheHashResults, this,
+        prefixes, full_hashes));
   }
 }
 
@@ -11,6 +11,11 @@
 #include "base/logging.h"
 #include "base/md5.h"
 #include "base/metrics/histogram.h"
+#include "build/build_config.h"
+
+#if defined(ARCH_CPU_X86_FAMILY)
+#include <emmintrin.h>
+#endif
 
 namespace {
 
@@ -20,38 +25,162 @@ namespace {
 static uint32 kMagic = 0x864088dd;
 
 // Current version the code writes out.
-static uint32 kVersion = 0x1;
+static uint32 kVersion = 0x2;
+
+// Version whose files |LoadFile()| converts.
+static uint32 kVersion1 = 0x1;
+
+typedef struct {
+  uint32 magic;
+  uint32 version;
+  uint32 block_count;
+  uint32 block_deltas;
+} FileHeader;
 
 typedef struct {
   uint32 magic;
   uint32 version;
   uint32 index_size;
   uint32 deltas_size;
-} FileHeader;
+} FileHeaderV1;
+
+COMPILE_ASSERT(sizeof(FileHeader) == sizeof(FileHeaderV1),
+               file_header_sizes_differ);
+
+// Reads the rest of a version 1 file of |file_size| bytes, whose header
+// has been read into |header| and digested into |context|, and decodes
+// its prefixes into |prefixes|.
+bool ReadVersion1Prefixes(FILE* fp,
+                          const FileHeaderV1& header,
+                          int64 file_size,
+                          base::MD5Context* context,
+                          std::vector<SBPrefix>* prefixes) {
+  typedef std::pair<SBPrefix,uint32> IndexPair;
+  std::vector<IndexPair> index;
+  const size_t index_bytes = sizeof(index[0]) * header.index_size;
 
-}  // namespace
+  // For a time, the second element of the index pair was a size_t rather
+  // than a fixed-size value.  This structure will be used to check, read and
+  // convert in case a 64-bit size_t was written.
+  std::vector<std::pair<SBPrefix,uint64> > alt_index;
+  const size_t alt_index_bytes = sizeof(alt_index[0]) * header.index_size;
 
-namespace safe_browsing {
+  std::vector<uint16> deltas;
+  const size_t deltas_bytes = sizeof(deltas[0]) * header.deltas_size;
 
-// For |std::upper_bound()| to find a prefix w/in a vector of pairs.
-// static
-bool PrefixSet::PrefixLess(const IndexPair& a, const IndexPair& b) {
-  return a.first < b.first;
+  // Check for bogus sizes before allocating any space.
+  using base::MD5Digest;
+  const size_t expected_bytes =
+      sizeof(header) + index_bytes + deltas_bytes + sizeof(MD5Digest);
+  bool read_alt_index = false;
+  if (static_cast<int64>(expected_bytes) != file_size) {
+    const size_t alt_expected_bytes =
+        sizeof(header) + alt_index_bytes + deltas_bytes + sizeof(MD5Digest);
+    if (static_cast<int64>(alt_expected_bytes) != file_size)
+      return false;
+
+    read_alt_index = true;
+  }
+
+  // Read the index vector.  Herb Sutter indicates that vectors are
+  // guaranteed to be contiuguous, so reading to where element 0 lives
+  // is valid.
+  size_t read;
+  if (read_alt_index) {
+    alt_index.resize(header.index_size);
+    read = fread(&(alt_index[0]), sizeof(alt_index[0]), alt_index.size(), fp);
+    if (read != alt_index.size())
+      return false;
+    base::MD5Update(context,
+                    base::StringPiece(reinterpret_cast<char*>(&(alt_index[0])),
+                                      alt_index_bytes));
+
+    index.reserve(alt_index.size());
+    for (size_t i = 0; i < alt_index.size(); ++i) {
+      const uint32 ofs = static_cast<uint32>(alt_index[i].second);
+      if (static_cast<uint64>(ofs) != alt_index[i].second)
+        return false;
+      index.push_back(std::make_pair(alt_index[i].first, ofs));
+    }
+  } else if (header.index_size) {
+    index.resize(header.index_size);
+    read = fread(&(index[0]), sizeof(index[0]), index.size(), fp);
+    if (read != index.size())
+      return false;
+    base::MD5Update(context,
+                    base::StringPiece(reinterpret_cast<char*>(&(index[0])),
+                                      index_bytes));
+  }
+
+  // Read vector of deltas.
+  if (header.deltas_size) {
+    deltas.resize(header.deltas_size);
+    read = fread(&(deltas[0]), sizeof(deltas[0]), deltas.size(), fp);
+    if (read != deltas.size())
+      return false;
+    base::MD5Update(context,
+                    base::StringPiece(reinterpret_cast<char*>(&(deltas[0])),
+                                      deltas_bytes));
+  }
+
+  base::MD5Digest calculated_digest;
+  base::MD5Final(&calculated_digest, context);
+
+  base::MD5Digest file_digest;
+  read = fread(&file_digest, sizeof(file_digest), 1, fp);
+  if (read != 1)
+    return false;
+
+  if (0 != memcmp(&file_digest, &calculated_digest, sizeof(file_digest)))
+    return false;
+
+  // The deltas for an index pair run to the next pair's offset, or the end
+  // of the deltas.
+  prefixes->reserve(index.size() + deltas.size());
+  for (size_t ii = 0; ii < index.size(); ++ii) {
+    const size_t deltas_end =
+        (ii + 1 < index.size()) ? index[ii + 1].second : deltas.size();
+    if (index[ii].second > deltas_end || deltas_end > deltas.size())
+      return false;
+
+    SBPrefix current = index[ii].first;
+    prefixes->push_back(current);
+    for (size_t di = index[ii].second; di < deltas_end; ++di) {
+      current += deltas[di];
+      prefixes->push_back(current);
+    }
+  }
+
+  // The data passed the digest check, but make sure it will not trip up
+  // the constructor.
+  for (size_t i = 1; i < prefixes->size(); ++i) {
+    if ((*prefixes)[i] < (*prefixes)[i - 1])
+      return false;
+  }
+  return true;
 }
 
+}  // namespace
+
+namespace safe_browsing {
+
 PrefixSet::PrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
   if (sorted_prefixes.size()) {
-    // Estimate the resulting vector sizes.  There will be strictly
-    // more than |min_runs| entries in |index_|, but there generally
-    // aren't many forced breaks.
-    const size_t min_runs = sorted_prefixes.size() / kMaxRun;
-    index_.reserve(min_runs);
-    deltas_.reserve(sorted_prefixes.size() - min_runs);
+    // Estimate the resulting vector sizes.  There will be at least
+    // |min_blocks| blocks, but there generally aren't many forced
+    // breaks.
+    const size_t min_blocks =
+        (sorted_prefixes.size() + kBlockDeltas) / (kBlockDeltas + 1);
+    std::vector<Block> blocks;
+    blocks.reserve(min_blocks);
+    block_bases_.reserve(min_blocks);
 
     // Lead with the first prefix.
     SBPrefix prev_prefix = sorted_prefixes[0];
     size_t run_length = 0;
-    index_.push_back(std::make_pair(prev_prefix, deltas_.size()));
+    block_bases_.push_back(prev_prefix);
+    blocks.push_back(Block());
+    size_t unique_prefixes = 1;
 
     for (size_t i = 1; i < sorted_prefixes.size(); ++i) {
       // Skip duplicates.
@@ -61,29 +190,37 @@ PrefixSet::PrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
       // Calculate the delta.  |unsigned| is mandatory, because the
       // sorted_prefixes could be more than INT_MAX apart.
       DCHECK_GT(sorted_prefixes[i], prev_prefix);
-      const unsigned delta = sorted_prefixes[i] - prev_prefix;
+      const unsigned delta = static_cast<unsigned>(sorted_prefixes[i]) -
+          static_cast<unsigned>(prev_prefix);
       const uint16 delta16 = static_cast<uint16>(delta);
 
-      // New index ref if the delta doesn't fit, or if too many
-      // consecutive deltas have been encoded.
-      if (delta != static_cast<unsigned>(delta16) || run_length >= kMaxRun) {
-        index_.push_back(std::make_pair(sorted_prefixes[i], deltas_.size()));
+      // New block if the delta doesn't fit, or if the current block
+      // is full.
+      if (delta != static_cast<unsigned>(delta16) ||
+          run_length == kBlockDeltas) {
+        block_bases_.push_back(sorted_prefixes[i]);
+        blocks.push_back(Block());
         run_length = 0;
       } else {
         // Continue the run of deltas.
-        deltas_.push_back(delta16);
-        DCHECK_EQ(static_cast<unsigned>(deltas_.back()), delta);
+        blocks.back().deltas[run_length] = delta16;
+        DCHECK_EQ(static_cast<unsigned>(blocks.back().deltas[run_length]),
+                  delta);
         ++run_length;
       }
 
       prev_prefix = sorted_prefixes[i];
+      ++unique_prefixes;
     }
 
+    AllocateBlocks(blocks.size());
+    memcpy(blocks_.get(), &blocks[0], sizeof(blocks[0]) * blocks.size());
+
     // Send up some memory-usage stats.  Bits because fractional bytes
     // are weird.
-    const size_t bits_used = index_.size() * sizeof(index_[0]) * CHAR_BIT +
-        deltas_.size() * sizeof(deltas_[0]) * CHAR_BIT;
-    const size_t unique_prefixes = index_.size() + deltas_.size();
+    const size_t bits_used =
+        block_bases_.size() * (sizeof(block_bases_[0]) + sizeof(Block)) *
+        CHAR_BIT;
     static const size_t kMaxBitsPerPrefix = sizeof(SBPrefix) * CHAR_BIT;
     UMA_HISTOGRAM_ENUMERATION("SB2.PrefixSetBitsPerPrefix",
                               bits_used / unique_prefixes,
@@ -91,59 +228,130 @@ PrefixSet::PrefixSet(const std::vector<SBPrefix>& sorted_prefixes) {
   }
 }
 
-PrefixSet::PrefixSet(IndexVector* index, std::vector<uint16>* deltas) {
-  DCHECK(index && deltas);
-  index_.swap(*index);
-  deltas_.swap(*deltas);
-}
+PrefixSet::PrefixSet() {}
 
 PrefixSet::~PrefixSet() {}
 
+void PrefixSet::AllocateBlocks(size_t block_count) {
+  COMPILE_ASSERT(sizeof(Block) == 64, block_should_fill_a_cache_line);
+  blocks_.reset(block_count ?
+      static_cast<Block*>(base::AlignedAlloc(sizeof(Block) * block_count,
+                                             sizeof(Block))) :
+      NULL);
+}
+
+bool PrefixSet::BlockContains(size_t block, SBPrefix prefix) const {
+  // The offsets of the block's prefixes from its base are compared, as
+  // they are computed without any chance of overflow.
+  const uint32 target = static_cast<uint32>(prefix) -
+      static_cast<uint32>(block_bases_[block]);
+  const uint16* deltas = blocks_.get()[block].deltas;
+
+#if defined(ARCH_CPU_X86_FAMILY)
+  // Widen eight deltas at a time to two vectors of four 32-bit lanes, turn
+  // each into running offsets with two shifted adds, carry in the last
+  // offset of the previous vector, and compare all four with |target|.
+  COMPILE_ASSERT(kBlockDeltas % 8 == 0, block_should_be_whole_vectors);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i targets = _mm_set1_epi32(static_cast<int>(target));
+  const __m128i* vectors = reinterpret_cast<const __m128i*>(deltas);
+  __m128i carry = zero;
+  __m128i found = zero;
+  for (size_t i = 0; i < kBlockDeltas / 8; ++i) {
+    const __m128i deltas16 = _mm_load_si128(vectors + i);
+    const __m128i halves[2] = {
+      _mm_unpacklo_epi16(deltas16, zero),
+      _mm_unpackhi_epi16(deltas16, zero),
+    };
+    for (size_t j = 0; j < arraysize(halves); ++j) {
+      __m128i offsets = halves[j];
+      offsets = _mm_add_epi32(offsets, _mm_slli_si128(offsets, 4));
+      offsets = _mm_add_epi32(offsets, _mm_slli_si128(offsets, 8));
+      offsets = _mm_add_epi32(offsets, carry);
+      found = _mm_or_si128(found, _mm_cmpeq_epi32(offsets, targets));
+      carry = _mm_shuffle_epi32(offsets, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+  }
+  return _mm_movemask_epi8(found) != 0;
+#else
+  // Scan forward accumulating deltas while a match is possible.
+  uint32 offset = 0;
+  for (size_t di = 0; di < kBlockDeltas && offset < target; ++di)
+    offset += deltas[di];
+  return offset == target;
+#endif
+}
+
 bool PrefixSet::Exists(SBPrefix prefix) const {
-  if (index_.empty())
+  if (block_bases_.empty())
     return false;
 
-  // Find the first position after |prefix| in |index_|.
-  IndexVector::const_iterator iter =
-      std::upper_bound(index_.begin(), index_.end(),
-                       IndexPair(prefix, 0), PrefixLess);
+  // Find the first block after |prefix|.
+  std::vector<SBPrefix>::const_iterator iter =
+      std::upper_bound(block_bases_.begin(), block_bases_.end(), prefix);
 
   // |prefix| comes before anything that's in the set.
-  if (iter == index_.begin())
+  if (iter == block_bases_.begin())
     return false;
 
-  // Capture the upper bound of our target entry's deltas.
-  const size_t bound = (iter == index_.end() ? deltas_.size() : iter->second);
-
-  // Back up to the entry our target is in.
+  // Back up to the block our target is in.
   --iter;
 
-  // All prefixes in |index_| are in the set.
-  SBPrefix current = iter->first;
-  if (current == prefix)
+  // All prefixes in |block_bases_| are in the set.
+  if (*iter == prefix)
     return true;
 
-  // Scan forward accumulating deltas while a match is possible.
-  for (size_t di = iter->second; di < bound && current < prefix; ++di) {
-    current += deltas_[di];
-  }
+  return BlockContains(iter - block_bases_.begin(), prefix);
+}
 
-  return current == prefix;
+void PrefixSet::ExistsMany(const std::vector<SBPrefix>& prefixes,
+                           std::vector<SBPrefix>* hits) const {
+  if (block_bases_.empty() || prefixes.empty())
+    return;
+
+  std::vector<SBPrefix> sorted_prefixes(prefixes);
+  std::sort(sorted_prefixes.begin(), sorted_prefixes.end());
+
+  // Each prefix can only be in the block of the previous prefix or a later
+  // one, so the search for its block gallops forward from there.  For
+  // large batches the blocks are mostly near each other, and are read in
+  // address order.
+  std::vector<SBPrefix>::const_iterator block_begin = block_bases_.begin();
+  const std::vector<SBPrefix>::const_iterator block_end = block_bases_.end();
+  for (size_t i = 0; i < sorted_prefixes.size(); ++i) {
+    const SBPrefix prefix = sorted_prefixes[i];
+    size_t step = 1;
+    while (step < static_cast<size_t>(block_end - block_begin) &&
+           block_begin[step] <= prefix) {
+      step *= 2;
+    }
+    std::vector<SBPrefix>::const_iterator iter = std::upper_bound(
+        block_begin + step / 2,
+        block_begin + std::min(step, static_cast<size_t>(block_end -
+                                                         block_begin)),
+        prefix);
+
+    // |prefix| comes before anything that's in the set.
+    if (iter == block_bases_.begin())
+      continue;
+    block_begin = --iter;
+
+    if (*iter == prefix || BlockContains(iter - block_bases_.begin(), prefix))
+      hits->push_back(prefix);
+  }
 }
 
 void PrefixSet::GetPrefixes(std::vector<SBPrefix>* prefixes) const {
-  prefixes->reserve(index_.size() + deltas_.size());
+  prefixes->reserve(block_bases_.size() * (kBlockDeltas + 1));
 
-  for (size_t ii = 0; ii < index_.size(); ++ii) {
-    // The deltas for this |index_| entry run to the next index entry,
-    // or the end of the deltas.
-    const size_t deltas_end =
-        (ii + 1 < index_.size()) ? index_[ii + 1].second : deltas_.size();
-
-    SBPrefix current = index_[ii].first;
+  for (size_t bi = 0; bi < block_bases_.size(); ++bi) {
+    // The deltas for this block run to the first unused delta, or the
+    // end of the block.
+    const uint16* deltas = blocks_.get()[bi].deltas;
+    SBPrefix current = block_bases_[bi];
     prefixes->push_back(current);
-    for (size_t di = index_[ii].second; di < deltas_end; ++di) {
-      current += deltas_[di];
+    for (size_t di = 0; di < kBlockDeltas && deltas[di]; ++di) {
+      current += deltas[di];
       prefixes->push_back(current);
     }
   }
@@ -167,79 +375,61 @@ PrefixSet* PrefixSet::LoadFile(const base::FilePath& filter_name) {
   if (read != 1)
     return NULL;
 
-  if (header.magic != kMagic || header.version != kVersion)
+  if (header.magic != kMagic)
     return NULL;
 
-  IndexVector index;
-  const size_t index_bytes = sizeof(index[0]) * header.index_size;
-
-  // For a time, the second element of the index_ pair was a size_t rather than
-  // a fixed-size value.  This structure will be used to check, read and convert
-  // in case a 64-bit size_t was written.
-  std::vector<std::pair<SBPrefix,uint64> > alt_index;
-  const size_t alt_index_bytes = sizeof(alt_index[0]) * header.index_size;
-
-  std::vector<uint16> deltas;
-  const size_t deltas_bytes = sizeof(deltas[0]) * header.deltas_size;
-
-  // Check for bogus sizes before allocating any space.
-  const size_t expected_bytes =
-      sizeof(header) + index_bytes + deltas_bytes + sizeof(MD5Digest);
-  bool read_alt_index = false;
-  if (static_cast<int64>(expected_bytes) != size_64) {
-    const size_t alt_expected_bytes =
-        sizeof(header) + alt_index_bytes + deltas_bytes + sizeof(MD5Digest);
-    if (static_cast<int64>(alt_expected_bytes) != size_64)
-      return NULL;
-
-    read_alt_index = true;
-  }
-
   // The file looks valid, start building the digest.
   base::MD5Context context;
   base::MD5Init(&context);
   base::MD5Update(&context, base::StringPiece(reinterpret_cast<char*>(&header),
                                               sizeof(header)));
 
-  // Read the index vector.  Herb Sutter indicates that vectors are
-  // guaranteed to be contiuguous, so reading to where element 0 lives
-  // is valid.
-  if (read_alt_index) {
-    alt_index.resize(header.index_size);
-    read = fread(&(alt_index[0]), sizeof(alt_index[0]), alt_index.size(),
-                 file.get());
-    if (read != alt_index.size())
+  // Rebuild the set from the prefixes of an older file.  The new format
+  // is written out the next time the set is.
+  if (header.version == kVersion1) {
+    FileHeaderV1 header_v1;
+    memcpy(&header_v1, &header, sizeof(header_v1));
+    std::vector<SBPrefix> prefixes;
+    if (!ReadVersion1Prefixes(file.get(), header_v1, size_64, &context,
+                              &prefixes)) {
       return NULL;
-    base::MD5Update(&context,
-                    base::StringPiece(reinterpret_cast<char*>(&(alt_index[0])),
-                                      alt_index_bytes));
-
-    index.reserve(alt_index.size());
-    for (size_t i = 0; i < alt_index.size(); ++i) {
-      const uint32 ofs = static_cast<uint32>(alt_index[i].second);
-      if (static_cast<uint64>(ofs) != alt_index[i].second)
-        return NULL;
-      index.push_back(std::make_pair(alt_index[i].first, ofs));
     }
-  } else if (header.index_size) {
-    index.resize(header.index_size);
-    read = fread(&(index[0]), sizeof(index[0]), index.size(), file.get());
-    if (read != index.size())
+    return new PrefixSet(prefixes);
+  }
+
+  if (header.version != kVersion || header.block_deltas != kBlockDeltas)
+    return NULL;
+
+  // Check for bogus sizes before allocating any space.
+  const size_t bases_bytes = sizeof(SBPrefix) * header.block_count;
+  const size_t blocks_bytes = sizeof(Block) * header.block_count;
+  const size_t expected_bytes =
+      sizeof(header) + bases_bytes + blocks_bytes + sizeof(MD5Digest);
+  if (static_cast<int64>(expected_bytes) != size_64)
+    return NULL;
+
+  scoped_ptr<PrefixSet> prefix_set(new PrefixSet);
+  if (header.block_count) {
+    std::vector<SBPrefix>& block_bases = prefix_set->block_bases_;
+    block_bases.resize(header.block_count);
+    read = fread(&(block_bases[0]), sizeof(block_bases[0]), block_bases.size(),
+                 file.get());
+    if (read != block_bases.size())
       return NULL;
     base::MD5Update(&context,
-                    base::StringPiece(reinterpret_cast<char*>(&(index[0])),
-                                      index_bytes));
-  }
+                    base::StringPiece(
+                        reinterpret_cast<char*>(&(block_bases[0])),
+                        bases_bytes));
 
-  // Read vector of deltas.
-  if (header.deltas_size) {
-    deltas.resize(header.deltas_size);
-    read = fread(&(deltas[0]), sizeof(deltas[0]), deltas.size(), file.get());
-    if (read != deltas.size())
+    prefix_set->AllocateBlocks(header.block_count);
+    read = fread(prefix_set->blocks_.get(), sizeof(Block), header.block_count,
+                 file.get());
+    if (read != header.block_count)
       return NULL;
     base::MD5Update(&context,
-                    base::StringPiece(reinterpret_cast<char*>(&(deltas[0])),
-                                      deltas_bytes));
+                    base::StringPiece(
+                        reinterpret_cast<char*>(prefix_set->blocks_.get()),
+                        blocks_bytes));
   }
 
   base::MD5Digest calculated_digest;
@@ -253,20 +443,18 @@ PrefixSet* PrefixSet::LoadFile(const base::FilePath& filter_name) {
   if (0 != memcmp(&file_digest, &calculated_digest, sizeof(file_digest)))
     return NULL;
 
-  // Steals contents of |index| and |deltas| via swap().
-  return new PrefixSet(&index, &deltas);
+  return prefix_set.release();
 }
 
 bool PrefixSet::WriteFile(const base::FilePath& filter_name) const {
   FileHeader header;
   header.magic = kMagic;
   header.version = kVersion;
-  header.index_size = static_cast<uint32>(index_.size());
-  header.deltas_size = static_cast<uint32>(deltas_.size());
+  header.block_count = static_cast<uint32>(block_bases_.size());
+  header.block_deltas = static_cast<uint32>(kBlockDeltas);
 
   // Sanity check that the 32-bit values never mess things up.
-  if (static_cast<size_t>(header.index_size) != index_.size() ||
-      static_cast<size_t>(header.deltas_size) != deltas_.size()) {
+  if (static_cast<size_t>(header.block_count) != block_bases_.size()) {
     NOTREACHED();
     return false;
   }
@@ -288,28 +476,26 @@ bool PrefixSet::WriteFile(const base::FilePath& filter_name) const {
 
   // As for reads, the standard guarantees the ability to access the
   // contents of the vector by a pointer to an element.
-  if (index_.size()) {
-    const size_t index_bytes = sizeof(index_[0]) * index_.size();
-    written = fwrite(&(index_[0]), sizeof(index_[0]), index_.size(),
-                     file.get());
-    if (written != index_.size())
+  if (block_bases_.size()) {
+    const size_t bases_bytes = sizeof(block_bases_[0]) * block_bases_.size();
+    written = fwrite(&(block_bases_[0]), sizeof(block_bases_[0]),
+                     block_bases_.size(), file.get());
+    if (written != block_bases_.size())
       return false;
     base::MD5Update(&context,
                     base::StringPiece(
-                        reinterpret_cast<const char*>(&(index_[0])),
-                        index_bytes));
-  }
+                        reinterpret_cast<const char*>(&(block_bases_[0])),
+                        bases_bytes));
 
-  if (deltas_.size()) {
-    const size_t deltas_bytes = sizeof(deltas_[0]) * deltas_.size();
-    written = fwrite(&(deltas_[0]), sizeof(deltas_[0]), deltas_.size(),
+    const size_t blocks_bytes = sizeof(Block) * block_bases_.size();
+    written = fwrite(blocks_.get(), sizeof(Block), block_bases_.size(),
                      file.get());
-    if (written != deltas_.size())
+    if (written != block_bases_.size())
       return false;
     base::MD5Update(&context,
                     base::StringPiece(
-                        reinterpret_cast<const char*>(&(deltas_[0])),
-                        deltas_bytes));
+                        reinterpret_cast<const char*>(blocks_.get()),
+                        blocks_bytes));
   }
 
   base::MD5Digest digest;
@@ -3,17 +3,25 @@
 // found in the LICENSE file.
 //
 // A read-only set implementation for |SBPrefix| items.  Prefixes are
-// sorted and stored as 16-bit deltas from the previous prefix.  An
-// index structure provides quick random access, and also handles
-// cases where 16 bits cannot encode a delta.
+// sorted and stored as 16-bit deltas from the previous prefix, packed
+// into blocks of |kBlockDeltas| deltas which each fill a cache line.
+// Each block follows a base prefix held in a separate index.  A delta
+// which cannot be encoded in 16 bits starts a new block, as does a
+// prefix which does not fit in the current one.  Unused deltas at the
+// end of a block are 0, which cannot otherwise occur since the set has
+// no duplicates.
 //
-// For example, the sequence {20, 25, 41, 65432, 150000, 160000} would
-// be stored as:
-//  A pair {20, 0} in |index_|.
-//  5, 16, 65391 in |deltas_|.
-//  A pair {150000, 3} in |index_|.
-//  10000 in |deltas_|.
-// |index_.size()| will be 2, |deltas_.size()| will be 4.
+// For example, with 4 deltas per block the sequence {20, 25, 41, 65432,
+// 150000, 160000, 160001, 160002, 160003, 160004} would be stored as:
+//  20, 150000, 160004 in |block_bases_|.
+//  {5, 16, 65391, 0}, {10000, 1, 1, 1}, {0, 0, 0, 0} in |blocks_|.
+//
+// |Exists()| binary searches |block_bases_|, which for realistic sets is
+// small enough to stay in cache, then reads the one cache line holding
+// the block the prefix would be in.  The block's deltas are summed all at
+// once with SIMD where available, rather than scanned one at a time.
+// |ExistsMany()| sorts its queries and streams them through the blocks
+// in order, searching forward from the previous query's block.
 //
 // This structure is intended for storage of sparse uniform sets of
 // prefixes of a certain size.  As of this writing, my safe-browsing
@@ -23,34 +31,36 @@
 //   24301 w/in 2^8 of the prior prefix
 //   622337 w/in 2^16 of the prior prefix
 //   47 further than 2^16 from the prior prefix
-// For this input, the memory usage is approximately 2 bytes per
-// prefix, a bit over 1.2M.  The bloom filter used 25 bits per prefix,
-// a bit over 1.9M on this data.
+// For this input the memory usage is 68 bytes per 33 prefixes, a bit
+// over 2 bytes per prefix, or about 1.3M.  The bloom filter used 25 bits
+// per prefix, a bit over 1.9M on this data.
 //
-// Experimenting with random selections of the above data, storage
-// size drops almost linearly as prefix count drops, until the index
-// overhead starts to become a problem a bit under 200k prefixes.  The
-// memory footprint gets worse than storing the raw prefix data around
-// 75k prefixes.  Fortunately, the actual memory footprint also falls.
-// If the prefix count increases the memory footprint should increase
-// approximately linearly.  The worst-case would be 2^16 items all
-// 2^16 apart, which would need 512k (versus 256k to store the raw
-// data).
+// Sets whose prefixes are mostly further than 2^16 apart, which is
+// every set of uniformly distributed prefixes under about 65k prefixes,
+// degrade towards a block per prefix.  The worst-case would be 2^16
+// items all 2^16 apart, which would need about 4.5M (versus 256k to
+// store the raw data).
 //
 // The on-disk format looks like:
 //         4 byte magic number
 //         4 byte version number
-//         4 byte |index_.size()|
-//         4 byte |deltas_.size()|
-//     n * 8 byte |&index_[0]..&index_[n]|
-//     m * 2 byte |&deltas_[0]..&deltas_[m]|
+//         4 byte |block_bases_.size()|
+//         4 byte |kBlockDeltas|
+//     n * 4 byte |&block_bases_[0]..&block_bases_[n]|
+//    n * 64 byte |&blocks_[0]..&blocks_[n]|
 //        16 byte digest
+//
+// Version 1 files, which stored a vector of (prefix, offset) index pairs
+// followed by a single vector of deltas with runs of at most 100 deltas,
+// are converted by |LoadFile()|.
 
 #ifndef CHROME_BROWSER_SAFE_BROWSING_PREFIX_SET_H_
 #define CHROME_BROWSER_SAFE_BROWSING_PREFIX_SET_H_
 
 #include <vector>
 
+#include "base/memory/aligned_memory.h"
+#include "base/memory/scoped_ptr.h"
 #include "chrome/browser/safe_browsing/safe_browsing_util.h"
 
 namespace base {
@@ -67,6 +77,12 @@ class PrefixSet {
   // |true| if |prefix| was in |prefixes| passed to the constructor.
   bool Exists(SBPrefix prefix) const;
 
+  // Appends those of |prefixes| which are in the set to |hits|, in
+  // sorted order.  |prefixes| need not be sorted.  Cheaper than calling
+  // |Exists()| for each when several prefixes are checked together.
+  void ExistsMany(const std::vector<SBPrefix>& prefixes,
+                  std::vector<SBPrefix>* hits) const;
+
   // Persist the set on disk.
   static PrefixSet* LoadFile(const base::FilePath& filter_name);
   bool WriteFile(const base::FilePath& filter_name) const;
@@ -76,30 +92,30 @@ class PrefixSet {
   void GetPrefixes(std::vector<SBPrefix>* prefixes) const;
 
  private:
-  // Maximum number of consecutive deltas to encode before generating
-  // a new index entry.  This helps keep the worst-case performance
-  // for |Exists()| under control.
-  static const size_t kMaxRun = 100;
-
-  // Helpers to make |index_| easier to deal with.
-  typedef std::pair<SBPrefix,uint32> IndexPair;
-  typedef std::vector<IndexPair> IndexVector;
-  static bool PrefixLess(const IndexPair& a, const IndexPair& b);
-
-  // Helper for |LoadFile()|.  Steals the contents of |index| and
-  // |deltas| using |swap()|.
-  PrefixSet(IndexVector* index, std::vector<uint16>* deltas);
-
-  // Top-level index of prefix to offset in |deltas_|.  Each pair
-  // indicates a base prefix and where the deltas from that prefix
-  // begin in |deltas_|.  The deltas for a pair end at the next pair's
-  // index into |deltas_|.
-  IndexVector index_;
-
-  // Deltas which are added to the prefix in |index_| to generate
-  // prefixes.  Deltas are only valid between consecutive items from
-  // |index_|, or the end of |deltas_| for the last |index_| pair.
-  std::vector<uint16> deltas_;
+  // The number of deltas in a block, which fill a 64-byte cache line.
+  static const size_t kBlockDeltas = 32;
+
+  struct Block {
+    uint16 deltas[kBlockDeltas];
+  };
+
+  // Helper for |LoadFile()|, which fills in the members.
+  PrefixSet();
+
+  // Allocates cache-line-aligned storage for |block_count| blocks.
+  void AllocateBlocks(size_t block_count);
+
+  // |true| if |prefix|, which is greater than the block's base, is one of
+  // the prefixes encoded in block |block|.
+  bool BlockContains(size_t block, SBPrefix prefix) const;
+
+  // The first prefix of each block.
+  std::vector<SBPrefix> block_bases_;
+
+  // |block_bases_.size()| blocks of deltas which are added to the
+  // corresponding base prefix in turn to generate the block's other
+  // prefixes.
+  scoped_ptr<Block, base::AlignedFreeDeleter> blocks_;
 
   DISALLOW_COPY_AND_ASSIGN(PrefixSet);
 };
@@ -13,18 +13,21 @@
 #include "base/md5.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/rand_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
 #include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
 #include "testing/platform_test.h"
 
 namespace {
 
 class PrefixSetTest : public PlatformTest {
  protected:
-  // Constants for the v1 format.
+  // Constants for the v2 format.
   static const size_t kMagicOffset = 0 * sizeof(uint32);
   static const size_t kVersionOffset = 1 * sizeof(uint32);
-  static const size_t kIndexSizeOffset = 2 * sizeof(uint32);
-  static const size_t kDeltasSizeOffset = 3 * sizeof(uint32);
+  static const size_t kBlockCountOffset = 2 * sizeof(uint32);
+  static const size_t kBlockDeltasOffset = 3 * sizeof(uint32);
   static const size_t kPayloadOffset = 4 * sizeof(uint32);
 
   // Generate a set of random prefixes to share between tests.  For
@@ -99,6 +102,52 @@ class PrefixSetTest : public PlatformTest {
     return true;
   }
 
+  // Write |sorted_prefixes| to |filename| in the v1 format, as the
+  // previous implementation did: an index of (prefix, offset) pairs
+  // starting runs of at most 100 16-bit deltas.
+  static void WriteVersion1File(const base::FilePath& filename,
+                                const std::vector<SBPrefix>& sorted_prefixes) {
+    const size_t kMaxRun = 100;
+    std::vector<std::pair<SBPrefix, uint32> > index;
+    std::vector<uint16> deltas;
+    size_t run_length = 0;
+    for (size_t i = 0; i < sorted_prefixes.size(); ++i) {
+      if (i && sorted_prefixes[i] == sorted_prefixes[i - 1])
+        continue;
+      const unsigned delta = i ? static_cast<unsigned>(sorted_prefixes[i]) -
+          static_cast<unsigned>(sorted_prefixes[i - 1]) : 0;
+      if (index.empty() || delta > 0xFFFF || run_length >= kMaxRun) {
+        index.push_back(std::make_pair(sorted_prefixes[i],
+                                       static_cast<uint32>(deltas.size())));
+        run_length = 0;
+      } else {
+        deltas.push_back(static_cast<uint16>(delta));
+        ++run_length;
+      }
+    }
+
+    file_util::ScopedFILE file(base::OpenFile(filename, "w+b"));
+    ASSERT_TRUE(file.get());
+    const uint32 header[] = {
+      0x864088dd, 1,
+      static_cast<uint32>(index.size()), static_cast<uint32>(deltas.size()),
+    };
+    ASSERT_EQ(1U, fwrite(header, sizeof(header), 1, file.get()));
+    if (!index.empty()) {
+      ASSERT_EQ(index.size(),
+                fwrite(&index[0], sizeof(index[0]), index.size(), file.get()));
+    }
+    if (!deltas.empty()) {
+      ASSERT_EQ(deltas.size(), fwrite(&deltas[0], sizeof(deltas[0]),
+                                      deltas.size(), file.get()));
+    }
+
+    // Leave space for the digest at the end, and regenerate it.
+    base::MD5Digest dummy;
+    ASSERT_EQ(1U, fwrite(&dummy, sizeof(dummy), 1, file.get()));
+    CleanChecksum(file.get());
+  }
+
   // Helper function to read the int32 value at |offset|, increment it
   // by |inc|, and write it back in place.  |fp| should be opened in
   // r+ mode.
@@ -258,7 +307,7 @@ TEST_F(PrefixSetTest, AllBig) {
 // largest item aren't present.  Create a sequence of items with
 // deltas above and below 2^16, and make sure they're all present.
 // Create a very long sequence with deltas below 2^16 to test crossing
-// |kMaxRun|.
+// block boundaries.
 TEST_F(PrefixSetTest, EdgeCases) {
   std::vector<SBPrefix> prefixes;
 
@@ -287,7 +336,7 @@ TEST_F(PrefixSetTest, EdgeCases) {
   }
 
   // Add a long sequence with deltas smaller than the maximum delta,
-  // so a new index item will be injected.
+  // so full blocks will be followed by new ones.
   delta = 256 * 256 - 1;
   prefix = kVeryPositive - delta * 1000;
   prefixes.push_back(prefix);
@@ -372,7 +421,8 @@ TEST_F(PrefixSetTest, CorruptionHelpers) {
   base::FilePath filename;
   ASSERT_TRUE(GetPrefixSetFile(&filename));
 
-  // This will modify data in |index_|, which will fail the digest check.
+  // This will modify data in |block_bases_|, which will fail the digest
+  // check.
   file_util::ScopedFILE file(base::OpenFile(filename, "r+b"));
   IncrementIntAt(file.get(), kPayloadOffset, 1);
   file.reset();
@@ -413,25 +463,25 @@ TEST_F(PrefixSetTest, CorruptionVersion) {
   ASSERT_FALSE(prefix_set.get());
 }
 
-// Bad |index_| size is caught by the sanity check.
-TEST_F(PrefixSetTest, CorruptionIndexSize) {
+// Bad |block_bases_| size is caught by the sanity check.
+TEST_F(PrefixSetTest, CorruptionBlockCount) {
   base::FilePath filename;
   ASSERT_TRUE(GetPrefixSetFile(&filename));
 
   ASSERT_NO_FATAL_FAILURE(
-      ModifyAndCleanChecksum(filename, kIndexSizeOffset, 1));
+      ModifyAndCleanChecksum(filename, kBlockCountOffset, 1));
   scoped_ptr<safe_browsing::PrefixSet>
       prefix_set(safe_browsing::PrefixSet::LoadFile(filename));
   ASSERT_FALSE(prefix_set.get());
 }
 
-// Bad |deltas_| size is caught by the sanity check.
-TEST_F(PrefixSetTest, CorruptionDeltasSize) {
+// A block size other than |kBlockDeltas| is rejected.
+TEST_F(PrefixSetTest, CorruptionBlockDeltas) {
   base::FilePath filename;
   ASSERT_TRUE(GetPrefixSetFile(&filename));
 
   ASSERT_NO_FATAL_FAILURE(
-      ModifyAndCleanChecksum(filename, kDeltasSizeOffset, 1));
+      ModifyAndCleanChecksum(filename, kBlockDeltasOffset, 1));
   scoped_ptr<safe_browsing::PrefixSet>
       prefix_set(safe_browsing::PrefixSet::LoadFile(filename));
   ASSERT_FALSE(prefix_set.get());
@@ -490,8 +540,11 @@ TEST_F(PrefixSetTest, SizeTRecovery) {
   // Open the file for rewrite.
   file_util::ScopedFILE file(base::OpenFile(filename, "r+b"));
 
-  // Leave existing magic and version.
-  ASSERT_NE(-1, fseek(file.get(), sizeof(uint32) * 2, SEEK_SET));
+  // Leave existing magic, and rewrite as a v1 file.
+  ASSERT_NE(-1, fseek(file.get(), sizeof(uint32), SEEK_SET));
+  uint32 version = 1;
+  ASSERT_EQ(sizeof(version),
+            fwrite(&version, 1, sizeof(version), file.get()));
 
   // Indicate two index values and two deltas.
   uint32 val = 2;
@@ -530,4 +583,141 @@ TEST_F(PrefixSetTest, SizeTRecovery) {
   EXPECT_EQ(prefixes_copy[3], 100065);
 }
 
+// Test that files written in the v1 format are converted on load, and
+// written back out in the current format.
+TEST_F(PrefixSetTest, Version1Migration) {
+  base::FilePath filename;
+  ASSERT_TRUE(GetPrefixSetFile(&filename));
+  ASSERT_NO_FATAL_FAILURE(WriteVersion1File(filename, shared_prefixes_));
+
+  scoped_ptr<safe_browsing::PrefixSet>
+      prefix_set(safe_browsing::PrefixSet::LoadFile(filename));
+  ASSERT_TRUE(prefix_set.get());
+  CheckPrefixes(*prefix_set, shared_prefixes_);
+
+  ASSERT_TRUE(prefix_set->WriteFile(filename));
+  prefix_set.reset(safe_browsing::PrefixSet::LoadFile(filename));
+  ASSERT_TRUE(prefix_set.get());
+  CheckPrefixes(*prefix_set, shared_prefixes_);
+
+  // A v1 file with an out-of-range offset is rejected despite a valid
+  // digest.
+  ASSERT_NO_FATAL_FAILURE(WriteVersion1File(filename, shared_prefixes_));
+  file_util::ScopedFILE file(base::OpenFile(filename, "r+b"));
+  ASSERT_NO_FATAL_FAILURE(IncrementIntAt(
+      file.get(), kPayloadOffset + sizeof(SBPrefix), 100000));
+  CleanChecksum(file.get());
+  file.reset();
+  prefix_set.reset(safe_browsing::PrefixSet::LoadFile(filename));
+  EXPECT_FALSE(prefix_set.get());
+}
+
+// |ExistsMany()| agrees with |Exists()| for present and absent prefixes
+// given in any order.
+TEST_F(PrefixSetTest, ExistsMany) {
+  safe_browsing::PrefixSet prefix_set(shared_prefixes_);
+
+  std::vector<SBPrefix> queries;
+  for (size_t i = 0; i < shared_prefixes_.size(); i += 3) {
+    queries.push_back(shared_prefixes_[i]);
+    queries.push_back(shared_prefixes_[i] - 1);
+    queries.push_back(shared_prefixes_[i] + 1);
+  }
+  for (size_t i = 0; i < 1000; ++i)
+    queries.push_back(static_cast<SBPrefix>(base::RandUint64()));
+  std::random_shuffle(queries.begin(), queries.end());
+
+  std::vector<SBPrefix> expected;
+  for (size_t i = 0; i < queries.size(); ++i) {
+    if (prefix_set.Exists(queries[i]))
+      expected.push_back(queries[i]);
+  }
+  std::sort(expected.begin(), expected.end());
+
+  std::vector<SBPrefix> hits;
+  prefix_set.ExistsMany(queries, &hits);
+  EXPECT_EQ(expected, hits);
+
+  // Duplicate queries are reported once each.
+  std::vector<SBPrefix> duplicates(3, shared_prefixes_[0]);
+  hits.clear();
+  prefix_set.ExistsMany(duplicates, &hits);
+  EXPECT_EQ(duplicates, hits);
+
+  // An empty set has no hits.
+  const std::vector<SBPrefix> empty;
+  safe_browsing::PrefixSet empty_set(empty);
+  hits.clear();
+  empty_set.ExistsMany(queries, &hits);
+  EXPECT_TRUE(hits.empty());
+}
+
+// Benchmark construction, file size and lookups over a set the size of
+// the browse list, with queries half of which are in the set.
+TEST_F(PrefixSetTest, DISABLED_Benchmark) {
+  const size_t kPrefixCount = 600000;
+  const size_t kQueryCount = 1000000;
+  std::vector<SBPrefix> prefixes;
+  for (size_t i = 0; i < kPrefixCount; ++i)
+    prefixes.push_back(static_cast<SBPrefix>(base::RandUint64()));
+  std::sort(prefixes.begin(), prefixes.end());
+
+  std::vector<SBPrefix> queries;
+  for (size_t i = 0; i < kQueryCount; ++i) {
+    queries.push_back((i % 2) ?
+        prefixes[base::RandGenerator(prefixes.size())] :
+        static_cast<SBPrefix>(base::RandUint64()));
+  }
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  safe_browsing::PrefixSet prefix_set(prefixes);
+  perf_test::PrintResult(
+      "prefix_set", "_build", "600000_prefixes",
+      (base::TimeTicks::Now() - start).InMillisecondsF(), "ms", true);
+
+  base::FilePath filename;
+  ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+  filename = temp_dir_.path().AppendASCII("PrefixSetBenchmark");
+  ASSERT_TRUE(prefix_set.WriteFile(filename));
+  int64 file_size = 0;
+  ASSERT_TRUE(base::GetFileSize(filename, &file_size));
+  perf_test::PrintResult(
+      "prefix_set", "_file_size", "600000_prefixes",
+      static_cast<double>(file_size) / kPrefixCount, "bytes_per_prefix", true);
+
+  size_t found = 0;
+  start = base::TimeTicks::Now();
+  for (size_t i = 0; i < queries.size(); ++i)
+    found += prefix_set.Exists(queries[i]);
+  perf_test::PrintResult(
+      "prefix_set", "_exists", "600000_prefixes",
+      (base::TimeTicks::Now() - start).InMicrosecondsF() * 1000 / kQueryCount,
+      "ns_per_query", true);
+
+  // Small batches are typical of a page's full hashes, large ones of
+  // checking a list against the set.
+  const size_t kBatchSizes[] = {30, 10000};
+  for (size_t b = 0; b < arraysize(kBatchSizes); ++b) {
+    size_t batch_found = 0;
+    std::vector<SBPrefix> batch;
+    std::vector<SBPrefix> hits;
+    start = base::TimeTicks::Now();
+    for (size_t i = 0; i < queries.size(); i += kBatchSizes[b]) {
+      batch.assign(queries.begin() + i,
+                   queries.begin() + std::min(i + kBatchSizes[b],
+                                              queries.size()));
+      hits.clear();
+      prefix_set.ExistsMany(batch, &hits);
+      batch_found += hits.size();
+    }
+    perf_test::PrintResult(
+        "prefix_set", "_exists_many",
+        "600000_prefixes_batch_" + base::Uint64ToString(kBatchSizes[b]),
+        (base::TimeTicks::Now() - start).InMicrosecondsF() * 1000 /
+            kQueryCount,
+        "ns_per_query", true);
+    EXPECT_EQ(found, batch_found);
+  }
+}
+
 }  // namespace
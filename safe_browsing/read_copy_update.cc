@@ -0,0 +1,66 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/safe_browsing/read_copy_update.h"
+
+#include "base/logging.h"
+#include "base/threading/platform_thread.h"
+
+namespace safe_browsing {
+namespace internal {
+
+ReadCopyUpdateBase::ReadCopyUpdateBase()
+    : epoch_(0),
+      value_(0) {
+  readers_[0] = 0;
+  readers_[1] = 0;
+}
+
+ReadCopyUpdateBase::~ReadCopyUpdateBase() {
+  DCHECK_EQ(0, base::subtle::NoBarrier_Load(&readers_[0]));
+  DCHECK_EQ(0, base::subtle::NoBarrier_Load(&readers_[1]));
+}
+
+base::subtle::Atomic32 ReadCopyUpdateBase::BeginRead() const {
+  while (true) {
+    const base::subtle::Atomic32 epoch = base::subtle::Acquire_Load(&epoch_);
+    base::subtle::Barrier_AtomicIncrement(&readers_[epoch], 1);
+
+    // If the epoch flipped between the load and the increment, Publish() may
+    // already have stopped waiting for |epoch|, so count against the new one.
+    if (base::subtle::Acquire_Load(&epoch_) == epoch)
+      return epoch;
+    base::subtle::Barrier_AtomicIncrement(&readers_[epoch], -1);
+  }
+}
+
+void ReadCopyUpdateBase::EndRead(base::subtle::Atomic32 epoch) const {
+  base::subtle::Barrier_AtomicIncrement(&readers_[epoch], -1);
+}
+
+void* ReadCopyUpdateBase::LoadValue() const {
+  return reinterpret_cast<void*>(base::subtle::Acquire_Load(&value_));
+}
+
+void* ReadCopyUpdateBase::Publish(void* value) {
+  base::AutoLock locked(publish_lock_);
+
+  void* old_value = LoadValue();
+  base::subtle::Release_Store(
+      &value_, reinterpret_cast<base::subtle::AtomicWord>(value));
+
+  // Readers which enter after the flip see |value|.  Those counted against
+  // the previous epoch may still see |old_value|.
+  const base::subtle::Atomic32 old_epoch =
+      base::subtle::NoBarrier_Load(&epoch_);
+  base::subtle::Release_Store(&epoch_, 1 - old_epoch);
+  base::subtle::MemoryBarrier();
+  while (base::subtle::Acquire_Load(&readers_[old_epoch]) != 0)
+    base::PlatformThread::YieldCurrentThread();
+
+  return old_value;
+}
+
+}  // namespace internal
+}  // namespace safe_browsing
@@ -0,0 +1,131 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// A read-copy-update pointer to immutable data which is read on threads that
+// must not block, such as the IO thread, and occasionally replaced on another
+// thread.  Readers never take a lock: entering and leaving a read-side section
+// is an atomic increment and decrement of a counter.  An update publishes the
+// new data with a single pointer store, so readers see either the old or the
+// new data in its entirety, then waits for the readers which might still see
+// the old data to finish before deleting it.
+//
+// Readers are grouped by the epoch in which they started.  An update flips
+// the epoch after publishing, so only readers counted against the previous
+// epoch can hold the old data, and waits for that count to drain.  Readers
+// which start during the wait are counted against the new epoch and see the
+// new data, so a steady stream of readers cannot starve the update.
+//
+//   ReadCopyUpdatePtr<Foo> foo;
+//
+//   // On any thread:
+//   {
+//     ReadCopyUpdatePtr<Foo>::Reader reader(&foo);
+//     if (reader.get())
+//       reader->Lookup(key);
+//   }
+//
+//   // On the updating thread:
+//   scoped_ptr<Foo> new_foo(new Foo(...));
+//   foo.Update(new_foo.Pass());
+//
+// The data must not be modified once published.  Update() waits, so it must
+// not be called on a thread which must not block.  A thread must not call
+// Update() while it holds a Reader on the same pointer, as it would wait for
+// itself.
+
+#ifndef CHROME_BROWSER_SAFE_BROWSING_READ_COPY_UPDATE_H_
+#define CHROME_BROWSER_SAFE_BROWSING_READ_COPY_UPDATE_H_
+
+#include "base/atomicops.h"
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/synchronization/lock.h"
+
+namespace safe_browsing {
+
+namespace internal {
+
+// The type-independent part of ReadCopyUpdatePtr<>.
+class ReadCopyUpdateBase {
+ protected:
+  ReadCopyUpdateBase();
+  ~ReadCopyUpdateBase();
+
+  // Enters a read-side section, returning the epoch to pass to EndRead().
+  base::subtle::Atomic32 BeginRead() const;
+  void EndRead(base::subtle::Atomic32 epoch) const;
+
+  // Returns the published value.  Only stable between BeginRead() and
+  // EndRead(), or on a thread which is the only one to publish.
+  void* LoadValue() const;
+
+  // Publishes |value| and returns the previous value once no reader can
+  // still be using it.
+  void* Publish(void* value);
+
+ private:
+  // The number of readers in each epoch.
+  mutable base::subtle::Atomic32 readers_[2];
+
+  // The current epoch, 0 or 1.
+  base::subtle::Atomic32 epoch_;
+
+  base::subtle::AtomicWord value_;
+
+  // Serializes calls to Publish().
+  base::Lock publish_lock_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReadCopyUpdateBase);
+};
+
+}  // namespace internal
+
+template <typename T>
+class ReadCopyUpdatePtr : public internal::ReadCopyUpdateBase {
+ public:
+  // Holds the data published when it was created for as long as it lives.
+  // Readers should be short-lived, since an update waits for them.
+  class Reader {
+   public:
+    explicit Reader(const ReadCopyUpdatePtr<T>* ptr)
+        : ptr_(ptr),
+          epoch_(ptr->BeginRead()),
+          value_(static_cast<const T*>(ptr->LoadValue())) {}
+    ~Reader() { ptr_->EndRead(epoch_); }
+
+    // Returns the data, which may be NULL if none has been published.
+    const T* get() const { return value_; }
+    const T* operator->() const { return value_; }
+    const T& operator*() const { return *value_; }
+
+   private:
+    const ReadCopyUpdatePtr<T>* ptr_;
+    const base::subtle::Atomic32 epoch_;
+    const T* const value_;
+
+    DISALLOW_COPY_AND_ASSIGN(Reader);
+  };
+
+  ReadCopyUpdatePtr() {}
+  ~ReadCopyUpdatePtr() { delete static_cast<T*>(LoadValue()); }
+
+  // Returns the published data without entering a read-side section.  Only
+  // safe where no update can run concurrently, such as on the only thread
+  // which makes updates.
+  const T* get() const { return static_cast<const T*>(LoadValue()); }
+
+  // Publishes |value|, which may be NULL, then deletes the previous data once
+  // all readers which might see it are done.  Updates from several threads
+  // are serialized.
+  void Update(scoped_ptr<T> value) {
+    delete static_cast<T*>(Publish(value.release()));
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ReadCopyUpdatePtr);
+};
+
+}  // namespace safe_browsing
+
+#endif  // CHROME_BROWSER_SAFE_BROWSING_READ_COPY_UPDATE_H_
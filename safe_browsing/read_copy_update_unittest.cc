@@ -0,0 +1,153 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/safe_browsing/read_copy_update.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/memory/scoped_vector.h"
+#include "base/threading/simple_thread.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace safe_browsing {
+
+namespace {
+
+const int kValueSize = 64;
+
+// Data whose entries all equal its generation while it is alive, and are
+// overwritten when it is deleted, so readers can detect a torn or freed
+// snapshot.
+class Snapshot {
+ public:
+  Snapshot(int generation, int* deleted_count)
+      : values_(kValueSize, generation),
+        deleted_count_(deleted_count) {}
+  ~Snapshot() {
+    std::fill(values_.begin(), values_.end(), -1);
+    if (deleted_count_)
+      ++*deleted_count_;
+  }
+
+  // Returns the generation, or -1 if the entries are inconsistent.
+  int Check() const {
+    for (size_t i = 1; i < values_.size(); ++i) {
+      if (values_[i] != values_[0])
+        return -1;
+    }
+    return values_[0];
+  }
+
+ private:
+  std::vector<int> values_;
+  int* deleted_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(Snapshot);
+};
+
+// Reads |ptr| until |done| is set, recording whether any snapshot was
+// inconsistent or older than one already seen.
+class SnapshotReader : public base::DelegateSimpleThread::Delegate {
+ public:
+  SnapshotReader(const ReadCopyUpdatePtr<Snapshot>* ptr,
+                 const base::subtle::Atomic32* done)
+      : ptr_(ptr),
+        done_(done),
+        reads_(0),
+        errors_(0) {}
+
+  virtual void Run() OVERRIDE {
+    int last_generation = 0;
+    do {
+      ReadCopyUpdatePtr<Snapshot>::Reader reader(ptr_);
+      const int generation = reader.get() ? reader->Check() : 0;
+      if (generation < last_generation)
+        ++errors_;
+      last_generation = generation;
+      ++reads_;
+    } while (!base::subtle::Acquire_Load(done_));
+  }
+
+  int reads() const { return reads_; }
+  int errors() const { return errors_; }
+
+ private:
+  const ReadCopyUpdatePtr<Snapshot>* ptr_;
+  const base::subtle::Atomic32* done_;
+  int reads_;
+  int errors_;
+
+  DISALLOW_COPY_AND_ASSIGN(SnapshotReader);
+};
+
+}  // namespace
+
+TEST(ReadCopyUpdatePtrTest, Basic) {
+  int deleted_count = 0;
+  {
+    ReadCopyUpdatePtr<Snapshot> ptr;
+    {
+      ReadCopyUpdatePtr<Snapshot>::Reader reader(&ptr);
+      EXPECT_TRUE(reader.get() == NULL);
+    }
+    EXPECT_TRUE(ptr.get() == NULL);
+
+    ptr.Update(scoped_ptr<Snapshot>(new Snapshot(1, &deleted_count)));
+    {
+      ReadCopyUpdatePtr<Snapshot>::Reader reader(&ptr);
+      ASSERT_TRUE(reader.get() != NULL);
+      EXPECT_EQ(1, reader->Check());
+    }
+    EXPECT_EQ(0, deleted_count);
+
+    // Each update deletes the data it replaces.
+    ptr.Update(scoped_ptr<Snapshot>(new Snapshot(2, &deleted_count)));
+    EXPECT_EQ(1, deleted_count);
+    EXPECT_EQ(2, ptr.get()->Check());
+
+    ptr.Update(scoped_ptr<Snapshot>());
+    EXPECT_EQ(2, deleted_count);
+    EXPECT_TRUE(ptr.get() == NULL);
+
+    ptr.Update(scoped_ptr<Snapshot>(new Snapshot(3, &deleted_count)));
+  }
+  // The last data goes with the pointer.
+  EXPECT_EQ(3, deleted_count);
+}
+
+// Readers on several threads must only ever see whole, live snapshots, in
+// publication order, while updates replace them as fast as they can.
+TEST(ReadCopyUpdatePtrTest, ConcurrentReadersAndUpdates) {
+  const int kReaderCount = 4;
+  const int kUpdateCount = 200;
+
+  ReadCopyUpdatePtr<Snapshot> ptr;
+  base::subtle::Atomic32 done = 0;
+
+  ScopedVector<SnapshotReader> readers;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (int i = 0; i < kReaderCount; ++i) {
+    readers.push_back(new SnapshotReader(&ptr, &done));
+    threads.push_back(
+        new base::DelegateSimpleThread(readers.back(), "SnapshotReader"));
+    threads.back()->Start();
+  }
+
+  int deleted_count = 0;
+  for (int generation = 1; generation <= kUpdateCount; ++generation) {
+    ptr.Update(scoped_ptr<Snapshot>(new Snapshot(generation, &deleted_count)));
+    EXPECT_EQ(generation - 1, deleted_count);
+  }
+
+  base::subtle::Release_Store(&done, 1);
+  for (int i = 0; i < kReaderCount; ++i) {
+    threads[i]->Join();
+    EXPECT_GT(readers[i]->reads(), 0);
+    EXPECT_EQ(0, readers[i]->errors());
+  }
+}
+
+}  // namespace safe_browsing
@@ -514,6 +514,14 @@ SafeBrowsingDatabaseNew::~SafeBrowsingDatabaseNew() {
   // DCHECK_EQ(creation_loop_, base::MessageLoop::current());
 }
 
+SafeBrowsingDatabaseNew::BrowseFilter::BrowseFilter() {}
+
+SafeBrowsingDatabaseNew::BrowseFilter::~BrowseFilter() {}
+
+SafeBrowsingDatabaseNew::HashCache::HashCache() {}
+
+SafeBrowsingDatabaseNew::HashCache::~HashCache() {}
+
 void SafeBrowsingDatabaseNew::Init(const base::FilePath& filename_base) {
   DCHECK_EQ(creation_loop_, base::MessageLoop::current());
   // Ensure we haven't been run before.
@@ -534,16 +542,8 @@ void SafeBrowsingDatabaseNew::Init(const base::FilePath& filename_base) {
                  base::Unretained(this)));
   DVLOG(1) << "Init browse store: " << browse_filename_.value();
 
-  {
-    // NOTE: There is no need to grab the lock in this function, since
-    // until it returns, there are no pointers to this class on other
-    // threads.  Then again, that means there is no possibility of
-    // contention on the lock...
-    base::AutoLock locked(lookup_lock_);
-    full_browse_hashes_.clear();
-    pending_browse_hashes_.clear();
-    LoadPrefixSet();
-  }
+  ClearHashCache();
+  LoadPrefixSet();
 
   if (download_store_.get()) {
     download_filename_ = DownloadDBFilename(filename_base);
@@ -616,7 +616,7 @@ void SafeBrowsingDatabaseNew::Init(const base::FilePath& filename_base) {
     if (base::GetFileInfo(side_effect_free_whitelist_filename_, &db_info)
         && db_info.size != 0) {
       const base::TimeTicks before = base::TimeTicks::Now();
-      side_effect_free_whitelist_prefix_set_.reset(
+      scoped_ptr<safe_browsing::PrefixSet> prefix_set(
           safe_browsing::PrefixSet::LoadFile(
               side_effect_free_whitelist_prefix_set_filename_));
       DVLOG(1) << "SafeBrowsingDatabaseNew read side-effect free whitelist "
@@ -624,8 +624,9 @@ void SafeBrowsingDatabaseNew::Init(const base::FilePath& filename_base) {
                << (base::TimeTicks::Now() - before).InMilliseconds() << " ms";
       UMA_HISTOGRAM_TIMES("SB2.SideEffectFreeWhitelistPrefixSetLoad",
                           base::TimeTicks::Now() - before);
-      if (!side_effect_free_whitelist_prefix_set_.get())
+      if (!prefix_set.get())
         RecordFailure(FAILURE_SIDE_EFFECT_FREE_WHITELIST_PREFIX_SET_READ);
+      side_effect_free_whitelist_prefix_set_.Update(prefix_set.Pass());
     }
   } else {
     // Delete any files of the side-effect free sidelist that may be around
@@ -662,16 +663,11 @@ bool SafeBrowsingDatabaseNew::ResetDatabase() {
     return false;
 
   // Reset objects in memory.
-  {
-    base::AutoLock locked(lookup_lock_);
-    full_browse_hashes_.clear();
-    pending_browse_hashes_.clear();
-    prefix_miss_cache_.clear();
-    browse_prefix_set_.reset();
-    side_effect_free_whitelist_prefix_set_.reset();
-    ip_blacklist_.clear();
-  }
-  // Wants to acquire the lock itself.
+  ClearHashCache();
+  browse_filter_.Update(scoped_ptr<BrowseFilter>());
+  side_effect_free_whitelist_prefix_set_.Update(
+      scoped_ptr<safe_browsing::PrefixSet>());
+  ip_blacklist_.Update(scoped_ptr<IPBlacklist>());
   WhitelistEverything(&csd_whitelist_);
   WhitelistEverything(&download_whitelist_);
   return true;
@@ -694,22 +690,32 @@ bool SafeBrowsingDatabaseNew::ContainsBrowseUrl(
   if (full_hashes.empty())
     return false;
 
-  // This function is called on the I/O thread, prevent changes to
-  // filter and caches.
-  base::AutoLock locked(lookup_lock_);
+  // This function is called on the I/O thread.  Updates publish a new
+  // filter and cache rather than changing the ones read here, so there is
+  // nothing to lock.
+  safe_browsing::ReadCopyUpdatePtr<BrowseFilter>::Reader browse_filter(
+      &browse_filter_);
+  safe_browsing::ReadCopyUpdatePtr<HashCache>::Reader hash_cache(
+      &hash_cache_);
 
-  // |browse_prefix_set_| is empty until it is either read from disk, or the
+  // |browse_filter_| is empty until it is either read from disk, or the
   // first update populates it.  Bail out without a hit if not yet
   // available.
-  if (!browse_prefix_set_.get())
+  if (!browse_filter.get())
     return false;
 
+  // The prefixes for a URL are checked as one batch, which yields the hits
+  // in sorted order.
+  std::vector<SBPrefix> prefixes;
+  prefixes.reserve(full_hashes.size());
+  for (size_t i = 0; i < full_hashes.size(); ++i)
+    prefixes.push_back(full_hashes[i].prefix);
+  browse_filter->prefix_set->ExistsMany(prefixes, prefix_hits);
+
   size_t miss_count = 0;
-  for (size_t i = 0; i < full_hashes.size(); ++i) {
-    const SBPrefix prefix = full_hashes[i].prefix;
-    if (browse_prefix_set_->Exists(prefix)) {
-      prefix_hits->push_back(prefix);
-      if (prefix_miss_cache_.count(prefix) > 0)
+  if (hash_cache.get()) {
+    for (size_t i = 0; i < prefix_hits->size(); ++i) {
+      if (hash_cache->prefix_misses.count((*prefix_hits)[i]) > 0)
         ++miss_count;
     }
   }
@@ -718,15 +724,15 @@ bool SafeBrowsingDatabaseNew::ContainsBrowseUrl(
   if (miss_count == prefix_hits->size())
     return false;
 
-  // Find the matching full-hash results.  |full_browse_hashes_| are from the
-  // database, |pending_browse_hashes_| are from GetHash requests between
-  // updates.
-  std::sort(prefix_hits->begin(), prefix_hits->end());
-
-  GetCachedFullHashesForBrowse(*prefix_hits, full_browse_hashes_,
-                               full_hits, last_update);
-  GetCachedFullHashesForBrowse(*prefix_hits, pending_browse_hashes_,
+  // Find the matching full-hash results.  |browse_filter->full_hashes| are
+  // from the database, |hash_cache->pending_hashes| are from GetHash
+  // requests between updates.
+  GetCachedFullHashesForBrowse(*prefix_hits, browse_filter->full_hashes,
                                full_hits, last_update);
+  if (hash_cache.get()) {
+    GetCachedFullHashesForBrowse(*prefix_hits, hash_cache->pending_hashes,
+                                 full_hits, last_update);
+  }
   return true;
 }
 
@@ -802,16 +808,17 @@ bool SafeBrowsingDatabaseNew::ContainsSideEffectFreeWhitelistUrl(
     url_to_check +=  "?" + query;
   crypto::SHA256HashString(url_to_check, &full_hash, sizeof(full_hash));
 
-  // This function can be called on any thread, so lock against any changes
-  base::AutoLock locked(lookup_lock_);
+  // This function can be called on any thread.
+  safe_browsing::ReadCopyUpdatePtr<safe_browsing::PrefixSet>::Reader
+      prefix_set(&side_effect_free_whitelist_prefix_set_);
 
   // |side_effect_free_whitelist_prefix_set_| is empty until it is either read
   // from disk, or the first update populates it.  Bail out without a hit if
   // not yet available.
-  if (!side_effect_free_whitelist_prefix_set_.get())
+  if (!prefix_set.get())
     return false;
 
-  return side_effect_free_whitelist_prefix_set_->Exists(full_hash.prefix);
+  return prefix_set->Exists(full_hash.prefix);
 }
 
 bool SafeBrowsingDatabaseNew::ContainsMalwareIP(const std::string& ip_address) {
@@ -829,9 +836,12 @@ bool SafeBrowsingDatabaseNew::ContainsMalwareIP(const std::string& ip_address) {
     return false;  // better safe than sorry.
   }
   // This function can be called from any thread.
-  base::AutoLock locked(lookup_lock_);
-  for (IPBlacklist::const_iterator it = ip_blacklist_.begin();
-       it != ip_blacklist_.end();
+  safe_browsing::ReadCopyUpdatePtr<IPBlacklist>::Reader ip_blacklist(
+      &ip_blacklist_);
+  if (!ip_blacklist.get())
+    return false;
+  for (IPBlacklist::const_iterator it = ip_blacklist->begin();
+       it != ip_blacklist->end();
        ++it) {
     const std::string& mask = it->first;
     DCHECK_EQ(mask.size(), ip_number.size());
@@ -862,14 +872,16 @@ bool SafeBrowsingDatabaseNew::ContainsDownloadWhitelistedString(
 }
 
 bool SafeBrowsingDatabaseNew::ContainsWhitelistedHashes(
-    const SBWhitelist& whitelist,
+    const SBWhitelistPtr& whitelist,
     const std::vector<SBFullHash>& hashes) {
-  base::AutoLock l(lookup_lock_);
-  if (whitelist.second)
+  SBWhitelistPtr::Reader reader(&whitelist);
+  if (!reader.get())
+    return false;
+  if (reader->second)
     return true;
   for (std::vector<SBFullHash>::const_iterator it = hashes.begin();
        it != hashes.end(); ++it) {
-    if (std::binary_search(whitelist.first.begin(), whitelist.first.end(), *it))
+    if (std::binary_search(reader->first.begin(), reader->first.end(), *it))
       return true;
   }
   return false;
@@ -1080,18 +1092,24 @@ void SafeBrowsingDatabaseNew::DeleteChunks(
 void SafeBrowsingDatabaseNew::CacheHashResults(
     const std::vector<SBPrefix>& prefixes,
     const std::vector<SBFullHashResult>& full_hits) {
-  // This is called on the I/O thread, lock against updates.
-  base::AutoLock locked(lookup_lock_);
+  // Lookups on the I/O thread keep using the current cache until the updated
+  // copy is published.
+  DCHECK_EQ(creation_loop_, base::MessageLoop::current());
+  scoped_ptr<HashCache> hash_cache(new HashCache);
+  if (hash_cache_.get())
+    *hash_cache = *hash_cache_.get();
 
   if (full_hits.empty()) {
-    prefix_miss_cache_.insert(prefixes.begin(), prefixes.end());
+    hash_cache->prefix_misses.insert(prefixes.begin(), prefixes.end());
+    hash_cache_.Update(hash_cache.Pass());
     return;
   }
 
   // TODO(shess): SBFullHashResult and SBAddFullHash are very similar.
   // Refactor to make them identical.
   const base::Time now = base::Time::Now();
-  const size_t orig_size = pending_browse_hashes_.size();
+  std::vector<SBAddFullHash>& pending_hashes = hash_cache->pending_hashes;
+  const size_t orig_size = pending_hashes.size();
   for (std::vector<SBFullHashResult>::const_iterator iter = full_hits.begin();
        iter != full_hits.end(); ++iter) {
     const int list_id = safe_browsing_util::GetListId(iter->list_name);
@@ -1099,17 +1117,23 @@ void SafeBrowsingDatabaseNew::CacheHashResults(
         list_id == safe_browsing_util::PHISH) {
       int encoded_chunk_id = EncodeChunkId(iter->add_chunk_id, list_id);
       SBAddFullHash add_full_hash(encoded_chunk_id, now, iter->hash);
-      pending_browse_hashes_.push_back(add_full_hash);
+      pending_hashes.push_back(add_full_hash);
     }
   }
 
   // Sort new entries then merge with the previously-sorted entries.
   std::vector<SBAddFullHash>::iterator
-      orig_end = pending_browse_hashes_.begin() + orig_size;
-  std::sort(orig_end, pending_browse_hashes_.end(), SBAddFullHashPrefixLess);
-  std::inplace_merge(pending_browse_hashes_.begin(),
-                     orig_end, pending_browse_hashes_.end(),
+      orig_end = pending_hashes.begin() + orig_size;
+  std::sort(orig_end, pending_hashes.end(), SBAddFullHashPrefixLess);
+  std::inplace_merge(pending_hashes.begin(),
+                     orig_end, pending_hashes.end(),
                      SBAddFullHashPrefixLess);
+  hash_cache_.Update(hash_cache.Pass());
+}
+
+void SafeBrowsingDatabaseNew::ClearHashCache() {
+  DCHECK_EQ(creation_loop_, base::MessageLoop::current());
+  hash_cache_.Update(scoped_ptr<HashCache>());
 }
 
 bool SafeBrowsingDatabaseNew::UpdateStarted(
@@ -1340,7 +1364,7 @@ void SafeBrowsingDatabaseNew::UpdateFinished(bool update_succeeded) {
 void SafeBrowsingDatabaseNew::UpdateWhitelistStore(
     const base::FilePath& store_filename,
     SafeBrowsingStore* store,
-    SBWhitelist* whitelist) {
+    SBWhitelistPtr* whitelist) {
   if (!store)
     return;
 
@@ -1395,10 +1419,10 @@ void SafeBrowsingDatabaseNew::UpdateBrowseStore() {
   // case |ContainsBrowseURL()| is called before the new filter is complete.
   std::vector<SBAddFullHash> pending_add_hashes;
   {
-    base::AutoLock locked(lookup_lock_);
-    pending_add_hashes.insert(pending_add_hashes.end(),
-                              pending_browse_hashes_.begin(),
-                              pending_browse_hashes_.end());
+    safe_browsing::ReadCopyUpdatePtr<HashCache>::Reader hash_cache(
+        &hash_cache_);
+    if (hash_cache.get())
+      pending_add_hashes = hash_cache->pending_hashes;
   }
 
   // Measure the amount of IO during the filter build.
@@ -1440,27 +1464,24 @@ void SafeBrowsingDatabaseNew::UpdateBrowseStore() {
   }
 
   std::sort(prefixes.begin(), prefixes.end());
-  scoped_ptr<safe_browsing::PrefixSet>
-      prefix_set(new safe_browsing::PrefixSet(prefixes));
+  scoped_ptr<BrowseFilter> browse_filter(new BrowseFilter);
+  browse_filter->prefix_set.reset(new safe_browsing::PrefixSet(prefixes));
 
   // This needs to be in sorted order by prefix for efficient access.
   std::sort(add_full_hashes.begin(), add_full_hashes.end(),
             SBAddFullHashPrefixLess);
+  browse_filter->full_hashes.swap(add_full_hashes);
 
-  // Swap in the newly built filter and cache.
-  {
-    base::AutoLock locked(lookup_lock_);
-    full_browse_hashes_.swap(add_full_hashes);
+  // Publish the newly built filter and clear the cache.  Lookups which are
+  // already running finish against the previous filter.
+  browse_filter_.Update(browse_filter.Pass());
 
-    // TODO(shess): If |CacheHashResults()| is posted between the
-    // earlier lock and this clear, those pending hashes will be lost.
-    // It could be fixed by only removing hashes which were collected
-    // at the earlier point.  I believe that is fail-safe as-is (the
-    // hash will be fetched again).
-    pending_browse_hashes_.clear();
-    prefix_miss_cache_.clear();
-    browse_prefix_set_.swap(prefix_set);
-  }
+  // TODO(shess): If |CacheHashResults()| is posted between the
+  // earlier copy and this clear, those pending hashes will be lost.
+  // It could be fixed by only removing hashes which were collected
+  // at the earlier point.  I believe that is fail-safe as-is (the
+  // hash will be fetched again).
+  ClearHashCache();
 
   DVLOG(1) << "SafeBrowsingDatabaseImpl built prefix set in "
            << (base::TimeTicks::Now() - before).InMilliseconds()
@@ -1468,7 +1489,7 @@ void SafeBrowsingDatabaseNew::UpdateBrowseStore() {
   UMA_HISTOGRAM_LONG_TIMES("SB2.BuildFilter", base::TimeTicks::Now() - before);
 
   // Persist the prefix set to disk.  Since only this thread changes
-  // |browse_prefix_set_|, there is no need to lock.
+  // |browse_filter_|, there is no need for a reader.
   WritePrefixSet();
 
   // Gather statistics.
@@ -1527,14 +1548,13 @@ void SafeBrowsingDatabaseNew::UpdateSideEffectFreeWhitelistStore() {
   scoped_ptr<safe_browsing::PrefixSet>
       prefix_set(new safe_browsing::PrefixSet(prefixes));
 
-  // Swap in the newly built prefix set.
-  {
-    base::AutoLock locked(lookup_lock_);
-    side_effect_free_whitelist_prefix_set_.swap(prefix_set);
-  }
+  // Publish the newly built prefix set.
+  side_effect_free_whitelist_prefix_set_.Update(prefix_set.Pass());
 
+  // Since only this thread changes |side_effect_free_whitelist_prefix_set_|,
+  // there is no need for a reader.
   const base::TimeTicks before = base::TimeTicks::Now();
-  const bool write_ok = side_effect_free_whitelist_prefix_set_->WriteFile(
+  const bool write_ok = side_effect_free_whitelist_prefix_set_.get()->WriteFile(
       side_effect_free_whitelist_prefix_set_filename_);
   DVLOG(1) << "SafeBrowsingDatabaseNew wrote side-effect free whitelist prefix "
            << "set in " << (base::TimeTicks::Now() - before).InMilliseconds()
@@ -1620,14 +1640,18 @@ void SafeBrowsingDatabaseNew::LoadPrefixSet() {
   base::DeleteFile(bloom_filter_filename, false);
 
   const base::TimeTicks before = base::TimeTicks::Now();
-  browse_prefix_set_.reset(safe_browsing::PrefixSet::LoadFile(
+  scoped_ptr<BrowseFilter> browse_filter(new BrowseFilter);
+  browse_filter->prefix_set.reset(safe_browsing::PrefixSet::LoadFile(
       browse_prefix_set_filename_));
   DVLOG(1) << "SafeBrowsingDatabaseNew read prefix set in "
            << (base::TimeTicks::Now() - before).InMilliseconds() << " ms";
   UMA_HISTOGRAM_TIMES("SB2.PrefixSetLoad", base::TimeTicks::Now() - before);
 
-  if (!browse_prefix_set_.get())
+  if (!browse_filter->prefix_set.get()) {
     RecordFailure(FAILURE_BROWSE_PREFIX_SET_READ);
+    return;
+  }
+  browse_filter_.Update(browse_filter.Pass());
 }
 
 bool SafeBrowsingDatabaseNew::Delete() {
@@ -1686,11 +1710,12 @@ bool SafeBrowsingDatabaseNew::Delete() {
 void SafeBrowsingDatabaseNew::WritePrefixSet() {
   DCHECK_EQ(creation_loop_, base::MessageLoop::current());
 
-  if (!browse_prefix_set_.get())
+  const BrowseFilter* browse_filter = browse_filter_.get();
+  if (!browse_filter)
     return;
 
   const base::TimeTicks before = base::TimeTicks::Now();
-  const bool write_ok = browse_prefix_set_->WriteFile(
+  const bool write_ok = browse_filter->prefix_set->WriteFile(
       browse_prefix_set_filename_);
   DVLOG(1) << "SafeBrowsingDatabaseNew wrote prefix set in "
            << (base::TimeTicks::Now() - before).InMilliseconds() << " ms";
@@ -1704,15 +1729,15 @@ void SafeBrowsingDatabaseNew::WritePrefixSet() {
 #endif
 }
 
-void SafeBrowsingDatabaseNew::WhitelistEverything(SBWhitelist* whitelist) {
-  base::AutoLock locked(lookup_lock_);
-  whitelist->second = true;
-  whitelist->first.clear();
+void SafeBrowsingDatabaseNew::WhitelistEverything(SBWhitelistPtr* whitelist) {
+  scoped_ptr<SBWhitelist> new_whitelist(new SBWhitelist);
+  new_whitelist->second = true;
+  whitelist->Update(new_whitelist.Pass());
 }
 
 void SafeBrowsingDatabaseNew::LoadWhitelist(
     const std::vector<SBAddFullHash>& full_hashes,
-    SBWhitelist* whitelist) {
+    SBWhitelistPtr* whitelist) {
   DCHECK_EQ(creation_loop_, base::MessageLoop::current());
   if (full_hashes.size() > kMaxWhitelistSize) {
     WhitelistEverything(whitelist);
@@ -1735,16 +1760,17 @@ void SafeBrowsingDatabaseNew::LoadWhitelist(
     // The kill switch is whitelisted hence we whitelist all URLs.
     WhitelistEverything(whitelist);
   } else {
-    base::AutoLock locked(lookup_lock_);
-    whitelist->second = false;
-    whitelist->first.swap(new_whitelist);
+    scoped_ptr<SBWhitelist> loaded_whitelist(new SBWhitelist);
+    loaded_whitelist->second = false;
+    loaded_whitelist->first.swap(new_whitelist);
+    whitelist->Update(loaded_whitelist.Pass());
   }
 }
 
 void SafeBrowsingDatabaseNew::LoadIpBlacklist(
     const std::vector<SBAddFullHash>& full_hashes) {
   DCHECK_EQ(creation_loop_, base::MessageLoop::current());
-  IPBlacklist new_blacklist;
+  scoped_ptr<IPBlacklist> new_blacklist(new IPBlacklist);
   DVLOG(2) << "Writing IP blacklist of size: " << full_hashes.size();
   for (std::vector<SBAddFullHash>::const_iterator it = full_hashes.begin();
        it != full_hashes.end();
@@ -1758,7 +1784,7 @@ void SafeBrowsingDatabaseNew::LoadIpBlacklist(
     if (prefix_size > kMaxIpPrefixSize || prefix_size < kMinIpPrefixSize) {
       DVLOG(2) << "Invalid IP prefix size in IP blacklist: " << prefix_size;
       RecordFailure(FAILURE_IP_BLACKLIST_UPDATE_INVALID);
-      new_blacklist.clear();  // Load empty blacklist.
+      new_blacklist->clear();  // Load empty blacklist.
       break;
     }
 
@@ -1776,11 +1802,10 @@ void SafeBrowsingDatabaseNew::LoadIpBlacklist(
              << " prefix_size:" << prefix_size
              << " hashed_ip:" << base::HexEncode(hashed_ip_prefix.data(),
                                                  hashed_ip_prefix.size());
-    new_blacklist[mask].insert(hashed_ip_prefix);
+    (*new_blacklist)[mask].insert(hashed_ip_prefix);
   }
 
-  base::AutoLock locked(lookup_lock_);
-  ip_blacklist_.swap(new_blacklist);
+  ip_blacklist_.Update(new_blacklist.Pass());
 }
 
 bool SafeBrowsingDatabaseNew::IsMalwareIPMatchKillSwitchOn() {
@@ -15,7 +15,7 @@
 #include "base/gtest_prod_util.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/memory/weak_ptr.h"
-#include "base/synchronization/lock.h"
+#include "chrome/browser/safe_browsing/read_copy_update.h"
 #include "chrome/browser/safe_browsing/safe_browsing_store.h"
 
 namespace base {
@@ -175,7 +175,8 @@ class SafeBrowsingDatabase {
 
   // Store the results of a GetHash response. In the case of empty results, we
   // cache the prefixes until the next update so that we don't have to issue
-  // further GetHash requests we know will be empty.
+  // further GetHash requests we know will be empty.  Called on the database
+  // thread, like updates.
   virtual void CacheHashResults(
       const std::vector<SBPrefix>& prefixes,
       const std::vector<SBFullHashResult>& full_hits) = 0;
@@ -332,17 +333,45 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   // in a sorted vector) as well as a boolean flag indicating whether all
   // lookups in the whitelist should be considered matches for safety.
   typedef std::pair<std::vector<SBFullHash>, bool> SBWhitelist;
+  typedef safe_browsing::ReadCopyUpdatePtr<SBWhitelist> SBWhitelistPtr;
 
   // This map holds a csd malware IP blacklist which maps a prefix mask
   // to a set of hashed blacklisted IP prefixes.  Each IP prefix is a hashed
   // IPv6 IP prefix using SHA-1.
   typedef std::map<std::string, base::hash_set<std::string> > IPBlacklist;
 
+  // The browse filter built by an update: the prefix set, which is never
+  // NULL, and the full-hash items from |browse_store_| ordered by prefix for
+  // efficient scanning.
+  struct BrowseFilter {
+    BrowseFilter();
+    ~BrowseFilter();
+
+    scoped_ptr<safe_browsing::PrefixSet> prefix_set;
+    std::vector<SBAddFullHash> full_hashes;
+  };
+
+  // Results of GetHash requests made since the last update, recorded by
+  // |CacheHashResults()|.  |pending_hashes| are full-hash items, ordered by
+  // prefix, which will be pushed to the store on the next update.
+  // |prefix_misses| are prefixes that returned empty results (no full hash
+  // match), cached to prevent asking for them every time.
+  struct HashCache {
+    HashCache();
+    ~HashCache();
+
+    std::vector<SBAddFullHash> pending_hashes;
+    std::set<SBPrefix> prefix_misses;
+  };
+
   // Returns true if the whitelist is disabled or if any of the given hashes
   // matches the whitelist.
-  bool ContainsWhitelistedHashes(const SBWhitelist& whitelist,
+  bool ContainsWhitelistedHashes(const SBWhitelistPtr& whitelist,
                                  const std::vector<SBFullHash>& hashes);
 
+  // Drops the results of GetHash requests cached by |CacheHashResults()|.
+  void ClearHashCache();
+
   // Return the browse_store_, download_store_, download_whitelist_store or
   // csd_whitelist_store_ based on list_id.
   SafeBrowsingStore* GetStore(int list_id);
@@ -360,11 +389,11 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   // of hashes is too large or if the kill switch URL is on the whitelist
   // we will whitelist everything.
   void LoadWhitelist(const std::vector<SBAddFullHash>& full_hashes,
-                     SBWhitelist* whitelist);
+                     SBWhitelistPtr* whitelist);
 
   // Call this method if an error occured with the given whitelist.  This will
   // result in all lookups to the whitelist to return true.
-  void WhitelistEverything(SBWhitelist* whitelist);
+  void WhitelistEverything(SBWhitelistPtr* whitelist);
 
   // Parses the IP blacklist from the given full-length hashes.
   void LoadIpBlacklist(const std::vector<SBAddFullHash>& full_hashes);
@@ -395,17 +424,19 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   void UpdateSideEffectFreeWhitelistStore();
   void UpdateWhitelistStore(const base::FilePath& store_filename,
                             SafeBrowsingStore* store,
-                            SBWhitelist* whitelist);
+                            SBWhitelistPtr* whitelist);
   void UpdateIpBlacklistStore();
 
   // Used to verify that various calls are made from the thread the
   // object was created on.
   base::MessageLoop* creation_loop_;
 
-  // Lock for protecting access to variables that may be used on the
-  // IO thread.  This includes |prefix_set_|, |full_browse_hashes_|,
-  // |pending_browse_hashes_|, |prefix_miss_cache_|, |csd_whitelist_|.
-  base::Lock lookup_lock_;
+  // The data used by lookups on the IO thread, |browse_filter_|,
+  // |hash_cache_|, the whitelists, the IP blacklist and
+  // |side_effect_free_whitelist_prefix_set_|, is immutable once published
+  // and is replaced wholesale, so lookups never block on an update.  It is
+  // only replaced on this object's thread, which waits for the lookups still
+  // using the previous data.
 
   // Underlying persistent store for chunk data.
   // For browsing related (phishing and malware URLs) chunks and prefixes.
@@ -438,25 +469,19 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   base::FilePath ip_blacklist_filename_;
   scoped_ptr<SafeBrowsingStore> ip_blacklist_store_;
 
-  SBWhitelist csd_whitelist_;
-  SBWhitelist download_whitelist_;
+  SBWhitelistPtr csd_whitelist_;
+  SBWhitelistPtr download_whitelist_;
   SBWhitelist extension_blacklist_;
 
   // The IP blacklist should be small.  At most a couple hundred IPs.
-  IPBlacklist ip_blacklist_;
+  safe_browsing::ReadCopyUpdatePtr<IPBlacklist> ip_blacklist_;
 
-  // Cached browse store related full-hash items, ordered by prefix for
-  // efficient scanning.
-  // |full_browse_hashes_| are items from |browse_store_|,
-  // |pending_browse_hashes_| are items from |CacheHashResults()|, which
-  // will be pushed to the store on the next update.
-  std::vector<SBAddFullHash> full_browse_hashes_;
-  std::vector<SBAddFullHash> pending_browse_hashes_;
+  // Empty until it is either read from disk, or the first update populates
+  // it.
+  safe_browsing::ReadCopyUpdatePtr<BrowseFilter> browse_filter_;
 
-  // Cache of prefixes that returned empty results (no full hash
-  // match) to |CacheHashResults()|.  Cached to prevent asking for
-  // them every time.  Cleared on next update.
-  std::set<SBPrefix> prefix_miss_cache_;
+  // Cleared on the next update.
+  safe_browsing::ReadCopyUpdatePtr<HashCache> hash_cache_;
 
   // Used to schedule resetting the database because of corruption.
   base::WeakPtrFactory<SafeBrowsingDatabaseNew> reset_factory_;
@@ -472,11 +497,11 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
 
   // Used to check if a prefix was in the browse database.
   base::FilePath browse_prefix_set_filename_;
-  scoped_ptr<safe_browsing::PrefixSet> browse_prefix_set_;
 
   // Used to check if a prefix was in the browse database.
   base::FilePath side_effect_free_whitelist_prefix_set_filename_;
-  scoped_ptr<safe_browsing::PrefixSet> side_effect_free_whitelist_prefix_set_;
+  safe_browsing::ReadCopyUpdatePtr<safe_browsing::PrefixSet>
+      side_effect_free_whitelist_prefix_set_;
 };
 
 #endif  // CHROME_BROWSER_SAFE_BROWSING_SAFE_BROWSING_DATABASE_H_
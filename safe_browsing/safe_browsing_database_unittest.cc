@@ -4,11 +4,15 @@
 //
 // Unit tests for the SafeBrowsing storage system.
 
+#include "base/atomicops.h"
 #include "base/file_util.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/logging.h"
+#include "base/memory/scoped_vector.h"
 #include "base/message_loop/message_loop.h"
 #include "base/sha1.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/simple_thread.h"
 #include "base/time/time.h"
 #include "chrome/browser/safe_browsing/safe_browsing_database.h"
 #include "chrome/browser/safe_browsing/safe_browsing_store_file.h"
@@ -246,6 +250,49 @@ class ScopedLogMessageIgnorer {
   }
 };
 
+// Repeatedly looks up URLs and an IP which every update keeps listed, until
+// |done| is set, counting the lookups which miss.
+class LookupThreadDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  LookupThreadDelegate(SafeBrowsingDatabase* database,
+                       const base::subtle::Atomic32* done)
+      : database_(database),
+        done_(done),
+        lookups_(0),
+        misses_(0) {}
+
+  virtual void Run() OVERRIDE {
+    const GURL kBrowseUrl("http://www.evil.com/malware.html");
+    const GURL kWhitelistUrl("http://www.good.com/a.html");
+    std::string matching_list;
+    std::vector<SBPrefix> prefix_hits;
+    std::vector<SBFullHashResult> full_hits;
+    do {
+      if (!database_->ContainsBrowseUrl(kBrowseUrl, &matching_list,
+                                        &prefix_hits, &full_hits,
+                                        base::Time::Now())) {
+        ++misses_;
+      }
+      if (!database_->ContainsDownloadWhitelistedUrl(kWhitelistUrl))
+        ++misses_;
+      if (!database_->ContainsMalwareIP("192.168.1.10"))
+        ++misses_;
+      lookups_ += 3;
+    } while (!base::subtle::Acquire_Load(done_));
+  }
+
+  int lookups() const { return lookups_; }
+  int misses() const { return misses_; }
+
+ private:
+  SafeBrowsingDatabase* database_;
+  const base::subtle::Atomic32* done_;
+  int lookups_;
+  int misses_;
+
+  DISALLOW_COPY_AND_ASSIGN(LookupThreadDelegate);
+};
+
 }  // namespace
 
 class SafeBrowsingDatabaseTest : public PlatformTest {
@@ -897,7 +944,8 @@ TEST_F(SafeBrowsingDatabaseTest, HashCaching) {
   PopulateDatabaseForCacheTest();
 
   // We should have both full hashes in the cache.
-  EXPECT_EQ(database_->pending_browse_hashes_.size(), 2U);
+  ASSERT_TRUE(database_->hash_cache_.get() != NULL);
+  EXPECT_EQ(database_->hash_cache_.get()->pending_hashes.size(), 2U);
 
   // Test the cache lookup for the first prefix.
   std::string listname;
@@ -963,18 +1011,23 @@ TEST_F(SafeBrowsingDatabaseTest, HashCaching) {
       GURL("http://www.evil.com/malware.html"),
       &listname, &prefixes, &full_hashes, Time::Now());
   EXPECT_TRUE(full_hashes.empty());
-  EXPECT_TRUE(database_->full_browse_hashes_.empty());
-  EXPECT_TRUE(database_->pending_browse_hashes_.empty());
+  ASSERT_TRUE(database_->browse_filter_.get() != NULL);
+  EXPECT_TRUE(database_->browse_filter_.get()->full_hashes.empty());
+  EXPECT_TRUE(database_->hash_cache_.get() == NULL);
 
   prefixes.clear();
   full_hashes.clear();
 
   // Test that the cache won't return expired values. First we have to adjust
   // the cached entries' received time to make them older, since the database
-  // cache insert uses Time::Now(). First, store some entries.
+  // cache insert uses Time::Now(). First, store some entries.  The published
+  // cache is immutable, so adjust a copy and publish that.
   PopulateDatabaseForCacheTest();
 
-  std::vector<SBAddFullHash>* hash_cache = &database_->pending_browse_hashes_;
+  ASSERT_TRUE(database_->hash_cache_.get() != NULL);
+  scoped_ptr<SafeBrowsingDatabaseNew::HashCache> cache(
+      new SafeBrowsingDatabaseNew::HashCache(*database_->hash_cache_.get()));
+  std::vector<SBAddFullHash>* hash_cache = &cache->pending_hashes;
   EXPECT_EQ(hash_cache->size(), 2U);
 
   // Now adjust one of the entries times to be in the past.
@@ -988,6 +1041,7 @@ TEST_F(SafeBrowsingDatabaseTest, HashCaching) {
     }
   }
   EXPECT_TRUE(iter != hash_cache->end());
+  database_->hash_cache_.Update(cache.Pass());
 
   database_->ContainsBrowseUrl(
       GURL("http://www.evil.com/malware.html"),
@@ -1015,13 +1069,15 @@ TEST_F(SafeBrowsingDatabaseTest, HashCaching) {
   database_->CacheHashResults(prefix_misses, empty_full_hash);
 
   // Prefixes with no full results are misses.
-  EXPECT_EQ(database_->prefix_miss_cache_.size(), 2U);
+  ASSERT_TRUE(database_->hash_cache_.get() != NULL);
+  EXPECT_EQ(database_->hash_cache_.get()->prefix_misses.size(), 2U);
 
   // Update the database.
   PopulateDatabaseForCacheTest();
 
   // Prefix miss cache should be cleared.
-  EXPECT_TRUE(database_->prefix_miss_cache_.empty());
+  ASSERT_TRUE(database_->hash_cache_.get() != NULL);
+  EXPECT_TRUE(database_->hash_cache_.get()->prefix_misses.empty());
 
   // Cache a GetHash miss for a particular prefix, and even though the prefix is
   // in the database, it is flagged as a miss so looking up the associated URL
@@ -1832,3 +1888,96 @@ TEST_F(SafeBrowsingDatabaseTest, MalwareIpBlacklist) {
   EXPECT_TRUE(database_->ContainsMalwareIP("192.1.255.255"));
   EXPECT_FALSE(database_->ContainsMalwareIP("192.2.0.0"));
 }
+
+// Lookups on other threads must keep seeing the entries every update keeps,
+// without blocking, while updates replace the filters underneath them.
+TEST_F(SafeBrowsingDatabaseTest, LookupsDuringUpdates) {
+  const int kLookupThreadCount = 4;
+  const int kUpdateCount = 20;
+
+  database_.reset();
+  database_.reset(new SafeBrowsingDatabaseNew(new SafeBrowsingStoreFile(),
+                                              NULL,
+                                              NULL,
+                                              new SafeBrowsingStoreFile(),
+                                              NULL,
+                                              NULL,
+                                              new SafeBrowsingStoreFile()));
+  database_->Init(database_filename_);
+
+  // Populate every list with the entries the lookups expect.
+  SBChunkList chunks;
+  SBChunk chunk;
+  std::vector<SBListChunkRanges> lists;
+  EXPECT_TRUE(database_->UpdateStarted(&lists));
+  InsertAddChunkHostPrefixUrl(&chunk, 1, "www.evil.com/",
+                              "www.evil.com/malware.html");
+  chunks.push_back(chunk);
+  database_->InsertChunks(safe_browsing_util::kMalwareList, chunks);
+  chunks.clear();
+  chunk.hosts.clear();
+  InsertAddChunkHostFullHashes(&chunk, 1, "www.good.com/",
+                               "www.good.com/a.html");
+  chunks.push_back(chunk);
+  database_->InsertChunks(safe_browsing_util::kDownloadWhiteList, chunks);
+  chunks.clear();
+  chunk.hosts.clear();
+  InsertAddChunkFullHash(&chunk, 1, "::ffff:192.168.1.0", 120);
+  chunks.push_back(chunk);
+  database_->InsertChunks(safe_browsing_util::kIPBlacklist, chunks);
+  database_->UpdateFinished(true);
+
+  base::subtle::Atomic32 done = 0;
+  ScopedVector<LookupThreadDelegate> delegates;
+  ScopedVector<base::DelegateSimpleThread> threads;
+  for (int i = 0; i < kLookupThreadCount; ++i) {
+    delegates.push_back(new LookupThreadDelegate(database_.get(), &done));
+    threads.push_back(new base::DelegateSimpleThread(delegates.back(),
+                                                     "SafeBrowsingLookup"));
+    threads.back()->Start();
+  }
+
+  // Each update adds a chunk to every list, and caches GetHash results, so
+  // every filter and the cache is rebuilt and republished.
+  for (int i = 0; i < kUpdateCount; ++i) {
+    const int chunk_number = 2 + i;
+    const std::string host = base::StringPrintf("www.evil%d.com/",
+                                                chunk_number);
+    EXPECT_TRUE(database_->UpdateStarted(&lists));
+    chunks.clear();
+    chunk.hosts.clear();
+    InsertAddChunkHostPrefixUrl(&chunk, chunk_number, host,
+                                host + "malware.html");
+    chunks.push_back(chunk);
+    database_->InsertChunks(safe_browsing_util::kMalwareList, chunks);
+    chunks.clear();
+    chunk.hosts.clear();
+    InsertAddChunkHostFullHashes(&chunk, chunk_number, host,
+                                 host + "good.html");
+    chunks.push_back(chunk);
+    database_->InsertChunks(safe_browsing_util::kDownloadWhiteList, chunks);
+    chunks.clear();
+    chunk.hosts.clear();
+    InsertAddChunkFullHash(&chunk, chunk_number,
+                           base::StringPrintf("::ffff:10.0.%d.0",
+                                              chunk_number),
+                           120);
+    chunks.push_back(chunk);
+    database_->InsertChunks(safe_browsing_util::kIPBlacklist, chunks);
+    database_->UpdateFinished(true);
+
+    SBFullHashResult full_hash;
+    full_hash.hash = Sha256Hash(host + "malware.html");
+    full_hash.list_name = safe_browsing_util::kMalwareList;
+    full_hash.add_chunk_id = chunk_number;
+    database_->CacheHashResults(std::vector<SBPrefix>(),
+                                std::vector<SBFullHashResult>(1, full_hash));
+  }
+
+  base::subtle::Release_Store(&done, 1);
+  for (int i = 0; i < kLookupThreadCount; ++i) {
+    threads[i]->Join();
+    EXPECT_GT(delegates[i]->lookups(), 0);
+    EXPECT_EQ(0, delegates[i]->misses());
+  }
+}
@@ -138,10 +138,6 @@ void SBProcessSubs(SBAddPrefixes* add_prefixes,
             SBAddPrefixLess<SBAddPrefix,SBAddPrefix>);
   std::sort(sub_prefixes->begin(), sub_prefixes->end(),
             SBAddPrefixLess<SBSubPrefix,SBSubPrefix>);
-  std::sort(add_full_hashes->begin(), add_full_hashes->end(),
-            SBAddPrefixHashLess<SBAddFullHash,SBAddFullHash>);
-  std::sort(sub_full_hashes->begin(), sub_full_hashes->end(),
-            SBAddPrefixHashLess<SBSubFullHash,SBSubFullHash>);
 
   // Factor out the prefix subs.
   SBAddPrefixes removed_adds;
@@ -150,10 +146,30 @@ void SBProcessSubs(SBAddPrefixes* add_prefixes,
                SBAddPrefixLess<SBSubPrefix,SBAddPrefix>,
                &removed_adds);
 
-  // Remove the full-hashes corrosponding to the adds which
-  // KnockoutSubs() removed.  Processing these w/in KnockoutSubs()
-  // would make the code more complicated, and they are very small
-  // relative to the prefix lists so the gain would be modest.
+  // Remove items from the deleted chunks.  This is done after other
+  // processing to allow subs to knock out adds (and be removed) even
+  // if the add's chunk is deleted.
+  RemoveDeleted(add_prefixes, add_chunks_deleted);
+  RemoveDeleted(sub_prefixes, sub_chunks_deleted);
+
+  SBProcessFullHashSubs(removed_adds, add_full_hashes, sub_full_hashes,
+                        add_chunks_deleted, sub_chunks_deleted);
+}
+
+void SBProcessFullHashSubs(const SBAddPrefixes& removed_adds,
+                           std::vector<SBAddFullHash>* add_full_hashes,
+                           std::vector<SBSubFullHash>* sub_full_hashes,
+                           const base::hash_set<int32>& add_chunks_deleted,
+                           const base::hash_set<int32>& sub_chunks_deleted) {
+  std::sort(add_full_hashes->begin(), add_full_hashes->end(),
+            SBAddPrefixHashLess<SBAddFullHash,SBAddFullHash>);
+  std::sort(sub_full_hashes->begin(), sub_full_hashes->end(),
+            SBAddPrefixHashLess<SBSubFullHash,SBSubFullHash>);
+
+  // Remove the full-hashes corrosponding to the adds which the prefix
+  // subs knocked out.  Processing these along with the prefixes would
+  // make the code more complicated, and they are very small relative
+  // to the prefix lists so the gain would be modest.
   RemoveMatchingPrefixes(removed_adds, add_full_hashes);
   RemoveMatchingPrefixes(removed_adds, sub_full_hashes);
 
@@ -164,11 +180,7 @@ void SBProcessSubs(SBAddPrefixes* add_prefixes,
                SBAddPrefixHashLess<SBSubFullHash,SBAddFullHash>,
                &removed_full_adds);
 
-  // Remove items from the deleted chunks.  This is done after other
-  // processing to allow subs to knock out adds (and be removed) even
-  // if the add's chunk is deleted.
-  RemoveDeleted(add_prefixes, add_chunks_deleted);
-  RemoveDeleted(sub_prefixes, sub_chunks_deleted);
+  // As above, deleted chunks are removed after the knockouts.
   RemoveDeleted(add_full_hashes, add_chunks_deleted);
   RemoveDeleted(sub_full_hashes, sub_chunks_deleted);
 }
@@ -146,6 +146,18 @@ void SBProcessSubs(SBAddPrefixes* add_prefixes,
                    const base::hash_set<int32>& add_chunks_deleted,
                    const base::hash_set<int32>& sub_chunks_deleted);
 
+// The full-hash part of SBProcessSubs(), for callers which knock the
+// sub prefixes out of the add prefixes themselves.  |removed_adds|
+// holds the knocked-out add prefixes in SBAddPrefixLess order; those
+// without full hashes may be omitted.  Removes the full hashes of
+// |removed_adds|, knocks out matching full-hash subs and adds, and
+// removes items from deleted chunks.
+void SBProcessFullHashSubs(const SBAddPrefixes& removed_adds,
+                           std::vector<SBAddFullHash>* add_full_hashes,
+                           std::vector<SBSubFullHash>* sub_full_hashes,
+                           const base::hash_set<int32>& add_chunks_deleted,
+                           const base::hash_set<int32>& sub_chunks_deleted);
+
 // TODO(shess): This uses int32 rather than int because it's writing
 // specifically-sized items to files.  SBPrefix should likewise be
 // explicitly sized.
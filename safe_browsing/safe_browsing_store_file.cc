@@ -4,7 +4,10 @@
 
 #include "chrome/browser/safe_browsing/safe_browsing_store_file.h"
 
+#include <algorithm>
+
 #include "base/md5.h"
+#include "base/memory/scoped_vector.h"
 #include "base/metrics/histogram.h"
 
 namespace {
@@ -167,6 +170,320 @@ bool ReadAndVerifyHeader(const base::FilePath& filename,
   return true;
 }
 
+// Fold the |size| bytes of |fp| from the current position, less the
+// trailing digest, into a checksum, and compare it with the trailing
+// digest.  |*matches| is set to the result of the comparison.  Returns
+// false if the file could not be read.
+bool CheckFileDigest(FILE* fp, int64 size, bool* matches) {
+  base::MD5Context context;
+  base::MD5Init(&context);
+
+  // Read everything except the final digest.
+  size_t bytes_left = static_cast<size_t>(size);
+  CHECK(size == static_cast<int64>(bytes_left));
+  if (bytes_left < sizeof(base::MD5Digest))
+    return false;
+  bytes_left -= sizeof(base::MD5Digest);
+
+  // Fold the contents of the file into the checksum.
+  while (bytes_left > 0) {
+    char buf[4096];
+    const size_t c = std::min(sizeof(buf), bytes_left);
+    const size_t ret = fread(buf, 1, c, fp);
+
+    // The file's size changed while reading, give up.
+    if (ret != c)
+      return false;
+    base::MD5Update(&context, base::StringPiece(buf, c));
+    bytes_left -= c;
+  }
+
+  // Calculate the digest to this point.
+  base::MD5Digest calculated_digest;
+  base::MD5Final(&calculated_digest, &context);
+
+  // Read the stored digest and verify it.
+  base::MD5Digest file_digest;
+  if (!ReadItem(&file_digest, fp, NULL))
+    return false;
+  *matches =
+      (0 == memcmp(&file_digest, &calculated_digest, sizeof(file_digest)));
+  return true;
+}
+
+// Merging ---------------------------------------------------------------------
+
+// Items are read and written in blocks of about this many bytes during
+// an update's merge.
+const size_t kMergeBufferBytes = 4096;
+
+// The most runs which are merged at once.  If there are more, they are
+// merged in groups of this many first.
+const size_t kMaxMergeRuns = 32;
+
+template <class T>
+size_t MergeBufferItems() {
+  return std::max(kMergeBufferBytes / sizeof(T), static_cast<size_t>(1));
+}
+
+// The location of a run of |count| items sorted by SBAddPrefixLess
+// starting at |offset| in |fp|.
+struct FileRun {
+  FileRun(FILE* run_fp, int64 run_offset, size_t run_count)
+      : fp(run_fp), offset(run_offset), count(run_count) {}
+
+  FILE* fp;
+  int64 offset;
+  size_t count;
+};
+
+// Reads a run of items a buffer at a time.  Readers and writers can
+// share a file, since each seeks to its position before it reads or
+// writes.
+template <class T>
+class RunReader {
+ public:
+  explicit RunReader(const FileRun& run)
+      : remaining_(run), pos_(0), out_of_order_(false) {}
+
+  // Reads the first buffer of items, returning false on failure.
+  bool Init() {
+    return Fill();
+  }
+
+  bool empty() const { return pos_ == buffer_.size(); }
+  const T& front() const { return buffer_[pos_]; }
+
+  // Advances past front().  Returns false if the file could not be
+  // read, or if the run turns out not to be sorted.
+  bool Pop() {
+    const T previous = buffer_[pos_];
+    ++pos_;
+    if (empty() && !Fill())
+      return false;
+    if (!empty() && SBAddPrefixLess(front(), previous)) {
+      out_of_order_ = true;
+      return false;
+    }
+    return true;
+  }
+
+  bool out_of_order() const { return out_of_order_; }
+
+ private:
+  bool Fill() {
+    buffer_.clear();
+    pos_ = 0;
+    const size_t count = std::min(remaining_.count, MergeBufferItems<T>());
+    if (!count)
+      return true;
+
+    if (fseek(remaining_.fp, static_cast<long>(remaining_.offset), SEEK_SET))
+      return false;
+    buffer_.resize(count);
+    if (fread(&buffer_[0], sizeof(T), count, remaining_.fp) != count)
+      return false;
+    remaining_.offset += count * sizeof(T);
+    remaining_.count -= count;
+    return true;
+  }
+
+  // The part of the run which has not been read into |buffer_|.
+  FileRun remaining_;
+
+  std::vector<T> buffer_;
+  size_t pos_;
+  bool out_of_order_;
+
+  DISALLOW_COPY_AND_ASSIGN(RunReader);
+};
+
+// Writes a run of items starting at |offset| in |fp| a buffer at a
+// time.  Flush() must be called after the last item.
+template <class T>
+class RunWriter {
+ public:
+  RunWriter(FILE* fp, int64 offset) : run_(fp, offset, 0) {}
+
+  bool Write(const T& item) {
+    buffer_.push_back(item);
+    return buffer_.size() < MergeBufferItems<T>() || Flush();
+  }
+
+  bool Flush() {
+    if (buffer_.empty())
+      return true;
+
+    const int64 offset = run_.offset + run_.count * sizeof(T);
+    if (fseek(run_.fp, static_cast<long>(offset), SEEK_SET))
+      return false;
+    if (fwrite(&buffer_[0], sizeof(T), buffer_.size(), run_.fp) !=
+        buffer_.size()) {
+      return false;
+    }
+    run_.count += buffer_.size();
+    buffer_.clear();
+    return true;
+  }
+
+  // The items written so far, once flushed.
+  const FileRun& run() const { return run_; }
+  int64 end_offset() const { return run_.offset + run_.count * sizeof(T); }
+
+ private:
+  FileRun run_;
+  std::vector<T> buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(RunWriter);
+};
+
+// Merges runs into a single stream in SBAddPrefixLess order.
+template <class T>
+class RunMerger {
+ public:
+  RunMerger() : out_of_order_(false) {}
+
+  // Reads the start of each of |runs|, returning false on failure.
+  bool Init(const std::vector<FileRun>& runs) {
+    for (size_t i = 0; i < runs.size(); ++i) {
+      readers_.push_back(new RunReader<T>(runs[i]));
+      if (!readers_.back()->Init())
+        return false;
+      if (!readers_.back()->empty())
+        heap_.push_back(readers_.back());
+    }
+    std::make_heap(heap_.begin(), heap_.end(), &RunMerger::ReaderGreater);
+    return true;
+  }
+
+  bool empty() const { return heap_.empty(); }
+  const T& front() const { return heap_.front()->front(); }
+
+  // Advances past front().  Returns false if a run could not be read,
+  // or was not sorted.
+  bool Pop() {
+    std::pop_heap(heap_.begin(), heap_.end(), &RunMerger::ReaderGreater);
+    RunReader<T>* reader = heap_.back();
+    if (!reader->Pop()) {
+      out_of_order_ = reader->out_of_order();
+      return false;
+    }
+    if (reader->empty()) {
+      heap_.pop_back();
+    } else {
+      std::push_heap(heap_.begin(), heap_.end(), &RunMerger::ReaderGreater);
+    }
+    return true;
+  }
+
+  bool out_of_order() const { return out_of_order_; }
+
+ private:
+  // Orders |heap_| so the reader with the least item is at the front.
+  static bool ReaderGreater(const RunReader<T>* a, const RunReader<T>* b) {
+    return SBAddPrefixLess(b->front(), a->front());
+  }
+
+  ScopedVector<RunReader<T> > readers_;
+  std::vector<RunReader<T>*> heap_;
+  bool out_of_order_;
+
+  DISALLOW_COPY_AND_ASSIGN(RunMerger);
+};
+
+// Merge |runs| in groups of |kMaxMergeRuns| until there are no more than
+// |max_runs| left, writing the merged runs to |fp| from |*end_offset|,
+// which is updated to the end of the data written.
+template <class T>
+bool ReduceRuns(FILE* fp, size_t max_runs, std::vector<FileRun>* runs,
+                int64* end_offset) {
+  DCHECK_GT(max_runs, 0U);
+  while (runs->size() > max_runs) {
+    std::vector<FileRun> merged_runs;
+    for (size_t i = 0; i < runs->size(); i += kMaxMergeRuns) {
+      const std::vector<FileRun> group(
+          runs->begin() + i,
+          runs->begin() + std::min(i + kMaxMergeRuns, runs->size()));
+      RunMerger<T> merger;
+      if (!merger.Init(group))
+        return false;
+
+      RunWriter<T> writer(fp, *end_offset);
+      while (!merger.empty()) {
+        if (!writer.Write(merger.front()) || !merger.Pop())
+          return false;
+      }
+      if (!writer.Flush())
+        return false;
+
+      merged_runs.push_back(writer.run());
+      *end_offset = writer.end_offset();
+    }
+    runs->swap(merged_runs);
+  }
+  return true;
+}
+
+// Compares the SBAddPrefix parts of items of different types, for
+// searching full hashes by add prefix.
+struct AddPrefixLess {
+  template <class T, class U>
+  bool operator()(const T& a, const U& b) const {
+    return SBAddPrefixLess(a, b);
+  }
+};
+
+// The streaming equivalent of the prefix processing in SBProcessSubs().
+// Merges |adds| and |subs| in parallel, dropping matched pairs and items
+// from deleted chunks.  Kept adds are appended to |add_prefixes|, kept
+// subs are written to |sub_writer|, and knocked-out adds which have full
+// hashes in |add_full_hashes| or |sub_full_hashes| (which must be sorted
+// by SBAddPrefixLess) are appended to |removed_adds|.
+bool KnockoutSubPrefixes(RunMerger<SBAddPrefix>* adds,
+                         RunMerger<SBSubPrefix>* subs,
+                         const std::vector<SBAddFullHash>& add_full_hashes,
+                         const std::vector<SBSubFullHash>& sub_full_hashes,
+                         const base::hash_set<int32>& add_chunks_deleted,
+                         const base::hash_set<int32>& sub_chunks_deleted,
+                         SBAddPrefixes* add_prefixes,
+                         RunWriter<SBSubPrefix>* sub_writer,
+                         SBAddPrefixes* removed_adds) {
+  while (!adds->empty() || !subs->empty()) {
+    // If |subs->front()| < |adds->front()|, retain the sub.
+    if (adds->empty() ||
+        (!subs->empty() && SBAddPrefixLess(subs->front(), adds->front()))) {
+      if (sub_chunks_deleted.count(subs->front().chunk_id) == 0 &&
+          !sub_writer->Write(subs->front())) {
+        return false;
+      }
+      if (!subs->Pop())
+        return false;
+
+      // If |adds->front()| < |subs->front()|, retain the add.
+    } else if (subs->empty() ||
+               SBAddPrefixLess(adds->front(), subs->front())) {
+      if (add_chunks_deleted.count(adds->front().chunk_id) == 0)
+        add_prefixes->push_back(adds->front());
+      if (!adds->Pop())
+        return false;
+
+      // Drop equal items, recording the add if its full hashes need to
+      // be dropped, too.
+    } else {
+      const SBAddPrefix& add = adds->front();
+      if (std::binary_search(add_full_hashes.begin(), add_full_hashes.end(),
+                             add, AddPrefixLess()) ||
+          std::binary_search(sub_full_hashes.begin(), sub_full_hashes.end(),
+                             add, AddPrefixLess())) {
+        removed_adds->push_back(add);
+      }
+      if (!adds->Pop() || !subs->Pop())
+        return false;
+    }
+  }
+  return sub_writer->Flush();
+}
+
 }  // namespace
 
 // static
@@ -201,7 +518,10 @@ void SafeBrowsingStoreFile::CheckForOriginalAndDelete(
 }
 
 SafeBrowsingStoreFile::SafeBrowsingStoreFile()
-    : chunks_written_(0), empty_(false), corruption_seen_(false) {}
+    : chunks_written_(0),
+      empty_(false),
+      corruption_seen_(false),
+      update_peak_bytes_(0) {}
 
 SafeBrowsingStoreFile::~SafeBrowsingStoreFile() {
   Close();
@@ -233,38 +553,10 @@ bool SafeBrowsingStoreFile::CheckValidity() {
   if (!base::GetFileSize(filename_, &size))
     return OnCorruptDatabase();
 
-  base::MD5Context context;
-  base::MD5Init(&context);
-
-  // Read everything except the final digest.
-  size_t bytes_left = static_cast<size_t>(size);
-  CHECK(size == static_cast<int64>(bytes_left));
-  if (bytes_left < sizeof(base::MD5Digest))
+  bool digest_matches = false;
+  if (!CheckFileDigest(file_.get(), size, &digest_matches))
     return OnCorruptDatabase();
-  bytes_left -= sizeof(base::MD5Digest);
-
-  // Fold the contents of the file into the checksum.
-  while (bytes_left > 0) {
-    char buf[4096];
-    const size_t c = std::min(sizeof(buf), bytes_left);
-    const size_t ret = fread(buf, 1, c, file_.get());
-
-    // The file's size changed while reading, give up.
-    if (ret != c)
-      return OnCorruptDatabase();
-    base::MD5Update(&context, base::StringPiece(buf, c));
-    bytes_left -= c;
-  }
-
-  // Calculate the digest to this point.
-  base::MD5Digest calculated_digest;
-  base::MD5Final(&calculated_digest, &context);
-
-  // Read the stored digest and verify it.
-  base::MD5Digest file_digest;
-  if (!ReadItem(&file_digest, file_.get(), NULL))
-    return OnCorruptDatabase();
-  if (0 != memcmp(&file_digest, &calculated_digest, sizeof(file_digest))) {
+  if (!digest_matches) {
     RecordFormatEvent(FORMAT_EVENT_VALIDITY_CHECKSUM_FAILURE);
     return OnCorruptDatabase();
   }
@@ -454,6 +746,13 @@ bool SafeBrowsingStoreFile::FinishChunk() {
       !add_hashes_.size() && !sub_hashes_.size())
     return true;
 
+  // Sort the prefixes so that each chunk's are a run which DoUpdate()
+  // can merge.
+  std::sort(add_prefixes_.begin(), add_prefixes_.end(),
+            SBAddPrefixLess<SBAddPrefix,SBAddPrefix>);
+  std::sort(sub_prefixes_.begin(), sub_prefixes_.end(),
+            SBAddPrefixLess<SBSubPrefix,SBSubPrefix>);
+
   ChunkHeader header;
   header.add_prefix_count = add_prefixes_.size();
   header.sub_prefix_count = sub_prefixes_.size();
@@ -483,63 +782,60 @@ bool SafeBrowsingStoreFile::DoUpdate(
   CHECK(add_prefixes_result);
   CHECK(add_full_hashes_result);
 
-  SBAddPrefixes add_prefixes;
-  SBSubPrefixes sub_prefixes;
+  // The prefixes are merged from runs in the files, the full hashes are
+  // small enough to process in memory.
+  std::vector<FileRun> add_prefix_runs;
+  std::vector<FileRun> sub_prefix_runs;
   std::vector<SBAddFullHash> add_full_hashes;
   std::vector<SBSubFullHash> sub_full_hashes;
 
-  // Read original data into the vectors.
+  // Locate the original data, which is merged last.
+  std::vector<FileRun> original_add_prefix_runs;
+  std::vector<FileRun> original_sub_prefix_runs;
   if (!empty_) {
     DCHECK(file_.get());
 
     if (!FileRewind(file_.get()))
       return OnCorruptDatabase();
 
-    base::MD5Context context;
-    base::MD5Init(&context);
+    // The merge reads the file out of order, so verify the checksum of
+    // the whole file first.
+    int64 file_size = 0;
+    if (!base::GetFileSize(filename_, &file_size))
+      return OnCorruptDatabase();
+    bool digest_matches = false;
+    if (!CheckFileDigest(file_.get(), file_size, &digest_matches))
+      return OnCorruptDatabase();
+    if (!digest_matches) {
+      RecordFormatEvent(FORMAT_EVENT_UPDATE_CHECKSUM_FAILURE);
+      return OnCorruptDatabase();
+    }
 
     // Read the file header and make sure it looks right.
-    FileHeader header;
-    if (!ReadAndVerifyHeader(filename_, file_.get(), &header, &context))
+    if (!FileRewind(file_.get()))
       return OnCorruptDatabase();
-
-    // Re-read the chunks-seen data to get to the later data in the
-    // file and calculate the checksum.  No new elements should be
-    // added to the sets.
-    if (!ReadToContainer(&add_chunks_cache_, header.add_chunk_count,
-                         file_.get(), &context) ||
-        !ReadToContainer(&sub_chunks_cache_, header.sub_chunk_count,
-                         file_.get(), &context))
+    FileHeader header;
+    if (!ReadAndVerifyHeader(filename_, file_.get(), &header, NULL))
       return OnCorruptDatabase();
 
-    if (!ReadToContainer(&add_prefixes, header.add_prefix_count,
-                         file_.get(), &context) ||
-        !ReadToContainer(&sub_prefixes, header.sub_prefix_count,
-                         file_.get(), &context) ||
+    // The chunks-seen data was read by BeginUpdate().
+    int64 offset = sizeof(header) +
+        header.add_chunk_count * sizeof(int32) +
+        header.sub_chunk_count * sizeof(int32);
+    original_add_prefix_runs.push_back(
+        FileRun(file_.get(), offset, header.add_prefix_count));
+    offset += header.add_prefix_count * sizeof(SBAddPrefix);
+    original_sub_prefix_runs.push_back(
+        FileRun(file_.get(), offset, header.sub_prefix_count));
+    offset += header.sub_prefix_count * sizeof(SBSubPrefix);
+
+    if (fseek(file_.get(), static_cast<long>(offset), SEEK_SET) ||
         !ReadToContainer(&add_full_hashes, header.add_hash_count,
-                         file_.get(), &context) ||
+                         file_.get(), NULL) ||
         !ReadToContainer(&sub_full_hashes, header.sub_hash_count,
-                         file_.get(), &context))
-      return OnCorruptDatabase();
-
-    // Calculate the digest to this point.
-    base::MD5Digest calculated_digest;
-    base::MD5Final(&calculated_digest, &context);
-
-    // Read the stored checksum and verify it.
-    base::MD5Digest file_digest;
-    if (!ReadItem(&file_digest, file_.get(), NULL))
+                         file_.get(), NULL))
       return OnCorruptDatabase();
-
-    if (0 != memcmp(&file_digest, &calculated_digest, sizeof(file_digest))) {
-      RecordFormatEvent(FORMAT_EVENT_UPDATE_CHECKSUM_FAILURE);
-      return OnCorruptDatabase();
-    }
-
-    // Close the file so we can later rename over it.
-    file_.reset();
   }
-  DCHECK(!file_.get());
 
   // Rewind the temporary storage.
   if (!FileRewind(new_file_.get()))
@@ -556,7 +852,8 @@ bool SafeBrowsingStoreFile::DoUpdate(
   UMA_HISTOGRAM_COUNTS("SB2.DatabaseUpdateKilobytes",
                        std::max(static_cast<int>(size / 1024), 1));
 
-  // Append the accumulated chunks onto the vectors read from |file_|.
+  // Locate the runs of prefixes for the accumulated chunks, and append
+  // their full hashes onto the vectors read from |file_|.
   for (int i = 0; i < chunks_written_; ++i) {
     ChunkHeader header;
 
@@ -577,17 +874,19 @@ bool SafeBrowsingStoreFile::DoUpdate(
     if (expected_size > size)
       return false;
 
-    // TODO(shess): If the vectors were kept sorted, then this code
-    // could use std::inplace_merge() to merge everything together in
-    // sorted order.  That might still be slower than just sorting at
-    // the end if there were a large number of chunks.  In that case
-    // some sort of recursive binary merge might be in order (merge
-    // chunks pairwise, merge those chunks pairwise, and so on, then
-    // merge the result with the main list).
-    if (!ReadToContainer(&add_prefixes, header.add_prefix_count,
-                         new_file_.get(), NULL) ||
-        !ReadToContainer(&sub_prefixes, header.sub_prefix_count,
-                         new_file_.get(), NULL) ||
+    ofs += sizeof(ChunkHeader);
+    if (header.add_prefix_count) {
+      add_prefix_runs.push_back(
+          FileRun(new_file_.get(), ofs, header.add_prefix_count));
+    }
+    ofs += header.add_prefix_count * sizeof(SBAddPrefix);
+    if (header.sub_prefix_count) {
+      sub_prefix_runs.push_back(
+          FileRun(new_file_.get(), ofs, header.sub_prefix_count));
+    }
+    ofs += header.sub_prefix_count * sizeof(SBSubPrefix);
+
+    if (fseek(new_file_.get(), static_cast<long>(ofs), SEEK_SET) ||
         !ReadToContainer(&add_full_hashes, header.add_hash_count,
                          new_file_.get(), NULL) ||
         !ReadToContainer(&sub_full_hashes, header.sub_hash_count,
@@ -599,17 +898,71 @@ bool SafeBrowsingStoreFile::DoUpdate(
   add_full_hashes.insert(add_full_hashes.end(),
                          pending_adds.begin(), pending_adds.end());
 
+  // The merge looks up knocked-out adds in the full hashes.
+  std::sort(add_full_hashes.begin(), add_full_hashes.end(),
+            SBAddPrefixHashLess<SBAddFullHash,SBAddFullHash>);
+  std::sort(sub_full_hashes.begin(), sub_full_hashes.end(),
+            SBAddPrefixHashLess<SBSubFullHash,SBSubFullHash>);
+
+  // Merge the chunks' runs until they can be merged with the original
+  // data at once.  Merged runs, and then the kept sub prefixes, are
+  // written after the chunks in the temporary file.
+  int64 end_offset = size;
+  if (!ReduceRuns<SBAddPrefix>(new_file_.get(), kMaxMergeRuns - 1,
+                               &add_prefix_runs, &end_offset) ||
+      !ReduceRuns<SBSubPrefix>(new_file_.get(), kMaxMergeRuns - 1,
+                               &sub_prefix_runs, &end_offset))
+    return false;
+  add_prefix_runs.insert(add_prefix_runs.end(),
+                         original_add_prefix_runs.begin(),
+                         original_add_prefix_runs.end());
+  sub_prefix_runs.insert(sub_prefix_runs.end(),
+                         original_sub_prefix_runs.begin(),
+                         original_sub_prefix_runs.end());
+
   // Knock the subs from the adds and process deleted chunks.
-  SBProcessSubs(&add_prefixes, &sub_prefixes,
-                &add_full_hashes, &sub_full_hashes,
-                add_del_cache_, sub_del_cache_);
+  SBAddPrefixes add_prefixes;
+  SBAddPrefixes removed_adds;
+  RunWriter<SBSubPrefix> sub_writer(new_file_.get(), end_offset);
+  {
+    RunMerger<SBAddPrefix> adds;
+    RunMerger<SBSubPrefix> subs;
+    if (!adds.Init(add_prefix_runs) || !subs.Init(sub_prefix_runs))
+      return false;
+    if (!KnockoutSubPrefixes(&adds, &subs, add_full_hashes, sub_full_hashes,
+                             add_del_cache_, sub_del_cache_,
+                             &add_prefixes, &sub_writer, &removed_adds)) {
+      // The chunks' runs are sorted by FinishChunk(), and the original
+      // data is always written sorted, so an unsorted run is corrupt.
+      if (adds.out_of_order() || subs.out_of_order())
+        return OnCorruptDatabase();
+      return false;
+    }
+  }
+  SBProcessFullHashSubs(removed_adds, &add_full_hashes, &sub_full_hashes,
+                        add_del_cache_, sub_del_cache_);
+
+  // Everything which is held in memory has been collected, and the
+  // merge buffers are still allocated.
+  const size_t peak_bytes =
+      add_prefixes.size() * sizeof(SBAddPrefix) +
+      removed_adds.size() * sizeof(SBAddPrefix) +
+      add_full_hashes.size() * sizeof(SBAddFullHash) +
+      sub_full_hashes.size() * sizeof(SBSubFullHash) +
+      (add_prefix_runs.size() + sub_prefix_runs.size() + 1) *
+          kMergeBufferBytes;
 
   // We no longer need to track deleted chunks.
   DeleteChunksFromSet(add_del_cache_, &add_chunks_cache_);
   DeleteChunksFromSet(sub_del_cache_, &sub_chunks_cache_);
 
-  // Write the new data to new_file_.
-  if (!FileRewind(new_file_.get()))
+  // Close the file so we can later rename over it.
+  file_.reset();
+
+  // Write the new data to the merge file.
+  const base::FilePath merge_filename = MergeFileForFilename(filename_);
+  file_util::ScopedFILE merge_file(base::OpenFile(merge_filename, "wb"));
+  if (!merge_file.get())
     return false;
 
   base::MD5Context context;
@@ -622,44 +975,57 @@ bool SafeBrowsingStoreFile::DoUpdate(
   header.add_chunk_count = add_chunks_cache_.size();
   header.sub_chunk_count = sub_chunks_cache_.size();
   header.add_prefix_count = add_prefixes.size();
-  header.sub_prefix_count = sub_prefixes.size();
+  header.sub_prefix_count = sub_writer.run().count;
   header.add_hash_count = add_full_hashes.size();
   header.sub_hash_count = sub_full_hashes.size();
-  if (!WriteItem(header, new_file_.get(), &context))
+  if (!WriteItem(header, merge_file.get(), &context))
     return false;
 
-  // Write all the chunk data.
-  if (!WriteContainer(add_chunks_cache_, new_file_.get(), &context) ||
-      !WriteContainer(sub_chunks_cache_, new_file_.get(), &context) ||
-      !WriteContainer(add_prefixes, new_file_.get(), &context) ||
-      !WriteContainer(sub_prefixes, new_file_.get(), &context) ||
-      !WriteContainer(add_full_hashes, new_file_.get(), &context) ||
-      !WriteContainer(sub_full_hashes, new_file_.get(), &context))
+  // Write all the chunk data, copying the kept sub prefixes from the
+  // temporary file.
+  if (!WriteContainer(add_chunks_cache_, merge_file.get(), &context) ||
+      !WriteContainer(sub_chunks_cache_, merge_file.get(), &context) ||
+      !WriteContainer(add_prefixes, merge_file.get(), &context))
+    return false;
+
+  RunReader<SBSubPrefix> sub_prefixes(sub_writer.run());
+  if (!sub_prefixes.Init())
+    return false;
+  while (!sub_prefixes.empty()) {
+    if (!WriteItem(sub_prefixes.front(), merge_file.get(), &context) ||
+        !sub_prefixes.Pop())
+      return false;
+  }
+
+  if (!WriteContainer(add_full_hashes, merge_file.get(), &context) ||
+      !WriteContainer(sub_full_hashes, merge_file.get(), &context))
     return false;
 
   // Write the checksum at the end.
   base::MD5Digest digest;
   base::MD5Final(&digest, &context);
-  if (!WriteItem(digest, new_file_.get(), NULL))
+  if (!WriteItem(digest, merge_file.get(), NULL))
     return false;
 
-  // Trim any excess left over from the temporary chunk data.
-  if (!base::TruncateFile(new_file_.get()))
-    return false;
-
-  // Close the file handle and swizzle the file into place.
+  // Close the file handles and swizzle the merged file into place.
+  merge_file.reset();
   new_file_.reset();
   if (!base::DeleteFile(filename_, false) &&
       base::PathExists(filename_))
     return false;
 
-  const base::FilePath new_filename = TemporaryFileForFilename(filename_);
-  if (!base::Move(new_filename, filename_))
+  if (!base::Move(merge_filename, filename_))
     return false;
 
+  // The chunk data has been committed.
+  base::DeleteFile(TemporaryFileForFilename(filename_), false);
+
   // Record counts before swapping to caller.
   UMA_HISTOGRAM_COUNTS("SB2.AddPrefixes", add_prefixes.size());
-  UMA_HISTOGRAM_COUNTS("SB2.SubPrefixes", sub_prefixes.size());
+  UMA_HISTOGRAM_COUNTS("SB2.SubPrefixes", header.sub_prefix_count);
+  UMA_HISTOGRAM_COUNTS("SB2.StoreUpdatePeakKilobytes",
+                       static_cast<int>(peak_bytes / 1024));
+  update_peak_bytes_ = peak_bytes;
 
   // Pass the resulting data off to the caller.
   add_prefixes_result->swap(add_prefixes);
@@ -675,10 +1041,13 @@ bool SafeBrowsingStoreFile::FinishUpdate(
   DCHECK(add_prefixes_result);
   DCHECK(add_full_hashes_result);
 
+  const base::TimeTicks before = base::TimeTicks::Now();
   if (!DoUpdate(pending_adds, add_prefixes_result, add_full_hashes_result)) {
     CancelUpdate();
     return false;
   }
+  UMA_HISTOGRAM_LONG_TIMES("SB2.StoreUpdateTime",
+                           base::TimeTicks::Now() - before);
 
   DCHECK(!new_file_.get());
   DCHECK(!file_.get());
@@ -739,6 +1108,13 @@ bool SafeBrowsingStoreFile::DeleteStore(const base::FilePath& basename) {
     return false;
   }
 
+  const base::FilePath merge_filename = MergeFileForFilename(basename);
+  if (!base::DeleteFile(merge_filename, false) &&
+      base::PathExists(merge_filename)) {
+    NOTREACHED();
+    return false;
+  }
+
   // With SQLite support gone, one way to get to this code is if the
   // existing file is a SQLite file.  Make sure the journal file is
   // also removed.
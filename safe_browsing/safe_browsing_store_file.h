@@ -53,11 +53,15 @@
 // }
 // MD5Digest checksum;      // Checksum over preceeding data.
 //
+// The add and sub prefix lists are kept in SBAddPrefixLess order, so
+// that updates can merge them from disk.
+//
 // During the course of an update, uncommitted data is stored in a
-// temporary file (which is later re-used to commit).  This is an
-// array of chunks, with the count kept in memory until the end of the
-// transaction.  The format of this file is like the main file, with
-// the list of chunks seen omitted, as that data is tracked in-memory:
+// temporary file.  This is an array of chunks, with the count kept in
+// memory until the end of the transaction.  The format of this file is
+// like the main file, with the list of chunks seen omitted, as that
+// data is tracked in-memory.  Each chunk's prefix lists are sorted, so
+// that each is a run which can be merged:
 //
 // array[] {
 //   uint32 add_prefix_count;
@@ -88,14 +92,24 @@
 // The overall transaction works like this:
 // - Open the original file to get the chunks-seen data.
 // - Open a temp file for storing new chunk info.
-// - Write new chunks to the temp file.
+// - Write new chunks to the temp file, sorting their prefixes.
 // - When the transaction is finished:
-//   - Read the rest of the original file's data into buffers.
-//   - Rewind the temp file and merge the new data into buffers.
-//   - Process buffers for deletions and apply subs.
-//   - Rewind and write the buffers out to temp file.
-//   - Delete original file.
-//   - Rename temp file to original filename.
+//   - Verify the original file's checksum, and read in its full hashes.
+//   - Read the full hashes from the temp file, and locate its runs.
+//   - If there are too many runs to merge at once, merge them in
+//     groups, appending the longer runs to the temp file.
+//   - Merge the add and sub prefix runs of both files in parallel,
+//     knocking subs out of adds and dropping deleted chunks as they go.
+//     The kept add prefixes are returned to the caller, so they are
+//     kept in memory.  The kept sub prefixes are appended to the temp
+//     file.
+//   - Process the full hashes in memory.
+//   - Write everything out to a merge file.
+//   - Delete original file and temp file.
+//   - Rename merge file to original filename.
+//
+// Memory use during the merge is bounded by the number of runs merged
+// at once, other than for the kept add prefixes and the full hashes.
 
 // TODO(shess): By using a checksum, this code can avoid doing an
 // fsync(), at the possible cost of more frequently retrieving the
@@ -162,6 +176,17 @@ class SafeBrowsingStoreFile : public SafeBrowsingStore {
     return base::FilePath(filename.value() + FILE_PATH_LITERAL("_new"));
   }
 
+  // Returns the name of the file the merged data for |filename| is
+  // written to before it replaces |filename|.
+  static const base::FilePath MergeFileForFilename(
+      const base::FilePath& filename) {
+    return base::FilePath(filename.value() + FILE_PATH_LITERAL("_merge"));
+  }
+
+  // Approximate peak bytes held in memory by the last successful
+  // FinishUpdate().  Exported for unit tests.
+  size_t update_peak_bytes() const { return update_peak_bytes_; }
+
   // Delete any on-disk files, including the permanent storage.
   static bool DeleteStore(const base::FilePath& basename);
 
@@ -290,6 +315,9 @@ class SafeBrowsingStoreFile : public SafeBrowsingStore {
   // TODO(shess): Remove with format-migration support.
   bool corruption_seen_;
 
+  // See update_peak_bytes().
+  size_t update_peak_bytes_;
+
   DISALLOW_COPY_AND_ASSIGN(SafeBrowsingStoreFile);
 };
 
@@ -4,15 +4,117 @@
 
 #include "chrome/browser/safe_browsing/safe_browsing_store_file.h"
 
+#include <algorithm>
+
 #include "base/bind.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/md5.h"
+#include "base/rand_util.h"
 #include "chrome/browser/safe_browsing/safe_browsing_store_unittest_helper.h"
 #include "testing/gtest/include/gtest/gtest.h"
 #include "testing/platform_test.h"
 
 namespace {
 
+const int kRandomChunkPrefixes = 250;
+
+SBFullHash RandomFullHash(SBPrefix prefix) {
+  SBFullHash full_hash;
+  base::RandBytes(&full_hash, sizeof(full_hash));
+  full_hash.prefix = prefix;
+  return full_hash;
+}
+
+// Writes |chunk_count| add chunks of random prefixes from
+// |first_add_chunk| to |store|, each with a full hash for its first
+// prefix, and |chunk_count| sub chunks from |first_sub_chunk|.  Half of
+// the subs knock out a random one of |targets|, and half are for random
+// prefixes in |later_add_chunk|.  Each sub chunk also knocks out a random
+// one of |target_hashes|, if any.  Everything written is appended to the
+// vectors for comparing with SBProcessSubs().
+void WriteRandomChunks(SafeBrowsingStore* store,
+                       int first_add_chunk,
+                       int first_sub_chunk,
+                       int chunk_count,
+                       int later_add_chunk,
+                       const SBAddPrefixes& targets,
+                       const std::vector<SBAddFullHash>& target_hashes,
+                       SBAddPrefixes* add_prefixes,
+                       SBSubPrefixes* sub_prefixes,
+                       std::vector<SBAddFullHash>* add_full_hashes,
+                       std::vector<SBSubFullHash>* sub_full_hashes) {
+  const base::Time now = base::Time::Now();
+  for (int i = 0; i < chunk_count; ++i) {
+    const int add_chunk = first_add_chunk + i;
+    EXPECT_TRUE(store->BeginChunk());
+    store->SetAddChunk(add_chunk);
+    for (int j = 0; j < kRandomChunkPrefixes; ++j) {
+      const SBPrefix prefix = static_cast<SBPrefix>(base::RandUint64());
+      EXPECT_TRUE(store->WriteAddPrefix(add_chunk, prefix));
+      add_prefixes->push_back(SBAddPrefix(add_chunk, prefix));
+      if (j == 0) {
+        const SBFullHash full_hash = RandomFullHash(prefix);
+        EXPECT_TRUE(store->WriteAddHash(add_chunk, now, full_hash));
+        add_full_hashes->push_back(SBAddFullHash(add_chunk, now, full_hash));
+      }
+    }
+    EXPECT_TRUE(store->FinishChunk());
+
+    const int sub_chunk = first_sub_chunk + i;
+    EXPECT_TRUE(store->BeginChunk());
+    store->SetSubChunk(sub_chunk);
+    for (int j = 0; j < kRandomChunkPrefixes; ++j) {
+      SBSubPrefix sub(sub_chunk, later_add_chunk,
+                      static_cast<SBPrefix>(base::RandUint64()));
+      if (j % 2 && !targets.empty()) {
+        const SBAddPrefix& target =
+            targets[base::RandGenerator(targets.size())];
+        sub.add_chunk_id = target.chunk_id;
+        sub.add_prefix = target.prefix;
+      }
+      EXPECT_TRUE(store->WriteSubPrefix(sub.chunk_id, sub.add_chunk_id,
+                                        sub.add_prefix));
+      sub_prefixes->push_back(sub);
+    }
+    if (!target_hashes.empty()) {
+      const SBAddFullHash& target =
+          target_hashes[base::RandGenerator(target_hashes.size())];
+      EXPECT_TRUE(store->WriteSubHash(sub_chunk, target.chunk_id,
+                                      target.full_hash));
+      sub_full_hashes->push_back(
+          SBSubFullHash(sub_chunk, target.chunk_id, target.full_hash));
+    }
+    EXPECT_TRUE(store->FinishChunk());
+  }
+}
+
+// Check that the results of an update match those of SBProcessSubs().
+void ExpectSameResults(SBAddPrefixes expected_prefixes,
+                       std::vector<SBAddFullHash> expected_hashes,
+                       SBAddPrefixes add_prefixes,
+                       std::vector<SBAddFullHash> add_full_hashes) {
+  std::sort(expected_prefixes.begin(), expected_prefixes.end(),
+            SBAddPrefixLess<SBAddPrefix,SBAddPrefix>);
+  std::sort(add_prefixes.begin(), add_prefixes.end(),
+            SBAddPrefixLess<SBAddPrefix,SBAddPrefix>);
+  ASSERT_EQ(expected_prefixes.size(), add_prefixes.size());
+  for (size_t i = 0; i < add_prefixes.size(); ++i) {
+    EXPECT_EQ(expected_prefixes[i].chunk_id, add_prefixes[i].chunk_id);
+    EXPECT_EQ(expected_prefixes[i].prefix, add_prefixes[i].prefix);
+  }
+
+  std::sort(expected_hashes.begin(), expected_hashes.end(),
+            SBAddPrefixHashLess<SBAddFullHash,SBAddFullHash>);
+  std::sort(add_full_hashes.begin(), add_full_hashes.end(),
+            SBAddPrefixHashLess<SBAddFullHash,SBAddFullHash>);
+  ASSERT_EQ(expected_hashes.size(), add_full_hashes.size());
+  for (size_t i = 0; i < add_full_hashes.size(); ++i) {
+    EXPECT_EQ(expected_hashes[i].chunk_id, add_full_hashes[i].chunk_id);
+    EXPECT_TRUE(SBFullHashEq(expected_hashes[i].full_hash,
+                             add_full_hashes[i].full_hash));
+  }
+}
+
 class SafeBrowsingStoreFileTest : public PlatformTest {
  public:
   virtual void SetUp() {
@@ -187,4 +289,97 @@ TEST_F(SafeBrowsingStoreFileTest, CheckValidityChecksum) {
   EXPECT_TRUE(store_->CancelUpdate());
 }
 
+// An update ten times the size of the stored data, over more chunks
+// than are merged at once, matches processing everything in memory
+// without holding all of the prefixes in memory.
+TEST_F(SafeBrowsingStoreFileTest, TenfoldUpdate) {
+  const int kChunks = 20;
+  const int kLaterAddChunk = 1000;
+  const base::hash_set<int32> no_chunks_deleted;
+
+  SBAddPrefixes add_prefixes;
+  SBSubPrefixes sub_prefixes;
+  std::vector<SBAddFullHash> add_full_hashes;
+  std::vector<SBSubFullHash> sub_full_hashes;
+
+  std::vector<SBAddFullHash> pending_adds;
+  SBAddPrefixes add_prefixes_result;
+  std::vector<SBAddFullHash> add_full_hashes_result;
+
+  // Store the initial data.
+  ASSERT_TRUE(store_->BeginUpdate());
+  WriteRandomChunks(store_.get(), 1, 1, kChunks, kLaterAddChunk,
+                    SBAddPrefixes(), std::vector<SBAddFullHash>(),
+                    &add_prefixes, &sub_prefixes,
+                    &add_full_hashes, &sub_full_hashes);
+  ASSERT_TRUE(store_->FinishUpdate(pending_adds, &add_prefixes_result,
+                                   &add_full_hashes_result));
+  SBProcessSubs(&add_prefixes, &sub_prefixes,
+                &add_full_hashes, &sub_full_hashes,
+                no_chunks_deleted, no_chunks_deleted);
+  ExpectSameResults(add_prefixes, add_full_hashes,
+                    add_prefixes_result, add_full_hashes_result);
+
+  // Update with ten times as much data, knocking out the stored data and
+  // deleting some chunks.
+  ASSERT_TRUE(store_->BeginUpdate());
+  const SBAddPrefixes targets(add_prefixes);
+  const std::vector<SBAddFullHash> target_hashes(add_full_hashes);
+  WriteRandomChunks(store_.get(), kChunks + 1, kChunks + 1, 10 * kChunks,
+                    kLaterAddChunk, targets, target_hashes,
+                    &add_prefixes, &sub_prefixes,
+                    &add_full_hashes, &sub_full_hashes);
+  base::hash_set<int32> add_chunks_deleted;
+  add_chunks_deleted.insert(2);
+  add_chunks_deleted.insert(kChunks + 2);
+  base::hash_set<int32> sub_chunks_deleted;
+  sub_chunks_deleted.insert(kChunks + 3);
+  store_->DeleteAddChunk(2);
+  store_->DeleteAddChunk(kChunks + 2);
+  store_->DeleteSubChunk(kChunks + 3);
+
+  // Processing in memory holds all of the prefixes at once.
+  const size_t in_memory_bytes =
+      add_prefixes.size() * sizeof(SBAddPrefix) +
+      sub_prefixes.size() * sizeof(SBSubPrefix);
+
+  ASSERT_TRUE(store_->FinishUpdate(pending_adds, &add_prefixes_result,
+                                   &add_full_hashes_result));
+  SBProcessSubs(&add_prefixes, &sub_prefixes,
+                &add_full_hashes, &sub_full_hashes,
+                add_chunks_deleted, sub_chunks_deleted);
+  ExpectSameResults(add_prefixes, add_full_hashes,
+                    add_prefixes_result, add_full_hashes_result);
+  EXPECT_GT(store_->update_peak_bytes(), 0U);
+  EXPECT_LT(store_->update_peak_bytes(), in_memory_bytes);
+  EXPECT_FALSE(base::PathExists(
+      SafeBrowsingStoreFile::TemporaryFileForFilename(filename_)));
+  EXPECT_FALSE(base::PathExists(
+      SafeBrowsingStoreFile::MergeFileForFilename(filename_)));
+
+  // The kept subs were stored, and knock out adds in a later update.
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(kLaterAddChunk);
+  for (size_t i = 0; i < sub_prefixes.size(); i += 2) {
+    if (sub_prefixes[i].add_chunk_id != kLaterAddChunk)
+      continue;
+    EXPECT_TRUE(store_->WriteAddPrefix(kLaterAddChunk,
+                                       sub_prefixes[i].add_prefix));
+    add_prefixes.push_back(
+        SBAddPrefix(kLaterAddChunk, sub_prefixes[i].add_prefix));
+  }
+  EXPECT_TRUE(store_->WriteAddPrefix(kLaterAddChunk, 17));
+  add_prefixes.push_back(SBAddPrefix(kLaterAddChunk, 17));
+  EXPECT_TRUE(store_->FinishChunk());
+
+  ASSERT_TRUE(store_->FinishUpdate(pending_adds, &add_prefixes_result,
+                                   &add_full_hashes_result));
+  SBProcessSubs(&add_prefixes, &sub_prefixes,
+                &add_full_hashes, &sub_full_hashes,
+                no_chunks_deleted, no_chunks_deleted);
+  ExpectSameResults(add_prefixes, add_full_hashes,
+                    add_prefixes_result, add_full_hashes_result);
+}
+
 }  // namespace
@@ -7,6 +7,7 @@
 #include <limits>
 
 #include "base/file_util.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/memory/scoped_vector.h"
 #include "base/metrics/histogram.h"
 #include "base/threading/thread_restrictions.h"
@@ -30,26 +31,35 @@ struct FileHeader {
   int32 version;
 };
 
+// Returns the number of bytes |commands| take up in a file.
+size_t GetCommandsFileSize(const std::vector<SessionCommand*>& commands) {
+  size_t size = 0;
+  for (size_t i = 0; i < commands.size(); ++i) {
+    size += sizeof(SessionCommand::size_type) +
+        sizeof(SessionCommand::id_type) + commands[i]->size();
+  }
+  return size;
+}
+
 // SessionFileReader ----------------------------------------------------------
 
 // SessionFileReader is responsible for reading the set of SessionCommands that
 // describe a Session back from a file. SessionFileRead does minimal error
 // checking on the file (pretty much only that the header is valid).
-
+//
+// The file is mapped into memory, and the contents of all the commands are
+// copied from it to a single SessionCommandArena, which is freed once the
+// commands are deleted. The mapping itself is released when the reader is
+// destroyed, so that the backend can move or delete the file.
 class SessionFileReader {
  public:
   typedef SessionCommand::id_type id_type;
   typedef SessionCommand::size_type size_type;
 
   explicit SessionFileReader(const base::FilePath& path)
-      : errored_(false),
-        buffer_(SessionBackend::kFileReadBufferSize, 0),
-        buffer_position_(0),
-        available_count_(0) {
-    file_.reset(new net::FileStream(NULL));
+      : position_(0) {
     if (base::PathExists(path))
-      file_->OpenSync(path,
-                      base::PLATFORM_FILE_OPEN | base::PLATFORM_FILE_READ);
+      file_.Initialize(path);
   }
   // Reads the contents of the file specified in the constructor, returning
   // true on success. It is up to the caller to free all SessionCommands
@@ -59,54 +69,44 @@ class SessionFileReader {
 
  private:
   // Reads a single command, returning it. A return value of NULL indicates
-  // either there are no commands, or there was an error. Use errored_ to
-  // distinguish the two. If NULL is returned, and there is no error, it means
-  // the end of file was successfully reached.
+  // there are no more commands, either because the end of the file was
+  // reached or because the last write was incomplete.
   SessionCommand* ReadCommand();
 
-  // Shifts the unused portion of buffer_ to the beginning and fills the
-  // remaining portion with data from the file. Returns false if the buffer
-  // couldn't be filled. A return value of false only signals an error if
-  // errored_ is set to true.
-  bool FillBuffer();
-
-  // Whether an error condition has been detected (
-  bool errored_;
+  // The mapped file.
+  base::MemoryMappedFile file_;
 
-  // As we read from the file, data goes here.
-  std::string buffer_;
+  // Offset in file_ of the next command.
+  size_t position_;
 
-  // The file.
-  scoped_ptr<net::FileStream> file_;
-
-  // Position in buffer_ of the data.
-  size_t buffer_position_;
-
-  // Number of available bytes; relative to buffer_position_.
-  size_t available_count_;
+  // Holds the contents of the commands read.
+  scoped_refptr<SessionCommandArena> arena_;
 
   DISALLOW_COPY_AND_ASSIGN(SessionFileReader);
 };
 
 bool SessionFileReader::Read(BaseSessionService::SessionType type,
                              std::vector<SessionCommand*>* commands) {
-  if (!file_->IsOpen())
+  if (!file_.IsValid())
     return false;
   FileHeader header;
-  int read_count;
   TimeTicks start_time = TimeTicks::Now();
-  read_count = file_->ReadUntilComplete(reinterpret_cast<char*>(&header),
-                                        sizeof(header));
-  if (read_count != sizeof(header) || header.signature != kFileSignature ||
+  if (file_.length() < sizeof(header))
+    return false;
+  memcpy(&header, file_.data(), sizeof(header));
+  if (header.signature != kFileSignature ||
       header.version != kFileCurrentVersion)
     return false;
+  position_ = sizeof(header);
 
+  // Each command takes up at least as many bytes in the file as its contents
+  // take in the arena, including the padding that aligns them.
+  arena_ = new SessionCommandArena(file_.length() - sizeof(header));
   ScopedVector<SessionCommand> read_commands;
   SessionCommand* command;
-  while ((command = ReadCommand()) && !errored_)
+  while ((command = ReadCommand()))
     read_commands.push_back(command);
-  if (!errored_)
-    read_commands.swap(*commands);
+  read_commands.swap(*commands);
   if (type == BaseSessionService::TAB_RESTORE) {
     UMA_HISTOGRAM_TIMES("TabRestore.read_session_file_time",
                         TimeTicks::Now() - start_time);
@@ -114,26 +114,24 @@ bool SessionFileReader::Read(BaseSessionService::SessionType type,
     UMA_HISTOGRAM_TIMES("SessionRestore.read_session_file_time",
                         TimeTicks::Now() - start_time);
   }
-  return !errored_;
+  return true;
 }
 
 SessionCommand* SessionFileReader::ReadCommand() {
-  // Make sure there is enough in the buffer for the size of the next command.
-  if (available_count_ < sizeof(size_type)) {
-    if (!FillBuffer())
-      return NULL;
-    if (available_count_ < sizeof(size_type)) {
-      VLOG(1) << "SessionFileReader::ReadCommand, file incomplete";
-      // Still couldn't read a valid size for the command, assume write was
+  const char* data = reinterpret_cast<const char*>(file_.data());
+  const size_t available_count = file_.length() - position_;
+  // Make sure there is enough in the file for the size of the next command.
+  if (available_count < sizeof(size_type)) {
+    if (available_count > 0) {
+      // Couldn't read a valid size for the command, assume write was
       // incomplete and return NULL.
-      return NULL;
+      VLOG(1) << "SessionFileReader::ReadCommand, file incomplete";
     }
+    return NULL;
   }
   // Get the size of the command.
   size_type command_size;
-  memcpy(&command_size, &(buffer_[buffer_position_]), sizeof(command_size));
-  buffer_position_ += sizeof(command_size);
-  available_count_ -= sizeof(command_size);
+  memcpy(&command_size, data + position_, sizeof(command_size));
 
   if (command_size == 0) {
     VLOG(1) << "SessionFileReader::ReadCommand, empty command";
@@ -141,51 +139,26 @@ SessionCommand* SessionFileReader::ReadCommand() {
     return NULL;
   }
 
-  // Make sure buffer has the complete contents of the command.
-  if (command_size > available_count_) {
-    if (command_size > buffer_.size())
-      buffer_.resize((command_size / 1024 + 1) * 1024, 0);
-    if (!FillBuffer() || command_size > available_count_) {
-      // Again, assume the file was ok, and just the last chunk was lost.
-      VLOG(1) << "SessionFileReader::ReadCommand, last chunk lost";
-      return NULL;
-    }
+  // Make sure the file has the complete contents of the command.
+  if (command_size > available_count - sizeof(command_size)) {
+    // Again, assume the file was ok, and just the last chunk was lost.
+    VLOG(1) << "SessionFileReader::ReadCommand, last chunk lost";
+    return NULL;
   }
-  const id_type command_id = buffer_[buffer_position_];
+  position_ += sizeof(command_size);
+  const id_type command_id = data[position_];
   // NOTE: command_size includes the size of the id, which is not part of
   // the contents of the SessionCommand.
-  SessionCommand* command =
-      new SessionCommand(command_id, command_size - sizeof(id_type));
+  SessionCommand* command = new SessionCommand(
+      command_id, command_size - sizeof(id_type), arena_.get());
   if (command_size > sizeof(id_type)) {
-    memcpy(command->contents(),
-           &(buffer_[buffer_position_ + sizeof(id_type)]),
+    memcpy(command->contents(), data + position_ + sizeof(id_type),
            command_size - sizeof(id_type));
   }
-  buffer_position_ += command_size;
-  available_count_ -= command_size;
+  position_ += command_size;
   return command;
 }
 
-bool SessionFileReader::FillBuffer() {
-  if (available_count_ > 0 && buffer_position_ > 0) {
-    // Shift buffer to beginning.
-    memmove(&(buffer_[0]), &(buffer_[buffer_position_]), available_count_);
-  }
-  buffer_position_ = 0;
-  DCHECK(buffer_position_ + available_count_ < buffer_.size());
-  int to_read = static_cast<int>(buffer_.size() - available_count_);
-  int read_count = file_->ReadUntilComplete(&(buffer_[available_count_]),
-                                            to_read);
-  if (read_count < 0) {
-    errored_ = true;
-    return false;
-  }
-  if (read_count == 0)
-    return false;
-  available_count_ += read_count;
-  return true;
-}
-
 }  // namespace
 
 // SessionBackend -------------------------------------------------------------
@@ -198,8 +171,14 @@ static const char* kLastTabSessionFileName = "Last Tabs";
 static const char* kCurrentSessionFileName = "Current Session";
 static const char* kLastSessionFileName = "Last Session";
 
+// File names the current file is compacted to.
+static const char* kCompactingTabSessionFileName = "Compacting Tabs";
+static const char* kCompactingSessionFileName = "Compacting Session";
+
+// static
+const size_t SessionBackend::kMinCompactionSize = 512 * 1024;
 // static
-const int SessionBackend::kFileReadBufferSize = 1024;
+const size_t SessionBackend::kCompactionSliceSize = 64 * 1024;
 
 SessionBackend::SessionBackend(BaseSessionService::SessionType type,
                                const base::FilePath& path_to_dir)
@@ -207,7 +186,16 @@ SessionBackend::SessionBackend(BaseSessionService::SessionType type,
       path_to_dir_(path_to_dir),
       last_session_valid_(false),
       inited_(false),
-      empty_file_(true) {
+      empty_file_(true),
+      min_compaction_size_(kMinCompactionSize),
+      compaction_slice_size_(kCompactionSliceSize),
+      file_size_(0),
+      compacted_size_(0),
+      appended_bytes_(0),
+      compaction_bytes_(0),
+      compaction_command_count_(0),
+      compaction_position_(0),
+      compaction_file_size_(0) {
   // NOTE: this is invoked on the main thread, don't do file access here.
 }
 
@@ -234,9 +222,29 @@ void SessionBackend::AppendCommands(
     ResetFile();
   }
   // Need to check current_session_file_ again, ResetFile may fail.
-  if (current_session_file_.get() && current_session_file_->IsOpen() &&
-      !AppendCommandsToFile(current_session_file_.get(), *commands)) {
-    current_session_file_.reset(NULL);
+  if (current_session_file_.get() && current_session_file_->IsOpen()) {
+    for (std::vector<SessionCommand*>::const_iterator i = commands->begin();
+         i != commands->end(); ++i) {
+      const size_type total_size =
+          static_cast<size_type>((*i)->size()) + sizeof(id_type);
+      if (type_ == BaseSessionService::TAB_RESTORE)
+        UMA_HISTOGRAM_COUNTS("TabRestore.command_size", total_size);
+      else
+        UMA_HISTOGRAM_COUNTS("SessionRestore.command_size", total_size);
+    }
+    if (AppendCommandsToFile(current_session_file_.get(), *commands)) {
+      const size_t size = GetCommandsFileSize(*commands);
+      file_size_ += size;
+      appended_bytes_ += size;
+      if (!compaction_filter_.is_null()) {
+        file_commands_.insert(file_commands_.end(), commands->begin(),
+                              commands->end());
+        commands->clear();
+        MaybeCompact();
+      }
+    } else {
+      current_session_file_.reset(NULL);
+    }
   }
   empty_file_ = false;
   STLDeleteElements(commands);
@@ -311,10 +319,6 @@ bool SessionBackend::AppendCommandsToFile(net::FileStream* file,
     int wrote;
     const size_type content_size = static_cast<size_type>((*i)->size());
     const size_type total_size =  content_size + sizeof(id_type);
-    if (type_ == BaseSessionService::TAB_RESTORE)
-      UMA_HISTOGRAM_COUNTS("TabRestore.command_size", total_size);
-    else
-      UMA_HISTOGRAM_COUNTS("SessionRestore.command_size", total_size);
     wrote = file->WriteSync(reinterpret_cast<const char*>(&total_size),
                             sizeof(total_size));
     if (wrote != sizeof(total_size)) {
@@ -345,13 +349,145 @@ bool SessionBackend::AppendCommandsToFile(net::FileStream* file,
   return true;
 }
 
+void SessionBackend::MaybeCompact() {
+  if (compaction_file_.get()) {
+    ContinueCompaction();
+    return;
+  }
+  if (file_size_ >= min_compaction_size_ && file_size_ >= 2 * compacted_size_)
+    StartCompaction();
+}
+
+void SessionBackend::StartCompaction() {
+  superseded_.clear();
+  compaction_filter_.Run(file_commands_, &superseded_);
+  DCHECK_EQ(file_commands_.size(), superseded_.size());
+  size_t live_size = 0;
+  for (size_t i = 0; i < file_commands_.size(); ++i) {
+    if (!superseded_[i]) {
+      live_size += sizeof(size_type) + sizeof(id_type) +
+          file_commands_[i]->size();
+    }
+  }
+  // Compacting a file which would not shrink by a quarter isn't worth the
+  // writes. Wait for it to double again.
+  if (live_size * 4 > file_size_ * 3) {
+    compacted_size_ = file_size_;
+    superseded_.clear();
+    return;
+  }
+
+  compaction_file_.reset(OpenAndWriteHeader(GetCompactionPath()));
+  if (!compaction_file_.get()) {
+    compacted_size_ = file_size_;
+    superseded_.clear();
+    return;
+  }
+  compaction_command_count_ = file_commands_.size();
+  compaction_position_ = 0;
+  compaction_file_size_ = sizeof(FileHeader);
+  ContinueCompaction();
+}
+
+void SessionBackend::ContinueCompaction() {
+  std::vector<SessionCommand*> slice;
+  size_t slice_size = 0;
+  while (compaction_position_ < compaction_command_count_ &&
+         slice_size < compaction_slice_size_) {
+    if (!superseded_[compaction_position_]) {
+      SessionCommand* command = file_commands_[compaction_position_];
+      slice.push_back(command);
+      slice_size += sizeof(size_type) + sizeof(id_type) + command->size();
+    }
+    ++compaction_position_;
+  }
+  if (!AppendCommandsToFile(compaction_file_.get(), slice)) {
+    AbortCompaction();
+    return;
+  }
+  compaction_file_size_ += slice_size;
+  compaction_bytes_ += slice_size;
+  if (compaction_position_ == compaction_command_count_)
+    FinishCompaction();
+}
+
+void SessionBackend::FinishCompaction() {
+  // The commands appended while compacting follow the compacted ones as they
+  // are. They are filtered by the next compaction.
+  std::vector<SessionCommand*> appended_commands(
+      file_commands_.begin() + compaction_command_count_,
+      file_commands_.end());
+  if (!AppendCommandsToFile(compaction_file_.get(), appended_commands)) {
+    AbortCompaction();
+    return;
+  }
+  const size_t appended_size = GetCommandsFileSize(appended_commands);
+  compaction_file_size_ += appended_size;
+  compaction_bytes_ += appended_size;
+
+  compaction_file_.reset(NULL);
+  current_session_file_.reset(NULL);
+  const base::FilePath current_session_path = GetCurrentSessionPath();
+  const bool moved = base::Move(GetCompactionPath(), current_session_path);
+  current_session_file_.reset(OpenForAppend(current_session_path));
+  if (!moved) {
+    AbortCompaction();
+    return;
+  }
+
+  size_t dropped_count = 0;
+  std::vector<SessionCommand*> compacted_commands;
+  for (size_t i = 0; i < file_commands_.size(); ++i) {
+    if (i < compaction_command_count_ && superseded_[i]) {
+      delete file_commands_[i];
+      ++dropped_count;
+    } else {
+      compacted_commands.push_back(file_commands_[i]);
+    }
+  }
+  // Only SessionService compacts its file.
+  UMA_HISTOGRAM_COUNTS("SessionRestore.compaction_size",
+                       static_cast<int>(compaction_bytes_ / 1024));
+  UMA_HISTOGRAM_PERCENTAGE(
+      "SessionRestore.compaction_dropped_commands",
+      static_cast<int>(dropped_count * 100 / compaction_command_count_));
+  if (appended_bytes_ > 0) {
+    // The bytes written to the file per byte of commands appended, in
+    // percent.
+    UMA_HISTOGRAM_CUSTOM_COUNTS(
+        "SessionRestore.write_amplification",
+        static_cast<int>((appended_bytes_ + compaction_bytes_) * 100 /
+                         appended_bytes_),
+        100, 1000, 50);
+  }
+
+  file_commands_.swap(compacted_commands);
+  file_size_ = compaction_file_size_;
+  compacted_size_ = file_size_;
+  appended_bytes_ = 0;
+  compaction_bytes_ = 0;
+  superseded_.clear();
+}
+
+void SessionBackend::AbortCompaction() {
+  if (compaction_filter_.is_null())
+    return;
+  compaction_file_.reset(NULL);
+  superseded_.clear();
+  base::DeleteFile(GetCompactionPath(), false);
+  // Wait for the file to double again before retrying.
+  compacted_size_ = file_size_;
+}
+
 SessionBackend::~SessionBackend() {
-  if (current_session_file_.get()) {
+  if (current_session_file_.get() || compaction_file_.get()) {
     // Destructor performs file IO because file is open in sync mode.
     // crbug.com/112512.
     base::ThreadRestrictions::ScopedAllowIO allow_io;
     current_session_file_.reset();
+    compaction_file_.reset();
   }
+  STLDeleteElements(&file_commands_);
 }
 
 void SessionBackend::ResetFile() {
@@ -368,6 +504,12 @@ void SessionBackend::ResetFile() {
   if (!current_session_file_.get())
     current_session_file_.reset(OpenAndWriteHeader(GetCurrentSessionPath()));
   empty_file_ = true;
+  AbortCompaction();
+  STLDeleteElements(&file_commands_);
+  file_size_ = sizeof(FileHeader);
+  compacted_size_ = file_size_;
+  appended_bytes_ = 0;
+  compaction_bytes_ = 0;
 }
 
 net::FileStream* SessionBackend::OpenAndWriteHeader(
@@ -388,6 +530,17 @@ net::FileStream* SessionBackend::OpenAndWriteHeader(
   return file.release();
 }
 
+net::FileStream* SessionBackend::OpenForAppend(const base::FilePath& path) {
+  scoped_ptr<net::FileStream> file(new net::FileStream(NULL));
+  if (file->OpenSync(path, base::PLATFORM_FILE_OPEN |
+      base::PLATFORM_FILE_WRITE | base::PLATFORM_FILE_EXCLUSIVE_WRITE |
+      base::PLATFORM_FILE_EXCLUSIVE_READ) != net::OK)
+    return NULL;
+  if (file->SeekSync(net::FROM_END, 0) < 0)
+    return NULL;
+  return file.release();
+}
+
 base::FilePath SessionBackend::GetLastSessionPath() {
   base::FilePath path = path_to_dir_;
   if (type_ == BaseSessionService::TAB_RESTORE)
@@ -405,3 +558,12 @@ base::FilePath SessionBackend::GetCurrentSessionPath() {
     path = path.AppendASCII(kCurrentSessionFileName);
   return path;
 }
+
+base::FilePath SessionBackend::GetCompactionPath() {
+  base::FilePath path = path_to_dir_;
+  if (type_ == BaseSessionService::TAB_RESTORE)
+    path = path.AppendASCII(kCompactingTabSessionFileName);
+  else
+    path = path.AppendASCII(kCompactingSessionFileName);
+  return path;
+}
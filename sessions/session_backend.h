@@ -7,6 +7,7 @@
 
 #include <vector>
 
+#include "base/callback.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/task/cancelable_task_tracker.h"
@@ -30,14 +31,32 @@ class FileStream;
 // BaseSessionService. A command consists of a unique id and a stream of bytes.
 // SessionBackend does not use the id in anyway, that is used by
 // BaseSessionService.
+//
+// If the service supplies a CompactionFilter, the current file is compacted
+// in the background once it has doubled in size since it was last reset or
+// compacted: the commands the filter finds superseded are dropped, and the
+// rest are written to a new file a slice at a time, each slice following the
+// commands of one AppendCommands() call. The new file then replaces the
+// current file. As a compaction writes at most the size of the file, and the
+// commands appended since the last one are at least half of it, compaction
+// writes at most twice the bytes the service appends.
 class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
  public:
   typedef SessionCommand::id_type id_type;
   typedef SessionCommand::size_type size_type;
 
-  // Initial size of the buffer used in reading the file. This is exposed
-  // for testing.
-  static const int kFileReadBufferSize;
+  // Sets |superseded| to whether each of |commands|, which are in the order
+  // they were written, is superseded by a later command and can be dropped
+  // without changing the session the commands restore. Run on the backend
+  // thread.
+  typedef base::Callback<void(const std::vector<SessionCommand*>& commands,
+                              std::vector<bool>* superseded)>
+      CompactionFilter;
+
+  // The size the current file must reach before it is first compacted, and
+  // the bytes of commands a compaction writes per AppendCommands() call.
+  static const size_t kMinCompactionSize;
+  static const size_t kCompactionSliceSize;
 
   // Creates a SessionBackend. This method is invoked on the MAIN thread,
   // and does no IO. The real work is done from Init, which is invoked on
@@ -49,6 +68,17 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   SessionBackend(BaseSessionService::SessionType type,
                  const base::FilePath& path_to_dir);
 
+  // Enables compaction of the current file with |filter|. Must be called
+  // before any command is appended.
+  void set_compaction_filter(const CompactionFilter& filter) {
+    compaction_filter_ = filter;
+  }
+
+  void set_compaction_sizes_for_testing(size_t min_size, size_t slice_size) {
+    min_compaction_size_ = min_size;
+    compaction_slice_size_ = slice_size;
+  }
+
   // Moves the current file to the last file, and recreates the current file.
   //
   // NOTE: this is invoked before every command, and does nothing if we've
@@ -107,6 +137,29 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   // the file is returned.
   net::FileStream* OpenAndWriteHeader(const base::FilePath& path);
 
+  // Opens the existing file at |path| to append commands to it. On success a
+  // handle to the file is returned.
+  net::FileStream* OpenForAppend(const base::FilePath& path);
+
+  // Starts compacting the current file if it has grown enough, or continues
+  // the compaction in progress.
+  void MaybeCompact();
+
+  // Runs the filter over file_commands_ and starts writing the commands which
+  // are not superseded to the compaction file.
+  void StartCompaction();
+
+  // Writes the next slice of the commands which are not superseded, and
+  // finishes the compaction after the last one.
+  void ContinueCompaction();
+
+  // Appends the commands appended since the compaction started, and replaces
+  // the current file with the compaction file.
+  void FinishCompaction();
+
+  // Stops the compaction in progress, if any, and deletes the compaction file.
+  void AbortCompaction();
+
   // Appends the specified commands to the specified file.
   bool AppendCommandsToFile(net::FileStream* file,
                             const std::vector<SessionCommand*>& commands);
@@ -119,6 +172,9 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   // Returns the path to the current file.
   base::FilePath GetCurrentSessionPath();
 
+  // Returns the path to the file the current file is compacted to.
+  base::FilePath GetCompactionPath();
+
   // Directory files are relative to.
   const base::FilePath path_to_dir_;
 
@@ -135,6 +191,38 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   // If true, the file is empty (no commands have been added to it).
   bool empty_file_;
 
+  CompactionFilter compaction_filter_;
+  size_t min_compaction_size_;
+  size_t compaction_slice_size_;
+
+  // The commands in the current file, in order. Only kept if there is a
+  // compaction filter, so that compacting never reads the file back.
+  std::vector<SessionCommand*> file_commands_;
+
+  // The size of the current file, and its size after it was last reset or
+  // compacted.
+  size_t file_size_;
+  size_t compacted_size_;
+
+  // The bytes of commands appended, and written by compactions, since the
+  // last compaction finished. Used to report write amplification.
+  size_t appended_bytes_;
+  size_t compaction_bytes_;
+
+  // The file being compacted to, NULL if no compaction is in progress.
+  scoped_ptr<net::FileStream> compaction_file_;
+
+  // Whether each of the first |compaction_command_count_| file_commands_,
+  // which were in the file when the compaction started, is superseded.
+  std::vector<bool> superseded_;
+  size_t compaction_command_count_;
+
+  // Index in file_commands_ of the next command to compact.
+  size_t compaction_position_;
+
+  // The size of the compaction file.
+  size_t compaction_file_size_;
+
   DISALLOW_COPY_AND_ASSIGN(SessionBackend);
 };
 
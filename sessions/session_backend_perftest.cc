@@ -0,0 +1,105 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/files/scoped_temp_dir.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/pickle.h"
+#include "base/stl_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/sessions/session_backend.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace {
+
+typedef std::vector<SessionCommand*> SessionCommands;
+
+// Navigations recorded for each tab.
+const int kNavigationsPerTab = 50;
+
+// Size of the page state recorded for each navigation, which dominates the
+// size of UpdateTabNavigation commands.
+const size_t kPageStateSize = 400;
+
+// Id of the commands written, as for SessionService's UpdateTabNavigation.
+const SessionCommand::id_type kCommandUpdateTabNavigation = 6;
+
+// Creates a command shaped like an UpdateTabNavigation command.
+SessionCommand* CreateNavigationCommand(int tab_id, int index) {
+  const std::string number = base::IntToString(index);
+  Pickle pickle;
+  pickle.WriteInt(tab_id);
+  pickle.WriteInt(index);
+  pickle.WriteString("http://www.example.com/tab" + base::IntToString(tab_id) +
+                     "/page" + number);
+  pickle.WriteString("Title of page " + number);
+  pickle.WriteString(std::string(kPageStateSize, 'p'));
+  pickle.WriteInt(0);
+  return new SessionCommand(kCommandUpdateTabNavigation, pickle);
+}
+
+// Records a session of |tab_count| tabs to |path|. The next backend created
+// for |path| reads it as the last session.
+void RecordSession(const base::FilePath& path, int tab_count) {
+  scoped_refptr<SessionBackend> backend(
+      new SessionBackend(BaseSessionService::SESSION_RESTORE, path));
+  for (int tab_id = 0; tab_id < tab_count; ++tab_id) {
+    SessionCommands* commands = new SessionCommands;
+    for (int i = 0; i < kNavigationsPerTab; ++i)
+      commands->push_back(CreateNavigationCommand(tab_id, i));
+    backend->AppendCommands(commands, false);
+  }
+}
+
+void RunRestore(int tab_count) {
+  const std::string trace = base::IntToString(tab_count) + "_tabs";
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  RecordSession(temp_dir.path(), tab_count);
+
+  scoped_refptr<SessionBackend> backend(
+      new SessionBackend(BaseSessionService::SESSION_RESTORE,
+                         temp_dir.path()));
+  SessionCommands commands;
+  base::TimeTicks start = base::TimeTicks::Now();
+  ASSERT_TRUE(backend->ReadLastSessionCommandsImpl(&commands));
+  perf_test::PrintResult("session_restore_read", "", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+  ASSERT_EQ(static_cast<size_t>(tab_count * kNavigationsPerTab),
+            commands.size());
+
+  // Reads each command back the way SessionService restores navigations.
+  start = base::TimeTicks::Now();
+  for (size_t i = 0; i < commands.size(); ++i) {
+    scoped_ptr<Pickle> pickle(commands[i]->PayloadAsPickle());
+    PickleIterator iterator(*pickle);
+    int tab_id;
+    int index;
+    std::string url;
+    ASSERT_TRUE(pickle->ReadInt(&iterator, &tab_id));
+    ASSERT_TRUE(pickle->ReadInt(&iterator, &index));
+    ASSERT_TRUE(pickle->ReadString(&iterator, &url));
+  }
+  perf_test::PrintResult("session_restore_parse", "", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+
+  start = base::TimeTicks::Now();
+  STLDeleteElements(&commands);
+  perf_test::PrintResult("session_restore_free", "", trace,
+                         (base::TimeTicks::Now() - start).InMillisecondsF(),
+                         "ms", true);
+}
+
+}  // namespace
+
+TEST(SessionBackendPerfTest, Restore) {
+  RunRestore(100);
+  RunRestore(500);
+}
@@ -2,6 +2,9 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <map>
+
+#include "base/bind.h"
 #include "base/file_util.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/stl_util.h"
@@ -28,6 +31,21 @@ SessionCommand* CreateCommandFromData(const TestData& data) {
   return command;
 }
 
+// A SessionBackend::CompactionFilter which finds the commands followed by a
+// later command with the same id.
+void FindCommandsWithLaterID(const std::vector<SessionCommand*>& commands,
+                             std::vector<bool>* superseded) {
+  superseded->assign(commands.size(), false);
+  std::map<SessionCommand::id_type, size_t> last_commands;
+  for (size_t i = 0; i < commands.size(); ++i) {
+    std::map<SessionCommand::id_type, size_t>::iterator last =
+        last_commands.find(commands[i]->id());
+    if (last != last_commands.end())
+      (*superseded)[last->second] = true;
+    last_commands[commands[i]->id()] = i;
+  }
+}
+
 }  // namespace
 
 class SessionBackendTest : public testing::Test {
@@ -128,8 +146,7 @@ TEST_F(SessionBackendTest, BigData) {
       new SessionBackend(BaseSessionService::SESSION_RESTORE, path_));
   std::vector<SessionCommand*> commands;
   commands.push_back(CreateCommandFromData(data[0]));
-  const SessionCommand::size_type big_size =
-      SessionBackend::kFileReadBufferSize + 100;
+  const SessionCommand::size_type big_size = 4096 + 100;
   const SessionCommand::id_type big_id = 50;
   SessionCommand* big_command = new SessionCommand(big_id, big_size);
   reinterpret_cast<char*>(big_command->contents())[0] = 'a';
@@ -201,3 +218,108 @@ TEST_F(SessionBackendTest, Truncate) {
 
   STLDeleteElements(&commands);
 }
+
+// Writes commands and drops the end of the last one, as if the browser
+// crashed while writing it. The complete commands are still read back.
+TEST_F(SessionBackendTest, TruncatedCommand) {
+  struct TestData data[] = {
+    { 1,  "a" },
+    { 2,  "abcdefgh" },
+  };
+  scoped_refptr<SessionBackend> backend(
+      new SessionBackend(BaseSessionService::SESSION_RESTORE, path_));
+  std::vector<SessionCommand*> commands;
+  for (size_t i = 0; i < arraysize(data); ++i)
+    commands.push_back(CreateCommandFromData(data[i]));
+  backend->AppendCommands(new SessionCommands(commands), false);
+  commands.clear();
+  backend = NULL;
+
+  const base::FilePath file_path = path_.AppendASCII("Current Session");
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(file_path, &contents));
+  contents.resize(contents.size() - 2);
+  ASSERT_EQ(static_cast<int>(contents.size()),
+            file_util::WriteFile(file_path, contents.data(),
+                                 static_cast<int>(contents.size())));
+
+  backend = new SessionBackend(BaseSessionService::SESSION_RESTORE, path_);
+  EXPECT_TRUE(backend->ReadLastSessionCommandsImpl(&commands));
+  ASSERT_EQ(1U, commands.size());
+  AssertCommandEqualsData(data[0], commands[0]);
+  STLDeleteElements(&commands);
+}
+
+// The contents of the commands read are aligned as PayloadAsPickle() needs,
+// whatever the sizes of the commands before them.
+TEST_F(SessionBackendTest, AlignedContents) {
+  struct TestData data[] = {
+    { 1,  "a" },
+    { 2,  "abc" },
+    { 3,  "" },
+    { 4,  "abcde" },
+  };
+  scoped_refptr<SessionBackend> backend(
+      new SessionBackend(BaseSessionService::SESSION_RESTORE, path_));
+  std::vector<SessionCommand*> commands;
+  for (size_t i = 0; i < arraysize(data); ++i)
+    commands.push_back(CreateCommandFromData(data[i]));
+  backend->AppendCommands(new SessionCommands(commands), false);
+  commands.clear();
+
+  backend = NULL;
+  backend = new SessionBackend(BaseSessionService::SESSION_RESTORE, path_);
+  backend->ReadLastSessionCommandsImpl(&commands);
+  ASSERT_EQ(arraysize(data), commands.size());
+  for (size_t i = 0; i < commands.size(); ++i) {
+    AssertCommandEqualsData(data[i], commands[i]);
+    EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(commands[i]->contents()) %
+                  sizeof(uint32));
+  }
+  STLDeleteElements(&commands);
+}
+
+// Appends commands most of which later ones supersede, one per call, until
+// the file has been compacted a few times. Each compaction is written over a
+// few calls.
+TEST_F(SessionBackendTest, Compaction) {
+  scoped_refptr<SessionBackend> backend(
+      new SessionBackend(BaseSessionService::SESSION_RESTORE, path_));
+  backend->set_compaction_filter(base::Bind(&FindCommandsWithLaterID));
+  backend->set_compaction_sizes_for_testing(1024, 256);
+
+  const int kCommandCount = 100;
+  const int kIDCount = 4;
+  std::map<SessionCommand::id_type, std::string> last_data;
+  for (int i = 0; i < kCommandCount; ++i) {
+    TestData data = { static_cast<SessionCommand::id_type>(i % kIDCount),
+                      std::string(97, static_cast<char>('a' + i % 26)) };
+    last_data[data.command_id] = data.data;
+    SessionCommands* commands = new SessionCommands;
+    commands->push_back(CreateCommandFromData(data));
+    backend->AppendCommands(commands, false);
+  }
+
+  SessionCommands commands;
+  ASSERT_TRUE(backend->ReadCurrentSessionCommandsImpl(&commands));
+  EXPECT_LT(commands.size(), static_cast<size_t>(kCommandCount / 2));
+  std::map<SessionCommand::id_type, std::string> read_data;
+  for (size_t i = 0; i < commands.size(); ++i) {
+    read_data[commands[i]->id()] =
+        std::string(commands[i]->contents(), commands[i]->size());
+  }
+  EXPECT_TRUE(last_data == read_data);
+  STLDeleteElements(&commands);
+
+  // Resetting the file stops compacting it.
+  backend->MoveCurrentSessionToLastSession();
+  EXPECT_FALSE(base::PathExists(path_.AppendASCII("Compacting Session")));
+  ASSERT_TRUE(backend->ReadLastSessionCommandsImpl(&commands));
+  read_data.clear();
+  for (size_t i = 0; i < commands.size(); ++i) {
+    read_data[commands[i]->id()] =
+        std::string(commands[i]->contents(), commands[i]->size());
+  }
+  EXPECT_TRUE(last_data == read_data);
+  STLDeleteElements(&commands);
+}
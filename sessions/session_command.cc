@@ -6,24 +6,65 @@
 
 #include "chrome/browser/sessions/session_command.h"
 
+#include "base/logging.h"
 #include "base/pickle.h"
 
+namespace {
+
+// Pickle reads its header and fields through aligned pointers.
+const size_t kArenaAlignment = sizeof(uint32);
+
+}  // namespace
+
+SessionCommandArena::SessionCommandArena(size_t capacity)
+    : data_(new char[capacity]),
+      capacity_(capacity),
+      used_(0) {
+}
+
+char* SessionCommandArena::Allocate(size_t size) {
+  const size_t offset =
+      (used_ + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+  CHECK_LE(offset + size, capacity_);
+  used_ = offset + size;
+  return data_.get() + offset;
+}
+
+SessionCommandArena::~SessionCommandArena() {
+}
+
 SessionCommand::SessionCommand(id_type id, size_type size)
     : id_(id),
-      contents_(size, 0) {
+      contents_(size, 0),
+      data_(const_cast<char*>(contents_.c_str())),
+      size_(size) {
 }
 
 SessionCommand::SessionCommand(id_type id, const Pickle& pickle)
     : id_(id),
-      contents_(pickle.size(), 0) {
+      contents_(pickle.size(), 0),
+      data_(const_cast<char*>(contents_.c_str())),
+      size_(static_cast<size_type>(pickle.size())) {
   DCHECK(pickle.size() < std::numeric_limits<size_type>::max());
   memcpy(contents(), pickle.data(), pickle.size());
 }
 
+SessionCommand::SessionCommand(id_type id,
+                               size_type size,
+                               SessionCommandArena* arena)
+    : id_(id),
+      arena_(arena),
+      data_(arena->Allocate(size)),
+      size_(size) {
+}
+
+SessionCommand::~SessionCommand() {
+}
+
 bool SessionCommand::GetPayload(void* dest, size_t count) const {
   if (size() != count)
     return false;
-  memcpy(dest, &(contents_[0]), count);
+  memcpy(dest, contents(), count);
   return true;
 }
 
@@ -8,9 +8,39 @@
 #include <string>
 
 #include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
 
 class Pickle;
 
+// SessionCommandArena holds the contents of the SessionCommands read from one
+// session file in a single block, so that reading a file with thousands of
+// commands does not allocate a buffer per command. The block is freed once
+// the last SessionCommand allocated from it is deleted.
+class SessionCommandArena
+    : public base::RefCountedThreadSafe<SessionCommandArena> {
+ public:
+  // Creates an arena of |capacity| bytes.
+  explicit SessionCommandArena(size_t capacity);
+
+  // Returns |size| bytes aligned as the contents of a Pickle.
+  char* Allocate(size_t size);
+
+  size_t capacity() const { return capacity_; }
+  size_t used() const { return used_; }
+
+ private:
+  friend class base::RefCountedThreadSafe<SessionCommandArena>;
+
+  ~SessionCommandArena();
+
+  scoped_ptr<char[]> data_;
+  const size_t capacity_;
+  size_t used_;
+
+  DISALLOW_COPY_AND_ASSIGN(SessionCommandArena);
+};
+
 // SessionCommand contains a command id and arbitrary chunk of data. The id
 // and chunk of data are specific to the service creating them.
 //
@@ -38,15 +68,21 @@ class SessionCommand {
   // id whose contents is populated from the contents of pickle.
   SessionCommand(id_type id, const Pickle& pickle);
 
+  // Creates a session command with the specified id whose buffer of size
+  // |size| is allocated from |arena|. The command keeps |arena| alive.
+  SessionCommand(id_type id, size_type size, SessionCommandArena* arena);
+
+  ~SessionCommand();
+
   // The contents of the command.
-  char* contents() { return const_cast<char*>(contents_.c_str()); }
-  const char* contents() const { return contents_.c_str(); }
+  char* contents() { return data_; }
+  const char* contents() const { return data_; }
 
   // Identifier for the command.
   id_type id() const { return id_; }
 
   // Size of data.
-  size_type size() const { return static_cast<size_type>(contents_.size()); }
+  size_type size() const { return size_; }
 
   // Convenience for extracting the data to a target. Returns false if
   // count is not equal to the size of data this command contains.
@@ -60,8 +96,16 @@ class SessionCommand {
 
  private:
   const id_type id_;
+
+  // The contents of commands which are not allocated from an arena.
   std::string contents_;
 
+  scoped_refptr<SessionCommandArena> arena_;
+
+  // Points into either |contents_| or |arena_|.
+  char* data_;
+  const size_type size_;
+
   DISALLOW_COPY_AND_ASSIGN(SessionCommand);
 };
 
@@ -83,8 +83,10 @@ static const SessionCommand::id_type kCommandSetTabUserAgentOverride = 18;
 static const SessionCommand::id_type kCommandSessionStorageAssociated = 19;
 static const SessionCommand::id_type kCommandSetActiveWindow = 20;
 
-// Every kWritesPerReset commands triggers recreating the file.
-static const int kWritesPerReset = 250;
+// Every kWritesPerReset commands triggers recreating the file. In between
+// SessionBackend compacts the file, which keeps the navigation updates that
+// make up most of it from piling up.
+static const int kWritesPerReset = 2500;
 
 namespace {
 
@@ -522,6 +524,9 @@ void SessionService::Save() {
 }
 
 void SessionService::Init() {
+  backend()->set_compaction_filter(
+      base::Bind(&SessionService::FindSupersededCommands));
+
   // Register for the notifications we're interested in.
   registrar_.Add(this, content::NOTIFICATION_NAV_LIST_PRUNED,
                  content::NotificationService::AllSources());
@@ -1473,6 +1478,47 @@ bool SessionService::ReplacePendingCommand(SessionCommand* command) {
   return false;
 }
 
+// static
+void SessionService::FindSupersededCommands(
+    const std::vector<SessionCommand*>& commands,
+    std::vector<bool>* superseded) {
+  superseded->assign(commands.size(), false);
+  // Navigations are identified by their tab, index and the number of times
+  // the tab was pruned from the front before them.
+  typedef std::pair<SessionID::id_type, std::pair<int, int> > NavigationKey;
+  std::map<SessionID::id_type, int> front_prune_counts;
+  std::map<NavigationKey, size_t> last_updates;
+  for (size_t i = 0; i < commands.size(); ++i) {
+    const SessionCommand* command = commands[i];
+    if (command->id() == kCommandTabNavigationPathPrunedFromFront) {
+      TabNavigationPathPrunedFromFrontPayload payload;
+      if (command->GetPayload(&payload, sizeof(payload)))
+        front_prune_counts[payload.id]++;
+      continue;
+    }
+    if (command->id() != kCommandUpdateTabNavigation)
+      continue;
+    scoped_ptr<Pickle> pickle(command->PayloadAsPickle());
+    PickleIterator iterator(*pickle);
+    SessionID::id_type tab_id;
+    int nav_index;
+    if (!pickle->ReadInt(&iterator, &tab_id) ||
+        !pickle->ReadInt(&iterator, &nav_index)) {
+      continue;
+    }
+    const NavigationKey key(
+        tab_id, std::make_pair(nav_index, front_prune_counts[tab_id]));
+    std::map<NavigationKey, size_t>::iterator last_update =
+        last_updates.find(key);
+    if (last_update != last_updates.end()) {
+      (*superseded)[last_update->second] = true;
+      last_update->second = i;
+    } else {
+      last_updates[key] = i;
+    }
+  }
+}
+
 void SessionService::ScheduleCommand(SessionCommand* command) {
   DCHECK(command);
   if (ReplacePendingCommand(command))
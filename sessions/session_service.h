@@ -51,9 +51,10 @@ class WebContents;
 // SessionService itself maintains a set of SessionCommands that allow
 // SessionService to rebuild the open state of the browser (as SessionWindow,
 // SessionTab and SerializedNavigationEntry). The commands are periodically
-// flushed to SessionBackend and written to a file. Every so often
-// SessionService rebuilds the contents of the file from the open state of the
-// browser.
+// flushed to SessionBackend and written to a file. SessionBackend compacts
+// the file in the background, dropping navigation updates which later ones
+// supersede, and every so often SessionService rebuilds the contents of the
+// file from the open state of the browser.
 class SessionService : public BaseSessionService,
                        public BrowserContextKeyedService,
                        public content::NotificationObserver,
@@ -205,6 +206,7 @@ class SessionService : public BaseSessionService,
   // Allow tests to access our innards for testing purposes.
   FRIEND_TEST_ALL_PREFIXES(SessionServiceTest, RestoreActivation1);
   FRIEND_TEST_ALL_PREFIXES(SessionServiceTest, RestoreActivation2);
+  FRIEND_TEST_ALL_PREFIXES(SessionServiceTest, CompactionFilter);
   FRIEND_TEST_ALL_PREFIXES(NoStartupWindowTest, DontInitSessionServiceForApps);
 
   typedef std::map<SessionID::id_type, std::pair<int, int> > IdToRange;
@@ -386,6 +388,14 @@ class SessionService : public BaseSessionService,
   // the pending commands and true is returned.
   bool ReplacePendingCommand(SessionCommand* command);
 
+  // The SessionBackend::CompactionFilter for the session file. An
+  // UpdateTabNavigation command is superseded by a later one for the same tab
+  // and index, unless the tab was pruned from the front in between, which
+  // shifts the indices of its navigations.
+  static void FindSupersededCommands(
+      const std::vector<SessionCommand*>& commands,
+      std::vector<bool>* superseded);
+
   // Schedules the specified command. This method takes ownership of the
   // command.
   virtual void ScheduleCommand(SessionCommand* command) OVERRIDE;
@@ -85,6 +85,16 @@ class SessionServiceTest : public BrowserWithTestWindowTest,
     }
   }
 
+  // Updates the navigation at |index| of |tab_id| to |url|.
+  void UpdateNavigationWithIndex(const SessionID& tab_id,
+                                 int index,
+                                 const std::string& url) {
+    SerializedNavigationEntry nav =
+        SerializedNavigationEntryTestHelper::CreateNavigation(url, "a");
+    nav.set_index(index);
+    UpdateNavigation(window_id, tab_id, nav, false);
+  }
+
   void ReadWindows(std::vector<SessionWindow*>* windows,
                    SessionID::id_type* active_window_id) {
     // Forces closing the file.
@@ -939,6 +949,51 @@ TEST_F(SessionServiceTest, ReplacePendingNavigationAndPrune) {
             windows[0]->tabs[0]->navigations[0].virtual_url());
 }
 
+// The compaction filter drops navigation updates which later ones replace,
+// but not those whose indices were shifted by pruning from the front.
+TEST_F(SessionServiceTest, CompactionFilter) {
+  const std::string base_url("http://google.com/");
+  SessionID tab1_id;
+  SessionID tab2_id;
+  helper_.PrepareTabInWindow(window_id, tab1_id, 0, true);
+  helper_.PrepareTabInWindow(window_id, tab2_id, 1, false);
+
+  UpdateNavigationWithIndex(tab1_id, 0, base_url + "a0");
+  UpdateNavigationWithIndex(tab2_id, 0, base_url + "b0");
+  UpdateNavigationWithIndex(tab1_id, 1, base_url + "a1");
+  service()->TabNavigationPathPrunedFromFront(window_id, tab1_id, 1);
+  UpdateNavigationWithIndex(tab2_id, 0, base_url + "b1");
+  UpdateNavigationWithIndex(tab1_id, 1, base_url + "a2");
+
+  // Drop the superseded commands before they are written.
+  std::vector<SessionCommand*>& commands = service()->pending_commands();
+  std::vector<bool> superseded;
+  SessionService::FindSupersededCommands(commands, &superseded);
+  ASSERT_EQ(commands.size(), superseded.size());
+  std::vector<SessionCommand*> live_commands;
+  for (size_t i = 0; i < commands.size(); ++i) {
+    if (superseded[i])
+      delete commands[i];
+    else
+      live_commands.push_back(commands[i]);
+  }
+  EXPECT_EQ(commands.size() - 1, live_commands.size());
+  commands.swap(live_commands);
+
+  ScopedVector<SessionWindow> windows;
+  ReadWindows(&(windows.get()), NULL);
+
+  ASSERT_EQ(1U, windows.size());
+  ASSERT_EQ(2U, windows[0]->tabs.size());
+  SessionTab* tab1 = windows[0]->tabs[0];
+  ASSERT_EQ(2U, tab1->navigations.size());
+  EXPECT_EQ(GURL(base_url + "a1"), tab1->navigations[0].virtual_url());
+  EXPECT_EQ(GURL(base_url + "a2"), tab1->navigations[1].virtual_url());
+  SessionTab* tab2 = windows[0]->tabs[1];
+  ASSERT_EQ(1U, tab2->navigations.size());
+  EXPECT_EQ(GURL(base_url + "b1"), tab2->navigations[0].virtual_url());
+}
+
 TEST_F(SessionServiceTest, RestoreActivation1) {
   SessionID window2_id;
   SessionID tab1_id;
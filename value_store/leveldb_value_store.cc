@@ -23,6 +23,35 @@ namespace {
 
 const char kInvalidJson[] = "Invalid JSON";
 
+// Values are stored as JSON, except for BinaryValues, which JSON cannot hold.
+// The bytes of those are stored as they are after kBinaryValueMarker, which
+// JSON never starts with. Older versions read such values as invalid JSON, so
+// BinaryValues must only be stored under keys which they do not read.
+const char kBinaryValueMarker = '\0';
+
+std::string SerializeValue(const base::Value& value) {
+  std::string serialized;
+  if (value.IsType(base::Value::TYPE_BINARY)) {
+    const base::BinaryValue& binary =
+        static_cast<const base::BinaryValue&>(value);
+    serialized.reserve(1 + binary.GetSize());
+    serialized.push_back(kBinaryValueMarker);
+    serialized.append(binary.GetBuffer(), binary.GetSize());
+  } else {
+    base::JSONWriter::Write(&value, &serialized);
+  }
+  return serialized;
+}
+
+// Returns NULL if |serialized| is not valid JSON.
+base::Value* DeserializeValue(const leveldb::Slice& serialized) {
+  if (!serialized.empty() && serialized[0] == kBinaryValueMarker) {
+    return base::BinaryValue::CreateWithCopiedBuffer(serialized.data() + 1,
+                                                     serialized.size() - 1);
+  }
+  return base::JSONReader().ReadToValue(serialized.ToString());
+}
+
 // Scoped leveldb snapshot which releases the snapshot on destruction.
 class ScopedSnapshot {
  public:
@@ -137,7 +166,6 @@ ValueStore::ReadResult LeveldbValueStore::Get() {
   if (open_error)
     return MakeReadResult(open_error.Pass());
 
-  base::JSONReader json_reader;
   leveldb::ReadOptions options = leveldb::ReadOptions();
   // All interaction with the db is done on the same thread, so snapshotting
   // isn't strictly necessary.  This is just defensive.
@@ -148,7 +176,7 @@ ValueStore::ReadResult LeveldbValueStore::Get() {
   scoped_ptr<leveldb::Iterator> it(db_->NewIterator(options));
   for (it->SeekToFirst(); it->Valid(); it->Next()) {
     std::string key = it->key().ToString();
-    base::Value* value = json_reader.ReadToValue(it->value().ToString());
+    base::Value* value = DeserializeValue(it->value());
     if (!value) {
       return MakeReadResult(
           Error::Create(CORRUPTION, kInvalidJson, util::NewKey(key)));
@@ -297,8 +325,8 @@ scoped_ptr<ValueStore::Error> LeveldbValueStore::ReadFromDb(
   DCHECK(BrowserThread::CurrentlyOn(BrowserThread::FILE));
   DCHECK(setting);
 
-  std::string value_as_json;
-  leveldb::Status s = db_->Get(options, key, &value_as_json);
+  std::string serialized_value;
+  leveldb::Status s = db_->Get(options, key, &serialized_value);
 
   if (s.IsNotFound()) {
     // Despite there being no value, it was still a success. Check this first
@@ -309,7 +337,7 @@ scoped_ptr<ValueStore::Error> LeveldbValueStore::ReadFromDb(
   if (!s.ok())
     return ToValueStoreError(s, util::NewKey(key));
 
-  base::Value* value = base::JSONReader().ReadToValue(value_as_json);
+  base::Value* value = DeserializeValue(serialized_value);
   if (!value)
     return Error::Create(CORRUPTION, kInvalidJson, util::NewKey(key));
 
@@ -340,9 +368,7 @@ scoped_ptr<ValueStore::Error> LeveldbValueStore::AddToBatch(
   }
 
   if (write_new_value) {
-    std::string value_as_json;
-    base::JSONWriter::Write(&value, &value_as_json);
-    batch->Put(key, value_as_json);
+    batch->Put(key, SerializeValue(value));
   }
 
   return util::NoError();
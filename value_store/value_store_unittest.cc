@@ -215,6 +215,19 @@ TEST_P(ValueStoreTest, GetWithMultipleValues) {
   EXPECT_PRED_FORMAT2(SettingsEq, *dict12_, storage_->Get());
 }
 
+TEST_P(ValueStoreTest, GetWithBinaryValue) {
+  // Bytes JSON cannot hold, including a leading NUL.
+  const char kBytes[] = "\0\x01\xff{\"foo\"";
+  scoped_ptr<base::BinaryValue> binary(
+      base::BinaryValue::CreateWithCopiedBuffer(kBytes, sizeof(kBytes)));
+  storage_->Set(DEFAULTS, key1_, *binary);
+
+  base::DictionaryValue expected;
+  expected.Set(key1_, binary->DeepCopy());
+  EXPECT_PRED_FORMAT2(SettingsEq, expected, storage_->Get(key1_));
+  EXPECT_PRED_FORMAT2(SettingsEq, expected, storage_->Get());
+}
+
 TEST_P(ValueStoreTest, RemoveWhenEmpty) {
   EXPECT_PRED_FORMAT2(ChangesEq, ValueStoreChangeList(),
                       storage_->Remove(key1_));